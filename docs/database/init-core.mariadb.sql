@@ -6,6 +6,7 @@
 -- License: MIT                                          --
 -- ----------------------------------------------------- --
 
+DROP TABLE IF EXISTS g_cache_invalidation;
 DROP TABLE IF EXISTS g_misc_config;
 DROP TABLE IF EXISTS g_api_key;
 DROP TABLE IF EXISTS g_client_user_scope;
@@ -161,3 +162,12 @@ CREATE TABLE g_misc_config (
 );
 CREATE INDEX i_gmc_type ON g_misc_config(gmc_type);
 CREATE INDEX i_gmc_name ON g_misc_config(gmc_name);
+
+CREATE TABLE g_cache_invalidation (
+  gci_id INT(11) PRIMARY KEY AUTO_INCREMENT,
+  gci_node VARCHAR(32) NOT NULL,
+  gci_cache VARCHAR(128) NOT NULL,
+  gci_key VARCHAR(512),
+  gci_created_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+CREATE INDEX i_gci_created_at ON g_cache_invalidation(gci_created_at);
@@ -6,6 +6,7 @@
 -- License: MIT                                           --
 -- ------------------------------------------------------ --
 
+DROP TABLE IF EXISTS g_cache_invalidation;
 DROP TABLE IF EXISTS g_misc_config;
 DROP TABLE IF EXISTS g_api_key;
 DROP TABLE IF EXISTS g_client_user_scope;
@@ -36,6 +37,7 @@ DROP TABLE IF EXISTS gpg_refresh_token_scope;
 DROP TABLE IF EXISTS gpg_refresh_token;
 DROP TABLE IF EXISTS gpg_code_scope;
 DROP TABLE IF EXISTS gpg_code;
+DROP TABLE IF EXISTS gpo_revocation_job;
 DROP TABLE IF EXISTS gpo_ciba_scope;
 DROP TABLE IF EXISTS gpo_ciba_scheme;
 DROP TABLE IF EXISTS gpo_ciba;
@@ -215,6 +217,15 @@ CREATE TABLE g_misc_config (
 CREATE INDEX i_gmc_type ON g_misc_config(gmc_type);
 CREATE INDEX i_gmc_name ON g_misc_config(gmc_name);
 
+CREATE TABLE g_cache_invalidation (
+  gci_id INT(11) PRIMARY KEY AUTO_INCREMENT,
+  gci_node VARCHAR(32) NOT NULL,
+  gci_cache VARCHAR(128) NOT NULL,
+  gci_key VARCHAR(512),
+  gci_created_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+CREATE INDEX i_gci_created_at ON g_cache_invalidation(gci_created_at);
+
 CREATE TABLE g_client (
   gc_id INT(11) PRIMARY KEY AUTO_INCREMENT,
   gc_client_id VARCHAR(128) NOT NULL UNIQUE,
@@ -682,6 +693,15 @@ CREATE TABLE gpo_ciba_scheme (
   FOREIGN KEY(gpob_id) REFERENCES gpo_ciba(gpob_id) ON DELETE CASCADE
 );
 
+CREATE TABLE gpo_revocation_job (
+  gporj_id INT(11) PRIMARY KEY AUTO_INCREMENT,
+  gporj_plugin_name VARCHAR(256) NOT NULL,
+  gporj_label BLOB,
+  gporj_steps BLOB NOT NULL,
+  gporj_created_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+CREATE INDEX i_gporj_plugin_name ON gpo_revocation_job(gporj_plugin_name);
+
 CREATE TABLE gs_code (
   gsc_id INT(11) PRIMARY KEY AUTO_INCREMENT,
   gsc_mod_name VARCHAR(128) NOT NULL,
@@ -0,0 +1,23 @@
+-- ----------------------------------------------------- --
+-- Upgrade Glewlwyd 2.7.0 2.8.0
+-- Copyright 2021 Nicolas Mora <mail@babelouest.org>     --
+-- License: MIT                                          --
+-- ----------------------------------------------------- --
+
+CREATE TABLE g_cache_invalidation (
+  gci_id INT(11) PRIMARY KEY AUTO_INCREMENT,
+  gci_node VARCHAR(32) NOT NULL,
+  gci_cache VARCHAR(128) NOT NULL,
+  gci_key VARCHAR(512),
+  gci_created_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+CREATE INDEX i_gci_created_at ON g_cache_invalidation(gci_created_at);
+
+CREATE TABLE gpo_revocation_job (
+  gporj_id INT(11) PRIMARY KEY AUTO_INCREMENT,
+  gporj_plugin_name VARCHAR(256) NOT NULL,
+  gporj_label BLOB,
+  gporj_steps BLOB NOT NULL,
+  gporj_created_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+CREATE INDEX i_gporj_plugin_name ON gpo_revocation_job(gporj_plugin_name);
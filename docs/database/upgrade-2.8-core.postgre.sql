@@ -0,0 +1,23 @@
+-- ----------------------------------------------------- --
+-- Upgrade Glewlwyd 2.7.0 2.8.0
+-- Copyright 2021 Nicolas Mora <mail@babelouest.org>     --
+-- License: MIT                                          --
+-- ----------------------------------------------------- --
+
+CREATE TABLE g_cache_invalidation (
+  gci_id SERIAL PRIMARY KEY,
+  gci_node VARCHAR(32) NOT NULL,
+  gci_cache VARCHAR(128) NOT NULL,
+  gci_key VARCHAR(512),
+  gci_created_at TIMESTAMPTZ NOT NULL DEFAULT NOW()
+);
+CREATE INDEX i_gci_created_at ON g_cache_invalidation(gci_created_at);
+
+CREATE TABLE gpo_revocation_job (
+  gporj_id SERIAL PRIMARY KEY,
+  gporj_plugin_name VARCHAR(256) NOT NULL,
+  gporj_label TEXT,
+  gporj_steps TEXT NOT NULL,
+  gporj_created_at TIMESTAMPTZ NOT NULL DEFAULT NOW()
+);
+CREATE INDEX i_gporj_plugin_name ON gpo_revocation_job(gporj_plugin_name);
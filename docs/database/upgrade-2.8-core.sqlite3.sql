@@ -0,0 +1,23 @@
+-- ----------------------------------------------------- --
+-- Upgrade Glewlwyd 2.7.0 2.8.0
+-- Copyright 2021 Nicolas Mora <mail@babelouest.org>     --
+-- License: MIT                                          --
+-- ----------------------------------------------------- --
+
+CREATE TABLE g_cache_invalidation (
+  gci_id INTEGER PRIMARY KEY AUTOINCREMENT,
+  gci_node TEXT NOT NULL,
+  gci_cache TEXT NOT NULL,
+  gci_key TEXT,
+  gci_created_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+CREATE INDEX i_gci_created_at ON g_cache_invalidation(gci_created_at);
+
+CREATE TABLE gpo_revocation_job (
+  gporj_id INTEGER PRIMARY KEY AUTOINCREMENT,
+  gporj_plugin_name TEXT NOT NULL,
+  gporj_label TEXT,
+  gporj_steps TEXT NOT NULL,
+  gporj_created_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+CREATE INDEX i_gporj_plugin_name ON gpo_revocation_job(gporj_plugin_name);
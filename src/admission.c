@@ -0,0 +1,351 @@
+/**
+ *
+ * Glewlwyd SSO Server
+ *
+ * Authentiation server
+ * Users are authenticated via various backend available: database, ldap
+ * Using various authentication methods available: password, OTP, send code, etc.
+ *
+ * Admission control functions definitions
+ *
+ * Copyright 2016-2021 Nicolas Mora <mail@babelouest.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU GENERAL PUBLIC LICENSE
+ * License as published by the Free Software Foundation;
+ * version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU GENERAL PUBLIC LICENSE for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+
+#include "glewlwyd.h"
+
+/**
+ * Plugin endpoints called by clients rather than by users in a browser,
+ * they must stay available during a login storm or a large admin export
+ */
+static const char * admission_plugin_token_urls[] = {
+  "token",
+  "introspect",
+  "revoke",
+  "userinfo",
+  "jwks",
+  ".well-known",
+  "par",
+  "device_authorization",
+  "ciba/",
+  NULL
+};
+
+/**
+ * Class of the admission slot held by the current thread while a limited callback runs,
+ * and whether the callback has released it with glewlwyd_admission_suspend
+ */
+static __thread struct _glwd_admission_class * admission_thread_class = NULL;
+static __thread int admission_thread_suspended = 0;
+
+/**
+ * Callback registered instead of the endpoint callback when its class is limited
+ */
+struct _glwd_admission_endpoint {
+  struct config_elements       * config;
+  struct _glwd_admission_class * admission_class;
+  unsigned int                   retry_after;
+  int                            count_alloc;
+  int                         (* callback)(const struct _u_request * request, struct _u_response * response, void * user_data);
+  void                         * user_data;
+};
+
+static int admission_acquire(struct _glwd_admission_class * admission_class) {
+  struct timespec deadline;
+  int ret, wait_ret = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += admission_class->queue_timeout / 1000;
+  deadline.tv_nsec += (long)(admission_class->queue_timeout % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  if (!pthread_mutex_lock(&admission_class->lock)) {
+    if (admission_class->active < admission_class->max_concurrent) {
+      admission_class->active++;
+      ret = G_OK;
+    } else if (admission_class->queued >= admission_class->max_queue || !admission_class->queue_timeout) {
+      admission_class->rejected_total++;
+      ret = G_ERROR;
+    } else {
+      admission_class->queued++;
+      admission_class->queued_total++;
+      while (admission_class->active >= admission_class->max_concurrent && wait_ret != ETIMEDOUT) {
+        wait_ret = pthread_cond_timedwait(&admission_class->cond, &admission_class->lock, &deadline);
+      }
+      admission_class->queued--;
+      if (admission_class->active < admission_class->max_concurrent) {
+        admission_class->active++;
+        ret = G_OK;
+      } else {
+        admission_class->rejected_total++;
+        ret = G_ERROR;
+      }
+    }
+    pthread_mutex_unlock(&admission_class->lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "admission_acquire - Error lock");
+    ret = G_ERROR;
+  }
+  return ret;
+}
+
+static void admission_release(struct _glwd_admission_class * admission_class) {
+  if (!pthread_mutex_lock(&admission_class->lock)) {
+    admission_class->active--;
+    pthread_cond_signal(&admission_class->cond);
+    pthread_mutex_unlock(&admission_class->lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "admission_release - Error lock");
+  }
+}
+
+/**
+ * Runs the wrapped callback and adds the allocations it made to its class counters
+ * The users resolved by the callback are shared until it returns,
+ * and the module instances it uses aren't released before
+ */
+static int admission_run_callback(struct _glwd_admission_endpoint * endpoint, const struct _u_request * request, struct _u_response * response) {
+  size_t alloc_count, hit_count, alloc_count_end, hit_count_end;
+  struct _module_epoch_ref epoch;
+  int ret;
+
+  glewlwyd_module_epoch_enter(endpoint->config, &epoch);
+  user_view_scope_begin();
+  if (endpoint->count_alloc) {
+    glewlwyd_alloc_cache_get_counters(&alloc_count, &hit_count);
+    ret = endpoint->callback(request, response, endpoint->user_data);
+    glewlwyd_alloc_cache_get_counters(&alloc_count_end, &hit_count_end);
+    __atomic_add_fetch(&endpoint->admission_class->alloc_total, alloc_count_end-alloc_count, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&endpoint->admission_class->alloc_cache_hit_total, hit_count_end-hit_count, __ATOMIC_RELAXED);
+  } else {
+    ret = endpoint->callback(request, response, endpoint->user_data);
+  }
+  user_view_scope_end();
+  glewlwyd_module_epoch_leave(endpoint->config, &epoch);
+  return ret;
+}
+
+/**
+ * The slot is held while the wrapped callback runs,
+ * so a request going through an authentication callback then an application callback
+ * is admitted once for each of them
+ */
+static int callback_glewlwyd_admission(const struct _u_request * request, struct _u_response * response, void * user_data) {
+  struct _glwd_admission_endpoint * endpoint = (struct _glwd_admission_endpoint *)user_data;
+  char * retry_after;
+  int ret;
+
+  if (!endpoint->admission_class->max_concurrent) {
+    ret = admission_run_callback(endpoint, request, response);
+  } else if (admission_acquire(endpoint->admission_class) == G_OK) {
+    admission_thread_class = endpoint->admission_class;
+    ret = admission_run_callback(endpoint, request, response);
+    admission_thread_class = NULL;
+    if (admission_thread_suspended) {
+      admission_thread_suspended = 0;
+    } else {
+      admission_release(endpoint->admission_class);
+    }
+  } else {
+    y_log_message(Y_LOG_LEVEL_WARNING, "Security - Request %s %s rejected, too many requests in class %s", request->http_verb, request->http_url, endpoint->admission_class->name);
+    retry_after = msprintf("%u", endpoint->retry_after);
+    u_map_put(response->map_header, "Retry-After", retry_after);
+    o_free(retry_after);
+    response->status = 503;
+    ret = U_CALLBACK_COMPLETE;
+  }
+  return ret;
+}
+
+/**
+ * Releases the admission slot held by the current request while it waits for an event,
+ * so the waiting request doesn't keep a slot of its class busy
+ * The webservice thread is still used by the request
+ */
+void glewlwyd_admission_suspend(void) {
+  if (admission_thread_class != NULL && !admission_thread_suspended) {
+    admission_release(admission_thread_class);
+    admission_thread_suspended = 1;
+  }
+}
+
+/**
+ * Takes back the admission slot released by glewlwyd_admission_suspend
+ * The slot is taken even if the class is full, the request only has its response left to build
+ */
+void glewlwyd_admission_resume(void) {
+  if (admission_thread_class != NULL && admission_thread_suspended) {
+    if (!pthread_mutex_lock(&admission_thread_class->lock)) {
+      admission_thread_class->active++;
+      pthread_mutex_unlock(&admission_thread_class->lock);
+      admission_thread_suspended = 0;
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_admission_resume - Error lock");
+    }
+  }
+}
+
+int glewlwyd_admission_init(struct config_elements * config) {
+  static const char * class_names[GLEWLWYD_ADMISSION_CLASS_COUNT] = {"token", "auth", "admin", "static"};
+  pthread_condattr_t condattr;
+  int ret = G_OK, i;
+
+  config->admission_retry_after = GLEWLWYD_DEFAULT_ADMISSION_RETRY_AFTER;
+  pointer_list_init(&config->admission_endpoint_list);
+  if (pthread_mutex_init(&config->admission_endpoint_lock, NULL)) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_admission_init - Error pthread_mutex_init admission_endpoint_lock");
+    ret = G_ERROR;
+  }
+  pthread_condattr_init(&condattr);
+  pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+  for (i=0; i<GLEWLWYD_ADMISSION_CLASS_COUNT && ret == G_OK; i++) {
+    config->admission_class[i].name = class_names[i];
+    config->admission_class[i].max_concurrent = 0;
+    config->admission_class[i].max_queue = 0;
+    config->admission_class[i].queue_timeout = 0;
+    config->admission_class[i].active = 0;
+    config->admission_class[i].queued = 0;
+    config->admission_class[i].queued_total = 0;
+    config->admission_class[i].rejected_total = 0;
+    config->admission_class[i].alloc_total = 0;
+    config->admission_class[i].alloc_cache_hit_total = 0;
+    if (pthread_mutex_init(&config->admission_class[i].lock, NULL) || pthread_cond_init(&config->admission_class[i].cond, &condattr)) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_admission_init - Error initializing class %s", class_names[i]);
+      ret = G_ERROR;
+    }
+  }
+  pthread_condattr_destroy(&condattr);
+  return ret;
+}
+
+void glewlwyd_admission_close(struct config_elements * config) {
+  int i;
+
+  for (i=0; i<GLEWLWYD_ADMISSION_CLASS_COUNT; i++) {
+    pthread_mutex_destroy(&config->admission_class[i].lock);
+    pthread_cond_destroy(&config->admission_class[i].cond);
+  }
+  pointer_list_clean_free(&config->admission_endpoint_list, &o_free);
+  pthread_mutex_destroy(&config->admission_endpoint_lock);
+}
+
+int glewlwyd_admission_get_plugin_class(const char * url) {
+  int i;
+
+  if (0 == o_strncmp(url, "mtls/", o_strlen("mtls/"))) {
+    url += o_strlen("mtls/");
+  }
+  for (i=0; admission_plugin_token_urls[i] != NULL; i++) {
+    if (0 == o_strncmp(url, admission_plugin_token_urls[i], o_strlen(admission_plugin_token_urls[i]))) {
+      return GLEWLWYD_ADMISSION_CLASS_TOKEN;
+    }
+  }
+  return GLEWLWYD_ADMISSION_CLASS_AUTH;
+}
+
+/**
+ * Replaces the callback with a wrapper that opens the user view scope of the callback
+ * and holds a reference on the current module epoch while it runs
+ * If the endpoint class is limited, the callback is executed only when a slot is available in the class
+ * If the allocation cache is enabled, the wrapper also counts the allocations of the class
+ * Wrappers are kept until the server stops because a removed endpoint
+ * may still be running requests
+ */
+int glewlwyd_admission_wrap_callback(struct config_elements * config, int admission_class, int (** callback)(const struct _u_request * request, struct _u_response * response, void * user_data), void ** user_data) {
+  struct _glwd_admission_endpoint * endpoint;
+  int ret;
+
+  if (admission_class < 0 || admission_class >= GLEWLWYD_ADMISSION_CLASS_COUNT) {
+    ret = G_OK;
+  } else if ((endpoint = o_malloc(sizeof(struct _glwd_admission_endpoint))) != NULL) {
+    endpoint->config = config;
+    endpoint->admission_class = &config->admission_class[admission_class];
+    endpoint->retry_after = config->admission_retry_after;
+    endpoint->count_alloc = !!config->alloc_cache_size;
+    endpoint->callback = *callback;
+    endpoint->user_data = *user_data;
+    pthread_mutex_lock(&config->admission_endpoint_lock);
+    pointer_list_append(&config->admission_endpoint_list, endpoint);
+    pthread_mutex_unlock(&config->admission_endpoint_lock);
+    *callback = &callback_glewlwyd_admission;
+    *user_data = endpoint;
+    ret = G_OK;
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_admission_wrap_callback - Error allocating resources for endpoint");
+    ret = G_ERROR_MEMORY;
+  }
+  return ret;
+}
+
+/**
+ * Adds an endpoint to the main instance, wrapped by the admission control of its class
+ */
+int glewlwyd_add_admission_endpoint(struct config_elements * config, int admission_class, const char * method, const char * url_prefix, const char * url_format, unsigned int priority, int (* callback)(const struct _u_request * request, struct _u_response * response, void * user_data), void * user_data) {
+  int ret;
+
+  if (glewlwyd_admission_wrap_callback(config, admission_class, &callback, &user_data) == G_OK) {
+    ret = ulfius_add_endpoint_by_val(config->instance, method, url_prefix, url_format, priority, callback, user_data);
+  } else {
+    ret = U_ERROR_MEMORY;
+  }
+  return ret;
+}
+
+/**
+ * Appends the admission counters and gauges to the prometheus metrics content
+ * They are not stored with the other metrics to avoid
+ * spawning a counter thread for each rejected request during an overload
+ */
+char * glewlwyd_admission_metrics(struct config_elements * config, char * content) {
+  unsigned int active[GLEWLWYD_ADMISSION_CLASS_COUNT], queued[GLEWLWYD_ADMISSION_CLASS_COUNT];
+  size_t queued_total[GLEWLWYD_ADMISSION_CLASS_COUNT], rejected_total[GLEWLWYD_ADMISSION_CLASS_COUNT];
+  int i;
+
+  for (i=0; i<GLEWLWYD_ADMISSION_CLASS_COUNT; i++) {
+    pthread_mutex_lock(&config->admission_class[i].lock);
+    active[i] = config->admission_class[i].active;
+    queued[i] = config->admission_class[i].queued;
+    queued_total[i] = config->admission_class[i].queued_total;
+    rejected_total[i] = config->admission_class[i].rejected_total;
+    pthread_mutex_unlock(&config->admission_class[i].lock);
+  }
+  content = mstrcatf(content, "# HELP glewlwyd_admission_queued_total Total number of requests that had to wait for a slot\n");
+  content = mstrcatf(content, "# TYPE glewlwyd_admission_queued_total counter\n");
+  for (i=0; i<GLEWLWYD_ADMISSION_CLASS_COUNT; i++) {
+    content = mstrcatf(content, "glewlwyd_admission_queued_total{class=\"%s\"} %zu\n", config->admission_class[i].name, queued_total[i]);
+  }
+  content = mstrcatf(content, "# HELP glewlwyd_admission_rejected_total Total number of requests rejected with a 503\n");
+  content = mstrcatf(content, "# TYPE glewlwyd_admission_rejected_total counter\n");
+  for (i=0; i<GLEWLWYD_ADMISSION_CLASS_COUNT; i++) {
+    content = mstrcatf(content, "glewlwyd_admission_rejected_total{class=\"%s\"} %zu\n", config->admission_class[i].name, rejected_total[i]);
+  }
+  content = mstrcatf(content, "# HELP glewlwyd_admission_active Number of requests being processed\n");
+  content = mstrcatf(content, "# TYPE glewlwyd_admission_active gauge\n");
+  for (i=0; i<GLEWLWYD_ADMISSION_CLASS_COUNT; i++) {
+    content = mstrcatf(content, "glewlwyd_admission_active{class=\"%s\"} %u\n", config->admission_class[i].name, active[i]);
+  }
+  content = mstrcatf(content, "# HELP glewlwyd_admission_queue_depth Number of requests waiting for a slot\n");
+  content = mstrcatf(content, "# TYPE glewlwyd_admission_queue_depth gauge\n");
+  for (i=0; i<GLEWLWYD_ADMISSION_CLASS_COUNT; i++) {
+    content = mstrcatf(content, "glewlwyd_admission_queue_depth{class=\"%s\"} %u\n", config->admission_class[i].name, queued[i]);
+  }
+  return content;
+}
@@ -0,0 +1,251 @@
+/**
+ *
+ * Glewlwyd SSO Server
+ *
+ * Authentiation server
+ * Users are authenticated via various backend available: database, ldap
+ * Using various authentication methods available: password, OTP, send code, etc.
+ *
+ * Thread-local allocation cache functions definitions
+ *
+ * Copyright 2016-2021 Nicolas Mora <mail@babelouest.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU GENERAL PUBLIC LICENSE
+ * License as published by the Free Software Foundation;
+ * version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU GENERAL PUBLIC LICENSE for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "glewlwyd.h"
+
+/**
+ * The cached blocks are classified with malloc_usable_size(),
+ * without the GNU C library, the allocation cache is not available
+ */
+#ifdef __GLIBC__
+
+#include <malloc.h>
+
+#define GLEWLWYD_ALLOC_CACHE_CLASSES        8
+#define GLEWLWYD_ALLOC_CACHE_MIN_SIZE_LOG2  4 // 16 bytes, the largest class is 2048 bytes
+
+/**
+ * Free blocks are chained in place, so the smallest class must hold a pointer
+ */
+struct _glwd_alloc_cache_block {
+  struct _glwd_alloc_cache_block * next;
+};
+
+/**
+ * Per-thread cache of free blocks by size class
+ * The blocks are regular malloc blocks, so a block allocated here
+ * can be freed by free() and a block allocated by malloc() can be given back here
+ */
+struct _glwd_alloc_cache_thread {
+  struct _glwd_alloc_cache_block * block[GLEWLWYD_ALLOC_CACHE_CLASSES];
+  unsigned int                     nb_block[GLEWLWYD_ALLOC_CACHE_CLASSES];
+  size_t                           alloc_count;
+  size_t                           hit_count;
+};
+
+static unsigned int alloc_cache_max_blocks = 0;
+static pthread_key_t alloc_cache_key;
+static __thread struct _glwd_alloc_cache_thread * alloc_cache_thread = NULL;
+static __thread int alloc_cache_thread_closed = 0;
+
+/**
+ * Releases the blocks of a thread cache when the thread exits
+ */
+static void alloc_cache_thread_release(void * data) {
+  struct _glwd_alloc_cache_thread * thread = (struct _glwd_alloc_cache_thread *)data;
+  struct _glwd_alloc_cache_block * block;
+  int i;
+
+  alloc_cache_thread = NULL;
+  alloc_cache_thread_closed = 1;
+  for (i=0; i<GLEWLWYD_ALLOC_CACHE_CLASSES; i++) {
+    while ((block = thread->block[i]) != NULL) {
+      thread->block[i] = block->next;
+      free(block);
+    }
+  }
+  free(thread);
+}
+
+static struct _glwd_alloc_cache_thread * get_alloc_cache_thread(void) {
+  if (alloc_cache_thread == NULL && !alloc_cache_thread_closed) {
+    // calloc is not hooked, so this doesn't recurse
+    if ((alloc_cache_thread = calloc(1, sizeof(struct _glwd_alloc_cache_thread))) != NULL) {
+      if (pthread_setspecific(alloc_cache_key, alloc_cache_thread)) {
+        free(alloc_cache_thread);
+        alloc_cache_thread = NULL;
+        alloc_cache_thread_closed = 1;
+      }
+    }
+  }
+  return alloc_cache_thread;
+}
+
+/**
+ * Returns the class able to store size bytes, -1 if the size is too large
+ */
+static int get_alloc_class(size_t size) {
+  int size_log2;
+
+  if (size <= (1<<GLEWLWYD_ALLOC_CACHE_MIN_SIZE_LOG2)) {
+    return 0;
+  } else {
+    size_log2 = (int)(sizeof(unsigned long)*8) - __builtin_clzl((unsigned long)(size-1));
+    return size_log2-GLEWLWYD_ALLOC_CACHE_MIN_SIZE_LOG2<GLEWLWYD_ALLOC_CACHE_CLASSES?size_log2-GLEWLWYD_ALLOC_CACHE_MIN_SIZE_LOG2:-1;
+  }
+}
+
+/**
+ * Returns the class of a free block, i.e. the largest class smaller than the block,
+ * -1 if the block is too large or too small to be cached
+ */
+static int get_free_class(size_t usable_size) {
+  int size_log2;
+
+  if (usable_size < (1<<GLEWLWYD_ALLOC_CACHE_MIN_SIZE_LOG2)) {
+    return -1;
+  } else {
+    size_log2 = (int)(sizeof(unsigned long)*8) - 1 - __builtin_clzl((unsigned long)usable_size);
+    return size_log2-GLEWLWYD_ALLOC_CACHE_MIN_SIZE_LOG2<GLEWLWYD_ALLOC_CACHE_CLASSES?size_log2-GLEWLWYD_ALLOC_CACHE_MIN_SIZE_LOG2:-1;
+  }
+}
+
+static void * alloc_cache_malloc(size_t size) {
+  struct _glwd_alloc_cache_thread * thread = get_alloc_cache_thread();
+  struct _glwd_alloc_cache_block * block;
+  int index;
+
+  if (thread != NULL) {
+    thread->alloc_count++;
+    if ((index = get_alloc_class(size)) >= 0) {
+      if ((block = thread->block[index]) != NULL) {
+        thread->block[index] = block->next;
+        thread->nb_block[index]--;
+        thread->hit_count++;
+        return block;
+      } else {
+        return malloc((size_t)1<<(index+GLEWLWYD_ALLOC_CACHE_MIN_SIZE_LOG2));
+      }
+    }
+  }
+  return malloc(size);
+}
+
+static void * alloc_cache_realloc(void * ptr, size_t size) {
+  struct _glwd_alloc_cache_thread * thread = get_alloc_cache_thread();
+
+  if (thread != NULL) {
+    thread->alloc_count++;
+  }
+  return realloc(ptr, size);
+}
+
+static void alloc_cache_free(void * ptr) {
+  struct _glwd_alloc_cache_thread * thread;
+  struct _glwd_alloc_cache_block * block;
+  int index;
+
+  if (ptr != NULL) {
+    if ((thread = get_alloc_cache_thread()) != NULL && (index = get_free_class(malloc_usable_size(ptr))) >= 0 && thread->nb_block[index] < alloc_cache_max_blocks) {
+      block = (struct _glwd_alloc_cache_block *)ptr;
+      block->next = thread->block[index];
+      thread->block[index] = block;
+      thread->nb_block[index]++;
+    } else {
+      free(ptr);
+    }
+  }
+}
+
+/**
+ * Installs the allocation cache for jansson and orcania allocations,
+ * must be called before the threads using them are started
+ */
+int glewlwyd_alloc_cache_init(struct config_elements * config) {
+  int ret;
+
+  if (config->alloc_cache_size) {
+    if (!pthread_key_create(&alloc_cache_key, &alloc_cache_thread_release)) {
+      alloc_cache_max_blocks = config->alloc_cache_size;
+      json_set_alloc_funcs(&alloc_cache_malloc, &alloc_cache_free);
+      o_set_alloc_funcs(&alloc_cache_malloc, &alloc_cache_realloc, &alloc_cache_free);
+      ret = G_OK;
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_alloc_cache_init - Error pthread_key_create");
+      config->alloc_cache_size = 0;
+      ret = G_ERROR;
+    }
+  } else {
+    ret = G_OK;
+  }
+  return ret;
+}
+
+/**
+ * Returns the number of allocations and cache hits of the current thread
+ * The counters only increase, the caller keeps the difference
+ */
+void glewlwyd_alloc_cache_get_counters(size_t * alloc_count, size_t * hit_count) {
+  if (alloc_cache_thread != NULL) {
+    *alloc_count = alloc_cache_thread->alloc_count;
+    *hit_count = alloc_cache_thread->hit_count;
+  } else {
+    *alloc_count = 0;
+    *hit_count = 0;
+  }
+}
+
+#else
+
+/**
+ * malloc_usable_size() is not available, the allocation cache is disabled
+ */
+int glewlwyd_alloc_cache_init(struct config_elements * config) {
+  if (config->alloc_cache_size) {
+    fprintf(stderr, "Warning - alloc_cache_size is not available without the GNU C library, allocation cache disabled\n");
+    config->alloc_cache_size = 0;
+  }
+  return G_OK;
+}
+
+void glewlwyd_alloc_cache_get_counters(size_t * alloc_count, size_t * hit_count) {
+  *alloc_count = 0;
+  *hit_count = 0;
+}
+
+#endif
+
+/**
+ * Appends the allocation counters by endpoint class to the prometheus metrics content
+ */
+char * glewlwyd_alloc_cache_metrics(struct config_elements * config, char * content) {
+  int i;
+
+  if (config->alloc_cache_size) {
+    content = mstrcatf(content, "# HELP glewlwyd_alloc_total Total number of memory allocations made by the requests\n");
+    content = mstrcatf(content, "# TYPE glewlwyd_alloc_total counter\n");
+    for (i=0; i<GLEWLWYD_ADMISSION_CLASS_COUNT; i++) {
+      content = mstrcatf(content, "glewlwyd_alloc_total{class=\"%s\"} %zu\n", config->admission_class[i].name, __atomic_load_n(&config->admission_class[i].alloc_total, __ATOMIC_RELAXED));
+    }
+    content = mstrcatf(content, "# HELP glewlwyd_alloc_cache_hit_total Total number of memory allocations made by the requests served by the thread cache\n");
+    content = mstrcatf(content, "# TYPE glewlwyd_alloc_cache_hit_total counter\n");
+    for (i=0; i<GLEWLWYD_ADMISSION_CLASS_COUNT; i++) {
+      content = mstrcatf(content, "glewlwyd_alloc_cache_hit_total{class=\"%s\"} %zu\n", config->admission_class[i].name, __atomic_load_n(&config->admission_class[i].alloc_cache_hit_total, __ATOMIC_RELAXED));
+    }
+  }
+  return content;
+}
@@ -26,72 +26,233 @@
  */
 #include "glewlwyd.h"
 
+/**
+ * Returns the hash of an api key token as stored in the database
+ * returned value must be o_free'd after use
+ */
+static char * get_api_key_hash(struct config_elements * config, const char * token) {
+  char * token_hash, * tmp;
+
+  token_hash = generate_hash(config->hash_algorithm, token);
+  tmp = str_replace(token_hash, "/", "_");
+  o_free(token_hash);
+  token_hash = str_replace(tmp, "+", "-");
+  o_free(tmp);
+  return token_hash;
+}
+
+/**
+ * Returns the enabled api keys as an object token_hash: gak_id
+ */
+static json_t * load_api_key_cache(struct config_elements * config) {
+  json_t * j_query, * j_result = NULL, * j_element = NULL, * j_cache = NULL;
+  int res;
+  size_t index = 0;
+
+  j_query = json_pack("{sss[ss]s{si}}",
+                      "table",
+                      GLEWLWYD_TABLE_API_KEY,
+                      "columns",
+                        "gak_id",
+                        "gak_token_hash",
+                      "where",
+                        "gak_enabled",
+                        1);
+  res = h_select(config->conn, j_query, &j_result, NULL);
+  json_decref(j_query);
+  if (res == H_OK) {
+    if ((j_cache = json_object()) != NULL) {
+      json_array_foreach(j_result, index, j_element) {
+        json_object_set(j_cache, json_string_value(json_object_get(j_element, "gak_token_hash")), json_object_get(j_element, "gak_id"));
+      }
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "load_api_key_cache - Error allocating resources for j_cache");
+    }
+    json_decref(j_result);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "load_api_key_cache - Error executing j_query");
+    glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+  }
+  return j_cache;
+}
+
+/**
+ * Returns the id of an enabled api key from the database, NULL if not found
+ */
+static json_t * get_api_key_id(struct config_elements * config, const char * token_hash) {
+  json_t * j_query, * j_result = NULL, * j_id = NULL;
+  int res;
+
+  j_query = json_pack("{sss[s]s{sssi}}",
+                      "table",
+                      GLEWLWYD_TABLE_API_KEY,
+                      "columns",
+                        "gak_id",
+                      "where",
+                        "gak_token_hash",
+                        token_hash,
+                        "gak_enabled",
+                        1);
+  res = h_select(config->conn, j_query, &j_result, NULL);
+  json_decref(j_query);
+  if (res == H_OK) {
+    if (json_array_size(j_result)) {
+      j_id = json_incref(json_object_get(json_array_get(j_result, 0), "gak_id"));
+    }
+    json_decref(j_result);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "get_api_key_id - Error executing j_query");
+    glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+  }
+  return j_id;
+}
+
+/**
+ * Verifies an api key against the in-memory list of enabled keys
+ * The list is reloaded every GLEWLWYD_API_KEY_CACHE_EXPIRATION seconds
+ * so keys disabled by another instance are eventually refused,
+ * or right away if cache invalidation is enabled
+ * A key missing from the list is looked up in the database,
+ * in case it was generated by another instance
+ * The usage counter is incremented in memory and written by flush_api_key_counter
+ * A list or a key read from the database is dropped instead of stored in the cache
+ * if a key was disabled meanwhile, so a reload can't revive it
+ */
 int verify_api_key(struct config_elements * config, const char * token) {
-  json_t * j_query, * j_result = NULL;
-  int res, ret;
-  char * token_hash = NULL, * tmp;
+  json_t * j_cache = NULL, * j_id = NULL, * j_counter;
+  int ret, reload = 0, flush = 0;
+  unsigned int generation = 0;
+  char * token_hash = NULL, * id_str;
+  time_t now;
   
   if (o_strlen(token) == GLEWLWYD_API_KEY_LENGTH) {
-    token_hash = generate_hash(config->hash_algorithm, token);
-    tmp = str_replace(token_hash, "/", "_");
-    o_free(token_hash);
-    token_hash = str_replace(tmp, "+", "-");
-    o_free(tmp);
-    j_query = json_pack("{sss[ss]s{ss?si}}",
-                        "table",
-                        GLEWLWYD_TABLE_API_KEY,
-                        "columns",
-                          "gak_id",
-                          "gak_counter",
-                        "where",
-                          "gak_token_hash",
-                          token_hash,
-                          "gak_enabled",
-                          1);
-    o_free(token_hash);
-    res = h_select(config->conn, j_query, &j_result, NULL);
-    json_decref(j_query);
-    if (res == H_OK) {
-      if (json_array_size(j_result)) {
-        j_query = json_pack("{sss{sI}s{sO}}",
-                            "table",
-                            GLEWLWYD_TABLE_API_KEY,
-                            "set",
-                              "gak_counter",
-                              json_integer_value(json_object_get(json_array_get(j_result, 0), "gak_counter"))+1,
-                            "where",
-                              "gak_id",
-                              json_object_get(json_array_get(j_result, 0), "gak_id"));
-        res = h_update(config->conn, j_query, NULL);
-        json_decref(j_query);
-        if (res == H_OK) {
-          ret = G_OK;
+    token_hash = get_api_key_hash(config, token);
+    time(&now);
+    if (!pthread_mutex_lock(&config->api_key_lock)) {
+      generation = config->api_key_cache_generation;
+      if (config->j_api_key_cache == NULL || config->api_key_cache_loaded_at + GLEWLWYD_API_KEY_CACHE_EXPIRATION <= now) {
+        reload = 1;
+      } else {
+        j_id = json_incref(json_object_get(config->j_api_key_cache, token_hash));
+      }
+      pthread_mutex_unlock(&config->api_key_lock);
+      if (reload) {
+        if ((j_cache = load_api_key_cache(config)) != NULL) {
+          j_id = json_incref(json_object_get(j_cache, token_hash));
+        }
+      } else if (j_id == NULL) {
+        j_id = get_api_key_id(config, token_hash);
+      }
+      if (j_id != NULL || j_cache != NULL) {
+        if (!pthread_mutex_lock(&config->api_key_lock)) {
+          if (generation != config->api_key_cache_generation) {
+            json_decref(j_cache);
+          } else if (j_cache != NULL) {
+            json_decref(config->j_api_key_cache);
+            config->j_api_key_cache = j_cache;
+            config->api_key_cache_loaded_at = now;
+          } else if (config->j_api_key_cache != NULL) {
+            json_object_set(config->j_api_key_cache, token_hash, j_id);
+          }
+          if (j_id != NULL) {
+            id_str = msprintf("%" JSON_INTEGER_FORMAT, json_integer_value(j_id));
+            if ((j_counter = json_object_get(config->j_api_key_counter, id_str)) != NULL) {
+              json_integer_set(j_counter, json_integer_value(j_counter)+1);
+            } else {
+              json_object_set_new(config->j_api_key_counter, id_str, json_integer(1));
+            }
+            o_free(id_str);
+            flush = (config->api_key_counter_flushed_at + GLEWLWYD_API_KEY_COUNTER_FLUSH_INTERVAL <= now);
+            ret = G_OK;
+          } else {
+            ret = G_ERROR_UNAUTHORIZED;
+          }
+          pthread_mutex_unlock(&config->api_key_lock);
         } else {
-          y_log_message(Y_LOG_LEVEL_ERROR, "verify_api_key - Error executing j_query (2)");
-          glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
-          ret = G_ERROR_DB;
+          y_log_message(Y_LOG_LEVEL_ERROR, "verify_api_key - Error pthread_mutex_lock (2)");
+          json_decref(j_cache);
+          ret = G_ERROR;
         }
+      } else if (reload) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "verify_api_key - Error load_api_key_cache");
+        ret = G_ERROR_DB;
       } else {
         ret = G_ERROR_UNAUTHORIZED;
       }
-      json_decref(j_result);
+      json_decref(j_id);
+      if (flush && flush_api_key_counter(config) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "verify_api_key - Error flush_api_key_counter");
+      }
     } else {
-      y_log_message(Y_LOG_LEVEL_ERROR, "verify_api_key - Error executing j_query (1)");
-      glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
-      ret = G_ERROR_DB;
+      y_log_message(Y_LOG_LEVEL_ERROR, "verify_api_key - Error pthread_mutex_lock (1)");
+      ret = G_ERROR;
     }
+    o_free(token_hash);
   } else {
     ret = G_ERROR_UNAUTHORIZED;
   }
   return ret;
 }
 
+/**
+ * Writes the pending usage counters of all api keys in a single query
+ */
+int flush_api_key_counter(struct config_elements * config) {
+  json_t * j_counter, * j_element = NULL;
+  const char * key = NULL;
+  char * case_clause = NULL, * in_clause = NULL, * query;
+  int res, ret = G_OK;
+
+  if (!pthread_mutex_lock(&config->api_key_lock)) {
+    j_counter = config->j_api_key_counter;
+    config->j_api_key_counter = json_object();
+    config->api_key_counter_flushed_at = time(NULL);
+    pthread_mutex_unlock(&config->api_key_lock);
+    if (json_object_size(j_counter)) {
+      json_object_foreach(j_counter, key, j_element) {
+        case_clause = mstrcatf(case_clause, " WHEN %s THEN %" JSON_INTEGER_FORMAT, key, json_integer_value(j_element));
+        if (in_clause == NULL) {
+          in_clause = o_strdup(key);
+        } else {
+          in_clause = mstrcatf(in_clause, ",%s", key);
+        }
+      }
+      query = msprintf("UPDATE " GLEWLWYD_TABLE_API_KEY " SET gak_counter=gak_counter+CASE gak_id%s ELSE 0 END WHERE gak_id IN (%s)", case_clause, in_clause);
+      res = h_execute_query(config->conn, query, NULL, H_OPTION_EXEC);
+      o_free(query);
+      o_free(case_clause);
+      o_free(in_clause);
+      if (res != H_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "flush_api_key_counter - Error executing query");
+        glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+        // Keep the counters for the next flush
+        if (!pthread_mutex_lock(&config->api_key_lock)) {
+          json_object_foreach(j_counter, key, j_element) {
+            json_integer_set(j_element, json_integer_value(j_element)+json_integer_value(json_object_get(config->j_api_key_counter, key)));
+          }
+          json_object_update(config->j_api_key_counter, j_counter);
+          pthread_mutex_unlock(&config->api_key_lock);
+        }
+        ret = G_ERROR_DB;
+      }
+    }
+    json_decref(j_counter);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "flush_api_key_counter - Error pthread_mutex_lock");
+    ret = G_ERROR;
+  }
+  return ret;
+}
+
 json_t * get_api_key_list(struct config_elements * config, const char * pattern, size_t offset, size_t limit) {
   json_t * j_query, * j_result, * j_return, * j_element;
   int res;
   size_t index;
   char * pattern_escaped, * pattern_clause;
 
+  if (flush_api_key_counter(config) != G_OK) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "get_api_key_list - Error flush_api_key_counter");
+  }
   j_query = json_pack("{sss[sssssss]siss}",
                       "table",
                       GLEWLWYD_TABLE_API_KEY,
@@ -136,14 +297,10 @@ json_t * get_api_key_list(struct config_elements * config, const char * pattern,
 json_t * generate_api_key(struct config_elements * config, const char * username, const char * issued_for, const char * user_agent) {
   json_t * j_query, * j_return, * j_last_index;
   int res;
-  char token[GLEWLWYD_API_KEY_LENGTH+1] = {0}, * token_hash, * tmp;
+  char token[GLEWLWYD_API_KEY_LENGTH+1] = {0}, * token_hash;
   
   rand_string(token, GLEWLWYD_API_KEY_LENGTH);
-  token_hash = generate_hash(config->hash_algorithm, token);
-  tmp = str_replace(token_hash, "/", "_");
-  o_free(token_hash);
-  token_hash = str_replace(tmp, "+", "-");
-  o_free(tmp);
+  token_hash = get_api_key_hash(config, token);
   if (token_hash != NULL) {
     if (pthread_mutex_lock(&config->insert_lock)) {
       y_log_message(Y_LOG_LEVEL_ERROR, "generate_api_key - Error pthread_mutex_lock");
@@ -161,6 +318,12 @@ json_t * generate_api_key(struct config_elements * config, const char * username
       if (res == H_OK) {
         if ((j_last_index = h_last_insert_id(config->conn)) != NULL) {
           update_issued_for(config, NULL, GLEWLWYD_TABLE_API_KEY, "gak_issued_for", issued_for, "gak_id", json_integer_value(j_last_index));
+          if (!pthread_mutex_lock(&config->api_key_lock)) {
+            if (config->j_api_key_cache != NULL) {
+              json_object_set(config->j_api_key_cache, token_hash, j_last_index);
+            }
+            pthread_mutex_unlock(&config->api_key_lock);
+          }
           j_return = json_pack("{sis{ss}}", "result", G_OK, "api_key", "key", token);
         } else {
           y_log_message(Y_LOG_LEVEL_ERROR, "generate_api_key - Error j_last_index");
@@ -201,6 +364,12 @@ int disable_api_key(struct config_elements * config, const char * token_hash) {
   res = h_update(config->conn, j_query, NULL);
   json_decref(j_query);
   if (res == H_OK) {
+    if (!pthread_mutex_lock(&config->api_key_lock)) {
+      json_object_del(config->j_api_key_cache, token_hash);
+      config->api_key_cache_generation++;
+      pthread_mutex_unlock(&config->api_key_lock);
+    }
+    glewlwyd_cache_invalidation_publish(config, GLEWLWYD_CACHE_API_KEY, token_hash);
     ret = G_OK;
   } else {
     y_log_message(Y_LOG_LEVEL_ERROR, "disable_api_key - Error executing j_query");
@@ -209,3 +378,24 @@ int disable_api_key(struct config_elements * config, const char * token_hash) {
   }
   return ret;
 }
+
+/**
+ * Cache invalidation handler, key is the token hash of a disabled key
+ */
+void invalidate_api_key_cache_callback(const char * cache, const char * key, void * cls) {
+  struct config_elements * config = (struct config_elements *)cls;
+
+  UNUSED(cache);
+  if (!pthread_mutex_lock(&config->api_key_lock)) {
+    if (key != NULL) {
+      json_object_del(config->j_api_key_cache, key);
+    } else {
+      json_decref(config->j_api_key_cache);
+      config->j_api_key_cache = NULL;
+    }
+    config->api_key_cache_generation++;
+    pthread_mutex_unlock(&config->api_key_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "invalidate_api_key_cache_callback - Error pthread_mutex_lock");
+  }
+}
@@ -379,6 +379,10 @@ int set_client(struct config_elements * config, const char * client_id, json_t *
       ret = G_ERROR;
     }
   }
+  if (ret == G_OK) {
+    glewlwyd_cache_invalidation_local(config, GLEWLWYD_CACHE_CLIENT, client_id);
+    glewlwyd_cache_invalidation_publish(config, GLEWLWYD_CACHE_CLIENT, client_id);
+  }
   return ret;
 }
 
@@ -443,5 +447,9 @@ int delete_client(struct config_elements * config, const char * client_id, const
       ret = G_ERROR;
     }
   }
+  if (ret == G_OK) {
+    glewlwyd_cache_invalidation_local(config, GLEWLWYD_CACHE_CLIENT, client_id);
+    glewlwyd_cache_invalidation_publish(config, GLEWLWYD_CACHE_CLIENT, client_id);
+  }
   return ret;
 }
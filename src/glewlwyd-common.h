@@ -95,6 +95,8 @@
 
 #define GLEWLWYD_DEFAULT_SALT_LENGTH 16
 
+#define GLEWLWYD_RANDOM_BUFFER_SIZE 512
+
 #define G_PBKDF2_ITERATOR_DEFAULT 150000
 
 #define SWITCH_DB_TYPE(T, M, S, P) \
@@ -277,6 +279,21 @@ struct _user_auth_scheme_module_instance {
   short int                         enabled;
 };
 
+/**
+ * User resolved once and shared by reference
+ * The view is immutable, the fields point to j_user values
+ * and it must be released with release_user_view
+ */
+struct _glewlwyd_user_view {
+  char         * lookup;
+  const char   * username;
+  const char   * source;
+  int            enabled;
+  const json_t * j_scope;
+  json_t       * j_user;
+  unsigned int   refcount;
+};
+
 struct config_plugin;
 
 /**
@@ -303,6 +320,7 @@ struct _plugin_module_instance {
   struct _plugin_module * module;
   void                  * cls;
   short int               enabled;
+  unsigned int            endpoint_generation;
 };
 
 #define GLWD_METRICS_AUTH_USER_VALID          "glewlwyd_auth_user_valid"
@@ -326,6 +344,102 @@ struct _glwd_metric {
   size_t                      data_size;
 };
 
+#define GLEWLWYD_ADMISSION_CLASS_TOKEN  0
+#define GLEWLWYD_ADMISSION_CLASS_AUTH   1
+#define GLEWLWYD_ADMISSION_CLASS_ADMIN  2
+#define GLEWLWYD_ADMISSION_CLASS_STATIC 3
+#define GLEWLWYD_ADMISSION_CLASS_COUNT  4
+
+/**
+ * Structure used to limit the number of requests
+ * processed at the same time for an endpoint class
+ */
+struct _glwd_admission_class {
+  const char    * name;
+  unsigned int    max_concurrent; // 0 means unlimited
+  unsigned int    max_queue;
+  unsigned int    queue_timeout;  // in milliseconds
+  unsigned int    active;
+  unsigned int    queued;
+  size_t          queued_total;
+  size_t          rejected_total;
+  size_t          alloc_total;
+  size_t          alloc_cache_hit_total;
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
+};
+
+// Caches invalidated across the Glewlwyd instances sharing the same database
+#define GLEWLWYD_CACHE_USER           "user"
+#define GLEWLWYD_CACHE_CLIENT         "client"
+#define GLEWLWYD_CACHE_SCOPE          "scope"
+#define GLEWLWYD_CACHE_SESSION        "session"
+#define GLEWLWYD_CACHE_SCHEME_CAN_USE "scheme_can_use"
+#define GLEWLWYD_CACHE_API_KEY        "api_key"
+
+#define GLEWLWYD_CACHE_INVALIDATION_NODE_LENGTH 16
+
+#define GLEWLWYD_CACHE_INVALIDATION_BACKEND_NONE   0
+#define GLEWLWYD_CACHE_INVALIDATION_BACKEND_POLL   1
+#define GLEWLWYD_CACHE_INVALIDATION_BACKEND_NOTIFY 2
+
+/**
+ * Function called when an entry of a cache must be invalidated
+ * key is NULL when the whole cache must be cleared
+ */
+typedef void (* glewlwyd_cache_invalidation_callback)(const char * cache, const char * key, void * cls);
+
+// Read modes for the queries that can be served by a replica
+#define GLEWLWYD_DB_READ_PRIMARY          0 // Read after write, always on the primary connection
+#define GLEWLWYD_DB_READ_REPLICA          1 // Stale data accepted
+#define GLEWLWYD_DB_READ_REPLICA_FALLBACK 2 // Stale data accepted, but an empty result is read again on the primary
+
+/**
+ * Prepared statement definition
+ * The query of each database type uses $1, $2, etc. as placeholders
+ * for the bound parameters, a placeholder can be used more than once
+ * query_sqlite and query_pgsql may be NULL if the query is the same as query_mariadb
+ */
+struct _glwd_statement {
+  const char * name;
+  const char * query_mariadb;
+  const char * query_sqlite;
+  const char * query_pgsql;
+};
+
+#define GLEWLWYD_RATE_LIMIT_STRIPES             32
+#define GLEWLWYD_RATE_LIMIT_STRIPE_MAX_BUCKETS  4096
+#define GLEWLWYD_RATE_LIMIT_STRIPE_PRUNE_BUCKETS 3072
+
+/**
+ * Structure used to store a part of the rate limit buckets
+ */
+struct _glwd_rate_limit_stripe {
+  pthread_mutex_t   lock;
+  json_t          * j_bucket;
+};
+
+#define GLEWLWYD_CREDENTIAL_CACHE_BUCKETS       64
+#define GLEWLWYD_CREDENTIAL_CACHE_SALT_LENGTH   32
+#define GLEWLWYD_CREDENTIAL_CACHE_DIGEST_LENGTH 32
+#define GLEWLWYD_CREDENTIAL_CACHE_MAX_SIZE      1024
+
+/**
+ * In-memory cache of the credentials successfully verified by a remote service
+ * Only the username and a salted digest of the password are stored
+ */
+struct _glwd_credential_cache {
+  pthread_mutex_t      lock;
+  unsigned char        salt[GLEWLWYD_CREDENTIAL_CACHE_SALT_LENGTH];
+  time_t               duration;
+  size_t               max_size;
+  size_t               size;
+  struct _pointer_list bucket[GLEWLWYD_CREDENTIAL_CACHE_BUCKETS];
+};
+
+// Outbound HTTP client, defined in src/http_client.c
+struct _glwd_http_client;
+
 /**
  * Structure used to store the global application config
  */
@@ -358,6 +472,12 @@ struct config_elements {
   char *                                         secure_connection_pem_file;
   char *                                         secure_connection_ca_file;
   struct _h_connection *                         conn;
+  struct _h_connection **                        conn_replica;
+  size_t                                         conn_replica_count;
+  unsigned int                                   conn_replica_index;
+  unsigned int                                   use_prepared_statement;
+  pthread_mutex_t                                statement_lock;
+  json_t *                                       j_statement_cache;
   struct _u_instance *                           instance;
   unsigned int                                   instance_initialized;
   struct _u_instance *                           instance_metrics;
@@ -392,6 +512,55 @@ struct config_elements {
   pthread_mutex_t                                metrics_lock;
   struct _pointer_list                           metrics_list;
   pthread_mutex_t                                insert_lock;
+  pthread_mutex_t                                endpoint_lock;
+  unsigned int                                   module_init_max_parallel;
+  unsigned int                                   module_init_timeout;
+  pthread_mutex_t                                module_epoch_lock;
+  pthread_cond_t                                 module_epoch_cond;
+  unsigned long                                  module_epoch_current;
+  struct _module_epoch_stripe *                  module_epoch_stripe;
+  struct _pointer_list                           module_retired_list;
+  pthread_t                                      module_reaper_thread;
+  unsigned short                                 module_reaper_status;
+  struct _pointer_list                           plugin_endpoint_list;
+  unsigned int                                   plugin_endpoint_generation;
+  pthread_mutex_t                                scheme_can_use_cache_lock;
+  json_t *                                       j_scheme_can_use_cache;
+  unsigned int                                   scheme_can_use_cache_expiration;
+  unsigned int                                   scheme_can_use_cache_generation;
+  pthread_mutex_t                                api_key_lock;
+  json_t *                                       j_api_key_cache;
+  time_t                                         api_key_cache_loaded_at;
+  unsigned int                                   api_key_cache_generation;
+  json_t *                                       j_api_key_counter;
+  time_t                                         api_key_counter_flushed_at;
+  struct _glwd_admission_class                   admission_class[GLEWLWYD_ADMISSION_CLASS_COUNT];
+  unsigned int                                   admission_retry_after;
+  pthread_mutex_t                                admission_endpoint_lock;
+  struct _pointer_list                           admission_endpoint_list;
+  json_t *                                       j_rate_limit;
+  struct _glwd_rate_limit_stripe                 rate_limit_stripe[GLEWLWYD_RATE_LIMIT_STRIPES];
+  pthread_mutex_t                                rate_limit_metrics_lock;
+  json_t *                                       j_rate_limit_throttled;
+  struct _pointer_list                           rate_limit_endpoint_list;
+  unsigned int                                   alloc_cache_size;
+  unsigned short                                 cache_invalidation_backend;
+  unsigned int                                   cache_invalidation_interval;
+  unsigned int                                   cache_invalidation_retention;
+  char *                                         cache_invalidation_conninfo;
+  char                                           cache_invalidation_node[GLEWLWYD_CACHE_INVALIDATION_NODE_LENGTH+1];
+  struct _pointer_list                           cache_invalidation_handler_list;
+  pthread_mutex_t                                cache_invalidation_lock;
+  pthread_cond_t                                 cache_invalidation_cond;
+  pthread_t                                      cache_invalidation_thread;
+  unsigned short                                 cache_invalidation_status;
+  unsigned int                                   http_client_timeout;
+  unsigned int                                   http_client_connect_timeout;
+  unsigned int                                   http_client_max_connections_per_host;
+  unsigned int                                   http_client_idle_timeout;
+  unsigned int                                   http_client_dns_cache_timeout;
+  unsigned int                                   http_client_max_idle_connections;
+  struct _glwd_http_client                     * http_client;
 };
 
 /**
@@ -417,6 +586,8 @@ struct config_plugin {
   json_t * (* glewlwyd_plugin_callback_get_user_list)(struct config_plugin * config, const char * pattern, size_t offset, size_t limit);
   json_t * (* glewlwyd_plugin_callback_get_user)(struct config_plugin * config, const char * username);
   json_t * (* glewlwyd_plugin_callback_get_user_profile)(struct config_plugin * config, const char * username);
+  int      (* glewlwyd_plugin_callback_get_user_view)(struct config_plugin * config, const char * username, const struct _glewlwyd_user_view ** view);
+  void     (* glewlwyd_plugin_callback_release_user_view)(struct config_plugin * config, const struct _glewlwyd_user_view * view);
   json_t * (* glewlwyd_plugin_callback_is_user_valid)(struct config_plugin * config, const char * username, json_t * j_user, int add);
   int      (* glewlwyd_plugin_callback_add_user)(struct config_plugin * config, json_t * j_user);
   int      (* glewlwyd_plugin_callback_set_user)(struct config_plugin * config, const char * username, json_t * j_user);
@@ -443,6 +614,18 @@ struct config_plugin {
   int      (* glewlwyd_plugin_callback_metrics_add_metric)(struct config_plugin * config, const char * name, const char * help);
   int      (* glewlwyd_plugin_callback_metrics_increment_counter)(struct config_plugin * config, const char * name, size_t inc, ...);
 
+  // Cluster cache invalidation functions
+  int      (* glewlwyd_plugin_callback_cache_invalidation_register)(struct config_plugin * config, const char * cache, glewlwyd_cache_invalidation_callback callback, void * cls);
+  int      (* glewlwyd_plugin_callback_cache_invalidation_unregister)(struct config_plugin * config, const char * cache, void * cls);
+  int      (* glewlwyd_plugin_callback_cache_invalidation_publish)(struct config_plugin * config, const char * cache, const char * key);
+
+  // Outbound HTTP requests using the shared connections
+  int      (* glewlwyd_plugin_callback_http_send_request)(struct config_plugin * config, const struct _u_request * request, struct _u_response * response);
+
+  // Admission control functions, to release the slot of a request waiting for an event
+  void     (* glewlwyd_plugin_callback_admission_suspend)(struct config_plugin * config);
+  void     (* glewlwyd_plugin_callback_admission_resume)(struct config_plugin * config);
+
   // Misc functions
   char   * (* glewlwyd_callback_get_plugin_external_url)(struct config_plugin * config, const char * name);
   char   * (* glewlwyd_callback_get_login_url)(struct config_plugin * config, const char * client_id, const char * scope_list, const char * callback_url, struct _u_map * additional_parameters);
@@ -469,6 +652,10 @@ struct config_module {
   int                    (* glewlwyd_module_callback_metrics_add_metric)(struct config_module * config, const char * name, const char * help);
   int                    (* glewlwyd_module_callback_metrics_increment_counter)(struct config_module * config, const char * name, size_t inc, ...);
   void                   (* glewlwyd_module_callback_update_issued_for)(struct config_module * config, const struct _h_connection * conn, const char * sql_table, const char * issued_for_column, const char * issued_for_value, const char * id_column, json_int_t id_value);
+  int                    (* glewlwyd_module_callback_cache_invalidation_register)(struct config_module * config, const char * cache, glewlwyd_cache_invalidation_callback callback, void * cls);
+  int                    (* glewlwyd_module_callback_cache_invalidation_unregister)(struct config_module * config, const char * cache, void * cls);
+  int                    (* glewlwyd_module_callback_cache_invalidation_publish)(struct config_module * config, const char * cache, const char * key);
+  int                    (* glewlwyd_module_callback_http_send_request)(struct config_module * config, const struct _u_request * request, struct _u_response * response);
 };
 
 /**
@@ -494,6 +681,30 @@ int check_result_value(json_t * result, const int value);
 
 int json_string_null_or_empty(json_t * j_str);
 
+/**
+ * Read-only queries, routed to a replica connection if available
+ */
+struct _h_connection * get_read_connection(struct config_elements * config, int read_mode);
+int select_read(struct config_elements * config, const json_t * j_query, json_t ** j_result, int read_mode);
+int execute_query_json_read(struct config_elements * config, const char * query, json_t ** j_result, int read_mode);
+
+/**
+ * Prepared statements, cached per connection
+ */
+int execute_statement_json(struct config_elements * config, struct _h_connection * conn, const struct _glwd_statement * statement, json_t * j_params, json_t ** j_result);
+int execute_statement_json_read(struct config_elements * config, const struct _glwd_statement * statement, json_t * j_params, json_t ** j_result, int read_mode);
+int init_prepared_statements(struct config_elements * config);
+
+/**
+ * Cache of the credentials verified by a remote service
+ * A duration of 0 disables the cache
+ */
+int  glewlwyd_credential_cache_init(struct _glwd_credential_cache * cache, time_t duration, size_t max_size);
+void glewlwyd_credential_cache_close(struct _glwd_credential_cache * cache);
+int  glewlwyd_credential_cache_check(struct _glwd_credential_cache * cache, const char * username, const char * password);
+void glewlwyd_credential_cache_set(struct _glwd_credential_cache * cache, const char * username, const char * password);
+void glewlwyd_credential_cache_remove(struct _glwd_credential_cache * cache, const char * username);
+
 /**
  * Modules functions prototypes
  */
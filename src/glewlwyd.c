@@ -26,6 +26,7 @@
  *
  */
 
+#include <ctype.h>
 #include <string.h>
 #include <getopt.h>
 #include <libconfig.h>
@@ -59,6 +60,7 @@ int main (int argc, char ** argv) {
   struct sockaddr_in bind_address, bind_address_metrics;
   pthread_t signal_thread_id;
   pthread_mutexattr_t mutexattr;
+  struct timespec modules_start, modules_end;
   static sigset_t close_signals;
   char * tmp, * tmp2;
 
@@ -95,6 +97,8 @@ int main (int argc, char ** argv) {
   config->config_p->glewlwyd_plugin_callback_get_user_list = &glewlwyd_plugin_callback_get_user_list;
   config->config_p->glewlwyd_plugin_callback_get_user = &glewlwyd_plugin_callback_get_user;
   config->config_p->glewlwyd_plugin_callback_get_user_profile = &glewlwyd_plugin_callback_get_user_profile;
+  config->config_p->glewlwyd_plugin_callback_get_user_view = &glewlwyd_plugin_callback_get_user_view;
+  config->config_p->glewlwyd_plugin_callback_release_user_view = &glewlwyd_plugin_callback_release_user_view;
   config->config_p->glewlwyd_plugin_callback_is_user_valid = &glewlwyd_plugin_callback_is_user_valid;
   config->config_p->glewlwyd_plugin_callback_add_user = &glewlwyd_plugin_callback_add_user;
   config->config_p->glewlwyd_plugin_callback_set_user = &glewlwyd_plugin_callback_set_user;
@@ -114,6 +118,12 @@ int main (int argc, char ** argv) {
   config->config_p->glewlwyd_plugin_callback_get_scheme_module = &glewlwyd_plugin_callback_get_scheme_module;
   config->config_p->glewlwyd_plugin_callback_metrics_add_metric = &glewlwyd_plugin_callback_metrics_add_metric;
   config->config_p->glewlwyd_plugin_callback_metrics_increment_counter = &glewlwyd_plugin_callback_metrics_increment_counter;
+  config->config_p->glewlwyd_plugin_callback_cache_invalidation_register = &glewlwyd_plugin_callback_cache_invalidation_register;
+  config->config_p->glewlwyd_plugin_callback_cache_invalidation_unregister = &glewlwyd_plugin_callback_cache_invalidation_unregister;
+  config->config_p->glewlwyd_plugin_callback_cache_invalidation_publish = &glewlwyd_plugin_callback_cache_invalidation_publish;
+  config->config_p->glewlwyd_plugin_callback_http_send_request = &glewlwyd_plugin_callback_http_send_request;
+  config->config_p->glewlwyd_plugin_callback_admission_suspend = &glewlwyd_plugin_callback_admission_suspend;
+  config->config_p->glewlwyd_plugin_callback_admission_resume = &glewlwyd_plugin_callback_admission_resume;
 
   // Init config structure with default values
   config->config_m->external_url = NULL;
@@ -129,6 +139,10 @@ int main (int argc, char ** argv) {
   config->config_m->glewlwyd_module_callback_metrics_add_metric = &glewlwyd_module_callback_metrics_add_metric;
   config->config_m->glewlwyd_module_callback_metrics_increment_counter = &glewlwyd_module_callback_metrics_increment_counter;
   config->config_m->glewlwyd_module_callback_update_issued_for = &glewlwyd_module_callback_update_issued_for;
+  config->config_m->glewlwyd_module_callback_cache_invalidation_register = &glewlwyd_module_callback_cache_invalidation_register;
+  config->config_m->glewlwyd_module_callback_cache_invalidation_unregister = &glewlwyd_module_callback_cache_invalidation_unregister;
+  config->config_m->glewlwyd_module_callback_cache_invalidation_publish = &glewlwyd_module_callback_cache_invalidation_publish;
+  config->config_m->glewlwyd_module_callback_http_send_request = &glewlwyd_module_callback_http_send_request;
   config->config_file = NULL;
   config->port = 0;
   config->max_post_size = GLEWLWYD_DEFAULT_MAX_POST_SIZE;
@@ -158,6 +172,11 @@ int main (int argc, char ** argv) {
   config->secure_connection_pem_file = NULL;
   config->secure_connection_ca_file = NULL;
   config->conn = NULL;
+  config->conn_replica = NULL;
+  config->conn_replica_count = 0;
+  config->conn_replica_index = 0;
+  config->use_prepared_statement = 1;
+  config->j_statement_cache = json_object();
   config->session_key = o_strdup(GLEWLWYD_DEFAULT_SESSION_KEY);
   config->session_expiration = GLEWLWYD_DEFAULT_SESSION_EXPIRATION_PASSWORD;
   config->salt_length = GLEWLWYD_DEFAULT_SALT_LENGTH;
@@ -184,6 +203,23 @@ int main (int argc, char ** argv) {
   config->metrics_endpoint = 0;
   config->metrics_endpoint_port = GLEWLWYD_DEFAULT_METRICS_PORT;
   config->metrics_endpoint_admin_session = 0;
+  config->module_init_max_parallel = GLEWLWYD_DEFAULT_MODULE_INIT_MAX_PARALLEL;
+  config->module_init_timeout = GLEWLWYD_DEFAULT_MODULE_INIT_TIMEOUT;
+  config->module_epoch_current = 1;
+  config->module_epoch_stripe = NULL;
+  config->module_reaper_status = GLEWLWYD_MODULE_REAPER_STOPPED;
+  pointer_list_init(&config->module_retired_list);
+  pointer_list_init(&config->plugin_endpoint_list);
+  config->plugin_endpoint_generation = 0;
+  config->j_scheme_can_use_cache = json_object();
+  config->scheme_can_use_cache_expiration = GLEWLWYD_DEFAULT_SCHEME_CAN_USE_CACHE_EXPIRATION;
+  config->scheme_can_use_cache_generation = 0;
+  config->alloc_cache_size = GLEWLWYD_DEFAULT_ALLOC_CACHE_SIZE;
+  config->j_api_key_cache = NULL;
+  config->api_key_cache_loaded_at = 0;
+  config->api_key_cache_generation = 0;
+  config->j_api_key_counter = json_object();
+  config->api_key_counter_flushed_at = time(NULL);
   http_comression_config.allow_gzip = 1;
   http_comression_config.allow_deflate = 1;
 
@@ -198,6 +234,48 @@ int main (int argc, char ** argv) {
     fprintf(stderr, "Error initializing insert mutex\n");
     exit_server(&config, GLEWLWYD_ERROR);
   }
+  if (pthread_mutex_init(&config->endpoint_lock, NULL) != 0) {
+    fprintf(stderr, "Error initializing endpoint mutex\n");
+    exit_server(&config, GLEWLWYD_ERROR);
+  }
+  if (glewlwyd_module_epoch_init(config) != G_OK) {
+    fprintf(stderr, "Error initializing module epoch\n");
+    exit_server(&config, GLEWLWYD_ERROR);
+  }
+  if (glewlwyd_module_reaper_start(config) != G_OK) {
+    fprintf(stderr, "Error starting module reaper\n");
+    exit_server(&config, GLEWLWYD_ERROR);
+  }
+  if (pthread_mutex_init(&config->scheme_can_use_cache_lock, NULL) != 0) {
+    fprintf(stderr, "Error initializing scheme can_use cache mutex\n");
+    exit_server(&config, GLEWLWYD_ERROR);
+  }
+  if (pthread_mutex_init(&config->api_key_lock, NULL) != 0) {
+    fprintf(stderr, "Error initializing api key mutex\n");
+    exit_server(&config, GLEWLWYD_ERROR);
+  }
+  if (pthread_mutex_init(&config->statement_lock, NULL) != 0) {
+    fprintf(stderr, "Error initializing statement mutex\n");
+    exit_server(&config, GLEWLWYD_ERROR);
+  }
+  if (glewlwyd_admission_init(config) != G_OK) {
+    fprintf(stderr, "Error initializing admission control\n");
+    exit_server(&config, GLEWLWYD_ERROR);
+  }
+  if (glewlwyd_rate_limit_init(config) != G_OK) {
+    fprintf(stderr, "Error initializing rate limit\n");
+    exit_server(&config, GLEWLWYD_ERROR);
+  }
+  if (glewlwyd_cache_invalidation_init(config) != G_OK ||
+      glewlwyd_cache_invalidation_register(config, GLEWLWYD_CACHE_SCHEME_CAN_USE, &invalidate_scheme_can_use_cache_callback, config) != G_OK ||
+      glewlwyd_cache_invalidation_register(config, GLEWLWYD_CACHE_API_KEY, &invalidate_api_key_cache_callback, config) != G_OK) {
+    fprintf(stderr, "Error initializing cache invalidation\n");
+    exit_server(&config, GLEWLWYD_ERROR);
+  }
+  if (glewlwyd_http_client_init(config) != G_OK) {
+    fprintf(stderr, "Error initializing http client\n");
+    exit_server(&config, GLEWLWYD_ERROR);
+  }
   pthread_mutexattr_destroy(&mutexattr);
 
   config->static_file_config = o_malloc(sizeof(struct _u_compressed_inmemory_website_config));
@@ -268,6 +346,12 @@ int main (int argc, char ** argv) {
     exit_server(&config, GLEWLWYD_ERROR);
   }
 
+  // Must be set before any thread is started
+  if (glewlwyd_alloc_cache_init(config) != G_OK) {
+    fprintf(stderr, "Error initializing allocation cache\n");
+    exit_server(&config, GLEWLWYD_ERROR);
+  }
+
   if (config->log_mode != Y_LOG_MODE_NONE && config->log_level != Y_LOG_LEVEL_NONE && !y_init_logs(GLEWLWYD_LOG_NAME, config->log_mode, config->log_level, config->log_file, "Starting Glewlwyd SSO authentication service")) {
     fprintf(stderr, "Error initializing logs\n");
     return 0;
@@ -350,6 +434,15 @@ int main (int argc, char ** argv) {
   config->config_m->conn = config->conn;
   config->config_m->hash_algorithm = config->hash_algorithm;
 
+  // Check the prepared statements support of the database servers
+  if (init_prepared_statements(config) != G_OK) {
+    fprintf(stderr, "Error initializing prepared statements\n");
+    exit_server(&config, GLEWLWYD_ERROR);
+  }
+
+  // Initialize modules in dependency order, instances of the same type are initialized in parallel
+  clock_gettime(CLOCK_MONOTONIC, &modules_start);
+
   // Initialize user modules
   if (init_user_module_list(config) != G_OK) {
     fprintf(stderr, "Error initializing user modules\n");
@@ -399,149 +492,163 @@ int main (int argc, char ** argv) {
     fprintf(stderr, "Error loading plugins modules instances\n");
     exit_server(&config, GLEWLWYD_ERROR);
   }
+  clock_gettime(CLOCK_MONOTONIC, &modules_end);
+  y_log_message(Y_LOG_LEVEL_INFO, "Modules initialized in %ld ms", (long)((modules_end.tv_sec - modules_start.tv_sec) * 1000 + (modules_end.tv_nsec - modules_start.tv_nsec) / 1000000));
+
+  // Receive the cache invalidation events from the other instances
+  if (glewlwyd_cache_invalidation_start(config) != G_OK) {
+    fprintf(stderr, "Error starting cache invalidation\n");
+    exit_server(&config, GLEWLWYD_ERROR);
+  }
+
+  // Close the expired idle outbound connections
+  if (glewlwyd_http_client_start(config) != G_OK) {
+    fprintf(stderr, "Error starting http client\n");
+    exit_server(&config, GLEWLWYD_ERROR);
+  }
 
   // At this point, we declare all API endpoints and configure
 
   // Authentication
-  ulfius_add_endpoint_by_val(config->instance, "POST", config->api_prefix, "/auth/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_auth, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "POST", config->api_prefix, "/auth/scheme/trigger/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_auth_trigger, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/auth/scheme/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_schemes_from_scopes, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "DELETE", config->api_prefix, "/auth/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_delete_session, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "POST", config->api_prefix, "/auth/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_auth, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "POST", config->api_prefix, "/auth/scheme/trigger/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_auth_trigger, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "GET", config->api_prefix, "/auth/scheme/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_schemes_from_scopes, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "DELETE", config->api_prefix, "/auth/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_delete_session, (void*)config);
 
   // User profile
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/profile_list/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_profile, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "GET", config->api_prefix, "/profile_list/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_profile, (void*)config);
   ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/profile_list/", GLEWLWYD_CALLBACK_PRIORITY_COMPRESSION, &callback_http_compression, &http_comression_config);
-  ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/profile/", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_user_profile_valid, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/profile/password", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_user_profile_valid, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/profile/plugin", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_user_session, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/profile/grant", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_user_profile_valid, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/profile/scheme/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_user_profile_valid, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/profile/session/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_user_session, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "*", config->api_prefix, "/profile/", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_user_profile_valid, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "*", config->api_prefix, "/profile/password", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_user_profile_valid, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "*", config->api_prefix, "/profile/plugin", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_user_session, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "*", config->api_prefix, "/profile/grant", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_user_profile_valid, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "*", config->api_prefix, "/profile/scheme/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_user_profile_valid, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "*", config->api_prefix, "/profile/session/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_user_session, (void*)config);
   ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/profile/*", GLEWLWYD_CALLBACK_PRIORITY_COMPRESSION, &callback_http_compression, &http_comression_config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/profile/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_update_profile, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "DELETE", config->api_prefix, "/profile/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_delete_profile, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/profile/password", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_update_password, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/profile/plugin", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_plugin_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/profile/grant", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_client_grant_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/profile/session", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_session_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "DELETE", config->api_prefix, "/profile/session/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_session, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "DELETE", config->api_prefix, "/profile/session/:session_hash", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_session, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/profile/scheme", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_scheme_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/profile/scheme/register/*", GLEWLWYD_CALLBACK_PRIORITY_PRE_APPLICATION, &callback_glewlwyd_scheme_check_forbid_profile, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "POST", config->api_prefix, "/profile/scheme/register/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_auth_register, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/profile/scheme/register/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_auth_register_get, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "PUT", config->api_prefix, "/profile/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_update_profile, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "DELETE", config->api_prefix, "/profile/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_delete_profile, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "PUT", config->api_prefix, "/profile/password", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_update_password, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "GET", config->api_prefix, "/profile/plugin", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_plugin_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "GET", config->api_prefix, "/profile/grant", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_client_grant_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "GET", config->api_prefix, "/profile/session", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_session_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "DELETE", config->api_prefix, "/profile/session/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_session, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "DELETE", config->api_prefix, "/profile/session/:session_hash", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_session, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "GET", config->api_prefix, "/profile/scheme", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_scheme_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "*", config->api_prefix, "/profile/scheme/register/*", GLEWLWYD_CALLBACK_PRIORITY_PRE_APPLICATION, &callback_glewlwyd_scheme_check_forbid_profile, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "POST", config->api_prefix, "/profile/scheme/register/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_auth_register, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "PUT", config->api_prefix, "/profile/scheme/register/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_auth_register_get, (void*)config);
 
   // Grant scopes endpoints
-  ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/auth/grant/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_user_session, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/auth/grant/:client_id/:scope_list", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_user_session_scope_grant, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/auth/grant/:client_id/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_user_session_scope_grant, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "*", config->api_prefix, "/auth/grant/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_user_session, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "GET", config->api_prefix, "/auth/grant/:client_id/:scope_list", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_user_session_scope_grant, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_AUTH, "PUT", config->api_prefix, "/auth/grant/:client_id/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_user_session_scope_grant, (void*)config);
   ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/auth/grant/*", GLEWLWYD_CALLBACK_PRIORITY_COMPRESSION, &callback_http_compression, &http_comression_config);
 
   // User profile by delegation
-  ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/delegate/:username/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_admin_session_delegate, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "*", config->api_prefix, "/delegate/:username/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_admin_session_delegate, (void*)config);
   ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/delegate/:username/*", GLEWLWYD_CALLBACK_PRIORITY_COMPRESSION, &callback_http_compression, &http_comression_config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/delegate/:username/profile/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_update_profile, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/delegate/:username/profile/session", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_session_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/delegate/:username/profile/plugin", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_plugin_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/delegate/:username/profile/grant", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_client_grant_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/delegate/:username/auth/grant/:client_id", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_user_session_scope_grant, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "DELETE", config->api_prefix, "/delegate/:username/profile/session/:session_hash", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_session, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/delegate/:username/profile/scheme", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_scheme_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "POST", config->api_prefix, "/delegate/:username/profile/scheme/register/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_auth_register_delegate, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/delegate/:username/profile/scheme/register/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_auth_register_get_delegate, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "PUT", config->api_prefix, "/delegate/:username/profile/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_update_profile, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/delegate/:username/profile/session", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_session_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/delegate/:username/profile/plugin", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_plugin_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/delegate/:username/profile/grant", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_client_grant_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "PUT", config->api_prefix, "/delegate/:username/auth/grant/:client_id", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_user_session_scope_grant, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "DELETE", config->api_prefix, "/delegate/:username/profile/session/:session_hash", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_session, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/delegate/:username/profile/scheme", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_get_scheme_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "POST", config->api_prefix, "/delegate/:username/profile/scheme/register/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_auth_register_delegate, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "PUT", config->api_prefix, "/delegate/:username/profile/scheme/register/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_user_auth_register_get_delegate, (void*)config);
 
   // Modules check session
-  ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/mod/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_admin_session_or_api_key, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "*", config->api_prefix, "/mod/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_admin_session_or_api_key, (void*)config);
   ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/mod/*", GLEWLWYD_CALLBACK_PRIORITY_COMPRESSION, &callback_http_compression, &http_comression_config);
 
   // Get all module types available
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/mod/type/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_module_type_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/mod/reload/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_reload_modules, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/mod/type/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_module_type_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "PUT", config->api_prefix, "/mod/reload/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_reload_modules, (void*)config);
 
   // User modules management
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/mod/user/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_user_module_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/mod/user/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_user_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "POST", config->api_prefix, "/mod/user/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_add_user_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/mod/user/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_user_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "DELETE", config->api_prefix, "/mod/user/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_user_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/mod/user/:name/:action", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_manage_user_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/mod/user/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_user_module_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/mod/user/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_user_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "POST", config->api_prefix, "/mod/user/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_add_user_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "PUT", config->api_prefix, "/mod/user/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_user_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "DELETE", config->api_prefix, "/mod/user/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_user_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "PUT", config->api_prefix, "/mod/user/:name/:action", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_manage_user_module, (void*)config);
 
   // User middleware modules management
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/mod/user_middleware/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_user_middleware_module_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/mod/user_middleware/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_user_middleware_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "POST", config->api_prefix, "/mod/user_middleware/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_add_user_middleware_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/mod/user_middleware/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_user_middleware_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "DELETE", config->api_prefix, "/mod/user_middleware/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_user_middleware_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/mod/user_middleware/:name/:action", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_manage_user_middleware_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/mod/user_middleware/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_user_middleware_module_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/mod/user_middleware/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_user_middleware_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "POST", config->api_prefix, "/mod/user_middleware/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_add_user_middleware_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "PUT", config->api_prefix, "/mod/user_middleware/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_user_middleware_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "DELETE", config->api_prefix, "/mod/user_middleware/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_user_middleware_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "PUT", config->api_prefix, "/mod/user_middleware/:name/:action", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_manage_user_middleware_module, (void*)config);
 
   // User auth scheme modules management
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/mod/scheme/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_user_auth_scheme_module_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/mod/scheme/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_user_auth_scheme_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "POST", config->api_prefix, "/mod/scheme/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_add_user_auth_scheme_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/mod/scheme/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_user_auth_scheme_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "DELETE", config->api_prefix, "/mod/scheme/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_user_auth_scheme_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/mod/scheme/:name/:action", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_manage_user_auth_scheme_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/mod/scheme/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_user_auth_scheme_module_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/mod/scheme/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_user_auth_scheme_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "POST", config->api_prefix, "/mod/scheme/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_add_user_auth_scheme_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "PUT", config->api_prefix, "/mod/scheme/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_user_auth_scheme_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "DELETE", config->api_prefix, "/mod/scheme/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_user_auth_scheme_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "PUT", config->api_prefix, "/mod/scheme/:name/:action", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_manage_user_auth_scheme_module, (void*)config);
 
   // Client modules management
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/mod/client/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_client_module_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/mod/client/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_client_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "POST", config->api_prefix, "/mod/client/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_add_client_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/mod/client/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_client_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "DELETE", config->api_prefix, "/mod/client/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_client_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/mod/client/:name/:action", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_manage_client_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/mod/client/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_client_module_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/mod/client/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_client_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "POST", config->api_prefix, "/mod/client/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_add_client_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "PUT", config->api_prefix, "/mod/client/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_client_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "DELETE", config->api_prefix, "/mod/client/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_client_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "PUT", config->api_prefix, "/mod/client/:name/:action", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_manage_client_module, (void*)config);
 
   // Plugin modules management
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/mod/plugin/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_plugin_module_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/mod/plugin/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_plugin_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "POST", config->api_prefix, "/mod/plugin/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_add_plugin_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/mod/plugin/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_plugin_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "DELETE", config->api_prefix, "/mod/plugin/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_plugin_module, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/mod/plugin/:name/:action", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_manage_plugin_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/mod/plugin/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_plugin_module_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/mod/plugin/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_plugin_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "POST", config->api_prefix, "/mod/plugin/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_add_plugin_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "PUT", config->api_prefix, "/mod/plugin/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_plugin_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "DELETE", config->api_prefix, "/mod/plugin/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_plugin_module, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "PUT", config->api_prefix, "/mod/plugin/:name/:action", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_manage_plugin_module, (void*)config);
 
   // Users CRUD
-  ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/user/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_admin_session_or_api_key, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "*", config->api_prefix, "/user/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_admin_session_or_api_key, (void*)config);
   ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/user/*", GLEWLWYD_CALLBACK_PRIORITY_COMPRESSION, &callback_http_compression, &http_comression_config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/user/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_user_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/user/:username", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_user, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "POST", config->api_prefix, "/user/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_add_user, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/user/:username", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_user, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "DELETE", config->api_prefix, "/user/:username", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_user, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/user/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_user_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/user/:username", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_user, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "POST", config->api_prefix, "/user/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_add_user, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "PUT", config->api_prefix, "/user/:username", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_user, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "DELETE", config->api_prefix, "/user/:username", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_user, (void*)config);
 
   // Clients CRUD
-  ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/client/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_admin_session_or_api_key, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "*", config->api_prefix, "/client/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_admin_session_or_api_key, (void*)config);
   ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/client/*", GLEWLWYD_CALLBACK_PRIORITY_COMPRESSION, &callback_http_compression, &http_comression_config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/client/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_client_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/client/:client_id", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_client, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "POST", config->api_prefix, "/client/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_add_client, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/client/:client_id", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_client, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "DELETE", config->api_prefix, "/client/:client_id", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_client, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/client/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_client_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/client/:client_id", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_client, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "POST", config->api_prefix, "/client/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_add_client, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "PUT", config->api_prefix, "/client/:client_id", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_client, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "DELETE", config->api_prefix, "/client/:client_id", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_client, (void*)config);
 
   // Scopes CRUD
-  ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/scope/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_admin_session_or_api_key, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "*", config->api_prefix, "/scope/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_admin_session_or_api_key, (void*)config);
   ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/scope/*", GLEWLWYD_CALLBACK_PRIORITY_COMPRESSION, &callback_http_compression, &http_comression_config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/scope/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_scope_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/scope/:scope", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_scope, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "POST", config->api_prefix, "/scope/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_add_scope, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/scope/:scope", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_scope, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "DELETE", config->api_prefix, "/scope/:scope", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_scope, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/scope/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_scope_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/scope/:scope", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_scope, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "POST", config->api_prefix, "/scope/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_add_scope, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "PUT", config->api_prefix, "/scope/:scope", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_scope, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "DELETE", config->api_prefix, "/scope/:scope", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_scope, (void*)config);
 
   // API key CRD
-  ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/key/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_admin_session, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "*", config->api_prefix, "/key/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_admin_session, (void*)config);
   ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/key/*", GLEWLWYD_CALLBACK_PRIORITY_COMPRESSION, &callback_http_compression, &http_comression_config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/key/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_api_key_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "DELETE", config->api_prefix, "/key/:key_hash", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_api_key, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "POST", config->api_prefix, "/key/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_add_api_key, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/key/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_api_key_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "DELETE", config->api_prefix, "/key/:key_hash", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_api_key, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "POST", config->api_prefix, "/key/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_add_api_key, (void*)config);
 
   // Misc configuration CRUD
-  ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/misc/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_admin_session, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "*", config->api_prefix, "/misc/*", GLEWLWYD_CALLBACK_PRIORITY_AUTHENTICATION, &callback_glewlwyd_check_admin_session, (void*)config);
   ulfius_add_endpoint_by_val(config->instance, "*", config->api_prefix, "/misc/*", GLEWLWYD_CALLBACK_PRIORITY_COMPRESSION, &callback_http_compression, &http_comression_config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/misc/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_misc_config_list, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "GET", config->api_prefix, "/misc/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_misc_config, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "PUT", config->api_prefix, "/misc/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_misc_config, (void*)config);
-  ulfius_add_endpoint_by_val(config->instance, "DELETE", config->api_prefix, "/misc/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_misc_config, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/misc/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_misc_config_list, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "GET", config->api_prefix, "/misc/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_get_misc_config, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "PUT", config->api_prefix, "/misc/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_set_misc_config, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_ADMIN, "DELETE", config->api_prefix, "/misc/:name", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_delete_misc_config, (void*)config);
 
   // Other configuration
-  ulfius_add_endpoint_by_val(config->instance, "GET", "/config", NULL, GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_server_configuration, (void*)config);
+  glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_STATIC, "GET", "/config", NULL, GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_glewlwyd_server_configuration, (void*)config);
   ulfius_add_endpoint_by_val(config->instance, "GET", "/config", NULL, GLEWLWYD_CALLBACK_PRIORITY_COMPRESSION, &callback_http_compression, &http_comression_config);
   ulfius_add_endpoint_by_val(config->instance, "OPTIONS", NULL, "*", GLEWLWYD_CALLBACK_PRIORITY_ZERO, &callback_glewlwyd_options, (void*)config);
   ulfius_add_endpoint_by_val(config->instance, "GET", NULL, "*", GLEWLWYD_CALLBACK_PRIORITY_POST_FILE, &callback_404_if_necessary, NULL);
@@ -549,7 +656,7 @@ int main (int argc, char ** argv) {
 
   // Static files server
   if (config->static_file_config->files_path != NULL) {
-    ulfius_add_endpoint_by_val(config->instance, "GET", NULL, "*", GLEWLWYD_CALLBACK_PRIORITY_FILE, &callback_static_compressed_inmemory_website, (void*)config->static_file_config);
+    glewlwyd_add_admission_endpoint(config, GLEWLWYD_ADMISSION_CLASS_STATIC, "GET", NULL, "*", GLEWLWYD_CALLBACK_PRIORITY_FILE, &callback_static_compressed_inmemory_website, (void*)config->static_file_config);
   }
   // Set default headers
   u_map_put(config->instance->default_headers, "Access-Control-Allow-Origin", config->allow_origin);
@@ -659,10 +766,21 @@ int main (int argc, char ** argv) {
  */
 void exit_server(struct config_elements ** config, int exit_value) {
   int close_logs = 0;
+  size_t i;
 
   if (config != NULL && *config != NULL) {
     close_logs = ((*config)->log_mode != Y_LOG_MODE_NONE && (*config)->log_level != Y_LOG_LEVEL_NONE);
 
+    // Stop the cache invalidation thread before the modules are closed
+    glewlwyd_cache_invalidation_stop(*config);
+
+    glewlwyd_module_reaper_stop(*config);
+    reap_retired_module_data(*config, 1);
+
+    if ((*config)->conn != NULL && flush_api_key_counter(*config) != G_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "exit_server - Error flush_api_key_counter");
+    }
+
     close_user_module_instance_list(*config);
     close_user_module_list(*config);
 
@@ -678,14 +796,29 @@ void exit_server(struct config_elements ** config, int exit_value) {
     close_plugin_module_instance_list(*config);
     close_plugin_module_list(*config);
 
+    reap_retired_module_data(*config, 1);
+    glewlwyd_module_epoch_close(*config);
     pthread_mutex_destroy(&(*config)->module_lock);
     pthread_mutex_destroy(&(*config)->insert_lock);
+    pthread_mutex_destroy(&(*config)->endpoint_lock);
+    pthread_mutex_destroy(&(*config)->scheme_can_use_cache_lock);
+    json_decref((*config)->j_scheme_can_use_cache);
+    pthread_mutex_destroy(&(*config)->api_key_lock);
+    json_decref((*config)->j_api_key_cache);
+    json_decref((*config)->j_api_key_counter);
+    pthread_mutex_destroy(&(*config)->statement_lock);
+    json_decref((*config)->j_statement_cache);
 
     /* stop framework */
     if ((*config)->instance_initialized) {
       ulfius_stop_framework((*config)->instance);
       ulfius_clean_instance((*config)->instance);
     }
+    glewlwyd_plugin_endpoint_close(*config);
+    glewlwyd_admission_close(*config);
+    glewlwyd_rate_limit_close(*config);
+    glewlwyd_cache_invalidation_close(*config);
+    glewlwyd_http_client_close(*config);
 
     if ((*config)->instance_metrics_initialized) {
       ulfius_stop_framework((*config)->instance_metrics);
@@ -694,6 +827,11 @@ void exit_server(struct config_elements ** config, int exit_value) {
 
     h_close_db((*config)->conn);
     h_clean_connection((*config)->conn);
+    for (i=0; i<(*config)->conn_replica_count; i++) {
+      h_close_db((*config)->conn_replica[i]);
+      h_clean_connection((*config)->conn_replica[i]);
+    }
+    o_free((*config)->conn_replica);
     ulfius_global_close();
 
     // Cleaning data
@@ -879,13 +1017,66 @@ int build_config_from_args(int argc, char ** argv, struct config_elements * conf
  * Initialize the application configuration based on the config file content
  * Read the config file, get mandatory variables and devices
  */
+/**
+ * Opens a read-only replica connection, the format is the same as the database configuration
+ * {"type": "mariadb", "host": "replica", "user": "glewlwyd", "password": "glewlwyd", "dbname": "glewlwyd", "port": 0}
+ * {"type": "postgre", "conninfo": "host=replica dbname=glewlwyd"}
+ */
+static int add_replica_connection(struct config_elements * config, json_t * j_replica) {
+  struct _h_connection * conn = NULL;
+  int ret = G_OK;
+
+  if (0 == o_strcmp("mariadb", json_string_value(json_object_get(j_replica, "type")))) {
+    if ((conn = h_connect_mariadb(json_string_value(json_object_get(j_replica, "host")), json_string_value(json_object_get(j_replica, "user")), json_string_value(json_object_get(j_replica, "password")), json_string_value(json_object_get(j_replica, "dbname")), (unsigned int)json_integer_value(json_object_get(j_replica, "port")), NULL)) != NULL) {
+      if (h_execute_query_mariadb(conn, "SET sql_mode='PIPES_AS_CONCAT';", NULL) != H_OK) {
+        fprintf(stderr, "Error executing mariadb query 'SET sql_mode='PIPES_AS_CONCAT';' on replica\n");
+        ret = G_ERROR_PARAM;
+      }
+    } else {
+      fprintf(stderr, "Error opening mariadb replica database %s\n", json_string_value(json_object_get(j_replica, "host")));
+      ret = G_ERROR_PARAM;
+    }
+  } else if (0 == o_strcmp("postgre", json_string_value(json_object_get(j_replica, "type")))) {
+    if ((conn = h_connect_pgsql(json_string_value(json_object_get(j_replica, "conninfo")))) == NULL) {
+      fprintf(stderr, "Error opening postgre replica database %s\n", json_string_value(json_object_get(j_replica, "conninfo")));
+      ret = G_ERROR_PARAM;
+    }
+  } else {
+    fprintf(stderr, "Error - replica database type must be mariadb or postgre\n");
+    ret = G_ERROR_PARAM;
+  }
+  if (ret == G_OK) {
+    if ((config->conn_replica = o_realloc(config->conn_replica, (config->conn_replica_count+1)*sizeof(struct _h_connection *))) != NULL) {
+      config->conn_replica[config->conn_replica_count] = conn;
+      config->conn_replica_count++;
+    } else {
+      fprintf(stderr, "Error allocating resources for conn_replica\n");
+      config->conn_replica_count = 0;
+      ret = G_ERROR_MEMORY;
+    }
+  }
+  if (ret != G_OK && conn != NULL) {
+    h_close_db(conn);
+    h_clean_connection(conn);
+  }
+  return ret;
+}
+
 int build_config_from_file(struct config_elements * config) {
 
   config_t cfg;
   config_setting_t * root = NULL,
                    * database = NULL,
                    * mime_type_list = NULL,
-                   * mime_type = NULL;
+                   * mime_type = NULL,
+                   * admission_control = NULL,
+                   * admission_class = NULL,
+                   * rate_limit_list = NULL,
+                   * rate_limit = NULL,
+                   * rate_limit_type = NULL,
+                   * cache_invalidation = NULL,
+                   * http_client = NULL,
+                   * database_replica_list = NULL;
   const char * str_value = NULL,
              * str_value_2 = NULL,
              * str_value_3 = NULL,
@@ -894,9 +1085,11 @@ int build_config_from_file(struct config_elements * config) {
   int int_value = 0,
       int_value_2 = 0,
       int_value_3 = 0,
-      i,
+      i, j,
       ret = G_OK;
   char * one_log_mode, * real_path;
+  json_t * j_rate_limit, * j_replica;
+  static const char * rate_limit_types[] = {"ip", "username", "client_id", NULL};
 
   config_init(&cfg);
 
@@ -1227,6 +1420,8 @@ int build_config_from_file(struct config_elements * config) {
             ret = G_ERROR_PARAM;
             break;
           }
+          o_free(config->cache_invalidation_conninfo);
+          config->cache_invalidation_conninfo = o_strdup(str_value_2);
         } else {
           fprintf(stderr, "Error - database type unknown\n");
           ret = G_ERROR_PARAM;
@@ -1237,12 +1432,39 @@ int build_config_from_file(struct config_elements * config) {
         ret = G_ERROR_PARAM;
         break;
       }
+      if (config_setting_lookup_bool(database, "prepared_statement", &int_value) == CONFIG_TRUE) {
+        config->use_prepared_statement = (uint)int_value;
+      }
     } else {
       fprintf(stderr, "Error - no database setting found\n");
       ret = G_ERROR_PARAM;
       break;
     }
 
+    database_replica_list = config_setting_get_member(root, "database_replica");
+    if (database_replica_list != NULL) {
+      for (i=0; i<config_setting_length(database_replica_list) && ret == G_OK; i++) {
+        database = config_setting_get_elem(database_replica_list, i);
+        str_value = str_value_2 = str_value_3 = str_value_4 = str_value_5 = NULL;
+        int_value = 0;
+        config_setting_lookup_string(database, "type", &str_value);
+        config_setting_lookup_string(database, "host", &str_value_2);
+        config_setting_lookup_string(database, "user", &str_value_3);
+        config_setting_lookup_string(database, "password", &str_value_4);
+        config_setting_lookup_string(database, "dbname", &str_value_5);
+        config_setting_lookup_int(database, "port", &int_value);
+        j_replica = json_pack("{sssssssssssi}", "type", str_value!=NULL?str_value:"", "host", str_value_2!=NULL?str_value_2:"", "user", str_value_3!=NULL?str_value_3:"", "password", str_value_4!=NULL?str_value_4:"", "dbname", str_value_5!=NULL?str_value_5:"", "port", int_value);
+        if (config_setting_lookup_string(database, "conninfo", &str_value) == CONFIG_TRUE) {
+          json_object_set_new(j_replica, "conninfo", json_string(str_value));
+        }
+        ret = add_replica_connection(config, j_replica);
+        json_decref(j_replica);
+      }
+      if (ret != G_OK) {
+        break;
+      }
+    }
+
     if (config_lookup_string(&cfg, "admin_scope", &str_value) == CONFIG_TRUE) {
       o_free(config->admin_scope);
       config->admin_scope = o_strdup(str_value);
@@ -1278,6 +1500,111 @@ int build_config_from_file(struct config_elements * config) {
       config->plugin_module_path = o_strdup(str_value);
     }
 
+    if (config_lookup_int(&cfg, "module_init_max_parallel", &int_value) == CONFIG_TRUE) {
+      config->module_init_max_parallel = (uint)int_value;
+    }
+
+    if (config_lookup_int(&cfg, "module_init_timeout", &int_value) == CONFIG_TRUE) {
+      config->module_init_timeout = (uint)int_value;
+    }
+
+    if (config_lookup_int(&cfg, "scheme_can_use_cache_expiration", &int_value) == CONFIG_TRUE) {
+      config->scheme_can_use_cache_expiration = (uint)int_value;
+    }
+
+    if (config_lookup_int(&cfg, "alloc_cache_size", &int_value) == CONFIG_TRUE) {
+      config->alloc_cache_size = (uint)int_value;
+    }
+
+    admission_control = config_lookup(&cfg, "admission_control");
+    if (admission_control != NULL) {
+      if (config_setting_lookup_int(admission_control, "retry_after", &int_value) == CONFIG_TRUE) {
+        config->admission_retry_after = (uint)int_value;
+      }
+      for (i=0; i<GLEWLWYD_ADMISSION_CLASS_COUNT; i++) {
+        admission_class = config_setting_get_member(admission_control, config->admission_class[i].name);
+        if (admission_class != NULL) {
+          if (config_setting_lookup_int(admission_class, "max_concurrent", &int_value) == CONFIG_TRUE) {
+            config->admission_class[i].max_concurrent = (uint)int_value;
+          }
+          if (config_setting_lookup_int(admission_class, "max_queue", &int_value) == CONFIG_TRUE) {
+            config->admission_class[i].max_queue = (uint)int_value;
+          }
+          if (config_setting_lookup_int(admission_class, "queue_timeout", &int_value) == CONFIG_TRUE) {
+            config->admission_class[i].queue_timeout = (uint)int_value;
+          }
+        }
+      }
+    }
+
+    cache_invalidation = config_lookup(&cfg, "cache_invalidation");
+    if (cache_invalidation != NULL) {
+      if (config_setting_lookup_string(cache_invalidation, "backend", &str_value) == CONFIG_TRUE && glewlwyd_cache_invalidation_set_backend(config, str_value) != G_OK) {
+        ret = G_ERROR_PARAM;
+        break;
+      }
+      if (config_setting_lookup_int(cache_invalidation, "interval", &int_value) == CONFIG_TRUE) {
+        config->cache_invalidation_interval = (uint)int_value;
+      }
+      if (config_setting_lookup_int(cache_invalidation, "retention", &int_value) == CONFIG_TRUE) {
+        config->cache_invalidation_retention = (uint)int_value;
+      }
+      if (config_setting_lookup_string(cache_invalidation, "conninfo", &str_value) == CONFIG_TRUE) {
+        o_free(config->cache_invalidation_conninfo);
+        config->cache_invalidation_conninfo = o_strdup(str_value);
+      }
+    }
+
+    http_client = config_lookup(&cfg, "http_client");
+    if (http_client != NULL) {
+      if (config_setting_lookup_int(http_client, "timeout", &int_value) == CONFIG_TRUE) {
+        config->http_client_timeout = (uint)int_value;
+      }
+      if (config_setting_lookup_int(http_client, "connect_timeout", &int_value) == CONFIG_TRUE) {
+        config->http_client_connect_timeout = (uint)int_value;
+      }
+      if (config_setting_lookup_int(http_client, "max_connections_per_host", &int_value) == CONFIG_TRUE) {
+        config->http_client_max_connections_per_host = (uint)int_value;
+      }
+      if (config_setting_lookup_int(http_client, "idle_timeout", &int_value) == CONFIG_TRUE) {
+        config->http_client_idle_timeout = (uint)int_value;
+      }
+      if (config_setting_lookup_int(http_client, "dns_cache_timeout", &int_value) == CONFIG_TRUE) {
+        config->http_client_dns_cache_timeout = (uint)int_value;
+      }
+      if (config_setting_lookup_int(http_client, "max_idle_connections", &int_value) == CONFIG_TRUE) {
+        config->http_client_max_idle_connections = (uint)int_value;
+      }
+    }
+
+    rate_limit_list = config_lookup(&cfg, "rate_limit");
+    if (rate_limit_list != NULL) {
+      for (i=0; i<config_setting_length(rate_limit_list) && ret == G_OK; i++) {
+        rate_limit = config_setting_get_elem(rate_limit_list, i);
+        if (config_setting_lookup_string(rate_limit, "endpoint", &str_value) == CONFIG_TRUE) {
+          j_rate_limit = json_pack("{ss}", "endpoint", str_value);
+          for (j=0; rate_limit_types[j] != NULL; j++) {
+            if ((rate_limit_type = config_setting_get_member(rate_limit, rate_limit_types[j])) != NULL &&
+                config_setting_lookup_int(rate_limit_type, "rate", &int_value) == CONFIG_TRUE &&
+                config_setting_lookup_int(rate_limit_type, "burst", &int_value_2) == CONFIG_TRUE) {
+              json_object_set_new(j_rate_limit, rate_limit_types[j], json_pack("{sisi}", "rate", int_value, "burst", int_value_2));
+            }
+          }
+          if (glewlwyd_rate_limit_set_endpoint(config, j_rate_limit) != G_OK) {
+            fprintf(stderr, "Error rate_limit for endpoint %s, exiting\n", str_value);
+            ret = G_ERROR_PARAM;
+          }
+          json_decref(j_rate_limit);
+        } else {
+          fprintf(stderr, "Error rate_limit, endpoint is mandatory, exiting\n");
+          ret = G_ERROR_PARAM;
+        }
+      }
+      if (ret != G_OK) {
+        break;
+      }
+    }
+
     if (config_lookup_bool(&cfg, "metrics_endpoint", &int_value) == CONFIG_TRUE) {
       config->metrics_endpoint = (ushort)int_value;
 
@@ -1307,11 +1634,36 @@ int build_config_from_file(struct config_elements * config) {
 /**
  * Initialize the application configuration based on the environment variables
  */
+/**
+ * Reads an admission class value from the environment variable
+ * built with the upper case class name, e.g. GLWD_ADMISSION_TOKEN_MAX_CONCURRENT
+ */
+static int build_config_admission_class_from_env(const char * env_format, const char * class_name, unsigned int * value) {
+  char * env_name = msprintf(env_format, class_name), * env_value, * endptr = NULL;
+  long int lvalue;
+  size_t i;
+  int ret = G_OK;
+
+  for (i=0; env_name != NULL && env_name[i] != '\0'; i++) {
+    env_name[i] = (char)toupper(env_name[i]);
+  }
+  if ((env_value = getenv(env_name)) != NULL && !o_strnullempty(env_value)) {
+    lvalue = strtol(env_value, &endptr, 10);
+    if (!(*endptr) && lvalue >= 0) {
+      *value = (uint)lvalue;
+    } else {
+      ret = G_ERROR_PARAM;
+    }
+  }
+  o_free(env_name);
+  return ret;
+}
+
 int build_config_from_env(struct config_elements * config) {
   char * value = NULL, * value2 = NULL, * endptr = NULL, * one_log_mode = NULL;
   long int lvalue;
-  int ret = G_OK;
-  json_t * j_mime_types, * j_element;
+  int ret = G_OK, i;
+  json_t * j_mime_types, * j_rate_limit, * j_replica, * j_element;
   size_t index;
 
   if (!config->port && (value = getenv(GLEWLWYD_ENV_PORT)) != NULL && !o_strnullempty(value)) {
@@ -1663,6 +2015,23 @@ int build_config_from_env(struct config_elements * config) {
     }
   }
 
+  if ((value = getenv(GLEWLWYD_ENV_DATABASE_REPLICA)) != NULL && !o_strnullempty(value)) {
+    j_replica = json_loads(value, JSON_DECODE_ANY, NULL);
+    if (json_is_array(j_replica)) {
+      json_array_foreach(j_replica, index, j_element) {
+        if (add_replica_connection(config, j_element) != G_OK) {
+          fprintf(stderr, "Error - variable "GLEWLWYD_ENV_DATABASE_REPLICA" invalid element at index %zu (env), exiting\n", index);
+          ret = G_ERROR_PARAM;
+          break;
+        }
+      }
+    } else {
+      fprintf(stderr, "Error - variable "GLEWLWYD_ENV_DATABASE_REPLICA" must be a JSON array, example [{\"type\":\"postgre\",\"conninfo\":\"host=replica dbname=glewlwyd\"}] (env), exiting\n");
+      ret = G_ERROR_PARAM;
+    }
+    json_decref(j_replica);
+  }
+
   if ((value = getenv(GLEWLWYD_ENV_DATABASE_TYPE)) != NULL && !o_strnullempty(value)) {
     if (config->conn != NULL) {
       h_close_db(config->conn);
@@ -1695,6 +2064,9 @@ int build_config_from_env(struct config_elements * config) {
       if ((config->conn = h_connect_pgsql(getenv(GLEWLWYD_ENV_DATABASE_POSTGRE_CONNINFO))) == NULL) {
         fprintf(stderr, "Error opening postgre database %s (env), exiting\n", getenv(GLEWLWYD_ENV_DATABASE_POSTGRE_CONNINFO));
         ret = G_ERROR_PARAM;
+      } else {
+        o_free(config->cache_invalidation_conninfo);
+        config->cache_invalidation_conninfo = o_strdup(getenv(GLEWLWYD_ENV_DATABASE_POSTGRE_CONNINFO));
       }
     } else {
       fprintf(stderr, "Error - database type unknown (env), exiting\n");
@@ -1702,6 +2074,190 @@ int build_config_from_env(struct config_elements * config) {
     }
   }
 
+  if ((value = getenv(GLEWLWYD_ENV_CACHE_INVALIDATION_BACKEND)) != NULL && !o_strnullempty(value)) {
+    if (glewlwyd_cache_invalidation_set_backend(config, value) != G_OK) {
+      ret = G_ERROR_PARAM;
+    }
+  }
+
+  if ((value = getenv(GLEWLWYD_ENV_CACHE_INVALIDATION_INTERVAL)) != NULL && !o_strnullempty(value)) {
+    endptr = NULL;
+    lvalue = strtol(value, &endptr, 10);
+    if (!(*endptr) && lvalue > 0) {
+      config->cache_invalidation_interval = (uint)lvalue;
+    } else {
+      fprintf(stderr, "Error invalid cache_invalidation interval number (env), exiting\n");
+      ret = G_ERROR_PARAM;
+    }
+  }
+
+  if ((value = getenv(GLEWLWYD_ENV_CACHE_INVALIDATION_RETENTION)) != NULL && !o_strnullempty(value)) {
+    endptr = NULL;
+    lvalue = strtol(value, &endptr, 10);
+    if (!(*endptr) && lvalue > 0) {
+      config->cache_invalidation_retention = (uint)lvalue;
+    } else {
+      fprintf(stderr, "Error invalid cache_invalidation retention number (env), exiting\n");
+      ret = G_ERROR_PARAM;
+    }
+  }
+
+  if ((value = getenv(GLEWLWYD_ENV_CACHE_INVALIDATION_CONNINFO)) != NULL && !o_strnullempty(value)) {
+    o_free(config->cache_invalidation_conninfo);
+    config->cache_invalidation_conninfo = o_strdup(value);
+  }
+
+  if ((value = getenv(GLEWLWYD_ENV_HTTP_CLIENT_TIMEOUT)) != NULL && !o_strnullempty(value)) {
+    endptr = NULL;
+    lvalue = strtol(value, &endptr, 10);
+    if (!(*endptr) && lvalue > 0) {
+      config->http_client_timeout = (uint)lvalue;
+    } else {
+      fprintf(stderr, "Error invalid http_client timeout number (env), exiting\n");
+      ret = G_ERROR_PARAM;
+    }
+  }
+
+  if ((value = getenv(GLEWLWYD_ENV_HTTP_CLIENT_CONNECT_TIMEOUT)) != NULL && !o_strnullempty(value)) {
+    endptr = NULL;
+    lvalue = strtol(value, &endptr, 10);
+    if (!(*endptr) && lvalue > 0) {
+      config->http_client_connect_timeout = (uint)lvalue;
+    } else {
+      fprintf(stderr, "Error invalid http_client connect_timeout number (env), exiting\n");
+      ret = G_ERROR_PARAM;
+    }
+  }
+
+  if ((value = getenv(GLEWLWYD_ENV_HTTP_CLIENT_MAX_CONNECTIONS_PER_HOST)) != NULL && !o_strnullempty(value)) {
+    endptr = NULL;
+    lvalue = strtol(value, &endptr, 10);
+    if (!(*endptr) && lvalue >= 0) {
+      config->http_client_max_connections_per_host = (uint)lvalue;
+    } else {
+      fprintf(stderr, "Error invalid http_client max_connections_per_host number (env), exiting\n");
+      ret = G_ERROR_PARAM;
+    }
+  }
+
+  if ((value = getenv(GLEWLWYD_ENV_HTTP_CLIENT_IDLE_TIMEOUT)) != NULL && !o_strnullempty(value)) {
+    endptr = NULL;
+    lvalue = strtol(value, &endptr, 10);
+    if (!(*endptr) && lvalue >= 0) {
+      config->http_client_idle_timeout = (uint)lvalue;
+    } else {
+      fprintf(stderr, "Error invalid http_client idle_timeout number (env), exiting\n");
+      ret = G_ERROR_PARAM;
+    }
+  }
+
+  if ((value = getenv(GLEWLWYD_ENV_HTTP_CLIENT_DNS_CACHE_TIMEOUT)) != NULL && !o_strnullempty(value)) {
+    endptr = NULL;
+    lvalue = strtol(value, &endptr, 10);
+    if (!(*endptr) && lvalue >= 0) {
+      config->http_client_dns_cache_timeout = (uint)lvalue;
+    } else {
+      fprintf(stderr, "Error invalid http_client dns_cache_timeout number (env), exiting\n");
+      ret = G_ERROR_PARAM;
+    }
+  }
+
+  if ((value = getenv(GLEWLWYD_ENV_HTTP_CLIENT_MAX_IDLE_CONNECTIONS)) != NULL && !o_strnullempty(value)) {
+    endptr = NULL;
+    lvalue = strtol(value, &endptr, 10);
+    if (!(*endptr) && lvalue >= 0) {
+      config->http_client_max_idle_connections = (uint)lvalue;
+    } else {
+      fprintf(stderr, "Error invalid http_client max_idle_connections number (env), exiting\n");
+      ret = G_ERROR_PARAM;
+    }
+  }
+
+  if ((value = getenv(GLEWLWYD_ENV_DATABASE_PREPARED_STATEMENT)) != NULL && !o_strnullempty(value)) {
+    config->use_prepared_statement = (uint)(o_strcmp(value, "1")==0);
+  }
+
+  if ((value = getenv(GLEWLWYD_ENV_MODULE_INIT_MAX_PARALLEL)) != NULL && !o_strnullempty(value)) {
+    endptr = NULL;
+    lvalue = strtol(value, &endptr, 10);
+    if (!(*endptr) && lvalue > 0) {
+      config->module_init_max_parallel = (uint)lvalue;
+    } else {
+      fprintf(stderr, "Error invalid module_init_max_parallel number (env), exiting\n");
+      ret = G_ERROR_PARAM;
+    }
+  }
+
+  if ((value = getenv(GLEWLWYD_ENV_MODULE_INIT_TIMEOUT)) != NULL && !o_strnullempty(value)) {
+    endptr = NULL;
+    lvalue = strtol(value, &endptr, 10);
+    if (!(*endptr) && lvalue >= 0) {
+      config->module_init_timeout = (uint)lvalue;
+    } else {
+      fprintf(stderr, "Error invalid module_init_timeout number (env), exiting\n");
+      ret = G_ERROR_PARAM;
+    }
+  }
+
+  if ((value = getenv(GLEWLWYD_ENV_SCHEME_CAN_USE_CACHE_EXPIRATION)) != NULL && !o_strnullempty(value)) {
+    endptr = NULL;
+    lvalue = strtol(value, &endptr, 10);
+    if (!(*endptr) && lvalue >= 0) {
+      config->scheme_can_use_cache_expiration = (uint)lvalue;
+    } else {
+      fprintf(stderr, "Error invalid scheme_can_use_cache_expiration number (env), exiting\n");
+      ret = G_ERROR_PARAM;
+    }
+  }
+
+  if ((value = getenv(GLEWLWYD_ENV_ALLOC_CACHE_SIZE)) != NULL && !o_strnullempty(value)) {
+    endptr = NULL;
+    lvalue = strtol(value, &endptr, 10);
+    if (!(*endptr) && lvalue >= 0) {
+      config->alloc_cache_size = (uint)lvalue;
+    } else {
+      fprintf(stderr, "Error invalid alloc_cache_size number (env), exiting\n");
+      ret = G_ERROR_PARAM;
+    }
+  }
+
+  if ((value = getenv(GLEWLWYD_ENV_ADMISSION_RETRY_AFTER)) != NULL && !o_strnullempty(value)) {
+    endptr = NULL;
+    lvalue = strtol(value, &endptr, 10);
+    if (!(*endptr) && lvalue >= 0) {
+      config->admission_retry_after = (uint)lvalue;
+    } else {
+      fprintf(stderr, "Error invalid admission retry_after number (env), exiting\n");
+      ret = G_ERROR_PARAM;
+    }
+  }
+
+  if ((value = getenv(GLEWLWYD_ENV_RATE_LIMIT)) != NULL && !o_strnullempty(value)) {
+    j_rate_limit = json_loads(value, JSON_DECODE_ANY, NULL);
+    if (json_is_array(j_rate_limit)) {
+      json_array_foreach(j_rate_limit, index, j_element) {
+        if (glewlwyd_rate_limit_set_endpoint(config, j_element) != G_OK) {
+          fprintf(stderr, "Error - variable "GLEWLWYD_ENV_RATE_LIMIT" invalid element at index %zu (env), exiting\n", index);
+          ret = G_ERROR_PARAM;
+          break;
+        }
+      }
+    } else {
+      fprintf(stderr, "Error - variable "GLEWLWYD_ENV_RATE_LIMIT" must be a JSON array, example [{\"endpoint\":\"auth\",\"ip\":{\"rate\":30,\"burst\":10}}] (env), exiting\n");
+      ret = G_ERROR_PARAM;
+    }
+    json_decref(j_rate_limit);
+  }
+
+  for (i=0; i<GLEWLWYD_ADMISSION_CLASS_COUNT; i++) {
+    if (build_config_admission_class_from_env(GLEWLWYD_ENV_ADMISSION_MAX_CONCURRENT, config->admission_class[i].name, &config->admission_class[i].max_concurrent) != G_OK ||
+        build_config_admission_class_from_env(GLEWLWYD_ENV_ADMISSION_MAX_QUEUE, config->admission_class[i].name, &config->admission_class[i].max_queue) != G_OK ||
+        build_config_admission_class_from_env(GLEWLWYD_ENV_ADMISSION_QUEUE_TIMEOUT, config->admission_class[i].name, &config->admission_class[i].queue_timeout) != G_OK) {
+      fprintf(stderr, "Error invalid admission %s number (env), exiting\n", config->admission_class[i].name);
+      ret = G_ERROR_PARAM;
+    }
+  }
+
   if ((value = getenv(GLEWLWYD_ENV_METRICS)) != NULL) {
     config->metrics_endpoint = (ushort)(o_strcmp(value, "1")==0);
   }
@@ -1732,6 +2288,7 @@ int build_config_from_env(struct config_elements * config) {
  */
 int check_config(struct config_elements * config) {
   int ret = G_OK;
+  size_t i;
 
   if (o_strnullempty(config->external_url)) {
     fprintf(stderr, "Error - configuration external_url mandatory\n");
@@ -1763,6 +2320,29 @@ int check_config(struct config_elements * config) {
     ret = G_ERROR_PARAM;
   }
 
+  for (i=0; i<config->conn_replica_count && config->conn != NULL; i++) {
+    if (config->conn_replica[i]->type != config->conn->type) {
+      fprintf(stderr, "Error - replica database type must be the same as the database type\n");
+      ret = G_ERROR_PARAM;
+      break;
+    }
+  }
+
+  if (config->cache_invalidation_backend == GLEWLWYD_CACHE_INVALIDATION_BACKEND_NOTIFY && (config->conn == NULL || config->conn->type != HOEL_DB_TYPE_PGSQL || o_strnullempty(config->cache_invalidation_conninfo))) {
+    fprintf(stderr, "Error - cache_invalidation backend 'notify' requires a postgre database\n");
+    ret = G_ERROR_PARAM;
+  }
+
+  if (config->cache_invalidation_backend != GLEWLWYD_CACHE_INVALIDATION_BACKEND_NONE && !config->cache_invalidation_interval) {
+    fprintf(stderr, "Error - cache_invalidation interval must be greater than 0\n");
+    ret = G_ERROR_PARAM;
+  }
+
+  if (!config->http_client_timeout || !config->http_client_connect_timeout) {
+    fprintf(stderr, "Error - http_client timeout and connect_timeout must be greater than 0\n");
+    ret = G_ERROR_PARAM;
+  }
+
   if (!config->port) {
     config->port = GLEWLWYD_DEFAULT_PORT;
   }
@@ -1875,7 +2455,276 @@ int module_instance_parameters_check(const char * module_parameters, const char
   return ret;
 }
 
-static int load_user_module_file(struct config_elements * config, const char * file_path) {
+static long module_init_elapsed_ms(const struct timespec * start, const struct timespec * end) {
+  return (long)((end->tv_sec - start->tv_sec) * 1000 + (end->tv_nsec - start->tv_nsec) / 1000000);
+}
+
+static struct _module_init_task * module_init_task_new(struct config_elements * config, const char * module_type, const char * module_name, const char * instance_name, void * module, void * instance, json_t * j_parameters, json_t * (* init)(struct _module_init_task * task), void (* close)(struct _module_init_task * task)) {
+  struct _module_init_task * task = o_malloc(sizeof(struct _module_init_task));
+
+  if (task != NULL) {
+    memset(task, 0, sizeof(struct _module_init_task));
+    task->config = config;
+    task->module_type = module_type;
+    task->module_name = module_name;
+    task->instance_name = instance_name;
+    task->module = module;
+    task->instance = instance;
+    task->j_parameters = json_incref(j_parameters);
+    task->init = init;
+    task->close = close;
+    task->status = GLEWLWYD_MODULE_INIT_TASK_PENDING;
+    task->refcount = 1;
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "module_init_task_new - Error allocating resources for task");
+  }
+  return task;
+}
+
+static void module_init_task_free(struct _module_init_task * task) {
+  if (task != NULL) {
+    json_decref(task->j_parameters);
+    json_decref(task->j_init);
+    o_free(task);
+  }
+}
+
+static void module_init_sync_release(struct _module_init_sync * sync) {
+  int free_sync;
+
+  pthread_mutex_lock(&sync->lock);
+  free_sync = !(--sync->refcount);
+  pthread_mutex_unlock(&sync->lock);
+  if (free_sync) {
+    pthread_mutex_destroy(&sync->lock);
+    pthread_cond_destroy(&sync->cond);
+    o_free(sync);
+  }
+}
+
+static void * module_init_task_run(void * args) {
+  struct _module_init_task * task = (struct _module_init_task *)args;
+  struct _module_init_sync * sync = task->sync;
+  json_t * j_init = task->init(task);
+  struct timespec end;
+  int free_task;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  pthread_mutex_lock(&sync->lock);
+  if (task->status == GLEWLWYD_MODULE_INIT_TASK_TIMEOUT) {
+    // Nobody is waiting for this instance anymore
+    y_log_message(Y_LOG_LEVEL_WARNING, "Init %s module instance '%s' returned after %ld ms, instance closed", task->module_type, task->instance_name, module_init_elapsed_ms(&task->start, &end));
+    if (check_result_value(j_init, G_OK)) {
+      task->close(task);
+    }
+    json_decref(j_init);
+  } else {
+    task->j_init = j_init;
+    task->duration_ms = module_init_elapsed_ms(&task->start, &end);
+    task->status = GLEWLWYD_MODULE_INIT_TASK_DONE;
+    sync->running--;
+    pthread_cond_signal(&sync->cond);
+  }
+  free_task = !(--task->refcount);
+  pthread_mutex_unlock(&sync->lock);
+  if (free_task) {
+    module_init_task_free(task);
+  }
+  module_init_sync_release(sync);
+  return NULL;
+}
+
+/**
+ * Run the init of all the tasks in task_list, at most config->module_init_max_parallel at a time
+ * A task running longer than config->module_init_timeout seconds is left behind with the status
+ * GLEWLWYD_MODULE_INIT_TASK_TIMEOUT, its instance is closed when its init returns
+ */
+static int run_module_init_task_list(struct config_elements * config, const char * module_type, struct _pointer_list * task_list) {
+  struct _module_init_sync * sync;
+  struct _module_init_task * task, * earliest;
+  struct timespec start, end, now;
+  pthread_attr_t attr;
+  pthread_t thread;
+  size_t i, next = 0, nb_done = 0, nb_tasks = pointer_list_size(task_list), max_parallel = config->module_init_max_parallel?config->module_init_max_parallel:1;
+  json_t * j_init;
+  int ret = G_OK;
+
+  if (!nb_tasks) {
+    return G_OK;
+  }
+  if ((sync = o_malloc(sizeof(struct _module_init_sync))) == NULL) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "run_module_init_task_list - Error allocating resources for sync");
+    return G_ERROR_MEMORY;
+  }
+  if (pthread_mutex_init(&sync->lock, NULL) || pthread_cond_init(&sync->cond, NULL)) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "run_module_init_task_list - Error initializing sync");
+    o_free(sync);
+    return G_ERROR;
+  }
+  sync->running = 0;
+  sync->refcount = 1;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  pthread_mutex_lock(&sync->lock);
+  while (nb_done < nb_tasks) {
+    while (next < nb_tasks && sync->running < max_parallel) {
+      task = (struct _module_init_task *)pointer_list_get_at(task_list, next++);
+      task->sync = sync;
+      task->status = GLEWLWYD_MODULE_INIT_TASK_RUNNING;
+      clock_gettime(CLOCK_MONOTONIC, &task->start);
+      clock_gettime(CLOCK_REALTIME, &task->deadline);
+      task->deadline.tv_sec += config->module_init_timeout;
+      task->refcount++;
+      sync->refcount++;
+      sync->running++;
+      if (pthread_create(&thread, &attr, module_init_task_run, task)) {
+        // Fallback to the current thread
+        y_log_message(Y_LOG_LEVEL_WARNING, "run_module_init_task_list - Error pthread_create for %s module instance '%s', init in the main thread", module_type, task->instance_name);
+        task->refcount--;
+        sync->refcount--;
+        sync->running--;
+        pthread_mutex_unlock(&sync->lock);
+        j_init = task->init(task);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        pthread_mutex_lock(&sync->lock);
+        task->j_init = j_init;
+        task->duration_ms = module_init_elapsed_ms(&task->start, &end);
+        task->status = GLEWLWYD_MODULE_INIT_TASK_DONE;
+      }
+    }
+
+    earliest = NULL;
+    for (i=0; i<next; i++) {
+      task = (struct _module_init_task *)pointer_list_get_at(task_list, i);
+      if (task->status == GLEWLWYD_MODULE_INIT_TASK_RUNNING && (earliest == NULL || task->deadline.tv_sec < earliest->deadline.tv_sec || (task->deadline.tv_sec == earliest->deadline.tv_sec && task->deadline.tv_nsec < earliest->deadline.tv_nsec))) {
+        earliest = task;
+      }
+    }
+    if (earliest != NULL) {
+      if (config->module_init_timeout) {
+        pthread_cond_timedwait(&sync->cond, &sync->lock, &earliest->deadline);
+      } else {
+        pthread_cond_wait(&sync->cond, &sync->lock);
+      }
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    nb_done = 0;
+    for (i=0; i<next; i++) {
+      task = (struct _module_init_task *)pointer_list_get_at(task_list, i);
+      if (task->status == GLEWLWYD_MODULE_INIT_TASK_RUNNING && config->module_init_timeout && (now.tv_sec > task->deadline.tv_sec || (now.tv_sec == task->deadline.tv_sec && now.tv_nsec >= task->deadline.tv_nsec))) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "run_module_init_task_list - Init %s module instance '%s' timed out after %u seconds, instance disabled", module_type, task->instance_name, config->module_init_timeout);
+        task->status = GLEWLWYD_MODULE_INIT_TASK_TIMEOUT;
+        task->duration_ms = (long)config->module_init_timeout * 1000;
+        sync->running--;
+        ret = G_ERROR;
+      }
+      if (task->status == GLEWLWYD_MODULE_INIT_TASK_DONE || task->status == GLEWLWYD_MODULE_INIT_TASK_TIMEOUT) {
+        nb_done++;
+      }
+    }
+  }
+  pthread_mutex_unlock(&sync->lock);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  pthread_attr_destroy(&attr);
+
+  for (i=0; i<nb_tasks; i++) {
+    task = (struct _module_init_task *)pointer_list_get_at(task_list, i);
+    y_log_message(Y_LOG_LEVEL_INFO, "Init %s module instance '%s' (%s): %s in %ld ms", module_type, task->instance_name, task->module_name, task->status==GLEWLWYD_MODULE_INIT_TASK_TIMEOUT?"timeout":(check_result_value(task->j_init, G_OK)?"success":"error"), task->duration_ms);
+  }
+  y_log_message(Y_LOG_LEVEL_INFO, "Init %zu %s module instance(s) in %ld ms", nb_tasks, module_type, module_init_elapsed_ms(&start, &end));
+  module_init_sync_release(sync);
+  return ret;
+}
+
+/**
+ * Release the tasks of task_list, a task still running is freed by its thread
+ */
+static void clean_module_init_task_list(struct _pointer_list * task_list) {
+  struct _module_init_task * task;
+  struct _module_init_sync * sync;
+  size_t i;
+  int free_task;
+
+  for (i=0; i<pointer_list_size(task_list); i++) {
+    task = (struct _module_init_task *)pointer_list_get_at(task_list, i);
+    if ((sync = task->sync) != NULL) {
+      pthread_mutex_lock(&sync->lock);
+      free_task = !(--task->refcount);
+      pthread_mutex_unlock(&sync->lock);
+    } else {
+      free_task = 1;
+    }
+    if (free_task) {
+      module_init_task_free(task);
+    }
+  }
+  pointer_list_clean(task_list);
+}
+
+static json_t * module_init_task_user(struct _module_init_task * task) {
+  return ((struct _user_module *)task->module)->user_module_init(task->config->config_m, task->readonly, task->multiple_passwords, task->j_parameters, &task->cls);
+}
+
+static void module_close_task_user(struct _module_init_task * task) {
+  ((struct _user_module *)task->module)->user_module_close(task->config->config_m, task->cls);
+}
+
+static json_t * module_init_task_user_middleware(struct _module_init_task * task) {
+  return ((struct _user_middleware_module *)task->module)->user_middleware_module_init(task->config->config_m, task->j_parameters, &task->cls);
+}
+
+static void module_close_task_user_middleware(struct _module_init_task * task) {
+  ((struct _user_middleware_module *)task->module)->user_middleware_module_close(task->config->config_m, task->cls);
+}
+
+static json_t * module_init_task_client(struct _module_init_task * task) {
+  return ((struct _client_module *)task->module)->client_module_init(task->config->config_m, task->readonly, task->j_parameters, &task->cls);
+}
+
+static void module_close_task_client(struct _module_init_task * task) {
+  ((struct _client_module *)task->module)->client_module_close(task->config->config_m, task->cls);
+}
+
+static json_t * module_init_task_user_auth_scheme(struct _module_init_task * task) {
+  return ((struct _user_auth_scheme_module *)task->module)->user_auth_scheme_module_init(task->config->config_m, task->j_parameters, task->instance_name, &task->cls);
+}
+
+static void module_close_task_user_auth_scheme(struct _module_init_task * task) {
+  ((struct _user_auth_scheme_module *)task->module)->user_auth_scheme_module_close(task->config->config_m, task->cls);
+}
+
+static json_t * module_init_task_plugin(struct _module_init_task * task) {
+  json_t * j_return;
+
+  glewlwyd_plugin_endpoint_scope(task->endpoint_generation);
+  j_return = ((struct _plugin_module *)task->module)->plugin_module_init(task->config->config_p, task->instance_name, task->j_parameters, &task->cls);
+  glewlwyd_plugin_endpoint_scope(0);
+  return j_return;
+}
+
+static void module_close_task_plugin(struct _module_init_task * task) {
+  glewlwyd_plugin_endpoint_scope(task->endpoint_generation);
+  ((struct _plugin_module *)task->module)->plugin_module_close(task->config->config_p, task->instance_name, task->cls);
+  glewlwyd_plugin_endpoint_scope(0);
+}
+
+static struct _user_module * find_user_module_lib(struct _pointer_list * module_list, const char * name) {
+  size_t i;
+  struct _user_module * module;
+
+  for (i=0; i<pointer_list_size(module_list); i++) {
+    module = (struct _user_module *)pointer_list_get_at(module_list, i);
+    if (module != NULL && 0 == o_strcmp(module->name, name)) {
+      return module;
+    }
+  }
+  return NULL;
+}
+
+static int load_user_module_file(struct config_elements * config, struct _pointer_list * module_list, const char * file_path) {
   void * file_handle;
   struct _user_module * cur_user_module = NULL;
   int ret;
@@ -1926,10 +2775,10 @@ static int load_user_module_file(struct config_elements * config, const char * f
           cur_user_module->display_name = o_strdup(json_string_value(json_object_get(j_parameters, "display_name")));
           cur_user_module->description = o_strdup(json_string_value(json_object_get(j_parameters, "description")));
           cur_user_module->api_version = json_real_value(json_object_get(j_parameters, "api_version"));
-          if (!o_strnullempty(cur_user_module->name) && get_user_module_lib(config, cur_user_module->name) == NULL) {
+          if (!o_strnullempty(cur_user_module->name) && find_user_module_lib(module_list, cur_user_module->name) == NULL) {
             if (cur_user_module->api_version >= _GLEWLWYD_USER_MODULE_VERSION) {
               if (!pthread_mutex_lock(&config->module_lock)) {
-                if (pointer_list_append(config->user_module_list, (void*)cur_user_module)) {
+                if (pointer_list_append(module_list, (void*)cur_user_module)) {
                   y_log_message(Y_LOG_LEVEL_INFO, "Loading user module %s - %s", file_path, cur_user_module->name);
                   ret = G_OK;
                 } else {
@@ -2019,12 +2868,13 @@ int init_user_module_list(struct config_elements * config) {
   DIR * modules_directory;
   struct dirent * in_file;
   char * file_path;
+  struct _pointer_list * module_list;
   struct stat u_stat;
   memset(&u_stat, 0, sizeof(struct stat));
 
-  config->user_module_list = o_malloc(sizeof(struct _pointer_list));
-  if (config->user_module_list != NULL) {
-    pointer_list_init(config->user_module_list);
+  module_list = o_malloc(sizeof(struct _pointer_list));
+  if (module_list != NULL) {
+    pointer_list_init(module_list);
     // read module_path and load modules
     if (NULL == (modules_directory = opendir(config->user_module_path))) {
       y_log_message(Y_LOG_LEVEL_ERROR, "init_user_module_list - Error reading libraries folder %s", config->user_module_path);
@@ -2045,7 +2895,7 @@ int init_user_module_list(struct config_elements * config) {
           }
         }
         if (is_reg) {
-          if (load_user_module_file(config, file_path) != G_OK) {
+          if (load_user_module_file(config, module_list, file_path) != G_OK) {
             y_log_message(Y_LOG_LEVEL_ERROR, "init_user_module_list - Error opening module file %s", file_path);
           }
         }
@@ -2053,8 +2903,9 @@ int init_user_module_list(struct config_elements * config) {
       }
       closedir(modules_directory);
     }
+    GLEWLWYD_MODULE_LIST_PUBLISH(config->user_module_list, module_list);
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "init_user_module_list - Error allocating resources for config->user_module_list");
+    y_log_message(Y_LOG_LEVEL_ERROR, "init_user_module_list - Error allocating resources for module_list");
     ret = G_ERROR_MEMORY;
   }
 
@@ -2062,16 +2913,19 @@ int init_user_module_list(struct config_elements * config) {
 }
 
 int load_user_module_instance_list(struct config_elements * config) {
-  json_t * j_query, * j_result, * j_instance, * j_parameters, * j_init;
+  json_t * j_query, * j_result, * j_instance, * j_parameters;
   int res, ret;
   size_t index, i;
   struct _user_module_instance * cur_instance;
   struct _user_module * module = NULL;
+  struct _module_init_task * task;
+  struct _pointer_list task_list, * instance_list;
   char * message;
 
-  config->user_module_instance_list = o_malloc(sizeof(struct _pointer_list));
-  if (config->user_module_instance_list != NULL) {
-    pointer_list_init(config->user_module_instance_list);
+  pointer_list_init(&task_list);
+  instance_list = o_malloc(sizeof(struct _pointer_list));
+  if (instance_list != NULL) {
+    pointer_list_init(instance_list);
     j_query = json_pack("{sss[sssssss]ss}",
                         "table",
                         GLEWLWYD_TABLE_USER_MODULE_INSTANCE,
@@ -2108,28 +2962,23 @@ int load_user_module_instance_list(struct config_elements * config) {
               cur_instance->module = module;
               cur_instance->readonly = json_integer_value(json_object_get(j_instance, "readonly"));
               cur_instance->multiple_passwords = json_integer_value(json_object_get(j_instance, "multiple_passwords"));
-              if (pointer_list_append(config->user_module_instance_list, cur_instance)) {
+              cur_instance->enabled = 0;
+              if (pointer_list_append(instance_list, cur_instance)) {
                 if (json_integer_value(json_object_get(j_instance, "enabled"))) {
                   j_parameters = json_loads(json_string_value(json_object_get(j_instance, "parameters")), JSON_DECODE_ANY, NULL);
                   if (j_parameters != NULL) {
-                    j_init = module->user_module_init(config->config_m, cur_instance->readonly, cur_instance->multiple_passwords, j_parameters, &cur_instance->cls);
-                    if (check_result_value(j_init, G_OK)) {
-                      cur_instance->enabled = 1;
-                    } else {
-                      y_log_message(Y_LOG_LEVEL_ERROR, "load_user_module_instance_list - Error init module %s/%s", module->name, json_string_value(json_object_get(j_instance, "name")));
-                      message = json_dumps(j_init, JSON_INDENT(2));
-                      y_log_message(Y_LOG_LEVEL_DEBUG, message);
-                      o_free(message);
-                      cur_instance->enabled = 0;
+                    if ((task = module_init_task_new(config, "user", module->name, cur_instance->name, module, cur_instance, j_parameters, &module_init_task_user, &module_close_task_user)) != NULL) {
+                      task->readonly = cur_instance->readonly;
+                      task->multiple_passwords = cur_instance->multiple_passwords;
+                      if (!pointer_list_append(&task_list, task)) {
+                        y_log_message(Y_LOG_LEVEL_ERROR, "load_user_module_instance_list - Error pointer_list_append task");
+                        module_init_task_free(task);
+                      }
                     }
-                    json_decref(j_init);
                   } else {
                     y_log_message(Y_LOG_LEVEL_ERROR, "load_user_module_instance_list - Error parsing module parameters %s/%s: %s", module->name, json_string_value(json_object_get(j_instance, "name")), json_string_value(json_object_get(j_instance, "parameters")));
-                    cur_instance->enabled = 0;
                   }
                   json_decref(j_parameters);
-                } else {
-                  cur_instance->enabled = 0;
                 }
               } else {
                 y_log_message(Y_LOG_LEVEL_ERROR, "load_user_module_instance_list - Error reallocating resources for user_module_instance_list");
@@ -2144,6 +2993,24 @@ int load_user_module_instance_list(struct config_elements * config) {
         }
         json_decref(j_result);
         pthread_mutex_unlock(&config->module_lock);
+        run_module_init_task_list(config, "user", &task_list);
+        if (!pthread_mutex_lock(&config->module_lock)) {
+          for (i=0; i<pointer_list_size(&task_list); i++) {
+            task = (struct _module_init_task *)pointer_list_get_at(&task_list, i);
+            cur_instance = (struct _user_module_instance *)task->instance;
+            if (task->status == GLEWLWYD_MODULE_INIT_TASK_DONE && check_result_value(task->j_init, G_OK)) {
+              cur_instance->cls = task->cls;
+              cur_instance->enabled = 1;
+            } else if (task->status == GLEWLWYD_MODULE_INIT_TASK_DONE) {
+              y_log_message(Y_LOG_LEVEL_ERROR, "load_user_module_instance_list - Error init module %s/%s", task->module_name, cur_instance->name);
+              message = json_dumps(task->j_init, JSON_INDENT(2));
+              y_log_message(Y_LOG_LEVEL_DEBUG, message);
+              o_free(message);
+            }
+          }
+          pthread_mutex_unlock(&config->module_lock);
+        }
+        clean_module_init_task_list(&task_list);
       } else {
         y_log_message(Y_LOG_LEVEL_ERROR, "load_user_module_instance_list - Error pthread_mutex_lock");
         ret = G_ERROR;
@@ -2152,8 +3019,9 @@ int load_user_module_instance_list(struct config_elements * config) {
       y_log_message(Y_LOG_LEVEL_ERROR, "load_user_module_instance_list - Error executing j_query");
       ret = G_ERROR;
     }
+    GLEWLWYD_MODULE_LIST_PUBLISH(config->user_module_instance_list, instance_list);
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "load_user_module_instance_list - Error allocating resource for config->user_module_instance_list");
+    y_log_message(Y_LOG_LEVEL_ERROR, "load_user_module_instance_list - Error allocating resource for instance_list");
     ret = G_ERROR_MEMORY;
   }
   return ret;
@@ -2161,10 +3029,11 @@ int load_user_module_instance_list(struct config_elements * config) {
 
 struct _user_module_instance * get_user_module_instance(struct config_elements * config, const char * name) {
   size_t i;
+  struct _pointer_list * instance_list = GLEWLWYD_MODULE_LIST_GET(config->user_module_instance_list);
   struct _user_module_instance * cur_instance;
 
-  for (i=0; i<pointer_list_size(config->user_module_instance_list); i++) {
-    cur_instance = (struct _user_module_instance *)pointer_list_get_at(config->user_module_instance_list, i);
+  for (i=0; i<pointer_list_size(instance_list); i++) {
+    cur_instance = (struct _user_module_instance *)pointer_list_get_at(instance_list, i);
     if (cur_instance != NULL && 0 == o_strcmp(cur_instance->name, name)) {
       return cur_instance;
     }
@@ -2173,75 +3042,87 @@ struct _user_module_instance * get_user_module_instance(struct config_elements *
 }
 
 struct _user_module * get_user_module_lib(struct config_elements * config, const char * name) {
+  return find_user_module_lib(GLEWLWYD_MODULE_LIST_GET(config->user_module_list), name);
+}
+
+static void free_user_module_instance_list(struct config_elements * config, struct _pointer_list * instance_list) {
   size_t i;
-  struct _user_module * module;
 
-  for (i=0; i<pointer_list_size(config->user_module_list); i++) {
-    module = (struct _user_module *)pointer_list_get_at(config->user_module_list, i);
-    if (module != NULL && 0 == o_strcmp(module->name, name)) {
-      return module;
+  for (i=0; i<pointer_list_size(instance_list); i++) {
+    struct _user_module_instance * instance = (struct _user_module_instance *)pointer_list_get_at(instance_list, i);
+    if (instance != NULL) {
+      if (instance->enabled && instance->module->user_module_close(config->config_m, instance->cls) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "free_user_module_instance_list - Error user_module_close for instance '%s'/'%s'", instance->module->name, instance->name);
+      }
+      o_free(instance->name);
+      o_free(instance);
     }
   }
-  return NULL;
+  pointer_list_clean(instance_list);
+  o_free(instance_list);
 }
 
 void close_user_module_instance_list(struct config_elements * config) {
-  size_t i;
-
   if (!pthread_mutex_lock(&config->module_lock)) {
-    for (i=0; i<pointer_list_size(config->user_module_instance_list); i++) {
-      struct _user_module_instance * instance = (struct _user_module_instance *)pointer_list_get_at(config->user_module_instance_list, i);
-      if (instance != NULL) {
-        if (instance->enabled && instance->module->user_module_close(config->config_m, instance->cls) != G_OK) {
-          y_log_message(Y_LOG_LEVEL_ERROR, "close_user_module_instance_list - Error user_module_close for instance '%s'/'%s'", instance->module->name, instance->name);
-        }
-        o_free(instance->name);
-        o_free(instance);
-      }
-    }
-    pointer_list_clean(config->user_module_instance_list);
-    o_free(config->user_module_instance_list);
+    free_user_module_instance_list(config, config->user_module_instance_list);
     pthread_mutex_unlock(&config->module_lock);
   } else {
     y_log_message(Y_LOG_LEVEL_ERROR, "close_user_module_instance_list - Error pthread_mutex_lock");
   }
 }
 
-void close_user_module_list(struct config_elements * config) {
+static void free_user_module_list(struct config_elements * config, struct _pointer_list * module_list) {
   size_t i;
 
-  if (!pthread_mutex_lock(&config->module_lock)) {
-    for (i=0; i<pointer_list_size(config->user_module_list); i++) {
-      struct _user_module * module = (struct _user_module *)pointer_list_get_at(config->user_module_list, i);
-      if (module != NULL) {
-        if (module->user_module_unload(config->config_m) != G_OK) {
-          y_log_message(Y_LOG_LEVEL_ERROR, "close_user_module_list - Error user_module_unload for module '%s'", module->name);
-        }
-  /*
-  * dlclose() makes valgrind not useful when it comes to libraries
-  * they say it's not relevant to use it anyway
-  * I'll let it here until I'm sure
-  */
-  #ifndef DEBUG
-        if (dlclose(module->file_handle)) {
-          y_log_message(Y_LOG_LEVEL_ERROR, "close_user_module_list - Error dlclose for module '%s'", module->name);
-        }
-  #endif
-        o_free(module->name);
-        o_free(module->display_name);
-        o_free(module->description);
-        o_free(module);
+  for (i=0; i<pointer_list_size(module_list); i++) {
+    struct _user_module * module = (struct _user_module *)pointer_list_get_at(module_list, i);
+    if (module != NULL) {
+      if (module->user_module_unload(config->config_m) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "free_user_module_list - Error user_module_unload for module '%s'", module->name);
+      }
+/*
+* dlclose() makes valgrind not useful when it comes to libraries
+* they say it's not relevant to use it anyway
+* I'll let it here until I'm sure
+*/
+#ifndef DEBUG
+      if (dlclose(module->file_handle)) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "free_user_module_list - Error dlclose for module '%s'", module->name);
       }
+#endif
+      o_free(module->name);
+      o_free(module->display_name);
+      o_free(module->description);
+      o_free(module);
     }
-    pointer_list_clean(config->user_module_list);
-    o_free(config->user_module_list);
+  }
+  pointer_list_clean(module_list);
+  o_free(module_list);
+}
+
+void close_user_module_list(struct config_elements * config) {
+  if (!pthread_mutex_lock(&config->module_lock)) {
+    free_user_module_list(config, config->user_module_list);
     pthread_mutex_unlock(&config->module_lock);
   } else {
     y_log_message(Y_LOG_LEVEL_ERROR, "close_user_module_list - Error pthread_mutex_lock");
   }
 }
 
-static int load_user_middleware_module_file(struct config_elements * config, const char * file_path) {
+static struct _user_middleware_module * find_user_middleware_module_lib(struct _pointer_list * module_list, const char * name) {
+  size_t i;
+  struct _user_middleware_module * module;
+
+  for (i=0; i<pointer_list_size(module_list); i++) {
+    module = (struct _user_middleware_module *)pointer_list_get_at(module_list, i);
+    if (module != NULL && 0 == o_strcmp(module->name, name)) {
+      return module;
+    }
+  }
+  return NULL;
+}
+
+static int load_user_middleware_module_file(struct config_elements * config, struct _pointer_list * module_list, const char * file_path) {
   void * file_handle;
   struct _user_middleware_module * cur_user_middleware_module = NULL;
   int ret;
@@ -2280,10 +3161,10 @@ static int load_user_middleware_module_file(struct config_elements * config, con
           cur_user_middleware_module->display_name = o_strdup(json_string_value(json_object_get(j_parameters, "display_name")));
           cur_user_middleware_module->description = o_strdup(json_string_value(json_object_get(j_parameters, "description")));
           cur_user_middleware_module->api_version = json_real_value(json_object_get(j_parameters, "api_version"));
-          if (!o_strnullempty(cur_user_middleware_module->name) && get_user_middleware_module_lib(config, cur_user_middleware_module->name) == NULL) {
+          if (!o_strnullempty(cur_user_middleware_module->name) && find_user_middleware_module_lib(module_list, cur_user_middleware_module->name) == NULL) {
             if (cur_user_middleware_module->api_version >= _GLEWLWYD_USER_MODULE_VERSION) {
               if (!pthread_mutex_lock(&config->module_lock)) {
-                if (pointer_list_append(config->user_middleware_module_list, (void*)cur_user_middleware_module)) {
+                if (pointer_list_append(module_list, (void*)cur_user_middleware_module)) {
                   y_log_message(Y_LOG_LEVEL_INFO, "Loading user middleware module %s - %s", file_path, cur_user_middleware_module->name);
                   ret = G_OK;
                 } else {
@@ -2367,12 +3248,13 @@ int init_user_middleware_module_list(struct config_elements * config) {
   DIR * modules_directory;
   struct dirent * in_file;
   char * file_path;
+  struct _pointer_list * module_list;
   struct stat u_stat;
   memset(&u_stat, 0, sizeof(struct stat));
 
-  config->user_middleware_module_list = o_malloc(sizeof(struct _pointer_list));
-  if (config->user_middleware_module_list != NULL) {
-    pointer_list_init(config->user_middleware_module_list);
+  module_list = o_malloc(sizeof(struct _pointer_list));
+  if (module_list != NULL) {
+    pointer_list_init(module_list);
     if (!o_strnullempty(config->user_middleware_module_path)) {
       // read module_path and load modules
       if (NULL == (modules_directory = opendir(config->user_middleware_module_path))) {
@@ -2393,7 +3275,7 @@ int init_user_middleware_module_list(struct config_elements * config) {
             }
           }
           if (is_reg) {
-            if (load_user_middleware_module_file(config, file_path) != G_OK) {
+            if (load_user_middleware_module_file(config, module_list, file_path) != G_OK) {
               y_log_message(Y_LOG_LEVEL_ERROR, "init_user_middleware_module_list - Error opening module file %s", file_path);
             }
           }
@@ -2402,8 +3284,9 @@ int init_user_middleware_module_list(struct config_elements * config) {
         closedir(modules_directory);
       }
     }
+    GLEWLWYD_MODULE_LIST_PUBLISH(config->user_middleware_module_list, module_list);
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "init_user_middleware_module_list - Error allocating resources for config->user_middleware_module_list");
+    y_log_message(Y_LOG_LEVEL_ERROR, "init_user_middleware_module_list - Error allocating resources for module_list");
     ret = G_ERROR_MEMORY;
   }
 
@@ -2411,16 +3294,19 @@ int init_user_middleware_module_list(struct config_elements * config) {
 }
 
 int load_user_middleware_module_instance_list(struct config_elements * config) {
-  json_t * j_query, * j_result, * j_instance, * j_parameters, * j_init;
+  json_t * j_query, * j_result, * j_instance, * j_parameters;
   int res, ret;
   size_t index, i;
   struct _user_middleware_module_instance * cur_instance;
   struct _user_middleware_module * module = NULL;
+  struct _module_init_task * task;
+  struct _pointer_list task_list, * instance_list;
   char * message;
 
-  config->user_middleware_module_instance_list = o_malloc(sizeof(struct _pointer_list));
-  if (config->user_middleware_module_instance_list != NULL) {
-    pointer_list_init(config->user_middleware_module_instance_list);
+  pointer_list_init(&task_list);
+  instance_list = o_malloc(sizeof(struct _pointer_list));
+  if (instance_list != NULL) {
+    pointer_list_init(instance_list);
     if (!o_strnullempty(config->user_middleware_module_path)) {
       j_query = json_pack("{sss[sssss]ss}",
                           "table",
@@ -2454,29 +3340,21 @@ int load_user_middleware_module_instance_list(struct config_elements * config) {
                 cur_instance->cls = NULL;
                 cur_instance->name = o_strdup(json_string_value(json_object_get(j_instance, "name")));
                 cur_instance->module = module;
-                if (pointer_list_append(config->user_middleware_module_instance_list, cur_instance)) {
+                cur_instance->enabled = 0;
+                if (pointer_list_append(instance_list, cur_instance)) {
                   if (json_integer_value(json_object_get(j_instance, "enabled"))) {
                     j_parameters = json_loads(json_string_value(json_object_get(j_instance, "parameters")), JSON_DECODE_ANY, NULL);
                     if (j_parameters != NULL) {
-                      j_init = module->user_middleware_module_init(config->config_m, j_parameters, &cur_instance->cls);
-                      if (check_result_value(j_init, G_OK)) {
-                        cur_instance->enabled = 1;
-                      } else {
-                        y_log_message(Y_LOG_LEVEL_ERROR, "load_user_middleware_module_instance_list - Error init module %s/%s", module->name, json_string_value(json_object_get(j_instance, "name")));
-                        message = json_dumps(j_init, JSON_INDENT(2));
-                        y_log_message(Y_LOG_LEVEL_DEBUG, message);
-                        o_free(message);
-                        cur_instance->enabled = 0;
-                        ret = G_ERROR_PARAM;
+                      if ((task = module_init_task_new(config, "user middleware", module->name, cur_instance->name, module, cur_instance, j_parameters, &module_init_task_user_middleware, &module_close_task_user_middleware)) != NULL) {
+                        if (!pointer_list_append(&task_list, task)) {
+                          y_log_message(Y_LOG_LEVEL_ERROR, "load_user_middleware_module_instance_list - Error pointer_list_append task");
+                          module_init_task_free(task);
+                        }
                       }
-                      json_decref(j_init);
                     } else {
                       y_log_message(Y_LOG_LEVEL_ERROR, "load_user_middleware_module_instance_list - Error parsing module parameters %s/%s: %s", module->name, json_string_value(json_object_get(j_instance, "name")), json_string_value(json_object_get(j_instance, "parameters")));
-                      cur_instance->enabled = 0;
                     }
                     json_decref(j_parameters);
-                  } else {
-                    cur_instance->enabled = 0;
                   }
                 } else {
                   y_log_message(Y_LOG_LEVEL_ERROR, "load_user_middleware_module_instance_list - Error reallocating resources for user_middleware_module_instance_list");
@@ -2491,6 +3369,27 @@ int load_user_middleware_module_instance_list(struct config_elements * config) {
           }
           json_decref(j_result);
           pthread_mutex_unlock(&config->module_lock);
+          if (run_module_init_task_list(config, "user middleware", &task_list) != G_OK) {
+            ret = G_ERROR_PARAM;
+          }
+          if (!pthread_mutex_lock(&config->module_lock)) {
+            for (i=0; i<pointer_list_size(&task_list); i++) {
+              task = (struct _module_init_task *)pointer_list_get_at(&task_list, i);
+              cur_instance = (struct _user_middleware_module_instance *)task->instance;
+              if (task->status == GLEWLWYD_MODULE_INIT_TASK_DONE && check_result_value(task->j_init, G_OK)) {
+                cur_instance->cls = task->cls;
+                cur_instance->enabled = 1;
+              } else if (task->status == GLEWLWYD_MODULE_INIT_TASK_DONE) {
+                y_log_message(Y_LOG_LEVEL_ERROR, "load_user_middleware_module_instance_list - Error init module %s/%s", task->module_name, cur_instance->name);
+                message = json_dumps(task->j_init, JSON_INDENT(2));
+                y_log_message(Y_LOG_LEVEL_DEBUG, message);
+                o_free(message);
+                ret = G_ERROR_PARAM;
+              }
+            }
+            pthread_mutex_unlock(&config->module_lock);
+          }
+          clean_module_init_task_list(&task_list);
         } else {
           y_log_message(Y_LOG_LEVEL_ERROR, "load_user_middleware_module_instance_list - Error pthread_mutex_lock");
           ret = G_ERROR;
@@ -2504,8 +3403,9 @@ int load_user_middleware_module_instance_list(struct config_elements * config) {
       y_log_message(Y_LOG_LEVEL_WARNING, "Warning - user_middleware_module_path missing in config file");
       ret = G_OK;
     }
+    GLEWLWYD_MODULE_LIST_PUBLISH(config->user_middleware_module_instance_list, instance_list);
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "load_user_middleware_module_instance_list - Error allocating resource for config->user_middleware_module_instance_list");
+    y_log_message(Y_LOG_LEVEL_ERROR, "load_user_middleware_module_instance_list - Error allocating resource for instance_list");
     ret = G_ERROR_MEMORY;
   }
   return ret;
@@ -2513,10 +3413,11 @@ int load_user_middleware_module_instance_list(struct config_elements * config) {
 
 struct _user_middleware_module_instance * get_user_middleware_module_instance(struct config_elements * config, const char * name) {
   size_t i;
+  struct _pointer_list * instance_list = GLEWLWYD_MODULE_LIST_GET(config->user_middleware_module_instance_list);
   struct _user_middleware_module_instance * cur_instance;
 
-  for (i=0; i<pointer_list_size(config->user_middleware_module_instance_list); i++) {
-    cur_instance = (struct _user_middleware_module_instance *)pointer_list_get_at(config->user_middleware_module_instance_list, i);
+  for (i=0; i<pointer_list_size(instance_list); i++) {
+    cur_instance = (struct _user_middleware_module_instance *)pointer_list_get_at(instance_list, i);
     if (cur_instance != NULL && 0 == o_strcmp(cur_instance->name, name)) {
       return cur_instance;
     }
@@ -2525,75 +3426,87 @@ struct _user_middleware_module_instance * get_user_middleware_module_instance(st
 }
 
 struct _user_middleware_module * get_user_middleware_module_lib(struct config_elements * config, const char * name) {
+  return find_user_middleware_module_lib(GLEWLWYD_MODULE_LIST_GET(config->user_middleware_module_list), name);
+}
+
+static void free_user_middleware_module_instance_list(struct config_elements * config, struct _pointer_list * instance_list) {
   size_t i;
-  struct _user_middleware_module * module;
 
-  for (i=0; i<pointer_list_size(config->user_middleware_module_list); i++) {
-    module = (struct _user_middleware_module *)pointer_list_get_at(config->user_middleware_module_list, i);
-    if (module != NULL && 0 == o_strcmp(module->name, name)) {
-      return module;
+  for (i=0; i<pointer_list_size(instance_list); i++) {
+    struct _user_middleware_module_instance * instance = (struct _user_middleware_module_instance *)pointer_list_get_at(instance_list, i);
+    if (instance != NULL) {
+      if (instance->enabled && instance->module->user_middleware_module_close(config->config_m, instance->cls) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "free_user_middleware_module_instance_list - Error user_middleware_module_close for instance '%s'/'%s'", instance->module->name, instance->name);
+      }
+      o_free(instance->name);
+      o_free(instance);
     }
   }
-  return NULL;
+  pointer_list_clean(instance_list);
+  o_free(instance_list);
 }
 
 void close_user_middleware_module_instance_list(struct config_elements * config) {
-  size_t i;
-
   if (!pthread_mutex_lock(&config->module_lock)) {
-    for (i=0; i<pointer_list_size(config->user_middleware_module_instance_list); i++) {
-      struct _user_middleware_module_instance * instance = (struct _user_middleware_module_instance *)pointer_list_get_at(config->user_middleware_module_instance_list, i);
-      if (instance != NULL) {
-        if (instance->enabled && instance->module->user_middleware_module_close(config->config_m, instance->cls) != G_OK) {
-          y_log_message(Y_LOG_LEVEL_ERROR, "close_user_middleware_module_instance_list - Error user_middleware_module_close for instance '%s'/'%s'", instance->module->name, instance->name);
-        }
-        o_free(instance->name);
-        o_free(instance);
-      }
-    }
-    pointer_list_clean(config->user_middleware_module_instance_list);
-    o_free(config->user_middleware_module_instance_list);
+    free_user_middleware_module_instance_list(config, config->user_middleware_module_instance_list);
     pthread_mutex_unlock(&config->module_lock);
   } else {
     y_log_message(Y_LOG_LEVEL_ERROR, "close_user_middleware_module_instance_list - Error pthread_mutex_lock");
   }
 }
 
-void close_user_middleware_module_list(struct config_elements * config) {
+static void free_user_middleware_module_list(struct config_elements * config, struct _pointer_list * module_list) {
   size_t i;
 
-  if (!pthread_mutex_lock(&config->module_lock)) {
-    for (i=0; i<pointer_list_size(config->user_middleware_module_list); i++) {
-      struct _user_middleware_module * module = (struct _user_middleware_module *)pointer_list_get_at(config->user_middleware_module_list, i);
-      if (module != NULL) {
-        if (module->user_middleware_module_unload(config->config_m) != G_OK) {
-          y_log_message(Y_LOG_LEVEL_ERROR, "close_user_middleware_module_list - Error user_middleware_module_unload for module '%s'", module->name);
-        }
-  /*
-  * dlclose() makes valgrind not useful when it comes to libraries
-  * they say it's not relevant to use it anyway
-  * I'll let it here until I'm sure
-  */
-  #ifndef DEBUG
-        if (dlclose(module->file_handle)) {
-          y_log_message(Y_LOG_LEVEL_ERROR, "close_user_middleware_module_list - Error dlclose for module '%s'", module->name);
-        }
-  #endif
-        o_free(module->name);
-        o_free(module->display_name);
-        o_free(module->description);
-        o_free(module);
+  for (i=0; i<pointer_list_size(module_list); i++) {
+    struct _user_middleware_module * module = (struct _user_middleware_module *)pointer_list_get_at(module_list, i);
+    if (module != NULL) {
+      if (module->user_middleware_module_unload(config->config_m) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "free_user_middleware_module_list - Error user_middleware_module_unload for module '%s'", module->name);
       }
+/*
+* dlclose() makes valgrind not useful when it comes to libraries
+* they say it's not relevant to use it anyway
+* I'll let it here until I'm sure
+*/
+#ifndef DEBUG
+      if (dlclose(module->file_handle)) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "free_user_middleware_module_list - Error dlclose for module '%s'", module->name);
+      }
+#endif
+      o_free(module->name);
+      o_free(module->display_name);
+      o_free(module->description);
+      o_free(module);
     }
-    pointer_list_clean(config->user_middleware_module_list);
-    o_free(config->user_middleware_module_list);
+  }
+  pointer_list_clean(module_list);
+  o_free(module_list);
+}
+
+void close_user_middleware_module_list(struct config_elements * config) {
+  if (!pthread_mutex_lock(&config->module_lock)) {
+    free_user_middleware_module_list(config, config->user_middleware_module_list);
     pthread_mutex_unlock(&config->module_lock);
   } else {
     y_log_message(Y_LOG_LEVEL_ERROR, "close_user_middleware_module_list - Error pthread_mutex_lock");
   }
 }
 
-static int load_user_auth_scheme_module_file(struct config_elements * config, const char * file_path) {
+static struct _user_auth_scheme_module * find_user_auth_scheme_module_lib(struct _pointer_list * module_list, const char * name) {
+  size_t i;
+  struct _user_auth_scheme_module * module;
+
+  for (i=0; i<pointer_list_size(module_list); i++) {
+    module = (struct _user_auth_scheme_module *)pointer_list_get_at(module_list, i);
+    if (module != NULL && 0 == o_strcmp(module->name, name)) {
+      return module;
+    }
+  }
+  return NULL;
+}
+
+static int load_user_auth_scheme_module_file(struct config_elements * config, struct _pointer_list * module_list, const char * file_path) {
   void * file_handle;
   struct _user_auth_scheme_module * cur_user_auth_scheme_module = NULL;
   int ret;
@@ -2636,9 +3549,9 @@ static int load_user_auth_scheme_module_file(struct config_elements * config, co
           cur_user_auth_scheme_module->display_name = o_strdup(json_string_value(json_object_get(j_module, "display_name")));
           cur_user_auth_scheme_module->description = o_strdup(json_string_value(json_object_get(j_module, "description")));
           cur_user_auth_scheme_module->api_version = json_real_value(json_object_get(j_module, "api_version"));
-          if (!o_strnullempty(cur_user_auth_scheme_module->name) && get_user_auth_scheme_module_lib(config, cur_user_auth_scheme_module->name) == NULL) {
+          if (!o_strnullempty(cur_user_auth_scheme_module->name) && find_user_auth_scheme_module_lib(module_list, cur_user_auth_scheme_module->name) == NULL) {
             if (!pthread_mutex_lock(&config->module_lock)) {
-              if (pointer_list_append(config->user_auth_scheme_module_list, cur_user_auth_scheme_module)) {
+              if (pointer_list_append(module_list, cur_user_auth_scheme_module)) {
                 y_log_message(Y_LOG_LEVEL_INFO, "Loading user auth scheme module %s - %s", file_path, cur_user_auth_scheme_module->name);
                 ret = G_OK;
               } else {
@@ -2714,12 +3627,13 @@ int init_user_auth_scheme_module_list(struct config_elements * config) {
   DIR * modules_directory;
   struct dirent * in_file;
   char * file_path;
+  struct _pointer_list * module_list;
   struct stat u_stat;
   memset(&u_stat, 0, sizeof(struct stat));
 
-  config->user_auth_scheme_module_list = o_malloc(sizeof(struct _pointer_list));
-  if (config->user_auth_scheme_module_list != NULL) {
-    pointer_list_init(config->user_auth_scheme_module_list);
+  module_list = o_malloc(sizeof(struct _pointer_list));
+  if (module_list != NULL) {
+    pointer_list_init(module_list);
     // read module_path and load modules
     if (NULL == (modules_directory = opendir(config->user_auth_scheme_module_path))) {
       y_log_message(Y_LOG_LEVEL_ERROR, "init_user_auth_scheme_module_list - Error reading libraries folder %s", config->user_auth_scheme_module_path);
@@ -2740,7 +3654,7 @@ int init_user_auth_scheme_module_list(struct config_elements * config) {
           }
         }
         if (is_reg) {
-          if (load_user_auth_scheme_module_file(config, file_path) != G_OK) {
+          if (load_user_auth_scheme_module_file(config, module_list, file_path) != G_OK) {
             y_log_message(Y_LOG_LEVEL_ERROR, "init_user_auth_scheme_module_list - Error opening module file %s", file_path);
           }
         }
@@ -2748,8 +3662,9 @@ int init_user_auth_scheme_module_list(struct config_elements * config) {
       }
       closedir(modules_directory);
     }
+    GLEWLWYD_MODULE_LIST_PUBLISH(config->user_auth_scheme_module_list, module_list);
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "init_user_auth_scheme_module_list - Error allocating resources for config->user_auth_scheme_module_list");
+    y_log_message(Y_LOG_LEVEL_ERROR, "init_user_auth_scheme_module_list - Error allocating resources for module_list");
     ret = G_ERROR_MEMORY;
   }
 
@@ -2757,16 +3672,19 @@ int init_user_auth_scheme_module_list(struct config_elements * config) {
 }
 
 int load_user_auth_scheme_module_instance_list(struct config_elements * config) {
-  json_t * j_query, * j_result, * j_instance, * j_parameters, * j_init;
+  json_t * j_query, * j_result, * j_instance, * j_parameters;
   int res, ret;
   size_t index, i;
   struct _user_auth_scheme_module_instance * cur_instance;
   struct _user_auth_scheme_module * module = NULL;
+  struct _module_init_task * task;
+  struct _pointer_list task_list, * instance_list;
   char * message;
 
-  config->user_auth_scheme_module_instance_list = o_malloc(sizeof(struct _pointer_list));
-  if (config->user_auth_scheme_module_instance_list != NULL) {
-    pointer_list_init(config->user_auth_scheme_module_instance_list);
+  pointer_list_init(&task_list);
+  instance_list = o_malloc(sizeof(struct _pointer_list));
+  if (instance_list != NULL) {
+    pointer_list_init(instance_list);
     j_query = json_pack("{sss[ssssssss]}",
                         "table",
                         GLEWLWYD_TABLE_USER_AUTH_SCHEME_MODULE_INSTANCE,
@@ -2804,32 +3722,21 @@ int load_user_auth_scheme_module_instance_list(struct config_elements * config)
               cur_instance->guasmi_expiration = json_integer_value(json_object_get(j_instance, "guasmi_expiration"));
               cur_instance->guasmi_max_use = json_integer_value(json_object_get(j_instance, "guasmi_max_use"));
               cur_instance->guasmi_allow_user_register = json_integer_value(json_object_get(j_instance, "guasmi_allow_user_register"));
-              if (pointer_list_append(config->user_auth_scheme_module_instance_list, cur_instance)) {
+              cur_instance->enabled = 0;
+              if (pointer_list_append(instance_list, cur_instance)) {
                 if (json_integer_value(json_object_get(j_instance, "enabled"))) {
                   j_parameters = json_loads(json_string_value(json_object_get(j_instance, "parameters")), JSON_DECODE_ANY, NULL);
                   if (j_parameters != NULL) {
-                    j_init = module->user_auth_scheme_module_init(config->config_m, j_parameters, cur_instance->name, &cur_instance->cls);
-                    if (check_result_value(j_init, G_OK)) {
-                      glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_AUTH_USER_VALID_SCHEME, 0, "scheme_type", module->name, "scheme_name", cur_instance->name, NULL);
-                      glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_AUTH_USER_INVALID_SCHEME, 0, "scheme_type", module->name, "scheme_name", cur_instance->name, NULL);
-                      cur_instance->enabled = 1;
-                    } else {
-                      y_log_message(Y_LOG_LEVEL_ERROR, "load_user_auth_scheme_module_instance_list - Error init module %s/%s", module->name, json_string_value(json_object_get(j_instance, "name")));
-                      if (check_result_value(j_init, G_ERROR_PARAM)) {
-                        message = json_dumps(json_object_get(j_init, "error"), JSON_INDENT(2));
-                        y_log_message(Y_LOG_LEVEL_DEBUG, message);
-                        o_free(message);
+                    if ((task = module_init_task_new(config, "user auth scheme", module->name, cur_instance->name, module, cur_instance, j_parameters, &module_init_task_user_auth_scheme, &module_close_task_user_auth_scheme)) != NULL) {
+                      if (!pointer_list_append(&task_list, task)) {
+                        y_log_message(Y_LOG_LEVEL_ERROR, "load_user_auth_scheme_module_instance_list - Error pointer_list_append task");
+                        module_init_task_free(task);
                       }
-                      cur_instance->enabled = 0;
                     }
-                    json_decref(j_init);
                   } else {
                     y_log_message(Y_LOG_LEVEL_ERROR, "load_user_auth_scheme_module_instance_list - Error parsing parameters for module %s: '%s'", cur_instance->name, json_string_value(json_object_get(j_instance, "parameters")));
-                    o_free(cur_instance->name);
                   }
                   json_decref(j_parameters);
-                } else {
-                  cur_instance->enabled = 0;
                 }
               } else {
                 y_log_message(Y_LOG_LEVEL_ERROR, "load_user_auth_scheme_module_instance_list - Error reallocating resources for user_auth_scheme_module_instance_list");
@@ -2844,6 +3751,28 @@ int load_user_auth_scheme_module_instance_list(struct config_elements * config)
         }
         json_decref(j_result);
         pthread_mutex_unlock(&config->module_lock);
+        run_module_init_task_list(config, "user auth scheme", &task_list);
+        if (!pthread_mutex_lock(&config->module_lock)) {
+          for (i=0; i<pointer_list_size(&task_list); i++) {
+            task = (struct _module_init_task *)pointer_list_get_at(&task_list, i);
+            cur_instance = (struct _user_auth_scheme_module_instance *)task->instance;
+            if (task->status == GLEWLWYD_MODULE_INIT_TASK_DONE && check_result_value(task->j_init, G_OK)) {
+              glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_AUTH_USER_VALID_SCHEME, 0, "scheme_type", task->module_name, "scheme_name", cur_instance->name, NULL);
+              glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_AUTH_USER_INVALID_SCHEME, 0, "scheme_type", task->module_name, "scheme_name", cur_instance->name, NULL);
+              cur_instance->cls = task->cls;
+              cur_instance->enabled = 1;
+            } else if (task->status == GLEWLWYD_MODULE_INIT_TASK_DONE) {
+              y_log_message(Y_LOG_LEVEL_ERROR, "load_user_auth_scheme_module_instance_list - Error init module %s/%s", task->module_name, cur_instance->name);
+              if (check_result_value(task->j_init, G_ERROR_PARAM)) {
+                message = json_dumps(json_object_get(task->j_init, "error"), JSON_INDENT(2));
+                y_log_message(Y_LOG_LEVEL_DEBUG, message);
+                o_free(message);
+              }
+            }
+          }
+          pthread_mutex_unlock(&config->module_lock);
+        }
+        clean_module_init_task_list(&task_list);
       } else {
         y_log_message(Y_LOG_LEVEL_ERROR, "load_user_auth_scheme_module_instance_list - Error pthread_mutex_lock");
         ret = G_ERROR;
@@ -2852,8 +3781,9 @@ int load_user_auth_scheme_module_instance_list(struct config_elements * config)
       y_log_message(Y_LOG_LEVEL_ERROR, "load_user_auth_scheme_module_instance_list - Error executing j_query");
       ret = G_ERROR;
     }
+    GLEWLWYD_MODULE_LIST_PUBLISH(config->user_auth_scheme_module_instance_list, instance_list);
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "load_user_auth_scheme_module_instance_list - Error allocating resources for config->user_auth_scheme_module_instance_list");
+    y_log_message(Y_LOG_LEVEL_ERROR, "load_user_auth_scheme_module_instance_list - Error allocating resources for instance_list");
     ret = G_ERROR_MEMORY;
   }
   return ret;
@@ -2861,10 +3791,11 @@ int load_user_auth_scheme_module_instance_list(struct config_elements * config)
 
 struct _user_auth_scheme_module_instance * get_user_auth_scheme_module_instance(struct config_elements * config, const char * name) {
   size_t i;
+  struct _pointer_list * instance_list = GLEWLWYD_MODULE_LIST_GET(config->user_auth_scheme_module_instance_list);
   struct _user_auth_scheme_module_instance * cur_instance;
 
-  for (i=0; i<pointer_list_size(config->user_auth_scheme_module_instance_list); i++) {
-    cur_instance = pointer_list_get_at(config->user_auth_scheme_module_instance_list, i);
+  for (i=0; i<pointer_list_size(instance_list); i++) {
+    cur_instance = pointer_list_get_at(instance_list, i);
     if (0 == o_strcmp(cur_instance->name, name)) {
       return cur_instance;
     }
@@ -2873,70 +3804,82 @@ struct _user_auth_scheme_module_instance * get_user_auth_scheme_module_instance(
 }
 
 struct _user_auth_scheme_module * get_user_auth_scheme_module_lib(struct config_elements * config, const char * name) {
+  return find_user_auth_scheme_module_lib(GLEWLWYD_MODULE_LIST_GET(config->user_auth_scheme_module_list), name);
+}
+
+static void free_user_auth_scheme_module_instance_list(struct config_elements * config, struct _pointer_list * instance_list) {
   size_t i;
-  struct _user_auth_scheme_module * module;
 
-  for (i=0; i<pointer_list_size(config->user_auth_scheme_module_list); i++) {
-    module = (struct _user_auth_scheme_module *)pointer_list_get_at(config->user_auth_scheme_module_list, i);
-    if (module != NULL && 0 == o_strcmp(module->name, name)) {
-      return module;
+  for (i=0; i<pointer_list_size(instance_list); i++) {
+    struct _user_auth_scheme_module_instance * instance = (struct _user_auth_scheme_module_instance *)pointer_list_get_at(instance_list, i);
+    if (instance != NULL) {
+      if (instance->enabled && instance->module->user_auth_scheme_module_close(config->config_m, instance->cls) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "free_user_auth_scheme_module_instance_list - Error user_auth_scheme_module_close for instance '%s'/'%s'", instance->module->name, instance->name);
+      }
+      o_free(instance->name);
+      o_free(instance);
     }
   }
-  return NULL;
+  pointer_list_clean(instance_list);
+  o_free(instance_list);
 }
 
 void close_user_auth_scheme_module_instance_list(struct config_elements * config) {
-  size_t i;
-
   if (!pthread_mutex_lock(&config->module_lock)) {
-    for (i=0; i<pointer_list_size(config->user_auth_scheme_module_instance_list); i++) {
-      struct _user_auth_scheme_module_instance * instance = (struct _user_auth_scheme_module_instance *)pointer_list_get_at(config->user_auth_scheme_module_instance_list, i);
-      if (instance != NULL) {
-        if (instance->enabled && instance->module->user_auth_scheme_module_close(config->config_m, instance->cls) != G_OK) {
-          y_log_message(Y_LOG_LEVEL_ERROR, "close_user_auth_scheme_module_instance_list - Error user_auth_scheme_module_close for instance '%s'/'%s'", instance->module->name, instance->name);
-        }
-        o_free(instance->name);
-        o_free(instance);
-      }
-    }
-    pointer_list_clean(config->user_auth_scheme_module_instance_list);
-    o_free(config->user_auth_scheme_module_instance_list);
+    free_user_auth_scheme_module_instance_list(config, config->user_auth_scheme_module_instance_list);
     pthread_mutex_unlock(&config->module_lock);
   } else {
     y_log_message(Y_LOG_LEVEL_ERROR, "close_user_auth_scheme_module_instance_list - Error pthread_mutex_lock");
   }
 }
 
-void close_user_auth_scheme_module_list(struct config_elements * config) {
+static void free_user_auth_scheme_module_list(struct config_elements * config, struct _pointer_list * module_list) {
   size_t i;
 
-  if (!pthread_mutex_lock(&config->module_lock)) {
-    for (i=0; i<pointer_list_size(config->user_auth_scheme_module_list); i++) {
-      struct _user_auth_scheme_module * module = (struct _user_auth_scheme_module *)pointer_list_get_at(config->user_auth_scheme_module_list, i);
-      if (module != NULL) {
-        if (module->user_auth_scheme_module_unload(config->config_m) != G_OK) {
-          y_log_message(Y_LOG_LEVEL_ERROR, "close_user_auth_scheme_module_list - Error user_auth_scheme_module_unload for module '%s'", module->name);
-        }
-  #ifndef DEBUG
-        if (dlclose(module->file_handle)) {
-          y_log_message(Y_LOG_LEVEL_ERROR, "close_user_auth_scheme_module_list - Error dlclose for module '%s'", module->name);
-        }
-  #endif
-        o_free(module->name);
-        o_free(module->display_name);
-        o_free(module->description);
-        o_free(module);
+  for (i=0; i<pointer_list_size(module_list); i++) {
+    struct _user_auth_scheme_module * module = (struct _user_auth_scheme_module *)pointer_list_get_at(module_list, i);
+    if (module != NULL) {
+      if (module->user_auth_scheme_module_unload(config->config_m) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "free_user_auth_scheme_module_list - Error user_auth_scheme_module_unload for module '%s'", module->name);
       }
+#ifndef DEBUG
+      if (dlclose(module->file_handle)) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "free_user_auth_scheme_module_list - Error dlclose for module '%s'", module->name);
+      }
+#endif
+      o_free(module->name);
+      o_free(module->display_name);
+      o_free(module->description);
+      o_free(module);
     }
-    pointer_list_clean(config->user_auth_scheme_module_list);
-    o_free(config->user_auth_scheme_module_list);
+  }
+  pointer_list_clean(module_list);
+  o_free(module_list);
+}
+
+void close_user_auth_scheme_module_list(struct config_elements * config) {
+  if (!pthread_mutex_lock(&config->module_lock)) {
+    free_user_auth_scheme_module_list(config, config->user_auth_scheme_module_list);
     pthread_mutex_unlock(&config->module_lock);
   } else {
     y_log_message(Y_LOG_LEVEL_ERROR, "close_user_auth_scheme_module_list - Error pthread_mutex_lock");
   }
 }
 
-static int load_client_module_file(struct config_elements * config, const char * file_path) {
+static struct _client_module * find_client_module_lib(struct _pointer_list * module_list, const char * name) {
+  size_t i;
+  struct _client_module * module;
+
+  for (i=0; i<pointer_list_size(module_list); i++) {
+    module = (struct _client_module *)pointer_list_get_at(module_list, i);
+    if (module != NULL && 0 == o_strcmp(module->name, name)) {
+      return module;
+    }
+  }
+  return NULL;
+}
+
+static int load_client_module_file(struct config_elements * config, struct _pointer_list * module_list, const char * file_path) {
   void * file_handle;
   struct _client_module * cur_client_module = NULL;
   int ret;
@@ -2981,9 +3924,9 @@ static int load_client_module_file(struct config_elements * config, const char *
           cur_client_module->display_name = o_strdup(json_string_value(json_object_get(j_parameters, "display_name")));
           cur_client_module->description = o_strdup(json_string_value(json_object_get(j_parameters, "description")));
           cur_client_module->api_version = json_real_value(json_object_get(j_parameters, "api_version"));
-          if (!o_strnullempty(cur_client_module->name) && get_client_module_lib(config, cur_client_module->name) == NULL) {
+          if (!o_strnullempty(cur_client_module->name) && find_client_module_lib(module_list, cur_client_module->name) == NULL) {
             if (!pthread_mutex_lock(&config->module_lock)) {
-              if (pointer_list_append(config->client_module_list, cur_client_module)) {
+              if (pointer_list_append(module_list, cur_client_module)) {
                 y_log_message(Y_LOG_LEVEL_INFO, "Loading client module %s - %s", file_path, cur_client_module->name);
                 ret = G_OK;
               } else {
@@ -3059,12 +4002,13 @@ int init_client_module_list(struct config_elements * config) {
   DIR * modules_directory;
   struct dirent * in_file;
   char * file_path;
+  struct _pointer_list * module_list;
   struct stat u_stat;
   memset(&u_stat, 0, sizeof(struct stat));
 
-  config->client_module_list = o_malloc(sizeof(struct _pointer_list));
-  if (config->client_module_list != NULL) {
-    pointer_list_init(config->client_module_list);
+  module_list = o_malloc(sizeof(struct _pointer_list));
+  if (module_list != NULL) {
+    pointer_list_init(module_list);
     // read module_path and load modules
     if (NULL == (modules_directory = opendir(config->client_module_path))) {
       y_log_message(Y_LOG_LEVEL_ERROR, "init_client_module_list - Error reading libraries folder %s", config->client_module_path);
@@ -3085,7 +4029,7 @@ int init_client_module_list(struct config_elements * config) {
           }
         }
         if (is_reg) {
-          if (load_client_module_file(config, file_path) != G_OK) {
+          if (load_client_module_file(config, module_list, file_path) != G_OK) {
             y_log_message(Y_LOG_LEVEL_ERROR, "init_client_module_list - Error opening module file %s", file_path);
           }
         }
@@ -3093,8 +4037,9 @@ int init_client_module_list(struct config_elements * config) {
       }
       closedir(modules_directory);
     }
+    GLEWLWYD_MODULE_LIST_PUBLISH(config->client_module_list, module_list);
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "init_client_module_list - Error allocating resources for config->client_module_list");
+    y_log_message(Y_LOG_LEVEL_ERROR, "init_client_module_list - Error allocating resources for module_list");
     ret = G_ERROR_MEMORY;
   }
 
@@ -3102,15 +4047,18 @@ int init_client_module_list(struct config_elements * config) {
 }
 
 int load_client_module_instance_list(struct config_elements * config) {
-  json_t * j_query, * j_result, * j_instance, * j_parameters, * j_init;
+  json_t * j_query, * j_result, * j_instance, * j_parameters;
   int res, ret;
   size_t index, i;
   struct _client_module_instance * cur_instance;
   struct _client_module * module = NULL;
+  struct _module_init_task * task;
+  struct _pointer_list task_list, * instance_list;
 
-  config->client_module_instance_list = o_malloc(sizeof(struct _pointer_list));
-  if (config->client_module_instance_list != NULL) {
-    pointer_list_init(config->client_module_instance_list);
+  pointer_list_init(&task_list);
+  instance_list = o_malloc(sizeof(struct _pointer_list));
+  if (instance_list != NULL) {
+    pointer_list_init(instance_list);
     j_query = json_pack("{sss[ssssss]ss}",
                         "table",
                         GLEWLWYD_TABLE_CLIENT_MODULE_INSTANCE,
@@ -3145,25 +4093,22 @@ int load_client_module_instance_list(struct config_elements * config) {
               cur_instance->name = o_strdup(json_string_value(json_object_get(j_instance, "name")));
               cur_instance->readonly = json_integer_value(json_object_get(j_instance, "readonly"));
               cur_instance->module = module;
-              if (pointer_list_append(config->client_module_instance_list, cur_instance)) {
+              cur_instance->enabled = 0;
+              if (pointer_list_append(instance_list, cur_instance)) {
                 if (json_integer_value(json_object_get(j_instance, "enabled"))) {
                   j_parameters = json_loads(json_string_value(json_object_get(j_instance, "parameters")), JSON_DECODE_ANY, NULL);
                   if (j_parameters != NULL) {
-                    j_init = module->client_module_init(config->config_m, cur_instance->readonly, j_parameters, &cur_instance->cls);
-                    if (check_result_value(j_init, G_OK)) {
-                      cur_instance->enabled = 1;
-                    } else {
-                      y_log_message(Y_LOG_LEVEL_ERROR, "load_client_module_instance_list - Error init module %s/%s", module->name, json_string_value(json_object_get(j_instance, "name")));
-                      cur_instance->enabled = 0;
+                    if ((task = module_init_task_new(config, "client", module->name, cur_instance->name, module, cur_instance, j_parameters, &module_init_task_client, &module_close_task_client)) != NULL) {
+                      task->readonly = cur_instance->readonly;
+                      if (!pointer_list_append(&task_list, task)) {
+                        y_log_message(Y_LOG_LEVEL_ERROR, "load_client_module_instance_list - Error pointer_list_append task");
+                        module_init_task_free(task);
+                      }
                     }
-                    json_decref(j_init);
                   } else {
                     y_log_message(Y_LOG_LEVEL_ERROR, "load_client_module_instance_list - Error parsing module parameters %s/%s: '%s'", module->name, json_string_value(json_object_get(j_instance, "name")), json_string_value(json_object_get(j_instance, "parameters")));
-                    cur_instance->enabled = 0;
                   }
                   json_decref(j_parameters);
-                } else {
-                  cur_instance->enabled = 0;
                 }
               } else {
                 y_log_message(Y_LOG_LEVEL_ERROR, "load_client_module_instance_list - Error reallocating resources for client_module_instance_list");
@@ -3178,6 +4123,21 @@ int load_client_module_instance_list(struct config_elements * config) {
         }
         json_decref(j_result);
         pthread_mutex_unlock(&config->module_lock);
+        run_module_init_task_list(config, "client", &task_list);
+        if (!pthread_mutex_lock(&config->module_lock)) {
+          for (i=0; i<pointer_list_size(&task_list); i++) {
+            task = (struct _module_init_task *)pointer_list_get_at(&task_list, i);
+            cur_instance = (struct _client_module_instance *)task->instance;
+            if (task->status == GLEWLWYD_MODULE_INIT_TASK_DONE && check_result_value(task->j_init, G_OK)) {
+              cur_instance->cls = task->cls;
+              cur_instance->enabled = 1;
+            } else if (task->status == GLEWLWYD_MODULE_INIT_TASK_DONE) {
+              y_log_message(Y_LOG_LEVEL_ERROR, "load_client_module_instance_list - Error init module %s/%s", task->module_name, cur_instance->name);
+            }
+          }
+          pthread_mutex_unlock(&config->module_lock);
+        }
+        clean_module_init_task_list(&task_list);
       } else {
         y_log_message(Y_LOG_LEVEL_ERROR, "load_client_module_instance_list - Error pthread_mutex_lock");
         ret = G_ERROR;
@@ -3186,8 +4146,9 @@ int load_client_module_instance_list(struct config_elements * config) {
       y_log_message(Y_LOG_LEVEL_ERROR, "load_client_module_instance_list - Error executing j_query");
       ret = G_ERROR;
     }
+    GLEWLWYD_MODULE_LIST_PUBLISH(config->client_module_instance_list, instance_list);
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "load_client_module_instance_list - Error allocating resources for config->client_module_instance_list");
+    y_log_message(Y_LOG_LEVEL_ERROR, "load_client_module_instance_list - Error allocating resources for instance_list");
     ret = G_ERROR;
   }
   return ret;
@@ -3195,10 +4156,11 @@ int load_client_module_instance_list(struct config_elements * config) {
 
 struct _client_module_instance * get_client_module_instance(struct config_elements * config, const char * name) {
   size_t i;
+  struct _pointer_list * instance_list = GLEWLWYD_MODULE_LIST_GET(config->client_module_instance_list);
   struct _client_module_instance * cur_instance;
 
-  for (i=0; i<pointer_list_size(config->client_module_instance_list); i++) {
-    cur_instance = pointer_list_get_at(config->client_module_instance_list, i);
+  for (i=0; i<pointer_list_size(instance_list); i++) {
+    cur_instance = pointer_list_get_at(instance_list, i);
     if (0 == o_strcmp(cur_instance->name, name)) {
       return cur_instance;
     }
@@ -3207,79 +4169,91 @@ struct _client_module_instance * get_client_module_instance(struct config_elemen
 }
 
 struct _client_module * get_client_module_lib(struct config_elements * config, const char * name) {
+  return find_client_module_lib(GLEWLWYD_MODULE_LIST_GET(config->client_module_list), name);
+}
+
+static void free_client_module_instance_list(struct config_elements * config, struct _pointer_list * instance_list) {
   size_t i;
-  struct _client_module * module;
 
-  for (i=0; i<pointer_list_size(config->client_module_list); i++) {
-    module = (struct _client_module *)pointer_list_get_at(config->client_module_list, i);
-    if (module != NULL && 0 == o_strcmp(module->name, name)) {
-      return module;
+  for (i=0; i<pointer_list_size(instance_list); i++) {
+    struct _client_module_instance * instance = (struct _client_module_instance *)pointer_list_get_at(instance_list, i);
+    if (instance != NULL) {
+      if (instance->enabled && instance->module->client_module_close(config->config_m, instance->cls) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "free_client_module_instance_list - Error client_module_close for instance '%s'/'%s'", instance->module->name, instance->name);
+      }
+      o_free(instance->name);
+      o_free(instance);
     }
   }
-  return NULL;
+  pointer_list_clean(instance_list);
+  o_free(instance_list);
 }
 
 void close_client_module_instance_list(struct config_elements * config) {
-  size_t i;
-
   if (!pthread_mutex_lock(&config->module_lock)) {
-    for (i=0; i<pointer_list_size(config->client_module_instance_list); i++) {
-      struct _client_module_instance * instance = (struct _client_module_instance *)pointer_list_get_at(config->client_module_instance_list, i);
-      if (instance != NULL) {
-        if (instance->enabled && instance->module->client_module_close(config->config_m, instance->cls) != G_OK) {
-          y_log_message(Y_LOG_LEVEL_ERROR, "close_client_module_instance_list - Error client_module_close for instance '%s'/'%s'", instance->module->name, instance->name);
-        }
-        o_free(instance->name);
-        o_free(instance);
-      }
-    }
-    pointer_list_clean(config->client_module_instance_list);
-    o_free(config->client_module_instance_list);
+    free_client_module_instance_list(config, config->client_module_instance_list);
     pthread_mutex_unlock(&config->module_lock);
   } else {
     y_log_message(Y_LOG_LEVEL_ERROR, "close_client_module_instance_list - Error pthread_mutex_lock");
   }
 }
 
-void close_client_module_list(struct config_elements * config) {
+static void free_client_module_list(struct config_elements * config, struct _pointer_list * module_list) {
   size_t i;
 
-  if (!pthread_mutex_lock(&config->module_lock)) {
-    for (i=0; i<pointer_list_size(config->client_module_list); i++) {
-      struct _client_module * module = (struct _client_module *)pointer_list_get_at(config->client_module_list, i);
-      if (module != NULL) {
-        if (module->client_module_unload(config->config_m) != G_OK) {
-          y_log_message(Y_LOG_LEVEL_ERROR, "close_client_module_list - Error client_module_unload for module '%s'", module->name);
-        }
-  /*
-  * dlclose() makes valgrind not useful when it comes to libraries
-  * they say it's not relevant to use it anyway
-  * I'll let it here until I'm sure
-  */
-  #ifndef DEBUG
-        if (dlclose(module->file_handle)) {
-          y_log_message(Y_LOG_LEVEL_ERROR, "close_client_module_list - Error dlclose for module '%s'", module->name);
-        }
-  #endif
-        o_free(module->name);
-        o_free(module->display_name);
-        o_free(module->description);
-        o_free(module);
+  for (i=0; i<pointer_list_size(module_list); i++) {
+    struct _client_module * module = (struct _client_module *)pointer_list_get_at(module_list, i);
+    if (module != NULL) {
+      if (module->client_module_unload(config->config_m) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "free_client_module_list - Error client_module_unload for module '%s'", module->name);
       }
+/*
+* dlclose() makes valgrind not useful when it comes to libraries
+* they say it's not relevant to use it anyway
+* I'll let it here until I'm sure
+*/
+#ifndef DEBUG
+      if (dlclose(module->file_handle)) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "free_client_module_list - Error dlclose for module '%s'", module->name);
+      }
+#endif
+      o_free(module->name);
+      o_free(module->display_name);
+      o_free(module->description);
+      o_free(module);
     }
-    pointer_list_clean(config->client_module_list);
-    o_free(config->client_module_list);
+  }
+  pointer_list_clean(module_list);
+  o_free(module_list);
+}
+
+void close_client_module_list(struct config_elements * config) {
+  if (!pthread_mutex_lock(&config->module_lock)) {
+    free_client_module_list(config, config->client_module_list);
     pthread_mutex_unlock(&config->module_lock);
   } else {
     y_log_message(Y_LOG_LEVEL_ERROR, "close_client_module_list - Error close_client_module_list");
   }
 }
 
-static int load_plugin_module_file(struct config_elements * config, const char * file_path) {
-  void * file_handle;
-  struct _plugin_module * cur_plugin_module = NULL;
-  int ret;
-  json_t * j_result;
+static struct _plugin_module * find_plugin_module_lib(struct _pointer_list * module_list, const char * name) {
+  size_t i;
+  struct _plugin_module * module;
+
+  for (i=0; i<pointer_list_size(module_list); i++) {
+    module = (struct _plugin_module *)pointer_list_get_at(module_list, i);
+    if (module != NULL && 0 == o_strcmp(module->name, name)) {
+      return module;
+    }
+  }
+  return NULL;
+}
+
+static int load_plugin_module_file(struct config_elements * config, struct _pointer_list * module_list, const char * file_path) {
+  void * file_handle;
+  struct _plugin_module * cur_plugin_module = NULL;
+  int ret;
+  json_t * j_result;
 
   file_handle = dlopen(file_path, RTLD_LAZY);
 
@@ -3306,9 +4280,9 @@ static int load_plugin_module_file(struct config_elements * config, const char *
           cur_plugin_module->display_name = o_strdup(json_string_value(json_object_get(j_result, "display_name")));
           cur_plugin_module->description = o_strdup(json_string_value(json_object_get(j_result, "description")));
           cur_plugin_module->api_version = json_real_value(json_object_get(j_result, "api_version"));
-          if (!o_strnullempty(cur_plugin_module->name) && get_plugin_module_lib(config, cur_plugin_module->name) == NULL) {
+          if (!o_strnullempty(cur_plugin_module->name) && find_plugin_module_lib(module_list, cur_plugin_module->name) == NULL) {
             if (!pthread_mutex_lock(&config->module_lock)) {
-              if (pointer_list_append(config->plugin_module_list, cur_plugin_module)) {
+              if (pointer_list_append(module_list, cur_plugin_module)) {
                 y_log_message(Y_LOG_LEVEL_INFO, "Loading plugin module %s - %s", file_path, cur_plugin_module->name);
                 ret = G_OK;
               } else {
@@ -3380,12 +4354,13 @@ int init_plugin_module_list(struct config_elements * config) {
   DIR * modules_directory;
   struct dirent * in_file;
   char * file_path;
+  struct _pointer_list * module_list;
   struct stat u_stat;
   memset(&u_stat, 0, sizeof(struct stat));
 
-  config->plugin_module_list = o_malloc(sizeof(struct _pointer_list));
-  if (config->plugin_module_list != NULL) {
-    pointer_list_init(config->plugin_module_list);
+  module_list = o_malloc(sizeof(struct _pointer_list));
+  if (module_list != NULL) {
+    pointer_list_init(module_list);
     // read module_path and load modules
     if (NULL == (modules_directory = opendir(config->plugin_module_path))) {
       y_log_message(Y_LOG_LEVEL_ERROR, "init_plugin_module_list - Error reading libraries folder %s", config->plugin_module_path);
@@ -3406,7 +4381,7 @@ int init_plugin_module_list(struct config_elements * config) {
           }
         }
         if (is_reg) {
-          if (load_plugin_module_file(config, file_path) != G_OK) {
+          if (load_plugin_module_file(config, module_list, file_path) != G_OK) {
             y_log_message(Y_LOG_LEVEL_ERROR, "init_client_module_list - Error opening module file %s", file_path);
           }
         }
@@ -3414,8 +4389,9 @@ int init_plugin_module_list(struct config_elements * config) {
       }
       closedir(modules_directory);
     }
+    GLEWLWYD_MODULE_LIST_PUBLISH(config->plugin_module_list, module_list);
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "init_plugin_module_list - Error allocating resources for config->client_module_list");
+    y_log_message(Y_LOG_LEVEL_ERROR, "init_plugin_module_list - Error allocating resources for module_list");
     ret = G_ERROR_MEMORY;
   }
 
@@ -3423,16 +4399,19 @@ int init_plugin_module_list(struct config_elements * config) {
 }
 
 int load_plugin_module_instance_list(struct config_elements * config) {
-  json_t * j_query, * j_result, * j_instance, * j_parameters, * j_init;
+  json_t * j_query, * j_result, * j_instance, * j_parameters;
   int res, ret;
   size_t index, i;
   struct _plugin_module_instance * cur_instance;
   struct _plugin_module * module = NULL;
+  struct _module_init_task * task;
+  struct _pointer_list task_list, * instance_list;
   char * message;
 
-  config->plugin_module_instance_list = o_malloc(sizeof(struct _pointer_list));
-  if (config->plugin_module_instance_list != NULL) {
-    pointer_list_init(config->plugin_module_instance_list);
+  pointer_list_init(&task_list);
+  instance_list = o_malloc(sizeof(struct _pointer_list));
+  if (instance_list != NULL) {
+    pointer_list_init(instance_list);
     j_query = json_pack("{sss[ssss]}",
                         "table",
                         GLEWLWYD_TABLE_PLUGIN_MODULE_INSTANCE,
@@ -3462,30 +4441,23 @@ int load_plugin_module_instance_list(struct config_elements * config) {
               cur_instance->cls = NULL;
               cur_instance->name = o_strdup(json_string_value(json_object_get(j_instance, "name")));
               cur_instance->module = module;
-              if (pointer_list_append(config->plugin_module_instance_list, cur_instance)) {
+              cur_instance->enabled = 0;
+              cur_instance->endpoint_generation = glewlwyd_plugin_endpoint_new_generation(config);
+              if (pointer_list_append(instance_list, cur_instance)) {
                 if (json_integer_value(json_object_get(j_instance, "enabled"))) {
                   j_parameters = json_loads(json_string_value(json_object_get(j_instance, "parameters")), JSON_DECODE_ANY, NULL);
                   if (j_parameters != NULL) {
-                    j_init = module->plugin_module_init(config->config_p, cur_instance->name, j_parameters, &cur_instance->cls);
-                    if (check_result_value(j_init, G_OK)) {
-                      cur_instance->enabled = 1;
-                    } else {
-                      y_log_message(Y_LOG_LEVEL_ERROR, "load_plugin_module_instance_list - Error init module %s/%s", module->name, json_string_value(json_object_get(j_instance, "name")));
-                      if (check_result_value(j_init, G_ERROR_PARAM)) {
-                        message = json_dumps(json_object_get(j_init, "error"), JSON_INDENT(2));
-                        y_log_message(Y_LOG_LEVEL_DEBUG, message);
-                        o_free(message);
+                    if ((task = module_init_task_new(config, "plugin", module->name, cur_instance->name, module, cur_instance, j_parameters, &module_init_task_plugin, &module_close_task_plugin)) != NULL) {
+                      task->endpoint_generation = cur_instance->endpoint_generation;
+                      if (!pointer_list_append(&task_list, task)) {
+                        y_log_message(Y_LOG_LEVEL_ERROR, "load_plugin_module_instance_list - Error pointer_list_append task");
+                        module_init_task_free(task);
                       }
-                      cur_instance->enabled = 0;
                     }
-                    json_decref(j_init);
                   } else {
                     y_log_message(Y_LOG_LEVEL_ERROR, "load_plugin_module_instance_list - Error parsing parameters for module %s/%s: '%s'", module->name, json_string_value(json_object_get(j_instance, "name")), json_string_value(json_object_get(j_instance, "parameters")));
-                    cur_instance->enabled = 0;
                   }
                   json_decref(j_parameters);
-                } else {
-                  cur_instance->enabled = 0;
                 }
               } else {
                 y_log_message(Y_LOG_LEVEL_ERROR, "load_plugin_module_instance_list - Error reallocating resources for client_module_instance_list");
@@ -3500,6 +4472,30 @@ int load_plugin_module_instance_list(struct config_elements * config) {
         }
         json_decref(j_result);
         pthread_mutex_unlock(&config->module_lock);
+        run_module_init_task_list(config, "plugin", &task_list);
+        if (!pthread_mutex_lock(&config->module_lock)) {
+          for (i=0; i<pointer_list_size(&task_list); i++) {
+            task = (struct _module_init_task *)pointer_list_get_at(&task_list, i);
+            cur_instance = (struct _plugin_module_instance *)task->instance;
+            if (task->status == GLEWLWYD_MODULE_INIT_TASK_DONE && check_result_value(task->j_init, G_OK)) {
+              cur_instance->cls = task->cls;
+              cur_instance->enabled = 1;
+              glewlwyd_plugin_endpoint_publish(config, cur_instance->endpoint_generation);
+            } else {
+              glewlwyd_plugin_endpoint_withdraw(config, cur_instance->endpoint_generation);
+              if (task->status == GLEWLWYD_MODULE_INIT_TASK_DONE) {
+                y_log_message(Y_LOG_LEVEL_ERROR, "load_plugin_module_instance_list - Error init module %s/%s", task->module_name, cur_instance->name);
+                if (check_result_value(task->j_init, G_ERROR_PARAM)) {
+                  message = json_dumps(json_object_get(task->j_init, "error"), JSON_INDENT(2));
+                  y_log_message(Y_LOG_LEVEL_DEBUG, message);
+                  o_free(message);
+                }
+              }
+            }
+          }
+          pthread_mutex_unlock(&config->module_lock);
+        }
+        clean_module_init_task_list(&task_list);
       } else {
         y_log_message(Y_LOG_LEVEL_ERROR, "load_plugin_module_instance_list - Error pthread_mutex_lock");
         ret = G_ERROR;
@@ -3508,8 +4504,9 @@ int load_plugin_module_instance_list(struct config_elements * config) {
       y_log_message(Y_LOG_LEVEL_ERROR, "load_plugin_module_instance_list - Error executing j_query");
       ret = G_ERROR;
     }
+    GLEWLWYD_MODULE_LIST_PUBLISH(config->plugin_module_instance_list, instance_list);
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "load_plugin_module_instance_list - Error allocating resources for config->client_module_instance_list");
+    y_log_message(Y_LOG_LEVEL_ERROR, "load_plugin_module_instance_list - Error allocating resources for instance_list");
     ret = G_ERROR;
   }
   return ret;
@@ -3517,10 +4514,11 @@ int load_plugin_module_instance_list(struct config_elements * config) {
 
 struct _plugin_module_instance * get_plugin_module_instance(struct config_elements * config, const char * name) {
   size_t i;
+  struct _pointer_list * instance_list = GLEWLWYD_MODULE_LIST_GET(config->plugin_module_instance_list);
   struct _plugin_module_instance * cur_instance;
 
-  for (i=0; i<pointer_list_size(config->plugin_module_instance_list); i++) {
-    cur_instance = (struct _plugin_module_instance *)pointer_list_get_at(config->plugin_module_instance_list, i);
+  for (i=0; i<pointer_list_size(instance_list); i++) {
+    cur_instance = (struct _plugin_module_instance *)pointer_list_get_at(instance_list, i);
     if (cur_instance != NULL && 0 == o_strcmp(cur_instance->name, name)) {
       return cur_instance;
     }
@@ -3529,67 +4527,874 @@ struct _plugin_module_instance * get_plugin_module_instance(struct config_elemen
 }
 
 struct _plugin_module * get_plugin_module_lib(struct config_elements * config, const char * name) {
+  return find_plugin_module_lib(GLEWLWYD_MODULE_LIST_GET(config->plugin_module_list), name);
+}
+
+static void free_plugin_module_instance_list(struct config_elements * config, struct _pointer_list * instance_list) {
   size_t i;
-  struct _plugin_module * module;
 
-  for (i=0; i<pointer_list_size(config->plugin_module_list); i++) {
-    module = (struct _plugin_module *)pointer_list_get_at(config->plugin_module_list, i);
-    if (module != NULL && 0 == o_strcmp(module->name, name)) {
-      return module;
+  for (i=0; i<pointer_list_size(instance_list); i++) {
+    struct _plugin_module_instance * instance = (struct _plugin_module_instance *)pointer_list_get_at(instance_list, i);
+    if (instance != NULL) {
+      glewlwyd_plugin_endpoint_scope(instance->endpoint_generation);
+      if (instance->enabled && instance->module->plugin_module_close(config->config_p, instance->name, instance->cls) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "free_plugin_module_instance_list - Error plugin_module_close for instance '%s'/'%s'", instance->module->name, instance->name);
+      }
+      glewlwyd_plugin_endpoint_scope(0);
+      o_free(instance->name);
+      o_free(instance);
     }
   }
-  return NULL;
+  pointer_list_clean(instance_list);
+  o_free(instance_list);
 }
 
 void close_plugin_module_instance_list(struct config_elements * config) {
+  if (!pthread_mutex_lock(&config->module_lock)) {
+    free_plugin_module_instance_list(config, config->plugin_module_instance_list);
+    pthread_mutex_unlock(&config->module_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "close_plugin_module_instance_list - Error pthread_mutex_lock");
+  }
+}
+
+static void free_plugin_module_list(struct config_elements * config, struct _pointer_list * module_list) {
   size_t i;
 
+  for (i=0; i<pointer_list_size(module_list); i++) {
+    struct _plugin_module * module = (struct _plugin_module *)pointer_list_get_at(module_list, i);
+    if (module != NULL) {
+      if (module->plugin_module_unload(config->config_p) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "free_plugin_module_list - Error plugin_module_unload for module '%s'", module->name);
+      }
+#ifndef DEBUG
+      if (dlclose(module->file_handle)) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "free_plugin_module_list - Error dlclose for module '%s'", module->name);
+      }
+#endif
+      o_free(module->name);
+      o_free(module->display_name);
+      o_free(module->description);
+      o_free(module);
+    }
+  }
+  pointer_list_clean(module_list);
+  o_free(module_list);
+}
+
+void close_plugin_module_list(struct config_elements * config) {
   if (!pthread_mutex_lock(&config->module_lock)) {
-    for (i=0; i<pointer_list_size(config->plugin_module_instance_list); i++) {
-      struct _plugin_module_instance * instance = (struct _plugin_module_instance *)pointer_list_get_at(config->plugin_module_instance_list, i);
-      if (instance != NULL) {
-        if (instance->enabled && instance->module->plugin_module_close(config->config_p, instance->name, instance->cls) != G_OK) {
-          y_log_message(Y_LOG_LEVEL_ERROR, "close_plugin_module_instance_list - Error plugin_module_close for instance '%s'/'%s'", instance->module->name, instance->name);
+    free_plugin_module_list(config, config->plugin_module_list);
+    pthread_mutex_unlock(&config->module_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "close_plugin_module_list - Error pthread_mutex_lock");
+  }
+}
+
+static size_t module_epoch_stripe_next = 0;
+static __thread size_t module_epoch_thread_stripe = 0;
+
+/**
+ * Each thread gets its stripe the first time it enters an epoch
+ * module_epoch_thread_stripe stores the stripe index + 1, 0 means not assigned yet
+ */
+static size_t get_module_epoch_stripe(void) {
+  if (!module_epoch_thread_stripe) {
+    module_epoch_thread_stripe = (__atomic_fetch_add(&module_epoch_stripe_next, 1, __ATOMIC_RELAXED)%GLEWLWYD_MODULE_EPOCH_STRIPES)+1;
+  }
+  return module_epoch_thread_stripe-1;
+}
+
+int glewlwyd_module_epoch_init(struct config_elements * config) {
+  size_t i;
+  int ret = G_OK;
+
+  if (!pthread_mutex_init(&config->module_epoch_lock, NULL) && !pthread_cond_init(&config->module_epoch_cond, NULL)) {
+    if ((config->module_epoch_stripe = o_malloc(GLEWLWYD_MODULE_EPOCH_STRIPES*sizeof(struct _module_epoch_stripe))) != NULL) {
+      memset(config->module_epoch_stripe, 0, GLEWLWYD_MODULE_EPOCH_STRIPES*sizeof(struct _module_epoch_stripe));
+      for (i=0; i<GLEWLWYD_MODULE_EPOCH_STRIPES; i++) {
+        if (pthread_mutex_init(&config->module_epoch_stripe[i].lock, NULL)) {
+          y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_module_epoch_init - Error pthread_mutex_init stripe");
+          ret = G_ERROR;
         }
-        o_free(instance->name);
-        o_free(instance);
       }
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_module_epoch_init - Error allocating resources for module_epoch_stripe");
+      ret = G_ERROR_MEMORY;
     }
-    pointer_list_clean(config->plugin_module_instance_list);
-    o_free(config->plugin_module_instance_list);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_module_epoch_init - Error pthread_mutex_init");
+    ret = G_ERROR;
+  }
+  return ret;
+}
+
+/**
+ * Must be called once the reaper is stopped and the retired data is released
+ */
+void glewlwyd_module_epoch_close(struct config_elements * config) {
+  size_t i;
+
+  if (config->module_epoch_stripe != NULL) {
+    for (i=0; i<GLEWLWYD_MODULE_EPOCH_STRIPES; i++) {
+      pthread_mutex_destroy(&config->module_epoch_stripe[i].lock);
+      o_free(config->module_epoch_stripe[i].count_list);
+    }
+    o_free(config->module_epoch_stripe);
+    config->module_epoch_stripe = NULL;
+  }
+  pointer_list_clean_free(&config->module_retired_list, &o_free);
+  pthread_mutex_destroy(&config->module_epoch_lock);
+  pthread_cond_destroy(&config->module_epoch_cond);
+}
+
+/**
+ * Takes a reference on the current epoch, the module data
+ * retired until the reference is released stays available
+ * Only the stripe of the calling thread is locked
+ */
+int glewlwyd_module_epoch_enter(struct config_elements * config, struct _module_epoch_ref * ref) {
+  struct _module_epoch_stripe * stripe;
+  struct _module_epoch_count * count_list;
+  int ret;
+
+  ref->stripe = get_module_epoch_stripe();
+  ref->epoch = 0;
+  stripe = &config->module_epoch_stripe[ref->stripe];
+  if (!pthread_mutex_lock(&stripe->lock)) {
+    // The epoch is read with the stripe locked, so the reaper sees either this reference or an epoch not older than the one it read
+    ref->epoch = __atomic_load_n(&config->module_epoch_current, __ATOMIC_SEQ_CST);
+    if (stripe->count_list_size && stripe->count_list[stripe->count_list_size-1].epoch == ref->epoch) {
+      stripe->count_list[stripe->count_list_size-1].refcount++;
+      ret = G_OK;
+    } else if ((count_list = o_realloc(stripe->count_list, (stripe->count_list_size+1)*sizeof(struct _module_epoch_count))) != NULL) {
+      stripe->count_list = count_list;
+      stripe->count_list[stripe->count_list_size].epoch = ref->epoch;
+      stripe->count_list[stripe->count_list_size].refcount = 1;
+      stripe->count_list_size++;
+      ret = G_OK;
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_module_epoch_enter - Error allocating resources for count_list");
+      ref->epoch = 0;
+      ret = G_ERROR_MEMORY;
+    }
+    pthread_mutex_unlock(&stripe->lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_module_epoch_enter - Error pthread_mutex_lock");
+    ret = G_ERROR;
+  }
+  return ret;
+}
+
+/**
+ * Releases the reference, the retired data is released later by the reaper thread
+ * The reference may be released by another thread than the one that took it
+ */
+void glewlwyd_module_epoch_leave(struct config_elements * config, struct _module_epoch_ref * ref) {
+  struct _module_epoch_stripe * stripe;
+  size_t i;
+
+  if (ref != NULL && ref->epoch) {
+    stripe = &config->module_epoch_stripe[ref->stripe];
+    if (!pthread_mutex_lock(&stripe->lock)) {
+      for (i=0; i<stripe->count_list_size; i++) {
+        if (stripe->count_list[i].epoch == ref->epoch) {
+          if (!(--stripe->count_list[i].refcount)) {
+            memmove(stripe->count_list+i, stripe->count_list+i+1, (stripe->count_list_size-i-1)*sizeof(struct _module_epoch_count));
+            stripe->count_list_size--;
+          }
+          break;
+        }
+      }
+      pthread_mutex_unlock(&stripe->lock);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_module_epoch_leave - Error pthread_mutex_lock");
+    }
+    ref->epoch = 0;
+  }
+}
+
+/**
+ * Module instances and lists are never released while published:
+ * a request may have read the previous list or instance just before it was replaced,
+ * so the replaced data is released when the requests started before it was retired are complete
+ */
+int retire_module_data(struct config_elements * config, void (* release)(struct config_elements * config, void * data), void * data) {
+  struct _module_retired * retired;
+  int ret;
+
+  if (release != NULL && data != NULL) {
+    if ((retired = o_malloc(sizeof(struct _module_retired))) != NULL) {
+      retired->release = release;
+      retired->data = data;
+      if (!pthread_mutex_lock(&config->module_epoch_lock)) {
+        // The requests starting from now can't reach the retired data
+        retired->epoch = __atomic_fetch_add(&config->module_epoch_current, 1, __ATOMIC_SEQ_CST);
+        if (pointer_list_append(&config->module_retired_list, retired)) {
+          pthread_cond_signal(&config->module_epoch_cond);
+          ret = G_OK;
+        } else {
+          y_log_message(Y_LOG_LEVEL_ERROR, "retire_module_data - Error pointer_list_append");
+          o_free(retired);
+          ret = G_ERROR_MEMORY;
+        }
+        pthread_mutex_unlock(&config->module_epoch_lock);
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "retire_module_data - Error pthread_mutex_lock");
+        o_free(retired);
+        ret = G_ERROR;
+      }
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "retire_module_data - Error allocating resources for retired");
+      ret = G_ERROR_MEMORY;
+    }
+  } else {
+    ret = G_ERROR_PARAM;
+  }
+  return ret;
+}
+
+/**
+ * Releases the data retired during the epochs older than every reference left
+ * If force is set, all the retired data is released
+ */
+void reap_retired_module_data(struct config_elements * config, int force) {
+  struct _module_retired * retired;
+  struct _pointer_list release_list;
+  unsigned long oldest;
+  size_t i;
+
+  pointer_list_init(&release_list);
+  // The current epoch is read before the stripes, the references taken after are on this epoch or a newer one
+  oldest = __atomic_load_n(&config->module_epoch_current, __ATOMIC_SEQ_CST);
+  if (!force && config->module_epoch_stripe != NULL) {
+    for (i=0; i<GLEWLWYD_MODULE_EPOCH_STRIPES; i++) {
+      if (!pthread_mutex_lock(&config->module_epoch_stripe[i].lock)) {
+        if (config->module_epoch_stripe[i].count_list_size && config->module_epoch_stripe[i].count_list[0].epoch < oldest) {
+          oldest = config->module_epoch_stripe[i].count_list[0].epoch;
+        }
+        pthread_mutex_unlock(&config->module_epoch_stripe[i].lock);
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "reap_retired_module_data - Error pthread_mutex_lock stripe");
+        oldest = 0;
+      }
+    }
+  }
+  if (!pthread_mutex_lock(&config->module_epoch_lock)) {
+    i = 0;
+    while (i<pointer_list_size(&config->module_retired_list)) {
+      retired = (struct _module_retired *)pointer_list_get_at(&config->module_retired_list, i);
+      if (force || retired->epoch < oldest) {
+        pointer_list_append(&release_list, retired);
+        pointer_list_remove_at(&config->module_retired_list, i);
+      } else {
+        i++;
+      }
+    }
+    pthread_mutex_unlock(&config->module_epoch_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "reap_retired_module_data - Error pthread_mutex_lock (1)");
+  }
+  if (pointer_list_size(&release_list)) {
+    if (!pthread_mutex_lock(&config->module_lock)) {
+      for (i=0; i<pointer_list_size(&release_list); i++) {
+        retired = (struct _module_retired *)pointer_list_get_at(&release_list, i);
+        retired->release(config, retired->data);
+        o_free(retired);
+      }
+      pthread_mutex_unlock(&config->module_lock);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "reap_retired_module_data - Error pthread_mutex_lock (2)");
+    }
+  }
+  pointer_list_clean(&release_list);
+}
+
+/**
+ * Releases the retired module data in the background, so the module close callbacks
+ * never run on a request thread
+ * The references aren't signaled when released, the retired list is checked
+ * every GLEWLWYD_MODULE_REAP_INTERVAL seconds while it's not empty
+ */
+static void * module_reaper_thread(void * args) {
+  struct config_elements * config = (struct config_elements *)args;
+  struct timespec abstime;
+
+  if (!pthread_mutex_lock(&config->module_epoch_lock)) {
+    while (config->module_reaper_status == GLEWLWYD_MODULE_REAPER_RUNNING) {
+      if (pointer_list_size(&config->module_retired_list)) {
+        clock_gettime(CLOCK_REALTIME, &abstime);
+        abstime.tv_sec += GLEWLWYD_MODULE_REAP_INTERVAL;
+        pthread_cond_timedwait(&config->module_epoch_cond, &config->module_epoch_lock, &abstime);
+      } else {
+        pthread_cond_wait(&config->module_epoch_cond, &config->module_epoch_lock);
+      }
+      if (config->module_reaper_status == GLEWLWYD_MODULE_REAPER_RUNNING && pointer_list_size(&config->module_retired_list)) {
+        pthread_mutex_unlock(&config->module_epoch_lock);
+        reap_retired_module_data(config, 0);
+        if (pthread_mutex_lock(&config->module_epoch_lock)) {
+          y_log_message(Y_LOG_LEVEL_ERROR, "module_reaper_thread - Error pthread_mutex_lock (2)");
+          return NULL;
+        }
+      }
+    }
+    pthread_mutex_unlock(&config->module_epoch_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "module_reaper_thread - Error pthread_mutex_lock (1)");
+  }
+  return NULL;
+}
+
+int glewlwyd_module_reaper_start(struct config_elements * config) {
+  int ret;
+
+  config->module_reaper_status = GLEWLWYD_MODULE_REAPER_RUNNING;
+  if (!pthread_create(&config->module_reaper_thread, NULL, &module_reaper_thread, (void *)config)) {
+    ret = G_OK;
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_module_reaper_start - Error pthread_create");
+    config->module_reaper_status = GLEWLWYD_MODULE_REAPER_STOPPED;
+    ret = G_ERROR;
+  }
+  return ret;
+}
+
+void glewlwyd_module_reaper_stop(struct config_elements * config) {
+  if (config->module_reaper_status == GLEWLWYD_MODULE_REAPER_RUNNING && !pthread_mutex_lock(&config->module_epoch_lock)) {
+    config->module_reaper_status = GLEWLWYD_MODULE_REAPER_STOPPING;
+    pthread_cond_signal(&config->module_epoch_cond);
+    pthread_mutex_unlock(&config->module_epoch_lock);
+    pthread_join(config->module_reaper_thread, NULL);
+    config->module_reaper_status = GLEWLWYD_MODULE_REAPER_STOPPED;
+  }
+}
+
+static void release_retired_pointer_list(struct config_elements * config, void * data) {
+  UNUSED(config);
+  pointer_list_clean((struct _pointer_list *)data);
+  o_free(data);
+}
+
+/**
+ * Replace the instance list with a copy, leaving the previous list unchanged
+ * for the requests still walking it
+ * Must be called with module_lock held
+ */
+static int replace_module_instance_list(struct config_elements * config, struct _pointer_list ** instance_list, void * add, void * remove) {
+  struct _pointer_list * cur_list = *instance_list, * new_list;
+  size_t i;
+  int ret = G_OK;
+
+  if ((new_list = o_malloc(sizeof(struct _pointer_list))) != NULL) {
+    pointer_list_init(new_list);
+    for (i=0; ret==G_OK && i<pointer_list_size(cur_list); i++) {
+      if (pointer_list_get_at(cur_list, i) != remove && !pointer_list_append(new_list, pointer_list_get_at(cur_list, i))) {
+        ret = G_ERROR_MEMORY;
+      }
+    }
+    if (ret == G_OK && add != NULL && !pointer_list_append(new_list, add)) {
+      ret = G_ERROR_MEMORY;
+    }
+    if (ret == G_OK) {
+      GLEWLWYD_MODULE_LIST_PUBLISH(*instance_list, new_list);
+      if (retire_module_data(config, &release_retired_pointer_list, cur_list) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "replace_module_instance_list - Error retire_module_data");
+      }
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "replace_module_instance_list - Error pointer_list_append");
+      pointer_list_clean(new_list);
+      o_free(new_list);
+    }
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "replace_module_instance_list - Error allocating resources for new_list");
+    ret = G_ERROR_MEMORY;
+  }
+  return ret;
+}
+
+int append_module_instance(struct config_elements * config, struct _pointer_list ** instance_list, void * instance) {
+  int ret;
+
+  if (!pthread_mutex_lock(&config->module_lock)) {
+    ret = replace_module_instance_list(config, instance_list, instance, NULL);
     pthread_mutex_unlock(&config->module_lock);
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "close_plugin_module_instance_list - Error pthread_mutex_lock");
+    y_log_message(Y_LOG_LEVEL_ERROR, "append_module_instance - Error pthread_mutex_lock");
+    ret = G_ERROR;
   }
+  return ret;
 }
 
-void close_plugin_module_list(struct config_elements * config) {
+int remove_module_instance(struct config_elements * config, struct _pointer_list ** instance_list, void * instance) {
+  int ret = G_ERROR_NOT_FOUND;
   size_t i;
 
   if (!pthread_mutex_lock(&config->module_lock)) {
-    for (i=0; i<pointer_list_size(config->plugin_module_list); i++) {
-      struct _plugin_module * module = (struct _plugin_module *)pointer_list_get_at(config->plugin_module_list, i);
-      if (module != NULL) {
-        if (module->plugin_module_unload(config->config_p) != G_OK) {
-          y_log_message(Y_LOG_LEVEL_ERROR, "close_plugin_module_list - Error plugin_module_unload for module '%s'", module->name);
-        }
-  #ifndef DEBUG
-        if (dlclose(module->file_handle)) {
-          y_log_message(Y_LOG_LEVEL_ERROR, "close_plugin_module_list - Error dlclose for module '%s'", module->name);
+    for (i=0; ret==G_ERROR_NOT_FOUND && i<pointer_list_size(*instance_list); i++) {
+      if (pointer_list_get_at(*instance_list, i) == instance) {
+        ret = replace_module_instance_list(config, instance_list, NULL, instance);
+      }
+    }
+    pthread_mutex_unlock(&config->module_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "remove_module_instance - Error pthread_mutex_lock");
+    ret = G_ERROR;
+  }
+  return ret;
+}
+
+static void release_retired_user_module_instance(struct config_elements * config, void * data) {
+  struct _user_module_instance * instance = (struct _user_module_instance *)data;
+
+  if (instance->enabled && instance->module->user_module_close(config->config_m, instance->cls) != G_OK) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "release_retired_user_module_instance - Error user_module_close for instance '%s'/'%s'", instance->module->name, instance->name);
+  }
+  o_free(instance->name);
+  o_free(instance);
+}
+
+int retire_user_module_instance(struct config_elements * config, struct _user_module_instance * instance) {
+  return retire_module_data(config, &release_retired_user_module_instance, instance);
+}
+
+/**
+ * Disable the instance and close its cls when the requests using it are done
+ */
+int retire_user_module_instance_cls(struct config_elements * config, struct _user_module_instance * instance) {
+  struct _user_module_instance * retired;
+  int ret;
+
+  if ((retired = o_malloc(sizeof(struct _user_module_instance))) != NULL) {
+    memcpy(retired, instance, sizeof(struct _user_module_instance));
+    retired->name = o_strdup(instance->name);
+    __atomic_store_n(&instance->enabled, 0, __ATOMIC_RELEASE);
+    if ((ret = retire_user_module_instance(config, retired)) != G_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "retire_user_module_instance_cls - Error retire_user_module_instance");
+      release_retired_user_module_instance(config, retired);
+      ret = G_OK;
+    }
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "retire_user_module_instance_cls - Error allocating resources for retired");
+    ret = G_ERROR_MEMORY;
+  }
+  return ret;
+}
+
+static void release_retired_user_middleware_module_instance(struct config_elements * config, void * data) {
+  struct _user_middleware_module_instance * instance = (struct _user_middleware_module_instance *)data;
+
+  if (instance->enabled && instance->module->user_middleware_module_close(config->config_m, instance->cls) != G_OK) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "release_retired_user_middleware_module_instance - Error user_middleware_module_close for instance '%s'/'%s'", instance->module->name, instance->name);
+  }
+  o_free(instance->name);
+  o_free(instance);
+}
+
+int retire_user_middleware_module_instance_cls(struct config_elements * config, struct _user_middleware_module_instance * instance) {
+  struct _user_middleware_module_instance * retired;
+  int ret;
+
+  if ((retired = o_malloc(sizeof(struct _user_middleware_module_instance))) != NULL) {
+    memcpy(retired, instance, sizeof(struct _user_middleware_module_instance));
+    retired->name = o_strdup(instance->name);
+    __atomic_store_n(&instance->enabled, 0, __ATOMIC_RELEASE);
+    if ((ret = retire_module_data(config, &release_retired_user_middleware_module_instance, retired)) != G_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "retire_user_middleware_module_instance_cls - Error retire_module_data");
+      release_retired_user_middleware_module_instance(config, retired);
+      ret = G_OK;
+    }
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "retire_user_middleware_module_instance_cls - Error allocating resources for retired");
+    ret = G_ERROR_MEMORY;
+  }
+  return ret;
+}
+
+static void release_retired_client_module_instance(struct config_elements * config, void * data) {
+  struct _client_module_instance * instance = (struct _client_module_instance *)data;
+
+  if (instance->enabled && instance->module->client_module_close(config->config_m, instance->cls) != G_OK) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "release_retired_client_module_instance - Error client_module_close for instance '%s'/'%s'", instance->module->name, instance->name);
+  }
+  o_free(instance->name);
+  o_free(instance);
+}
+
+int retire_client_module_instance(struct config_elements * config, struct _client_module_instance * instance) {
+  return retire_module_data(config, &release_retired_client_module_instance, instance);
+}
+
+int retire_client_module_instance_cls(struct config_elements * config, struct _client_module_instance * instance) {
+  struct _client_module_instance * retired;
+  int ret;
+
+  if ((retired = o_malloc(sizeof(struct _client_module_instance))) != NULL) {
+    memcpy(retired, instance, sizeof(struct _client_module_instance));
+    retired->name = o_strdup(instance->name);
+    __atomic_store_n(&instance->enabled, 0, __ATOMIC_RELEASE);
+    if ((ret = retire_client_module_instance(config, retired)) != G_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "retire_client_module_instance_cls - Error retire_client_module_instance");
+      release_retired_client_module_instance(config, retired);
+      ret = G_OK;
+    }
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "retire_client_module_instance_cls - Error allocating resources for retired");
+    ret = G_ERROR_MEMORY;
+  }
+  return ret;
+}
+
+static void release_retired_user_auth_scheme_module_instance(struct config_elements * config, void * data) {
+  struct _user_auth_scheme_module_instance * instance = (struct _user_auth_scheme_module_instance *)data;
+
+  if (instance->enabled && instance->module->user_auth_scheme_module_close(config->config_m, instance->cls) != G_OK) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "release_retired_user_auth_scheme_module_instance - Error user_auth_scheme_module_close for instance '%s'/'%s'", instance->module->name, instance->name);
+  }
+  o_free(instance->name);
+  o_free(instance);
+}
+
+int retire_user_auth_scheme_module_instance(struct config_elements * config, struct _user_auth_scheme_module_instance * instance) {
+  return retire_module_data(config, &release_retired_user_auth_scheme_module_instance, instance);
+}
+
+int retire_user_auth_scheme_module_instance_cls(struct config_elements * config, struct _user_auth_scheme_module_instance * instance) {
+  struct _user_auth_scheme_module_instance * retired;
+  int ret;
+
+  if ((retired = o_malloc(sizeof(struct _user_auth_scheme_module_instance))) != NULL) {
+    memcpy(retired, instance, sizeof(struct _user_auth_scheme_module_instance));
+    retired->name = o_strdup(instance->name);
+    __atomic_store_n(&instance->enabled, 0, __ATOMIC_RELEASE);
+    if ((ret = retire_user_auth_scheme_module_instance(config, retired)) != G_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "retire_user_auth_scheme_module_instance_cls - Error retire_user_auth_scheme_module_instance");
+      release_retired_user_auth_scheme_module_instance(config, retired);
+      ret = G_OK;
+    }
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "retire_user_auth_scheme_module_instance_cls - Error allocating resources for retired");
+    ret = G_ERROR_MEMORY;
+  }
+  return ret;
+}
+
+/**
+ * The instance removes the endpoints it still owns when it's closed,
+ * the endpoints taken over by a newer generation stay declared
+ */
+static void release_retired_plugin_module_instance(struct config_elements * config, void * data) {
+  struct _plugin_module_instance * instance = (struct _plugin_module_instance *)data;
+
+  glewlwyd_plugin_endpoint_scope(instance->endpoint_generation);
+  if (instance->enabled && instance->module->plugin_module_close(config->config_p, instance->name, instance->cls) != G_OK) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "release_retired_plugin_module_instance - Error plugin_module_close for instance '%s'/'%s'", instance->module->name, instance->name);
+  }
+  glewlwyd_plugin_endpoint_scope(0);
+  o_free(instance->name);
+  o_free(instance);
+}
+
+int retire_plugin_module_instance(struct config_elements * config, struct _plugin_module_instance * instance) {
+  return retire_module_data(config, &release_retired_plugin_module_instance, instance);
+}
+
+/**
+ * Withdraw the instance endpoints and close its cls when the requests using it are done
+ */
+int retire_plugin_module_instance_cls(struct config_elements * config, struct _plugin_module_instance * instance) {
+  struct _plugin_module_instance * retired;
+  int ret;
+
+  if ((retired = o_malloc(sizeof(struct _plugin_module_instance))) != NULL) {
+    memcpy(retired, instance, sizeof(struct _plugin_module_instance));
+    retired->name = o_strdup(instance->name);
+    glewlwyd_plugin_endpoint_withdraw(config, instance->endpoint_generation);
+    __atomic_store_n(&instance->enabled, 0, __ATOMIC_RELEASE);
+    instance->cls = NULL;
+    if ((ret = retire_plugin_module_instance(config, retired)) != G_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "retire_plugin_module_instance_cls - Error retire_plugin_module_instance");
+      release_retired_plugin_module_instance(config, retired);
+      ret = G_OK;
+    }
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "retire_plugin_module_instance_cls - Error allocating resources for retired");
+    ret = G_ERROR_MEMORY;
+  }
+  return ret;
+}
+
+static void release_retired_user_module_generation(struct config_elements * config, void * data) {
+  struct _module_generation * generation = (struct _module_generation *)data;
+
+  if (generation->instance_list != NULL) {
+    free_user_module_instance_list(config, generation->instance_list);
+  }
+  if (generation->module_list != NULL) {
+    free_user_module_list(config, generation->module_list);
+  }
+  o_free(generation);
+}
+
+static void release_retired_user_middleware_module_generation(struct config_elements * config, void * data) {
+  struct _module_generation * generation = (struct _module_generation *)data;
+
+  if (generation->instance_list != NULL) {
+    free_user_middleware_module_instance_list(config, generation->instance_list);
+  }
+  if (generation->module_list != NULL) {
+    free_user_middleware_module_list(config, generation->module_list);
+  }
+  o_free(generation);
+}
+
+static void release_retired_client_module_generation(struct config_elements * config, void * data) {
+  struct _module_generation * generation = (struct _module_generation *)data;
+
+  if (generation->instance_list != NULL) {
+    free_client_module_instance_list(config, generation->instance_list);
+  }
+  if (generation->module_list != NULL) {
+    free_client_module_list(config, generation->module_list);
+  }
+  o_free(generation);
+}
+
+static void release_retired_user_auth_scheme_module_generation(struct config_elements * config, void * data) {
+  struct _module_generation * generation = (struct _module_generation *)data;
+
+  if (generation->instance_list != NULL) {
+    free_user_auth_scheme_module_instance_list(config, generation->instance_list);
+  }
+  if (generation->module_list != NULL) {
+    free_user_auth_scheme_module_list(config, generation->module_list);
+  }
+  o_free(generation);
+}
+
+static void release_retired_plugin_module_generation(struct config_elements * config, void * data) {
+  struct _module_generation * generation = (struct _module_generation *)data;
+
+  if (generation->instance_list != NULL) {
+    free_plugin_module_instance_list(config, generation->instance_list);
+  }
+  if (generation->module_list != NULL) {
+    free_plugin_module_list(config, generation->module_list);
+  }
+  o_free(generation);
+}
+
+/**
+ * Retire the lists replaced by a reload
+ * If the instances list wasn't replaced, its instances still use the previous modules,
+ * so the previous modules list is kept as well
+ */
+static int retire_module_generation(struct config_elements * config, struct _module_generation * generation, struct _pointer_list * module_list, struct _pointer_list * instance_list, void (* release)(struct config_elements * config, void * data)) {
+  int ret;
+
+  if (generation->instance_list == instance_list) {
+    generation->instance_list = NULL;
+    generation->module_list = NULL;
+  } else if (generation->module_list == module_list) {
+    generation->module_list = NULL;
+  }
+  if ((ret = retire_module_data(config, release, generation)) != G_OK) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "retire_module_generation - Error retire_module_data");
+    o_free(generation);
+  }
+  return ret;
+}
+
+/**
+ * Load a new set of modules and instances alongside the current one,
+ * publish it, then retire the current one
+ */
+int reload_user_module_list(struct config_elements * config) {
+  struct _module_generation * generation;
+  int ret = G_OK;
+
+  if (!pthread_mutex_lock(&config->module_lock)) {
+    if ((generation = o_malloc(sizeof(struct _module_generation))) != NULL) {
+      generation->module_list = config->user_module_list;
+      generation->instance_list = config->user_module_instance_list;
+      if (init_user_module_list(config) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "reload_user_module_list - Error init_user_module_list");
+        ret = G_ERROR;
+      }
+      if (load_user_module_instance_list(config) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "reload_user_module_list - Error load_user_module_instance_list");
+        ret = G_ERROR;
+      }
+      retire_module_generation(config, generation, config->user_module_list, config->user_module_instance_list, &release_retired_user_module_generation);
+      invalidate_scheme_can_use_cache(config, NULL, NULL);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "reload_user_module_list - Error allocating resources for generation");
+      ret = G_ERROR_MEMORY;
+    }
+    pthread_mutex_unlock(&config->module_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "reload_user_module_list - Error pthread_mutex_lock");
+    ret = G_ERROR;
+  }
+  return ret;
+}
+
+int reload_user_middleware_module_list(struct config_elements * config) {
+  struct _module_generation * generation;
+  int ret = G_OK;
+
+  if (!pthread_mutex_lock(&config->module_lock)) {
+    if ((generation = o_malloc(sizeof(struct _module_generation))) != NULL) {
+      generation->module_list = config->user_middleware_module_list;
+      generation->instance_list = config->user_middleware_module_instance_list;
+      if (init_user_middleware_module_list(config) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "reload_user_middleware_module_list - Error init_user_middleware_module_list");
+        ret = G_ERROR;
+      }
+      if (load_user_middleware_module_instance_list(config) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "reload_user_middleware_module_list - Error load_user_middleware_module_instance_list");
+        ret = G_ERROR;
+      }
+      retire_module_generation(config, generation, config->user_middleware_module_list, config->user_middleware_module_instance_list, &release_retired_user_middleware_module_generation);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "reload_user_middleware_module_list - Error allocating resources for generation");
+      ret = G_ERROR_MEMORY;
+    }
+    pthread_mutex_unlock(&config->module_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "reload_user_middleware_module_list - Error pthread_mutex_lock");
+    ret = G_ERROR;
+  }
+  return ret;
+}
+
+/**
+ * Middleware instances are applied in order, so the whole instances list
+ * is reloaded when one of them is added, updated or removed
+ */
+int reload_user_middleware_module_instance_list(struct config_elements * config) {
+  struct _module_generation * generation;
+  int ret;
+
+  if (!pthread_mutex_lock(&config->module_lock)) {
+    if ((generation = o_malloc(sizeof(struct _module_generation))) != NULL) {
+      generation->module_list = NULL;
+      generation->instance_list = config->user_middleware_module_instance_list;
+      if ((ret = load_user_middleware_module_instance_list(config)) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "reload_user_middleware_module_instance_list - Error load_user_middleware_module_instance_list");
+      }
+      retire_module_generation(config, generation, NULL, config->user_middleware_module_instance_list, &release_retired_user_middleware_module_generation);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "reload_user_middleware_module_instance_list - Error allocating resources for generation");
+      ret = G_ERROR_MEMORY;
+    }
+    pthread_mutex_unlock(&config->module_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "reload_user_middleware_module_instance_list - Error pthread_mutex_lock");
+    ret = G_ERROR;
+  }
+  return ret;
+}
+
+int reload_client_module_list(struct config_elements * config) {
+  struct _module_generation * generation;
+  int ret = G_OK;
+
+  if (!pthread_mutex_lock(&config->module_lock)) {
+    if ((generation = o_malloc(sizeof(struct _module_generation))) != NULL) {
+      generation->module_list = config->client_module_list;
+      generation->instance_list = config->client_module_instance_list;
+      if (init_client_module_list(config) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "reload_client_module_list - Error init_client_module_list");
+        ret = G_ERROR;
+      }
+      if (load_client_module_instance_list(config) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "reload_client_module_list - Error load_client_module_instance_list");
+        ret = G_ERROR;
+      }
+      retire_module_generation(config, generation, config->client_module_list, config->client_module_instance_list, &release_retired_client_module_generation);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "reload_client_module_list - Error allocating resources for generation");
+      ret = G_ERROR_MEMORY;
+    }
+    pthread_mutex_unlock(&config->module_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "reload_client_module_list - Error pthread_mutex_lock");
+    ret = G_ERROR;
+  }
+  return ret;
+}
+
+int reload_user_auth_scheme_module_list(struct config_elements * config) {
+  struct _module_generation * generation;
+  int ret = G_OK;
+
+  if (!pthread_mutex_lock(&config->module_lock)) {
+    if ((generation = o_malloc(sizeof(struct _module_generation))) != NULL) {
+      generation->module_list = config->user_auth_scheme_module_list;
+      generation->instance_list = config->user_auth_scheme_module_instance_list;
+      if (init_user_auth_scheme_module_list(config) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "reload_user_auth_scheme_module_list - Error init_user_auth_scheme_module_list");
+        ret = G_ERROR;
+      }
+      if (load_user_auth_scheme_module_instance_list(config) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "reload_user_auth_scheme_module_list - Error load_user_auth_scheme_module_instance_list");
+        ret = G_ERROR;
+      }
+      retire_module_generation(config, generation, config->user_auth_scheme_module_list, config->user_auth_scheme_module_instance_list, &release_retired_user_auth_scheme_module_generation);
+      invalidate_scheme_can_use_cache(config, NULL, NULL);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "reload_user_auth_scheme_module_list - Error allocating resources for generation");
+      ret = G_ERROR_MEMORY;
+    }
+    pthread_mutex_unlock(&config->module_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "reload_user_auth_scheme_module_list - Error pthread_mutex_lock");
+    ret = G_ERROR;
+  }
+  return ret;
+}
+
+/**
+ * The new plugin instances are initialized while the current ones still serve their endpoints,
+ * each new instance takes over the endpoints of the previous one when it's published,
+ * the endpoints the new instances didn't declare are withdrawn
+ * The previous instances are closed when the requests using them are complete
+ */
+int reload_plugin_module_list(struct config_elements * config) {
+  struct _module_generation * generation;
+  struct _plugin_module_instance * instance;
+  size_t i;
+  int ret = G_OK;
+
+  if (!pthread_mutex_lock(&config->module_lock)) {
+    if ((generation = o_malloc(sizeof(struct _module_generation))) != NULL) {
+      generation->module_list = config->plugin_module_list;
+      generation->instance_list = config->plugin_module_instance_list;
+      if (init_plugin_module_list(config) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "reload_plugin_module_list - Error init_plugin_module_list");
+        ret = G_ERROR;
+      }
+      if (load_plugin_module_instance_list(config) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "reload_plugin_module_list - Error load_plugin_module_instance_list");
+        ret = G_ERROR;
+      }
+      for (i=0; i<pointer_list_size(generation->instance_list); i++) {
+        instance = (struct _plugin_module_instance *)pointer_list_get_at(generation->instance_list, i);
+        if (instance != NULL) {
+          glewlwyd_plugin_endpoint_withdraw(config, instance->endpoint_generation);
         }
-  #endif
-        o_free(module->name);
-        o_free(module->display_name);
-        o_free(module->description);
-        o_free(module);
       }
+      retire_module_generation(config, generation, config->plugin_module_list, config->plugin_module_instance_list, &release_retired_plugin_module_generation);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "reload_plugin_module_list - Error allocating resources for generation");
+      ret = G_ERROR_MEMORY;
     }
-    pointer_list_clean(config->plugin_module_list);
-    o_free(config->plugin_module_list);
     pthread_mutex_unlock(&config->module_lock);
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "close_plugin_module_list - Error pthread_mutex_lock");
+    y_log_message(Y_LOG_LEVEL_ERROR, "reload_plugin_module_list - Error pthread_mutex_lock");
+    ret = G_ERROR;
   }
+  return ret;
 }
 
 char * get_ip_data(struct config_elements * config, const char * ip_address) {
@@ -3605,7 +5410,7 @@ char * get_ip_data(struct config_elements * config, const char * ip_address) {
       ulfius_init_request(&req);
       ulfius_init_response(&resp);
       ulfius_set_request_properties(&req, U_OPT_HTTP_URL, url, U_OPT_NONE);
-      if (ulfius_send_http_request(&req, &resp) == U_OK && resp.status >= 200 && resp.status < 300) {
+      if (glewlwyd_http_client_send_request(config, &req, &resp) == G_OK && resp.status >= 200 && resp.status < 300) {
         if ((j_response = ulfius_get_json_body_response(&resp, NULL)) != NULL) {
           for (i=0; properties[i]!=NULL; i++) {
             if (data == NULL) {
@@ -3619,7 +5424,7 @@ char * get_ip_data(struct config_elements * config, const char * ip_address) {
         }
         json_decref(j_response);
       } else {
-        y_log_message(Y_LOG_LEVEL_ERROR, "get_ip_data - Error ulfius_send_http_request - url %s", url);
+        y_log_message(Y_LOG_LEVEL_ERROR, "get_ip_data - Error glewlwyd_http_client_send_request - url %s", url);
       }
       ulfius_clean_request(&req);
       ulfius_clean_response(&resp);
@@ -41,6 +41,8 @@
 #endif
 
 #include <stdio.h>
+#include <time.h>
+#include <pthread.h>
 
 /** Angharad libraries **/
 #include <ulfius.h>
@@ -79,6 +81,32 @@
 #define GLEWLWYD_API_KEY_HEADER_KEY                        "Authorization"
 #define GLEWLWYD_API_KEY_HEADER_PREFIX                     "token "
 #define GLEWLWYD_API_KEY_LENGTH                            32
+#define GLEWLWYD_API_KEY_CACHE_EXPIRATION                  60
+#define GLEWLWYD_API_KEY_COUNTER_FLUSH_INTERVAL            30
+#define GLEWLWYD_LIST_STREAM_PAGE_SIZE                     100
+#define GLEWLWYD_LIST_STREAM_BLOCK_SIZE                    16384
+#define GLEWLWYD_DEFAULT_MODULE_INIT_MAX_PARALLEL          8
+#define GLEWLWYD_DEFAULT_MODULE_INIT_TIMEOUT               60
+#define GLEWLWYD_MODULE_EPOCH_STRIPES                      16
+#define GLEWLWYD_MODULE_REAP_INTERVAL                      1
+#define GLEWLWYD_DEFAULT_SCHEME_CAN_USE_CACHE_EXPIRATION   60
+#define GLEWLWYD_SCHEME_CAN_USE_CACHE_MAX_USERS            4096
+#define GLEWLWYD_DEFAULT_ADMISSION_RETRY_AFTER             1
+#define GLEWLWYD_DEFAULT_ALLOC_CACHE_SIZE                  0
+#define GLEWLWYD_DEFAULT_HTTP_CLIENT_TIMEOUT               30
+#define GLEWLWYD_DEFAULT_HTTP_CLIENT_CONNECT_TIMEOUT       10
+#define GLEWLWYD_DEFAULT_HTTP_CLIENT_MAX_CONNECTIONS_PER_HOST 8
+#define GLEWLWYD_DEFAULT_HTTP_CLIENT_IDLE_TIMEOUT          60
+#define GLEWLWYD_DEFAULT_HTTP_CLIENT_DNS_CACHE_TIMEOUT     60
+#define GLEWLWYD_DEFAULT_HTTP_CLIENT_MAX_IDLE_CONNECTIONS  64
+#define GLEWLWYD_HTTP_CLIENT_REAPER_INTERVAL               10
+#define GLEWLWYD_HTTP_CLIENT_REAPER_STOPPED                0
+#define GLEWLWYD_HTTP_CLIENT_REAPER_RUNNING                1
+#define GLEWLWYD_HTTP_CLIENT_REAPER_STOPPING               2
+#define GLEWLWYD_DEFAULT_CACHE_INVALIDATION_INTERVAL       1000
+#define GLEWLWYD_DEFAULT_CACHE_INVALIDATION_RETENTION      3600
+#define GLEWLWYD_CACHE_INVALIDATION_LOOKBACK               100
+#define GLEWLWYD_CACHE_INVALIDATION_CHANNEL                "glewlwyd_cache_invalidation"
 #define GLEWLWYD_MAIL_ON_CONNEXION_TYPE                    "mail-on-connexion"
 #define GLEWLWYD_IP_GEOLOCATION_API_TYPE                   "ip-geolocation-api"
 
@@ -100,11 +128,21 @@
 #define GLEWLWYD_TABLE_CLIENT_USER_SCOPE                       "g_client_user_scope"
 #define GLEWLWYD_TABLE_API_KEY                                 "g_api_key"
 #define GLEWLWYD_TABLE_MISC_CONFIG                             "g_misc_config"
+#define GLEWLWYD_TABLE_CACHE_INVALIDATION                      "g_cache_invalidation"
 
 // Module management
 #define GLEWLWYD_MODULE_ACTION_STOP  0
 #define GLEWLWYD_MODULE_ACTION_START 1
 
+#define GLEWLWYD_MODULE_INIT_TASK_PENDING 0
+#define GLEWLWYD_MODULE_INIT_TASK_RUNNING 1
+#define GLEWLWYD_MODULE_INIT_TASK_DONE    2
+#define GLEWLWYD_MODULE_INIT_TASK_TIMEOUT 3
+
+// Module lists are replaced as a whole and never modified once published
+#define GLEWLWYD_MODULE_LIST_GET(list)            __atomic_load_n(&(list), __ATOMIC_ACQUIRE)
+#define GLEWLWYD_MODULE_LIST_PUBLISH(list, value) __atomic_store_n(&(list), (value), __ATOMIC_RELEASE)
+
 // Environment variables names
 #define GLEWLWYD_ENV_PORT                        "GLWD_PORT"
 #define GLEWLWYD_ENV_MAX_POST_SIZE               "GLWD_MAX_POST_SIZE"
@@ -148,10 +186,31 @@
 #define GLEWLWYD_ENV_DATABASE_MARIADB_PORT       "GLWD_DATABASE_MARIADB_PORT"
 #define GLEWLWYD_ENV_DATABASE_SQLITE3_PATH       "GLWD_DATABASE_SQLITE3_PATH"
 #define GLEWLWYD_ENV_DATABASE_POSTGRE_CONNINFO   "GLWD_DATABASE_POSTGRE_CONNINFO"
+#define GLEWLWYD_ENV_DATABASE_REPLICA            "GLWD_DATABASE_REPLICA"
+#define GLEWLWYD_ENV_DATABASE_PREPARED_STATEMENT "GLWD_DATABASE_PREPARED_STATEMENT"
 #define GLEWLWYD_ENV_METRICS                     "GLWD_METRICS"
 #define GLEWLWYD_ENV_METRICS_PORT                "GLWD_METRICS_PORT"
 #define GLEWLWYD_ENV_METRICS_ADMIN               "GLWD_METRICS_ADMIN"
 #define GLEWLWYD_ENV_METRICS_BIND_ADDRESS        "GLWD_METRICS_BIND_ADDRESS"
+#define GLEWLWYD_ENV_MODULE_INIT_MAX_PARALLEL    "GLWD_MODULE_INIT_MAX_PARALLEL"
+#define GLEWLWYD_ENV_MODULE_INIT_TIMEOUT         "GLWD_MODULE_INIT_TIMEOUT"
+#define GLEWLWYD_ENV_SCHEME_CAN_USE_CACHE_EXPIRATION "GLWD_SCHEME_CAN_USE_CACHE_EXPIRATION"
+#define GLEWLWYD_ENV_ADMISSION_RETRY_AFTER       "GLWD_ADMISSION_RETRY_AFTER"
+#define GLEWLWYD_ENV_ADMISSION_MAX_CONCURRENT    "GLWD_ADMISSION_%s_MAX_CONCURRENT"
+#define GLEWLWYD_ENV_ADMISSION_MAX_QUEUE         "GLWD_ADMISSION_%s_MAX_QUEUE"
+#define GLEWLWYD_ENV_ADMISSION_QUEUE_TIMEOUT     "GLWD_ADMISSION_%s_QUEUE_TIMEOUT"
+#define GLEWLWYD_ENV_RATE_LIMIT                  "GLWD_RATE_LIMIT"
+#define GLEWLWYD_ENV_ALLOC_CACHE_SIZE            "GLWD_ALLOC_CACHE_SIZE"
+#define GLEWLWYD_ENV_CACHE_INVALIDATION_BACKEND  "GLWD_CACHE_INVALIDATION_BACKEND"
+#define GLEWLWYD_ENV_CACHE_INVALIDATION_INTERVAL "GLWD_CACHE_INVALIDATION_INTERVAL"
+#define GLEWLWYD_ENV_CACHE_INVALIDATION_RETENTION "GLWD_CACHE_INVALIDATION_RETENTION"
+#define GLEWLWYD_ENV_CACHE_INVALIDATION_CONNINFO "GLWD_CACHE_INVALIDATION_CONNINFO"
+#define GLEWLWYD_ENV_HTTP_CLIENT_TIMEOUT         "GLWD_HTTP_CLIENT_TIMEOUT"
+#define GLEWLWYD_ENV_HTTP_CLIENT_CONNECT_TIMEOUT "GLWD_HTTP_CLIENT_CONNECT_TIMEOUT"
+#define GLEWLWYD_ENV_HTTP_CLIENT_MAX_CONNECTIONS_PER_HOST "GLWD_HTTP_CLIENT_MAX_CONNECTIONS_PER_HOST"
+#define GLEWLWYD_ENV_HTTP_CLIENT_IDLE_TIMEOUT    "GLWD_HTTP_CLIENT_IDLE_TIMEOUT"
+#define GLEWLWYD_ENV_HTTP_CLIENT_DNS_CACHE_TIMEOUT "GLWD_HTTP_CLIENT_DNS_CACHE_TIMEOUT"
+#define GLEWLWYD_ENV_HTTP_CLIENT_MAX_IDLE_CONNECTIONS "GLWD_HTTP_CLIENT_MAX_IDLE_CONNECTIONS"
 
 struct send_mail_content_struct {
   char                   * host;
@@ -167,6 +226,118 @@ struct send_mail_content_struct {
   char                   * body;
 };
 
+/**
+ * Synchronization shared by a set of module instance init tasks
+ * and the threads running them
+ */
+struct _module_init_sync {
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
+  size_t          running;
+  size_t          refcount;
+};
+
+/**
+ * Init of a module instance at startup, run in its own thread
+ * A task timed out is released by its thread when the init eventually returns
+ */
+struct _module_init_task {
+  struct config_elements   * config;
+  struct _module_init_sync * sync;
+  const char               * module_type;
+  const char               * module_name;
+  const char               * instance_name;
+  void                     * module;
+  void                     * instance;
+  unsigned int               endpoint_generation;
+  int                        readonly;
+  int                        multiple_passwords;
+  json_t                   * j_parameters;
+  json_t                   * j_init;
+  void                     * cls;
+  json_t *                (* init)(struct _module_init_task * task);
+  void                    (* close)(struct _module_init_task * task);
+  int                        status;
+  size_t                     refcount;
+  struct timespec            start;
+  struct timespec            deadline;
+  long                       duration_ms;
+};
+
+/**
+ * Module data replaced while requests may still use it,
+ * epoch is the module epoch during which it was retired
+ */
+struct _module_retired {
+  void       (* release)(struct config_elements * config, void * data);
+  void        * data;
+  unsigned long epoch;
+};
+
+/**
+ * Every request holds a reference on the epoch current when it started,
+ * a new epoch starts every time module data is retired
+ * The data retired during an epoch is released when this epoch
+ * and all the previous ones have no reference left
+ */
+struct _module_epoch_ref {
+  size_t        stripe;
+  unsigned long epoch;
+};
+
+struct _module_epoch_count {
+  unsigned long epoch;
+  size_t        refcount;
+};
+
+/**
+ * The references are counted per stripe, each thread uses its own stripe
+ * so the requests don't share a lock, count_list is sorted by epoch
+ */
+struct _module_epoch_stripe {
+  pthread_mutex_t              lock;
+  struct _module_epoch_count * count_list;
+  size_t                       count_list_size;
+};
+
+#define GLEWLWYD_MODULE_REAPER_STOPPED  0
+#define GLEWLWYD_MODULE_REAPER_RUNNING  1
+#define GLEWLWYD_MODULE_REAPER_STOPPING 2
+
+/**
+ * Callback of a plugin endpoint for one instance generation
+ */
+struct _plugin_endpoint_target {
+  int  (* callback)(const struct _u_request * request, struct _u_response * response, void * user_data);
+  void  * user_data;
+};
+
+/**
+ * Plugin endpoint declared in the webservice
+ * The webservice calls a dispatcher running the target of the instance generation owning the endpoint,
+ * so a reloaded instance takes over the endpoints of the previous one without declaring them twice
+ * The target declared by an instance being initialized is pending until the instance is published
+ * An endpoint is kept until the server stops because requests may still be running it
+ */
+struct _plugin_endpoint {
+  struct config_elements         * config;
+  char                           * method;
+  char                           * url;
+  int                              removed;
+  unsigned int                     generation;
+  struct _plugin_endpoint_target * target;
+  unsigned int                     pending_generation;
+  struct _plugin_endpoint_target * pending;
+};
+
+/**
+ * A modules list and its instances list replaced by a reload
+ */
+struct _module_generation {
+  struct _pointer_list * module_list;
+  struct _pointer_list * instance_list;
+};
+
 // Main functions and misc functions
 int build_config_from_env(struct config_elements * config);
 int  build_config_from_file(struct config_elements * config);
@@ -196,6 +367,31 @@ struct _user_auth_scheme_module_instance * get_user_auth_scheme_module_instance(
 struct _user_auth_scheme_module * get_user_auth_scheme_module_lib(struct config_elements * config, const char * name);
 struct _plugin_module_instance * get_plugin_module_instance(struct config_elements * config, const char * name);
 struct _plugin_module * get_plugin_module_lib(struct config_elements * config, const char * name);
+int    retire_module_data(struct config_elements * config, void (* release)(struct config_elements * config, void * data), void * data);
+void   reap_retired_module_data(struct config_elements * config, int force);
+int    glewlwyd_module_epoch_init(struct config_elements * config);
+void   glewlwyd_module_epoch_close(struct config_elements * config);
+int    glewlwyd_module_reaper_start(struct config_elements * config);
+void   glewlwyd_module_reaper_stop(struct config_elements * config);
+int    glewlwyd_module_epoch_enter(struct config_elements * config, struct _module_epoch_ref * ref);
+void   glewlwyd_module_epoch_leave(struct config_elements * config, struct _module_epoch_ref * ref);
+int    append_module_instance(struct config_elements * config, struct _pointer_list ** instance_list, void * instance);
+int    remove_module_instance(struct config_elements * config, struct _pointer_list ** instance_list, void * instance);
+int    retire_user_module_instance(struct config_elements * config, struct _user_module_instance * instance);
+int    retire_user_module_instance_cls(struct config_elements * config, struct _user_module_instance * instance);
+int    retire_user_middleware_module_instance_cls(struct config_elements * config, struct _user_middleware_module_instance * instance);
+int    retire_client_module_instance(struct config_elements * config, struct _client_module_instance * instance);
+int    retire_client_module_instance_cls(struct config_elements * config, struct _client_module_instance * instance);
+int    retire_user_auth_scheme_module_instance(struct config_elements * config, struct _user_auth_scheme_module_instance * instance);
+int    retire_user_auth_scheme_module_instance_cls(struct config_elements * config, struct _user_auth_scheme_module_instance * instance);
+int    retire_plugin_module_instance(struct config_elements * config, struct _plugin_module_instance * instance);
+int    retire_plugin_module_instance_cls(struct config_elements * config, struct _plugin_module_instance * instance);
+int    reload_user_module_list(struct config_elements * config);
+int    reload_user_middleware_module_list(struct config_elements * config);
+int    reload_user_middleware_module_instance_list(struct config_elements * config);
+int    reload_client_module_list(struct config_elements * config);
+int    reload_user_auth_scheme_module_list(struct config_elements * config);
+int    reload_plugin_module_list(struct config_elements * config);
 char * get_ip_data(struct config_elements * config, const char * ip_address);
 const char * get_template_property(json_t * j_params, const char * template_property, const char * user_lang, const char * property_field);
 char * complete_template(const char * template, ...);
@@ -218,6 +414,7 @@ json_t * auth_trigger_identify_scheme(struct config_elements * config, const cha
 int user_session_update(struct config_elements * config, const char * session_uid, const char * ip_source, const char * user_agent, const char * issued_for, const char * username, const char * scheme_name, int update_login);
 json_t * get_session_for_username(struct config_elements * config, const char * session_uid, const char * username);
 json_t * get_current_user_for_session(struct config_elements * config, const char * session_uid);
+int get_current_user_view_for_session(struct config_elements * config, const char * session_uid, const struct _glewlwyd_user_view ** view);
 json_t * get_users_for_session(struct config_elements * config, const char * session_uid);
 int user_session_delete(struct config_elements * config, const char * session_uid, const char * username);
 char * get_session_id(struct config_elements * config, const struct _u_request * request);
@@ -232,10 +429,14 @@ json_t * user_get_profile(struct config_elements * config, const char * username
 int user_update_password(struct config_elements * config, const char * username, const char * old_password, const char ** new_passwords, size_t new_passwords_len, const char * ip_address);
 int user_set_password(struct config_elements * config, const char * username, const char ** new_passwords, size_t new_passwords_len);
 json_t * get_scheme_list_for_user(struct config_elements * config, const char * username);
+int get_scheme_can_use(struct config_elements * config, struct _user_auth_scheme_module_instance * instance, const char * username);
+void invalidate_scheme_can_use_cache(struct config_elements * config, const char * username, const char * scheme_name);
+void invalidate_scheme_can_use_cache_callback(const char * cache, const char * key, void * cls);
 
 // User
 int user_has_scope(json_t * j_user, const char * scope);
 int user_has_scheme(struct config_elements * config, const char * username, const char * scheme_name);
+json_t * get_user_scheme_list(struct config_elements * config, const char * username);
 
 // Client
 json_t * auth_check_client_credentials(struct config_elements * config, const char * client_id, const char * password);
@@ -313,6 +514,11 @@ void close_plugin_module_list(struct config_elements * config);
 // Plugin functions
 int glewlwyd_callback_add_plugin_endpoint(struct config_plugin * config, const char * method, const char * name, const char * url, unsigned int priority, int (* callback)(const struct _u_request * request, struct _u_response * response, void * user_data), void * user_data);
 int glewlwyd_callback_remove_plugin_endpoint(struct config_plugin * config, const char * method, const char * name, const char * url);
+void glewlwyd_plugin_endpoint_scope(unsigned int generation);
+unsigned int glewlwyd_plugin_endpoint_new_generation(struct config_elements * config);
+void glewlwyd_plugin_endpoint_publish(struct config_elements * config, unsigned int generation);
+void glewlwyd_plugin_endpoint_withdraw(struct config_elements * config, unsigned int generation);
+void glewlwyd_plugin_endpoint_close(struct config_elements * config);
 json_t * glewlwyd_callback_check_session_valid(struct config_plugin * config, const struct _u_request * request, const char * scope_list);
 json_t * glewlwyd_callback_check_user_valid(struct config_plugin * config, const char * username, const char * password, const char * scope_list);
 json_t * glewlwyd_callback_check_client_valid(struct config_plugin * config, const char * client_id, const char * password);
@@ -326,6 +532,8 @@ void glewlwyd_callback_update_issued_for(struct config_plugin * config, const st
 json_t * glewlwyd_plugin_callback_get_user_list(struct config_plugin * config, const char * pattern, size_t offset, size_t limit);
 json_t * glewlwyd_plugin_callback_get_user(struct config_plugin * config, const char * username);
 json_t * glewlwyd_plugin_callback_get_user_profile(struct config_plugin * config, const char * username);
+int glewlwyd_plugin_callback_get_user_view(struct config_plugin * config, const char * username, const struct _glewlwyd_user_view ** view);
+void glewlwyd_plugin_callback_release_user_view(struct config_plugin * config, const struct _glewlwyd_user_view * view);
 json_t * glewlwyd_plugin_callback_is_user_valid(struct config_plugin * config, const char * username, json_t * j_user, int add);
 int glewlwyd_plugin_callback_add_user(struct config_plugin * config, json_t * j_user);
 int glewlwyd_plugin_callback_set_user(struct config_plugin * config, const char * username, json_t * j_user);
@@ -345,10 +553,20 @@ int glewlwyd_plugin_callback_scheme_can_use(struct config_plugin * config, const
 int glewlwyd_plugin_callback_scheme_deregister(struct config_plugin * config, const char * mod_name, const char * username);
 int glewlwyd_plugin_callback_metrics_add_metric(struct config_plugin * config, const char * name, const char * help);
 int glewlwyd_plugin_callback_metrics_increment_counter(struct config_plugin * config, const char * name, size_t inc, ...);
+int glewlwyd_plugin_callback_cache_invalidation_register(struct config_plugin * config, const char * cache, glewlwyd_cache_invalidation_callback callback, void * cls);
+int glewlwyd_plugin_callback_cache_invalidation_unregister(struct config_plugin * config, const char * cache, void * cls);
+int glewlwyd_plugin_callback_cache_invalidation_publish(struct config_plugin * config, const char * cache, const char * key);
+int glewlwyd_plugin_callback_http_send_request(struct config_plugin * config, const struct _u_request * request, struct _u_response * response);
+void glewlwyd_plugin_callback_admission_suspend(struct config_plugin * config);
+void glewlwyd_plugin_callback_admission_resume(struct config_plugin * config);
 
 // User CRUD functions
 json_t * get_user_list(struct config_elements * config, const char * pattern, size_t offset, size_t limit, const char * source);
 json_t * get_user(struct config_elements * config, const char * username, const char * source);
+int get_user_view(struct config_elements * config, const char * username, const struct _glewlwyd_user_view ** view);
+void release_user_view(const struct _glewlwyd_user_view * view);
+void user_view_scope_begin(void);
+void user_view_scope_end(void);
 json_t * get_user_profile(struct config_elements * config, const char * username, const char * source);
 json_t * is_user_valid(struct config_elements * config, const char * username, json_t * j_user, int add, const char * source);
 int add_user(struct config_elements * config, json_t * j_user, const char * source);
@@ -362,6 +580,10 @@ int glewlwyd_module_metrics_increment_counter(struct config_module * config, con
 int glewlwyd_module_callback_metrics_add_metric(struct config_module * config, const char * name, const char * help);
 int glewlwyd_module_callback_metrics_increment_counter(struct config_module * config, const char * name, size_t inc, ...);
 void glewlwyd_module_callback_update_issued_for(struct config_module * config, const struct _h_connection * conn, const char * sql_table, const char * issued_for_column, const char * issued_for_value, const char * id_column, json_int_t id_value);
+int glewlwyd_module_callback_cache_invalidation_register(struct config_module * config, const char * cache, glewlwyd_cache_invalidation_callback callback, void * cls);
+int glewlwyd_module_callback_cache_invalidation_unregister(struct config_module * config, const char * cache, void * cls);
+int glewlwyd_module_callback_cache_invalidation_publish(struct config_module * config, const char * cache, const char * key);
+int glewlwyd_module_callback_http_send_request(struct config_module * config, const struct _u_request * request, struct _u_response * response);
 
 // Client CRUD functions
 json_t * get_client_list(struct config_elements * config, const char * pattern, size_t offset, size_t limit, const char * source);
@@ -372,7 +594,7 @@ int set_client(struct config_elements * config, const char * client_id, json_t *
 int delete_client(struct config_elements * config, const char * client_id, const char * source);
 
 // Scope CRUD functions
-json_t * get_scope_list(struct config_elements * config, const char * pattern, size_t offset, size_t limit);
+json_t * get_scope_list(struct config_elements * config, const char * pattern, const char * after, size_t offset, size_t limit);
 json_t * get_scope(struct config_elements * config, const char * scope);
 json_t * is_scope_valid(struct config_elements * config, json_t * j_scope, int add);
 int add_scope(struct config_elements * config, json_t * j_scope);
@@ -384,6 +606,8 @@ int verify_api_key(struct config_elements * config, const char * api_key);
 json_t * get_api_key_list(struct config_elements * config, const char * pattern, size_t offset, size_t limit);
 json_t * generate_api_key(struct config_elements * config, const char * username, const char * issued_for, const char * user_agent);
 int disable_api_key(struct config_elements * config, const char * token_hash);
+int flush_api_key_counter(struct config_elements * config);
+void invalidate_api_key_cache_callback(const char * cache, const char * key, void * cls);
 
 // Misc Config CRUD functions
 json_t * get_misc_config_list(struct config_elements * config);
@@ -403,6 +627,52 @@ int glewlwyd_metrics_increment_counter_va(struct config_elements * config, const
 int glewlwyd_metrics_increment_counter(struct config_elements * config, const char * name, const char * label, size_t inc);
 char * glewlwyd_metrics_build_label(va_list vl_label);
 
+// Admission control functions
+int glewlwyd_admission_init(struct config_elements * config);
+void glewlwyd_admission_close(struct config_elements * config);
+int glewlwyd_admission_get_plugin_class(const char * url);
+void glewlwyd_admission_suspend(void);
+void glewlwyd_admission_resume(void);
+int glewlwyd_admission_wrap_callback(struct config_elements * config, int admission_class, int (** callback)(const struct _u_request * request, struct _u_response * response, void * user_data), void ** user_data);
+int glewlwyd_add_admission_endpoint(struct config_elements * config, int admission_class, const char * method, const char * url_prefix, const char * url_format, unsigned int priority, int (* callback)(const struct _u_request * request, struct _u_response * response, void * user_data), void * user_data);
+char * glewlwyd_admission_metrics(struct config_elements * config, char * content);
+
+// Rate limit functions
+int glewlwyd_rate_limit_init(struct config_elements * config);
+void glewlwyd_rate_limit_close(struct config_elements * config);
+int glewlwyd_rate_limit_set_endpoint(struct config_elements * config, json_t * j_endpoint);
+int glewlwyd_rate_limit_check(struct config_elements * config, const char * endpoint, const char * ip_source, const char * username, const char * client_id, unsigned int * retry_after);
+void glewlwyd_rate_limit_set_response(struct _u_response * response, unsigned int retry_after);
+int glewlwyd_rate_limit_wrap_callback(struct config_elements * config, const char * endpoint, int (** callback)(const struct _u_request * request, struct _u_response * response, void * user_data), void ** user_data);
+char * glewlwyd_rate_limit_metrics(struct config_elements * config, char * content);
+
+// Allocation cache
+int glewlwyd_alloc_cache_init(struct config_elements * config);
+void glewlwyd_alloc_cache_get_counters(size_t * alloc_count, size_t * hit_count);
+char * glewlwyd_alloc_cache_metrics(struct config_elements * config, char * content);
+
+// Cluster cache invalidation
+#define GLEWLWYD_CACHE_INVALIDATION_STOPPED  0
+#define GLEWLWYD_CACHE_INVALIDATION_RUNNING  1
+#define GLEWLWYD_CACHE_INVALIDATION_STOPPING 2
+
+int glewlwyd_cache_invalidation_init(struct config_elements * config);
+int glewlwyd_cache_invalidation_set_backend(struct config_elements * config, const char * backend);
+int glewlwyd_cache_invalidation_start(struct config_elements * config);
+void glewlwyd_cache_invalidation_stop(struct config_elements * config);
+void glewlwyd_cache_invalidation_close(struct config_elements * config);
+int glewlwyd_cache_invalidation_register(struct config_elements * config, const char * cache, glewlwyd_cache_invalidation_callback callback, void * cls);
+int glewlwyd_cache_invalidation_unregister(struct config_elements * config, const char * cache, void * cls);
+void glewlwyd_cache_invalidation_local(struct config_elements * config, const char * cache, const char * key);
+int glewlwyd_cache_invalidation_publish(struct config_elements * config, const char * cache, const char * key);
+
+// Outbound HTTP client
+int glewlwyd_http_client_init(struct config_elements * config);
+int glewlwyd_http_client_start(struct config_elements * config);
+void glewlwyd_http_client_stop(struct config_elements * config);
+void glewlwyd_http_client_close(struct config_elements * config);
+int glewlwyd_http_client_send_request(struct config_elements * config, const struct _u_request * request, struct _u_response * response);
+
 // Callback functions
 int callback_glewlwyd_check_user_session (const struct _u_request * request, struct _u_response * response, void * user_data);
 int callback_glewlwyd_check_admin_session (const struct _u_request * request, struct _u_response * response, void * user_data);
@@ -0,0 +1,599 @@
+/**
+ *
+ * Glewlwyd SSO Server
+ *
+ * Authentiation server
+ * Users are authenticated via various backend available: database, ldap
+ * Using various authentication methods available: password, OTP, send code, etc.
+ *
+ * Outbound HTTP client functions definitions
+ *
+ * Copyright 2016-2021 Nicolas Mora <mail@babelouest.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU GENERAL PUBLIC LICENSE
+ * License as published by the Free Software Foundation;
+ * version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU GENERAL PUBLIC LICENSE for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <curl/curl.h>
+
+#include "glewlwyd.h"
+
+/**
+ * An idle curl handle keeps its connection open to be reused by the next request to the same origin
+ */
+struct _glwd_http_client_handle {
+  CURL * curl;
+  time_t last_used;
+};
+
+/**
+ * Origin is 'scheme://host:port', the number of handles in use for an origin is capped
+ * The idle handles are sorted from the least recently used to the most recently used
+ */
+struct _glwd_http_client_origin {
+  char                 * origin;
+  struct _pointer_list   idle_list;
+  unsigned int           active;
+  unsigned int           waiters;
+  pthread_cond_t         cond;
+};
+
+/**
+ * The number of idle handles is capped for all the origins,
+ * the reaper thread closes the expired idle handles and removes the unused origins
+ */
+struct _glwd_http_client {
+  CURLSH               * share;
+  pthread_mutex_t        share_lock[CURL_LOCK_DATA_LAST];
+  pthread_mutex_t        lock;
+  struct _pointer_list   origin_list;
+  size_t                 idle_count;
+  pthread_cond_t         reaper_cond;
+  pthread_t              reaper_thread;
+  unsigned short int     reaper_status;
+};
+
+static void free_http_client_handle(void * data) {
+  struct _glwd_http_client_handle * handle = (struct _glwd_http_client_handle *)data;
+
+  if (handle != NULL) {
+    curl_easy_cleanup(handle->curl);
+    o_free(handle);
+  }
+}
+
+static void free_http_client_origin(void * data) {
+  struct _glwd_http_client_origin * origin = (struct _glwd_http_client_origin *)data;
+
+  if (origin != NULL) {
+    pointer_list_clean_free(&origin->idle_list, &free_http_client_handle);
+    pthread_cond_destroy(&origin->cond);
+    o_free(origin->origin);
+    o_free(origin);
+  }
+}
+
+static void http_client_share_lock(CURL * curl, curl_lock_data data, curl_lock_access access, void * userptr) {
+  UNUSED(curl);
+  UNUSED(access);
+  pthread_mutex_lock(&((struct _glwd_http_client *)userptr)->share_lock[data]);
+}
+
+static void http_client_share_unlock(CURL * curl, curl_lock_data data, void * userptr) {
+  UNUSED(curl);
+  pthread_mutex_unlock(&((struct _glwd_http_client *)userptr)->share_lock[data]);
+}
+
+/**
+ * Returns 'scheme://host:port' of the url, or NULL if the url is invalid
+ */
+static char * get_http_client_origin(const char * url) {
+  const char * host = o_strstr(url, "://"), * end;
+
+  if (host != NULL && host != url) {
+    host += 3;
+    if ((end = strpbrk(host, "/?#")) == NULL) {
+      end = host + o_strlen(host);
+    }
+    if (end != host) {
+      return o_strndup(url, (size_t)(end - url));
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Returns the origin entry, creates it if missing
+ * http_client->lock must be locked
+ */
+static struct _glwd_http_client_origin * get_http_client_origin_entry(struct _glwd_http_client * http_client, const char * str_origin) {
+  struct _glwd_http_client_origin * origin = NULL;
+  pthread_condattr_t condattr;
+  size_t i;
+
+  for (i=0; i<pointer_list_size(&http_client->origin_list); i++) {
+    origin = (struct _glwd_http_client_origin *)pointer_list_get_at(&http_client->origin_list, i);
+    if (0 == o_strcasecmp(origin->origin, str_origin)) {
+      return origin;
+    }
+  }
+  if ((origin = o_malloc(sizeof(struct _glwd_http_client_origin))) != NULL) {
+    origin->origin = o_strdup(str_origin);
+    origin->active = 0;
+    origin->waiters = 0;
+    pointer_list_init(&origin->idle_list);
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    if (pthread_cond_init(&origin->cond, &condattr)) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "get_http_client_origin_entry - Error pthread_cond_init");
+      pointer_list_clean(&origin->idle_list);
+      o_free(origin->origin);
+      o_free(origin);
+      origin = NULL;
+    } else if (!pointer_list_append(&http_client->origin_list, origin)) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "get_http_client_origin_entry - Error pointer_list_append");
+      free_http_client_origin(origin);
+      origin = NULL;
+    }
+    pthread_condattr_destroy(&condattr);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "get_http_client_origin_entry - Error allocating resources for origin");
+  }
+  return origin;
+}
+
+/**
+ * Removes the origin entry if no request uses it and it has no idle handle
+ * http_client->lock must be locked
+ */
+static void remove_http_client_origin_if_unused(struct _glwd_http_client * http_client, struct _glwd_http_client_origin * origin) {
+  if (!origin->active && !origin->waiters && !pointer_list_size(&origin->idle_list)) {
+    if (pointer_list_remove_pointer(&http_client->origin_list, origin)) {
+      free_http_client_origin(origin);
+    }
+  }
+}
+
+/**
+ * Moves the least recently used idle handle of all the origins to the list to_close
+ * http_client->lock must be locked
+ */
+static int evict_http_client_lru_handle(struct _glwd_http_client * http_client, struct _pointer_list * to_close) {
+  struct _glwd_http_client_origin * origin, * origin_lru = NULL;
+  struct _glwd_http_client_handle * handle, * handle_lru = NULL;
+  size_t i;
+
+  for (i=0; i<pointer_list_size(&http_client->origin_list); i++) {
+    origin = (struct _glwd_http_client_origin *)pointer_list_get_at(&http_client->origin_list, i);
+    if (pointer_list_size(&origin->idle_list)) {
+      handle = (struct _glwd_http_client_handle *)pointer_list_get_at(&origin->idle_list, 0);
+      if (handle_lru == NULL || handle->last_used < handle_lru->last_used) {
+        handle_lru = handle;
+        origin_lru = origin;
+      }
+    }
+  }
+  if (handle_lru != NULL) {
+    pointer_list_remove_at(&origin_lru->idle_list, 0);
+    http_client->idle_count--;
+    if (!pointer_list_append(to_close, handle_lru)) {
+      free_http_client_handle(handle_lru);
+    }
+    remove_http_client_origin_if_unused(http_client, origin_lru);
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+/**
+ * Takes an idle handle for the origin or creates a new one
+ * Waits until timeout if max_connections_per_host handles are already in use
+ */
+static struct _glwd_http_client_handle * http_client_handle_acquire(struct config_elements * config, const char * str_origin, unsigned long timeout) {
+  struct _glwd_http_client * http_client = config->http_client;
+  struct _glwd_http_client_origin * origin;
+  struct _glwd_http_client_handle * handle = NULL;
+  struct timespec deadline;
+  time_t now;
+  int res = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += (time_t)timeout;
+  if (!pthread_mutex_lock(&http_client->lock)) {
+    if ((origin = get_http_client_origin_entry(http_client, str_origin)) != NULL) {
+      origin->waiters++;
+      while (config->http_client_max_connections_per_host && origin->active >= config->http_client_max_connections_per_host && res != ETIMEDOUT) {
+        res = pthread_cond_timedwait(&origin->cond, &http_client->lock, &deadline);
+      }
+      origin->waiters--;
+      if (res != ETIMEDOUT) {
+        time(&now);
+        // The most recently used handle is at the end of the list
+        while (handle == NULL && pointer_list_size(&origin->idle_list)) {
+          handle = (struct _glwd_http_client_handle *)pointer_list_get_at(&origin->idle_list, pointer_list_size(&origin->idle_list)-1);
+          pointer_list_remove_at(&origin->idle_list, pointer_list_size(&origin->idle_list)-1);
+          http_client->idle_count--;
+          if (handle->last_used + (time_t)config->http_client_idle_timeout <= now) {
+            free_http_client_handle(handle);
+            handle = NULL;
+          }
+        }
+        if (handle == NULL) {
+          if ((handle = o_malloc(sizeof(struct _glwd_http_client_handle))) != NULL) {
+            if ((handle->curl = curl_easy_init()) == NULL) {
+              y_log_message(Y_LOG_LEVEL_ERROR, "http_client_handle_acquire - Error curl_easy_init");
+              o_free(handle);
+              handle = NULL;
+            }
+          } else {
+            y_log_message(Y_LOG_LEVEL_ERROR, "http_client_handle_acquire - Error allocating resources for handle");
+          }
+        }
+        if (handle != NULL) {
+          origin->active++;
+        }
+      } else {
+        y_log_message(Y_LOG_LEVEL_WARNING, "http_client_handle_acquire - Too many concurrent requests to %s", str_origin);
+      }
+      remove_http_client_origin_if_unused(http_client, origin);
+    }
+    pthread_mutex_unlock(&http_client->lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "http_client_handle_acquire - Error pthread_mutex_lock");
+  }
+  return handle;
+}
+
+/**
+ * Puts the handle back in the idle list of the origin if its connection can be reused
+ * If there are already max_idle_connections idle handles, the least recently used one is closed
+ * The handles are closed once the lock is released
+ */
+static void http_client_handle_release(struct config_elements * config, const char * str_origin, struct _glwd_http_client_handle * handle, int reuse) {
+  struct _glwd_http_client * http_client = config->http_client;
+  struct _glwd_http_client_origin * origin;
+  struct _pointer_list to_close;
+
+  pointer_list_init(&to_close);
+  if (!pthread_mutex_lock(&http_client->lock)) {
+    if ((origin = get_http_client_origin_entry(http_client, str_origin)) != NULL) {
+      origin->active--;
+      if (reuse && config->http_client_idle_timeout) {
+        curl_easy_reset(handle->curl);
+        time(&handle->last_used);
+        if (pointer_list_append(&origin->idle_list, handle)) {
+          http_client->idle_count++;
+          handle = NULL;
+        }
+      }
+      pthread_cond_signal(&origin->cond);
+      remove_http_client_origin_if_unused(http_client, origin);
+    }
+    while (config->http_client_max_idle_connections && http_client->idle_count > config->http_client_max_idle_connections && evict_http_client_lru_handle(http_client, &to_close));
+    pthread_mutex_unlock(&http_client->lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "http_client_handle_release - Error pthread_mutex_lock");
+  }
+  free_http_client_handle(handle);
+  pointer_list_clean_free(&to_close, &free_http_client_handle);
+}
+
+/**
+ * Closes the idle handles unused for more than idle_timeout seconds
+ * and removes the origins that have no handle left
+ */
+static void * http_client_reaper_thread(void * args) {
+  struct config_elements * config = (struct config_elements *)args;
+  struct _glwd_http_client * http_client = config->http_client;
+  struct _glwd_http_client_origin * origin;
+  struct _glwd_http_client_handle * handle;
+  struct _pointer_list to_close;
+  struct timespec deadline;
+  time_t now;
+  size_t i;
+  int running = 1;
+
+  while (running) {
+    pointer_list_init(&to_close);
+    if (!pthread_mutex_lock(&http_client->lock)) {
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      deadline.tv_sec += GLEWLWYD_HTTP_CLIENT_REAPER_INTERVAL;
+      while (http_client->reaper_status == GLEWLWYD_HTTP_CLIENT_REAPER_RUNNING && pthread_cond_timedwait(&http_client->reaper_cond, &http_client->lock, &deadline) != ETIMEDOUT);
+      running = (http_client->reaper_status == GLEWLWYD_HTTP_CLIENT_REAPER_RUNNING);
+      if (running) {
+        time(&now);
+        for (i=0; i<pointer_list_size(&http_client->origin_list);) {
+          origin = (struct _glwd_http_client_origin *)pointer_list_get_at(&http_client->origin_list, i);
+          // The least recently used handles are at the beginning of the list
+          while (pointer_list_size(&origin->idle_list)) {
+            handle = (struct _glwd_http_client_handle *)pointer_list_get_at(&origin->idle_list, 0);
+            if (handle->last_used + (time_t)config->http_client_idle_timeout <= now) {
+              pointer_list_remove_at(&origin->idle_list, 0);
+              http_client->idle_count--;
+              if (!pointer_list_append(&to_close, handle)) {
+                free_http_client_handle(handle);
+              }
+            } else {
+              break;
+            }
+          }
+          if (!origin->active && !origin->waiters && !pointer_list_size(&origin->idle_list)) {
+            pointer_list_remove_at(&http_client->origin_list, i);
+            free_http_client_origin(origin);
+          } else {
+            i++;
+          }
+        }
+      }
+      pthread_mutex_unlock(&http_client->lock);
+    }
+    pointer_list_clean_free(&to_close, &free_http_client_handle);
+  }
+  return NULL;
+}
+
+static size_t http_client_write_body(void * contents, size_t size, size_t nmemb, void * user_data) {
+  struct _u_response * response = (struct _u_response *)user_data;
+  size_t len = size * nmemb;
+  void * body;
+
+  if ((body = o_realloc(response->binary_body, response->binary_body_length + len)) != NULL) {
+    memcpy((char *)body + response->binary_body_length, contents, len);
+    response->binary_body = body;
+    response->binary_body_length += len;
+    return len;
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "http_client_write_body - Error allocating resources for binary_body");
+    return 0;
+  }
+}
+
+static size_t http_client_write_header(void * buffer, size_t size, size_t nitems, void * user_data) {
+  struct _u_response * response = (struct _u_response *)user_data;
+  size_t len = size * nitems;
+  char * header = o_strndup((const char *)buffer, len), * separator, * value;
+
+  if (header != NULL) {
+    if (0 == o_strncmp(header, "HTTP/", o_strlen("HTTP/"))) {
+      // New response, i.e. after a redirection or a 100 Continue
+      u_map_clean(response->map_header);
+      u_map_init(response->map_header);
+    } else if ((separator = o_strchr(header, ':')) != NULL) {
+      *separator = '\0';
+      value = trimwhitespace(separator + 1);
+      u_map_put(response->map_header, trimwhitespace(header), value);
+    }
+    o_free(header);
+  }
+  return len;
+}
+
+/**
+ * Sends the request using a pooled connection to the origin
+ * Requests using a proxy or a client certificate are sent with ulfius_send_http_request
+ */
+int glewlwyd_http_client_send_request(struct config_elements * config, const struct _u_request * request, struct _u_response * response) {
+  struct _glwd_http_client_handle * handle;
+  struct curl_slist * header_list = NULL;
+  char * origin = NULL, * url = NULL, * header, * escaped_key, * escaped_value, * post_body = NULL;
+  const char ** keys;
+  unsigned long timeout;
+  long status = 0;
+  CURLcode res = CURLE_OK;
+  int ret = G_OK, i;
+
+  if (request == NULL || response == NULL || o_strnullempty(request->http_url)) {
+    return G_ERROR_PARAM;
+  }
+#ifndef U_DISABLE_GNUTLS
+  if (config->http_client == NULL || request->proxy != NULL || request->client_cert_file != NULL) {
+#else
+  if (config->http_client == NULL || request->proxy != NULL) {
+#endif
+    return ulfius_send_http_request(request, response)==U_OK?G_OK:G_ERROR;
+  }
+  if ((origin = get_http_client_origin(request->http_url)) == NULL) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_http_client_send_request - Invalid url %s", request->http_url);
+    return G_ERROR_PARAM;
+  }
+  timeout = request->timeout?request->timeout:config->http_client_timeout;
+  if ((handle = http_client_handle_acquire(config, origin, timeout)) != NULL) {
+    // url parameters
+    url = o_strdup(request->http_url);
+    keys = u_map_enum_keys(request->map_url);
+    for (i=0; keys != NULL && keys[i] != NULL; i++) {
+      escaped_key = curl_easy_escape(handle->curl, keys[i], 0);
+      escaped_value = curl_easy_escape(handle->curl, u_map_get(request->map_url, keys[i]), 0);
+      url = mstrcatf(url, "%s%s=%s", (o_strchr(url, '?')!=NULL?"&":"?"), escaped_key, escaped_value);
+      curl_free(escaped_key);
+      curl_free(escaped_value);
+    }
+    // body, the post parameters are used if there's no binary body
+    if (request->binary_body_length) {
+      curl_easy_setopt(handle->curl, CURLOPT_POSTFIELDS, request->binary_body);
+      curl_easy_setopt(handle->curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)request->binary_body_length);
+    } else if (u_map_count(request->map_post_body) > 0) {
+      keys = u_map_enum_keys(request->map_post_body);
+      for (i=0; keys[i] != NULL; i++) {
+        escaped_key = curl_easy_escape(handle->curl, keys[i], 0);
+        escaped_value = curl_easy_escape(handle->curl, u_map_get(request->map_post_body, keys[i]), 0);
+        if (post_body == NULL) {
+          post_body = msprintf("%s=%s", escaped_key, escaped_value);
+        } else {
+          post_body = mstrcatf(post_body, "&%s=%s", escaped_key, escaped_value);
+        }
+        curl_free(escaped_key);
+        curl_free(escaped_value);
+      }
+      curl_easy_setopt(handle->curl, CURLOPT_POSTFIELDS, post_body);
+      if (!u_map_has_key_case(request->map_header, ULFIUS_HTTP_HEADER_CONTENT)) {
+        header_list = curl_slist_append(header_list, ULFIUS_HTTP_HEADER_CONTENT ": application/x-www-form-urlencoded");
+      }
+    }
+    // headers
+    keys = u_map_enum_keys(request->map_header);
+    for (i=0; keys != NULL && keys[i] != NULL; i++) {
+      header = msprintf("%s: %s", keys[i], u_map_get(request->map_header, keys[i]));
+      header_list = curl_slist_append(header_list, header);
+      o_free(header);
+    }
+    curl_easy_setopt(handle->curl, CURLOPT_URL, url);
+    curl_easy_setopt(handle->curl, CURLOPT_CUSTOMREQUEST, o_strnullempty(request->http_verb)?"GET":request->http_verb);
+    if (0 == o_strcasecmp(request->http_verb, "HEAD")) {
+      curl_easy_setopt(handle->curl, CURLOPT_NOBODY, 1L);
+    }
+    curl_easy_setopt(handle->curl, CURLOPT_HTTPHEADER, header_list);
+    if (request->auth_basic_user != NULL && request->auth_basic_password != NULL) {
+      curl_easy_setopt(handle->curl, CURLOPT_HTTPAUTH, CURLAUTH_BASIC);
+      curl_easy_setopt(handle->curl, CURLOPT_USERNAME, request->auth_basic_user);
+      curl_easy_setopt(handle->curl, CURLOPT_PASSWORD, request->auth_basic_password);
+    }
+    curl_easy_setopt(handle->curl, CURLOPT_SSL_VERIFYPEER, request->check_server_certificate?1L:0L);
+    curl_easy_setopt(handle->curl, CURLOPT_SSL_VERIFYHOST, request->check_server_certificate?2L:0L);
+    if (request->ca_path != NULL) {
+      curl_easy_setopt(handle->curl, CURLOPT_CAPATH, request->ca_path);
+    }
+    curl_easy_setopt(handle->curl, CURLOPT_FOLLOWLOCATION, request->follow_redirect?1L:0L);
+    curl_easy_setopt(handle->curl, CURLOPT_TIMEOUT, (long)timeout);
+    curl_easy_setopt(handle->curl, CURLOPT_CONNECTTIMEOUT, (long)config->http_client_connect_timeout);
+    curl_easy_setopt(handle->curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle->curl, CURLOPT_SHARE, config->http_client->share);
+    curl_easy_setopt(handle->curl, CURLOPT_DNS_CACHE_TIMEOUT, (long)config->http_client_dns_cache_timeout);
+    curl_easy_setopt(handle->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle->curl, CURLOPT_MAXAGE_CONN, (long)config->http_client_idle_timeout);
+    curl_easy_setopt(handle->curl, CURLOPT_WRITEFUNCTION, &http_client_write_body);
+    curl_easy_setopt(handle->curl, CURLOPT_WRITEDATA, response);
+    curl_easy_setopt(handle->curl, CURLOPT_HEADERFUNCTION, &http_client_write_header);
+    curl_easy_setopt(handle->curl, CURLOPT_HEADERDATA, response);
+
+    if ((res = curl_easy_perform(handle->curl)) == CURLE_OK) {
+      curl_easy_getinfo(handle->curl, CURLINFO_RESPONSE_CODE, &status);
+      response->status = status;
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_http_client_send_request - Error curl_easy_perform %s: %s", origin, curl_easy_strerror(res));
+      ret = G_ERROR;
+    }
+    // The handle is closed on error, its connection may be in an unknown state
+    http_client_handle_release(config, origin, handle, res == CURLE_OK);
+    curl_slist_free_all(header_list);
+    o_free(post_body);
+    o_free(url);
+  } else {
+    ret = G_ERROR;
+  }
+  o_free(origin);
+  return ret;
+}
+
+int glewlwyd_http_client_init(struct config_elements * config) {
+  struct _glwd_http_client * http_client;
+  pthread_condattr_t condattr;
+  int ret = G_OK, i;
+
+  config->http_client_timeout = GLEWLWYD_DEFAULT_HTTP_CLIENT_TIMEOUT;
+  config->http_client_connect_timeout = GLEWLWYD_DEFAULT_HTTP_CLIENT_CONNECT_TIMEOUT;
+  config->http_client_max_connections_per_host = GLEWLWYD_DEFAULT_HTTP_CLIENT_MAX_CONNECTIONS_PER_HOST;
+  config->http_client_idle_timeout = GLEWLWYD_DEFAULT_HTTP_CLIENT_IDLE_TIMEOUT;
+  config->http_client_dns_cache_timeout = GLEWLWYD_DEFAULT_HTTP_CLIENT_DNS_CACHE_TIMEOUT;
+  config->http_client_max_idle_connections = GLEWLWYD_DEFAULT_HTTP_CLIENT_MAX_IDLE_CONNECTIONS;
+  config->http_client = NULL;
+  if ((http_client = o_malloc(sizeof(struct _glwd_http_client))) != NULL) {
+    pointer_list_init(&http_client->origin_list);
+    http_client->idle_count = 0;
+    http_client->reaper_status = GLEWLWYD_HTTP_CLIENT_REAPER_STOPPED;
+    for (i=0; i<CURL_LOCK_DATA_LAST; i++) {
+      pthread_mutex_init(&http_client->share_lock[i], NULL);
+    }
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    if (pthread_mutex_init(&http_client->lock, NULL) || pthread_cond_init(&http_client->reaper_cond, &condattr)) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_http_client_init - Error initializing lock");
+      ret = G_ERROR;
+    } else if ((http_client->share = curl_share_init()) == NULL) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_http_client_init - Error curl_share_init");
+      pthread_mutex_destroy(&http_client->lock);
+      pthread_cond_destroy(&http_client->reaper_cond);
+      ret = G_ERROR;
+    } else {
+      // The DNS entries and the TLS sessions are shared by all the handles
+      curl_share_setopt(http_client->share, CURLSHOPT_LOCKFUNC, &http_client_share_lock);
+      curl_share_setopt(http_client->share, CURLSHOPT_UNLOCKFUNC, &http_client_share_unlock);
+      curl_share_setopt(http_client->share, CURLSHOPT_USERDATA, http_client);
+      curl_share_setopt(http_client->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+      curl_share_setopt(http_client->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+      config->http_client = http_client;
+    }
+    if (ret != G_OK) {
+      for (i=0; i<CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_destroy(&http_client->share_lock[i]);
+      }
+      o_free(http_client);
+    }
+    pthread_condattr_destroy(&condattr);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_http_client_init - Error allocating resources for http_client");
+    ret = G_ERROR_MEMORY;
+  }
+  return ret;
+}
+
+/**
+ * Starts the thread closing the expired idle connections
+ */
+int glewlwyd_http_client_start(struct config_elements * config) {
+  struct _glwd_http_client * http_client = config->http_client;
+  int ret = G_OK;
+
+  if (http_client != NULL && config->http_client_idle_timeout) {
+    http_client->reaper_status = GLEWLWYD_HTTP_CLIENT_REAPER_RUNNING;
+    if (pthread_create(&http_client->reaper_thread, NULL, &http_client_reaper_thread, (void *)config)) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_http_client_start - Error pthread_create");
+      http_client->reaper_status = GLEWLWYD_HTTP_CLIENT_REAPER_STOPPED;
+      ret = G_ERROR;
+    }
+  }
+  return ret;
+}
+
+void glewlwyd_http_client_stop(struct config_elements * config) {
+  struct _glwd_http_client * http_client = config->http_client;
+
+  if (http_client != NULL && http_client->reaper_status == GLEWLWYD_HTTP_CLIENT_REAPER_RUNNING && !pthread_mutex_lock(&http_client->lock)) {
+    http_client->reaper_status = GLEWLWYD_HTTP_CLIENT_REAPER_STOPPING;
+    pthread_cond_signal(&http_client->reaper_cond);
+    pthread_mutex_unlock(&http_client->lock);
+    pthread_join(http_client->reaper_thread, NULL);
+    http_client->reaper_status = GLEWLWYD_HTTP_CLIENT_REAPER_STOPPED;
+  }
+}
+
+void glewlwyd_http_client_close(struct config_elements * config) {
+  struct _glwd_http_client * http_client = config->http_client;
+  int i;
+
+  if (http_client != NULL) {
+    glewlwyd_http_client_stop(config);
+    pointer_list_clean_free(&http_client->origin_list, &free_http_client_origin);
+    curl_share_cleanup(http_client->share);
+    pthread_mutex_destroy(&http_client->lock);
+    pthread_cond_destroy(&http_client->reaper_cond);
+    for (i=0; i<CURL_LOCK_DATA_LAST; i++) {
+      pthread_mutex_destroy(&http_client->share_lock[i]);
+    }
+    o_free(http_client);
+    config->http_client = NULL;
+  }
+}
@@ -0,0 +1,534 @@
+/**
+ *
+ * Glewlwyd SSO Server
+ *
+ * Authentiation server
+ * Users are authenticated via various backend available: database, ldap
+ * Using various authentication methods available: password, OTP, send code, etc.
+ *
+ * Cluster cache invalidation functions definitions
+ *
+ * Copyright 2016-2021 Nicolas Mora <mail@babelouest.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU GENERAL PUBLIC LICENSE
+ * License as published by the Free Software Foundation;
+ * version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU GENERAL PUBLIC LICENSE for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#ifdef GLEWLWYD_WITH_PGSQL_NOTIFY
+#include <poll.h>
+#include <libpq-fe.h>
+#endif
+
+#include "glewlwyd.h"
+
+#define GLEWLWYD_CACHE_INVALIDATION_CLEANUP_INTERVAL 60
+
+struct _glwd_cache_invalidation_handler {
+  char                               * cache;
+  glewlwyd_cache_invalidation_callback callback;
+  void                               * cls;
+};
+
+static void free_cache_invalidation_handler(void * data) {
+  struct _glwd_cache_invalidation_handler * handler = (struct _glwd_cache_invalidation_handler *)data;
+
+  if (handler != NULL) {
+    o_free(handler->cache);
+    o_free(handler);
+  }
+}
+
+/**
+ * Calls the handlers registered for the cache
+ * If cache is NULL, all the caches are cleared
+ */
+static void cache_invalidation_dispatch(struct config_elements * config, const char * cache, const char * key) {
+  struct _glwd_cache_invalidation_handler * handler;
+  size_t i;
+
+  if (!pthread_mutex_lock(&config->cache_invalidation_lock)) {
+    for (i=0; i<pointer_list_size(&config->cache_invalidation_handler_list); i++) {
+      handler = (struct _glwd_cache_invalidation_handler *)pointer_list_get_at(&config->cache_invalidation_handler_list, i);
+      if (cache == NULL) {
+        handler->callback(handler->cache, NULL, handler->cls);
+      } else if (0 == o_strcmp(handler->cache, cache)) {
+        handler->callback(handler->cache, key, handler->cls);
+      }
+    }
+    pthread_mutex_unlock(&config->cache_invalidation_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "cache_invalidation_dispatch - Error pthread_mutex_lock");
+  }
+}
+
+/**
+ * Waits for the next poll, returns 0 if the thread must stop
+ */
+static int cache_invalidation_wait(struct config_elements * config) {
+  struct timespec deadline;
+  int wait_ret = 0, ret;
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += config->cache_invalidation_interval / 1000;
+  deadline.tv_nsec += (long)(config->cache_invalidation_interval % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+  if (!pthread_mutex_lock(&config->cache_invalidation_lock)) {
+    while (config->cache_invalidation_status == GLEWLWYD_CACHE_INVALIDATION_RUNNING && wait_ret != ETIMEDOUT) {
+      wait_ret = pthread_cond_timedwait(&config->cache_invalidation_cond, &config->cache_invalidation_lock, &deadline);
+    }
+    ret = (config->cache_invalidation_status == GLEWLWYD_CACHE_INVALIDATION_RUNNING);
+    pthread_mutex_unlock(&config->cache_invalidation_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "cache_invalidation_wait - Error pthread_mutex_lock");
+    ret = 0;
+  }
+  return ret;
+}
+
+static char * get_cache_invalidation_time_clause(struct config_elements * config, time_t t) {
+  if (config->conn->type==HOEL_DB_TYPE_MARIADB) {
+    return msprintf("FROM_UNIXTIME(%u)", (unsigned int)t);
+  } else if (config->conn->type==HOEL_DB_TYPE_PGSQL) {
+    return msprintf("TO_TIMESTAMP(%u)", (unsigned int)t);
+  } else { // HOEL_DB_TYPE_SQLITE
+    return msprintf("%u", (unsigned int)t);
+  }
+}
+
+static json_int_t get_cache_invalidation_last_id(struct config_elements * config) {
+  json_t * j_result = NULL;
+  json_int_t last_id = 0;
+
+  if (h_execute_query_json(config->conn, "SELECT MAX(gci_id) AS last_id FROM " GLEWLWYD_TABLE_CACHE_INVALIDATION, &j_result) == H_OK) {
+    last_id = json_integer_value(json_object_get(json_array_get(j_result, 0), "last_id"));
+    json_decref(j_result);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "get_cache_invalidation_last_id - Error executing query");
+    glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+  }
+  return last_id;
+}
+
+/**
+ * Dispatches the events published by the other instances since last_id
+ * Ids may become visible out of order when inserts are concurrent,
+ * so the last GLEWLWYD_CACHE_INVALIDATION_LOOKBACK ids are read again
+ * and the events already dispatched are skipped with j_seen
+ * Returns the new last id
+ */
+static json_int_t cache_invalidation_poll(struct config_elements * config, json_int_t last_id, json_t * j_seen) {
+  json_t * j_query, * j_result = NULL, * j_element = NULL, * j_seen_new;
+  char * where_clause, str_id[32];
+  size_t index = 0;
+  json_int_t new_last_id = last_id;
+  int res;
+
+  where_clause = msprintf("> %" JSON_INTEGER_FORMAT, last_id>GLEWLWYD_CACHE_INVALIDATION_LOOKBACK?last_id-GLEWLWYD_CACHE_INVALIDATION_LOOKBACK:0);
+  j_query = json_pack("{sss[ssss]s{s{ssss}}ss}",
+                      "table",
+                      GLEWLWYD_TABLE_CACHE_INVALIDATION,
+                      "columns",
+                        "gci_id",
+                        "gci_node",
+                        "gci_cache",
+                        "gci_key",
+                      "where",
+                        "gci_id",
+                          "operator",
+                          "raw",
+                          "value",
+                          where_clause,
+                      "order_by",
+                      "gci_id");
+  o_free(where_clause);
+  res = h_select(config->conn, j_query, &j_result, NULL);
+  json_decref(j_query);
+  if (res == H_OK) {
+    j_seen_new = json_object();
+    json_array_foreach(j_result, index, j_element) {
+      snprintf(str_id, sizeof(str_id), "%" JSON_INTEGER_FORMAT, json_integer_value(json_object_get(j_element, "gci_id")));
+      if (json_object_get(j_seen, str_id) == NULL && 0 != o_strcmp(config->cache_invalidation_node, json_string_value(json_object_get(j_element, "gci_node")))) {
+        cache_invalidation_dispatch(config, json_string_value(json_object_get(j_element, "gci_cache")), json_string_value(json_object_get(j_element, "gci_key")));
+      }
+      json_object_set(j_seen_new, str_id, json_true());
+      if (json_integer_value(json_object_get(j_element, "gci_id")) > new_last_id) {
+        new_last_id = json_integer_value(json_object_get(j_element, "gci_id"));
+      }
+    }
+    json_object_clear(j_seen);
+    json_object_update(j_seen, j_seen_new);
+    json_decref(j_seen_new);
+    json_decref(j_result);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "cache_invalidation_poll - Error executing j_query");
+    glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+  }
+  return new_last_id;
+}
+
+/**
+ * Removes the events older than config->cache_invalidation_retention
+ */
+static void cache_invalidation_cleanup(struct config_elements * config) {
+  json_t * j_query;
+  char * time_clause, * where_clause;
+  int res;
+
+  time_clause = get_cache_invalidation_time_clause(config, time(NULL) - config->cache_invalidation_retention);
+  where_clause = msprintf("< %s", time_clause);
+  j_query = json_pack("{sss{s{ssss}}}",
+                      "table",
+                      GLEWLWYD_TABLE_CACHE_INVALIDATION,
+                      "where",
+                        "gci_created_at",
+                          "operator",
+                          "raw",
+                          "value",
+                          where_clause);
+  o_free(time_clause);
+  o_free(where_clause);
+  res = h_delete(config->conn, j_query, NULL);
+  json_decref(j_query);
+  if (res != H_OK) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "cache_invalidation_cleanup - Error executing j_query");
+    glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+  }
+}
+
+static void * cache_invalidation_poll_thread(void * args) {
+  struct config_elements * config = (struct config_elements *)args;
+  json_int_t last_id = get_cache_invalidation_last_id(config);
+  json_t * j_seen = json_object();
+  time_t last_cleanup = 0;
+
+  while (cache_invalidation_wait(config)) {
+    last_id = cache_invalidation_poll(config, last_id, j_seen);
+    if (last_cleanup + GLEWLWYD_CACHE_INVALIDATION_CLEANUP_INTERVAL <= time(NULL)) {
+      cache_invalidation_cleanup(config);
+      last_cleanup = time(NULL);
+    }
+  }
+  json_decref(j_seen);
+  return NULL;
+}
+
+#ifdef GLEWLWYD_WITH_PGSQL_NOTIFY
+static PGconn * cache_invalidation_listen(struct config_elements * config) {
+  PGconn * conn = PQconnectdb(config->cache_invalidation_conninfo);
+  PGresult * res;
+
+  if (PQstatus(conn) == CONNECTION_OK) {
+    res = PQexec(conn, "LISTEN " GLEWLWYD_CACHE_INVALIDATION_CHANNEL);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "cache_invalidation_listen - Error LISTEN: %s", PQerrorMessage(conn));
+      PQfinish(conn);
+      conn = NULL;
+    }
+    PQclear(res);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "cache_invalidation_listen - Error PQconnectdb: %s", PQerrorMessage(conn));
+    PQfinish(conn);
+    conn = NULL;
+  }
+  return conn;
+}
+
+static void cache_invalidation_notify_read(struct config_elements * config, PGconn * conn) {
+  PGnotify * notify;
+  json_t * j_payload;
+
+  while ((notify = PQnotifies(conn)) != NULL) {
+    if ((j_payload = json_loads(notify->extra, JSON_DECODE_ANY, NULL)) != NULL) {
+      if (0 != o_strcmp(config->cache_invalidation_node, json_string_value(json_object_get(j_payload, "node")))) {
+        cache_invalidation_dispatch(config, json_string_value(json_object_get(j_payload, "cache")), json_string_value(json_object_get(j_payload, "key")));
+      }
+      json_decref(j_payload);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "cache_invalidation_notify_read - Error invalid payload");
+    }
+    PQfreemem(notify);
+  }
+}
+
+/**
+ * Notifications sent while the connection is lost are not received,
+ * so all the caches are cleared when the connection is back
+ */
+static void * cache_invalidation_notify_thread(void * args) {
+  struct config_elements * config = (struct config_elements *)args;
+  PGconn * conn = NULL;
+  struct pollfd pfd;
+  int connected = 0, running = 1;
+
+  while (running) {
+    if (conn == NULL) {
+      if ((conn = cache_invalidation_listen(config)) != NULL) {
+        if (connected) {
+          y_log_message(Y_LOG_LEVEL_INFO, "Cache invalidation connection restored, clear all caches");
+          cache_invalidation_dispatch(config, NULL, NULL);
+        }
+        connected = 1;
+      } else {
+        running = cache_invalidation_wait(config);
+        continue;
+      }
+    }
+    pfd.fd = PQsocket(conn);
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, (int)config->cache_invalidation_interval) > 0) {
+      if (PQconsumeInput(conn)) {
+        cache_invalidation_notify_read(config, conn);
+      }
+    }
+    if (PQstatus(conn) != CONNECTION_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "cache_invalidation_notify_thread - Error connection lost: %s", PQerrorMessage(conn));
+      PQfinish(conn);
+      conn = NULL;
+    }
+    if (!pthread_mutex_lock(&config->cache_invalidation_lock)) {
+      running = (config->cache_invalidation_status == GLEWLWYD_CACHE_INVALIDATION_RUNNING);
+      pthread_mutex_unlock(&config->cache_invalidation_lock);
+    }
+  }
+  PQfinish(conn);
+  return NULL;
+}
+#endif
+
+int glewlwyd_cache_invalidation_init(struct config_elements * config) {
+  pthread_condattr_t condattr;
+  int ret = G_OK;
+
+  config->cache_invalidation_backend = GLEWLWYD_CACHE_INVALIDATION_BACKEND_NONE;
+  config->cache_invalidation_interval = GLEWLWYD_DEFAULT_CACHE_INVALIDATION_INTERVAL;
+  config->cache_invalidation_retention = GLEWLWYD_DEFAULT_CACHE_INVALIDATION_RETENTION;
+  config->cache_invalidation_conninfo = NULL;
+  config->cache_invalidation_status = GLEWLWYD_CACHE_INVALIDATION_STOPPED;
+  pointer_list_init(&config->cache_invalidation_handler_list);
+  // Identifies the events published by this instance
+  if (rand_string(config->cache_invalidation_node, GLEWLWYD_CACHE_INVALIDATION_NODE_LENGTH) == NULL) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_cache_invalidation_init - Error rand_string");
+    ret = G_ERROR;
+  }
+  pthread_condattr_init(&condattr);
+  pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+  if (pthread_mutex_init(&config->cache_invalidation_lock, NULL) || pthread_cond_init(&config->cache_invalidation_cond, &condattr)) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_cache_invalidation_init - Error initializing lock");
+    ret = G_ERROR;
+  }
+  pthread_condattr_destroy(&condattr);
+  return ret;
+}
+
+int glewlwyd_cache_invalidation_set_backend(struct config_elements * config, const char * backend) {
+  int ret = G_OK;
+
+  if (0 == o_strcmp("none", backend)) {
+    config->cache_invalidation_backend = GLEWLWYD_CACHE_INVALIDATION_BACKEND_NONE;
+  } else if (0 == o_strcmp("poll", backend)) {
+    config->cache_invalidation_backend = GLEWLWYD_CACHE_INVALIDATION_BACKEND_POLL;
+  } else if (0 == o_strcmp("notify", backend)) {
+#ifdef GLEWLWYD_WITH_PGSQL_NOTIFY
+    config->cache_invalidation_backend = GLEWLWYD_CACHE_INVALIDATION_BACKEND_NOTIFY;
+#else
+    fprintf(stderr, "Error cache_invalidation backend 'notify' not available, Glewlwyd must be built with PostgreSQL LISTEN/NOTIFY support\n");
+    ret = G_ERROR_PARAM;
+#endif
+  } else {
+    fprintf(stderr, "Error cache_invalidation backend '%s' unknown, values available are 'none', 'poll' or 'notify'\n", backend);
+    ret = G_ERROR_PARAM;
+  }
+  return ret;
+}
+
+/**
+ * Starts the thread receiving the events published by the other instances
+ */
+int glewlwyd_cache_invalidation_start(struct config_elements * config) {
+  void * (* thread_run)(void *) = NULL;
+  int ret;
+
+  if (config->cache_invalidation_backend == GLEWLWYD_CACHE_INVALIDATION_BACKEND_POLL) {
+    thread_run = &cache_invalidation_poll_thread;
+#ifdef GLEWLWYD_WITH_PGSQL_NOTIFY
+  } else if (config->cache_invalidation_backend == GLEWLWYD_CACHE_INVALIDATION_BACKEND_NOTIFY) {
+    thread_run = &cache_invalidation_notify_thread;
+#endif
+  }
+  if (thread_run != NULL) {
+    config->cache_invalidation_status = GLEWLWYD_CACHE_INVALIDATION_RUNNING;
+    if (!pthread_create(&config->cache_invalidation_thread, NULL, thread_run, (void *)config)) {
+      ret = G_OK;
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_cache_invalidation_start - Error pthread_create");
+      config->cache_invalidation_status = GLEWLWYD_CACHE_INVALIDATION_STOPPED;
+      ret = G_ERROR;
+    }
+  } else {
+    ret = G_OK;
+  }
+  return ret;
+}
+
+void glewlwyd_cache_invalidation_stop(struct config_elements * config) {
+  if (config->cache_invalidation_status == GLEWLWYD_CACHE_INVALIDATION_RUNNING && !pthread_mutex_lock(&config->cache_invalidation_lock)) {
+    config->cache_invalidation_status = GLEWLWYD_CACHE_INVALIDATION_STOPPING;
+    pthread_cond_signal(&config->cache_invalidation_cond);
+    pthread_mutex_unlock(&config->cache_invalidation_lock);
+    pthread_join(config->cache_invalidation_thread, NULL);
+    config->cache_invalidation_status = GLEWLWYD_CACHE_INVALIDATION_STOPPED;
+  }
+}
+
+void glewlwyd_cache_invalidation_close(struct config_elements * config) {
+  glewlwyd_cache_invalidation_stop(config);
+  pointer_list_clean_free(&config->cache_invalidation_handler_list, &free_cache_invalidation_handler);
+  pthread_mutex_destroy(&config->cache_invalidation_lock);
+  pthread_cond_destroy(&config->cache_invalidation_cond);
+  o_free(config->cache_invalidation_conninfo);
+}
+
+/**
+ * Registers a function called when another instance invalidates an entry of the cache
+ * The function is called in the cache invalidation thread
+ */
+int glewlwyd_cache_invalidation_register(struct config_elements * config, const char * cache, glewlwyd_cache_invalidation_callback callback, void * cls) {
+  struct _glwd_cache_invalidation_handler * handler;
+  int ret;
+
+  if (!o_strnullempty(cache) && callback != NULL) {
+    if ((handler = o_malloc(sizeof(struct _glwd_cache_invalidation_handler))) != NULL) {
+      handler->cache = o_strdup(cache);
+      handler->callback = callback;
+      handler->cls = cls;
+      if (!pthread_mutex_lock(&config->cache_invalidation_lock)) {
+        if (pointer_list_append(&config->cache_invalidation_handler_list, handler)) {
+          ret = G_OK;
+        } else {
+          y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_cache_invalidation_register - Error pointer_list_append");
+          free_cache_invalidation_handler(handler);
+          ret = G_ERROR;
+        }
+        pthread_mutex_unlock(&config->cache_invalidation_lock);
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_cache_invalidation_register - Error pthread_mutex_lock");
+        free_cache_invalidation_handler(handler);
+        ret = G_ERROR;
+      }
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_cache_invalidation_register - Error allocating resources for handler");
+      ret = G_ERROR_MEMORY;
+    }
+  } else {
+    ret = G_ERROR_PARAM;
+  }
+  return ret;
+}
+
+/**
+ * Removes the functions registered for the cache with cls
+ * Must be called by a module before its cls is freed
+ */
+int glewlwyd_cache_invalidation_unregister(struct config_elements * config, const char * cache, void * cls) {
+  struct _glwd_cache_invalidation_handler * handler;
+  size_t i;
+  int ret = G_ERROR_NOT_FOUND;
+
+  if (!pthread_mutex_lock(&config->cache_invalidation_lock)) {
+    for (i=pointer_list_size(&config->cache_invalidation_handler_list); i>0; i--) {
+      handler = (struct _glwd_cache_invalidation_handler *)pointer_list_get_at(&config->cache_invalidation_handler_list, i-1);
+      if (handler->cls == cls && 0 == o_strcmp(handler->cache, cache)) {
+        pointer_list_remove_at(&config->cache_invalidation_handler_list, i-1);
+        free_cache_invalidation_handler(handler);
+        ret = G_OK;
+      }
+    }
+    pthread_mutex_unlock(&config->cache_invalidation_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_cache_invalidation_unregister - Error pthread_mutex_lock");
+    ret = G_ERROR;
+  }
+  return ret;
+}
+
+/**
+ * Calls the handlers registered on this instance for the cache,
+ * used when the data cached by modules or plugins is modified on this instance
+ */
+void glewlwyd_cache_invalidation_local(struct config_elements * config, const char * cache, const char * key) {
+  if (!o_strnullempty(cache)) {
+    cache_invalidation_dispatch(config, cache, key);
+  }
+}
+
+/**
+ * Tells the other instances to invalidate the key in their cache, or the whole cache if key is NULL
+ * The local cache must be updated by the caller
+ */
+int glewlwyd_cache_invalidation_publish(struct config_elements * config, const char * cache, const char * key) {
+  json_t * j_query, * j_payload;
+  char * time_clause, * str_payload, * payload_escaped, * query;
+  int res, ret;
+
+  if (config->cache_invalidation_backend == GLEWLWYD_CACHE_INVALIDATION_BACKEND_POLL) {
+    time_clause = get_cache_invalidation_time_clause(config, time(NULL));
+    j_query = json_pack("{sss{sssss?s{ss}}}",
+                        "table",
+                        GLEWLWYD_TABLE_CACHE_INVALIDATION,
+                        "values",
+                          "gci_node",
+                          config->cache_invalidation_node,
+                          "gci_cache",
+                          cache,
+                          "gci_key",
+                          key,
+                          "gci_created_at",
+                            "raw",
+                            time_clause);
+    o_free(time_clause);
+    res = h_insert(config->conn, j_query, NULL);
+    json_decref(j_query);
+    if (res == H_OK) {
+      ret = G_OK;
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_cache_invalidation_publish - Error executing j_query");
+      glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+      ret = G_ERROR_DB;
+    }
+  } else if (config->cache_invalidation_backend == GLEWLWYD_CACHE_INVALIDATION_BACKEND_NOTIFY) {
+    j_payload = json_pack("{sssss?}", "node", config->cache_invalidation_node, "cache", cache, "key", key);
+    str_payload = json_dumps(j_payload, JSON_COMPACT);
+    payload_escaped = h_escape_string_with_quotes(config->conn, str_payload);
+    query = msprintf("NOTIFY " GLEWLWYD_CACHE_INVALIDATION_CHANNEL ", %s", payload_escaped);
+    if (h_execute_query(config->conn, query, NULL, H_OPTION_EXEC) == H_OK) {
+      ret = G_OK;
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_cache_invalidation_publish - Error executing query");
+      glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+      ret = G_ERROR_DB;
+    }
+    o_free(query);
+    o_free(payload_escaped);
+    o_free(str_payload);
+    json_decref(j_payload);
+  } else {
+    ret = G_OK;
+  }
+  return ret;
+}
@@ -120,27 +120,79 @@ char * get_client_hostname(const struct _u_request * request) {
   return hostname;
 }
 
+/**
+ * Per-thread buffer of random bytes
+ * Random bytes are drawn from gnutls by blocks of GLEWLWYD_RANDOM_BUFFER_SIZE
+ * and wiped as soon as they are used
+ */
+struct _random_buffer {
+  unsigned char data[GLEWLWYD_RANDOM_BUFFER_SIZE];
+  size_t        offset;
+};
+
+static __thread struct _random_buffer random_buffer_key = {{0}, GLEWLWYD_RANDOM_BUFFER_SIZE};
+static __thread struct _random_buffer random_buffer_nonce = {{0}, GLEWLWYD_RANDOM_BUFFER_SIZE};
+
+static int random_buffer_refill(struct _random_buffer * buffer, int nonce) {
+  if (buffer->offset >= GLEWLWYD_RANDOM_BUFFER_SIZE) {
+    if (gnutls_rnd(nonce?GNUTLS_RND_NONCE:GNUTLS_RND_KEY, buffer->data, GLEWLWYD_RANDOM_BUFFER_SIZE)) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "random_buffer_refill - Error gnutls_rnd");
+      return G_ERROR;
+    }
+    buffer->offset = 0;
+  }
+  return G_OK;
+}
+
+/**
+ * Fills str with str_size characters picked from charset
+ * Bytes over the largest multiple of charset_len are rejected so the mapping is unbiased
+ */
+static int random_buffer_fill_charset(char * str, size_t str_size, const char * charset, size_t charset_len, int nonce) {
+  struct _random_buffer * buffer = nonce?&random_buffer_nonce:&random_buffer_key;
+  unsigned int limit;
+  unsigned char x;
+  size_t n = 0;
+
+  if (!charset_len || charset_len > 256) {
+    return G_ERROR_PARAM;
+  }
+  limit = 256 - (256 % charset_len);
+  while (n < str_size) {
+    if (random_buffer_refill(buffer, nonce) != G_OK) {
+      return G_ERROR;
+    }
+    for (; buffer->offset < GLEWLWYD_RANDOM_BUFFER_SIZE && n < str_size; buffer->offset++) {
+      x = buffer->data[buffer->offset];
+      buffer->data[buffer->offset] = 0;
+      if (x < limit) {
+        str[n++] = charset[x % charset_len];
+      }
+    }
+  }
+  return G_OK;
+}
+
 /**
  *
  * Generates a random long integer between 0 and max
  *
  */
 unsigned char random_at_most(unsigned char max, int nonce) {
-  unsigned char
-  num_bins = (unsigned char) max + 1,
-  num_rand = (unsigned char) 0xff,
-  bin_size = num_rand / num_bins,
-  defect   = num_rand % num_bins;
+  struct _random_buffer * buffer = nonce?&random_buffer_nonce:&random_buffer_key;
+  unsigned int num_bins = (unsigned int)max + 1, limit = 256 - (256 % num_bins);
+  unsigned char x;
 
-  unsigned char x[1];
   do {
-    gnutls_rnd(nonce?GNUTLS_RND_NONCE:GNUTLS_RND_KEY, x, sizeof(x));
-  }
-  // This is carefully written not to overflow
-  while (num_rand - defect <= (unsigned char)x[0]);
+    if (random_buffer_refill(buffer, nonce) != G_OK) {
+      return 0;
+    }
+    x = buffer->data[buffer->offset];
+    buffer->data[buffer->offset] = 0;
+    buffer->offset++;
+  } while (x >= limit);
 
-  // Truncated division is intentional
-  return x[0]/bin_size;
+  return x % num_bins;
 }
 
 /**
@@ -154,12 +206,7 @@ char * rand_string(char * str, size_t str_size) {
  * Generates a random string and store it in str
  */
 char * rand_string_from_charset(char * str, size_t str_size, const char * charset) {
-  size_t n;
-  
-  if (str_size && str != NULL) {
-    for (n = 0; n < str_size; n++) {
-      str[n] = charset[random_at_most((o_strlen(charset)) - 2, 0)];
-    }
+  if (str_size && str != NULL && random_buffer_fill_charset(str, str_size, charset, o_strlen(charset), 0) == G_OK) {
     str[str_size] = '\0';
     return str;
   } else {
@@ -172,12 +219,8 @@ char * rand_string_from_charset(char * str, size_t str_size, const char * charse
  */
 char * rand_string_nonce(char * str, size_t str_size) {
   const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
-  size_t n;
   
-  if (str_size && str != NULL) {
-    for (n = 0; n < str_size; n++) {
-      str[n] = charset[random_at_most((sizeof(charset)) - 2, 1)];
-    }
+  if (str_size && str != NULL && random_buffer_fill_charset(str, str_size, charset, sizeof(charset) - 1, 1) == G_OK) {
     str[str_size] = '\0';
     return str;
   } else {
@@ -187,13 +230,8 @@ char * rand_string_nonce(char * str, size_t str_size) {
 
 int rand_code(char * str, size_t str_size) {
   const char charset[] = "0123456789";
-  size_t n;
   
-  if (str_size && str != NULL) {
-    for (n = 0; n < str_size; n++) {
-      unsigned char key = random_at_most((sizeof(charset)) - 2, 0);
-      str[n] = charset[key];
-    }
+  if (str_size && str != NULL && random_buffer_fill_charset(str, str_size, charset, sizeof(charset) - 1, 0) == G_OK) {
     str[str_size] = '\0';
     return 1;
   } else {
@@ -562,3 +600,609 @@ int check_result_value(json_t * result, const int value) {
 int json_string_null_or_empty(json_t * j_str) {
   return o_strnullempty(json_string_value(j_str));
 }
+
+/**
+ * Returns the connection to use for a read-only query
+ * The replicas are used in turn, the primary connection is used
+ * if there is no replica or if the read mode is GLEWLWYD_DB_READ_PRIMARY
+ */
+struct _h_connection * get_read_connection(struct config_elements * config, int read_mode) {
+  if (read_mode == GLEWLWYD_DB_READ_PRIMARY || !config->conn_replica_count) {
+    return config->conn;
+  } else {
+    return config->conn_replica[__atomic_fetch_add(&config->conn_replica_index, 1, __ATOMIC_RELAXED) % config->conn_replica_count];
+  }
+}
+
+/**
+ * Runs a select on a replica, the select is run again on the primary connection
+ * if the replica fails, or if the result is empty with GLEWLWYD_DB_READ_REPLICA_FALLBACK
+ */
+int select_read(struct config_elements * config, const json_t * j_query, json_t ** j_result, int read_mode) {
+  struct _h_connection * conn = get_read_connection(config, read_mode);
+  int res = h_select(conn, j_query, j_result, NULL);
+
+  if (conn != config->conn) {
+    if (res != H_OK) {
+      y_log_message(Y_LOG_LEVEL_WARNING, "select_read - Error executing query on replica, fallback to primary");
+      res = h_select(config->conn, j_query, j_result, NULL);
+    } else if (read_mode == GLEWLWYD_DB_READ_REPLICA_FALLBACK && !json_array_size(*j_result)) {
+      json_decref(*j_result);
+      *j_result = NULL;
+      res = h_select(config->conn, j_query, j_result, NULL);
+    }
+  }
+  return res;
+}
+
+/**
+ * Same as select_read for a raw select query
+ */
+int execute_query_json_read(struct config_elements * config, const char * query, json_t ** j_result, int read_mode) {
+  struct _h_connection * conn = get_read_connection(config, read_mode);
+  int res = h_execute_query_json(conn, query, j_result);
+
+  if (conn != config->conn) {
+    if (res != H_OK) {
+      y_log_message(Y_LOG_LEVEL_WARNING, "execute_query_json_read - Error executing query on replica, fallback to primary");
+      res = h_execute_query_json(config->conn, query, j_result);
+    } else if (read_mode == GLEWLWYD_DB_READ_REPLICA_FALLBACK && !json_array_size(*j_result)) {
+      json_decref(*j_result);
+      *j_result = NULL;
+      res = h_execute_query_json(config->conn, query, j_result);
+    }
+  }
+  return res;
+}
+
+#define GLEWLWYD_STATEMENT_STATUS_DISABLED 0
+#define GLEWLWYD_STATEMENT_STATUS_NEW      1
+#define GLEWLWYD_STATEMENT_STATUS_PREPARED 2
+
+/**
+ * Returns the literal value of a bound parameter, escaped for the connection
+ * returned value must be o_free'd after use
+ */
+static char * get_statement_param_literal(const struct _h_connection * conn, json_t * j_param) {
+  if (json_is_string(j_param)) {
+    return h_escape_string_with_quotes(conn, json_string_value(j_param));
+  } else if (json_is_integer(j_param)) {
+    return msprintf("%" JSON_INTEGER_FORMAT, json_integer_value(j_param));
+  } else if (json_is_true(j_param)) {
+    return o_strdup("1");
+  } else if (json_is_false(j_param)) {
+    return o_strdup("0");
+  } else {
+    return o_strdup("NULL");
+  }
+}
+
+/**
+ * Replaces the placeholders $1, $2, etc. of the query
+ * If str_using is NULL, the placeholders are replaced with the literal values
+ * Otherwise the placeholders are replaced with '?' and the literal values
+ * are appended to *str_using in the order of the query, if j_params is not NULL
+ * returned value must be o_free'd after use
+ */
+static char * build_statement_query(const struct _h_connection * conn, const char * query, json_t * j_params, char ** str_using) {
+  char * str_query = o_strdup(""), * literal = NULL, * endptr;
+  const char * cur = query, * next;
+  long index;
+
+  while (str_query != NULL && (next = o_strchr(cur, '$')) != NULL) {
+    index = strtol(next+1, &endptr, 10);
+    if (endptr != next+1 && index > 0) {
+      if (j_params != NULL || str_using == NULL) {
+        if ((size_t)index > json_array_size(j_params) || (literal = get_statement_param_literal(conn, json_array_get(j_params, (size_t)index-1))) == NULL) {
+          y_log_message(Y_LOG_LEVEL_ERROR, "build_statement_query - Error parameter $%ld", index);
+          o_free(str_query);
+          str_query = NULL;
+          break;
+        }
+      }
+      if (str_using == NULL) {
+        str_query = mstrcatf(str_query, "%.*s%s", (int)(next-cur), cur, literal);
+      } else {
+        str_query = mstrcatf(str_query, "%.*s?", (int)(next-cur), cur);
+        if (literal != NULL) {
+          if (*str_using == NULL) {
+            *str_using = o_strdup(literal);
+          } else {
+            *str_using = mstrcatf(*str_using, ", %s", literal);
+          }
+        }
+      }
+      o_free(literal);
+      literal = NULL;
+      cur = endptr;
+    } else {
+      str_query = mstrcatf(str_query, "%.*s$", (int)(next-cur), cur);
+      cur = next+1;
+    }
+  }
+  if (str_query != NULL) {
+    str_query = mstrcatf(str_query, "%s", cur);
+  }
+  return str_query;
+}
+
+/**
+ * Returns the prepared statements cache of the connection
+ * statement_lock must be locked
+ */
+static json_t * get_statement_cache_conn(struct config_elements * config, const struct _h_connection * conn) {
+  char conn_key[32] = {0};
+  json_t * j_conn;
+
+  snprintf(conn_key, 31, "%p", (void *)conn);
+  if ((j_conn = json_object_get(config->j_statement_cache, conn_key)) == NULL) {
+    j_conn = json_pack("{sos{}}", "enabled", json_true(), "statements");
+    json_object_set_new(config->j_statement_cache, conn_key, j_conn);
+  }
+  return j_conn;
+}
+
+/**
+ * Returns the status of the statement on this connection
+ * Prepared statements are not available on SQLite via SQL,
+ * the statement is expanded in a plain query instead
+ */
+static int get_statement_status(struct config_elements * config, const struct _h_connection * conn, const char * name) {
+  json_t * j_conn, * j_status;
+  int status = GLEWLWYD_STATEMENT_STATUS_DISABLED;
+
+  if (config->use_prepared_statement && conn->type != HOEL_DB_TYPE_SQLITE) {
+    if (!pthread_mutex_lock(&config->statement_lock)) {
+      j_conn = get_statement_cache_conn(config, conn);
+      if (json_object_get(j_conn, "enabled") == json_true()) {
+        if ((j_status = json_object_get(json_object_get(j_conn, "statements"), name)) != NULL) {
+          status = (int)json_integer_value(j_status);
+        } else {
+          status = GLEWLWYD_STATEMENT_STATUS_NEW;
+        }
+      }
+      pthread_mutex_unlock(&config->statement_lock);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "get_statement_status - Error pthread_mutex_lock");
+    }
+  }
+  return status;
+}
+
+static void set_statement_status(struct config_elements * config, const struct _h_connection * conn, const char * name, int status) {
+  if (!pthread_mutex_lock(&config->statement_lock)) {
+    json_object_set_new(json_object_get(get_statement_cache_conn(config, conn), "statements"), name, json_integer(status));
+    pthread_mutex_unlock(&config->statement_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "set_statement_status - Error pthread_mutex_lock");
+  }
+}
+
+/**
+ * Prepares the statement on the connection, unless another thread already did
+ * The statement is marked as prepared only if the server accepts the PREPARE
+ * If reset is true, the statement is prepared again, e.g. the connection was reset
+ * statement_lock is kept during the PREPARE so two threads don't prepare the same name
+ */
+static int prepare_statement(struct config_elements * config, const struct _h_connection * conn, const struct _glwd_statement * statement, const char * query, int reset) {
+  char * str_prepare = NULL, * str_deallocate, * str_marker, * str_marker_escaped, * str_using = NULL;
+  json_t * j_statements;
+  int res;
+
+  if (!pthread_mutex_lock(&config->statement_lock)) {
+    j_statements = json_object_get(get_statement_cache_conn(config, conn), "statements");
+    if (!reset && json_integer_value(json_object_get(j_statements, statement->name)) == GLEWLWYD_STATEMENT_STATUS_PREPARED) {
+      res = H_OK;
+    } else {
+      if (conn->type == HOEL_DB_TYPE_PGSQL) {
+        if (reset) {
+          // PostgreSQL doesn't replace an existing prepared statement
+          if ((str_deallocate = msprintf("DEALLOCATE %s", statement->name)) != NULL) {
+            h_execute_query(conn, str_deallocate, NULL, H_OPTION_EXEC);
+          }
+          o_free(str_deallocate);
+        }
+        str_prepare = msprintf("PREPARE %s AS %s", statement->name, query);
+      } else if ((str_marker = build_statement_query(conn, query, NULL, &str_using)) != NULL) {
+        if ((str_marker_escaped = h_escape_string_with_quotes(conn, str_marker)) != NULL) {
+          str_prepare = msprintf("PREPARE %s FROM %s", statement->name, str_marker_escaped);
+        }
+        o_free(str_marker_escaped);
+        o_free(str_marker);
+      }
+      if (str_prepare == NULL) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "prepare_statement - Error allocating resources for statement %s", statement->name);
+        res = H_ERROR_MEMORY;
+      } else if ((res = h_execute_query(conn, str_prepare, NULL, H_OPTION_EXEC)) == H_OK) {
+        json_object_set_new(j_statements, statement->name, json_integer(GLEWLWYD_STATEMENT_STATUS_PREPARED));
+      } else {
+        y_log_message(Y_LOG_LEVEL_DEBUG, "prepare_statement - Error preparing statement %s", statement->name);
+      }
+      o_free(str_prepare);
+    }
+    pthread_mutex_unlock(&config->statement_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "prepare_statement - Error pthread_mutex_lock");
+    res = H_ERROR;
+  }
+  return res;
+}
+
+/**
+ * Builds the EXECUTE query of a prepared statement
+ * PostgreSQL binds the parameters by their number,
+ * MariaDB binds them in the order of the placeholders in the query
+ * returned value must be o_free'd after use
+ */
+static char * build_statement_execute(const struct _h_connection * conn, const struct _glwd_statement * statement, const char * query, json_t * j_params) {
+  char * str_using = NULL, * str_marker, * literal, * str_execute = NULL;
+  size_t index;
+  json_t * j_param;
+
+  if (conn->type == HOEL_DB_TYPE_PGSQL) {
+    json_array_foreach(j_params, index, j_param) {
+      if ((literal = get_statement_param_literal(conn, j_param)) != NULL) {
+        if (str_using == NULL) {
+          str_using = o_strdup(literal);
+        } else {
+          str_using = mstrcatf(str_using, ", %s", literal);
+        }
+        o_free(literal);
+      } else {
+        o_free(str_using);
+        return NULL;
+      }
+    }
+    if (str_using != NULL) {
+      str_execute = msprintf("EXECUTE %s(%s)", statement->name, str_using);
+    } else {
+      str_execute = msprintf("EXECUTE %s", statement->name);
+    }
+  } else if ((str_marker = build_statement_query(conn, query, j_params, &str_using)) != NULL) {
+    if (str_using != NULL) {
+      str_execute = msprintf("EXECUTE %s USING %s", statement->name, str_using);
+    } else {
+      str_execute = msprintf("EXECUTE %s", statement->name);
+    }
+    o_free(str_marker);
+  }
+  o_free(str_using);
+  return str_execute;
+}
+
+/**
+ * Executes a prepared statement on the connection
+ * j_params is a JSON array of the bound parameters: string, integer, boolean or null
+ * The statement is prepared on its first use on the connection, then only the
+ * parameters are sent. If the EXECUTE fails, the statement is prepared again once,
+ * e.g. the connection was reset. If the server rejects the PREPARE of a statement
+ * but runs its plain query, this statement is always expanded in a plain query
+ * on this connection from now on
+ */
+int execute_statement_json(struct config_elements * config, struct _h_connection * conn, const struct _glwd_statement * statement, json_t * j_params, json_t ** j_result) {
+  const char * query = SWITCH_DB_TYPE(conn->type, statement->query_mariadb, statement->query_sqlite, statement->query_pgsql);
+  int status = get_statement_status(config, conn, statement->name), res = H_ERROR, res_prepare = H_OK;
+  char * str_query;
+
+  if (query == NULL) {
+    query = statement->query_mariadb;
+  }
+  if (status != GLEWLWYD_STATEMENT_STATUS_DISABLED && (str_query = build_statement_execute(conn, statement, query, j_params)) != NULL) {
+    if (status == GLEWLWYD_STATEMENT_STATUS_NEW) {
+      res_prepare = prepare_statement(config, conn, statement, query, 0);
+    }
+    if (res_prepare == H_OK) {
+      if ((res = h_execute_query_json(conn, str_query, j_result)) != H_OK && status == GLEWLWYD_STATEMENT_STATUS_PREPARED) {
+        if ((res_prepare = prepare_statement(config, conn, statement, query, 1)) == H_OK) {
+          res = h_execute_query_json(conn, str_query, j_result);
+        }
+      }
+    }
+    o_free(str_query);
+  }
+  if (res != H_OK) {
+    if ((str_query = build_statement_query(conn, query, j_params, NULL)) != NULL) {
+      res = h_execute_query_json(conn, str_query, j_result);
+      if (res == H_OK && res_prepare != H_OK) {
+        y_log_message(Y_LOG_LEVEL_WARNING, "execute_statement_json - Prepared statement %s not supported, statement disabled for this connection", statement->name);
+        set_statement_status(config, conn, statement->name, GLEWLWYD_STATEMENT_STATUS_DISABLED);
+      }
+      o_free(str_query);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "execute_statement_json - Error build_statement_query %s", statement->name);
+      res = H_ERROR_MEMORY;
+    }
+  }
+  return res;
+}
+
+/**
+ * Same as select_read for a prepared statement
+ */
+int execute_statement_json_read(struct config_elements * config, const struct _glwd_statement * statement, json_t * j_params, json_t ** j_result, int read_mode) {
+  struct _h_connection * conn = get_read_connection(config, read_mode);
+  int res = execute_statement_json(config, conn, statement, j_params, j_result);
+
+  if (conn != config->conn) {
+    if (res != H_OK) {
+      y_log_message(Y_LOG_LEVEL_WARNING, "execute_statement_json_read - Error executing statement on replica, fallback to primary");
+      res = execute_statement_json(config, config->conn, statement, j_params, j_result);
+    } else if (read_mode == GLEWLWYD_DB_READ_REPLICA_FALLBACK && !json_array_size(*j_result)) {
+      json_decref(*j_result);
+      *j_result = NULL;
+      res = execute_statement_json(config, config->conn, statement, j_params, j_result);
+    }
+  }
+  return res;
+}
+
+/**
+ * Entry of the credential cache
+ */
+struct _glwd_credential_entry {
+  char        * username;
+  unsigned char digest[GLEWLWYD_CREDENTIAL_CACHE_DIGEST_LENGTH];
+  time_t        expires_at;
+};
+
+static void credential_entry_free(void * data) {
+  struct _glwd_credential_entry * entry = (struct _glwd_credential_entry *)data;
+  if (entry != NULL) {
+    o_free(entry->username);
+    gnutls_memset(entry->digest, 0, GLEWLWYD_CREDENTIAL_CACHE_DIGEST_LENGTH);
+    o_free(entry);
+  }
+}
+
+/**
+ * The bucket index is case insensitive, so all the entries of a username
+ * can be removed whatever its case is
+ */
+static size_t credential_cache_bucket_index(const char * username) {
+  size_t hash = 5381;
+
+  for (; *username; username++) {
+    hash = ((hash << 5) + hash) + (unsigned char)tolower((unsigned char)*username);
+  }
+  return hash % GLEWLWYD_CREDENTIAL_CACHE_BUCKETS;
+}
+
+/**
+ * HMAC-SHA256 of username and password, using the random salt of the cache as key
+ */
+static int credential_cache_digest(struct _glwd_credential_cache * cache, const char * username, const char * password, unsigned char * digest) {
+  size_t username_len = o_strlen(username), password_len = o_strlen(password);
+  unsigned char * data;
+  int ret;
+
+  if ((data = o_malloc(username_len+password_len+1)) != NULL) {
+    memcpy(data, username, username_len);
+    data[username_len] = '\0';
+    memcpy(data+username_len+1, password, password_len);
+    if (!gnutls_hmac_fast(GNUTLS_MAC_SHA256, cache->salt, GLEWLWYD_CREDENTIAL_CACHE_SALT_LENGTH, data, username_len+password_len+1, digest)) {
+      ret = G_OK;
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "credential_cache_digest - Error gnutls_hmac_fast");
+      ret = G_ERROR;
+    }
+    gnutls_memset(data, 0, username_len+password_len+1);
+    o_free(data);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "credential_cache_digest - Error allocating resources for data");
+    ret = G_ERROR_MEMORY;
+  }
+  return ret;
+}
+
+/**
+ * Removes the expired entries of all buckets, cache->lock must be locked
+ */
+static void credential_cache_purge(struct _glwd_credential_cache * cache, time_t now) {
+  struct _glwd_credential_entry * entry;
+  size_t i, j;
+
+  for (i=0; i<GLEWLWYD_CREDENTIAL_CACHE_BUCKETS; i++) {
+    for (j=pointer_list_size(&cache->bucket[i]); j>0; j--) {
+      entry = (struct _glwd_credential_entry *)pointer_list_get_at(&cache->bucket[i], j-1);
+      if (entry->expires_at <= now) {
+        pointer_list_remove_at(&cache->bucket[i], j-1);
+        credential_entry_free(entry);
+        cache->size--;
+      }
+    }
+  }
+}
+
+/**
+ * Removes the entries of username in its bucket, cache->lock must be locked
+ */
+static void credential_cache_remove_username(struct _glwd_credential_cache * cache, size_t index, const char * username) {
+  struct _glwd_credential_entry * entry;
+  size_t i;
+
+  for (i=pointer_list_size(&cache->bucket[index]); i>0; i--) {
+    entry = (struct _glwd_credential_entry *)pointer_list_get_at(&cache->bucket[index], i-1);
+    if (0 == o_strcasecmp(username, entry->username)) {
+      pointer_list_remove_at(&cache->bucket[index], i-1);
+      credential_entry_free(entry);
+      cache->size--;
+    }
+  }
+}
+
+/**
+ * Initializes a credential cache with a random salt
+ * The entries expire after duration seconds, at most max_size entries are stored
+ */
+int glewlwyd_credential_cache_init(struct _glwd_credential_cache * cache, time_t duration, size_t max_size) {
+  size_t i;
+  int ret;
+
+  if (cache != NULL) {
+    cache->duration = duration;
+    cache->max_size = max_size;
+    cache->size = 0;
+    for (i=0; i<GLEWLWYD_CREDENTIAL_CACHE_BUCKETS; i++) {
+      pointer_list_init(&cache->bucket[i]);
+    }
+    if (gnutls_rnd(GNUTLS_RND_KEY, cache->salt, GLEWLWYD_CREDENTIAL_CACHE_SALT_LENGTH)) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_credential_cache_init - Error gnutls_rnd");
+      ret = G_ERROR;
+    } else if (pthread_mutex_init(&cache->lock, NULL)) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_credential_cache_init - Error pthread_mutex_init");
+      ret = G_ERROR;
+    } else {
+      ret = G_OK;
+    }
+  } else {
+    ret = G_ERROR_PARAM;
+  }
+  return ret;
+}
+
+void glewlwyd_credential_cache_close(struct _glwd_credential_cache * cache) {
+  size_t i;
+
+  if (cache != NULL) {
+    for (i=0; i<GLEWLWYD_CREDENTIAL_CACHE_BUCKETS; i++) {
+      pointer_list_clean_free(&cache->bucket[i], &credential_entry_free);
+    }
+    cache->size = 0;
+    gnutls_memset(cache->salt, 0, GLEWLWYD_CREDENTIAL_CACHE_SALT_LENGTH);
+    pthread_mutex_destroy(&cache->lock);
+  }
+}
+
+/**
+ * Returns G_OK if the username and password were verified successfully
+ * and the entry hasn't expired, G_ERROR_NOT_FOUND otherwise
+ */
+int glewlwyd_credential_cache_check(struct _glwd_credential_cache * cache, const char * username, const char * password) {
+  unsigned char digest[GLEWLWYD_CREDENTIAL_CACHE_DIGEST_LENGTH];
+  struct _glwd_credential_entry * entry;
+  size_t index, i;
+  time_t now;
+  int ret = G_ERROR_NOT_FOUND;
+
+  if (cache != NULL && cache->duration && !o_strnullempty(username) && !o_strnullempty(password)) {
+    if (credential_cache_digest(cache, username, password, digest) == G_OK) {
+      index = credential_cache_bucket_index(username);
+      time(&now);
+      if (!pthread_mutex_lock(&cache->lock)) {
+        for (i=pointer_list_size(&cache->bucket[index]); i>0; i--) {
+          entry = (struct _glwd_credential_entry *)pointer_list_get_at(&cache->bucket[index], i-1);
+          if (0 == o_strcmp(username, entry->username)) {
+            if (entry->expires_at <= now) {
+              pointer_list_remove_at(&cache->bucket[index], i-1);
+              credential_entry_free(entry);
+              cache->size--;
+            } else if (!gnutls_memcmp(digest, entry->digest, GLEWLWYD_CREDENTIAL_CACHE_DIGEST_LENGTH)) {
+              ret = G_OK;
+            }
+          }
+        }
+        pthread_mutex_unlock(&cache->lock);
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_credential_cache_check - Error pthread_mutex_lock");
+      }
+      gnutls_memset(digest, 0, GLEWLWYD_CREDENTIAL_CACHE_DIGEST_LENGTH);
+    }
+  }
+  return ret;
+}
+
+/**
+ * Stores a successful verification, only the last password verified is kept for a username
+ * If the cache is full after removing the expired entries, the verification isn't stored
+ */
+void glewlwyd_credential_cache_set(struct _glwd_credential_cache * cache, const char * username, const char * password) {
+  struct _glwd_credential_entry * entry;
+  size_t index;
+  time_t now;
+
+  if (cache != NULL && cache->duration && !o_strnullempty(username) && !o_strnullempty(password)) {
+    if ((entry = o_malloc(sizeof(struct _glwd_credential_entry))) != NULL) {
+      entry->username = o_strdup(username);
+      time(&now);
+      entry->expires_at = now + cache->duration;
+      if (entry->username != NULL && credential_cache_digest(cache, username, password, entry->digest) == G_OK) {
+        index = credential_cache_bucket_index(username);
+        if (!pthread_mutex_lock(&cache->lock)) {
+          credential_cache_remove_username(cache, index, username);
+          if (cache->size >= cache->max_size) {
+            credential_cache_purge(cache, now);
+          }
+          if (cache->size < cache->max_size && pointer_list_append(&cache->bucket[index], entry)) {
+            cache->size++;
+            entry = NULL;
+          }
+          pthread_mutex_unlock(&cache->lock);
+        } else {
+          y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_credential_cache_set - Error pthread_mutex_lock");
+        }
+      }
+      credential_entry_free(entry);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_credential_cache_set - Error allocating resources for entry");
+    }
+  }
+}
+
+/**
+ * Removes the entries of username, or all the entries if username is NULL
+ */
+void glewlwyd_credential_cache_remove(struct _glwd_credential_cache * cache, const char * username) {
+  size_t i;
+
+  if (cache != NULL && cache->duration) {
+    if (!pthread_mutex_lock(&cache->lock)) {
+      if (username == NULL) {
+        for (i=0; i<GLEWLWYD_CREDENTIAL_CACHE_BUCKETS; i++) {
+          pointer_list_clean_free(&cache->bucket[i], &credential_entry_free);
+        }
+        cache->size = 0;
+      } else {
+        credential_cache_remove_username(cache, credential_cache_bucket_index(username), username);
+      }
+      pthread_mutex_unlock(&cache->lock);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_credential_cache_remove - Error pthread_mutex_lock");
+    }
+  }
+}
+
+/**
+ * Checks once that the MariaDB servers accept literals as bound parameters of EXECUTE
+ * MySQL only accepts user variables in EXECUTE ... USING, so the prepared statements
+ * are disabled on a connection that fails the check
+ */
+int init_prepared_statements(struct config_elements * config) {
+  struct _h_connection * conn;
+  json_t * j_result = NULL;
+  size_t i;
+  int enabled, ret = G_OK;
+
+  for (i=0; i<=config->conn_replica_count && config->use_prepared_statement; i++) {
+    conn = i?config->conn_replica[i-1]:config->conn;
+    if (conn->type == HOEL_DB_TYPE_MARIADB) {
+      enabled = 0;
+      if (h_execute_query(conn, "PREPARE glwd_statement_check FROM 'SELECT ?'", NULL, H_OPTION_EXEC) == H_OK) {
+        enabled = (h_execute_query_json(conn, "EXECUTE glwd_statement_check USING 1", &j_result) == H_OK);
+        json_decref(j_result);
+        j_result = NULL;
+        h_execute_query(conn, "DEALLOCATE PREPARE glwd_statement_check", NULL, H_OPTION_EXEC);
+      }
+      if (!pthread_mutex_lock(&config->statement_lock)) {
+        json_object_set(get_statement_cache_conn(config, conn), "enabled", enabled?json_true():json_false());
+        pthread_mutex_unlock(&config->statement_lock);
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "init_prepared_statements - Error pthread_mutex_lock");
+        ret = G_ERROR;
+      }
+      if (!enabled) {
+        y_log_message(Y_LOG_LEVEL_WARNING, "Prepared statements not supported by the database server, prepared statements disabled for this connection");
+      }
+    }
+  }
+  return ret;
+}
@@ -35,11 +35,13 @@ json_t * get_module_type_list(struct config_elements * config) {
   struct _plugin_module * plugin_module;
   size_t i;
   json_t * j_return;
+  struct _pointer_list * module_list;
   
   if ((j_return = json_pack("{sis{s[]s[]s[]s[]s[]}}", "result", G_OK, "module", "user", "user_middleware", "client", "scheme", "plugin")) != NULL) {
     // Gathering user modules
-    for (i=0; i<pointer_list_size(config->user_module_list); i++) {
-      user_module = (struct _user_module *)pointer_list_get_at(config->user_module_list, i);
+    module_list = GLEWLWYD_MODULE_LIST_GET(config->user_module_list);
+    for (i=0; i<pointer_list_size(module_list); i++) {
+      user_module = (struct _user_module *)pointer_list_get_at(module_list, i);
       if (user_module != NULL) {
         json_array_append_new(json_object_get(json_object_get(j_return, "module"), "user"), json_pack("{ssss?ss?}",
                                                                                                       "name", user_module->name,
@@ -50,8 +52,9 @@ json_t * get_module_type_list(struct config_elements * config) {
       }
     }
     // Gathering user middleware modules
-    for (i=0; i<pointer_list_size(config->user_middleware_module_list); i++) {
-      user_middleware_module = (struct _user_middleware_module *)pointer_list_get_at(config->user_middleware_module_list, i);
+    module_list = GLEWLWYD_MODULE_LIST_GET(config->user_middleware_module_list);
+    for (i=0; i<pointer_list_size(module_list); i++) {
+      user_middleware_module = (struct _user_middleware_module *)pointer_list_get_at(module_list, i);
       if (user_middleware_module != NULL) {
         json_array_append_new(json_object_get(json_object_get(j_return, "module"), "user_middleware"), json_pack("{ssss?ss?}",
                                                                                                                  "name", user_middleware_module->name,
@@ -62,8 +65,9 @@ json_t * get_module_type_list(struct config_elements * config) {
       }
     }
     // Gathering client modules
-    for (i=0; i<pointer_list_size(config->client_module_list); i++) {
-      client_module = (struct _client_module *)pointer_list_get_at(config->client_module_list, i);
+    module_list = GLEWLWYD_MODULE_LIST_GET(config->client_module_list);
+    for (i=0; i<pointer_list_size(module_list); i++) {
+      client_module = (struct _client_module *)pointer_list_get_at(module_list, i);
       if (client_module != NULL) {
         json_array_append_new(json_object_get(json_object_get(j_return, "module"), "client"), json_pack("{ssss?ss?}",
                                                                                                         "name", client_module->name,
@@ -74,8 +78,9 @@ json_t * get_module_type_list(struct config_elements * config) {
       }
     }
     // Gathering user auth scheme modules
-    for (i=0; i<pointer_list_size(config->user_auth_scheme_module_list); i++) {
-      scheme_module = (struct _user_auth_scheme_module *)pointer_list_get_at(config->user_auth_scheme_module_list, i);
+    module_list = GLEWLWYD_MODULE_LIST_GET(config->user_auth_scheme_module_list);
+    for (i=0; i<pointer_list_size(module_list); i++) {
+      scheme_module = (struct _user_auth_scheme_module *)pointer_list_get_at(module_list, i);
       if (scheme_module != NULL) {
         json_array_append_new(json_object_get(json_object_get(j_return, "module"), "scheme"), json_pack("{ssss?ss?}",
                                                                                                         "name", scheme_module->name,
@@ -86,8 +91,9 @@ json_t * get_module_type_list(struct config_elements * config) {
       }
     }
     // Gathering plugin modules
-    for (i=0; i<pointer_list_size(config->plugin_module_list); i++) {
-      plugin_module = (struct _plugin_module *)pointer_list_get_at(config->plugin_module_list, i);
+    module_list = GLEWLWYD_MODULE_LIST_GET(config->plugin_module_list);
+    for (i=0; i<pointer_list_size(module_list); i++) {
+      plugin_module = (struct _plugin_module *)pointer_list_get_at(module_list, i);
       if (plugin_module != NULL) {
         json_array_append_new(json_object_get(json_object_get(j_return, "module"), "plugin"), json_pack("{ssss?ss?}",
                                                                                                         "name", plugin_module->name,
@@ -214,6 +220,7 @@ json_t * is_user_module_valid(struct config_elements * config, json_t * j_module
   int found;
   struct _user_module * module;
   char * parameters;
+  struct _pointer_list * module_list;
   
   if (j_module != NULL && json_is_object(j_module)) {
     if ((j_error_list = json_array()) != NULL) {
@@ -231,8 +238,9 @@ json_t * is_user_module_valid(struct config_elements * config, json_t * j_module
         }
         if (json_object_get(j_module, "module") != NULL && json_is_string(json_object_get(j_module, "module")) && json_string_length(json_object_get(j_module, "module")) > 0 && json_string_length(json_object_get(j_module, "module")) <= 128) {
           found = 0;
-          for (i=0; i<pointer_list_size(config->user_module_list); i++) {
-            module = (struct _user_module *)pointer_list_get_at(config->user_module_list, i);
+          module_list = GLEWLWYD_MODULE_LIST_GET(config->user_module_list);
+          for (i=0; i<pointer_list_size(module_list); i++) {
+            module = (struct _user_module *)pointer_list_get_at(module_list, i);
             if (module != NULL) {
               if (0 == o_strcmp(module->name, json_string_value(json_object_get(j_module, "module")))) {
                 found = 1;
@@ -296,6 +304,7 @@ json_t * add_user_module(struct config_elements * config, json_t * j_module) {
   size_t i;
   json_t * j_return, * j_result;
   char * parameters = json_dumps(json_object_get(j_module, "parameters"), JSON_COMPACT);
+  struct _pointer_list * module_list;
   
   j_query = json_pack("{sss{sOsOsOsisisiss}}",
                       "table",
@@ -324,8 +333,9 @@ json_t * add_user_module(struct config_elements * config, json_t * j_module) {
   json_decref(j_query);
   if (res == H_OK) {
     module = NULL;
-    for (i=0; i<pointer_list_size(config->user_module_list); i++) {
-      module = (struct _user_module *)pointer_list_get_at(config->user_module_list, i);
+    module_list = GLEWLWYD_MODULE_LIST_GET(config->user_module_list);
+    for (i=0; i<pointer_list_size(module_list); i++) {
+      module = (struct _user_module *)pointer_list_get_at(module_list, i);
       if (0 == o_strcmp(module->name, json_string_value(json_object_get(j_module, "module")))) {
         break;
       } else {
@@ -342,10 +352,10 @@ json_t * add_user_module(struct config_elements * config, json_t * j_module) {
           cur_instance->enabled = 0;
           cur_instance->readonly = json_object_get(j_module, "readonly")==json_true()?1:0;
           cur_instance->multiple_passwords = json_object_get(j_module, "multiple_passwords")==json_true()?1:0;
-          if (pointer_list_append(config->user_module_instance_list, cur_instance)) {
+          if (append_module_instance(config, &config->user_module_instance_list, cur_instance) == G_OK) {
             j_result = module->user_module_init(config->config_m, cur_instance->readonly, cur_instance->multiple_passwords, json_object_get(j_module, "parameters"), &cur_instance->cls);
             if (check_result_value(j_result, G_OK)) {
-              cur_instance->enabled = 1;
+              __atomic_store_n(&cur_instance->enabled, 1, __ATOMIC_RELEASE);
               j_return = json_pack("{si}", "result", G_OK);
             } else if (check_result_value(j_result, G_ERROR_PARAM)) {
               j_return = json_pack("{sisO}", "result", G_ERROR_PARAM, "error", json_object_get(j_result, "error"));
@@ -452,9 +462,8 @@ int delete_user_module(struct config_elements * config, const char * name) {
         json_decref(j_result);
       }
       if (!error) {
-        if (pointer_list_remove_pointer(config->user_module_instance_list, instance)) {
-          o_free(instance->name);
-          o_free(instance);
+        if (remove_module_instance(config, &config->user_module_instance_list, instance) == G_OK) {
+          retire_user_module_instance(config, instance);
           j_query = json_pack("{sss{ss}}",
                               "table",
                               GLEWLWYD_TABLE_USER_MODULE_INSTANCE,
@@ -471,7 +480,7 @@ int delete_user_module(struct config_elements * config, const char * name) {
             ret = G_ERROR_DB;
           }
         } else {
-          y_log_message(Y_LOG_LEVEL_ERROR, "delete_user_module - Error pointer_list_remove_pointer");
+          y_log_message(Y_LOG_LEVEL_ERROR, "delete_user_module - Error remove_module_instance");
           ret = G_ERROR;
         }
       } else {
@@ -500,7 +509,7 @@ json_t * manage_user_module(struct config_elements * config, const char * name,
         if (!pthread_mutex_lock(&config->module_lock)) {
           j_result = instance->module->user_module_init(config->config_m, instance->readonly, instance->multiple_passwords, json_object_get(json_object_get(j_module, "module"), "parameters"), &instance->cls);
           if (check_result_value(j_result, G_OK)) {
-            instance->enabled = 1;
+            __atomic_store_n(&instance->enabled, 1, __ATOMIC_RELEASE);
             json_object_set(json_object_get(j_module, "module"), "enabled", json_true());
             if (set_user_module(config, name, json_object_get(j_module, "module")) == G_OK) {
               j_return = json_pack("{si}", "result", G_OK);
@@ -526,8 +535,7 @@ json_t * manage_user_module(struct config_elements * config, const char * name,
     } else if (action == GLEWLWYD_MODULE_ACTION_STOP) {
       if (instance->enabled) {
         if (!pthread_mutex_lock(&config->module_lock)) {
-          if (instance->module->user_module_close(config->config_m, instance->cls) == G_OK) {
-            instance->enabled = 0;
+          if (retire_user_module_instance_cls(config, instance) == G_OK) {
             json_object_set(json_object_get(j_module, "module"), "enabled", json_false());
             if (set_user_module(config, name, json_object_get(j_module, "module")) == G_OK) {
               j_return = json_pack("{si}", "result", G_OK);
@@ -536,7 +544,7 @@ json_t * manage_user_module(struct config_elements * config, const char * name,
               j_return = json_pack("{si}", "result", G_ERROR);
             }
           } else {
-            y_log_message(Y_LOG_LEVEL_ERROR, "manage_user_module - Error close module %s/%s", instance->module->name, json_string_value(json_object_get(json_object_get(j_module, "module"), "name")));
+            y_log_message(Y_LOG_LEVEL_ERROR, "manage_user_module - Error retire module %s/%s", instance->module->name, json_string_value(json_object_get(json_object_get(j_module, "module"), "name")));
             j_return = json_pack("{si}", "result", G_ERROR);
           }
           pthread_mutex_unlock(&config->module_lock);
@@ -654,6 +662,7 @@ json_t * is_user_middleware_module_valid(struct config_elements * config, json_t
   int found;
   struct _user_middleware_module * module;
   char * parameters;
+  struct _pointer_list * module_list;
   
   if (j_module != NULL && json_is_object(j_module)) {
     if ((j_error_list = json_array()) != NULL) {
@@ -671,8 +680,9 @@ json_t * is_user_middleware_module_valid(struct config_elements * config, json_t
         }
         if (json_object_get(j_module, "module") != NULL && json_is_string(json_object_get(j_module, "module")) && json_string_length(json_object_get(j_module, "module")) > 0 && json_string_length(json_object_get(j_module, "module")) <= 128) {
           found = 0;
-          for (i=0; i<pointer_list_size(config->user_middleware_module_list); i++) {
-            module = (struct _user_middleware_module *)pointer_list_get_at(config->user_middleware_module_list, i);
+          module_list = GLEWLWYD_MODULE_LIST_GET(config->user_middleware_module_list);
+          for (i=0; i<pointer_list_size(module_list); i++) {
+            module = (struct _user_middleware_module *)pointer_list_get_at(module_list, i);
             if (module != NULL) {
               if (0 == o_strcmp(module->name, json_string_value(json_object_get(j_module, "module")))) {
                 found = 1;
@@ -750,8 +760,7 @@ json_t * add_user_middleware_module(struct config_elements * config, json_t * j_
   res = h_insert(config->conn, j_query, NULL);
   json_decref(j_query);
   if (res == H_OK) {
-    close_user_middleware_module_instance_list(config);
-    j_return = json_pack("{si}", "result", load_user_middleware_module_instance_list(config));
+    j_return = json_pack("{si}", "result", reload_user_middleware_module_instance_list(config));
   } else {
     y_log_message(Y_LOG_LEVEL_ERROR, "add_user_middleware_module - Error executing j_query");
     glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
@@ -787,8 +796,7 @@ int set_user_middleware_module(struct config_elements * config, const char * nam
   res = h_update(config->conn, j_query, NULL);
   json_decref(j_query);
   if (res == H_OK) {
-    close_user_middleware_module_instance_list(config);
-    load_user_middleware_module_instance_list(config);
+    reload_user_middleware_module_instance_list(config);
     ret = G_OK;
   } else {
     y_log_message(Y_LOG_LEVEL_ERROR, "add_user_middleware_module - Error executing j_query");
@@ -815,8 +823,7 @@ int delete_user_middleware_module(struct config_elements * config, const char *
     res = h_delete(config->conn, j_query, NULL);
     json_decref(j_query);
     if (res == H_OK) {
-      close_user_middleware_module_instance_list(config);
-      load_user_middleware_module_instance_list(config);
+      reload_user_middleware_module_instance_list(config);
       ret = G_OK;
     } else {
       y_log_message(Y_LOG_LEVEL_ERROR, "delete_user_middleware_module - Error executing j_query");
@@ -840,7 +847,7 @@ json_t * manage_user_middleware_module(struct config_elements * config, const ch
         if (!pthread_mutex_lock(&config->module_lock)) {
           j_result = instance->module->user_middleware_module_init(config->config_m, json_object_get(json_object_get(j_module, "module"), "parameters"), &instance->cls);
           if (check_result_value(j_result, G_OK)) {
-            instance->enabled = 1;
+            __atomic_store_n(&instance->enabled, 1, __ATOMIC_RELEASE);
             json_object_set(json_object_get(j_module, "module"), "enabled", json_true());
             if (set_user_middleware_module(config, name, json_object_get(j_module, "module")) == G_OK) {
               j_return = json_pack("{si}", "result", G_OK);
@@ -866,8 +873,7 @@ json_t * manage_user_middleware_module(struct config_elements * config, const ch
     } else if (action == GLEWLWYD_MODULE_ACTION_STOP) {
       if (instance->enabled) {
         if (!pthread_mutex_lock(&config->module_lock)) {
-          if (instance->module->user_middleware_module_close(config->config_m, instance->cls) == G_OK) {
-            instance->enabled = 0;
+          if (retire_user_middleware_module_instance_cls(config, instance) == G_OK) {
             json_object_set(json_object_get(j_module, "module"), "enabled", json_false());
             if (set_user_middleware_module(config, name, json_object_get(j_module, "module")) == G_OK) {
               j_return = json_pack("{si}", "result", G_OK);
@@ -876,7 +882,7 @@ json_t * manage_user_middleware_module(struct config_elements * config, const ch
               j_return = json_pack("{si}", "result", G_ERROR);
             }
           } else {
-            y_log_message(Y_LOG_LEVEL_ERROR, "manage_user_middleware_module - Error close module %s/%s", instance->module->name, json_string_value(json_object_get(json_object_get(j_module, "module"), "name")));
+            y_log_message(Y_LOG_LEVEL_ERROR, "manage_user_middleware_module - Error retire module %s/%s", instance->module->name, json_string_value(json_object_get(json_object_get(j_module, "module"), "name")));
             j_return = json_pack("{si}", "result", G_ERROR);
           }
           pthread_mutex_unlock(&config->module_lock);
@@ -1018,6 +1024,7 @@ json_t * is_user_auth_scheme_module_valid(struct config_elements * config, json_
   int found;
   struct _user_auth_scheme_module * module;
   char * parameters;
+  struct _pointer_list * module_list;
   
   if (j_module != NULL && json_is_object(j_module)) {
     if ((j_error_list = json_array()) != NULL) {
@@ -1035,8 +1042,9 @@ json_t * is_user_auth_scheme_module_valid(struct config_elements * config, json_
         }
         if (json_object_get(j_module, "module") != NULL && json_is_string(json_object_get(j_module, "module")) && json_string_length(json_object_get(j_module, "module")) > 0 && json_string_length(json_object_get(j_module, "module")) <= 128) {
           found = 0;
-          for (i=0; i<pointer_list_size(config->user_auth_scheme_module_list); i++) {
-            module = (struct _user_auth_scheme_module *)pointer_list_get_at(config->user_auth_scheme_module_list, i);
+          module_list = GLEWLWYD_MODULE_LIST_GET(config->user_auth_scheme_module_list);
+          for (i=0; i<pointer_list_size(module_list); i++) {
+            module = (struct _user_auth_scheme_module *)pointer_list_get_at(module_list, i);
             if (module != NULL) {
               if (0 == o_strcmp(module->name, json_string_value(json_object_get(j_module, "module")))) {
                 found = 1;
@@ -1099,6 +1107,7 @@ json_t * add_user_auth_scheme_module(struct config_elements * config, json_t * j
   int res;
   size_t i;
   char * parameters = json_dumps(json_object_get(j_module, "parameters"), JSON_COMPACT);
+  struct _pointer_list * module_list;
   
   j_query = json_pack("{sss{sOsOsOsssOsOsisisisi}}",
                       "table",
@@ -1130,8 +1139,9 @@ json_t * add_user_auth_scheme_module(struct config_elements * config, json_t * j
     j_last_id = h_last_insert_id(config->conn);
     if (j_last_id != NULL) {
       module = NULL;
-      for (i=0; i<pointer_list_size(config->user_auth_scheme_module_list); i++) {
-        module = (struct _user_auth_scheme_module *)pointer_list_get_at(config->user_auth_scheme_module_list, i);
+      module_list = GLEWLWYD_MODULE_LIST_GET(config->user_auth_scheme_module_list);
+      for (i=0; i<pointer_list_size(module_list); i++) {
+        module = (struct _user_auth_scheme_module *)pointer_list_get_at(module_list, i);
         if (0 == o_strcmp(module->name, json_string_value(json_object_get(j_module, "module")))) {
           break;
         } else {
@@ -1152,12 +1162,12 @@ json_t * add_user_auth_scheme_module(struct config_elements * config, json_t * j
             cur_instance->guasmi_forbid_user_profile = json_object_get(j_module, "forbid_user_profile")==json_true();
             cur_instance->guasmi_forbid_user_reset_credential = json_object_get(j_module, "forbid_user_reset_credential")==json_true();
             cur_instance->enabled = 0;
-            if (pointer_list_append(config->user_auth_scheme_module_instance_list, cur_instance)) {
+            if (append_module_instance(config, &config->user_auth_scheme_module_instance_list, cur_instance) == G_OK) {
               j_result = module->user_auth_scheme_module_init(config->config_m, json_object_get(j_module, "parameters"), cur_instance->name, &cur_instance->cls);
               if (check_result_value(j_result, G_OK)) {
                 glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_AUTH_USER_VALID_SCHEME, 0, "scheme_type", module->name, "scheme_name", cur_instance->name, NULL);
                 glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_AUTH_USER_INVALID_SCHEME, 0, "scheme_type", module->name, "scheme_name", cur_instance->name, NULL);
-                cur_instance->enabled = 1;
+                __atomic_store_n(&cur_instance->enabled, 1, __ATOMIC_RELEASE);
                 j_return = json_pack("{si}", "result", G_OK);
               } else if (check_result_value(j_result, G_ERROR_PARAM)) {
                 j_return = json_pack("{sisO}", "result", G_ERROR_PARAM, "error", json_object_get(j_result, "error"));
@@ -1196,6 +1206,7 @@ json_t * add_user_auth_scheme_module(struct config_elements * config, json_t * j
     j_return = json_pack("{si}", "result", G_ERROR_DB);
   }
   o_free(parameters);
+  invalidate_scheme_can_use_cache(config, NULL, NULL);
   return j_return;
 }
 
@@ -1255,6 +1266,7 @@ int set_user_auth_scheme_module(struct config_elements * config, const char * na
     glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
     ret = G_ERROR_DB;
   }
+  invalidate_scheme_can_use_cache(config, NULL, NULL);
   return ret;
 }
 
@@ -1266,9 +1278,8 @@ int delete_user_auth_scheme_module(struct config_elements * config, const char *
   if (check_result_value(j_result, G_OK)) {
     if (!pthread_mutex_lock(&config->module_lock)) {
       instance = get_user_auth_scheme_module_instance(config, name);
-      if (pointer_list_remove_pointer(config->user_auth_scheme_module_instance_list, instance)) {
-        o_free(instance->name);
-        o_free(instance);
+      if (remove_module_instance(config, &config->user_auth_scheme_module_instance_list, instance) == G_OK) {
+        retire_user_auth_scheme_module_instance(config, instance);
         j_query = json_pack("{sss{ss}}",
                             "table",
                             GLEWLWYD_TABLE_USER_AUTH_SCHEME_MODULE_INSTANCE,
@@ -1285,7 +1296,7 @@ int delete_user_auth_scheme_module(struct config_elements * config, const char *
           ret = G_ERROR_DB;
         }
       } else {
-        y_log_message(Y_LOG_LEVEL_ERROR, "delete_user_auth_scheme_module - Error pointer_list_remove_pointer");
+        y_log_message(Y_LOG_LEVEL_ERROR, "delete_user_auth_scheme_module - Error remove_module_instance");
         ret = G_ERROR;
       }
       pthread_mutex_unlock(&config->module_lock);
@@ -1298,6 +1309,7 @@ int delete_user_auth_scheme_module(struct config_elements * config, const char *
     ret = G_ERROR;
   }
   json_decref(j_result);
+  invalidate_scheme_can_use_cache(config, NULL, NULL);
   return ret;
 }
 
@@ -1313,7 +1325,7 @@ json_t * manage_user_auth_scheme_module(struct config_elements * config, const c
           if (check_result_value(j_result, G_OK)) {
             glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_AUTH_USER_VALID_SCHEME, 0, "scheme_type", instance->module->name, "scheme_name", instance->name, NULL);
             glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_AUTH_USER_INVALID_SCHEME, 0, "scheme_type", instance->module->name, "scheme_name", instance->name, NULL);
-            instance->enabled = 1;
+            __atomic_store_n(&instance->enabled, 1, __ATOMIC_RELEASE);
             json_object_set(json_object_get(j_module, "module"), "enabled", json_true());
             if (set_user_auth_scheme_module(config, name, json_object_get(j_module, "module")) == G_OK) {
               j_return = json_pack("{si}", "result", G_OK);
@@ -1339,8 +1351,7 @@ json_t * manage_user_auth_scheme_module(struct config_elements * config, const c
     } else if (action == GLEWLWYD_MODULE_ACTION_STOP) {
       if (instance->enabled) {
         if (!pthread_mutex_lock(&config->module_lock)) {
-          if (instance->module->user_auth_scheme_module_close(config->config_m, instance->cls) == G_OK) {
-            instance->enabled = 0;
+          if (retire_user_auth_scheme_module_instance_cls(config, instance) == G_OK) {
             json_object_set(json_object_get(j_module, "module"), "enabled", json_false());
             if (set_user_auth_scheme_module(config, name, json_object_get(j_module, "module")) == G_OK) {
               j_return = json_pack("{si}", "result", G_OK);
@@ -1349,7 +1360,7 @@ json_t * manage_user_auth_scheme_module(struct config_elements * config, const c
               j_return = json_pack("{si}", "result", G_ERROR);
             }
           } else {
-            y_log_message(Y_LOG_LEVEL_ERROR, "manage_user_auth_scheme_module - Error close module %s/%s", instance->module->name, json_string_value(json_object_get(json_object_get(j_module, "module"), "name")));
+            y_log_message(Y_LOG_LEVEL_ERROR, "manage_user_auth_scheme_module - Error retire module %s/%s", instance->module->name, json_string_value(json_object_get(json_object_get(j_module, "module"), "name")));
             j_return = json_pack("{si}", "result", G_ERROR);
           }
           pthread_mutex_unlock(&config->module_lock);
@@ -1369,6 +1380,7 @@ json_t * manage_user_auth_scheme_module(struct config_elements * config, const c
     j_return = json_pack("{sis[s]}", "result", G_ERROR_PARAM, "error", "action not found");
   }
   json_decref(j_module);
+  invalidate_scheme_can_use_cache(config, NULL, NULL);
   return j_return;
 }
 
@@ -1475,6 +1487,7 @@ json_t * is_client_module_valid(struct config_elements * config, json_t * j_modu
   int found;
   struct _client_module * module;
   char * parameters;
+  struct _pointer_list * module_list;
   
   if (j_module != NULL && json_is_object(j_module)) {
     if ((j_error_list = json_array()) != NULL) {
@@ -1492,8 +1505,9 @@ json_t * is_client_module_valid(struct config_elements * config, json_t * j_modu
         }
         if (json_object_get(j_module, "module") != NULL && json_is_string(json_object_get(j_module, "module")) && json_string_length(json_object_get(j_module, "module")) > 0 && json_string_length(json_object_get(j_module, "module")) <= 128) {
           found = 0;
-          for (i=0; i<pointer_list_size(config->client_module_list); i++) {
-            module = (struct _client_module *)pointer_list_get_at(config->client_module_list, i);
+          module_list = GLEWLWYD_MODULE_LIST_GET(config->client_module_list);
+          for (i=0; i<pointer_list_size(module_list); i++) {
+            module = (struct _client_module *)pointer_list_get_at(module_list, i);
             if (module != NULL) {
               if (0 == o_strcmp(module->name, json_string_value(json_object_get(j_module, "module")))) {
                 found = 1;
@@ -1553,6 +1567,7 @@ json_t * add_client_module(struct config_elements * config, json_t * j_module) {
   int res;
   size_t i;
   char * parameters = json_dumps(json_object_get(j_module, "parameters"), JSON_COMPACT);
+  struct _pointer_list * module_list;
   
   j_query = json_pack("{sss{sOsOsOsisiss}}",
                       "table",
@@ -1579,8 +1594,9 @@ json_t * add_client_module(struct config_elements * config, json_t * j_module) {
   json_decref(j_query);
   if (res == H_OK) {
     module = NULL;
-    for (i=0; i<pointer_list_size(config->client_module_list); i++) {
-      module = (struct _client_module *)pointer_list_get_at(config->client_module_list, i);
+    module_list = GLEWLWYD_MODULE_LIST_GET(config->client_module_list);
+    for (i=0; i<pointer_list_size(module_list); i++) {
+      module = (struct _client_module *)pointer_list_get_at(module_list, i);
       if (0 == o_strcmp(module->name, json_string_value(json_object_get(j_module, "module")))) {
         break;
       } else {
@@ -1596,10 +1612,10 @@ json_t * add_client_module(struct config_elements * config, json_t * j_module) {
           cur_instance->module = module;
           cur_instance->enabled = 0;
           cur_instance->readonly = json_object_get(j_module, "readonly")==json_true()?1:0;
-          if (pointer_list_append(config->client_module_instance_list, cur_instance)) {
+          if (append_module_instance(config, &config->client_module_instance_list, cur_instance) == G_OK) {
             j_result = module->client_module_init(config->config_m, cur_instance->readonly, json_object_get(j_module, "parameters"), &cur_instance->cls);
             if (check_result_value(j_result, G_OK)) {
-              cur_instance->enabled = 1;
+              __atomic_store_n(&cur_instance->enabled, 1, __ATOMIC_RELEASE);
               j_return = json_pack("{si}", "result", G_OK);
             } else if (check_result_value(j_result, G_ERROR_PARAM)) {
               j_return = json_pack("{sisO}", "result", G_ERROR_PARAM, "error", json_object_get(j_result, "error"));
@@ -1704,9 +1720,8 @@ int delete_client_module(struct config_elements * config, const char * name) {
     }
     if (!error) {
       if (!pthread_mutex_lock(&config->module_lock)) {
-        if (pointer_list_remove_pointer(config->client_module_instance_list, instance)) {
-          o_free(instance->name);
-          o_free(instance);
+        if (remove_module_instance(config, &config->client_module_instance_list, instance) == G_OK) {
+          retire_client_module_instance(config, instance);
           j_query = json_pack("{sss{ss}}",
                               "table",
                               GLEWLWYD_TABLE_CLIENT_MODULE_INSTANCE,
@@ -1723,7 +1738,7 @@ int delete_client_module(struct config_elements * config, const char * name) {
             ret = G_ERROR_DB;
           }
         } else {
-          y_log_message(Y_LOG_LEVEL_ERROR, "delete_client_module - Error pointer_list_remove_pointer");
+          y_log_message(Y_LOG_LEVEL_ERROR, "delete_client_module - Error remove_module_instance");
           ret = G_ERROR;
         }
         pthread_mutex_unlock(&config->module_lock);
@@ -1752,7 +1767,7 @@ json_t * manage_client_module(struct config_elements * config, const char * name
         if (!pthread_mutex_lock(&config->module_lock)) {
           j_result = instance->module->client_module_init(config->config_m, instance->readonly, json_object_get(json_object_get(j_module, "module"), "parameters"), &instance->cls);
           if (check_result_value(j_result, G_OK)) {
-            instance->enabled = 1;
+            __atomic_store_n(&instance->enabled, 1, __ATOMIC_RELEASE);
             json_object_set(json_object_get(j_module, "module"), "enabled", json_true());
             if (set_client_module(config, name, json_object_get(j_module, "module")) == G_OK) {
               j_return = json_pack("{si}", "result", G_OK);
@@ -1778,8 +1793,7 @@ json_t * manage_client_module(struct config_elements * config, const char * name
     } else if (action == GLEWLWYD_MODULE_ACTION_STOP) {
       if (instance->enabled) {
         if (!pthread_mutex_lock(&config->module_lock)) {
-          if (instance->module->client_module_close(config->config_m, instance->cls) == G_OK) {
-            instance->enabled = 0;
+          if (retire_client_module_instance_cls(config, instance) == G_OK) {
             json_object_set(json_object_get(j_module, "module"), "enabled", json_false());
             if (set_client_module(config, name, json_object_get(j_module, "module")) == G_OK) {
               j_return = json_pack("{si}", "result", G_OK);
@@ -1788,7 +1802,7 @@ json_t * manage_client_module(struct config_elements * config, const char * name
               j_return = json_pack("{si}", "result", G_ERROR);
             }
           } else {
-            y_log_message(Y_LOG_LEVEL_ERROR, "manage_client_module - Error close module %s/%s", instance->module->name, json_string_value(json_object_get(json_object_get(j_module, "module"), "name")));
+            y_log_message(Y_LOG_LEVEL_ERROR, "manage_client_module - Error retire module %s/%s", instance->module->name, json_string_value(json_object_get(json_object_get(j_module, "module"), "name")));
             j_return = json_pack("{si}", "result", G_ERROR);
           }
           pthread_mutex_unlock(&config->module_lock);
@@ -1930,6 +1944,7 @@ json_t * is_plugin_module_valid(struct config_elements * config, json_t * j_modu
   int found;
   struct _plugin_module * module;
   char * parameters;
+  struct _pointer_list * module_list;
   
   if (j_module != NULL && json_is_object(j_module)) {
     if ((j_error_list = json_array()) != NULL) {
@@ -1947,8 +1962,9 @@ json_t * is_plugin_module_valid(struct config_elements * config, json_t * j_modu
         }
         if (json_object_get(j_module, "module") != NULL && json_is_string(json_object_get(j_module, "module")) && json_string_length(json_object_get(j_module, "module")) > 0 && json_string_length(json_object_get(j_module, "module")) <= 128) {
           found = 0;
-          for (i=0; i<pointer_list_size(config->plugin_module_list); i++) {
-            module = (struct _plugin_module *)pointer_list_get_at(config->plugin_module_list, i);
+          module_list = GLEWLWYD_MODULE_LIST_GET(config->plugin_module_list);
+          for (i=0; i<pointer_list_size(module_list); i++) {
+            module = (struct _plugin_module *)pointer_list_get_at(module_list, i);
             if (module != NULL) {
               if (0 == o_strcmp(module->name, json_string_value(json_object_get(j_module, "module")))) {
                 found = 1;
@@ -2002,6 +2018,7 @@ json_t * add_plugin_module(struct config_elements * config, json_t * j_module) {
   int res;
   size_t i;
   char * parameters = json_dumps(json_object_get(j_module, "parameters"), JSON_COMPACT);
+  struct _pointer_list * module_list;
   
   j_query = json_pack("{sss{sOsOsOsiss}}",
                       "table",
@@ -2021,8 +2038,9 @@ json_t * add_plugin_module(struct config_elements * config, json_t * j_module) {
   json_decref(j_query);
   if (res == H_OK) {
     module = NULL;
-    for (i=0; i<pointer_list_size(config->plugin_module_list); i++) {
-      module = (struct _plugin_module *)pointer_list_get_at(config->plugin_module_list, i);
+    module_list = GLEWLWYD_MODULE_LIST_GET(config->plugin_module_list);
+    for (i=0; i<pointer_list_size(module_list); i++) {
+      module = (struct _plugin_module *)pointer_list_get_at(module_list, i);
       if (0 == o_strcmp(module->name, json_string_value(json_object_get(j_module, "module")))) {
         break;
       } else {
@@ -2037,14 +2055,20 @@ json_t * add_plugin_module(struct config_elements * config, json_t * j_module) {
           cur_instance->name = o_strdup(json_string_value(json_object_get(j_module, "name")));
           cur_instance->module = module;
           cur_instance->enabled = 0;
-          if (pointer_list_append(config->plugin_module_instance_list, cur_instance)) {
+          cur_instance->endpoint_generation = glewlwyd_plugin_endpoint_new_generation(config);
+          if (append_module_instance(config, &config->plugin_module_instance_list, cur_instance) == G_OK) {
+            glewlwyd_plugin_endpoint_scope(cur_instance->endpoint_generation);
             j_result = module->plugin_module_init(config->config_p, cur_instance->name, json_object_get(j_module, "parameters"), &cur_instance->cls);
+            glewlwyd_plugin_endpoint_scope(0);
             if (check_result_value(j_result, G_OK)) {
-              cur_instance->enabled = 1;
+              __atomic_store_n(&cur_instance->enabled, 1, __ATOMIC_RELEASE);
+              glewlwyd_plugin_endpoint_publish(config, cur_instance->endpoint_generation);
               j_return = json_pack("{si}", "result", G_OK);
             } else if (check_result_value(j_result, G_ERROR_PARAM)) {
+              glewlwyd_plugin_endpoint_withdraw(config, cur_instance->endpoint_generation);
               j_return = json_pack("{sisO*}", "result", G_ERROR_PARAM, "error", json_object_get(j_result, "error"));
             } else {
+              glewlwyd_plugin_endpoint_withdraw(config, cur_instance->endpoint_generation);
               y_log_message(Y_LOG_LEVEL_ERROR, "add_plugin_module - Error init module %s/%s", module->name, json_string_value(json_object_get(j_module, "name")));
               j_return = json_pack("{si}", "result", G_ERROR);
             }
@@ -2115,9 +2139,8 @@ int delete_plugin_module(struct config_elements * config, const char * name) {
   if (check_result_value(j_result, G_OK)) {
     if (!pthread_mutex_lock(&config->module_lock)) {
       instance = get_plugin_module_instance(config, name);
-      if (pointer_list_remove_pointer(config->plugin_module_instance_list, instance)) {
-        o_free(instance->name);
-        o_free(instance);
+      if (remove_module_instance(config, &config->plugin_module_instance_list, instance) == G_OK) {
+        retire_plugin_module_instance(config, instance);
         j_query = json_pack("{sss{ss}}",
                             "table",
                             GLEWLWYD_TABLE_PLUGIN_MODULE_INSTANCE,
@@ -2134,7 +2157,7 @@ int delete_plugin_module(struct config_elements * config, const char * name) {
           ret = G_ERROR_DB;
         }
       } else {
-        y_log_message(Y_LOG_LEVEL_ERROR, "delete_plugin_module - Error pointer_list_remove_pointer");
+        y_log_message(Y_LOG_LEVEL_ERROR, "delete_plugin_module - Error remove_module_instance");
         ret = G_ERROR;
       }
       pthread_mutex_unlock(&config->module_lock);
@@ -2158,9 +2181,14 @@ json_t * manage_plugin_module(struct config_elements * config, const char * name
     if (action == GLEWLWYD_MODULE_ACTION_START) {
       if (!instance->enabled) {
         if (!pthread_mutex_lock(&config->module_lock)) {
+          // The retired generation of a stopped instance may still own its endpoints
+          instance->endpoint_generation = glewlwyd_plugin_endpoint_new_generation(config);
+          glewlwyd_plugin_endpoint_scope(instance->endpoint_generation);
           j_result = instance->module->plugin_module_init(config->config_p, instance->name, json_object_get(json_object_get(j_module, "module"), "parameters"), &instance->cls);
+          glewlwyd_plugin_endpoint_scope(0);
           if (check_result_value(j_result, G_OK)) {
-            instance->enabled = 1;
+            __atomic_store_n(&instance->enabled, 1, __ATOMIC_RELEASE);
+            glewlwyd_plugin_endpoint_publish(config, instance->endpoint_generation);
             json_object_set(json_object_get(j_module, "module"), "enabled", json_true());
             if (set_plugin_module(config, name, json_object_get(j_module, "module")) == G_OK) {
               j_return = json_pack("{si}", "result", G_OK);
@@ -2169,8 +2197,10 @@ json_t * manage_plugin_module(struct config_elements * config, const char * name
               j_return = json_pack("{si}", "result", G_ERROR);
             }
           } else if (check_result_value(j_result, G_ERROR_PARAM)) {
+            glewlwyd_plugin_endpoint_withdraw(config, instance->endpoint_generation);
             j_return = json_pack("{sisO}", "result", G_ERROR_PARAM, "error", json_object_get(j_result, "error"));
           } else {
+            glewlwyd_plugin_endpoint_withdraw(config, instance->endpoint_generation);
             y_log_message(Y_LOG_LEVEL_ERROR, "manage_plugin_module - Error init module %s/%s", instance->module->name, json_string_value(json_object_get(json_object_get(j_module, "module"), "name")));
             j_return = json_pack("{si}", "result", G_ERROR);
           }
@@ -2186,9 +2216,7 @@ json_t * manage_plugin_module(struct config_elements * config, const char * name
     } else if (action == GLEWLWYD_MODULE_ACTION_STOP) {
       if (instance->enabled) {
         if (!pthread_mutex_lock(&config->module_lock)) {
-          if (instance->module->plugin_module_close(config->config_p, instance->name, instance->cls) == G_OK) {
-            instance->enabled = 0;
-            instance->cls = NULL;
+          if (retire_plugin_module_instance_cls(config, instance) == G_OK) {
             json_object_set(json_object_get(j_module, "module"), "enabled", json_false());
             if (set_plugin_module(config, name, json_object_get(j_module, "module")) == G_OK) {
               j_return = json_pack("{si}", "result", G_OK);
@@ -2197,7 +2225,7 @@ json_t * manage_plugin_module(struct config_elements * config, const char * name
               j_return = json_pack("{si}", "result", G_ERROR);
             }
           } else {
-            y_log_message(Y_LOG_LEVEL_ERROR, "manage_plugin_module - Error close module %s/%s", instance->module->name, json_string_value(json_object_get(json_object_get(j_module, "module"), "name")));
+            y_log_message(Y_LOG_LEVEL_ERROR, "manage_plugin_module - Error retire module %s/%s", instance->module->name, json_string_value(json_object_get(json_object_get(j_module, "module"), "name")));
             j_return = json_pack("{si}", "result", G_ERROR);
           }
           pthread_mutex_unlock(&config->module_lock);
@@ -29,14 +29,210 @@
 #include <ctype.h>
 #include "glewlwyd.h"
 
+/**
+ * Instance generation of the plugin endpoints added or removed by the current thread
+ * A plugin declares and removes its endpoints in its init and close functions,
+ * which don't identify the instance, so the caller sets the generation around those calls
+ */
+static __thread unsigned int plugin_endpoint_scope = 0;
+
+static void release_plugin_endpoint_target(struct config_elements * config, void * data) {
+  UNUSED(config);
+  o_free(data);
+}
+
+static void free_plugin_endpoint(void * data) {
+  struct _plugin_endpoint * endpoint = (struct _plugin_endpoint *)data;
+
+  if (endpoint != NULL) {
+    o_free(endpoint->method);
+    o_free(endpoint->url);
+    o_free(endpoint->target);
+    o_free(endpoint->pending);
+    o_free(endpoint);
+  }
+}
+
+/**
+ * The epoch reference is taken before the target is read,
+ * so a replaced target and its instance are released after the request
+ */
+static int callback_glewlwyd_plugin_endpoint(const struct _u_request * request, struct _u_response * response, void * user_data) {
+  struct _plugin_endpoint * endpoint = (struct _plugin_endpoint *)user_data;
+  struct _plugin_endpoint_target * target;
+  struct _module_epoch_ref epoch;
+  int ret;
+
+  glewlwyd_module_epoch_enter(endpoint->config, &epoch);
+  if ((target = __atomic_load_n(&endpoint->target, __ATOMIC_ACQUIRE)) != NULL) {
+    ret = target->callback(request, response, target->user_data);
+  } else {
+    ret = U_CALLBACK_IGNORE;
+  }
+  glewlwyd_module_epoch_leave(endpoint->config, &epoch);
+  return ret;
+}
+
+/**
+ * Must be called with endpoint_lock held
+ */
+static struct _plugin_endpoint * get_plugin_endpoint(struct config_elements * config, const char * method, const char * url) {
+  struct _plugin_endpoint * endpoint;
+  size_t i;
+
+  for (i=0; i<pointer_list_size(&config->plugin_endpoint_list); i++) {
+    endpoint = (struct _plugin_endpoint *)pointer_list_get_at(&config->plugin_endpoint_list, i);
+    if (!endpoint->removed && 0 == o_strcasecmp(endpoint->method, method) && 0 == o_strcmp(endpoint->url, url)) {
+      return endpoint;
+    }
+  }
+  return NULL;
+}
+
+void glewlwyd_plugin_endpoint_scope(unsigned int generation) {
+  plugin_endpoint_scope = generation;
+}
+
+unsigned int glewlwyd_plugin_endpoint_new_generation(struct config_elements * config) {
+  return __atomic_add_fetch(&config->plugin_endpoint_generation, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Publishes the endpoints declared by an instance generation once the instance is ready
+ */
+void glewlwyd_plugin_endpoint_publish(struct config_elements * config, unsigned int generation) {
+  struct _plugin_endpoint * endpoint;
+  struct _pointer_list retired_list;
+  size_t i;
+
+  pointer_list_init(&retired_list);
+  pthread_mutex_lock(&config->endpoint_lock);
+  for (i=0; i<pointer_list_size(&config->plugin_endpoint_list); i++) {
+    endpoint = (struct _plugin_endpoint *)pointer_list_get_at(&config->plugin_endpoint_list, i);
+    if (!endpoint->removed && endpoint->pending != NULL && endpoint->pending_generation == generation) {
+      if (endpoint->target != NULL) {
+        pointer_list_append(&retired_list, endpoint->target);
+      }
+      __atomic_store_n(&endpoint->target, endpoint->pending, __ATOMIC_RELEASE);
+      endpoint->generation = generation;
+      endpoint->pending = NULL;
+      endpoint->pending_generation = 0;
+    }
+  }
+  pthread_mutex_unlock(&config->endpoint_lock);
+  for (i=0; i<pointer_list_size(&retired_list); i++) {
+    if (retire_module_data(config, &release_plugin_endpoint_target, pointer_list_get_at(&retired_list, i)) != G_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_plugin_endpoint_publish - Error retire_module_data");
+    }
+  }
+  pointer_list_clean(&retired_list);
+}
+
+/**
+ * Stops dispatching requests to an instance generation that was stopped, replaced or failed to initialize
+ * The endpoints stay declared until the instance is closed, or another generation takes them over
+ */
+void glewlwyd_plugin_endpoint_withdraw(struct config_elements * config, unsigned int generation) {
+  struct _plugin_endpoint * endpoint;
+  struct _pointer_list retired_list;
+  size_t i;
+
+  pointer_list_init(&retired_list);
+  pthread_mutex_lock(&config->endpoint_lock);
+  for (i=0; i<pointer_list_size(&config->plugin_endpoint_list); i++) {
+    endpoint = (struct _plugin_endpoint *)pointer_list_get_at(&config->plugin_endpoint_list, i);
+    if (!endpoint->removed) {
+      if (endpoint->generation == generation && endpoint->target != NULL) {
+        pointer_list_append(&retired_list, endpoint->target);
+        __atomic_store_n(&endpoint->target, NULL, __ATOMIC_RELEASE);
+      }
+      if (endpoint->pending_generation == generation) {
+        o_free(endpoint->pending);
+        endpoint->pending = NULL;
+        endpoint->pending_generation = 0;
+      }
+    }
+  }
+  pthread_mutex_unlock(&config->endpoint_lock);
+  for (i=0; i<pointer_list_size(&retired_list); i++) {
+    if (retire_module_data(config, &release_plugin_endpoint_target, pointer_list_get_at(&retired_list, i)) != G_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_plugin_endpoint_withdraw - Error retire_module_data");
+    }
+  }
+  pointer_list_clean(&retired_list);
+}
+
+/**
+ * Must be called once the webservice is stopped
+ */
+void glewlwyd_plugin_endpoint_close(struct config_elements * config) {
+  pointer_list_clean_free(&config->plugin_endpoint_list, &free_plugin_endpoint);
+}
+
 int glewlwyd_callback_add_plugin_endpoint(struct config_plugin * config, const char * method, const char * name, const char * url, unsigned int priority, int (* callback)(const struct _u_request * request, struct _u_response * response, void * user_data), void * user_data) {
   int ret;
   char * p_url;
+  struct _plugin_endpoint * endpoint;
+  struct _plugin_endpoint_target * target, * replaced = NULL;
 
   if (config != NULL && config->glewlwyd_config != NULL && config->glewlwyd_config->instance != NULL && method != NULL && name != NULL && url != NULL && callback != NULL && 0 != o_strncasecmp(name, "auth", o_strlen("auth"))) {
     p_url = msprintf("%s/%s", name, url);
-    if (p_url != NULL) {
-      if ((ret = ulfius_add_endpoint_by_val(config->glewlwyd_config->instance, method, config->glewlwyd_config->api_prefix, p_url, GLEWLWYD_CALLBACK_PRIORITY_PLUGIN + priority, callback, user_data)) != U_OK) {
+    if (p_url != NULL && (target = o_malloc(sizeof(struct _plugin_endpoint_target))) != NULL) {
+      // Plugin instances may be initialized in parallel
+      pthread_mutex_lock(&config->glewlwyd_config->endpoint_lock);
+      // The rate limit is checked before waiting for an admission slot
+      if (glewlwyd_admission_wrap_callback(config->glewlwyd_config, glewlwyd_admission_get_plugin_class(url), &callback, &user_data) == G_OK &&
+          glewlwyd_rate_limit_wrap_callback(config->glewlwyd_config, p_url, &callback, &user_data) == G_OK) {
+        target->callback = callback;
+        target->user_data = user_data;
+        if ((endpoint = get_plugin_endpoint(config->glewlwyd_config, method, p_url)) != NULL) {
+          if (plugin_endpoint_scope) {
+            // The endpoint is taken over when the instance is published
+            o_free(endpoint->pending);
+            endpoint->pending = target;
+            endpoint->pending_generation = plugin_endpoint_scope;
+          } else {
+            replaced = endpoint->target;
+            __atomic_store_n(&endpoint->target, target, __ATOMIC_RELEASE);
+          }
+          ret = U_OK;
+        } else if ((endpoint = o_malloc(sizeof(struct _plugin_endpoint))) != NULL) {
+          endpoint->config = config->glewlwyd_config;
+          endpoint->method = o_strdup(method);
+          endpoint->url = o_strdup(p_url);
+          endpoint->removed = 0;
+          endpoint->generation = plugin_endpoint_scope;
+          if (plugin_endpoint_scope) {
+            endpoint->target = NULL;
+            endpoint->pending = target;
+            endpoint->pending_generation = plugin_endpoint_scope;
+          } else {
+            endpoint->target = target;
+            endpoint->pending = NULL;
+            endpoint->pending_generation = 0;
+          }
+          if (pointer_list_append(&config->glewlwyd_config->plugin_endpoint_list, endpoint)) {
+            if ((ret = ulfius_add_endpoint_by_val(config->glewlwyd_config->instance, method, config->glewlwyd_config->api_prefix, p_url, GLEWLWYD_CALLBACK_PRIORITY_PLUGIN + priority, &callback_glewlwyd_plugin_endpoint, endpoint)) != U_OK) {
+              // The endpoint is kept in the list but not used anymore
+              endpoint->removed = 1;
+            }
+          } else {
+            free_plugin_endpoint(endpoint);
+            ret = U_ERROR_MEMORY;
+          }
+        } else {
+          o_free(target);
+          ret = U_ERROR_MEMORY;
+        }
+      } else {
+        o_free(target);
+        ret = U_ERROR_MEMORY;
+      }
+      pthread_mutex_unlock(&config->glewlwyd_config->endpoint_lock);
+      if (replaced != NULL && retire_module_data(config->glewlwyd_config, &release_plugin_endpoint_target, replaced) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_callback_add_plugin_endpoint - Error retire_module_data");
+      }
+      if (ret != U_OK) {
         y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_callback_add_plugin_endpoint - Error %d ulfius_add_endpoint_by_val %s - %s/%s",ret, method, config->glewlwyd_config->api_prefix, p_url);
         ret = G_ERROR;
       } else {
@@ -46,6 +242,7 @@ int glewlwyd_callback_add_plugin_endpoint(struct config_plugin * config, const c
       o_free(p_url);
     } else {
       y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_callback_add_plugin_endpoint - Error allocating resources for p_url");
+      o_free(p_url);
       ret = G_ERROR_MEMORY;
     }
   } else {
@@ -55,14 +252,44 @@ int glewlwyd_callback_add_plugin_endpoint(struct config_plugin * config, const c
   return ret;
 }
 
+/**
+ * An instance only removes the endpoints it owns,
+ * the endpoints taken over by a newer generation of the instance stay declared
+ */
 int glewlwyd_callback_remove_plugin_endpoint(struct config_plugin * config, const char * method, const char * name, const char * url) {
   int ret;
   char * p_url;
+  struct _plugin_endpoint * endpoint;
+  struct _plugin_endpoint_target * replaced = NULL;
 
   if (config != NULL && config->glewlwyd_config != NULL && config->glewlwyd_config->instance != NULL && method != NULL && name != NULL && url != NULL) {
     p_url = msprintf("%s/%s", name, url);
     if (p_url != NULL) {
-      if ((ret = ulfius_remove_endpoint_by_val(config->glewlwyd_config->instance, method, config->glewlwyd_config->api_prefix, p_url)) != U_OK) {
+      pthread_mutex_lock(&config->glewlwyd_config->endpoint_lock);
+      if ((endpoint = get_plugin_endpoint(config->glewlwyd_config, method, p_url)) == NULL) {
+        ret = U_ERROR_NOT_FOUND;
+      } else if (plugin_endpoint_scope && endpoint->pending_generation == plugin_endpoint_scope) {
+        o_free(endpoint->pending);
+        endpoint->pending = NULL;
+        endpoint->pending_generation = 0;
+        ret = U_OK;
+      } else if (plugin_endpoint_scope && endpoint->generation != plugin_endpoint_scope) {
+        ret = U_OK;
+      } else if (endpoint->pending != NULL) {
+        // Another generation will take over the endpoint
+        replaced = endpoint->target;
+        __atomic_store_n(&endpoint->target, NULL, __ATOMIC_RELEASE);
+        ret = U_OK;
+      } else if ((ret = ulfius_remove_endpoint_by_val(config->glewlwyd_config->instance, method, config->glewlwyd_config->api_prefix, p_url)) == U_OK) {
+        replaced = endpoint->target;
+        __atomic_store_n(&endpoint->target, NULL, __ATOMIC_RELEASE);
+        endpoint->removed = 1;
+      }
+      pthread_mutex_unlock(&config->glewlwyd_config->endpoint_lock);
+      if (replaced != NULL && retire_module_data(config->glewlwyd_config, &release_plugin_endpoint_target, replaced) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_callback_remove_plugin_endpoint - Error retire_module_data");
+      }
+      if (ret != U_OK) {
         y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_callback_remove_plugin_endpoint - Error %d ulfius_remove_endpoint_by_val %s - %s/%s", ret, method, config->glewlwyd_config->api_prefix, p_url);
         ret = G_ERROR;
       } else {
@@ -229,16 +456,19 @@ json_t * glewlwyd_callback_check_client_valid(struct config_plugin * config, con
 }
 
 json_t * glewlwyd_callback_get_client_granted_scopes(struct config_plugin * config, const char * client_id, const char * username, const char * scope_list) {
-  json_t * j_user = get_user(config->glewlwyd_config, username, NULL), * j_grant = NULL;
-  if (check_result_value(j_user, G_OK)) {
-    j_grant = get_granted_scopes_for_client(config->glewlwyd_config, json_object_get(j_user, "user"), client_id, scope_list);
-  } else if (check_result_value(j_user, G_ERROR_NOT_FOUND)){
+  const struct _glewlwyd_user_view * view = NULL;
+  json_t * j_grant = NULL;
+  int res = get_user_view(config->glewlwyd_config, username, &view);
+
+  if (res == G_OK) {
+    j_grant = get_granted_scopes_for_client(config->glewlwyd_config, view->j_user, client_id, scope_list);
+    release_user_view(view);
+  } else if (res == G_ERROR_NOT_FOUND) {
     j_grant = json_pack("{si}", "result", G_ERROR_NOT_FOUND);
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_callback_get_client_granted_scopes - Error get_user");
+    y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_callback_get_client_granted_scopes - Error get_user_view");
     j_grant = json_pack("{si}", "result", G_ERROR);
   }
-  json_decref(j_user);
   return j_grant;
 }
 
@@ -474,6 +704,15 @@ json_t * glewlwyd_plugin_callback_get_user_profile(struct config_plugin * config
   return get_user_profile(config->glewlwyd_config, username, NULL);
 }
 
+int glewlwyd_plugin_callback_get_user_view(struct config_plugin * config, const char * username, const struct _glewlwyd_user_view ** view) {
+  return get_user_view(config->glewlwyd_config, username, view);
+}
+
+void glewlwyd_plugin_callback_release_user_view(struct config_plugin * config, const struct _glewlwyd_user_view * view) {
+  UNUSED(config);
+  release_user_view(view);
+}
+
 json_t * glewlwyd_plugin_callback_is_user_valid(struct config_plugin * config, const char * username, json_t * j_user, int add) {
   json_t * j_cur_user, * j_return;
   
@@ -592,6 +831,7 @@ json_t * glewlwyd_plugin_callback_scheme_register(struct config_plugin * config,
   struct _user_auth_scheme_module_instance * scheme_instance = get_user_auth_scheme_module_instance(config->glewlwyd_config, mod_name);
   if (scheme_instance != NULL && scheme_instance->enabled) {
     j_return = scheme_instance->module->user_auth_scheme_module_register(config->glewlwyd_config->config_m, http_request, username, j_scheme_data, scheme_instance->cls);
+    invalidate_scheme_can_use_cache(config->glewlwyd_config, username, mod_name);
   } else {
     j_return = json_pack("{si}", "result", G_ERROR_PARAM);
   }
@@ -613,7 +853,7 @@ int glewlwyd_plugin_callback_scheme_can_use(struct config_plugin * config, const
   int ret;
   struct _user_auth_scheme_module_instance * scheme_instance = get_user_auth_scheme_module_instance(config->glewlwyd_config, mod_name);
   if (scheme_instance != NULL && scheme_instance->enabled) {
-    ret = scheme_instance->module->user_auth_scheme_module_can_use(config->glewlwyd_config->config_m, username, scheme_instance->cls);
+    ret = get_scheme_can_use(config->glewlwyd_config, scheme_instance, username);
   } else {
     ret = G_ERROR_PARAM;
   }
@@ -625,6 +865,7 @@ int glewlwyd_plugin_callback_scheme_deregister(struct config_plugin * config, co
   struct _user_auth_scheme_module_instance * scheme_instance = get_user_auth_scheme_module_instance(config->glewlwyd_config, mod_name);
   if (scheme_instance != NULL && scheme_instance->enabled) {
     ret = scheme_instance->module->user_auth_scheme_module_deregister(config->glewlwyd_config->config_m, username, scheme_instance->cls);
+    invalidate_scheme_can_use_cache(config->glewlwyd_config, username, mod_name);
   } else {
     ret = G_ERROR_PARAM;
   }
@@ -657,3 +898,29 @@ int glewlwyd_plugin_callback_metrics_increment_counter(struct config_plugin * co
   }
   return ret;
 }
+
+int glewlwyd_plugin_callback_cache_invalidation_register(struct config_plugin * config, const char * cache, glewlwyd_cache_invalidation_callback callback, void * cls) {
+  return glewlwyd_cache_invalidation_register(config->glewlwyd_config, cache, callback, cls);
+}
+
+int glewlwyd_plugin_callback_cache_invalidation_unregister(struct config_plugin * config, const char * cache, void * cls) {
+  return glewlwyd_cache_invalidation_unregister(config->glewlwyd_config, cache, cls);
+}
+
+int glewlwyd_plugin_callback_cache_invalidation_publish(struct config_plugin * config, const char * cache, const char * key) {
+  return glewlwyd_cache_invalidation_publish(config->glewlwyd_config, cache, key);
+}
+
+int glewlwyd_plugin_callback_http_send_request(struct config_plugin * config, const struct _u_request * request, struct _u_response * response) {
+  return glewlwyd_http_client_send_request(config->glewlwyd_config, request, response);
+}
+
+void glewlwyd_plugin_callback_admission_suspend(struct config_plugin * config) {
+  UNUSED(config);
+  glewlwyd_admission_suspend();
+}
+
+void glewlwyd_plugin_callback_admission_resume(struct config_plugin * config) {
+  UNUSED(config);
+  glewlwyd_admission_resume();
+}
@@ -81,6 +81,26 @@
 #define GLEWLWYD_DEVICE_AUTH_DEVICE_CODE_LENGTH 32
 #define GLEWLWYD_DEVICE_AUTH_USER_CODE_LENGTH   8
 
+#define GLEWLWYD_DEVICE_PENDING_BUCKETS         64
+#define GLEWLWYD_DEVICE_PENDING_BUCKET_MAX_SIZE 256
+#define GLEWLWYD_CACHE_OAUTH2_DEVICE_PENDING    "oauth2_device_pending"
+#define GLEWLWYD_DEVICE_PENDING_CHECK_INTERVAL  10
+
+/**
+ * Device authorization still waiting for the user
+ * Polls on a pending device code are answered from this entry without reading the database
+ * The device code is read again in the database GLEWLWYD_DEVICE_PENDING_CHECK_INTERVAL seconds after checked_at,
+ * in case an invalidation was missed
+ */
+struct _oauth2_device_pending {
+  json_int_t   id;
+  char       * code;
+  char       * client_id;
+  time_t       expires_at;
+  time_t       last_check;
+  time_t       checked_at;
+};
+
 struct _oauth2_config {
   struct config_plugin             * glewlwyd_config;
   jwt_t                            * jwt_key;
@@ -92,6 +112,10 @@ struct _oauth2_config {
   unsigned short int                 refresh_token_rolling;
   unsigned short int                 auth_type_enabled[5];
   pthread_mutex_t                    insert_lock;
+  unsigned short int                 device_pending_enabled;
+  struct _pointer_list               device_pending_list[GLEWLWYD_DEVICE_PENDING_BUCKETS];
+  pthread_mutex_t                    device_pending_lock;
+  unsigned int                       device_pending_generation;
   struct _glewlwyd_resource_config * glewlwyd_resource_config;
   struct _glewlwyd_resource_config * introspect_revoke_resource_config;
 };
@@ -1406,7 +1430,7 @@ static json_t * refresh_token_list_get(struct _oauth2_config * config, const cha
     o_free(pattern_escaped);
     o_free(name_escaped);
   }
-  res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result, NULL);
+  res = select_read(config->glewlwyd_config->glewlwyd_config, j_query, &j_result, GLEWLWYD_DB_READ_REPLICA);
   json_decref(j_query);
   if (res == H_OK) {
     json_array_foreach(j_result, index, j_element) {
@@ -1732,7 +1756,7 @@ static json_t * get_token_metadata(struct _oauth2_config * config, const char *
       if (client_id != NULL) {
         json_object_set_new(json_object_get(j_query, "where"), "gpgr_client_id", json_string(client_id));
       }
-      res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result, NULL);
+      res = select_read(config->glewlwyd_config->glewlwyd_config, j_query, &j_result, GLEWLWYD_DB_READ_PRIMARY);
       json_decref(j_query);
       if (res == H_OK) {
         if (json_array_size(j_result)) {
@@ -1755,7 +1779,7 @@ static json_t * get_token_metadata(struct _oauth2_config * config, const char *
                                 "where",
                                   "gpgr_id",
                                   json_object_get(json_array_get(j_result, 0), "gpgr_id"));
-            res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result_scope, NULL);
+            res = select_read(config->glewlwyd_config->glewlwyd_config, j_query, &j_result_scope, GLEWLWYD_DB_READ_PRIMARY);
             json_decref(j_query);
             if (res == H_OK) {
               json_array_foreach(j_result_scope, index, j_element) {
@@ -1805,7 +1829,7 @@ static json_t * get_token_metadata(struct _oauth2_config * config, const char *
       if (client_id != NULL) {
         json_object_set_new(json_object_get(j_query, "where"), "gpga_client_id", json_string(client_id));
       }
-      res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result, NULL);
+      res = select_read(config->glewlwyd_config->glewlwyd_config, j_query, &j_result, GLEWLWYD_DB_READ_PRIMARY);
       json_decref(j_query);
       if (res == H_OK) {
         if (json_array_size(j_result)) {
@@ -1829,7 +1853,7 @@ static json_t * get_token_metadata(struct _oauth2_config * config, const char *
                                 "where",
                                   "gpga_id",
                                   json_object_get(json_array_get(j_result, 0), "gpga_id"));
-            res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result_scope, NULL);
+            res = select_read(config->glewlwyd_config->glewlwyd_config, j_query, &j_result_scope, GLEWLWYD_DB_READ_PRIMARY);
             json_decref(j_query);
             if (res == H_OK) {
               json_array_foreach(j_result_scope, index, j_element) {
@@ -1881,6 +1905,157 @@ static const char * get_client_id_for_introspection(struct _oauth2_config * conf
   }
 }
 
+static void free_device_pending(void * data) {
+  struct _oauth2_device_pending * device_pending = (struct _oauth2_device_pending *)data;
+
+  if (device_pending != NULL) {
+    o_free(device_pending->code);
+    o_free(device_pending->client_id);
+    o_free(device_pending);
+  }
+}
+
+static size_t get_device_pending_bucket(const char * code) {
+  size_t hash = 5381;
+
+  for (; code != NULL && *code != '\0'; code++) {
+    hash = ((hash << 5) + hash) + (unsigned char)*code;
+  }
+  return hash%GLEWLWYD_DEVICE_PENDING_BUCKETS;
+}
+
+static unsigned int get_device_pending_generation(struct _oauth2_config * config) {
+  unsigned int generation = 0;
+
+  if (!pthread_mutex_lock(&config->device_pending_lock)) {
+    generation = config->device_pending_generation;
+    pthread_mutex_unlock(&config->device_pending_lock);
+  }
+  return generation;
+}
+
+/**
+ * Looks for a pending device code, on success last_check is set to the previous poll time
+ * An expired entry, or an entry checked more than GLEWLWYD_DEVICE_PENDING_CHECK_INTERVAL seconds ago,
+ * is removed so the database gives the answer
+ */
+static int get_device_pending(struct _oauth2_config * config, const char * code, const char * client_id, time_t now, time_t * last_check) {
+  struct _pointer_list * bucket = &config->device_pending_list[get_device_pending_bucket(code)];
+  struct _oauth2_device_pending * device_pending;
+  size_t i;
+  int ret = G_ERROR_NOT_FOUND;
+
+  if (!config->device_pending_enabled) {
+    ret = G_ERROR_NOT_FOUND;
+  } else if (!pthread_mutex_lock(&config->device_pending_lock)) {
+    for (i=0; i<pointer_list_size(bucket); i++) {
+      device_pending = (struct _oauth2_device_pending *)pointer_list_get_at(bucket, i);
+      if (0 == o_strcmp(device_pending->code, code)) {
+        if (device_pending->expires_at < now || device_pending->checked_at + GLEWLWYD_DEVICE_PENDING_CHECK_INTERVAL <= now) {
+          pointer_list_remove_at(bucket, i);
+          free_device_pending(device_pending);
+        } else if (0 == o_strcmp(device_pending->client_id, client_id)) {
+          *last_check = device_pending->last_check;
+          device_pending->last_check = now;
+          ret = G_OK;
+        }
+        break;
+      }
+    }
+    pthread_mutex_unlock(&config->device_pending_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "get_device_pending - Error pthread_mutex_lock");
+    ret = G_ERROR;
+  }
+  return ret;
+}
+
+/**
+ * Adds a device code read as pending in the database,
+ * unless a device code was approved since generation was read
+ * last_check is the time the device code was read in the database
+ */
+static void set_device_pending(struct _oauth2_config * config, const char * code, json_int_t id, const char * client_id, time_t expires_at, time_t last_check, unsigned int generation) {
+  struct _pointer_list * bucket = &config->device_pending_list[get_device_pending_bucket(code)];
+  struct _oauth2_device_pending * device_pending;
+  size_t i;
+
+  if (config->device_pending_enabled && !pthread_mutex_lock(&config->device_pending_lock)) {
+    if (generation == config->device_pending_generation) {
+      for (i=0; i<pointer_list_size(bucket); i++) {
+        device_pending = (struct _oauth2_device_pending *)pointer_list_get_at(bucket, i);
+        if (0 == o_strcmp(device_pending->code, code)) {
+          pointer_list_remove_at(bucket, i);
+          free_device_pending(device_pending);
+          break;
+        }
+      }
+      if (pointer_list_size(bucket) >= GLEWLWYD_DEVICE_PENDING_BUCKET_MAX_SIZE) {
+        device_pending = (struct _oauth2_device_pending *)pointer_list_get_at(bucket, 0);
+        pointer_list_remove_at(bucket, 0);
+        free_device_pending(device_pending);
+      }
+      if ((device_pending = o_malloc(sizeof(struct _oauth2_device_pending))) != NULL) {
+        device_pending->id = id;
+        device_pending->code = o_strdup(code);
+        device_pending->client_id = o_strdup(client_id);
+        device_pending->expires_at = expires_at;
+        device_pending->last_check = last_check;
+        device_pending->checked_at = last_check;
+        if (!pointer_list_append(bucket, device_pending)) {
+          y_log_message(Y_LOG_LEVEL_ERROR, "set_device_pending - Error pointer_list_append");
+          free_device_pending(device_pending);
+        }
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "set_device_pending - Error allocating resources for device_pending");
+      }
+    }
+    pthread_mutex_unlock(&config->device_pending_lock);
+  } else if (config->device_pending_enabled) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "set_device_pending - Error pthread_mutex_lock");
+  }
+}
+
+static void remove_device_pending(struct _oauth2_config * config, json_int_t id) {
+  struct _oauth2_device_pending * device_pending;
+  size_t i, j;
+  int found = 0;
+
+  if (!pthread_mutex_lock(&config->device_pending_lock)) {
+    config->device_pending_generation++;
+    for (i=0; i<GLEWLWYD_DEVICE_PENDING_BUCKETS && !found; i++) {
+      for (j=0; j<pointer_list_size(&config->device_pending_list[i]); j++) {
+        device_pending = (struct _oauth2_device_pending *)pointer_list_get_at(&config->device_pending_list[i], j);
+        if (device_pending->id == id) {
+          pointer_list_remove_at(&config->device_pending_list[i], j);
+          free_device_pending(device_pending);
+          found = 1;
+          break;
+        }
+      }
+    }
+    pthread_mutex_unlock(&config->device_pending_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "remove_device_pending - Error pthread_mutex_lock");
+  }
+}
+
+static void device_pending_invalidation_callback(const char * cache, const char * key, void * cls) {
+  struct _oauth2_config * config = (struct _oauth2_config *)cls;
+  size_t i;
+
+  UNUSED(cache);
+  if (key != NULL) {
+    remove_device_pending(config, (json_int_t)strtoll(key, NULL, 10));
+  } else if (!pthread_mutex_lock(&config->device_pending_lock)) {
+    config->device_pending_generation++;
+    for (i=0; i<GLEWLWYD_DEVICE_PENDING_BUCKETS; i++) {
+      pointer_list_clean_free(&config->device_pending_list[i], &free_device_pending);
+    }
+    pthread_mutex_unlock(&config->device_pending_lock);
+  }
+}
+
 static json_t * generate_device_authorization(struct _oauth2_config * config, const char * client_id, const char * scope_list, const char * ip_source) {
   char device_code[GLEWLWYD_DEVICE_AUTH_DEVICE_CODE_LENGTH+1] = {0}, user_code[GLEWLWYD_DEVICE_AUTH_USER_CODE_LENGTH+2] = {0}, * device_code_hash = NULL, * user_code_hash = NULL;
   json_t * j_return, * j_query, * j_device_auth_id;
@@ -1977,7 +2152,7 @@ static json_t * generate_device_authorization(struct _oauth2_config * config, co
 }
 
 static int validate_device_authorization_scope(struct _oauth2_config * config, json_int_t gpgda_id, const char * username, const char * scope_list) {
-  char * query, * scope_clause = NULL, * scope_escaped, ** scope_array = NULL, * username_escaped;
+  char * query, * scope_clause = NULL, * scope_escaped, ** scope_array = NULL, * username_escaped, * key;
   int res, i, ret;
   
   if (split_string(scope_list, " ", &scope_array)) {
@@ -2003,6 +2178,10 @@ static int validate_device_authorization_scope(struct _oauth2_config * config, j
       o_free(username_escaped);
       o_free(query);
       if (res == H_OK) {
+        remove_device_pending(config, gpgda_id);
+        key = msprintf("%"JSON_INTEGER_FORMAT, gpgda_id);
+        config->glewlwyd_config->glewlwyd_plugin_callback_cache_invalidation_publish(config->glewlwyd_config, GLEWLWYD_CACHE_OAUTH2_DEVICE_PENDING, key);
+        o_free(key);
         ret = G_OK;
       } else {
         y_log_message(Y_LOG_LEVEL_ERROR, "validate_device_authorization_scope - Error executing query (2)");
@@ -2118,7 +2297,8 @@ static int check_auth_type_device_code(const struct _u_request * request, struct
              * username = NULL;
   int res;
   char * device_code_hash, * refresh_token, * access_token, * scope = NULL, * issued_for = get_client_hostname(request);
-  time_t now;
+  time_t now, last_check = 0;
+  unsigned int generation;
   size_t index = 0;
   
   if (client_id == NULL && u_map_get(request->map_post_body, "client_id") != NULL) {
@@ -2131,206 +2311,229 @@ static int check_auth_type_device_code(const struct _u_request * request, struct
     j_client = check_client_valid(config, client_id, client_id, client_secret, NULL, GLEWLWYD_AUTHORIZATION_TYPE_DEVICE_AUTHORIZATION, 0, ip_source);
     if (check_result_value(j_client, G_OK)) {
       device_code_hash = config->glewlwyd_config->glewlwyd_callback_generate_hash(config->glewlwyd_config, device_code);
-      j_query = json_pack("{sss[sssss]s{sssOs{ssss}}}",
-                          "table",
-                          GLEWLWYD_PLUGIN_OAUTH2_TABLE_DEVICE_AUTHORIZATION,
-                          "columns",
-                            "gpgda_id",
-                            "gpgda_username AS username",
-                            "gpgda_status",
-                            SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "UNIX_TIMESTAMP(gpgda_expires_at) AS expires_at", "gpgda_expires_at AS expires_at", "EXTRACT(EPOCH FROM gpgda_expires_at)::integer AS expires_at"),
-                            SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "UNIX_TIMESTAMP(gpgda_last_check) AS last_check", "gpgda_last_check AS last_check", "EXTRACT(EPOCH FROM gpgda_last_check)::integer AS last_check"),
-                          "where",
-                            "gpgda_device_code_hash",
-                            device_code_hash,
-                            "gpgda_client_id",
-                            json_object_get(json_object_get(j_client, "client"), "client_id"),
-                            "gpgda_status",
-                              "operator",
-                              "raw",
-                              "value",
-                              "<= 1");
-      o_free(device_code_hash);
-      res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result, NULL);
-      json_decref(j_query);
-      if (res == H_OK) {
-        if (json_array_size(j_result)) {
-          time(&now);
-          if (json_integer_value(json_object_get(json_array_get(j_result, 0), "expires_at")) >= (json_int_t)now) {
-            if (json_integer_value(json_object_get(json_array_get(j_result, 0), "gpgda_status")) == 1) {
-              j_query = json_pack("{sss[s]s{sOsi}}",
-                                  "table",
-                                  GLEWLWYD_PLUGIN_OAUTH2_TABLE_DEVICE_AUTHORIZATION_SCOPE,
-                                  "columns",
-                                    "gpgdas_scope",
-                                  "where",
-                                    "gpgda_id",
-                                    json_object_get(json_array_get(j_result, 0), "gpgda_id"),
-                                    "gpgdas_allowed",
-                                    1);
-              res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result_scope, NULL);
-              json_decref(j_query);
-              if (res == H_OK) {
-                json_array_foreach(j_result_scope, index, j_element) {
-                  if (scope == NULL) {
-                    scope = o_strdup(json_string_value(json_object_get(j_element, "gpgdas_scope")));
-                  } else {
-                    scope = mstrcatf(scope, " %s", json_string_value(json_object_get(j_element, "gpgdas_scope")));
+      time(&now);
+      if (get_device_pending(config, device_code_hash, json_string_value(json_object_get(json_object_get(j_client, "client"), "client_id")), now, &last_check) == G_OK) {
+        if ((json_int_t)(now - last_check) >= json_integer_value(json_object_get(config->j_params, "device-authorization-interval"))) {
+          // Wait for it!
+          j_body = json_pack("{ss}", "error", "authorization_pending");
+          ulfius_set_json_body_response(response, 400, j_body);
+          json_decref(j_body);
+        } else {
+          // Slow down dammit!
+          j_body = json_pack("{ss}", "error", "slow_down");
+          ulfius_set_json_body_response(response, 400, j_body);
+          json_decref(j_body);
+        }
+      } else {
+        generation = get_device_pending_generation(config);
+        j_query = json_pack("{sss[sssss]s{sssOs{ssss}}}",
+                            "table",
+                            GLEWLWYD_PLUGIN_OAUTH2_TABLE_DEVICE_AUTHORIZATION,
+                            "columns",
+                              "gpgda_id",
+                              "gpgda_username AS username",
+                              "gpgda_status",
+                              SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "UNIX_TIMESTAMP(gpgda_expires_at) AS expires_at", "gpgda_expires_at AS expires_at", "EXTRACT(EPOCH FROM gpgda_expires_at)::integer AS expires_at"),
+                              SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "UNIX_TIMESTAMP(gpgda_last_check) AS last_check", "gpgda_last_check AS last_check", "EXTRACT(EPOCH FROM gpgda_last_check)::integer AS last_check"),
+                            "where",
+                              "gpgda_device_code_hash",
+                              device_code_hash,
+                              "gpgda_client_id",
+                              json_object_get(json_object_get(j_client, "client"), "client_id"),
+                              "gpgda_status",
+                                "operator",
+                                "raw",
+                                "value",
+                                "<= 1");
+        res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result, NULL);
+        json_decref(j_query);
+        if (res == H_OK) {
+          if (json_array_size(j_result)) {
+            time(&now);
+            if (json_integer_value(json_object_get(json_array_get(j_result, 0), "expires_at")) >= (json_int_t)now) {
+              if (json_integer_value(json_object_get(json_array_get(j_result, 0), "gpgda_status")) == 1) {
+                j_query = json_pack("{sss[s]s{sOsi}}",
+                                    "table",
+                                    GLEWLWYD_PLUGIN_OAUTH2_TABLE_DEVICE_AUTHORIZATION_SCOPE,
+                                    "columns",
+                                      "gpgdas_scope",
+                                    "where",
+                                      "gpgda_id",
+                                      json_object_get(json_array_get(j_result, 0), "gpgda_id"),
+                                      "gpgdas_allowed",
+                                      1);
+                res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result_scope, NULL);
+                json_decref(j_query);
+                if (res == H_OK) {
+                  json_array_foreach(j_result_scope, index, j_element) {
+                    if (scope == NULL) {
+                      scope = o_strdup(json_string_value(json_object_get(j_element, "gpgdas_scope")));
+                    } else {
+                      scope = mstrcatf(scope, " %s", json_string_value(json_object_get(j_element, "gpgdas_scope")));
+                    }
                   }
-                }
-                // All clear, please send back tokens
-                username = json_string_value(json_object_get(json_array_get(j_result, 0), "username"));
-                j_user = config->glewlwyd_config->glewlwyd_plugin_callback_get_user(config->glewlwyd_config, username);
-                if (check_result_value(j_user, G_OK)) {
-                  time(&now);
-                  if ((refresh_token = generate_refresh_token(config, client_id, username, json_string_value(json_object_get(json_object_get(j_user, "user"), "scope_list")), now, ip_source)) != NULL) {
-                    j_refresh_token = serialize_refresh_token(config, GLEWLWYD_AUTHORIZATION_TYPE_DEVICE_AUTHORIZATION, 0, username, client_id, scope, now, config->refresh_token_duration, config->refresh_token_rolling, refresh_token, issued_for, u_map_get_case(request->map_header, "user-agent"));
-                    if (check_result_value(j_refresh_token, G_OK)) {
-                      j_user_only = config->glewlwyd_config->glewlwyd_plugin_callback_get_user(config->glewlwyd_config, username);
-                      if (check_result_value(j_user_only, G_OK)) {
-                        if ((access_token = generate_access_token(config, 
-                                                                  username, 
-                                                                  client_id,
-                                                                  json_object_get(j_user_only, "user"), 
-                                                                  json_string_value(json_object_get(json_object_get(j_user, "user"), "scope_list")), 
-                                                                  now,
-                                                                  ip_source)) != NULL) {
-                          if (serialize_access_token(config, GLEWLWYD_AUTHORIZATION_TYPE_DEVICE_AUTHORIZATION, json_integer_value(json_object_get(j_refresh_token, "gpgr_id")), username, client_id, scope, now, issued_for, u_map_get_case(request->map_header, "user-agent"), access_token) == G_OK) {
-                            j_query = json_pack("{sss{si}s{sO}}",
-                                                "table",
-                                                GLEWLWYD_PLUGIN_OAUTH2_TABLE_DEVICE_AUTHORIZATION,
-                                                "set",
-                                                  "gpgda_status", 2,
-                                                "where",
-                                                  "gpgda_id", json_object_get(json_array_get(j_result, 0), "gpgda_id"));
-                            res = h_update(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
-                            json_decref(j_query);
-                            if (res == H_OK) {
-                              j_body = json_pack("{sssssssisIss}",
-                                                 "token_type",
-                                                 "bearer",
-                                                 "access_token",
-                                                 access_token,
-                                                 "refresh_token",
-                                                 refresh_token,
-                                                 "iat",
-                                                 now,
-                                                 "expires_in",
-                                                 config->access_token_duration,
-                                                 "scope",
-                                                 scope);
-                              ulfius_set_json_body_response(response, 200, j_body);
-                              json_decref(j_body);
-                              config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OAUTH2_REFRESH_TOKEN, 1, "plugin", config->name, "response_type", "device_code", NULL);
-                              config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OAUTH2_REFRESH_TOKEN, 1, "plugin", config->name, NULL);
-                              config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OAUTH2_USER_ACCESS_TOKEN, 1, "plugin", config->name, "response_type", "device_code", NULL);
-                              config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OAUTH2_USER_ACCESS_TOKEN, 1, "plugin", config->name, NULL);
+                  // All clear, please send back tokens
+                  username = json_string_value(json_object_get(json_array_get(j_result, 0), "username"));
+                  j_user = config->glewlwyd_config->glewlwyd_plugin_callback_get_user(config->glewlwyd_config, username);
+                  if (check_result_value(j_user, G_OK)) {
+                    time(&now);
+                    if ((refresh_token = generate_refresh_token(config, client_id, username, json_string_value(json_object_get(json_object_get(j_user, "user"), "scope_list")), now, ip_source)) != NULL) {
+                      j_refresh_token = serialize_refresh_token(config, GLEWLWYD_AUTHORIZATION_TYPE_DEVICE_AUTHORIZATION, 0, username, client_id, scope, now, config->refresh_token_duration, config->refresh_token_rolling, refresh_token, issued_for, u_map_get_case(request->map_header, "user-agent"));
+                      if (check_result_value(j_refresh_token, G_OK)) {
+                        j_user_only = config->glewlwyd_config->glewlwyd_plugin_callback_get_user(config->glewlwyd_config, username);
+                        if (check_result_value(j_user_only, G_OK)) {
+                          if ((access_token = generate_access_token(config, 
+                                                                    username, 
+                                                                    client_id,
+                                                                    json_object_get(j_user_only, "user"), 
+                                                                    json_string_value(json_object_get(json_object_get(j_user, "user"), "scope_list")), 
+                                                                    now,
+                                                                    ip_source)) != NULL) {
+                            if (serialize_access_token(config, GLEWLWYD_AUTHORIZATION_TYPE_DEVICE_AUTHORIZATION, json_integer_value(json_object_get(j_refresh_token, "gpgr_id")), username, client_id, scope, now, issued_for, u_map_get_case(request->map_header, "user-agent"), access_token) == G_OK) {
+                              j_query = json_pack("{sss{si}s{sO}}",
+                                                  "table",
+                                                  GLEWLWYD_PLUGIN_OAUTH2_TABLE_DEVICE_AUTHORIZATION,
+                                                  "set",
+                                                    "gpgda_status", 2,
+                                                  "where",
+                                                    "gpgda_id", json_object_get(json_array_get(j_result, 0), "gpgda_id"));
+                              res = h_update(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
+                              json_decref(j_query);
+                              if (res == H_OK) {
+                                j_body = json_pack("{sssssssisIss}",
+                                                   "token_type",
+                                                   "bearer",
+                                                   "access_token",
+                                                   access_token,
+                                                   "refresh_token",
+                                                   refresh_token,
+                                                   "iat",
+                                                   now,
+                                                   "expires_in",
+                                                   config->access_token_duration,
+                                                   "scope",
+                                                   scope);
+                                ulfius_set_json_body_response(response, 200, j_body);
+                                json_decref(j_body);
+                                config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OAUTH2_REFRESH_TOKEN, 1, "plugin", config->name, "response_type", "device_code", NULL);
+                                config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OAUTH2_REFRESH_TOKEN, 1, "plugin", config->name, NULL);
+                                config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OAUTH2_USER_ACCESS_TOKEN, 1, "plugin", config->name, "response_type", "device_code", NULL);
+                                config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OAUTH2_USER_ACCESS_TOKEN, 1, "plugin", config->name, NULL);
+                              } else {
+                                y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oauth2 - Error executing j_query (4)");
+                                j_body = json_pack("{ss}", "error", "server_error");
+                                ulfius_set_json_body_response(response, 500, j_body);
+                                json_decref(j_body);
+                              }
                             } else {
-                              y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oauth2 - Error executing j_query (4)");
+                              y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oauth2 - Error serialize_access_token");
                               j_body = json_pack("{ss}", "error", "server_error");
                               ulfius_set_json_body_response(response, 500, j_body);
                               json_decref(j_body);
                             }
                           } else {
-                            y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oauth2 - Error serialize_access_token");
+                            y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oauth2 - Error generate_access_token");
                             j_body = json_pack("{ss}", "error", "server_error");
                             ulfius_set_json_body_response(response, 500, j_body);
                             json_decref(j_body);
                           }
+                          o_free(access_token);
                         } else {
-                          y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oauth2 - Error generate_access_token");
+                          y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oauth2 - Error glewlwyd_plugin_callback_get_user");
                           j_body = json_pack("{ss}", "error", "server_error");
                           ulfius_set_json_body_response(response, 500, j_body);
                           json_decref(j_body);
                         }
-                        o_free(access_token);
+                        json_decref(j_user_only);
                       } else {
-                        y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oauth2 - Error glewlwyd_plugin_callback_get_user");
+                        y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oauth2 - Error serialize_refresh_token");
                         j_body = json_pack("{ss}", "error", "server_error");
                         ulfius_set_json_body_response(response, 500, j_body);
                         json_decref(j_body);
                       }
-                      json_decref(j_user_only);
+                      json_decref(j_refresh_token);
+                      o_free(refresh_token);
                     } else {
-                      y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oauth2 - Error serialize_refresh_token");
+                      y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oauth2 - Error generate_refresh_token");
                       j_body = json_pack("{ss}", "error", "server_error");
                       ulfius_set_json_body_response(response, 500, j_body);
                       json_decref(j_body);
                     }
-                    json_decref(j_refresh_token);
-                    o_free(refresh_token);
                   } else {
-                    y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oauth2 - Error generate_refresh_token");
+                    y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oauth2 - Error getting user %s", username);
                     j_body = json_pack("{ss}", "error", "server_error");
                     ulfius_set_json_body_response(response, 500, j_body);
                     json_decref(j_body);
                   }
+                  json_decref(j_user);
+                  o_free(scope);
+                  json_decref(j_result_scope);
                 } else {
-                  y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oauth2 - Error getting user %s", username);
+                  y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - Error executing j_query (2)");
                   j_body = json_pack("{ss}", "error", "server_error");
                   ulfius_set_json_body_response(response, 500, j_body);
                   json_decref(j_body);
                 }
-                json_decref(j_user);
-                o_free(scope);
-                json_decref(j_result_scope);
               } else {
-                y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - Error executing j_query (2)");
-                j_body = json_pack("{ss}", "error", "server_error");
-                ulfius_set_json_body_response(response, 500, j_body);
-                json_decref(j_body);
-              }
-            } else {
-              j_query = json_pack("{sss{s{ss}}s{sO}}",
-                                  "table",
-                                  GLEWLWYD_PLUGIN_OAUTH2_TABLE_DEVICE_AUTHORIZATION,
-                                  "set",
-                                    "gpgda_last_check",
-                                      "raw",
-                                      SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "CURRENT_TIMESTAMP", "strftime('%s','now')", "NOW()"),
-                                  "where",
-                                    "gpgda_id",
-                                    json_object_get(json_array_get(j_result, 0), "gpgda_id"));
-              res = h_update(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
-              json_decref(j_query);
-              if (res == H_OK) {
-                if (((json_int_t)now - json_integer_value(json_object_get(json_array_get(j_result, 0), "last_check"))) >= json_integer_value(json_object_get(config->j_params, "device-authorization-interval"))) {
-                  // Wait for it!
-                  j_body = json_pack("{ss}", "error", "authorization_pending");
-                  ulfius_set_json_body_response(response, 400, j_body);
-                  json_decref(j_body);
+                j_query = json_pack("{sss{s{ss}}s{sO}}",
+                                    "table",
+                                    GLEWLWYD_PLUGIN_OAUTH2_TABLE_DEVICE_AUTHORIZATION,
+                                    "set",
+                                      "gpgda_last_check",
+                                        "raw",
+                                        SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "CURRENT_TIMESTAMP", "strftime('%s','now')", "NOW()"),
+                                    "where",
+                                      "gpgda_id",
+                                      json_object_get(json_array_get(j_result, 0), "gpgda_id"));
+                res = h_update(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
+                json_decref(j_query);
+                if (res == H_OK) {
+                  set_device_pending(config,
+                                     device_code_hash,
+                                     json_integer_value(json_object_get(json_array_get(j_result, 0), "gpgda_id")),
+                                     json_string_value(json_object_get(json_object_get(j_client, "client"), "client_id")),
+                                     (time_t)json_integer_value(json_object_get(json_array_get(j_result, 0), "expires_at")),
+                                     now,
+                                     generation);
+                  if (((json_int_t)now - json_integer_value(json_object_get(json_array_get(j_result, 0), "last_check"))) >= json_integer_value(json_object_get(config->j_params, "device-authorization-interval"))) {
+                    // Wait for it!
+                    j_body = json_pack("{ss}", "error", "authorization_pending");
+                    ulfius_set_json_body_response(response, 400, j_body);
+                    json_decref(j_body);
+                  } else {
+                    // Slow down dammit!
+                    j_body = json_pack("{ss}", "error", "slow_down");
+                    ulfius_set_json_body_response(response, 400, j_body);
+                    json_decref(j_body);
+                  }
                 } else {
-                  // Slow down dammit!
-                  j_body = json_pack("{ss}", "error", "slow_down");
-                  ulfius_set_json_body_response(response, 400, j_body);
+                  y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - Error executing j_query (3)");
+                  j_body = json_pack("{ss}", "error", "server_error");
+                  ulfius_set_json_body_response(response, 500, j_body);
                   json_decref(j_body);
                 }
-              } else {
-                y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - Error executing j_query (3)");
-                j_body = json_pack("{ss}", "error", "server_error");
-                ulfius_set_json_body_response(response, 500, j_body);
-                json_decref(j_body);
               }
+            } else {
+              // Code expired
+              j_body = json_pack("{ss}", "error", "expired_token");
+              ulfius_set_json_body_response(response, 400, j_body);
+              json_decref(j_body);
             }
           } else {
-            // Code expired
-            j_body = json_pack("{ss}", "error", "expired_token");
+            y_log_message(Y_LOG_LEVEL_DEBUG, "check_auth_type_device_code - Invalid code");
+            j_body = json_pack("{ss}", "error", "access_denied");
             ulfius_set_json_body_response(response, 400, j_body);
             json_decref(j_body);
           }
+          json_decref(j_result);
         } else {
-          y_log_message(Y_LOG_LEVEL_DEBUG, "check_auth_type_device_code - Invalid code");
-          j_body = json_pack("{ss}", "error", "access_denied");
-          ulfius_set_json_body_response(response, 400, j_body);
+          y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - Error executing j_query (1)");
+          j_body = json_pack("{ss}", "error", "server_error");
+          ulfius_set_json_body_response(response, 500, j_body);
           json_decref(j_body);
         }
-        json_decref(j_result);
-      } else {
-        y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - Error executing j_query (1)");
-        j_body = json_pack("{ss}", "error", "server_error");
-        ulfius_set_json_body_response(response, 500, j_body);
-        json_decref(j_body);
       }
+      o_free(device_code_hash);
     } else {
       j_body = json_pack("{ss}", "error", "unauthorized_client");
       ulfius_set_json_body_response(response, 403, j_body);
@@ -3740,7 +3943,7 @@ json_t * plugin_module_init(struct config_plugin * config, const char * name, js
   jwa_alg alg = R_JWA_ALG_UNKNOWN;
   pthread_mutexattr_t mutexattr;
   json_t * j_return = NULL, * j_result = NULL, * j_element = NULL;
-  size_t index = 0;
+  size_t index = 0, i;
   struct _oauth2_config * p_config = NULL;
   jwk_t * key_priv = NULL, * key_pub = NULL;
   
@@ -3749,6 +3952,12 @@ json_t * plugin_module_init(struct config_plugin * config, const char * name, js
   if (*cls != NULL) {
     p_config = (struct _oauth2_config *)*cls;
     p_config->glewlwyd_resource_config = NULL;
+    for (i=0; i<GLEWLWYD_DEVICE_PENDING_BUCKETS; i++) {
+      pointer_list_init(&p_config->device_pending_list[i]);
+    }
+    // Without cache invalidation, another instance sharing the database wouldn't remove the entries
+    p_config->device_pending_enabled = (config->glewlwyd_config->cache_invalidation_backend != GLEWLWYD_CACHE_INVALIDATION_BACKEND_NONE);
+    p_config->device_pending_generation = 0;
     
     do {
       pthread_mutexattr_init ( &mutexattr );
@@ -3758,6 +3967,11 @@ json_t * plugin_module_init(struct config_plugin * config, const char * name, js
         j_return = json_pack("{si}", "result", G_ERROR);
         break;
       }
+      if (pthread_mutex_init(&p_config->device_pending_lock, NULL) != 0) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "plugin_module_init - oauth2 - Error initializing device_pending_lock");
+        j_return = json_pack("{si}", "result", G_ERROR);
+        break;
+      }
       pthread_mutexattr_destroy(&mutexattr);
       
       p_config->name = name;
@@ -4030,6 +4244,11 @@ json_t * plugin_module_init(struct config_plugin * config, const char * name, js
       if (json_object_get(p_config->j_params, "introspection-revocation-allowed") == json_true()) {
         config->glewlwyd_plugin_callback_metrics_increment_counter(config, GLWD_METRICS_OAUTH2_INVALID_ACCESS_TOKEN, 0, "plugin", name, NULL);
       }
+      if (config->glewlwyd_plugin_callback_cache_invalidation_register(config, GLEWLWYD_CACHE_OAUTH2_DEVICE_PENDING, &device_pending_invalidation_callback, p_config) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "plugin_module_init - oauth2 - Error registering device_pending invalidation");
+        j_return = json_pack("{si}", "result", G_ERROR);
+        break;
+      }
       
     } while (0);
     json_decref(j_result);
@@ -4054,6 +4273,10 @@ json_t * plugin_module_init(struct config_plugin * config, const char * name, js
         r_jwt_free(p_config->jwt_key);
         json_decref(p_config->j_params);
         pthread_mutex_destroy(&p_config->insert_lock);
+        for (i=0; i<GLEWLWYD_DEVICE_PENDING_BUCKETS; i++) {
+          pointer_list_clean_free(&p_config->device_pending_list[i], &free_device_pending);
+        }
+        pthread_mutex_destroy(&p_config->device_pending_lock);
         o_free(p_config);
       }
     }
@@ -4067,6 +4290,8 @@ json_t * plugin_module_init(struct config_plugin * config, const char * name, js
 }
 
 int plugin_module_close(struct config_plugin * config, const char * name, void * cls) {
+  size_t i;
+
   UNUSED(name);
   if (cls != NULL) {
     y_log_message(Y_LOG_LEVEL_INFO, "Close plugin Glewlwyd Oauth2 '%s'", name);
@@ -4094,9 +4319,14 @@ int plugin_module_close(struct config_plugin * config, const char * name, void *
       config->glewlwyd_callback_remove_plugin_endpoint(config, "POST", name, "device_authorization/");
       config->glewlwyd_callback_remove_plugin_endpoint(config, "GET", name, "device/");
     }
+    config->glewlwyd_plugin_callback_cache_invalidation_unregister(config, GLEWLWYD_CACHE_OAUTH2_DEVICE_PENDING, cls);
     r_jwt_free(((struct _oauth2_config *)cls)->jwt_key);
     json_decref(((struct _oauth2_config *)cls)->j_params);
     pthread_mutex_destroy(&((struct _oauth2_config *)cls)->insert_lock);
+    for (i=0; i<GLEWLWYD_DEVICE_PENDING_BUCKETS; i++) {
+      pointer_list_clean_free(&((struct _oauth2_config *)cls)->device_pending_list[i], &free_device_pending);
+    }
+    pthread_mutex_destroy(&((struct _oauth2_config *)cls)->device_pending_lock);
     o_free(cls);
   }
   return G_OK;
@@ -27,10 +27,13 @@
 
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #include <pthread.h>
+#include <sched.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <zlib.h>
 #include <gnutls/gnutls.h>
 #include <gnutls/crypto.h>
 #include <gnutls/abstract.h>
@@ -47,6 +50,7 @@
 #define OIDC_REQUEST_URI_SUFFIX_LENGTH 32
 #define OIDC_SID_LENGTH                32
 #define OIDC_DPOP_NONCE_LENGTH         16
+#define OIDC_REFRESH_TOKEN_LOCK_STRIPES 32
 
 #define GLEWLWYD_ACCESS_TOKEN_EXP_DEFAULT  3600
 #define GLEWLWYD_REFRESH_TOKEN_EXP_DEFAULT 1209600
@@ -87,6 +91,7 @@
 #define GLEWLWYD_PLUGIN_OIDC_TABLE_CIBA                       "gpo_ciba"
 #define GLEWLWYD_PLUGIN_OIDC_TABLE_CIBA_SCOPE                 "gpo_ciba_scope"
 #define GLEWLWYD_PLUGIN_OIDC_TABLE_CIBA_SCHEME                "gpo_ciba_scheme"
+#define GLEWLWYD_PLUGIN_OIDC_TABLE_REVOCATION_JOB             "gpo_revocation_job"
 
 // Authorization types available
 #define GLEWLWYD_AUTHORIZATION_TYPE_AUTHORIZATION_CODE                  0
@@ -179,6 +184,11 @@
 #define GLWD_METRICS_OIDC_INVALID_DEVICE_CODE         "glewlwyd_oidc_invalid_device_code"
 #define GLWD_METRICS_OIDC_INVALID_REFRESH_TOKEN       "glewlwyd_oidc_invalid_refresh_token"
 #define GLWD_METRICS_OIDC_INVALID_ACCESS_TOKEN        "glewlwyd_oidc_invalid_acccess_token"
+#define GLWD_METRICS_OIDC_REVOKED                     "glewlwyd_oidc_revoked"
+#define GLWD_METRICS_OIDC_REVOCATION_BACKGROUND       "glewlwyd_oidc_revocation_background"
+#define GLWD_METRICS_OIDC_REVOCATION_COMPLETE         "glewlwyd_oidc_revocation_background_complete"
+#define GLWD_METRICS_OIDC_REVOCATION_FAILED           "glewlwyd_oidc_revocation_background_failed"
+#define GLWD_METRICS_OIDC_REVOCATION_RETRY            "glewlwyd_oidc_revocation_retry"
 
 #define GLEWLWYD_TOKEN_TYPE_BEARER "bearer"
 #define GLEWLWYD_TOKEN_TYPE_DPOP "DPoP"
@@ -187,6 +197,133 @@
 #define GLEWLWYD_INTROSPECT_TOKEN_TYPE_CLIENT_TOKEN 1
 #define GLEWLWYD_INTROSPECT_TOKEN_TYPE_DPOP         2
 
+#define GLEWLWYD_CLIENT_ENC_JWKS_CACHE_DURATION       600
+#define GLEWLWYD_CLIENT_ENC_JWKS_CACHE_ERROR_DURATION 10
+#define GLEWLWYD_CLIENT_ENC_JWKS_CACHE_MAX_SIZE       1024
+
+#define GLEWLWYD_PENDING_AUTH_BUCKETS         64
+#define GLEWLWYD_PENDING_AUTH_BUCKET_MAX_SIZE 256
+#define GLEWLWYD_PENDING_AUTH_TYPE_DEVICE     0
+#define GLEWLWYD_PENDING_AUTH_TYPE_CIBA       1
+#define GLEWLWYD_PENDING_AUTH_CHECK_INTERVAL  10
+#define GLEWLWYD_CACHE_OIDC_PENDING_AUTH      "oidc_pending_auth"
+#define GLEWLWYD_LONG_POLL_DEFAULT_MAX_REQUESTS 64
+#define GLEWLWYD_LONG_POLL_MAX_DURATION         10
+
+#define GLEWLWYD_CLIENT_REDIRECT_URI_BUCKETS         64
+#define GLEWLWYD_CLIENT_REDIRECT_URI_BUCKET_MAX_SIZE 64
+#define GLEWLWYD_CLIENT_REDIRECT_URI_CACHE_DURATION  600
+#define GLEWLWYD_CLIENT_REDIRECT_URI_CACHE_DURATION_LOCAL 60
+
+#define GLEWLWYD_METADATA_GZIP_WINDOW_BITS 15
+#define GLEWLWYD_METADATA_GZIP_ENCODING    16
+
+#define GLEWLWYD_SIGN_KTY_OCT 0
+#define GLEWLWYD_SIGN_KTY_RSA 1
+#define GLEWLWYD_SIGN_KTY_EC  2
+#define GLEWLWYD_SIGN_KTY_OKP 3
+#define GLEWLWYD_SIGN_KTY_MAX 4
+
+#define GLEWLWYD_SIGN_KEY_STATE_DROPPED 0
+#define GLEWLWYD_SIGN_KEY_STATE_PENDING 1
+#define GLEWLWYD_SIGN_KEY_STATE_ACTIVE  2
+#define GLEWLWYD_SIGN_KEY_STATE_RETIRED 3
+
+#define GLEWLWYD_SIGN_KEYS_UPDATE_RETRY_DELAY 60
+
+#define GLEWLWYD_REVOCATION_BATCH_SIZE   500
+#define GLEWLWYD_REVOCATION_SYNC_BATCHES 8
+#define GLEWLWYD_REVOCATION_MAX_STEPS    8
+#define GLEWLWYD_REVOCATION_BATCH_DELAY     20    // milliseconds
+#define GLEWLWYD_REVOCATION_ERROR_DELAY     1000  // milliseconds, doubled after each consecutive error
+#define GLEWLWYD_REVOCATION_MAX_ERROR_DELAY 60000 // milliseconds
+#define GLEWLWYD_REVOCATION_CLOSE_TIMEOUT   30000 // milliseconds
+
+/**
+ * Encryption keys of a client, parsed from its pubkey, jwks and jwks_uri properties
+ * The fingerprint is a hash of those properties so an updated client invalidates its entry
+ * An incomplete jwks (jwks or jwks_uri import failed) is kept only for a short time
+ */
+struct _oidc_client_enc_jwks {
+  char   * client_id;
+  char   * fingerprint;
+  time_t   expires_at;
+  jwks_t * jwks;
+};
+
+/**
+ * Device authorization or CIBA request still waiting for the user
+ * Polls on a pending request are answered from this entry without reading the database,
+ * the entry is removed as soon as the request is approved, denied or cancelled
+ * The request is read again in the database GLEWLWYD_PENDING_AUTH_CHECK_INTERVAL seconds after checked_at,
+ * in case an invalidation was missed
+ */
+struct _oidc_pending_auth {
+  unsigned short int   type;
+  json_int_t           id;
+  char               * code;
+  char               * client_id;
+  json_t             * j_request;
+  time_t               expires_at;
+  time_t               last_check;
+  time_t               checked_at;
+};
+
+/**
+ * Redirect URIs of a client compiled in an open addressing hash set
+ * The entry is removed when the client is updated or deleted, or when it expires,
+ * nb_uri is also checked against the client record in case the invalidation was missed
+ */
+struct _oidc_client_redirect_uri {
+  char          * client_id;
+  size_t          nb_uri;
+  size_t          table_size;
+  char         ** uri_table;
+  time_t          expires_at;
+};
+
+/**
+ * Signing keys of the plugin, published as a whole with an atomic pointer swap
+ * jwks_sign contains the active keys, jwks_private also contains the pending and retired keys
+ * to decrypt request objects, jwks_public contains the public keys of all of them
+ * The set is refcounted, the published pointer holds one reference and each request
+ * minting or verifying a token holds another one, so a replaced set is freed by its last user
+ * next_update is the next 'nbf' or 'exp' boundary of the keys, 0 if there is none
+ */
+struct _oidc_sign_keys {
+  jwks_t  * jwks_sign;
+  jwks_t  * jwks_private;
+  jwks_t  * jwks_public;
+  jwk_t   * jwk_sign_default;
+  jwk_t   * jwk_sign_kty[GLEWLWYD_SIGN_KTY_MAX];
+  jwa_alg   sign_alg_default;
+  char    * fingerprint;
+  time_t    next_update;
+  int       refcount;
+};
+
+/**
+ * Active key removed from the key source,
+ * still available for verification until the tokens it signed expire
+ */
+struct _oidc_retired_key {
+  jwk_t  * jwk;
+  time_t   expires_at;
+};
+
+/**
+ * Discovery or JWKS document served as is
+ * The gzip version and the strong ETags are computed once, when the document is generated
+ * The gzip version has its own ETag since it's a different representation
+ */
+struct _oidc_metadata {
+  char   * body;
+  char   * body_gzip;
+  size_t   body_gzip_len;
+  char   * etag;
+  char   * etag_gzip;
+};
+
 /**
  * Structure used to store all the plugin parameters and data duringexecution
  */
@@ -195,12 +332,37 @@ struct _oidc_config {
   const char                   * name;
   json_t                       * j_params;
 
-  jwks_t                       * jwks_sign;
-  jwks_t                       * jwks_public;
+  struct _oidc_sign_keys       * sign_keys;
+  unsigned int                   sign_keys_epoch;
+  unsigned int                   sign_keys_readers[2];
+  time_t                         sign_keys_next_update;
+  struct _pointer_list           sign_keys_retired;
+  pthread_t                      sign_keys_thread;
+  pthread_mutex_t                sign_keys_lock;
+  pthread_cond_t                 sign_keys_cond;
+  int                            sign_keys_thread_started;
+  int                            sign_keys_stop;
   int                            x5u_flags;
-
-  char                         * discovery_str;
-  char                         * jwks_str;
+  struct _pointer_list           client_enc_jwks_list;
+  pthread_mutex_t                client_enc_jwks_lock;
+  unsigned short int             pending_auth_enabled;
+  struct _pointer_list           pending_auth_list[GLEWLWYD_PENDING_AUTH_BUCKETS];
+  pthread_mutex_t                pending_auth_lock;
+  pthread_cond_t                 pending_auth_cond;
+  unsigned int                   pending_auth_generation;
+  unsigned int                   pending_auth_waiters;
+  struct _pointer_list           client_redirect_uri_list[GLEWLWYD_CLIENT_REDIRECT_URI_BUCKETS];
+  pthread_mutex_t                client_redirect_uri_lock;
+  struct _pointer_list           revocation_job_list;
+  pthread_t                      revocation_thread;
+  pthread_mutex_t                revocation_lock;
+  pthread_cond_t                 revocation_cond;
+  int                            revocation_thread_started;
+  int                            revocation_stop;
+
+  struct _oidc_metadata          discovery;
+  struct _oidc_metadata          jwks;
+  pthread_mutex_t                metadata_lock;
   char                         * check_session_iframe;
 
   json_int_t                     access_token_duration;
@@ -214,12 +376,19 @@ struct _oidc_config {
   unsigned short int             auth_type_enabled[7];
   unsigned short int             subject_type;
   pthread_mutex_t                insert_lock;
+  pthread_mutex_t                refresh_token_lock[OIDC_REFRESH_TOKEN_LOCK_STRIPES];
+  unsigned int                   refresh_token_claim_instance;
   char                         * introspect_revoke_scope;
   char                         * client_register_scope;
   time_t                         dpop_max_iat;
   time_t                         dpop_max_iat_gap;
 };
 
+/**
+ * Number given to each plugin instance to name its refresh token claim variables
+ */
+static unsigned int refresh_token_claim_instance_counter = 0;
+
 static size_t get_enc_key_size(jwa_enc enc) {
   size_t size = 0;
   switch (enc) {
@@ -1017,6 +1186,22 @@ static json_t * check_parameters (json_t * j_params) {
         ret = G_ERROR_PARAM;
       }
     }
+    if (json_object_get(j_params, "jwks-rotation-interval") != NULL && (!json_is_integer(json_object_get(j_params, "jwks-rotation-interval")) || json_integer_value(json_object_get(j_params, "jwks-rotation-interval")) < 0)) {
+      json_array_append_new(j_error, json_string("Property 'jwks-rotation-interval' is optional and must be a positive integer"));
+      ret = G_ERROR_PARAM;
+    }
+    if (json_object_get(j_params, "metadata-max-age") != NULL && (!json_is_integer(json_object_get(j_params, "metadata-max-age")) || json_integer_value(json_object_get(j_params, "metadata-max-age")) < 0)) {
+      json_array_append_new(j_error, json_string("Property 'metadata-max-age' is optional and must be a positive integer"));
+      ret = G_ERROR_PARAM;
+    }
+    if (json_object_get(j_params, "token-long-poll-duration") != NULL && (!json_is_integer(json_object_get(j_params, "token-long-poll-duration")) || json_integer_value(json_object_get(j_params, "token-long-poll-duration")) < 0 || json_integer_value(json_object_get(j_params, "token-long-poll-duration")) > GLEWLWYD_LONG_POLL_MAX_DURATION)) {
+      json_array_append_new(j_error, json_string("Property 'token-long-poll-duration' is optional and must be a integer between 0 and 10"));
+      ret = G_ERROR_PARAM;
+    }
+    if (json_object_get(j_params, "token-long-poll-max-requests") != NULL && (!json_is_integer(json_object_get(j_params, "token-long-poll-max-requests")) || json_integer_value(json_object_get(j_params, "token-long-poll-max-requests")) <= 0)) {
+      json_array_append_new(j_error, json_string("Property 'token-long-poll-max-requests' is optional and must be a non null positive integer"));
+      ret = G_ERROR_PARAM;
+    }
     if (!json_string_null_or_empty(json_object_get(j_params, "client-cert-source")) && 0 != o_strcmp("TLS", json_string_value(json_object_get(j_params, "client-cert-source"))) && 0 != o_strcmp("header", json_string_value(json_object_get(j_params, "client-cert-source"))) && 0 != o_strcmp("both", json_string_value(json_object_get(j_params, "client-cert-source")))) {
       json_array_append_new(j_error, json_string("client-cert-source is optional and must be one of the following values: 'TLS', 'header' or 'both'"));
     }
@@ -1755,6 +1940,20 @@ static json_t * oidc_verify_dpop_proof(struct _oidc_config * config, const struc
   return j_return;
 }
 
+static const struct _glwd_statement statement_oidc_dpop_jti = {
+  "glwd_oidc_dpop_jti",
+  "SELECT gpod_id FROM " GLEWLWYD_PLUGIN_OIDC_TABLE_DPOP " WHERE gpod_plugin_name=$1 AND gpod_jti_hash=$2 AND gpod_client_id=$3",
+  NULL,
+  NULL
+};
+
+static const struct _glwd_statement statement_oidc_ciba_jti = {
+  "glwd_oidc_ciba_jti",
+  "SELECT gpob_id FROM " GLEWLWYD_PLUGIN_OIDC_TABLE_CIBA " WHERE gpob_plugin_name=$1 AND gpob_jti_hash=$2 AND gpob_client_id=$3",
+  NULL,
+  NULL
+};
+
 /**
  * Verifies that this jti has not been used for another DPoP
  * If so, stores its metadata
@@ -1771,15 +1970,8 @@ static int check_dpop_jti(struct _oidc_config * config,
   json_t * j_query, * j_result;
   int res, ret;
 
-  j_query = json_pack("{sss[s]s{ssssss}}",
-                      "table", GLEWLWYD_PLUGIN_OIDC_TABLE_DPOP,
-                      "columns",
-                        "gpod_id",
-                      "where",
-                        "gpod_plugin_name", config->name,
-                        "gpod_jti_hash", jti_hash,
-                        "gpod_client_id", client_id);
-  res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result, NULL);
+  j_query = json_pack("[sss]", config->name, jti_hash, client_id);
+  res = execute_statement_json(config->glewlwyd_config->glewlwyd_config, config->glewlwyd_config->glewlwyd_config->conn, &statement_oidc_dpop_jti, j_query, &j_result);
   json_decref(j_query);
   if (res == H_OK) {
     if (!json_array_size(j_result)) {
@@ -1836,21 +2028,14 @@ static int check_ciba_jti(struct _oidc_config * config,
                           const char * client_id,
                           const char * ip_source) {
   char * jti_hash;
-  json_t * j_query, * j_result;
+  json_t * j_params, * j_result;
   int res, ret;
 
   if (!o_strnullempty(jti)) {
     jti_hash = config->glewlwyd_config->glewlwyd_callback_generate_hash(config->glewlwyd_config, jti);
-    j_query = json_pack("{sss[s]s{ssssss}}",
-                        "table", GLEWLWYD_PLUGIN_OIDC_TABLE_CIBA,
-                        "columns",
-                          "gpob_id",
-                        "where",
-                          "gpob_plugin_name", config->name,
-                          "gpob_jti_hash", jti_hash,
-                          "gpob_client_id", client_id);
-    res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result, NULL);
-    json_decref(j_query);
+    j_params = json_pack("[sss]", config->name, jti_hash, client_id);
+    res = execute_statement_json(config->glewlwyd_config->glewlwyd_config, config->glewlwyd_config->glewlwyd_config->conn, &statement_oidc_ciba_jti, j_params, &j_result);
+    json_decref(j_params);
     o_free(jti_hash);
     if (res == H_OK) {
       if (!json_array_size(j_result)) {
@@ -1862,7 +2047,7 @@ static int check_ciba_jti(struct _oidc_config * config,
       }
       json_decref(j_result);
     } else {
-      y_log_message(Y_LOG_LEVEL_ERROR, "check_ciba_jti - Error executing j_query");
+      y_log_message(Y_LOG_LEVEL_ERROR, "check_ciba_jti - Error executing statement");
       config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
       ret = G_ERROR_DB;
     }
@@ -1872,6 +2057,13 @@ static int check_ciba_jti(struct _oidc_config * config,
   return ret;
 }
 
+static const struct _glwd_statement statement_oidc_sub_public = {
+  "glwd_oidc_sub_public",
+  "SELECT gposi_sub FROM " GLEWLWYD_PLUGIN_OIDC_TABLE_SUBJECT_IDENTIFIER " WHERE gposi_plugin_name=$1 AND gposi_username=$2 AND gposi_client_id IS NULL AND gposi_sector_identifier_uri IS NULL",
+  NULL,
+  NULL
+};
+
 /**
  * Get sub associated with username in public mode
  * Or create one and store it in the database if it doesn't exist
@@ -1881,21 +2073,8 @@ static char * get_sub_public(struct _oidc_config * config, const char * username
   int res;
   char * sub = NULL;
 
-  j_query = json_pack("{sss[s]s{sssssoso}}",
-                      "table",
-                      GLEWLWYD_PLUGIN_OIDC_TABLE_SUBJECT_IDENTIFIER,
-                      "columns",
-                        "gposi_sub",
-                      "where",
-                        "gposi_plugin_name",
-                        config->name,
-                        "gposi_username",
-                        username,
-                        "gposi_client_id",
-                        json_null(),
-                        "gposi_sector_identifier_uri",
-                        json_null());
-  res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result, NULL);
+  j_query = json_pack("[ss]", config->name, username);
+  res = execute_statement_json(config->glewlwyd_config->glewlwyd_config, config->glewlwyd_config->glewlwyd_config->conn, &statement_oidc_sub_public, j_query, &j_result);
   json_decref(j_query);
   if (res == H_OK) {
     if (json_array_size(j_result)) {
@@ -2158,14 +2337,14 @@ static int is_encrypt_token_allowed(struct _oidc_config * config, json_t * j_cli
   return ret;
 }
 
-static jwa_alg get_token_sign_alg(struct _oidc_config * config, json_t * j_client, int type) {
+static jwa_alg get_token_sign_alg(struct _oidc_config * config, struct _oidc_sign_keys * sign_keys, json_t * j_client, int type) {
   const char * sign_kid = json_string_value(json_object_get(config->j_params, "client-sign_kid-parameter"));
   jwk_t * jwk = NULL;
   jwa_alg alg = R_JWA_ALG_UNKNOWN;
 
   if (j_client != NULL) {
     if (!json_string_null_or_empty(json_object_get(j_client, sign_kid))) {
-      jwk = r_jwks_get_by_kid(config->jwks_sign, json_string_value(json_object_get(j_client, sign_kid)));
+      jwk = r_jwks_get_by_kid(sign_keys->jwks_sign, json_string_value(json_object_get(j_client, sign_kid)));
       alg = r_str_to_jwa_alg(r_jwk_get_property_str(jwk, "alg"));
       r_jwk_free(jwk);
     } else {
@@ -2197,9 +2376,7 @@ static jwa_alg get_token_sign_alg(struct _oidc_config * config, json_t * j_clien
     }
   }
   if (alg == R_JWA_ALG_UNKNOWN) {
-    jwk = r_jwks_get_at(config->jwks_sign, 0);
-    alg = r_str_to_jwa_alg(r_jwk_get_property_str(jwk, "alg"));
-    r_jwk_free(jwk);
+    alg = sign_keys->sign_alg_default;
   }
   return alg;
 }
@@ -2258,103 +2435,315 @@ static jwa_enc get_token_enc(struct _oidc_config * config, json_t * j_client, in
   return enc;
 }
 
-static jwk_t * get_jwk_sign(struct _oidc_config * config, json_t * j_client, jwa_alg alg) {
-  jwks_t * jwks_subset = NULL;
-  jwk_t * jwk = NULL;
+static int get_sign_kty_index(jwa_alg alg) {
+  if (alg == R_JWA_ALG_HS256 || alg == R_JWA_ALG_HS384 || alg == R_JWA_ALG_HS512) {
+    return GLEWLWYD_SIGN_KTY_OCT;
+  } else if (alg == R_JWA_ALG_RS256 || alg == R_JWA_ALG_RS384 || alg == R_JWA_ALG_RS512 ||
+             alg == R_JWA_ALG_PS256 || alg == R_JWA_ALG_PS384 || alg == R_JWA_ALG_PS512) {
+    return GLEWLWYD_SIGN_KTY_RSA;
+  } else if (alg == R_JWA_ALG_ES256 || alg == R_JWA_ALG_ES384 || alg == R_JWA_ALG_ES512) {
+    return GLEWLWYD_SIGN_KTY_EC;
+  } else if (alg == R_JWA_ALG_EDDSA || alg == R_JWA_ALG_ES256K) {
+    return GLEWLWYD_SIGN_KTY_OKP;
+  } else {
+    return -1;
+  }
+}
+
+/**
+ * Resolve once the default signing key, its alg and the first key of each kty,
+ * so minting a token doesn't have to search jwks_sign every time
+ */
+static int build_sign_key_handles(struct _oidc_sign_keys * sign_keys) {
+  int ret = G_OK, i;
+  jwks_t * jwks_subset;
+  const char * kty[GLEWLWYD_SIGN_KTY_MAX] = {"{\"kty\":\"oct\"}", "{\"kty\":\"RSA\"}", "{\"kty\":\"EC\"}", "{\"kty\":\"OKP\"}"};
+
+  if ((sign_keys->jwk_sign_default = r_jwks_get_at(sign_keys->jwks_sign, 0)) != NULL) {
+    sign_keys->sign_alg_default = r_str_to_jwa_alg(r_jwk_get_property_str(sign_keys->jwk_sign_default, "alg"));
+    for (i=0; i<GLEWLWYD_SIGN_KTY_MAX; i++) {
+      jwks_subset = r_jwks_search_json_str(sign_keys->jwks_sign, kty[i]);
+      sign_keys->jwk_sign_kty[i] = r_jwks_get_at(jwks_subset, 0);
+      r_jwks_free(jwks_subset);
+    }
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_key_handles - oidc - Error getting default sign key");
+    ret = G_ERROR;
+  }
+  return ret;
+}
+
+static void free_sign_keys(void * data) {
+  struct _oidc_sign_keys * sign_keys = (struct _oidc_sign_keys *)data;
+  int i;
+
+  if (sign_keys != NULL) {
+    r_jwks_free(sign_keys->jwks_sign);
+    r_jwks_free(sign_keys->jwks_private);
+    r_jwks_free(sign_keys->jwks_public);
+    r_jwk_free(sign_keys->jwk_sign_default);
+    for (i=0; i<GLEWLWYD_SIGN_KTY_MAX; i++) {
+      r_jwk_free(sign_keys->jwk_sign_kty[i]);
+    }
+    o_free(sign_keys->fingerprint);
+    o_free(sign_keys);
+  }
+}
+
+/**
+ * Return the current signing keys with a new reference on them,
+ * the caller must release the set with release_sign_keys when the token is built
+ * No lock is taken: the reader registers in the counter of the current epoch
+ * before loading the pointer, publish_sign_keys switches the epoch after the swap
+ * and waits for the readers of the previous epoch before releasing the previous set
+ */
+static struct _oidc_sign_keys * acquire_sign_keys(struct _oidc_config * config) {
+  struct _oidc_sign_keys * sign_keys;
+  unsigned int epoch;
+
+  while (1) {
+    epoch = __atomic_load_n(&config->sign_keys_epoch, __ATOMIC_SEQ_CST) & 1;
+    __atomic_add_fetch(&config->sign_keys_readers[epoch], 1, __ATOMIC_SEQ_CST);
+    if ((__atomic_load_n(&config->sign_keys_epoch, __ATOMIC_SEQ_CST) & 1) == epoch) {
+      break;
+    }
+    __atomic_sub_fetch(&config->sign_keys_readers[epoch], 1, __ATOMIC_SEQ_CST);
+  }
+  sign_keys = __atomic_load_n(&config->sign_keys, __ATOMIC_SEQ_CST);
+  if (sign_keys != NULL) {
+    __atomic_add_fetch(&sign_keys->refcount, 1, __ATOMIC_RELAXED);
+  }
+  __atomic_sub_fetch(&config->sign_keys_readers[epoch], 1, __ATOMIC_RELEASE);
+  return sign_keys;
+}
+
+static void release_sign_keys(struct _oidc_sign_keys * sign_keys) {
+  if (sign_keys != NULL && !__atomic_sub_fetch(&sign_keys->refcount, 1, __ATOMIC_ACQ_REL)) {
+    free_sign_keys(sign_keys);
+  }
+}
+
+static void free_retired_key(void * data) {
+  struct _oidc_retired_key * retired_key = (struct _oidc_retired_key *)data;
+
+  if (retired_key != NULL) {
+    r_jwk_free(retired_key->jwk);
+    o_free(retired_key);
+  }
+}
+
+static jwk_t * get_jwk_sign(struct _oidc_config * config, struct _oidc_sign_keys * sign_keys, json_t * j_client, jwa_alg alg) {
   const char * sign_kid = json_string_value(json_object_get(config->j_params, "client-sign_kid-parameter"));
+  int index = get_sign_kty_index(alg);
 
-  if (r_jwks_size(config->jwks_sign) == 1 || j_client == NULL) {
-    return r_jwks_get_at(config->jwks_sign, 0);
+  if (r_jwks_size(sign_keys->jwks_sign) == 1 || j_client == NULL) {
+    return r_jwk_copy(sign_keys->jwk_sign_default);
   } else if (!json_string_null_or_empty(json_object_get(j_client, sign_kid))) {
-    return r_jwks_get_by_kid(config->jwks_sign, json_string_value(json_object_get(j_client, sign_kid)));
+    return r_jwks_get_by_kid(sign_keys->jwks_sign, json_string_value(json_object_get(j_client, sign_kid)));
+  } else if (index >= 0) {
+    return r_jwk_copy(sign_keys->jwk_sign_kty[index]);
   } else {
-    if (alg == R_JWA_ALG_HS256 || alg == R_JWA_ALG_HS384 || alg == R_JWA_ALG_HS512) {
-      jwks_subset = r_jwks_search_json_str(config->jwks_sign, "{\"kty\":\"oct\"}");
-      jwk = r_jwks_get_at(jwks_subset, 0);
-      r_jwks_free(jwks_subset);
-    } else if (alg == R_JWA_ALG_RS256 || alg == R_JWA_ALG_RS384 || alg == R_JWA_ALG_RS512 ||
-               alg == R_JWA_ALG_PS256 || alg == R_JWA_ALG_PS384 || alg == R_JWA_ALG_PS512) {
-      jwks_subset = r_jwks_search_json_str(config->jwks_sign, "{\"kty\":\"RSA\"}");
-      jwk = r_jwks_get_at(jwks_subset, 0);
-      r_jwks_free(jwks_subset);
-    } else if (alg == R_JWA_ALG_ES256 || alg == R_JWA_ALG_ES384 || alg == R_JWA_ALG_ES512) {
-      jwks_subset = r_jwks_search_json_str(config->jwks_sign, "{\"kty\":\"EC\"}");
-      jwk = r_jwks_get_at(jwks_subset, 0);
-      r_jwks_free(jwks_subset);
-    } else if (alg == R_JWA_ALG_EDDSA || alg == R_JWA_ALG_ES256K) {
-      jwks_subset = r_jwks_search_json_str(config->jwks_sign, "{\"kty\":\"OKP\"}");
-      jwk = r_jwks_get_at(jwks_subset, 0);
-      r_jwks_free(jwks_subset);
-    }
+    return NULL;
   }
-  return jwk;
 }
 
-static jwk_t * get_jwk_enc(struct _oidc_config * config, json_t * j_client, jwa_alg alg, jwa_enc enc) {
-  jwks_t * jwks_pub, * jwks_subset;
-  jwk_t * jwk = NULL, * jwk_import = NULL;
-  const char * alg_kid_p = json_string_value(json_object_get(config->j_params, "client-alg_kid-parameter"));
-  unsigned char key[64] = {0};
-  size_t key_len = 64;
+static void free_client_enc_jwks(void * data) {
+  struct _oidc_client_enc_jwks * client_enc_jwks = (struct _oidc_client_enc_jwks *)data;
+
+  if (client_enc_jwks != NULL) {
+    o_free(client_enc_jwks->client_id);
+    o_free(client_enc_jwks->fingerprint);
+    r_jwks_free(client_enc_jwks->jwks);
+    o_free(client_enc_jwks);
+  }
+}
+
+static char * get_client_enc_jwks_fingerprint(struct _oidc_config * config, json_t * j_client) {
+  json_t * j_pubkey = json_object_get(j_client, json_string_value(json_object_get(config->j_params, "client-pubkey-parameter"))),
+         * j_jwks = json_object_get(j_client, json_string_value(json_object_get(config->j_params, "client-jwks-parameter"))),
+         * j_jwks_uri = json_object_get(j_client, json_string_value(json_object_get(config->j_params, "client-jwks_uri-parameter")));
+  char * str_jwks = NULL, * data = NULL, * fingerprint = NULL;
+
+  if (json_string_null_or_empty(json_object_get(j_client, "client_id"))) {
+    return NULL;
+  }
+  if (json_string_null_or_empty(j_pubkey) && j_jwks == NULL && json_string_null_or_empty(j_jwks_uri)) {
+    return NULL;
+  }
+  if (j_jwks != NULL) {
+    str_jwks = json_dumps(j_jwks, JSON_COMPACT|JSON_SORT_KEYS);
+  }
+  if ((data = msprintf("%s\n%s\n%s", json_string_null_or_empty(j_pubkey)?"":json_string_value(j_pubkey), str_jwks!=NULL?str_jwks:"", json_string_null_or_empty(j_jwks_uri)?"":json_string_value(j_jwks_uri))) != NULL) {
+    fingerprint = config->glewlwyd_config->glewlwyd_callback_generate_hash(config->glewlwyd_config, data);
+  }
+  o_free(str_jwks);
+  o_free(data);
+  return fingerprint;
+}
+
+static jwks_t * build_client_enc_jwks(struct _oidc_config * config, json_t * j_client, int * complete) {
+  jwks_t * jwks_pub = NULL;
+  jwk_t * jwk_import = NULL;
 
+  *complete = 1;
   if (r_jwks_init(&jwks_pub) == RHN_OK) {
     if (!json_string_null_or_empty(json_object_get(j_client, json_string_value(json_object_get(config->j_params, "client-pubkey-parameter"))))) {
       if ((jwk_import = r_jwk_quick_import(R_IMPORT_PEM, R_X509_TYPE_UNSPECIFIED, json_string_value(json_object_get(j_client, json_string_value(json_object_get(config->j_params, "client-pubkey-parameter")))), json_string_length(json_object_get(j_client, json_string_value(json_object_get(config->j_params, "client-pubkey-parameter")))))) != NULL) {
         r_jwks_append_jwk(jwks_pub, jwk_import);
         r_jwk_free(jwk_import);
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "build_client_enc_jwks - Error r_jwk_quick_import");
+        *complete = 0;
       }
     }
     if (json_object_get(j_client, json_string_value(json_object_get(config->j_params, "client-jwks-parameter"))) != NULL) {
       if (r_jwks_import_from_json_t(jwks_pub, json_object_get(j_client, json_string_value(json_object_get(config->j_params, "client-jwks-parameter")))) != RHN_OK) {
-        y_log_message(Y_LOG_LEVEL_ERROR, "get_jwk_enc - Error r_jwks_import_from_json_t");
+        y_log_message(Y_LOG_LEVEL_ERROR, "build_client_enc_jwks - Error r_jwks_import_from_json_t");
+        *complete = 0;
       }
     }
     if (!json_string_null_or_empty(json_object_get(j_client, json_string_value(json_object_get(config->j_params, "client-jwks_uri-parameter"))))) {
       if (r_jwks_import_from_uri(jwks_pub, json_string_value(json_object_get(j_client, json_string_value(json_object_get(config->j_params, "client-jwks_uri-parameter")))), config->x5u_flags) != RHN_OK) {
-        y_log_message(Y_LOG_LEVEL_ERROR, "get_jwk_enc - Error r_jwks_import_from_uri");
+        y_log_message(Y_LOG_LEVEL_ERROR, "build_client_enc_jwks - Error r_jwks_import_from_uri");
+        *complete = 0;
       }
     }
-    if (!json_string_null_or_empty(json_object_get(j_client, alg_kid_p))) {
-      jwk = r_jwks_get_by_kid(jwks_pub, json_string_value(json_object_get(j_client, alg_kid_p)));
-      if (jwk == NULL) {
-        y_log_message(Y_LOG_LEVEL_DEBUG, "Error, kid '%s' specified for client '%s' is invalid", json_string_value(json_object_get(j_client, alg_kid_p)), json_string_value(json_object_get(j_client, "client_id")));
-      }
-    } else if (alg == R_JWA_ALG_RSA1_5 || alg == R_JWA_ALG_RSA_OAEP || alg == R_JWA_ALG_RSA_OAEP_256) {
-      jwks_subset = r_jwks_search_json_str(jwks_pub, "{\"kty\":\"RSA\"}");
-      jwk = r_jwks_get_at(jwks_subset, 0);
-      r_jwks_free(jwks_subset);
-    } else if (alg == R_JWA_ALG_ECDH_ES || alg == R_JWA_ALG_ECDH_ES_A128KW || alg == R_JWA_ALG_ECDH_ES_A192KW || alg == R_JWA_ALG_ECDH_ES_A256KW) {
-      jwks_subset = r_jwks_search_json_str(jwks_pub, "{\"kty\":\"EC\"}");
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "build_client_enc_jwks - Error r_jwks_init");
+  }
+  return jwks_pub;
+}
+
+static jwk_t * select_client_enc_jwk(struct _oidc_config * config, jwks_t * jwks_pub, json_t * j_client, jwa_alg alg) {
+  jwks_t * jwks_subset;
+  jwk_t * jwk = NULL;
+  const char * alg_kid_p = json_string_value(json_object_get(config->j_params, "client-alg_kid-parameter"));
+
+  if (!json_string_null_or_empty(json_object_get(j_client, alg_kid_p))) {
+    jwk = r_jwks_get_by_kid(jwks_pub, json_string_value(json_object_get(j_client, alg_kid_p)));
+    if (jwk == NULL) {
+      y_log_message(Y_LOG_LEVEL_DEBUG, "Error, kid '%s' specified for client '%s' is invalid", json_string_value(json_object_get(j_client, alg_kid_p)), json_string_value(json_object_get(j_client, "client_id")));
+    }
+  } else if (alg == R_JWA_ALG_RSA1_5 || alg == R_JWA_ALG_RSA_OAEP || alg == R_JWA_ALG_RSA_OAEP_256) {
+    jwks_subset = r_jwks_search_json_str(jwks_pub, "{\"kty\":\"RSA\"}");
+    jwk = r_jwks_get_at(jwks_subset, 0);
+    r_jwks_free(jwks_subset);
+  } else if (alg == R_JWA_ALG_ECDH_ES || alg == R_JWA_ALG_ECDH_ES_A128KW || alg == R_JWA_ALG_ECDH_ES_A192KW || alg == R_JWA_ALG_ECDH_ES_A256KW) {
+    jwks_subset = r_jwks_search_json_str(jwks_pub, "{\"kty\":\"EC\"}");
+    jwk = r_jwks_get_at(jwks_subset, 0);
+    r_jwks_free(jwks_subset);
+    if (jwk == NULL) {
+      jwks_subset = r_jwks_search_json_str(jwks_pub, "{\"kty\":\"OKP\"}");
       jwk = r_jwks_get_at(jwks_subset, 0);
       r_jwks_free(jwks_subset);
-      if (jwk == NULL) {
-        jwks_subset = r_jwks_search_json_str(jwks_pub, "{\"kty\":\"OKP\"}");
-        jwk = r_jwks_get_at(jwks_subset, 0);
-        r_jwks_free(jwks_subset);
-      }
-    } else if (alg == R_JWA_ALG_A128KW || alg == R_JWA_ALG_A192KW || alg == R_JWA_ALG_A256KW ||
-               alg == R_JWA_ALG_A128GCMKW || alg == R_JWA_ALG_A192GCMKW || alg == R_JWA_ALG_A256GCMKW ||
-               alg == R_JWA_ALG_PBES2_H256 || alg == R_JWA_ALG_PBES2_H384 || alg == R_JWA_ALG_PBES2_H512) {
-      if (!json_string_null_or_empty(json_object_get(j_client, "client_secret"))) {
-        if (generate_digest_raw((alg == R_JWA_ALG_DIR?digest_SHA512:digest_SHA256), (const unsigned char *)json_string_value(json_object_get(j_client, "client_secret")), json_string_length(json_object_get(j_client, "client_secret")), key, &key_len)) {
-          if (alg == R_JWA_ALG_DIR) {
-            key_len = get_enc_key_size(enc);
-          } else if (alg == R_JWA_ALG_A128GCMKW || alg == R_JWA_ALG_A128KW) {
-            key_len = 16;
-          } else if (alg == R_JWA_ALG_A192GCMKW || alg == R_JWA_ALG_A192KW) {
-            key_len = 24;
-          }
-          jwk = r_jwk_quick_import(R_IMPORT_SYMKEY, key, key_len);
-        } else {
-          y_log_message(Y_LOG_LEVEL_ERROR, "get_jwk_enc - Error generate_digest_raw");
-        }
+    }
+  }
+  return jwk;
+}
+
+/**
+ * Return the client encryption key, the client jwks is kept in cache
+ * until the client properties change or the cache duration expires
+ * If another thread has cached the same client in the meantime,
+ * its entry is replaced so the list holds one entry per client
+ */
+static jwk_t * get_jwk_enc_from_client_jwks(struct _oidc_config * config, json_t * j_client, jwa_alg alg) {
+  char * fingerprint = get_client_enc_jwks_fingerprint(config, j_client);
+  struct _oidc_client_enc_jwks * client_enc_jwks = NULL, * cur;
+  jwks_t * jwks_pub = NULL;
+  jwk_t * jwk = NULL;
+  time_t now;
+  size_t i;
+  int complete = 0;
+
+  if (fingerprint == NULL) {
+    return NULL;
+  }
+  time(&now);
+  pthread_mutex_lock(&config->client_enc_jwks_lock);
+  for (i=0; i<pointer_list_size(&config->client_enc_jwks_list); i++) {
+    cur = (struct _oidc_client_enc_jwks *)pointer_list_get_at(&config->client_enc_jwks_list, i);
+    if (0 == o_strcmp(cur->client_id, json_string_value(json_object_get(j_client, "client_id")))) {
+      if (0 == o_strcmp(cur->fingerprint, fingerprint) && cur->expires_at > now) {
+        client_enc_jwks = cur;
       } else {
-        y_log_message(Y_LOG_LEVEL_ERROR, "get_jwk_enc - Client '%s' has no secret available", json_string_value(json_object_get(j_client, "client_id")));
+        pointer_list_remove_pointer(&config->client_enc_jwks_list, cur);
+        free_client_enc_jwks(cur);
       }
+      break;
+    }
+  }
+  if (client_enc_jwks != NULL) {
+    jwk = select_client_enc_jwk(config, client_enc_jwks->jwks, j_client, alg);
+  }
+  pthread_mutex_unlock(&config->client_enc_jwks_lock);
+
+  if (client_enc_jwks == NULL && (jwks_pub = build_client_enc_jwks(config, j_client, &complete)) != NULL) {
+    jwk = select_client_enc_jwk(config, jwks_pub, j_client, alg);
+    if ((client_enc_jwks = o_malloc(sizeof(struct _oidc_client_enc_jwks))) != NULL) {
+      client_enc_jwks->client_id = o_strdup(json_string_value(json_object_get(j_client, "client_id")));
+      client_enc_jwks->fingerprint = fingerprint;
+      client_enc_jwks->expires_at = now + (complete?GLEWLWYD_CLIENT_ENC_JWKS_CACHE_DURATION:GLEWLWYD_CLIENT_ENC_JWKS_CACHE_ERROR_DURATION);
+      client_enc_jwks->jwks = jwks_pub;
+      fingerprint = NULL;
+      jwks_pub = NULL;
+      pthread_mutex_lock(&config->client_enc_jwks_lock);
+      for (i=0; i<pointer_list_size(&config->client_enc_jwks_list); i++) {
+        cur = (struct _oidc_client_enc_jwks *)pointer_list_get_at(&config->client_enc_jwks_list, i);
+        if (0 == o_strcmp(cur->client_id, client_enc_jwks->client_id)) {
+          pointer_list_remove_pointer(&config->client_enc_jwks_list, cur);
+          free_client_enc_jwks(cur);
+          break;
+        }
+      }
+      if (pointer_list_size(&config->client_enc_jwks_list) >= GLEWLWYD_CLIENT_ENC_JWKS_CACHE_MAX_SIZE) {
+        cur = (struct _oidc_client_enc_jwks *)pointer_list_get_at(&config->client_enc_jwks_list, 0);
+        pointer_list_remove_pointer(&config->client_enc_jwks_list, cur);
+        free_client_enc_jwks(cur);
+      }
+      if (!pointer_list_append(&config->client_enc_jwks_list, client_enc_jwks)) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "get_jwk_enc_from_client_jwks - Error pointer_list_append");
+        free_client_enc_jwks(client_enc_jwks);
+      }
+      pthread_mutex_unlock(&config->client_enc_jwks_lock);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "get_jwk_enc_from_client_jwks - Error allocating resources for client_enc_jwks");
     }
     r_jwks_free(jwks_pub);
-  } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "get_jwk_enc - Error r_jwks_init");
+  }
+  o_free(fingerprint);
+  return jwk;
+}
+
+static jwk_t * get_jwk_enc(struct _oidc_config * config, json_t * j_client, jwa_alg alg, jwa_enc enc) {
+  jwk_t * jwk = NULL;
+  const char * alg_kid_p = json_string_value(json_object_get(config->j_params, "client-alg_kid-parameter"));
+  unsigned char key[64] = {0};
+  size_t key_len = 64;
+
+  if (!json_string_null_or_empty(json_object_get(j_client, alg_kid_p)) ||
+      alg == R_JWA_ALG_RSA1_5 || alg == R_JWA_ALG_RSA_OAEP || alg == R_JWA_ALG_RSA_OAEP_256 ||
+      alg == R_JWA_ALG_ECDH_ES || alg == R_JWA_ALG_ECDH_ES_A128KW || alg == R_JWA_ALG_ECDH_ES_A192KW || alg == R_JWA_ALG_ECDH_ES_A256KW) {
+    jwk = get_jwk_enc_from_client_jwks(config, j_client, alg);
+  } else if (alg == R_JWA_ALG_A128KW || alg == R_JWA_ALG_A192KW || alg == R_JWA_ALG_A256KW ||
+             alg == R_JWA_ALG_A128GCMKW || alg == R_JWA_ALG_A192GCMKW || alg == R_JWA_ALG_A256GCMKW ||
+             alg == R_JWA_ALG_PBES2_H256 || alg == R_JWA_ALG_PBES2_H384 || alg == R_JWA_ALG_PBES2_H512) {
+    if (!json_string_null_or_empty(json_object_get(j_client, "client_secret"))) {
+      if (generate_digest_raw((alg == R_JWA_ALG_DIR?digest_SHA512:digest_SHA256), (const unsigned char *)json_string_value(json_object_get(j_client, "client_secret")), json_string_length(json_object_get(j_client, "client_secret")), key, &key_len)) {
+        if (alg == R_JWA_ALG_DIR) {
+          key_len = get_enc_key_size(enc);
+        } else if (alg == R_JWA_ALG_A128GCMKW || alg == R_JWA_ALG_A128KW) {
+          key_len = 16;
+        } else if (alg == R_JWA_ALG_A192GCMKW || alg == R_JWA_ALG_A192KW) {
+          key_len = 24;
+        }
+        jwk = r_jwk_quick_import(R_IMPORT_SYMKEY, key, key_len);
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "get_jwk_enc - Error generate_digest_raw");
+      }
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "get_jwk_enc - Client '%s' has no secret available", json_string_value(json_object_get(j_client, "client_id")));
+    }
   }
   return jwk;
 }
@@ -2452,9 +2841,12 @@ static char * generate_x_hash(struct _oidc_config * config, json_t * j_client, c
   unsigned char x_hash[128] = {0};
   size_t x_hash_len = 128, x_hash_encoded_len = 0;
   char * to_return = NULL, x_hash_encoded[128] = {0};
+  struct _oidc_sign_keys * sign_keys;
 
   if (value != NULL && j_client != NULL) {
-    key_size = get_key_size_from_alg(r_jwa_alg_to_str(get_token_sign_alg(config, j_client, GLEWLWYD_TOKEN_TYPE_ID_TOKEN)));
+    sign_keys = acquire_sign_keys(config);
+    key_size = get_key_size_from_alg(r_jwa_alg_to_str(get_token_sign_alg(config, sign_keys, j_client, GLEWLWYD_TOKEN_TYPE_ID_TOKEN)));
+    release_sign_keys(sign_keys);
     if (key_size == 256) dig_alg = GNUTLS_DIG_SHA256;
     else if (key_size == 384) dig_alg = GNUTLS_DIG_SHA384;
     else if (key_size == 512) dig_alg = GNUTLS_DIG_SHA512;
@@ -2490,8 +2882,9 @@ static char * generate_client_access_token(struct _oidc_config * config,
                                            const char * dpop_jkt,
                                            const char * ip_source) {
   jwt_t * jwt;
-  jwa_alg alg = get_token_sign_alg(config, j_client, GLEWLWYD_TOKEN_TYPE_ACCESS_TOKEN);
-  jwk_t * jwk = get_jwk_sign(config, j_client, alg);
+  struct _oidc_sign_keys * sign_keys = acquire_sign_keys(config);
+  jwa_alg alg = get_token_sign_alg(config, sign_keys, j_client, GLEWLWYD_TOKEN_TYPE_ACCESS_TOKEN);
+  jwk_t * jwk = get_jwk_sign(config, sign_keys, j_client, alg);
   char * token = NULL, * property = NULL;
   json_t * j_element = NULL, * j_value, * j_cnf;
   size_t index = 0, index_p = 0;
@@ -2561,6 +2954,7 @@ static char * generate_client_access_token(struct _oidc_config * config,
     y_log_message(Y_LOG_LEVEL_ERROR, "generate_client_access_token - oidc - Error no jwk available");
   }
   r_jwk_free(jwk);
+  release_sign_keys(sign_keys);
   return token;
 }
 
@@ -3210,8 +3604,9 @@ static char * generate_id_token(struct _oidc_config * config,
                                 const char * sid,
                                 const char * ip_source) {
   jwt_t * jwt;
-  jwa_alg alg = get_token_sign_alg(config, j_client, GLEWLWYD_TOKEN_TYPE_ID_TOKEN);
-  jwk_t * jwk = get_jwk_sign(config, j_client, alg);
+  struct _oidc_sign_keys * sign_keys = acquire_sign_keys(config);
+  jwa_alg alg = get_token_sign_alg(config, sign_keys, j_client, GLEWLWYD_TOKEN_TYPE_ID_TOKEN);
+  jwk_t * jwk = get_jwk_sign(config, sign_keys, j_client, alg);
   int key_size = get_key_size_from_alg(r_jwa_alg_to_str(alg));
   char * token = NULL, at_hash_encoded[128] = {0}, c_hash_encoded[128] = {0}, rt_hash_encoded[128] = {0}, * sub = get_sub(config, username, j_client);
   unsigned char at_hash[128] = {0}, c_hash[128] = {0}, rt_hash[128] = {0};
@@ -3335,10 +3730,46 @@ static char * generate_id_token(struct _oidc_config * config,
     y_log_message(Y_LOG_LEVEL_ERROR, "generate_id_token - oidc - Error no sign jwk available");
   }
   r_jwk_free(jwk);
+  release_sign_keys(sign_keys);
   o_free(sub);
   return token;
 }
 
+/**
+ * Get the id of a token row from its hash
+ * Token hashes are unique, so the row can be found by its natural key
+ * without relying on the connection-wide last insert id
+ */
+static json_t * get_token_id_from_hash(struct _oidc_config * config, const char * table, const char * id_column, const char * plugin_column, const char * hash_column, const char * token_hash) {
+  json_t * j_query, * j_result = NULL, * j_return = NULL;
+  int res;
+
+  j_query = json_pack("{sss[s]s{ssss}}",
+                      "table",
+                      table,
+                      "columns",
+                        id_column,
+                      "where",
+                        plugin_column,
+                        config->name,
+                        hash_column,
+                        token_hash);
+  res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result, NULL);
+  json_decref(j_query);
+  if (res == H_OK) {
+    if (json_array_size(j_result) == 1) {
+      j_return = json_incref(json_object_get(json_array_get(j_result, 0), id_column));
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "get_token_id_from_hash - oidc - Error token not found in table %s", table);
+    }
+    json_decref(j_result);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "get_token_id_from_hash - oidc - Error executing j_query");
+    config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+  }
+  return j_return;
+}
+
 /**
  * Store a signature of the acces token in the database
  */
@@ -3359,106 +3790,100 @@ static int serialize_access_token(struct _oidc_config * config,
   int res, ret, i;
   char * issued_at_clause, ** scope_array = NULL, * access_token_hash = NULL, * str_authorization_details = NULL;
 
-  if (pthread_mutex_lock(&config->insert_lock)) {
-    y_log_message(Y_LOG_LEVEL_ERROR, "serialize_access_token - oidc - Error pthread_mutex_lock");
-    ret = G_ERROR;
-  } else {
-    if ((access_token_hash = config->glewlwyd_config->glewlwyd_callback_generate_hash(config->glewlwyd_config, access_token)) != NULL) {
-      if (issued_for != NULL && now > 0) {
-        if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_MARIADB) {
-          issued_at_clause = msprintf("FROM_UNIXTIME(%u)", (now));
-        } else if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_PGSQL) {
-          issued_at_clause = msprintf("TO_TIMESTAMP(%u)", (now));
-        } else { // HOEL_DB_TYPE_SQLITE
-          issued_at_clause = msprintf("%u", (now));
-        }
-        if (j_authorization_details != NULL) {
-          str_authorization_details = json_dumps(j_authorization_details, JSON_COMPACT);
-        }
-        j_query = json_pack("{sss{sssisososos{ss}ssssssss#ss?ss?}}",
-                            "table",
-                            GLEWLWYD_PLUGIN_OIDC_TABLE_ACCESS_TOKEN,
-                            "values",
-                              "gpoa_plugin_name",
-                              config->name,
-                              "gpoa_authorization_type",
-                              auth_type,
-                              "gpor_id",
-                              gpor_id?json_integer(gpor_id):json_null(),
-                              "gpoa_username",
-                              username!=NULL?json_string(username):json_null(),
-                              "gpoa_client_id",
-                              client_id!=NULL?json_string(client_id):json_null(),
-                              "gpoa_issued_at",
-                                "raw",
-                                issued_at_clause,
-                              "gpoa_issued_for",
-                              issued_for,
-                              "gpoa_user_agent",
-                              user_agent!=NULL?user_agent:"",
-                              "gpoa_token_hash",
-                              access_token_hash,
-                              "gpoa_jti",
-                              jti, OIDC_JTI_LENGTH,
-                              "gpoa_resource",
-                              resource,
-                              "gpoa_authorization_details",
-                              str_authorization_details);
-        o_free(issued_at_clause);
-        o_free(str_authorization_details);
-        res = h_insert(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
-        json_decref(j_query);
-        if (res == H_OK) {
-          j_last_id = h_last_insert_id(config->glewlwyd_config->glewlwyd_config->conn);
-          if (j_last_id != NULL) {
-            config->glewlwyd_config->glewlwyd_callback_update_issued_for(config->glewlwyd_config, NULL, GLEWLWYD_PLUGIN_OIDC_TABLE_ACCESS_TOKEN, "gpoa_issued_for", issued_for, "gpoa_id", json_integer_value(j_last_id));
-            if (split_string(scope_list, " ", &scope_array) > 0) {
-              j_query = json_pack("{sss[]}",
-                                  "table",
-                                  GLEWLWYD_PLUGIN_OIDC_TABLE_ACCESS_TOKEN_SCOPE,
-                                  "values");
-              if (j_query != NULL) {
-                for (i=0; scope_array[i] != NULL; i++) {
-                  json_array_append_new(json_object_get(j_query, "values"), json_pack("{sOss}", "gpoa_id", j_last_id, "gpoas_scope", scope_array[i]));
-                }
-                res = h_insert(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
-                json_decref(j_query);
-                if (res == H_OK) {
-                  ret = G_OK;
-                } else {
-                  y_log_message(Y_LOG_LEVEL_ERROR, "serialize_access_token - oidc - Error executing j_query (2)");
-                  config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
-                  ret = G_ERROR_DB;
-                }
-              } else {
-                y_log_message(Y_LOG_LEVEL_ERROR, "serialize_access_token - oidc - Error json_pack");
-                ret = G_ERROR;
-              }
-            } else {
-              y_log_message(Y_LOG_LEVEL_ERROR, "serialize_access_token - oidc - Error split_string");
-              ret = G_ERROR;
-            }
-            free_string_array(scope_array);
-          } else {
-            y_log_message(Y_LOG_LEVEL_ERROR, "serialize_access_token - oidc - Error h_last_insert_id");
-            config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
-            ret = G_ERROR_DB;
-          }
-          json_decref(j_last_id);
-        } else {
-          y_log_message(Y_LOG_LEVEL_ERROR, "serialize_access_token - oidc - Error executing j_query (1)");
-          config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
-          ret = G_ERROR_DB;
-        }
-      } else {
-        ret = G_ERROR_PARAM;
-      }
-      o_free(access_token_hash);
-    } else {
-      y_log_message(Y_LOG_LEVEL_ERROR, "oidc serialize_access_token - Error glewlwyd_callback_generate_hash");
-      ret = G_ERROR;
-    }
-    pthread_mutex_unlock(&config->insert_lock);
+  if ((access_token_hash = config->glewlwyd_config->glewlwyd_callback_generate_hash(config->glewlwyd_config, access_token)) != NULL) {
+    if (issued_for != NULL && now > 0) {
+      if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_MARIADB) {
+        issued_at_clause = msprintf("FROM_UNIXTIME(%u)", (now));
+      } else if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_PGSQL) {
+        issued_at_clause = msprintf("TO_TIMESTAMP(%u)", (now));
+      } else { // HOEL_DB_TYPE_SQLITE
+        issued_at_clause = msprintf("%u", (now));
+      }
+      if (j_authorization_details != NULL) {
+        str_authorization_details = json_dumps(j_authorization_details, JSON_COMPACT);
+      }
+      j_query = json_pack("{sss{sssisososos{ss}ssssssss#ss?ss?}}",
+                          "table",
+                          GLEWLWYD_PLUGIN_OIDC_TABLE_ACCESS_TOKEN,
+                          "values",
+                            "gpoa_plugin_name",
+                            config->name,
+                            "gpoa_authorization_type",
+                            auth_type,
+                            "gpor_id",
+                            gpor_id?json_integer(gpor_id):json_null(),
+                            "gpoa_username",
+                            username!=NULL?json_string(username):json_null(),
+                            "gpoa_client_id",
+                            client_id!=NULL?json_string(client_id):json_null(),
+                            "gpoa_issued_at",
+                              "raw",
+                              issued_at_clause,
+                            "gpoa_issued_for",
+                            issued_for,
+                            "gpoa_user_agent",
+                            user_agent!=NULL?user_agent:"",
+                            "gpoa_token_hash",
+                            access_token_hash,
+                            "gpoa_jti",
+                            jti, OIDC_JTI_LENGTH,
+                            "gpoa_resource",
+                            resource,
+                            "gpoa_authorization_details",
+                            str_authorization_details);
+      o_free(issued_at_clause);
+      o_free(str_authorization_details);
+      res = h_insert(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
+      json_decref(j_query);
+      if (res == H_OK) {
+        j_last_id = get_token_id_from_hash(config, GLEWLWYD_PLUGIN_OIDC_TABLE_ACCESS_TOKEN, "gpoa_id", "gpoa_plugin_name", "gpoa_token_hash", access_token_hash);
+        if (j_last_id != NULL) {
+          config->glewlwyd_config->glewlwyd_callback_update_issued_for(config->glewlwyd_config, NULL, GLEWLWYD_PLUGIN_OIDC_TABLE_ACCESS_TOKEN, "gpoa_issued_for", issued_for, "gpoa_id", json_integer_value(j_last_id));
+          if (split_string(scope_list, " ", &scope_array) > 0) {
+            j_query = json_pack("{sss[]}",
+                                "table",
+                                GLEWLWYD_PLUGIN_OIDC_TABLE_ACCESS_TOKEN_SCOPE,
+                                "values");
+            if (j_query != NULL) {
+              for (i=0; scope_array[i] != NULL; i++) {
+                json_array_append_new(json_object_get(j_query, "values"), json_pack("{sOss}", "gpoa_id", j_last_id, "gpoas_scope", scope_array[i]));
+              }
+              res = h_insert(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
+              json_decref(j_query);
+              if (res == H_OK) {
+                ret = G_OK;
+              } else {
+                y_log_message(Y_LOG_LEVEL_ERROR, "serialize_access_token - oidc - Error executing j_query (2)");
+                config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+                ret = G_ERROR_DB;
+              }
+            } else {
+              y_log_message(Y_LOG_LEVEL_ERROR, "serialize_access_token - oidc - Error json_pack");
+              ret = G_ERROR;
+            }
+          } else {
+            y_log_message(Y_LOG_LEVEL_ERROR, "serialize_access_token - oidc - Error split_string");
+            ret = G_ERROR;
+          }
+          free_string_array(scope_array);
+        } else {
+          y_log_message(Y_LOG_LEVEL_ERROR, "serialize_access_token - oidc - Error get_token_id_from_hash");
+          config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+          ret = G_ERROR_DB;
+        }
+        json_decref(j_last_id);
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "serialize_access_token - oidc - Error executing j_query (1)");
+        config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+        ret = G_ERROR_DB;
+      }
+    } else {
+      ret = G_ERROR_PARAM;
+    }
+    o_free(access_token_hash);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "oidc serialize_access_token - Error glewlwyd_callback_generate_hash");
+    ret = G_ERROR;
   }
   return ret;
 }
@@ -3480,8 +3905,9 @@ static char * generate_access_token(struct _oidc_config * config,
                                     json_t * j_authorization_details,
                                     const char * ip_source) {
   jwt_t * jwt;
-  jwa_alg alg = get_token_sign_alg(config, j_client, GLEWLWYD_TOKEN_TYPE_ACCESS_TOKEN);
-  jwk_t * jwk = get_jwk_sign(config, j_client, alg);
+  struct _oidc_sign_keys * sign_keys = acquire_sign_keys(config);
+  jwa_alg alg = get_token_sign_alg(config, sign_keys, j_client, GLEWLWYD_TOKEN_TYPE_ACCESS_TOKEN);
+  jwk_t * jwk = get_jwk_sign(config, sign_keys, j_client, alg);
   char * token = NULL, * property = NULL, * sub = get_sub(config, username, j_client);
   json_t * j_element = NULL, * j_value, * j_cnf;
   size_t index = 0, index_p = 0;
@@ -3571,6 +3997,7 @@ static char * generate_access_token(struct _oidc_config * config,
   }
   o_free(sub);
   r_jwk_free(jwk);
+  release_sign_keys(sign_keys);
   return token;
 }
 
@@ -3599,128 +4026,122 @@ static json_t * serialize_refresh_token(struct _oidc_config * config,
   int res, i;
   char * issued_at_clause, * expires_at_clause, * last_seen_clause, ** scope_array = NULL, * str_claims_request = NULL, * str_authorization_details = NULL;
 
-  if (pthread_mutex_lock(&config->insert_lock)) {
-    y_log_message(Y_LOG_LEVEL_ERROR, "serialize_refresh_token - oidc - Error pthread_mutex_lock");
-    j_return = json_pack("{si}", "result", G_ERROR);
-  } else {
-    if (token_hash != NULL && username != NULL && issued_for != NULL && now > 0 && duration > 0) {
-      json_error_t error;
-      if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_MARIADB) {
-        issued_at_clause = msprintf("FROM_UNIXTIME(%u)", (now));
-      } else if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_PGSQL) {
-        issued_at_clause = msprintf("TO_TIMESTAMP(%u)", (now));
-      } else { // HOEL_DB_TYPE_SQLITE
-        issued_at_clause = msprintf("%u", (now));
-      }
-      if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_MARIADB) {
-        last_seen_clause = msprintf("FROM_UNIXTIME(%u)", (now));
-      } else if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_PGSQL) {
-        last_seen_clause = msprintf("TO_TIMESTAMP(%u)", (now));
-      } else { // HOEL_DB_TYPE_SQLITE
-        last_seen_clause = msprintf("%u", (now));
-      }
-      if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_MARIADB) {
-        expires_at_clause = msprintf("FROM_UNIXTIME(%u)", (now + (unsigned int)duration));
-      } else if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_PGSQL) {
-        expires_at_clause = msprintf("TO_TIMESTAMP(%u)", (now + (unsigned int)duration ));
-      } else { // HOEL_DB_TYPE_SQLITE
-        expires_at_clause = msprintf("%u", (now + (unsigned int)duration));
-      }
-      if (j_claims_request != NULL) {
-        if ((str_claims_request = json_dumps(j_claims_request, JSON_COMPACT)) == NULL) {
-          y_log_message(Y_LOG_LEVEL_ERROR, "serialize_refresh_token - oidc - Error dumping JSON claims request");
-        }
-      }
-      if (j_authorization_details != NULL) {
-        str_authorization_details = json_dumps(j_authorization_details, JSON_COMPACT);
+  if (token_hash != NULL && username != NULL && issued_for != NULL && now > 0 && duration > 0) {
+    json_error_t error;
+    if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_MARIADB) {
+      issued_at_clause = msprintf("FROM_UNIXTIME(%u)", (now));
+    } else if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_PGSQL) {
+      issued_at_clause = msprintf("TO_TIMESTAMP(%u)", (now));
+    } else { // HOEL_DB_TYPE_SQLITE
+      issued_at_clause = msprintf("%u", (now));
+    }
+    if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_MARIADB) {
+      last_seen_clause = msprintf("FROM_UNIXTIME(%u)", (now));
+    } else if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_PGSQL) {
+      last_seen_clause = msprintf("TO_TIMESTAMP(%u)", (now));
+    } else { // HOEL_DB_TYPE_SQLITE
+      last_seen_clause = msprintf("%u", (now));
+    }
+    if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_MARIADB) {
+      expires_at_clause = msprintf("FROM_UNIXTIME(%u)", (now + (unsigned int)duration));
+    } else if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_PGSQL) {
+      expires_at_clause = msprintf("TO_TIMESTAMP(%u)", (now + (unsigned int)duration ));
+    } else { // HOEL_DB_TYPE_SQLITE
+      expires_at_clause = msprintf("%u", (now + (unsigned int)duration));
+    }
+    if (j_claims_request != NULL) {
+      if ((str_claims_request = json_dumps(j_claims_request, JSON_COMPACT)) == NULL) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "serialize_refresh_token - oidc - Error dumping JSON claims request");
       }
-      j_query = json_pack_ex(&error, 0, "{sss{ss si so ss so s{ss} s{ss} s{ss} sI si ss ss ss ss ss? ss? ss?}}",
-                          "table", GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN,
-                          "values",
-                            "gpor_plugin_name", config->name,
-                            "gpor_authorization_type", auth_type,
-                            "gpoc_id", gpoc_id?json_integer(gpoc_id):json_null(),
-                            "gpor_username", username,
-                            "gpor_client_id", client_id!=NULL?json_string(client_id):json_null(),
-                            "gpor_issued_at",
-                              "raw",
-                              issued_at_clause,
-                            "gpor_last_seen",
-                              "raw",
-                              last_seen_clause,
-                            "gpor_expires_at",
-                              "raw",
-                              expires_at_clause,
-                            "gpor_duration", duration,
-                            "gpor_rolling_expiration", rolling,
-                            "gpor_claims_request", str_claims_request!=NULL?str_claims_request:"",
-                            "gpor_token_hash", token_hash,
-                            "gpor_issued_for", issued_for,
-                            "gpor_user_agent", user_agent!=NULL?user_agent:"",
-                            "gpor_resource", resource,
-                            "gpor_dpop_jkt", dpop_jkt,
-                            "gpor_authorization_details", str_authorization_details);
-      if (config->refresh_token_one_use) {
-        if (o_strnullempty(jti)) {
-          rand_string_nonce(jti, OIDC_JTI_LENGTH);
-        }
-        json_object_set_new(json_object_get(j_query, "values"), "gpor_jti", json_string(jti));
+    }
+    if (j_authorization_details != NULL) {
+      str_authorization_details = json_dumps(j_authorization_details, JSON_COMPACT);
+    }
+    j_query = json_pack_ex(&error, 0, "{sss{ss si so ss so s{ss} s{ss} s{ss} sI si ss ss ss ss ss? ss? ss?}}",
+                        "table", GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN,
+                        "values",
+                          "gpor_plugin_name", config->name,
+                          "gpor_authorization_type", auth_type,
+                          "gpoc_id", gpoc_id?json_integer(gpoc_id):json_null(),
+                          "gpor_username", username,
+                          "gpor_client_id", client_id!=NULL?json_string(client_id):json_null(),
+                          "gpor_issued_at",
+                            "raw",
+                            issued_at_clause,
+                          "gpor_last_seen",
+                            "raw",
+                            last_seen_clause,
+                          "gpor_expires_at",
+                            "raw",
+                            expires_at_clause,
+                          "gpor_duration", duration,
+                          "gpor_rolling_expiration", rolling,
+                          "gpor_claims_request", str_claims_request!=NULL?str_claims_request:"",
+                          "gpor_token_hash", token_hash,
+                          "gpor_issued_for", issued_for,
+                          "gpor_user_agent", user_agent!=NULL?user_agent:"",
+                          "gpor_resource", resource,
+                          "gpor_dpop_jkt", dpop_jkt,
+                          "gpor_authorization_details", str_authorization_details);
+    if (config->refresh_token_one_use) {
+      if (o_strnullempty(jti)) {
+        rand_string_nonce(jti, OIDC_JTI_LENGTH);
       }
-      o_free(issued_at_clause);
-      o_free(expires_at_clause);
-      o_free(last_seen_clause);
-      o_free(str_claims_request);
-      o_free(str_authorization_details);
-      res = h_insert(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
-      json_decref(j_query);
-      if (res == H_OK) {
-        j_last_id = h_last_insert_id(config->glewlwyd_config->glewlwyd_config->conn);
-        if (j_last_id != NULL) {
-          config->glewlwyd_config->glewlwyd_callback_update_issued_for(config->glewlwyd_config, NULL, GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN, "gpor_issued_for", issued_for, "gpor_id", json_integer_value(j_last_id));
-          if (split_string(scope_list, " ", &scope_array) > 0) {
-            j_query = json_pack("{sss[]}",
-                                "table",
-                                GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN_SCOPE,
-                                "values");
-            if (j_query != NULL) {
-              for (i=0; scope_array[i] != NULL; i++) {
-                json_array_append_new(json_object_get(j_query, "values"), json_pack("{sOss}", "gpor_id", j_last_id, "gpors_scope", scope_array[i]));
-              }
-              res = h_insert(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
-              json_decref(j_query);
-              if (res == H_OK) {
-                j_return = json_pack("{sisO}", "result", G_OK, "gpor_id", j_last_id);
-              } else {
-                y_log_message(Y_LOG_LEVEL_ERROR, "serialize_refresh_token - oidc - Error executing j_query (2)");
-                config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
-                j_return = json_pack("{si}", "result", G_ERROR_DB);
-              }
+      json_object_set_new(json_object_get(j_query, "values"), "gpor_jti", json_string(jti));
+    }
+    o_free(issued_at_clause);
+    o_free(expires_at_clause);
+    o_free(last_seen_clause);
+    o_free(str_claims_request);
+    o_free(str_authorization_details);
+    res = h_insert(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
+    json_decref(j_query);
+    if (res == H_OK) {
+      j_last_id = get_token_id_from_hash(config, GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN, "gpor_id", "gpor_plugin_name", "gpor_token_hash", token_hash);
+      if (j_last_id != NULL) {
+        config->glewlwyd_config->glewlwyd_callback_update_issued_for(config->glewlwyd_config, NULL, GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN, "gpor_issued_for", issued_for, "gpor_id", json_integer_value(j_last_id));
+        if (split_string(scope_list, " ", &scope_array) > 0) {
+          j_query = json_pack("{sss[]}",
+                              "table",
+                              GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN_SCOPE,
+                              "values");
+          if (j_query != NULL) {
+            for (i=0; scope_array[i] != NULL; i++) {
+              json_array_append_new(json_object_get(j_query, "values"), json_pack("{sOss}", "gpor_id", j_last_id, "gpors_scope", scope_array[i]));
+            }
+            res = h_insert(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
+            json_decref(j_query);
+            if (res == H_OK) {
+              j_return = json_pack("{sisO}", "result", G_OK, "gpor_id", j_last_id);
             } else {
-              y_log_message(Y_LOG_LEVEL_ERROR, "serialize_refresh_token - oidc - Error json_pack");
-              j_return = json_pack("{si}", "result", G_ERROR);
+              y_log_message(Y_LOG_LEVEL_ERROR, "serialize_refresh_token - oidc - Error executing j_query (2)");
+              config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+              j_return = json_pack("{si}", "result", G_ERROR_DB);
             }
           } else {
-            y_log_message(Y_LOG_LEVEL_ERROR, "serialize_refresh_token - oidc - Error split_string");
+            y_log_message(Y_LOG_LEVEL_ERROR, "serialize_refresh_token - oidc - Error json_pack");
             j_return = json_pack("{si}", "result", G_ERROR);
           }
-          free_string_array(scope_array);
         } else {
-          y_log_message(Y_LOG_LEVEL_ERROR, "serialize_refresh_token - oidc - Error h_last_insert_id");
-          config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
-          j_return = json_pack("{si}", "result", G_ERROR_DB);
+          y_log_message(Y_LOG_LEVEL_ERROR, "serialize_refresh_token - oidc - Error split_string");
+          j_return = json_pack("{si}", "result", G_ERROR);
         }
-        json_decref(j_last_id);
+        free_string_array(scope_array);
       } else {
-        y_log_message(Y_LOG_LEVEL_ERROR, "serialize_refresh_token - oidc - Error executing j_query (1)");
+        y_log_message(Y_LOG_LEVEL_ERROR, "serialize_refresh_token - oidc - Error get_token_id_from_hash");
         config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
         j_return = json_pack("{si}", "result", G_ERROR_DB);
       }
+      json_decref(j_last_id);
     } else {
-      j_return = json_pack("{si}", "result", G_ERROR_PARAM);
+      y_log_message(Y_LOG_LEVEL_ERROR, "serialize_refresh_token - oidc - Error executing j_query (1)");
+      config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+      j_return = json_pack("{si}", "result", G_ERROR_DB);
     }
-    o_free(token_hash);
-    pthread_mutex_unlock(&config->insert_lock);
+  } else {
+    j_return = json_pack("{si}", "result", G_ERROR_PARAM);
   }
+  o_free(token_hash);
   return j_return;
 }
 
@@ -3746,6 +4167,183 @@ static int is_authorization_type_enabled(struct _oidc_config * config, uint auth
   return (authorization_type <= 7)?config->auth_type_enabled[authorization_type]:0;
 }
 
+/**
+ * djb2 hash of a string, used for the in-memory buckets and hash sets
+ */
+static size_t get_string_hash(const char * str) {
+  size_t hash = 5381;
+
+  for (; str != NULL && *str != '\0'; str++) {
+    hash = ((hash << 5) + hash) + (unsigned char)*str;
+  }
+  return hash;
+}
+
+static void free_client_redirect_uri(void * data) {
+  struct _oidc_client_redirect_uri * client_redirect_uri = (struct _oidc_client_redirect_uri *)data;
+  size_t i;
+
+  if (client_redirect_uri != NULL) {
+    for (i=0; i<client_redirect_uri->table_size; i++) {
+      o_free(client_redirect_uri->uri_table[i]);
+    }
+    o_free(client_redirect_uri->uri_table);
+    o_free(client_redirect_uri->client_id);
+    o_free(client_redirect_uri);
+  }
+}
+
+/**
+ * Build the hash set of the client redirect URIs, the table is at least twice as big as the number of URIs
+ */
+static struct _oidc_client_redirect_uri * build_client_redirect_uri(json_t * j_client) {
+  struct _oidc_client_redirect_uri * client_redirect_uri;
+  json_t * j_element = NULL;
+  size_t index = 0, slot;
+
+  if ((client_redirect_uri = o_malloc(sizeof(struct _oidc_client_redirect_uri))) != NULL) {
+    client_redirect_uri->client_id = o_strdup(json_string_value(json_object_get(j_client, "client_id")));
+    client_redirect_uri->nb_uri = json_array_size(json_object_get(j_client, "redirect_uri"));
+    client_redirect_uri->table_size = 8;
+    while (client_redirect_uri->table_size < (client_redirect_uri->nb_uri<<1)) {
+      client_redirect_uri->table_size <<= 1;
+    }
+    client_redirect_uri->expires_at = 0;
+    if ((client_redirect_uri->uri_table = o_malloc(client_redirect_uri->table_size*sizeof(char *))) != NULL) {
+      memset(client_redirect_uri->uri_table, 0, client_redirect_uri->table_size*sizeof(char *));
+      json_array_foreach(json_object_get(j_client, "redirect_uri"), index, j_element) {
+        if (json_string_length(j_element)) {
+          slot = get_string_hash(json_string_value(j_element))&(client_redirect_uri->table_size-1);
+          while (client_redirect_uri->uri_table[slot] != NULL && 0 != o_strcmp(client_redirect_uri->uri_table[slot], json_string_value(j_element))) {
+            slot = (slot+1)&(client_redirect_uri->table_size-1);
+          }
+          if (client_redirect_uri->uri_table[slot] == NULL) {
+            client_redirect_uri->uri_table[slot] = o_strdup(json_string_value(j_element));
+          }
+        }
+      }
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "build_client_redirect_uri - Error allocating resources for uri_table");
+      client_redirect_uri->table_size = 0;
+      free_client_redirect_uri(client_redirect_uri);
+      client_redirect_uri = NULL;
+    }
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "build_client_redirect_uri - Error allocating resources for client_redirect_uri");
+  }
+  return client_redirect_uri;
+}
+
+static int has_client_redirect_uri(struct _oidc_client_redirect_uri * client_redirect_uri, const char * redirect_uri) {
+  size_t slot = get_string_hash(redirect_uri)&(client_redirect_uri->table_size-1);
+
+  while (client_redirect_uri->uri_table[slot] != NULL) {
+    if (0 == o_strcmp(client_redirect_uri->uri_table[slot], redirect_uri)) {
+      return 1;
+    }
+    slot = (slot+1)&(client_redirect_uri->table_size-1);
+  }
+  return 0;
+}
+
+/**
+ * Verify if redirect_uri is registered for the client
+ * The client redirect URIs hash set is kept in cache until the client is updated or the cache duration expires,
+ * the cache duration is shorter if there's no cache invalidation backend to get the updates of the other instances
+ */
+static int is_client_redirect_uri_valid(struct _oidc_config * config, json_t * j_client, const char * redirect_uri) {
+  const char * client_id = json_string_value(json_object_get(j_client, "client_id"));
+  struct _pointer_list * bucket = &config->client_redirect_uri_list[get_string_hash(client_id)%GLEWLWYD_CLIENT_REDIRECT_URI_BUCKETS];
+  struct _oidc_client_redirect_uri * client_redirect_uri = NULL, * cur;
+  size_t nb_uri = json_array_size(json_object_get(j_client, "redirect_uri"));
+  int found = 0, cached = 0;
+  time_t now;
+  size_t i;
+
+  if (o_strnullempty(redirect_uri)) {
+    return 0;
+  }
+  time(&now);
+  pthread_mutex_lock(&config->client_redirect_uri_lock);
+  for (i=0; i<pointer_list_size(bucket); i++) {
+    cur = (struct _oidc_client_redirect_uri *)pointer_list_get_at(bucket, i);
+    if (0 == o_strcmp(cur->client_id, client_id)) {
+      if (cur->expires_at > now && cur->nb_uri == nb_uri) {
+        found = has_client_redirect_uri(cur, redirect_uri);
+        cached = 1;
+      } else {
+        pointer_list_remove_pointer(bucket, cur);
+        free_client_redirect_uri(cur);
+      }
+      break;
+    }
+  }
+  pthread_mutex_unlock(&config->client_redirect_uri_lock);
+
+  if (!cached) {
+    if ((client_redirect_uri = build_client_redirect_uri(j_client)) != NULL) {
+      found = has_client_redirect_uri(client_redirect_uri, redirect_uri);
+      if (config->glewlwyd_config->glewlwyd_config->cache_invalidation_backend != GLEWLWYD_CACHE_INVALIDATION_BACKEND_NONE) {
+        client_redirect_uri->expires_at = now + GLEWLWYD_CLIENT_REDIRECT_URI_CACHE_DURATION;
+      } else {
+        client_redirect_uri->expires_at = now + GLEWLWYD_CLIENT_REDIRECT_URI_CACHE_DURATION_LOCAL;
+      }
+      pthread_mutex_lock(&config->client_redirect_uri_lock);
+      for (i=0; i<pointer_list_size(bucket); i++) {
+        cur = (struct _oidc_client_redirect_uri *)pointer_list_get_at(bucket, i);
+        if (0 == o_strcmp(cur->client_id, client_id)) {
+          pointer_list_remove_pointer(bucket, cur);
+          free_client_redirect_uri(cur);
+          break;
+        }
+      }
+      if (pointer_list_size(bucket) >= GLEWLWYD_CLIENT_REDIRECT_URI_BUCKET_MAX_SIZE) {
+        cur = (struct _oidc_client_redirect_uri *)pointer_list_get_at(bucket, 0);
+        pointer_list_remove_pointer(bucket, cur);
+        free_client_redirect_uri(cur);
+      }
+      if (!pointer_list_append(bucket, client_redirect_uri)) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "is_client_redirect_uri_valid - Error pointer_list_append");
+        free_client_redirect_uri(client_redirect_uri);
+      }
+      pthread_mutex_unlock(&config->client_redirect_uri_lock);
+    } else {
+      found = json_array_has_string(json_object_get(j_client, "redirect_uri"), redirect_uri);
+    }
+  }
+  return found;
+}
+
+/**
+ * Called when a client is updated or deleted, on this instance or another one
+ */
+static void client_redirect_uri_invalidation_callback(const char * cache, const char * key, void * cls) {
+  struct _oidc_config * config = (struct _oidc_config *)cls;
+  struct _pointer_list * bucket;
+  struct _oidc_client_redirect_uri * cur;
+  size_t i;
+  UNUSED(cache);
+
+  pthread_mutex_lock(&config->client_redirect_uri_lock);
+  if (key != NULL) {
+    bucket = &config->client_redirect_uri_list[get_string_hash(key)%GLEWLWYD_CLIENT_REDIRECT_URI_BUCKETS];
+    for (i=0; i<pointer_list_size(bucket); i++) {
+      cur = (struct _oidc_client_redirect_uri *)pointer_list_get_at(bucket, i);
+      if (0 == o_strcmp(cur->client_id, key)) {
+        pointer_list_remove_pointer(bucket, cur);
+        free_client_redirect_uri(cur);
+        break;
+      }
+    }
+  } else {
+    for (i=0; i<GLEWLWYD_CLIENT_REDIRECT_URI_BUCKETS; i++) {
+      pointer_list_clean_free(&config->client_redirect_uri_list[i], &free_client_redirect_uri);
+      pointer_list_init(&config->client_redirect_uri_list[i]);
+    }
+  }
+  pthread_mutex_unlock(&config->client_redirect_uri_lock);
+}
+
 /**
  * Verify if a client is valid without checking its secret
  */
@@ -3754,19 +4352,13 @@ static json_t * check_client_valid_without_secret(struct _oidc_config * config,
                                                   const char * redirect_uri,
                                                   unsigned short authorization_type,
                                                   const char * ip_source) {
-  json_t * j_client, * j_element = NULL, * j_return;
+  json_t * j_client, * j_return;
   int uri_found = 0, authorization_type_enabled;
-  size_t index = 0;
 
   j_client = config->glewlwyd_config->glewlwyd_plugin_callback_get_client(config->glewlwyd_config, client_id);
   if (check_result_value(j_client, G_OK) && json_object_get(json_object_get(j_client, "client"), "enabled") == json_true()) {
     if (redirect_uri != NULL) {
-      uri_found = 0;
-      json_array_foreach(json_object_get(json_object_get(j_client, "client"), "redirect_uri"), index, j_element) {
-        if (0 == o_strcmp(json_string_value(j_element), redirect_uri)) {
-          uri_found = 1;
-        }
-      }
+      uri_found = is_client_redirect_uri_valid(config, json_object_get(j_client, "client"), redirect_uri);
     } else {
       uri_found = 1;
     }
@@ -3925,7 +4517,7 @@ static json_t * check_client_valid(struct _oidc_config * config,
       j_return = json_pack("{si}", "result", G_ERROR_UNAUTHORIZED);
     } else {
       if (redirect_uri != NULL) {
-        uri_found = json_array_has_string(json_object_get(json_object_get(j_client, "client"), "redirect_uri"), redirect_uri);
+        uri_found = is_client_redirect_uri_valid(config, json_object_get(j_client, "client"), redirect_uri);
       } else {
         uri_found = 1;
       }
@@ -4501,69 +5093,564 @@ static json_t * get_refresh_token_duration_rolling(struct _oidc_config * config,
   return j_return;
 }
 
-static int revoke_tokens_from_code(struct _oidc_config * config, json_int_t gpoc_id, const char * ip_source) {
-  int ret, res;
-  char * query;
-  json_t * j_result, * j_result_r, * j_element = NULL;
-  size_t index = 0;
+/**
+ * Table handled by the revocation engine
+ * A row is disabled by applying set_clause, active_clause must no longer match a disabled row
+ */
+struct _oidc_revocation_table {
+  const char         * name;
+  const char         * table;
+  const char         * id_column;
+  const char         * active_clause;
+  const char         * set_clause;
+  unsigned short int   pending_auth;
+};
+
+static const struct _oidc_revocation_table revocation_table_code                 = {"code", GLEWLWYD_PLUGIN_OIDC_TABLE_CODE, "gpoc_id", "gpoc_enabled=1", "gpoc_enabled=0", 0};
+static const struct _oidc_revocation_table revocation_table_refresh_token        = {"refresh_token", GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN, "gpor_id", "gpor_enabled=1", "gpor_enabled=0", 0};
+static const struct _oidc_revocation_table revocation_table_access_token         = {"access_token", GLEWLWYD_PLUGIN_OIDC_TABLE_ACCESS_TOKEN, "gpoa_id", "gpoa_enabled=1", "gpoa_enabled=0", 0};
+static const struct _oidc_revocation_table revocation_table_id_token             = {"id_token", GLEWLWYD_PLUGIN_OIDC_TABLE_ID_TOKEN, "gpoi_id", "gpoi_enabled=1", "gpoi_enabled=0", 0};
+static const struct _oidc_revocation_table revocation_table_device_authorization = {"device_authorization", GLEWLWYD_PLUGIN_OIDC_TABLE_DEVICE_AUTHORIZATION, "gpoda_id", "gpoda_status IN (0,1)", "gpoda_status=3", 1};
+static const struct _oidc_revocation_table revocation_table_rar                  = {"rar", GLEWLWYD_PLUGIN_OIDC_TABLE_RAR, "gporar_id", "gporar_enabled=1", "gporar_enabled=0", 0};
+static const struct _oidc_revocation_table revocation_table_par                  = {"par", GLEWLWYD_PLUGIN_OIDC_TABLE_PAR, "gpop_id", "gpop_status IN (0,1)", "gpop_status=2", 0};
+static const struct _oidc_revocation_table revocation_table_ciba                 = {"ciba", GLEWLWYD_PLUGIN_OIDC_TABLE_CIBA, "gpob_id", "gpob_enabled=1", "gpob_enabled=0", 1};
+
+/**
+ * Rows of a table matching filter
+ */
+struct _oidc_revocation_step {
+  const struct _oidc_revocation_table * table;
+  char                                * filter;
+};
+
+/**
+ * Set of rows to disable, processed step by step, GLEWLWYD_REVOCATION_BATCH_SIZE rows at a time
+ * A job continued in background is stored in the table GLEWLWYD_PLUGIN_OIDC_TABLE_REVOCATION_JOB
+ * until it's complete, id is the row id
+ */
+struct _oidc_revocation_job {
+  json_int_t                     id;
+  char                         * label;
+  struct _oidc_revocation_step   step[GLEWLWYD_REVOCATION_MAX_STEPS];
+  size_t                         nb_step;
+  size_t                         current;
+  size_t                         revoked;
+  unsigned short int             pending_auth;
+  unsigned int                   nb_error;
+  struct timespec                next_attempt;
+};
+
+static const struct _oidc_revocation_table * revocation_table_list[] = {
+  &revocation_table_code,
+  &revocation_table_refresh_token,
+  &revocation_table_access_token,
+  &revocation_table_id_token,
+  &revocation_table_device_authorization,
+  &revocation_table_rar,
+  &revocation_table_par,
+  &revocation_table_ciba,
+  NULL
+};
+
+static void clear_pending_auth(struct _oidc_config * config);
+
+static void free_revocation_job(void * data) {
+  struct _oidc_revocation_job * job = (struct _oidc_revocation_job *)data;
+  size_t i;
+
+  if (job != NULL) {
+    for (i=0; i<job->nb_step; i++) {
+      o_free(job->step[i].filter);
+    }
+    o_free(job->label);
+    o_free(job);
+  }
+}
+
+static struct _oidc_revocation_job * init_revocation_job(const char * label) {
+  struct _oidc_revocation_job * job;
+
+  if ((job = o_malloc(sizeof(struct _oidc_revocation_job))) != NULL) {
+    memset(job, 0, sizeof(struct _oidc_revocation_job));
+    job->label = o_strdup(label);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "init_revocation_job - Error allocating resources for job");
+  }
+  return job;
+}
 
-  query = msprintf("SELECT gpoa_jti AS jti, gpoa_client_id AS client_id FROM " GLEWLWYD_PLUGIN_OIDC_TABLE_ACCESS_TOKEN " WHERE gpor_id IN (SELECT gpor_id FROM " GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN " WHERE gpoc_id=%" JSON_INTEGER_FORMAT ") AND gpoa_enabled=1", gpoc_id);
+/**
+ * Adds a step to the job, the job takes ownership of filter
+ */
+static int add_revocation_step(struct _oidc_revocation_job * job, const struct _oidc_revocation_table * table, char * filter) {
+  int ret;
+
+  if (job != NULL && table != NULL && filter != NULL && job->nb_step < GLEWLWYD_REVOCATION_MAX_STEPS) {
+    job->step[job->nb_step].table = table;
+    job->step[job->nb_step].filter = filter;
+    job->nb_step++;
+    ret = G_OK;
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "add_revocation_step - Error input parameters");
+    o_free(filter);
+    ret = G_ERROR_PARAM;
+  }
+  return ret;
+}
+
+static const struct _oidc_revocation_table * get_revocation_table(const char * name) {
+  const struct _oidc_revocation_table * table = NULL;
+  size_t i;
+
+  for (i=0; table==NULL && revocation_table_list[i]!=NULL; i++) {
+    if (0 == o_strcmp(name, revocation_table_list[i]->name)) {
+      table = revocation_table_list[i];
+    }
+  }
+  return table;
+}
+
+/**
+ * Disables the next batch of the current step,
+ * the step is complete when the batch has less than GLEWLWYD_REVOCATION_BATCH_SIZE rows
+ */
+static int run_revocation_batch(struct _oidc_config * config, struct _oidc_revocation_job * job) {
+  struct _oidc_revocation_step * step = &job->step[job->current];
+  json_t * j_result = NULL, * j_element = NULL;
+  char * query, * id_list = NULL;
+  size_t index = 0, nb_rows = 0;
+  int res, ret;
+
+  query = msprintf("SELECT %s AS id FROM %s WHERE %s AND %s LIMIT %d", step->table->id_column, step->table->table, step->table->active_clause, step->filter, GLEWLWYD_REVOCATION_BATCH_SIZE);
   res = h_execute_query_json(config->glewlwyd_config->glewlwyd_config->conn, query, &j_result);
   o_free(query);
   if (res == H_OK) {
+    nb_rows = json_array_size(j_result);
     json_array_foreach(j_result, index, j_element) {
-      y_log_message(Y_LOG_LEVEL_INFO, "Event oidc - Plugin '%s' - Access token jti '%s' generated for client '%s' revoked, origin: %s", config->name, json_string_value(json_object_get(j_element, "jti")), json_string_value(json_object_get(j_element, "client_id")), ip_source);
+      if (id_list == NULL) {
+        id_list = msprintf("%" JSON_INTEGER_FORMAT, json_integer_value(json_object_get(j_element, "id")));
+      } else {
+        id_list = mstrcatf(id_list, ",%" JSON_INTEGER_FORMAT, json_integer_value(json_object_get(j_element, "id")));
+      }
     }
     json_decref(j_result);
-    query = msprintf("SELECT gpor_client_id AS client_id FROM " GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN " WHERE gpoc_id=%" JSON_INTEGER_FORMAT " AND gpor_enabled=1", gpoc_id);
-    res = h_execute_query_json(config->glewlwyd_config->glewlwyd_config->conn, query, &j_result_r);
-    o_free(query);
-    if (res == H_OK) {
-      if (json_array_size(j_result_r)) {
-        y_log_message(Y_LOG_LEVEL_INFO, "Event oidc - Plugin '%s' - Refresh token generated for client '%s' revoked, origin: %s", config->name, json_string_value(json_object_get(json_array_get(j_result_r, 0), "client_id")), ip_source);
-      }
-      json_decref(j_result_r);
-      query = msprintf("UPDATE " GLEWLWYD_PLUGIN_OIDC_TABLE_ACCESS_TOKEN " SET gpoa_enabled='0' WHERE gpor_id IN (SELECT gpor_id FROM " GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN " WHERE gpoc_id=%" JSON_INTEGER_FORMAT ")", gpoc_id);
+    if (nb_rows) {
+      query = msprintf("UPDATE %s SET %s WHERE %s IN (%s) AND %s", step->table->table, step->table->set_clause, step->table->id_column, id_list, step->table->active_clause);
       res = h_execute_query(config->glewlwyd_config->glewlwyd_config->conn, query, NULL, H_OPTION_EXEC);
       o_free(query);
-      if (res == H_OK) {
-        query = msprintf("UPDATE " GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN " SET gpor_enabled='0' WHERE gpoc_id=%" JSON_INTEGER_FORMAT, gpoc_id);
-        res = h_execute_query(config->glewlwyd_config->glewlwyd_config->conn, query, NULL, H_OPTION_EXEC);
-        o_free(query);
-        if (res == H_OK) {
-          ret = G_OK;
+    }
+    o_free(id_list);
+    if (res == H_OK) {
+      if (nb_rows) {
+        job->revoked += nb_rows;
+        if (step->table->pending_auth) {
+          job->pending_auth = 1;
+        }
+        config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_REVOKED, nb_rows, "plugin", config->name, "table", step->table->name, NULL);
+      }
+      if (nb_rows < GLEWLWYD_REVOCATION_BATCH_SIZE) {
+        job->current++;
+      }
+      ret = G_OK;
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "run_revocation_batch - Error executing query (2)");
+      config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+      ret = G_ERROR_DB;
+    }
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "run_revocation_batch - Error executing query (1)");
+    config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+    ret = G_ERROR_DB;
+  }
+  return ret;
+}
+
+/**
+ * Runs at most max_batches batches of the job, or until the job is complete if max_batches is 0
+ * Device authorization and CIBA requests disabled are removed from the pending requests registry of every instance
+ */
+static int run_revocation_job(struct _oidc_config * config, struct _oidc_revocation_job * job, unsigned int max_batches) {
+  unsigned int nb_batches = 0;
+  int ret = G_OK;
+
+  while (ret == G_OK && job->current < job->nb_step && (!max_batches || nb_batches < max_batches)) {
+    ret = run_revocation_batch(config, job);
+    nb_batches++;
+  }
+  if (job->pending_auth) {
+    clear_pending_auth(config);
+    config->glewlwyd_config->glewlwyd_plugin_callback_cache_invalidation_publish(config->glewlwyd_config, GLEWLWYD_CACHE_OIDC_PENDING_AUTH, NULL);
+    job->pending_auth = 0;
+  }
+  return ret;
+}
+
+/**
+ * Returns the delay before the next attempt of a job after nb_error consecutive errors
+ */
+static long get_revocation_error_delay(unsigned int nb_error) {
+  long delay = GLEWLWYD_REVOCATION_ERROR_DELAY;
+
+  while (nb_error > 1 && delay < GLEWLWYD_REVOCATION_MAX_ERROR_DELAY) {
+    delay *= 2;
+    nb_error--;
+  }
+  return delay<GLEWLWYD_REVOCATION_MAX_ERROR_DELAY?delay:GLEWLWYD_REVOCATION_MAX_ERROR_DELAY;
+}
+
+static void set_revocation_deadline(struct timespec * deadline, long delay) {
+  clock_gettime(CLOCK_MONOTONIC, deadline);
+  deadline->tv_nsec += (delay % 1000L) * 1000000L;
+  deadline->tv_sec += delay / 1000L + deadline->tv_nsec / 1000000000L;
+  deadline->tv_nsec %= 1000000000L;
+}
+
+static int is_revocation_time_before(const struct timespec * time_a, const struct timespec * time_b) {
+  return (time_a->tv_sec < time_b->tv_sec || (time_a->tv_sec == time_b->tv_sec && time_a->tv_nsec < time_b->tv_nsec));
+}
+
+static int is_revocation_deadline_passed(const struct timespec * deadline) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return !is_revocation_time_before(&now, deadline);
+}
+
+/**
+ * Stores the remaining steps of the job so it's resumed at the next start
+ * if the instance stops before the job is complete
+ */
+static int persist_revocation_job(struct _oidc_config * config, struct _oidc_revocation_job * job) {
+  json_t * j_query, * j_steps = json_array(), * j_last_id;
+  char * str_steps = NULL;
+  size_t i;
+  int res, ret;
+
+  if (j_steps != NULL) {
+    for (i=job->current; i<job->nb_step; i++) {
+      json_array_append_new(j_steps, json_pack("{ssss}", "table", job->step[i].table->name, "filter", job->step[i].filter));
+    }
+    str_steps = json_dumps(j_steps, JSON_COMPACT);
+  }
+  json_decref(j_steps);
+  if (str_steps != NULL) {
+    j_query = json_pack("{sss{ssssss}}",
+                        "table",
+                        GLEWLWYD_PLUGIN_OIDC_TABLE_REVOCATION_JOB,
+                        "values",
+                          "gporj_plugin_name", config->name,
+                          "gporj_label", job->label,
+                          "gporj_steps", str_steps);
+    res = h_insert(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
+    json_decref(j_query);
+    if (res == H_OK) {
+      if ((j_last_id = h_last_insert_id(config->glewlwyd_config->glewlwyd_config->conn)) != NULL) {
+        job->id = json_integer_value(j_last_id);
+        ret = G_OK;
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "persist_revocation_job - Error h_last_insert_id");
+        config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+        ret = G_ERROR_DB;
+      }
+      json_decref(j_last_id);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "persist_revocation_job - Error executing j_query");
+      config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+      ret = G_ERROR_DB;
+    }
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "persist_revocation_job - Error serializing steps");
+    ret = G_ERROR_MEMORY;
+  }
+  o_free(str_steps);
+  return ret;
+}
+
+/**
+ * Removes the stored job once it's complete,
+ * if the removal fails, the job is run again at the next start, which is harmless
+ * since the rows already disabled don't match the steps anymore
+ */
+static void remove_persisted_revocation_job(struct _oidc_config * config, struct _oidc_revocation_job * job) {
+  json_t * j_query;
+
+  if (job->id) {
+    j_query = json_pack("{sss{sI}}",
+                        "table",
+                        GLEWLWYD_PLUGIN_OIDC_TABLE_REVOCATION_JOB,
+                        "where",
+                          "gporj_id", job->id);
+    if (h_delete(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL) != H_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "remove_persisted_revocation_job - Error executing j_query");
+      config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+    }
+    json_decref(j_query);
+    job->id = 0;
+  }
+}
+
+/**
+ * Background revocation thread, the jobs due are run one batch at a time in turn
+ * so a large revocation doesn't delay the other ones
+ * Each job has its own next attempt time: GLEWLWYD_REVOCATION_BATCH_DELAY after a batch,
+ * or a delay doubled after each consecutive error of the job, so a failing job doesn't delay the others
+ * When the plugin is closed, the remaining jobs are continued without the delay
+ * between the batches, the failed batches are still retried after their delay,
+ * until GLEWLWYD_REVOCATION_CLOSE_TIMEOUT, then the jobs not complete are left
+ * in the database and resumed at the next start
+ */
+static void * thread_revocation_run(void * args) {
+  struct _oidc_config * config = (struct _oidc_config *)args;
+  struct _oidc_revocation_job * job, * cur_job;
+  struct timespec deadline = {0, 0}, close_deadline = {0, 0};
+  size_t i;
+  long delay;
+  int closing = 0;
+
+  pthread_mutex_lock(&config->revocation_lock);
+  while (!closing || pointer_list_size(&config->revocation_job_list)) {
+    if (config->revocation_stop && !closing) {
+      closing = 1;
+      set_revocation_deadline(&close_deadline, GLEWLWYD_REVOCATION_CLOSE_TIMEOUT);
+    }
+    if (!pointer_list_size(&config->revocation_job_list)) {
+      if (!closing) {
+        pthread_cond_wait(&config->revocation_cond, &config->revocation_lock);
+      }
+    } else if (closing && is_revocation_deadline_passed(&close_deadline)) {
+      while (pointer_list_size(&config->revocation_job_list)) {
+        job = (struct _oidc_revocation_job *)pointer_list_get_at(&config->revocation_job_list, 0);
+        pointer_list_remove_at(&config->revocation_job_list, 0);
+        y_log_message(Y_LOG_LEVEL_WARNING, "Event oidc - Plugin '%s' - Revocation of %s not complete when the plugin was closed, %zu rows disabled, the revocation will be resumed at the next start", config->name, job->label, job->revoked);
+        config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_REVOCATION_FAILED, 1, "plugin", config->name, NULL);
+        free_revocation_job(job);
+      }
+    } else {
+      job = NULL;
+      for (i=0; i<pointer_list_size(&config->revocation_job_list); i++) {
+        cur_job = (struct _oidc_revocation_job *)pointer_list_get_at(&config->revocation_job_list, i);
+        // Closing the plugin ends the delay between the batches, not the delay before a retry
+        if ((closing && !cur_job->nb_error) || is_revocation_deadline_passed(&cur_job->next_attempt)) {
+          job = cur_job;
+          pointer_list_remove_at(&config->revocation_job_list, i);
+          break;
+        } else if (!i || is_revocation_time_before(&cur_job->next_attempt, &deadline)) {
+          deadline = cur_job->next_attempt;
+        }
+      }
+      if (job == NULL) {
+        if (closing && is_revocation_time_before(&close_deadline, &deadline)) {
+          deadline = close_deadline;
+        }
+        pthread_cond_timedwait(&config->revocation_cond, &config->revocation_lock, &deadline);
+      } else {
+        pthread_mutex_unlock(&config->revocation_lock);
+        if (run_revocation_job(config, job, 1) == G_OK) {
+          job->nb_error = 0;
+          set_revocation_deadline(&job->next_attempt, GLEWLWYD_REVOCATION_BATCH_DELAY);
+        } else {
+          job->nb_error++;
+          delay = get_revocation_error_delay(job->nb_error);
+          set_revocation_deadline(&job->next_attempt, delay);
+          y_log_message(Y_LOG_LEVEL_WARNING, "Event oidc - Plugin '%s' - Revocation of %s failed %u times in a row, retry in %ld ms", config->name, job->label, job->nb_error, delay);
+          config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_REVOCATION_RETRY, 1, "plugin", config->name, NULL);
+        }
+        if (job->current >= job->nb_step) {
+          remove_persisted_revocation_job(config, job);
+          y_log_message(Y_LOG_LEVEL_INFO, "Event oidc - Plugin '%s' - Revocation of %s complete, %zu rows disabled", config->name, job->label, job->revoked);
+          config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_REVOCATION_COMPLETE, 1, "plugin", config->name, NULL);
+          free_revocation_job(job);
+          job = NULL;
+        }
+        pthread_mutex_lock(&config->revocation_lock);
+        if (job != NULL && !pointer_list_append(&config->revocation_job_list, job)) {
+          y_log_message(Y_LOG_LEVEL_ERROR, "thread_revocation_run - Error pointer_list_append, the revocation of %s will be resumed at the next start", job->label);
+          config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_REVOCATION_FAILED, 1, "plugin", config->name, NULL);
+          free_revocation_job(job);
+        }
+      }
+    }
+  }
+  pthread_mutex_unlock(&config->revocation_lock);
+  return NULL;
+}
+
+static void stop_revocation_thread(struct _oidc_config * config) {
+  pthread_mutex_lock(&config->revocation_lock);
+  config->revocation_stop = 1;
+  pthread_cond_broadcast(&config->revocation_cond);
+  pthread_mutex_unlock(&config->revocation_lock);
+  if (config->revocation_thread_started) {
+    pthread_join(config->revocation_thread, NULL);
+    config->revocation_thread_started = 0;
+  }
+  pointer_list_clean_free(&config->revocation_job_list, &free_revocation_job);
+}
+
+/**
+ * Hands the job to the background revocation thread, starts the thread if needed
+ */
+static int queue_revocation_job(struct _oidc_config * config, struct _oidc_revocation_job * job) {
+  int ret = G_ERROR;
+
+  if (job->nb_error) {
+    set_revocation_deadline(&job->next_attempt, get_revocation_error_delay(job->nb_error));
+  } else {
+    set_revocation_deadline(&job->next_attempt, 0);
+  }
+  if (!pthread_mutex_lock(&config->revocation_lock)) {
+    if (!config->revocation_stop && !config->revocation_thread_started) {
+      if (!pthread_create(&config->revocation_thread, NULL, &thread_revocation_run, config)) {
+        config->revocation_thread_started = 1;
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "queue_revocation_job - Error pthread_create revocation_thread");
+      }
+    }
+    if (config->revocation_thread_started && !config->revocation_stop && pointer_list_append(&config->revocation_job_list, job)) {
+      config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_REVOCATION_BACKGROUND, 1, "plugin", config->name, NULL);
+      pthread_cond_broadcast(&config->revocation_cond);
+      ret = G_OK;
+    }
+    pthread_mutex_unlock(&config->revocation_lock);
+  }
+  return ret;
+}
+
+/**
+ * Disables the rows of the job, then frees the job
+ * The first GLEWLWYD_REVOCATION_SYNC_BATCHES batches are run by the caller,
+ * the rest of a large job, or a job with a failed batch, is stored in the database,
+ * then handed to the background revocation thread which retries until the job is complete
+ * If the job can't be stored, the caller runs it until it's complete and gets the error if any
+ */
+static int run_revocation(struct _oidc_config * config, struct _oidc_revocation_job * job) {
+  int ret;
+
+  if (job == NULL) {
+    ret = G_ERROR_MEMORY;
+  } else if ((ret = run_revocation_job(config, job, GLEWLWYD_REVOCATION_SYNC_BATCHES)) != G_OK || job->current < job->nb_step) {
+    if (ret != G_OK) {
+      job->nb_error++;
+    }
+    if (persist_revocation_job(config, job) == G_OK) {
+      if (queue_revocation_job(config, job) == G_OK) {
+        y_log_message(Y_LOG_LEVEL_INFO, "Event oidc - Plugin '%s' - Revocation of %s continued in background, %zu rows disabled", config->name, job->label, job->revoked);
+        job = NULL;
+        ret = G_OK;
+      } else if (ret != G_OK) {
+        y_log_message(Y_LOG_LEVEL_WARNING, "Event oidc - Plugin '%s' - Revocation of %s failed, it will be resumed at the next start", config->name, job->label);
+      }
+    }
+    if (job != NULL && ret == G_OK) {
+      if ((ret = run_revocation_job(config, job, 0)) == G_OK) {
+        remove_persisted_revocation_job(config, job);
+      }
+    }
+  }
+  if (job != NULL && ret == G_OK && job->revoked) {
+    y_log_message(Y_LOG_LEVEL_INFO, "Event oidc - Plugin '%s' - Revocation of %s complete, %zu rows disabled", config->name, job->label, job->revoked);
+  }
+  free_revocation_job(job);
+  return ret;
+}
+
+/**
+ * Queues the revocation jobs stored by a previous run of the plugin that weren't complete
+ * The steps are run again from the first one, the rows already disabled don't match anymore
+ */
+static int resume_revocation_jobs(struct _oidc_config * config) {
+  json_t * j_query, * j_result = NULL, * j_element = NULL, * j_steps, * j_step = NULL;
+  struct _oidc_revocation_job * job;
+  size_t index = 0, index_step = 0;
+  int res, ret = G_OK;
+
+  j_query = json_pack("{sss[sss]s{ss}}",
+                      "table",
+                      GLEWLWYD_PLUGIN_OIDC_TABLE_REVOCATION_JOB,
+                      "columns",
+                        "gporj_id",
+                        "gporj_label",
+                        "gporj_steps",
+                      "where",
+                        "gporj_plugin_name", config->name);
+  res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result, NULL);
+  json_decref(j_query);
+  if (res == H_OK) {
+    json_array_foreach(j_result, index, j_element) {
+      if ((job = init_revocation_job(json_string_value(json_object_get(j_element, "gporj_label")))) != NULL) {
+        job->id = json_integer_value(json_object_get(j_element, "gporj_id"));
+        j_steps = json_loads(json_string_value(json_object_get(j_element, "gporj_steps")), JSON_DECODE_ANY, NULL);
+        res = json_is_array(j_steps)?G_OK:G_ERROR_PARAM;
+        json_array_foreach(j_steps, index_step, j_step) {
+          if (res == G_OK) {
+            res = add_revocation_step(job, get_revocation_table(json_string_value(json_object_get(j_step, "table"))), o_strdup(json_string_value(json_object_get(j_step, "filter"))));
+          }
+        }
+        json_decref(j_steps);
+        if (res != G_OK) {
+          y_log_message(Y_LOG_LEVEL_ERROR, "resume_revocation_jobs - Invalid stored revocation job %" JSON_INTEGER_FORMAT, job->id);
+          free_revocation_job(job);
+        } else if (queue_revocation_job(config, job) != G_OK) {
+          y_log_message(Y_LOG_LEVEL_ERROR, "resume_revocation_jobs - Error queue_revocation_job");
+          free_revocation_job(job);
+          ret = G_ERROR;
         } else {
-          y_log_message(Y_LOG_LEVEL_ERROR, "oidc revoke_tokens_from_code - Error executing query (4)");
-          config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
-          ret = G_ERROR_DB;
+          y_log_message(Y_LOG_LEVEL_INFO, "Event oidc - Plugin '%s' - Revocation of %s resumed", config->name, job->label);
         }
       } else {
-        y_log_message(Y_LOG_LEVEL_ERROR, "oidc revoke_tokens_from_code - Error executing query (3)");
-        config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
-        ret = G_ERROR_DB;
+        ret = G_ERROR_MEMORY;
       }
-    } else {
-      y_log_message(Y_LOG_LEVEL_ERROR, "oidc revoke_tokens_from_code - Error executing query (2)");
-      config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
-      ret = G_ERROR_DB;
     }
+    json_decref(j_result);
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "oidc revoke_tokens_from_code - Error executing query (1)");
+    y_log_message(Y_LOG_LEVEL_ERROR, "resume_revocation_jobs - Error executing j_query");
     config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
     ret = G_ERROR_DB;
   }
   return ret;
 }
 
+/**
+ * Disables the access tokens and refresh tokens generated from a code that was replayed
+ */
+static int revoke_tokens_from_code(struct _oidc_config * config, json_int_t gpoc_id, const char * client_id, const char * ip_source) {
+  struct _oidc_revocation_job * job;
+  char * label = msprintf("tokens generated from a replayed code for client '%s', origin: %s", client_id, ip_source);
+  int ret;
+
+  if ((job = init_revocation_job(label)) != NULL) {
+    add_revocation_step(job, &revocation_table_access_token, msprintf("gpor_id IN (SELECT gpor_id FROM " GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN " WHERE gpoc_id=%" JSON_INTEGER_FORMAT ")", gpoc_id));
+    add_revocation_step(job, &revocation_table_refresh_token, msprintf("gpoc_id=%" JSON_INTEGER_FORMAT, gpoc_id));
+  }
+  if ((ret = run_revocation(config, job)) != G_OK) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "oidc revoke_tokens_from_code - Error run_revocation");
+  }
+  o_free(label);
+  return ret;
+}
+
 /**
  * verify that the auth code is valid
  */
+static const struct _glwd_statement statement_oidc_code = {
+  "glwd_oidc_code",
+  "SELECT gpoc_username AS username, gpoc_nonce AS nonce, gpoc_claims_request AS claims_request, gpoc_id, gpoc_code_challenge AS code_challenge, gpoc_resource AS resource, gpoc_enabled AS enabled, gpoc_authorization_details, gpoc_s_hash AS s_hash, gpoc_sid AS sid, gpoc_dpop_jkt AS dpop_jkt FROM " GLEWLWYD_PLUGIN_OIDC_TABLE_CODE " WHERE gpoc_plugin_name=$1 AND gpoc_client_id=$2 AND gpoc_redirect_uri=$3 AND gpoc_code_hash=$4 AND gpoc_expires_at > NOW()",
+  "SELECT gpoc_username AS username, gpoc_nonce AS nonce, gpoc_claims_request AS claims_request, gpoc_id, gpoc_code_challenge AS code_challenge, gpoc_resource AS resource, gpoc_enabled AS enabled, gpoc_authorization_details, gpoc_s_hash AS s_hash, gpoc_sid AS sid, gpoc_dpop_jkt AS dpop_jkt FROM " GLEWLWYD_PLUGIN_OIDC_TABLE_CODE " WHERE gpoc_plugin_name=$1 AND gpoc_client_id=$2 AND gpoc_redirect_uri=$3 AND gpoc_code_hash=$4 AND gpoc_expires_at > (strftime('%s','now'))",
+  NULL
+};
+
+static const struct _glwd_statement statement_oidc_code_scope = {
+  "glwd_oidc_code_scope",
+  "SELECT gpocs_scope AS name FROM " GLEWLWYD_PLUGIN_OIDC_TABLE_CODE_SCOPE " WHERE gpoc_id=$1",
+  NULL,
+  NULL
+};
+
 static json_t * validate_authorization_code(struct _oidc_config * config, const char * code, const char * client_id, const char * redirect_uri, const char * code_verifier, const char * ip_source) {
   char * code_hash = config->glewlwyd_config->glewlwyd_callback_generate_hash(config->glewlwyd_config, code),
-       * expiration_clause = NULL,
        * scope_list = NULL,
        * tmp;
-  json_t * j_query,
+  json_t * j_params,
          * j_result = NULL,
          * j_result_scope = NULL,
          * j_return,
@@ -4575,45 +5662,9 @@ static json_t * validate_authorization_code(struct _oidc_config * config, const
   int rolling_refresh = config->refresh_token_rolling, rolling_refresh_override = -1;
 
   if (code_hash != NULL) {
-    if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_MARIADB) {
-      expiration_clause = o_strdup("> NOW()");
-    } else if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_PGSQL) {
-      expiration_clause = o_strdup("> NOW()");
-    } else { // HOEL_DB_TYPE_SQLITE
-      expiration_clause = o_strdup("> (strftime('%s','now'))");
-    }
-    j_query = json_pack("{sss[sssssssssss]s{sssssssss{ssss}}}",
-                        "table",
-                        GLEWLWYD_PLUGIN_OIDC_TABLE_CODE,
-                        "columns",
-                          "gpoc_username AS username",
-                          "gpoc_nonce AS nonce",
-                          "gpoc_claims_request AS claims_request",
-                          "gpoc_id",
-                          "gpoc_code_challenge AS code_challenge",
-                          "gpoc_resource AS resource",
-                          "gpoc_enabled AS enabled",
-                          "gpoc_authorization_details",
-                          "gpoc_s_hash AS s_hash",
-                          "gpoc_sid AS sid",
-                          "gpoc_dpop_jkt AS dpop_jkt",
-                        "where",
-                          "gpoc_plugin_name",
-                          config->name,
-                          "gpoc_client_id",
-                          client_id,
-                          "gpoc_redirect_uri",
-                          redirect_uri,
-                          "gpoc_code_hash",
-                          code_hash,
-                          "gpoc_expires_at",
-                            "operator",
-                            "raw",
-                            "value",
-                            expiration_clause);
-    o_free(expiration_clause);
-    res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result, NULL);
-    json_decref(j_query);
+    j_params = json_pack("[ssss]", config->name, client_id, redirect_uri, code_hash);
+    res = execute_statement_json(config->glewlwyd_config->glewlwyd_config, config->glewlwyd_config->glewlwyd_config->conn, &statement_oidc_code, j_params, &j_result);
+    json_decref(j_params);
     if (res == H_OK) {
       if (json_array_size(j_result)) {
         if (json_integer_value(json_object_get(json_array_get(j_result, 0), "enabled"))) {
@@ -4622,16 +5673,9 @@ static json_t * validate_authorization_code(struct _oidc_config * config, const
           }
           json_object_del(json_array_get(j_result, 0), "gpoc_authorization_details");
           if ((res = validate_code_challenge(json_array_get(j_result, 0), code_verifier)) == G_OK) {
-            j_query = json_pack("{sss[s]s{sO}}",
-                                "table",
-                                GLEWLWYD_PLUGIN_OIDC_TABLE_CODE_SCOPE,
-                                "columns",
-                                  "gpocs_scope AS name",
-                                "where",
-                                  "gpoc_id",
-                                  json_object_get(json_array_get(j_result, 0), "gpoc_id"));
-            res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result_scope, NULL);
-            json_decref(j_query);
+            j_params = json_pack("[O]", json_object_get(json_array_get(j_result, 0), "gpoc_id"));
+            res = execute_statement_json(config->glewlwyd_config->glewlwyd_config, config->glewlwyd_config->glewlwyd_config->conn, &statement_oidc_code_scope, j_params, &j_result_scope);
+            json_decref(j_params);
             if (res == H_OK && json_array_size(j_result_scope) > 0) {
               if (!json_object_set_new(json_array_get(j_result, 0), "scope", json_array())) {
                 json_array_foreach(j_result_scope, index, j_element) {
@@ -4674,7 +5718,7 @@ static json_t * validate_authorization_code(struct _oidc_config * config, const
                 j_return = json_pack("{si}", "result", G_ERROR_MEMORY);
               }
             } else {
-              y_log_message(Y_LOG_LEVEL_ERROR, "oidc validate_authorization_code - Error executing j_query (2)");
+              y_log_message(Y_LOG_LEVEL_ERROR, "oidc validate_authorization_code - Error executing statement (2)");
               config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
               j_return = json_pack("{si}", "result", G_ERROR_DB);
             }
@@ -4691,7 +5735,7 @@ static json_t * validate_authorization_code(struct _oidc_config * config, const
           json_decref(j_result_scope);
         } else {
           if (json_true() == json_object_get(config->j_params, "auth-type-code-revoke-replayed")) {
-            if (revoke_tokens_from_code(config, json_integer_value(json_object_get(json_array_get(j_result, 0), "gpoc_id")), ip_source) != G_OK) {
+            if (revoke_tokens_from_code(config, json_integer_value(json_object_get(json_array_get(j_result, 0), "gpoc_id")), client_id, ip_source) != G_OK) {
               y_log_message(Y_LOG_LEVEL_ERROR, "oidc validate_authorization_code - Error revoke_tokens_from_code");
             }
           }
@@ -4701,7 +5745,7 @@ static json_t * validate_authorization_code(struct _oidc_config * config, const
         j_return = json_pack("{si}", "result", G_ERROR_NOT_FOUND);
       }
     } else {
-      y_log_message(Y_LOG_LEVEL_ERROR, "oidc validate_authorization_code - Error executing j_query (1)");
+      y_log_message(Y_LOG_LEVEL_ERROR, "oidc validate_authorization_code - Error executing statement (1)");
       config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
       j_return = json_pack("{si}", "result", G_ERROR_DB);
     }
@@ -4832,57 +5876,34 @@ static json_t * validate_session_client_scope(struct _oidc_config * config, cons
 /**
  * Verify that the refresh token is still valid to get an access token
  */
+#define GLEWLWYD_STATEMENT_OIDC_REFRESH_TOKEN_COLUMNS(issued_at, expired_at, last_seen) "SELECT gpor_id, gpor_authorization_type AS authorization_type, gpoc_id, gpor_username AS username, gpor_client_id AS client_id, " issued_at " AS issued_at, " expired_at " AS expired_at, " last_seen " AS last_seen, gpor_duration AS duration, gpor_rolling_expiration, gpor_claims_request AS claims_request, gpor_jti AS jti, gpor_dpop_jkt AS dpop_jkt, gpor_resource AS resource, gpor_authorization_details, gpor_enabled FROM " GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN " WHERE gpor_plugin_name=$1 AND gpor_token_hash=$2 AND gpor_expires_at > "
+
+static const struct _glwd_statement statement_oidc_refresh_token = {
+  "glwd_oidc_refresh_token",
+  GLEWLWYD_STATEMENT_OIDC_REFRESH_TOKEN_COLUMNS("UNIX_TIMESTAMP(gpor_issued_at)", "UNIX_TIMESTAMP(gpor_expires_at)", "UNIX_TIMESTAMP(gpor_last_seen)") "FROM_UNIXTIME($3)",
+  GLEWLWYD_STATEMENT_OIDC_REFRESH_TOKEN_COLUMNS("gpor_issued_at", "gpor_expires_at", "gpor_last_seen") "$3",
+  GLEWLWYD_STATEMENT_OIDC_REFRESH_TOKEN_COLUMNS("EXTRACT(EPOCH FROM gpor_issued_at)::integer", "EXTRACT(EPOCH FROM gpor_expires_at)::integer", "EXTRACT(EPOCH FROM gpor_last_seen)::integer") "TO_TIMESTAMP($3)"
+};
+
+static const struct _glwd_statement statement_oidc_refresh_token_scope = {
+  "glwd_oidc_refresh_token_scope",
+  "SELECT gpors_scope AS scope FROM " GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN_SCOPE " WHERE gpor_id=$1",
+  NULL,
+  NULL
+};
+
 static json_t * validate_refresh_token(struct _oidc_config * config, const char * refresh_token) {
-  json_t * j_return, * j_query, * j_result, * j_result_scope, * j_element = NULL;
-  char * token_hash, * expires_at_clause;
+  json_t * j_return, * j_params, * j_result, * j_result_scope, * j_element = NULL;
+  char * token_hash;
   int res, enabled;
   size_t index = 0;
-  time_t now;
 
   if (refresh_token != NULL) {
     token_hash = config->glewlwyd_config->glewlwyd_callback_generate_hash(config->glewlwyd_config, refresh_token);
     if (token_hash != NULL) {
-      time(&now);
-      if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_MARIADB) {
-        expires_at_clause = msprintf("> FROM_UNIXTIME(%u)", (now));
-      } else if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_PGSQL) {
-        expires_at_clause = msprintf("> TO_TIMESTAMP(%u)", now);
-      } else { // HOEL_DB_TYPE_SQLITE
-        expires_at_clause = msprintf("> %u", (now));
-      }
-      j_query = json_pack("{sss[ssssssssssssssss]s{sssss{ssss}}}",
-                          "table",
-                          GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN,
-                          "columns",
-                            "gpor_id",
-                            "gpor_authorization_type AS authorization_type",
-                            "gpoc_id",
-                            "gpor_username AS username",
-                            "gpor_client_id AS client_id",
-                            SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "UNIX_TIMESTAMP(gpor_issued_at) AS issued_at", "gpor_issued_at AS issued_at", "EXTRACT(EPOCH FROM gpor_issued_at)::integer AS issued_at"),
-                            SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "UNIX_TIMESTAMP(gpor_expires_at) AS expired_at", "gpor_expires_at AS expired_at", "EXTRACT(EPOCH FROM gpor_expires_at)::integer AS expired_at"),
-                            SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "UNIX_TIMESTAMP(gpor_last_seen) AS last_seen", "gpor_last_seen AS last_seen", "EXTRACT(EPOCH FROM gpor_last_seen)::integer AS last_seen"),
-                            "gpor_duration AS duration",
-                            "gpor_rolling_expiration",
-                            "gpor_claims_request AS claims_request",
-                            "gpor_jti AS jti",
-                            "gpor_dpop_jkt AS dpop_jkt",
-                            "gpor_resource AS resource",
-                            "gpor_authorization_details",
-                            "gpor_enabled",
-                          "where",
-                            "gpor_plugin_name",
-                            config->name,
-                            "gpor_token_hash",
-                            token_hash,
-                            "gpor_expires_at",
-                              "operator",
-                              "raw",
-                              "value",
-                              expires_at_clause);
-      o_free(expires_at_clause);
-      res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result, NULL);
-      json_decref(j_query);
+      j_params = json_pack("[ssI]", config->name, token_hash, (json_int_t)time(NULL));
+      res = execute_statement_json(config->glewlwyd_config->glewlwyd_config, config->glewlwyd_config->glewlwyd_config->conn, &statement_oidc_refresh_token, j_params, &j_result);
+      json_decref(j_params);
       if (res == H_OK) {
         if (json_array_size(j_result) > 0) {
           enabled = json_integer_value(json_object_get(json_array_get(j_result, 0), "gpor_enabled"));
@@ -4893,15 +5914,9 @@ static json_t * validate_refresh_token(struct _oidc_config * config, const char
             json_object_set_new(json_array_get(j_result, 0), "authorization_details", json_loads(json_string_value(json_object_get(json_array_get(j_result, 0), "gpor_authorization_details")), JSON_DECODE_ANY, NULL));
           }
           json_object_del(json_array_get(j_result, 0), "gpor_authorization_details");
-          j_query = json_pack("{sss[s]s{sO}}",
-                              "table",
-                              GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN_SCOPE,
-                              "columns",
-                                "gpors_scope AS scope",
-                              "where",
-                                "gpor_id",
-                                json_object_get(json_array_get(j_result, 0), "gpor_id"));
-          res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result_scope, NULL);
+          j_params = json_pack("[O]", json_object_get(json_array_get(j_result, 0), "gpor_id"));
+          res = execute_statement_json(config->glewlwyd_config->glewlwyd_config, config->glewlwyd_config->glewlwyd_config->conn, &statement_oidc_refresh_token_scope, j_params, &j_result_scope);
+          json_decref(j_params);
           if (res == H_OK) {
             if (!json_object_set_new(json_array_get(j_result, 0), "scope", json_array())) {
               json_array_foreach(j_result_scope, index, j_element) {
@@ -4914,17 +5929,16 @@ static json_t * validate_refresh_token(struct _oidc_config * config, const char
             }
             json_decref(j_result_scope);
           } else {
-            y_log_message(Y_LOG_LEVEL_ERROR, "oidc validate_refresh_token - Error executing j_query (2)");
+            y_log_message(Y_LOG_LEVEL_ERROR, "oidc validate_refresh_token - Error executing statement (2)");
             config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
             j_return = json_pack("{si}", "result", G_ERROR_DB);
           }
-          json_decref(j_query);
         } else {
           j_return = json_pack("{si}", "result", G_ERROR_NOT_FOUND);
         }
         json_decref(j_result);
       } else {
-        y_log_message(Y_LOG_LEVEL_ERROR, "oidc validate_refresh_token - Error executing j_query (1)");
+        y_log_message(Y_LOG_LEVEL_ERROR, "oidc validate_refresh_token - Error executing statement (1)");
         config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
         j_return = json_pack("{si}", "result", G_ERROR_DB);
       }
@@ -4986,7 +6000,7 @@ static json_t * refresh_token_list_get(struct _oidc_config * config, const char
     o_free(pattern_escaped);
     o_free(name_escaped);
   }
-  res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result, NULL);
+  res = select_read(config->glewlwyd_config->glewlwyd_config, j_query, &j_result, GLEWLWYD_DB_READ_REPLICA);
   json_decref(j_query);
   if (res == H_OK) {
     json_array_foreach(j_result, index, j_element) {
@@ -5178,6 +6192,84 @@ static int update_refresh_token(struct _oidc_config * config, json_int_t gpor_id
   return ret;
 }
 
+/**
+ * Atomically disable a one-use refresh token before it's rotated
+ * Only one concurrent request can claim the token, the others get G_ERROR_UNAUTHORIZED
+ * and are handled as a refresh token replay
+ * The claim is a conditional update, so it's atomic across Glewlwyd instances sharing the database
+ */
+static int consume_refresh_token(struct _oidc_config * config, json_int_t gpor_id, time_t now) {
+  json_t * j_result = NULL;
+  int res, ret;
+  char * query, * name_escaped, * last_seen_clause, * claim_variable;
+  pthread_mutex_t * stripe_lock;
+
+  if ((name_escaped = h_escape_string_with_quotes(config->glewlwyd_config->glewlwyd_config->conn, config->name)) != NULL) {
+    if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_MARIADB) {
+      // MariaDB has no UPDATE ... RETURNING and hoel doesn't return the number of updated rows,
+      // so the update sets a session variable on the claimed row only
+      // Other threads may run queries on the same connection between the statements,
+      // the per-token striped mutex keeps the variable for the duration of the claim
+      // The connection is shared by all the plugin instances, so the variable name
+      // includes the instance number since each instance has its own stripes
+      stripe_lock = &config->refresh_token_lock[(size_t)gpor_id%OIDC_REFRESH_TOKEN_LOCK_STRIPES];
+      if (!pthread_mutex_lock(stripe_lock)) {
+        claim_variable = msprintf("@glwd_refresh_claim_%u_%zu", config->refresh_token_claim_instance, (size_t)gpor_id%OIDC_REFRESH_TOKEN_LOCK_STRIPES);
+        query = msprintf("SET %s=NULL", claim_variable);
+        res = h_execute_query(config->glewlwyd_config->glewlwyd_config->conn, query, NULL, H_OPTION_EXEC);
+        o_free(query);
+        if (res == H_OK) {
+          query = msprintf("UPDATE " GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN " SET gpor_enabled=(%s:=0), gpor_last_seen=FROM_UNIXTIME(%u) WHERE gpor_plugin_name=%s AND gpor_id=%" JSON_INTEGER_FORMAT " AND gpor_enabled=1", claim_variable, now, name_escaped, gpor_id);
+          res = h_execute_query(config->glewlwyd_config->glewlwyd_config->conn, query, NULL, H_OPTION_EXEC);
+          o_free(query);
+        }
+        if (res == H_OK) {
+          query = msprintf("SELECT %s AS claimed", claim_variable);
+          res = h_execute_query_json(config->glewlwyd_config->glewlwyd_config->conn, query, &j_result);
+          o_free(query);
+        }
+        pthread_mutex_unlock(stripe_lock);
+        o_free(claim_variable);
+        if (res == H_OK) {
+          ret = json_is_integer(json_object_get(json_array_get(j_result, 0), "claimed"))?G_OK:G_ERROR_UNAUTHORIZED;
+          json_decref(j_result);
+        } else {
+          y_log_message(Y_LOG_LEVEL_ERROR, "oidc consume_refresh_token - Error executing query (mariadb)");
+          config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+          ret = G_ERROR_DB;
+        }
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "oidc consume_refresh_token - Error pthread_mutex_lock");
+        ret = G_ERROR;
+      }
+    } else {
+      // Conditional update and claim check are done in a single statement, SQLite supports RETURNING since 3.35
+      if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_PGSQL) {
+        last_seen_clause = msprintf("TO_TIMESTAMP(%u)", now);
+      } else { // HOEL_DB_TYPE_SQLITE
+        last_seen_clause = msprintf("%u", now);
+      }
+      query = msprintf("UPDATE " GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN " SET gpor_enabled=0, gpor_last_seen=%s WHERE gpor_plugin_name=%s AND gpor_id=%" JSON_INTEGER_FORMAT " AND gpor_enabled=1 RETURNING gpor_id", last_seen_clause, name_escaped, gpor_id);
+      res = h_execute_query_json(config->glewlwyd_config->glewlwyd_config->conn, query, &j_result);
+      o_free(query);
+      o_free(last_seen_clause);
+      if (res == H_OK) {
+        ret = json_array_size(j_result)?G_OK:G_ERROR_UNAUTHORIZED;
+        json_decref(j_result);
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "oidc consume_refresh_token - Error executing query");
+        config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+        ret = G_ERROR_DB;
+      }
+    }
+    o_free(name_escaped);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "oidc consume_refresh_token - Error h_escape_string_with_quotes");
+    ret = G_ERROR;
+  }
+  return ret;
+}
+
 /**
  * Download a request object from an URI
  */
@@ -5196,8 +6288,8 @@ static char * get_request_from_uri(struct _oidc_config * config, const char * re
     req.check_server_certificate = 0;
   }
 
-  if (ulfius_send_http_request(&req, &resp) != U_OK) {
-    y_log_message(Y_LOG_LEVEL_ERROR, "get_request_from_uri - Error ulfius_send_http_request");
+  if (config->glewlwyd_config->glewlwyd_plugin_callback_http_send_request(config->glewlwyd_config, &req, &resp) != G_OK) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "get_request_from_uri - Error glewlwyd_plugin_callback_http_send_request");
   } else if (resp.status == 200) {
     if (json_object_get(config->j_params, "request-parameter-ietf-strict") == json_true()) {
       valid_ct = !o_strcmp(u_map_get(resp.map_header, ULFIUS_HTTP_HEADER_CONTENT), "application/oauth-authz-req+jwt") || !o_strcmp(u_map_get(resp.map_header, ULFIUS_HTTP_HEADER_CONTENT), "application/jwt");
@@ -5214,7 +6306,7 @@ static char * get_request_from_uri(struct _oidc_config * config, const char * re
       y_log_message(Y_LOG_LEVEL_ERROR, "get_request_from_uri - Error invalid content type");
     }
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "get_request_from_uri - Error ulfius_send_http_request response status is %d", resp.status);
+    y_log_message(Y_LOG_LEVEL_ERROR, "get_request_from_uri - Error glewlwyd_plugin_callback_http_send_request response status is %d", resp.status);
   }
 
   ulfius_clean_request(&req);
@@ -5503,6 +6595,7 @@ static json_t * verify_request_signature(struct _oidc_config * config, jwt_t * j
 
 static int decrypt_request_token(struct _oidc_config * config, jwt_t * jwt) {
   int ret, res;
+  struct _oidc_sign_keys * sign_keys;
   jwk_t * jwk = NULL;
   unsigned char * key = NULL, key_hash[64] = {0};
   size_t key_len = 0, key_hash_len = 64;
@@ -5517,13 +6610,15 @@ static int decrypt_request_token(struct _oidc_config * config, jwt_t * jwt) {
     if (json_object_get(config->j_params, "request-parameter-allow-encrypted") == json_true()) {
       alg = r_jwt_get_enc_alg(jwt);
       enc = r_jwt_get_enc(jwt);
-      if (r_jwks_size(config->jwks_sign) == 1) {
-        jwk = r_jwks_get_at(config->jwks_sign, 0);
+      sign_keys = acquire_sign_keys(config);
+      if (r_jwks_size(sign_keys->jwks_private) == 1) {
+        jwk = r_jwks_get_at(sign_keys->jwks_private, 0);
       } else if (r_jwt_get_header_str_value(jwt, "kid") != NULL) {
-        jwk = r_jwks_get_by_kid(config->jwks_sign, r_jwt_get_header_str_value(jwt, "kid"));
+        jwk = r_jwks_get_by_kid(sign_keys->jwks_private, r_jwt_get_header_str_value(jwt, "kid"));
       } else if (!json_string_null_or_empty(json_object_get(config->j_params, "default-kid"))) {
-        jwk = r_jwks_get_by_kid(config->jwks_sign, json_string_value(json_object_get(config->j_params, "default-kid")));
+        jwk = r_jwks_get_by_kid(sign_keys->jwks_private, json_string_value(json_object_get(config->j_params, "default-kid")));
       }
+      release_sign_keys(sign_keys);
       if (jwk != NULL) {
         if (r_jwk_key_type(jwk, &bits, 0) & R_KEY_TYPE_SYMMETRIC) {
           if (alg == R_JWA_ALG_A128GCMKW || alg == R_JWA_ALG_A128KW || alg == R_JWA_ALG_A192GCMKW || alg == R_JWA_ALG_A192KW || alg == R_JWA_ALG_A256GCMKW || alg == R_JWA_ALG_A256KW || alg == R_JWA_ALG_DIR) {
@@ -5977,7 +7072,7 @@ static int send_ciba_client_notification(struct _oidc_config * config, json_t *
                                             U_OPT_NONE);
         o_free(bearer_token);
         json_decref(j_body);
-        if (ulfius_send_http_request(&req, &resp) == U_OK) {
+        if (config->glewlwyd_config->glewlwyd_plugin_callback_http_send_request(config->glewlwyd_config, &req, &resp) == G_OK) {
           if (resp.status == 200 || resp.status == 204) {
             ret = G_OK;
           } else {
@@ -5985,7 +7080,7 @@ static int send_ciba_client_notification(struct _oidc_config * config, json_t *
             ret = G_ERROR;
           }
         } else {
-          y_log_message(Y_LOG_LEVEL_ERROR, "send_ciba_client_notification ping - Error ulfius_send_http_request");
+          y_log_message(Y_LOG_LEVEL_ERROR, "send_ciba_client_notification ping - Error glewlwyd_plugin_callback_http_send_request");
           ret = G_ERROR;
         }
         ulfius_clean_response(&resp);
@@ -6014,7 +7109,7 @@ static int send_ciba_client_notification(struct _oidc_config * config, json_t *
                                                   U_OPT_CHECK_PROXY_CERTIFICATE, json_object_get(config->j_params, "oauth-ciba-allow-https-non-secure")==json_true()?0:1,
                                                   U_OPT_NONE);
               o_free(bearer_token);
-              if (ulfius_send_http_request(&req, &resp) == U_OK) {
+              if (config->glewlwyd_config->glewlwyd_plugin_callback_http_send_request(config->glewlwyd_config, &req, &resp) == G_OK) {
                 if (resp.status == 200 || resp.status == 204) {
                   ret = G_OK;
                 } else {
@@ -6022,7 +7117,7 @@ static int send_ciba_client_notification(struct _oidc_config * config, json_t *
                   ret = G_ERROR;
                 }
               } else {
-                y_log_message(Y_LOG_LEVEL_ERROR, "send_ciba_client_notification push - Error ulfius_send_http_request");
+                y_log_message(Y_LOG_LEVEL_ERROR, "send_ciba_client_notification push - Error glewlwyd_plugin_callback_http_send_request");
                 ret = G_ERROR;
               }
               ulfius_clean_response(&resp);
@@ -6060,7 +7155,7 @@ static int send_ciba_client_notification(struct _oidc_config * config, json_t *
                                               U_OPT_NONE);
           o_free(bearer_token);
           json_decref(j_body);
-          if (ulfius_send_http_request(&req, &resp) == U_OK) {
+          if (config->glewlwyd_config->glewlwyd_plugin_callback_http_send_request(config->glewlwyd_config, &req, &resp) == G_OK) {
             if (resp.status == 200 || resp.status == 204) {
               ret = G_OK;
             } else {
@@ -6068,7 +7163,7 @@ static int send_ciba_client_notification(struct _oidc_config * config, json_t *
               ret = G_ERROR;
             }
           } else {
-            y_log_message(Y_LOG_LEVEL_ERROR, "send_ciba_client_notification push - Error ulfius_send_http_request");
+            y_log_message(Y_LOG_LEVEL_ERROR, "send_ciba_client_notification push - Error glewlwyd_plugin_callback_http_send_request");
             ret = G_ERROR;
           }
           ulfius_clean_response(&resp);
@@ -6088,6 +7183,13 @@ static int send_ciba_client_notification(struct _oidc_config * config, json_t *
   return ret;
 }
 
+static const struct _glwd_statement statement_oidc_request_jti = {
+  "glwd_oidc_request_jti",
+  "SELECT gpoctr_id FROM " GLEWLWYD_PLUGIN_OIDC_TABLE_CLIENT_TOKEN_REQUEST " WHERE gpoctr_plugin_name=$1 AND gpoctr_cient_id=$2 AND gpoctr_jti_hash=$3",
+  NULL,
+  NULL
+};
+
 static int check_request_jti_unused(struct _oidc_config * config, const char * jti, const char * iss, const char * ip_source) {
   json_t * j_query, * j_result = NULL, * j_last_index;
   int ret, res;
@@ -6099,19 +7201,8 @@ static int check_request_jti_unused(struct _oidc_config * config, const char * j
   } else {
     if (!o_strnullempty(jti)) {
       jti_hash = config->glewlwyd_config->glewlwyd_callback_generate_hash(config->glewlwyd_config, jti);
-      j_query = json_pack("{sss[s]s{ssssss}}",
-                          "table",
-                          GLEWLWYD_PLUGIN_OIDC_TABLE_CLIENT_TOKEN_REQUEST,
-                          "columns",
-                            "gpoctr_id",
-                          "where",
-                            "gpoctr_plugin_name",
-                            config->name,
-                            "gpoctr_cient_id",
-                            iss,
-                            "gpoctr_jti_hash",
-                            jti_hash);
-      res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result, NULL);
+      j_query = json_pack("[sss]", config->name, iss, jti_hash);
+      res = execute_statement_json(config->glewlwyd_config->glewlwyd_config, config->glewlwyd_config->glewlwyd_config->conn, &statement_oidc_request_jti, j_query, &j_result);
       json_decref(j_query);
       if (res == H_OK) {
         if (json_array_size(j_result)) {
@@ -6311,52 +7402,46 @@ static int revoke_id_token(struct _oidc_config * config, const char * token) {
   return ret;
 }
 
+#define GLEWLWYD_STATEMENT_OIDC_REFRESH_TOKEN_METADATA(issued_at, expires_at) "SELECT gpor_id, gpor_username AS username, gpor_client_id AS client_id, gpor_client_id AS aud, " issued_at " AS iat, " issued_at " AS nbf, " expires_at " AS exp, gpor_enabled FROM " GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN " WHERE gpor_plugin_name=$1 AND gpor_token_hash=$2 AND ($4 IS NULL OR gpor_client_id=$4) AND gpor_expires_at > "
+
+static const struct _glwd_statement statement_oidc_refresh_token_metadata = {
+  "glwd_oidc_refresh_token_metadata",
+  GLEWLWYD_STATEMENT_OIDC_REFRESH_TOKEN_METADATA("UNIX_TIMESTAMP(gpor_issued_at)", "UNIX_TIMESTAMP(gpor_expires_at)") "FROM_UNIXTIME($3)",
+  GLEWLWYD_STATEMENT_OIDC_REFRESH_TOKEN_METADATA("gpor_issued_at", "gpor_expires_at") "$3",
+  GLEWLWYD_STATEMENT_OIDC_REFRESH_TOKEN_METADATA("EXTRACT(EPOCH FROM gpor_issued_at)::integer", "EXTRACT(EPOCH FROM gpor_expires_at)::integer") "TO_TIMESTAMP($3)"
+};
+
+#define GLEWLWYD_STATEMENT_OIDC_ACCESS_TOKEN_METADATA(issued_at) "SELECT gpoa_id, gpoa_username AS username, gpoa_client_id AS client_id, gpoa_resource AS aud, " issued_at " AS iat, " issued_at " AS nbf, gpoa_jti as jti, gpoa_authorization_details, gpoa_enabled FROM " GLEWLWYD_PLUGIN_OIDC_TABLE_ACCESS_TOKEN " WHERE gpoa_plugin_name=$1 AND gpoa_token_hash=$2 AND ($3 IS NULL OR gpoa_client_id=$3)"
+
+static const struct _glwd_statement statement_oidc_access_token_metadata = {
+  "glwd_oidc_access_token_metadata",
+  GLEWLWYD_STATEMENT_OIDC_ACCESS_TOKEN_METADATA("UNIX_TIMESTAMP(gpoa_issued_at)"),
+  GLEWLWYD_STATEMENT_OIDC_ACCESS_TOKEN_METADATA("gpoa_issued_at"),
+  GLEWLWYD_STATEMENT_OIDC_ACCESS_TOKEN_METADATA("EXTRACT(EPOCH FROM gpoa_issued_at)::integer")
+};
+
+static const struct _glwd_statement statement_oidc_access_token_scope = {
+  "glwd_oidc_access_token_scope",
+  "SELECT gpoas_scope AS scope FROM " GLEWLWYD_PLUGIN_OIDC_TABLE_ACCESS_TOKEN_SCOPE " WHERE gpoa_id=$1",
+  NULL,
+  NULL
+};
+
 static json_t * get_token_metadata(struct _oidc_config * config, const char * token, const char * token_type_hint, const char * client_id) {
-  json_t * j_query, * j_result, * j_result_scope, * j_return = NULL, * j_element = NULL, * j_client = NULL, * j_cnf = NULL, * j_claims;
+  json_t * j_query, * j_params, * j_result, * j_result_scope, * j_return = NULL, * j_element = NULL, * j_client = NULL, * j_cnf = NULL, * j_claims;
   int res, found_refresh = 0, found_access = 0, found_id_token = 0;
   size_t index = 0;
-  char * token_hash = NULL, * scope_list = NULL, * expires_at_clause, * sub = NULL;
+  char * token_hash = NULL, * scope_list = NULL, * sub = NULL;
   time_t now;
   jwt_t * jwt = NULL;
 
   if (!o_strnullempty(token)) {
     token_hash = config->glewlwyd_config->glewlwyd_callback_generate_hash(config->glewlwyd_config, token);
     time(&now);
-    if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_MARIADB) {
-      expires_at_clause = msprintf("> FROM_UNIXTIME(%u)", (now));
-    } else if (config->glewlwyd_config->glewlwyd_config->conn->type==HOEL_DB_TYPE_PGSQL) {
-      expires_at_clause = msprintf("> TO_TIMESTAMP(%u)", now);
-    } else { // HOEL_DB_TYPE_SQLITE
-      expires_at_clause = msprintf("> %u", (now));
-    }
     if (token_type_hint == NULL || 0 == o_strcmp("refresh_token", token_type_hint)) {
-      j_query = json_pack("{sss[ssssssss]s{sssss{ssss}}}",
-                          "table",
-                          GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN,
-                          "columns",
-                            "gpor_id",
-                            "gpor_username AS username",
-                            "gpor_client_id AS client_id",
-                            "gpor_client_id AS aud",
-                            SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "UNIX_TIMESTAMP(gpor_issued_at) AS iat", "gpor_issued_at AS iat", "EXTRACT(EPOCH FROM gpor_issued_at)::integer AS iat"),
-                            SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "UNIX_TIMESTAMP(gpor_issued_at) AS nbf", "gpor_issued_at AS nbf", "EXTRACT(EPOCH FROM gpor_issued_at)::integer AS nbf"),
-                            SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "UNIX_TIMESTAMP(gpor_expires_at) AS exp", "gpor_expires_at AS exp", "EXTRACT(EPOCH FROM gpor_expires_at)::integer AS exp"),
-                            "gpor_enabled",
-                          "where",
-                            "gpor_plugin_name",
-                            config->name,
-                            "gpor_token_hash",
-                            token_hash,
-                            "gpor_expires_at",
-                              "operator",
-                              "raw",
-                              "value",
-                              expires_at_clause);
-      if (client_id != NULL) {
-        json_object_set_new(json_object_get(j_query, "where"), "gpor_client_id", json_string(client_id));
-      }
-      res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result, NULL);
-      json_decref(j_query);
+      j_params = json_pack("[ssIs?]", config->name, token_hash, (json_int_t)now, client_id);
+      res = execute_statement_json_read(config->glewlwyd_config->glewlwyd_config, &statement_oidc_refresh_token_metadata, j_params, &j_result, GLEWLWYD_DB_READ_PRIMARY);
+      json_decref(j_params);
       if (res == H_OK) {
         if (json_array_size(j_result)) {
           found_refresh = 1;
@@ -6381,16 +7466,9 @@ static json_t * get_token_metadata(struct _oidc_config * config, const char * to
             if (json_object_get(json_array_get(j_result, 0), "username") == json_null()) {
               json_object_del(json_array_get(j_result, 0), "username");
             }
-            j_query = json_pack("{sss[s]s{sO}}",
-                                "table",
-                                GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN_SCOPE,
-                                "columns",
-                                  "gpors_scope AS scope",
-                                "where",
-                                  "gpor_id",
-                                  json_object_get(json_array_get(j_result, 0), "gpor_id"));
-            res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result_scope, NULL);
-            json_decref(j_query);
+            j_params = json_pack("[O]", json_object_get(json_array_get(j_result, 0), "gpor_id"));
+            res = execute_statement_json_read(config->glewlwyd_config->glewlwyd_config, &statement_oidc_refresh_token_scope, j_params, &j_result_scope, GLEWLWYD_DB_READ_PRIMARY);
+            json_decref(j_params);
             if (res == H_OK) {
               json_array_foreach(j_result_scope, index, j_element) {
                 if (scope_list == NULL) {
@@ -6425,29 +7503,9 @@ static json_t * get_token_metadata(struct _oidc_config * config, const char * to
       }
     }
     if ((token_type_hint == NULL && !found_refresh) || 0 == o_strcmp("access_token", token_type_hint)) {
-      j_query = json_pack("{sss[sssssssss]s{ssss}}",
-                          "table",
-                          GLEWLWYD_PLUGIN_OIDC_TABLE_ACCESS_TOKEN,
-                          "columns",
-                            "gpoa_id",
-                            "gpoa_username AS username",
-                            "gpoa_client_id AS client_id",
-                            "gpoa_resource AS aud",
-                            SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "UNIX_TIMESTAMP(gpoa_issued_at) AS iat", "gpoa_issued_at AS iat", "EXTRACT(EPOCH FROM gpoa_issued_at)::integer AS iat"),
-                            SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "UNIX_TIMESTAMP(gpoa_issued_at) AS nbf", "gpoa_issued_at AS nbf", "EXTRACT(EPOCH FROM gpoa_issued_at)::integer AS nbf"),
-                            "gpoa_jti as jti",
-                            "gpoa_authorization_details",
-                            "gpoa_enabled",
-                          "where",
-                            "gpoa_plugin_name",
-                            config->name,
-                            "gpoa_token_hash",
-                            token_hash);
-      if (client_id != NULL) {
-        json_object_set_new(json_object_get(j_query, "where"), "gpoa_client_id", json_string(client_id));
-      }
-      res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result, NULL);
-      json_decref(j_query);
+      j_params = json_pack("[sss?]", config->name, token_hash, client_id);
+      res = execute_statement_json_read(config->glewlwyd_config->glewlwyd_config, &statement_oidc_access_token_metadata, j_params, &j_result, GLEWLWYD_DB_READ_PRIMARY);
+      json_decref(j_params);
       if (res == H_OK) {
         if (json_array_size(j_result)) {
           found_access = 1;
@@ -6476,16 +7534,9 @@ static json_t * get_token_metadata(struct _oidc_config * config, const char * to
             if (json_object_get(json_array_get(j_result, 0), "username") == json_null()) {
               json_object_del(json_array_get(j_result, 0), "username");
             }
-            j_query = json_pack("{sss[s]s{sO}}",
-                                "table",
-                                GLEWLWYD_PLUGIN_OIDC_TABLE_ACCESS_TOKEN_SCOPE,
-                                "columns",
-                                  "gpoas_scope AS scope",
-                                "where",
-                                  "gpoa_id",
-                                  json_object_get(json_array_get(j_result, 0), "gpoa_id"));
-            res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result_scope, NULL);
-            json_decref(j_query);
+            j_params = json_pack("[O]", json_object_get(json_array_get(j_result, 0), "gpoa_id"));
+            res = execute_statement_json_read(config->glewlwyd_config->glewlwyd_config, &statement_oidc_access_token_scope, j_params, &j_result_scope, GLEWLWYD_DB_READ_PRIMARY);
+            json_decref(j_params);
             if (res == H_OK) {
               json_array_foreach(j_result_scope, index, j_element) {
                 if (scope_list == NULL) {
@@ -6612,7 +7663,6 @@ static json_t * get_token_metadata(struct _oidc_config * config, const char * to
       j_return = json_pack("{sis{so}}", "result", G_OK, "token", "active", json_false());
     }
     o_free(token_hash);
-    o_free(expires_at_clause);
   } else {
     j_return = json_pack("{si}", "result", G_ERROR_PARAM);
   }
@@ -7185,7 +8235,7 @@ static json_t * is_client_registration_valid(struct _oidc_config * config, json_
                                                 U_OPT_CHECK_SERVER_CERTIFICATE, (json_object_get(config->j_params, "request-uri-allow-https-non-secure")==json_true())?0:1,
                                                 U_OPT_CHECK_PROXY_CERTIFICATE, (json_object_get(config->j_params, "request-uri-allow-https-non-secure")==json_true())?0:1,
                                                 U_OPT_NONE) == U_OK) {
-          if (ulfius_send_http_request(&req, &resp) == U_OK) {
+          if (config->glewlwyd_config->glewlwyd_plugin_callback_http_send_request(config->glewlwyd_config, &req, &resp) == G_OK) {
             if (resp.status >= 200 && resp.status < 300) {
               if ((j_resp = ulfius_get_json_body_response(&resp, NULL)) != NULL && json_is_array(j_resp)) {
                 json_array_foreach(j_resp, index, j_element) {
@@ -7236,7 +8286,7 @@ static json_t * is_client_registration_valid(struct _oidc_config * config, json_
               break;
             }
           } else {
-            y_log_message(Y_LOG_LEVEL_ERROR, "is_client_registration_valid - Error ulfius_send_http_request");
+            y_log_message(Y_LOG_LEVEL_ERROR, "is_client_registration_valid - Error glewlwyd_plugin_callback_http_send_request");
             j_error = json_pack("{ssss}", "error", "invalid_client_metadata", "error_description", "Invalid sector_identifier_uri");
             break;
           }
@@ -7667,8 +8717,9 @@ static json_t * is_client_registration_valid(struct _oidc_config * config, json_
 
 static char * build_jwt_auth_response(struct _oidc_config * config, json_t * j_client, struct _u_map * map_query, int * enc_res) {
   jwt_t * jwt;
-  jwa_alg alg = get_token_sign_alg(config, j_client, GLEWLWYD_TOKEN_TYPE_AUTH);
-  jwk_t * jwk = get_jwk_sign(config, j_client, alg);
+  struct _oidc_sign_keys * sign_keys = acquire_sign_keys(config);
+  jwa_alg alg = get_token_sign_alg(config, sign_keys, j_client, GLEWLWYD_TOKEN_TYPE_AUTH);
+  jwk_t * jwk = get_jwk_sign(config, sign_keys, j_client, alg);
   time_t now;
   char * token = NULL, * out_token = NULL;
   const char ** keys, * value;
@@ -7703,6 +8754,7 @@ static char * build_jwt_auth_response(struct _oidc_config * config, json_t * j_c
     y_log_message(Y_LOG_LEVEL_ERROR, "build_jwt_auth_response - oidc - Error no jwk available");
   }
   r_jwk_free(jwk);
+  release_sign_keys(sign_keys);
   if (token != NULL) {
     out_token = encrypt_token_if_required(config, token, j_client, GLEWLWYD_TOKEN_TYPE_AUTH, enc_res);
     o_free(token);
@@ -7870,20 +8922,264 @@ static char * generate_session_state(const char * client_id, const char * redire
   unsigned char intermediate_hash[32] = {0}, intermediate_hash_b64[64] = {0};
   size_t intermediate_hash_len = 32, intermediate_hash_b64_len = 0;
 
-  if (!o_strnullempty(client_id) && (0 == o_strncmp(redirect_uri, "http://", o_strlen("http://")) || 0 == o_strncmp(redirect_uri, "https://", o_strlen("https://"))) && !o_strnullempty(username)) {
-    origin = o_strdup(redirect_uri);
-    *(o_strchr(o_strstr(origin, "://")+3, '/')) = '\0';
-    rand_string_nonce(salt, GLEWLWYD_DEFAULT_SALT_LENGTH);
-    intermediate = msprintf("%s %s %s %s", client_id, origin, username, salt);
-    if (generate_digest_raw(digest_SHA256, (const unsigned char *)intermediate, o_strlen(intermediate), intermediate_hash, &intermediate_hash_len)) {
-      if (o_base64_encode(intermediate_hash, intermediate_hash_len, intermediate_hash_b64, &intermediate_hash_b64_len)) {
-        session_state = msprintf("%s.%s", intermediate_hash_b64, salt);
+  if (!o_strnullempty(client_id) && (0 == o_strncmp(redirect_uri, "http://", o_strlen("http://")) || 0 == o_strncmp(redirect_uri, "https://", o_strlen("https://"))) && !o_strnullempty(username)) {
+    origin = o_strdup(redirect_uri);
+    *(o_strchr(o_strstr(origin, "://")+3, '/')) = '\0';
+    rand_string_nonce(salt, GLEWLWYD_DEFAULT_SALT_LENGTH);
+    intermediate = msprintf("%s %s %s %s", client_id, origin, username, salt);
+    if (generate_digest_raw(digest_SHA256, (const unsigned char *)intermediate, o_strlen(intermediate), intermediate_hash, &intermediate_hash_len)) {
+      if (o_base64_encode(intermediate_hash, intermediate_hash_len, intermediate_hash_b64, &intermediate_hash_b64_len)) {
+        session_state = msprintf("%s.%s", intermediate_hash_b64, salt);
+      }
+    }
+    o_free(intermediate);
+    o_free(origin);
+  }
+  return session_state;
+}
+
+static void free_pending_auth(void * data) {
+  struct _oidc_pending_auth * pending_auth = (struct _oidc_pending_auth *)data;
+
+  if (pending_auth != NULL) {
+    o_free(pending_auth->code);
+    o_free(pending_auth->client_id);
+    json_decref(pending_auth->j_request);
+    o_free(pending_auth);
+  }
+}
+
+static size_t get_pending_auth_bucket(const char * code) {
+  return get_string_hash(code)%GLEWLWYD_PENDING_AUTH_BUCKETS;
+}
+
+/**
+ * The generation changes every time a pending request is removed,
+ * a poll that read a pending request in the database must not cache it
+ * if the request was approved in between
+ */
+static unsigned int get_pending_auth_generation(struct _oidc_config * config) {
+  unsigned int generation = 0;
+
+  if (!pthread_mutex_lock(&config->pending_auth_lock)) {
+    generation = config->pending_auth_generation;
+    pthread_mutex_unlock(&config->pending_auth_lock);
+  }
+  return generation;
+}
+
+/**
+ * Looks for a pending request in the registry
+ * On success, last_check is set to the previous poll time and the poll time is updated,
+ * j_request is set to a copy of the cached request if not NULL
+ * An expired entry, or an entry checked more than GLEWLWYD_PENDING_AUTH_CHECK_INTERVAL seconds ago,
+ * is removed so the database gives the answer
+ */
+static int get_pending_auth(struct _oidc_config * config, unsigned short int type, const char * code, const char * client_id, time_t now, time_t * last_check, json_t ** j_request) {
+  struct _pointer_list * bucket = &config->pending_auth_list[get_pending_auth_bucket(code)];
+  struct _oidc_pending_auth * pending_auth;
+  size_t i;
+  int ret = G_ERROR_NOT_FOUND;
+
+  if (!config->pending_auth_enabled) {
+    ret = G_ERROR_NOT_FOUND;
+  } else if (!pthread_mutex_lock(&config->pending_auth_lock)) {
+    for (i=0; i<pointer_list_size(bucket); i++) {
+      pending_auth = (struct _oidc_pending_auth *)pointer_list_get_at(bucket, i);
+      if (pending_auth->type == type && 0 == o_strcmp(pending_auth->code, code)) {
+        if (pending_auth->expires_at < now || pending_auth->checked_at + GLEWLWYD_PENDING_AUTH_CHECK_INTERVAL <= now) {
+          pointer_list_remove_at(bucket, i);
+          free_pending_auth(pending_auth);
+        } else if (client_id == NULL || 0 == o_strcmp(pending_auth->client_id, client_id)) {
+          if (last_check != NULL) {
+            *last_check = pending_auth->last_check;
+          }
+          if (j_request != NULL) {
+            *j_request = json_deep_copy(pending_auth->j_request);
+          }
+          pending_auth->last_check = now;
+          ret = G_OK;
+        }
+        break;
+      }
+    }
+    pthread_mutex_unlock(&config->pending_auth_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "get_pending_auth - Error pthread_mutex_lock");
+    ret = G_ERROR;
+  }
+  return ret;
+}
+
+/**
+ * Adds a request read as pending in the database to the registry,
+ * unless a pending request was removed since generation was read
+ * last_check is the time the request was read in the database
+ */
+static void set_pending_auth(struct _oidc_config * config, unsigned short int type, const char * code, json_int_t id, const char * client_id, json_t * j_request, time_t expires_at, time_t last_check, unsigned int generation) {
+  struct _pointer_list * bucket = &config->pending_auth_list[get_pending_auth_bucket(code)];
+  struct _oidc_pending_auth * pending_auth;
+  size_t i;
+
+  if (config->pending_auth_enabled && !pthread_mutex_lock(&config->pending_auth_lock)) {
+    if (generation == config->pending_auth_generation) {
+      for (i=0; i<pointer_list_size(bucket); i++) {
+        pending_auth = (struct _oidc_pending_auth *)pointer_list_get_at(bucket, i);
+        if (pending_auth->type == type && 0 == o_strcmp(pending_auth->code, code)) {
+          pointer_list_remove_at(bucket, i);
+          free_pending_auth(pending_auth);
+          break;
+        }
+      }
+      if (pointer_list_size(bucket) >= GLEWLWYD_PENDING_AUTH_BUCKET_MAX_SIZE) {
+        pending_auth = (struct _oidc_pending_auth *)pointer_list_get_at(bucket, 0);
+        pointer_list_remove_at(bucket, 0);
+        free_pending_auth(pending_auth);
+      }
+      if ((pending_auth = o_malloc(sizeof(struct _oidc_pending_auth))) != NULL) {
+        pending_auth->type = type;
+        pending_auth->id = id;
+        pending_auth->code = o_strdup(code);
+        pending_auth->client_id = o_strdup(client_id);
+        pending_auth->j_request = json_deep_copy(j_request);
+        pending_auth->expires_at = expires_at;
+        pending_auth->last_check = last_check;
+        pending_auth->checked_at = last_check;
+        if (!pointer_list_append(bucket, pending_auth)) {
+          y_log_message(Y_LOG_LEVEL_ERROR, "set_pending_auth - Error pointer_list_append");
+          free_pending_auth(pending_auth);
+        }
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "set_pending_auth - Error allocating resources for pending_auth");
+      }
+    }
+    pthread_mutex_unlock(&config->pending_auth_lock);
+  } else if (config->pending_auth_enabled) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "set_pending_auth - Error pthread_mutex_lock");
+  }
+}
+
+static void remove_pending_auth(struct _oidc_config * config, unsigned short int type, json_int_t id) {
+  struct _oidc_pending_auth * pending_auth;
+  size_t i, j;
+  int found = 0;
+
+  if (!pthread_mutex_lock(&config->pending_auth_lock)) {
+    config->pending_auth_generation++;
+    for (i=0; i<GLEWLWYD_PENDING_AUTH_BUCKETS && !found; i++) {
+      for (j=0; j<pointer_list_size(&config->pending_auth_list[i]); j++) {
+        pending_auth = (struct _oidc_pending_auth *)pointer_list_get_at(&config->pending_auth_list[i], j);
+        if (pending_auth->type == type && pending_auth->id == id) {
+          pointer_list_remove_at(&config->pending_auth_list[i], j);
+          free_pending_auth(pending_auth);
+          found = 1;
+          break;
+        }
+      }
+    }
+    pthread_cond_broadcast(&config->pending_auth_cond);
+    pthread_mutex_unlock(&config->pending_auth_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "remove_pending_auth - Error pthread_mutex_lock");
+  }
+}
+
+/**
+ * Removes a pending request from the registry of every instance
+ * Must be called after the request status has been updated in the database
+ */
+static void invalidate_pending_auth(struct _oidc_config * config, unsigned short int type, json_int_t id) {
+  char * key = msprintf("%s:%"JSON_INTEGER_FORMAT, type==GLEWLWYD_PENDING_AUTH_TYPE_DEVICE?"device":"ciba", id);
+
+  remove_pending_auth(config, type, id);
+  config->glewlwyd_config->glewlwyd_plugin_callback_cache_invalidation_publish(config->glewlwyd_config, GLEWLWYD_CACHE_OIDC_PENDING_AUTH, key);
+  o_free(key);
+}
+
+static void clear_pending_auth(struct _oidc_config * config) {
+  size_t i;
+
+  if (!pthread_mutex_lock(&config->pending_auth_lock)) {
+    config->pending_auth_generation++;
+    for (i=0; i<GLEWLWYD_PENDING_AUTH_BUCKETS; i++) {
+      pointer_list_clean_free(&config->pending_auth_list[i], &free_pending_auth);
+    }
+    pthread_cond_broadcast(&config->pending_auth_cond);
+    pthread_mutex_unlock(&config->pending_auth_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "clear_pending_auth - Error pthread_mutex_lock");
+  }
+}
+
+static void pending_auth_invalidation_callback(const char * cache, const char * key, void * cls) {
+  UNUSED(cache);
+  if (key == NULL) {
+    clear_pending_auth((struct _oidc_config *)cls);
+  } else if (0 == o_strncmp(key, "device:", o_strlen("device:"))) {
+    remove_pending_auth((struct _oidc_config *)cls, GLEWLWYD_PENDING_AUTH_TYPE_DEVICE, (json_int_t)strtoll(key+o_strlen("device:"), NULL, 10));
+  } else if (0 == o_strncmp(key, "ciba:", o_strlen("ciba:"))) {
+    remove_pending_auth((struct _oidc_config *)cls, GLEWLWYD_PENDING_AUTH_TYPE_CIBA, (json_int_t)strtoll(key+o_strlen("ciba:"), NULL, 10));
+  }
+}
+
+/**
+ * Long poll: parks a poll on a pending request until the request is approved, denied or cancelled
+ * on any instance, or until 'token-long-poll-duration' seconds have passed
+ * Returns G_OK if the request is no longer pending, so the database gives the answer
+ * The poll holds a webservice thread, so the duration is capped to GLEWLWYD_LONG_POLL_MAX_DURATION,
+ * its admission slot is released while it waits
+ * The plugin endpoint dispatcher holds a module epoch reference while the poll waits,
+ * so a reloaded or stopped instance is closed after its waiting polls
+ */
+static int wait_pending_auth(struct _oidc_config * config, unsigned short int type, const char * code) {
+  struct _pointer_list * bucket = &config->pending_auth_list[get_pending_auth_bucket(code)];
+  struct _oidc_pending_auth * pending_auth;
+  struct timespec deadline;
+  json_int_t duration = json_integer_value(json_object_get(config->j_params, "token-long-poll-duration"));
+  time_t now;
+  size_t i;
+  int ret = G_ERROR, wait_ret = 0, done = 0, suspended = 0;
+
+  if (duration > GLEWLWYD_LONG_POLL_MAX_DURATION) {
+    duration = GLEWLWYD_LONG_POLL_MAX_DURATION;
+  }
+  if (config->pending_auth_enabled && duration > 0 && !pthread_mutex_lock(&config->pending_auth_lock)) {
+    if (config->pending_auth_waiters < (unsigned int)json_integer_value(json_object_get(config->j_params, "token-long-poll-max-requests"))) {
+      config->pending_auth_waiters++;
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      deadline.tv_sec += (time_t)duration;
+      while (!done) {
+        pending_auth = NULL;
+        for (i=0; i<pointer_list_size(bucket); i++) {
+          if (((struct _oidc_pending_auth *)pointer_list_get_at(bucket, i))->type == type && 0 == o_strcmp(((struct _oidc_pending_auth *)pointer_list_get_at(bucket, i))->code, code)) {
+            pending_auth = (struct _oidc_pending_auth *)pointer_list_get_at(bucket, i);
+            break;
+          }
+        }
+        time(&now);
+        if (pending_auth == NULL || pending_auth->expires_at < now) {
+          ret = G_OK;
+          done = 1;
+        } else if (wait_ret != 0) {
+          // Still pending, the next poll interval starts now
+          pending_auth->last_check = now;
+          done = 1;
+        } else {
+          if (!suspended) {
+            config->glewlwyd_config->glewlwyd_plugin_callback_admission_suspend(config->glewlwyd_config);
+            suspended = 1;
+          }
+          wait_ret = pthread_cond_timedwait(&config->pending_auth_cond, &config->pending_auth_lock, &deadline);
+        }
       }
+      config->pending_auth_waiters--;
+    }
+    pthread_mutex_unlock(&config->pending_auth_lock);
+    if (suspended) {
+      config->glewlwyd_config->glewlwyd_plugin_callback_admission_resume(config->glewlwyd_config);
     }
-    o_free(intermediate);
-    o_free(origin);
   }
-  return session_state;
+  return ret;
 }
 
 static json_t * generate_device_authorization(struct _oidc_config * config, const char * client_id, const char * scope_list, const char * resource, json_t * j_authorization_details, const char * dpop_jkt, const char * ip_source) {
@@ -8015,6 +9311,7 @@ static int validate_device_authorization_scope(struct _oidc_config * config, jso
       o_free(sid_sescaped);
       o_free(query);
       if (res == H_OK) {
+        invalidate_pending_auth(config, GLEWLWYD_PENDING_AUTH_TYPE_DEVICE, gpoda_id);
         if (json_array_size(j_amr)) {
           j_query = json_pack("{sss[]}", "table", GLEWLWYD_PLUGIN_OIDC_TABLE_DEVICE_SCHEME, "values");
           json_array_foreach(j_amr, index, j_element) {
@@ -8150,12 +9447,12 @@ static int check_auth_type_device_code(const struct _u_request * request,
          * j_result_scope = NULL,
          * j_result_sheme = NULL,
          * j_element = NULL,
-         * j_user = NULL,
          * j_refresh_token = NULL,
          * j_refresh = NULL,
          * j_amr = NULL,
          * j_jkt = NULL,
          * json_body = NULL;
+  const struct _glewlwyd_user_view * user_view = NULL;
   const char * device_code = u_map_get(request->map_post_body, "device_code"),
              * client_id = request->auth_basic_user,
              * client_secret = request->auth_basic_password,
@@ -8178,7 +9475,9 @@ static int check_auth_type_device_code(const struct _u_request * request,
        * issued_for = get_client_hostname(request),
        * dpop_nonce,
       ** resource_list = NULL;
-  time_t now;
+  time_t now, last_check = 0;
+  unsigned int generation;
+  int pending;
   size_t index = 0, i;
   
   if (client_id == NULL && u_map_get(request->map_post_body, "client_id") != NULL) {
@@ -8201,456 +9500,479 @@ static int check_auth_type_device_code(const struct _u_request * request,
     }
     if (check_result_value(j_client, G_OK) && is_client_auth_method_allowed(json_object_get(j_client, "client"), client_auth_method)) {
       device_code_hash = config->glewlwyd_config->glewlwyd_callback_generate_hash(config->glewlwyd_config, device_code);
-      j_query = json_pack("{sss[sssssssss]s{sssOs{ssss}}}",
-                          "table",
-                          GLEWLWYD_PLUGIN_OIDC_TABLE_DEVICE_AUTHORIZATION,
-                          "columns",
-                            "gpoda_id",
-                            "gpoda_username AS username",
-                            "gpoda_status",
-                            SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "UNIX_TIMESTAMP(gpoda_expires_at) AS expires_at", "gpoda_expires_at AS expires_at", "EXTRACT(EPOCH FROM gpoda_expires_at)::integer AS expires_at"),
-                            SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "UNIX_TIMESTAMP(gpoda_last_check) AS last_check", "gpoda_last_check AS last_check", "EXTRACT(EPOCH FROM gpoda_last_check)::integer AS last_check"),
-                            "gpoda_resource AS resource",
-                            "gpoda_dpop_jkt AS dpop_jkt",
-                            "gpoda_authorization_details",
-                            "gpoda_sid AS sid",
-                          "where",
-                            "gpoda_device_code_hash", device_code_hash,
-                            "gpoda_client_id", json_object_get(json_object_get(j_client, "client"), "client_id"),
-                            "gpoda_status",
-                              "operator",
-                              "raw",
-                              "value",
-                              "<= 1");
-      o_free(device_code_hash);
-      res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result, NULL);
-      json_decref(j_query);
-      if (res == H_OK) {
-        if (json_array_size(j_result)) {
-          time(&now);
-          if ((time_t)json_integer_value(json_object_get(json_array_get(j_result, 0), "expires_at")) >= now) {
-            if (json_integer_value(json_object_get(json_array_get(j_result, 0), "gpoda_status")) == 1) {
-              if (json_object_get(json_array_get(j_result, 0), "gpoda_authorization_details") != json_null()) {
-                json_object_set_new(json_array_get(j_result, 0), "authorization_details", json_loads(json_string_value(json_object_get(json_array_get(j_result, 0), "gpoda_authorization_details")), JSON_DECODE_ANY, NULL));
-              }
-              json_object_del(json_array_get(j_result, 0), "gpoda_authorization_details");
-              j_query = json_pack("{sss[s]s{sOsi}}",
-                                  "table",
-                                  GLEWLWYD_PLUGIN_OIDC_TABLE_DEVICE_AUTHORIZATION_SCOPE,
-                                  "columns",
-                                    "gpodas_scope",
-                                  "where",
-                                    "gpoda_id",
-                                    json_object_get(json_array_get(j_result, 0), "gpoda_id"),
-                                    "gpodas_allowed",
-                                    1);
-              res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result_scope, NULL);
-              json_decref(j_query);
-              if (res == H_OK) {
-                json_array_foreach(j_result_scope, index, j_element) {
-                  if (0 == o_strcmp("openid", json_string_value(json_object_get(j_element, "gpodas_scope")))) {
-                    has_openid = 1;
-                  }
-                  if (scope == NULL) {
-                    scope = o_strdup(json_string_value(json_object_get(j_element, "gpodas_scope")));
-                  } else {
-                    scope = mstrcatf(scope, " %s", json_string_value(json_object_get(j_element, "gpodas_scope")));
-                  }
+      time(&now);
+      pending = get_pending_auth(config, GLEWLWYD_PENDING_AUTH_TYPE_DEVICE, device_code_hash, json_string_value(json_object_get(json_object_get(j_client, "client"), "client_id")), now, &last_check, NULL);
+      if (pending == G_OK && (now - last_check) < json_integer_value(json_object_get(config->j_params, "device-authorization-interval"))) {
+        // Slow down dammit!
+        j_body = json_pack("{ss}", "error", "slow_down");
+        ulfius_set_json_body_response(response, 400, j_body);
+        json_decref(j_body);
+      } else if (pending == G_OK && wait_pending_auth(config, GLEWLWYD_PENDING_AUTH_TYPE_DEVICE, device_code_hash) != G_OK) {
+        // Wait for it!
+        j_body = json_pack("{ss}", "error", "authorization_pending");
+        ulfius_set_json_body_response(response, 400, j_body);
+        json_decref(j_body);
+      } else {
+        generation = get_pending_auth_generation(config);
+        j_query = json_pack("{sss[sssssssss]s{sssOs{ssss}}}",
+                            "table",
+                            GLEWLWYD_PLUGIN_OIDC_TABLE_DEVICE_AUTHORIZATION,
+                            "columns",
+                              "gpoda_id",
+                              "gpoda_username AS username",
+                              "gpoda_status",
+                              SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "UNIX_TIMESTAMP(gpoda_expires_at) AS expires_at", "gpoda_expires_at AS expires_at", "EXTRACT(EPOCH FROM gpoda_expires_at)::integer AS expires_at"),
+                              SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "UNIX_TIMESTAMP(gpoda_last_check) AS last_check", "gpoda_last_check AS last_check", "EXTRACT(EPOCH FROM gpoda_last_check)::integer AS last_check"),
+                              "gpoda_resource AS resource",
+                              "gpoda_dpop_jkt AS dpop_jkt",
+                              "gpoda_authorization_details",
+                              "gpoda_sid AS sid",
+                            "where",
+                              "gpoda_device_code_hash", device_code_hash,
+                              "gpoda_client_id", json_object_get(json_object_get(j_client, "client"), "client_id"),
+                              "gpoda_status",
+                                "operator",
+                                "raw",
+                                "value",
+                                "<= 1");
+        res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result, NULL);
+        json_decref(j_query);
+        if (res == H_OK) {
+          if (json_array_size(j_result)) {
+            time(&now);
+            if ((time_t)json_integer_value(json_object_get(json_array_get(j_result, 0), "expires_at")) >= now) {
+              if (json_integer_value(json_object_get(json_array_get(j_result, 0), "gpoda_status")) == 1) {
+                if (json_object_get(json_array_get(j_result, 0), "gpoda_authorization_details") != json_null()) {
+                  json_object_set_new(json_array_get(j_result, 0), "authorization_details", json_loads(json_string_value(json_object_get(json_array_get(j_result, 0), "gpoda_authorization_details")), JSON_DECODE_ANY, NULL));
                 }
-                j_query = json_pack("{sss[s]s{sO}}",
+                json_object_del(json_array_get(j_result, 0), "gpoda_authorization_details");
+                j_query = json_pack("{sss[s]s{sOsi}}",
                                     "table",
-                                    GLEWLWYD_PLUGIN_OIDC_TABLE_DEVICE_SCHEME,
+                                    GLEWLWYD_PLUGIN_OIDC_TABLE_DEVICE_AUTHORIZATION_SCOPE,
                                     "columns",
-                                      "gpodh_scheme_module AS scheme_module",
+                                      "gpodas_scope",
                                     "where",
                                       "gpoda_id",
-                                      json_object_get(json_array_get(j_result, 0), "gpoda_id"));
-                res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result_sheme, NULL);
+                                      json_object_get(json_array_get(j_result, 0), "gpoda_id"),
+                                      "gpodas_allowed",
+                                      1);
+                res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result_scope, NULL);
                 json_decref(j_query);
                 if (res == H_OK) {
-                  if ((j_amr = json_array()) != NULL) {
-                    json_array_foreach(j_result_sheme, index, j_element) {
-                      json_array_append(j_amr, json_object_get(j_element, "scheme_module"));
+                  json_array_foreach(j_result_scope, index, j_element) {
+                    if (0 == o_strcmp("openid", json_string_value(json_object_get(j_element, "gpodas_scope")))) {
+                      has_openid = 1;
                     }
-                    j_refresh = get_refresh_token_duration_rolling(config, scope);
-                    if (check_result_value(j_refresh, G_OK)) {
-                      // All clear, please send back tokens
-                      username = json_string_value(json_object_get(json_array_get(j_result, 0), "username"));
-                      j_user = config->glewlwyd_config->glewlwyd_plugin_callback_get_user(config->glewlwyd_config, username);
-                      if (check_result_value(j_user, G_OK)) {
-                        time(&now);
-                        j_jkt = oidc_verify_dpop_proof(config, request, "POST", "/token", json_object_get(j_client, "client"), NULL, json_string_value(json_object_get(json_array_get(j_result, 0), "dpop_jkt")));
-                        if (check_result_value(j_jkt, G_OK)) {
-                          if (json_object_get(j_jkt, "jkt") == NULL ||
-                              (res = check_dpop_jti(config,
-                                                    json_string_value(json_object_get(json_object_get(j_jkt, "claims"), "jti")),
-                                                    json_string_value(json_object_get(json_object_get(j_jkt, "claims"), "htm")),
-                                                    json_string_value(json_object_get(json_object_get(j_jkt, "claims"), "htu")),
-                                                    json_integer_value(json_object_get(json_object_get(j_jkt, "claims"), "iat")),
-                                                    client_id,
-                                                    json_string_value(json_object_get(j_jkt, "jkt")),
-                                                    ip_source)) == G_OK) {
-                            if (json_object_get(j_jkt, "jkt") != NULL && json_object_get(config->j_params, "oauth-dpop-nonce-mandatory") == json_true()) {
-                              if ((dpop_nonce = refresh_client_dpop_nonce(config, client_id)) != NULL) {
-                                ulfius_set_response_properties(response, U_OPT_HEADER_PARAMETER, "DPoP-Nonce", dpop_nonce, U_OPT_NONE);
-                                o_free(dpop_nonce);
+                    if (scope == NULL) {
+                      scope = o_strdup(json_string_value(json_object_get(j_element, "gpodas_scope")));
+                    } else {
+                      scope = mstrcatf(scope, " %s", json_string_value(json_object_get(j_element, "gpodas_scope")));
+                    }
+                  }
+                  j_query = json_pack("{sss[s]s{sO}}",
+                                      "table",
+                                      GLEWLWYD_PLUGIN_OIDC_TABLE_DEVICE_SCHEME,
+                                      "columns",
+                                        "gpodh_scheme_module AS scheme_module",
+                                      "where",
+                                        "gpoda_id",
+                                        json_object_get(json_array_get(j_result, 0), "gpoda_id"));
+                  res = h_select(config->glewlwyd_config->glewlwyd_config->conn, j_query, &j_result_sheme, NULL);
+                  json_decref(j_query);
+                  if (res == H_OK) {
+                    if ((j_amr = json_array()) != NULL) {
+                      json_array_foreach(j_result_sheme, index, j_element) {
+                        json_array_append(j_amr, json_object_get(j_element, "scheme_module"));
+                      }
+                      j_refresh = get_refresh_token_duration_rolling(config, scope);
+                      if (check_result_value(j_refresh, G_OK)) {
+                        // All clear, please send back tokens
+                        username = json_string_value(json_object_get(json_array_get(j_result, 0), "username"));
+                        if (config->glewlwyd_config->glewlwyd_plugin_callback_get_user_view(config->glewlwyd_config, username, &user_view) == G_OK) {
+                          time(&now);
+                          j_jkt = oidc_verify_dpop_proof(config, request, "POST", "/token", json_object_get(j_client, "client"), NULL, json_string_value(json_object_get(json_array_get(j_result, 0), "dpop_jkt")));
+                          if (check_result_value(j_jkt, G_OK)) {
+                            if (json_object_get(j_jkt, "jkt") == NULL ||
+                                (res = check_dpop_jti(config,
+                                                      json_string_value(json_object_get(json_object_get(j_jkt, "claims"), "jti")),
+                                                      json_string_value(json_object_get(json_object_get(j_jkt, "claims"), "htm")),
+                                                      json_string_value(json_object_get(json_object_get(j_jkt, "claims"), "htu")),
+                                                      json_integer_value(json_object_get(json_object_get(j_jkt, "claims"), "iat")),
+                                                      client_id,
+                                                      json_string_value(json_object_get(j_jkt, "jkt")),
+                                                      ip_source)) == G_OK) {
+                              if (json_object_get(j_jkt, "jkt") != NULL && json_object_get(config->j_params, "oauth-dpop-nonce-mandatory") == json_true()) {
+                                if ((dpop_nonce = refresh_client_dpop_nonce(config, client_id)) != NULL) {
+                                  ulfius_set_response_properties(response, U_OPT_HEADER_PARAMETER, "DPoP-Nonce", dpop_nonce, U_OPT_NONE);
+                                  o_free(dpop_nonce);
+                                }
                               }
-                            }
-                            if (json_object_get(j_jkt, "jkt") != NULL) {
-                              token_type = GLEWLWYD_TOKEN_TYPE_DPOP;
-                            }
-                            if (json_object_get(json_array_get(j_result, 0), "dpop_jkt") != json_null() &&
-                                0 != o_strcmp(json_string_value(json_object_get(json_array_get(j_result, 0), "dpop_jkt")), json_string_value(json_object_get(j_jkt, "jkt")))) {
-                              j_body = json_pack("{ssss}", "error", "invalid_dpop_proof", "error_description", "Invalid DPoP");
-                              ulfius_set_json_body_response(response, 403, j_body);
-                              json_decref(j_body);
-                            } else {
-                              if ((refresh_token = generate_refresh_token()) != NULL) {
-                                y_log_message(Y_LOG_LEVEL_INFO, "Event oidc - Plugin '%s' - Refresh token generated for client '%s' granted by user '%s' with scope list '%s', origin: %s", config->name, client_id, username, scope, get_ip_source(request));
-                                if (json_object_get(config->j_params, "resource-allowed") == json_true()) {
-                                  resource = u_map_get(request->map_post_body, "resource");
-                                  resource_stored = json_string_value(json_object_get(json_array_get(j_result, 0), "resource"));
-                                  if (!o_strnullempty(resource)) {
-                                    if (!o_strnullempty(resource_stored)) {
-                                      if (split_string(resource_stored, ",", &resource_list)) {
-                                        resource_valid = 0;
-                                        for (i=0; resource_list[i]!=NULL && !has_error; i++) {
-                                          if (0 == o_strcmp(resource_list[i], resource)) {
-                                            resource_valid = 1;
-                                            if ((res = verify_resource(config, resource, json_object_get(j_client, "client"), scope)) == G_ERROR_PARAM) {
-                                              y_log_message(Y_LOG_LEVEL_DEBUG, "oidc get_access_token_from_refresh - Error resource '%s' unauthorized", resource_list[i]);
-                                              has_error = 1;
-                                              json_body = json_pack("{ssss}", "error", "invalid_target", "error_description", "Invalid Resource");
-                                              ulfius_set_json_body_response(response, 400, json_body);
-                                              json_decref(json_body);
-                                            } else if (res != G_OK) {
-                                              y_log_message(Y_LOG_LEVEL_DEBUG, "oidc get_access_token_from_refresh - Error verify_resource '%s'", resource);
-                                              has_error = 1;
-                                              json_body = json_pack("{ssss}", "error", "server_error");
-                                              ulfius_set_json_body_response(response, 500, json_body);
-                                              json_decref(json_body);
+                              if (json_object_get(j_jkt, "jkt") != NULL) {
+                                token_type = GLEWLWYD_TOKEN_TYPE_DPOP;
+                              }
+                              if (json_object_get(json_array_get(j_result, 0), "dpop_jkt") != json_null() &&
+                                  0 != o_strcmp(json_string_value(json_object_get(json_array_get(j_result, 0), "dpop_jkt")), json_string_value(json_object_get(j_jkt, "jkt")))) {
+                                j_body = json_pack("{ssss}", "error", "invalid_dpop_proof", "error_description", "Invalid DPoP");
+                                ulfius_set_json_body_response(response, 403, j_body);
+                                json_decref(j_body);
+                              } else {
+                                if ((refresh_token = generate_refresh_token()) != NULL) {
+                                  y_log_message(Y_LOG_LEVEL_INFO, "Event oidc - Plugin '%s' - Refresh token generated for client '%s' granted by user '%s' with scope list '%s', origin: %s", config->name, client_id, username, scope, get_ip_source(request));
+                                  if (json_object_get(config->j_params, "resource-allowed") == json_true()) {
+                                    resource = u_map_get(request->map_post_body, "resource");
+                                    resource_stored = json_string_value(json_object_get(json_array_get(j_result, 0), "resource"));
+                                    if (!o_strnullempty(resource)) {
+                                      if (!o_strnullempty(resource_stored)) {
+                                        if (split_string(resource_stored, ",", &resource_list)) {
+                                          resource_valid = 0;
+                                          for (i=0; resource_list[i]!=NULL && !has_error; i++) {
+                                            if (0 == o_strcmp(resource_list[i], resource)) {
+                                              resource_valid = 1;
+                                              if ((res = verify_resource(config, resource, json_object_get(j_client, "client"), scope)) == G_ERROR_PARAM) {
+                                                y_log_message(Y_LOG_LEVEL_DEBUG, "oidc get_access_token_from_refresh - Error resource '%s' unauthorized", resource_list[i]);
+                                                has_error = 1;
+                                                json_body = json_pack("{ssss}", "error", "invalid_target", "error_description", "Invalid Resource");
+                                                ulfius_set_json_body_response(response, 400, json_body);
+                                                json_decref(json_body);
+                                              } else if (res != G_OK) {
+                                                y_log_message(Y_LOG_LEVEL_DEBUG, "oidc get_access_token_from_refresh - Error verify_resource '%s'", resource);
+                                                has_error = 1;
+                                                json_body = json_pack("{ssss}", "error", "server_error");
+                                                ulfius_set_json_body_response(response, 500, json_body);
+                                                json_decref(json_body);
+                                              }
                                             }
                                           }
-                                        }
-                                        if (!resource_valid) {
-                                          y_log_message(Y_LOG_LEVEL_DEBUG, "oidc get_access_token_from_refresh - Error resource '%s' unauthorized", resource);
-                                          has_error = 1;
-                                          json_body = json_pack("{ssss}", "error", "invalid_target", "error_description", "Invalid Resource");
-                                          ulfius_set_json_body_response(response, 400, json_body);
+                                          if (!resource_valid) {
+                                            y_log_message(Y_LOG_LEVEL_DEBUG, "oidc get_access_token_from_refresh - Error resource '%s' unauthorized", resource);
+                                            has_error = 1;
+                                            json_body = json_pack("{ssss}", "error", "invalid_target", "error_description", "Invalid Resource");
+                                            ulfius_set_json_body_response(response, 400, json_body);
+                                            json_decref(json_body);
+                                          }
+                                          free_string_array(resource_list);
+                                        } else {
+                                          json_body = json_pack("{ssss}", "error", "server_error");
+                                          ulfius_set_json_body_response(response, 500, json_body);
                                           json_decref(json_body);
+                                          has_error = 1;
+                                          y_log_message(Y_LOG_LEVEL_ERROR, "oidc get_access_token_from_refresh - Error split_string");
                                         }
-                                        free_string_array(resource_list);
                                       } else {
-                                        json_body = json_pack("{ssss}", "error", "server_error");
-                                        ulfius_set_json_body_response(response, 500, json_body);
-                                        json_decref(json_body);
+                                        y_log_message(Y_LOG_LEVEL_DEBUG, "oidc get_access_token_from_refresh - Error resource '%s' unauthorized", resource);
                                         has_error = 1;
-                                        y_log_message(Y_LOG_LEVEL_ERROR, "oidc get_access_token_from_refresh - Error split_string");
+                                        json_body = json_pack("{ssss}", "error", "invalid_target", "error_description", "Invalid Resource");
+                                        ulfius_set_json_body_response(response, 400, json_body);
+                                        json_decref(json_body);
                                       }
+                                    } else if (!o_strnullempty(resource_stored) && o_strchr(resource_stored, ',') == NULL) {
+                                      resource = resource_stored;
                                     } else {
-                                      y_log_message(Y_LOG_LEVEL_DEBUG, "oidc get_access_token_from_refresh - Error resource '%s' unauthorized", resource);
-                                      has_error = 1;
-                                      json_body = json_pack("{ssss}", "error", "invalid_target", "error_description", "Invalid Resource");
-                                      ulfius_set_json_body_response(response, 400, json_body);
-                                      json_decref(json_body);
+                                      resource = NULL;
                                     }
-                                  } else if (!o_strnullempty(resource_stored) && o_strchr(resource_stored, ',') == NULL) {
-                                    resource = resource_stored;
-                                  } else {
-                                    resource = NULL;
                                   }
-                                }
-                                if (!has_error) {
-                                  j_refresh_token = serialize_refresh_token(config,
-                                                                            GLEWLWYD_AUTHORIZATION_TYPE_DEVICE_AUTHORIZATION,
-                                                                            0,
-                                                                            username,
-                                                                            client_id,
-                                                                            scope,
-                                                                            resource_stored,
-                                                                            now,
-                                                                            json_integer_value(json_object_get(json_object_get(j_refresh, "refresh-token"), "refresh-token-duration")),
-                                                                            json_object_get(json_object_get(j_refresh, "refresh-token"), "refresh-token-rolling")==json_true(),
-                                                                            NULL,
-                                                                            refresh_token,
-                                                                            issued_for,
-                                                                            u_map_get_case(request->map_header, "user-agent"),
-                                                                            jti_r,
-                                                                            json_string_value(json_object_get(j_jkt, "jkt")),
-                                                                            json_object_get(json_array_get(j_result, 0), "authorization_details"));
-                                  if (check_result_value(j_refresh_token, G_OK)) {
-                                    if ((access_token = generate_access_token(config,
+                                  if (!has_error) {
+                                    j_refresh_token = serialize_refresh_token(config,
+                                                                              GLEWLWYD_AUTHORIZATION_TYPE_DEVICE_AUTHORIZATION,
+                                                                              0,
                                                                               username,
-                                                                              json_object_get(j_client, "client"),
-                                                                              json_object_get(j_user, "user"),
+                                                                              client_id,
                                                                               scope,
-                                                                              NULL,
-                                                                              resource,
+                                                                              resource_stored,
                                                                               now,
-                                                                              jti,
-                                                                              x5t_s256,
+                                                                              json_integer_value(json_object_get(json_object_get(j_refresh, "refresh-token"), "refresh-token-duration")),
+                                                                              json_object_get(json_object_get(j_refresh, "refresh-token"), "refresh-token-rolling")==json_true(),
+                                                                              NULL,
+                                                                              refresh_token,
+                                                                              issued_for,
+                                                                              u_map_get_case(request->map_header, "user-agent"),
+                                                                              jti_r,
                                                                               json_string_value(json_object_get(j_jkt, "jkt")),
-                                                                              json_object_get(json_array_get(j_result, 0), "authorization_details"),
-                                                                              get_ip_source(request))) != NULL) {
-                                      if (serialize_access_token(config,
-                                                                 GLEWLWYD_AUTHORIZATION_TYPE_DEVICE_AUTHORIZATION,
-                                                                 json_integer_value(json_object_get(j_refresh_token, "gpgr_id")),
-                                                                 username,
-                                                                 client_id,
-                                                                 scope,
-                                                                 resource,
-                                                                 now,
-                                                                 issued_for,
-                                                                 u_map_get_case(request->map_header, "user-agent"),
-                                                                 access_token,
-                                                                 jti,
-                                                                 json_object_get(json_array_get(j_result, 0), "authorization_details")) == G_OK) {
-                                        if (!has_openid ||
-                                            (id_token = generate_id_token(config,
-                                                                          username,
-                                                                          json_object_get(j_user, "user"),
-                                                                          json_object_get(j_client, "client"),
-                                                                          now,
-                                                                          now,
-                                                                          NULL,
-                                                                          j_amr,
-                                                                          access_token,
-                                                                          NULL,
-                                                                          scope,
-                                                                          NULL,
-                                                                          NULL,
-                                                                          NULL,
-                                                                          NULL,
-                                                                          json_string_value(json_object_get(json_array_get(j_result, 0), "sid")),
-                                                                          ip_source)) != NULL) {
+                                                                              json_object_get(json_array_get(j_result, 0), "authorization_details"));
+                                    if (check_result_value(j_refresh_token, G_OK)) {
+                                      if ((access_token = generate_access_token(config,
+                                                                                username,
+                                                                                json_object_get(j_client, "client"),
+                                                                                user_view->j_user,
+                                                                                scope,
+                                                                                NULL,
+                                                                                resource,
+                                                                                now,
+                                                                                jti,
+                                                                                x5t_s256,
+                                                                                json_string_value(json_object_get(j_jkt, "jkt")),
+                                                                                json_object_get(json_array_get(j_result, 0), "authorization_details"),
+                                                                                get_ip_source(request))) != NULL) {
+                                        if (serialize_access_token(config,
+                                                                   GLEWLWYD_AUTHORIZATION_TYPE_DEVICE_AUTHORIZATION,
+                                                                   json_integer_value(json_object_get(j_refresh_token, "gpgr_id")),
+                                                                   username,
+                                                                   client_id,
+                                                                   scope,
+                                                                   resource,
+                                                                   now,
+                                                                   issued_for,
+                                                                   u_map_get_case(request->map_header, "user-agent"),
+                                                                   access_token,
+                                                                   jti,
+                                                                   json_object_get(json_array_get(j_result, 0), "authorization_details")) == G_OK) {
                                           if (!has_openid ||
-                                              serialize_id_token(config,
-                                                                 GLEWLWYD_AUTHORIZATION_TYPE_DEVICE_AUTHORIZATION,
-                                                                 id_token,
-                                                                 username,
-                                                                 client_id,
-                                                                 json_string_value(json_object_get(json_array_get(j_result, 0), "sid")),
-                                                                 0,
-                                                                 json_integer_value(json_object_get(j_refresh_token, "gpgr_id")),
-                                                                 now,
-                                                                 issued_for,
-                                                                 u_map_get_case(request->map_header, "user-agent")) == G_OK) {
-                                            if ((access_token_out = encrypt_token_if_required(config, access_token, json_object_get(j_client, "client"), GLEWLWYD_TOKEN_TYPE_ACCESS_TOKEN, &a_enc_res)) != NULL &&
-                                                (refresh_token_out = encrypt_token_if_required(config, refresh_token, json_object_get(j_client, "client"), GLEWLWYD_TOKEN_TYPE_REFRESH_TOKEN, &r_enc_res)) != NULL &&
-                                                (!has_openid || (id_token_out = encrypt_token_if_required(config, id_token, json_object_get(j_client, "client"), GLEWLWYD_TOKEN_TYPE_ID_TOKEN, &i_enc_res)) != NULL)) {
-                                              j_query = json_pack("{sss{si}s{sO}}",
-                                                                  "table",
-                                                                  GLEWLWYD_PLUGIN_OIDC_TABLE_DEVICE_AUTHORIZATION,
-                                                                  "set",
-                                                                    "gpoda_status", 2,
-                                                                  "where",
-                                                                    "gpoda_id", json_object_get(json_array_get(j_result, 0), "gpoda_id"));
-                                              res = h_update(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
-                                              json_decref(j_query);
-                                              if (res == H_OK) {
-                                                j_body = json_pack("{ssssssss*sisIsssO*}",
-                                                                   "token_type", token_type,
-                                                                   "access_token", access_token_out,
-                                                                   "refresh_token", refresh_token_out,
-                                                                   "id_token", id_token_out,
-                                                                   "iat", now,
-                                                                   "expires_in", config->access_token_duration,
-                                                                   "scope", scope,
-                                                                   "authorization_details", json_object_get(json_array_get(j_result, 0), "authorization_details"));
-                                                ulfius_set_json_body_response(response, 200, j_body);
+                                              (id_token = generate_id_token(config,
+                                                                            username,
+                                                                            user_view->j_user,
+                                                                            json_object_get(j_client, "client"),
+                                                                            now,
+                                                                            now,
+                                                                            NULL,
+                                                                            j_amr,
+                                                                            access_token,
+                                                                            NULL,
+                                                                            scope,
+                                                                            NULL,
+                                                                            NULL,
+                                                                            NULL,
+                                                                            NULL,
+                                                                            json_string_value(json_object_get(json_array_get(j_result, 0), "sid")),
+                                                                            ip_source)) != NULL) {
+                                            if (!has_openid ||
+                                                serialize_id_token(config,
+                                                                   GLEWLWYD_AUTHORIZATION_TYPE_DEVICE_AUTHORIZATION,
+                                                                   id_token,
+                                                                   username,
+                                                                   client_id,
+                                                                   json_string_value(json_object_get(json_array_get(j_result, 0), "sid")),
+                                                                   0,
+                                                                   json_integer_value(json_object_get(j_refresh_token, "gpgr_id")),
+                                                                   now,
+                                                                   issued_for,
+                                                                   u_map_get_case(request->map_header, "user-agent")) == G_OK) {
+                                              if ((access_token_out = encrypt_token_if_required(config, access_token, json_object_get(j_client, "client"), GLEWLWYD_TOKEN_TYPE_ACCESS_TOKEN, &a_enc_res)) != NULL &&
+                                                  (refresh_token_out = encrypt_token_if_required(config, refresh_token, json_object_get(j_client, "client"), GLEWLWYD_TOKEN_TYPE_REFRESH_TOKEN, &r_enc_res)) != NULL &&
+                                                  (!has_openid || (id_token_out = encrypt_token_if_required(config, id_token, json_object_get(j_client, "client"), GLEWLWYD_TOKEN_TYPE_ID_TOKEN, &i_enc_res)) != NULL)) {
+                                                j_query = json_pack("{sss{si}s{sO}}",
+                                                                    "table",
+                                                                    GLEWLWYD_PLUGIN_OIDC_TABLE_DEVICE_AUTHORIZATION,
+                                                                    "set",
+                                                                      "gpoda_status", 2,
+                                                                    "where",
+                                                                      "gpoda_id", json_object_get(json_array_get(j_result, 0), "gpoda_id"));
+                                                res = h_update(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
+                                                json_decref(j_query);
+                                                if (res == H_OK) {
+                                                  j_body = json_pack("{ssssssss*sisIsssO*}",
+                                                                     "token_type", token_type,
+                                                                     "access_token", access_token_out,
+                                                                     "refresh_token", refresh_token_out,
+                                                                     "id_token", id_token_out,
+                                                                     "iat", now,
+                                                                     "expires_in", config->access_token_duration,
+                                                                     "scope", scope,
+                                                                     "authorization_details", json_object_get(json_array_get(j_result, 0), "authorization_details"));
+                                                  ulfius_set_json_body_response(response, 200, j_body);
+                                                  json_decref(j_body);
+                                                  config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_ID_TOKEN, 1, "plugin", "response_type", "device_code", config->name, NULL);
+                                                  config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_ID_TOKEN, 1, "plugin", config->name, NULL);
+                                                  config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_REFRESH_TOKEN, 1, "plugin", "response_type", "device_code", config->name, NULL);
+                                                  config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_REFRESH_TOKEN, 1, "plugin", config->name, NULL);
+                                                  config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_USER_ACCESS_TOKEN, 1, "plugin", "response_type", "device_code", config->name, NULL);
+                                                  config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_USER_ACCESS_TOKEN, 1, "plugin", config->name, NULL);
+                                                } else {
+                                                  y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error executing j_query (4)");
+                                                  j_body = json_pack("{ss}", "error", "server_error");
+                                                  ulfius_set_json_body_response(response, 500, j_body);
+                                                  json_decref(j_body);
+                                                }
+                                              } else if (r_enc_res == G_ERROR_UNAUTHORIZED || a_enc_res == G_ERROR_UNAUTHORIZED || i_enc_res == G_ERROR_UNAUTHORIZED) {
+                                                j_body = json_pack("{ss}", "error", "server_error");
+                                                j_body = json_pack("{ss}", "error_description", "Invalid encryption parameters");
+                                                ulfius_set_json_body_response(response, 400, j_body);
                                                 json_decref(j_body);
-                                                config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_ID_TOKEN, 1, "plugin", "response_type", "device_code", config->name, NULL);
-                                                config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_ID_TOKEN, 1, "plugin", config->name, NULL);
-                                                config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_REFRESH_TOKEN, 1, "plugin", "response_type", "device_code", config->name, NULL);
-                                                config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_REFRESH_TOKEN, 1, "plugin", config->name, NULL);
-                                                config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_USER_ACCESS_TOKEN, 1, "plugin", "response_type", "device_code", config->name, NULL);
-                                                config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_USER_ACCESS_TOKEN, 1, "plugin", config->name, NULL);
                                               } else {
-                                                y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error executing j_query (4)");
+                                                y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error encrypt_token_if_required");
                                                 j_body = json_pack("{ss}", "error", "server_error");
                                                 ulfius_set_json_body_response(response, 500, j_body);
                                                 json_decref(j_body);
                                               }
-                                            } else if (r_enc_res == G_ERROR_UNAUTHORIZED || a_enc_res == G_ERROR_UNAUTHORIZED || i_enc_res == G_ERROR_UNAUTHORIZED) {
-                                              j_body = json_pack("{ss}", "error", "server_error");
-                                              j_body = json_pack("{ss}", "error_description", "Invalid encryption parameters");
-                                              ulfius_set_json_body_response(response, 400, j_body);
-                                              json_decref(j_body);
+                                              o_free(id_token_out);
+                                              o_free(access_token_out);
+                                              o_free(refresh_token_out);
                                             } else {
-                                              y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error encrypt_token_if_required");
+                                              y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error serialize_id_token");
                                               j_body = json_pack("{ss}", "error", "server_error");
                                               ulfius_set_json_body_response(response, 500, j_body);
                                               json_decref(j_body);
                                             }
-                                            o_free(id_token_out);
-                                            o_free(access_token_out);
-                                            o_free(refresh_token_out);
                                           } else {
-                                            y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error serialize_id_token");
+                                            y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error generate_id_token");
                                             j_body = json_pack("{ss}", "error", "server_error");
                                             ulfius_set_json_body_response(response, 500, j_body);
                                             json_decref(j_body);
                                           }
+                                          o_free(id_token);
                                         } else {
-                                          y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error generate_id_token");
+                                          y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error serialize_access_token");
                                           j_body = json_pack("{ss}", "error", "server_error");
                                           ulfius_set_json_body_response(response, 500, j_body);
                                           json_decref(j_body);
                                         }
-                                        o_free(id_token);
                                       } else {
-                                        y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error serialize_access_token");
+                                        y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error generate_access_token");
                                         j_body = json_pack("{ss}", "error", "server_error");
                                         ulfius_set_json_body_response(response, 500, j_body);
                                         json_decref(j_body);
                                       }
+                                      o_free(access_token);
                                     } else {
-                                      y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error generate_access_token");
+                                      y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error serialize_refresh_token");
                                       j_body = json_pack("{ss}", "error", "server_error");
                                       ulfius_set_json_body_response(response, 500, j_body);
                                       json_decref(j_body);
                                     }
-                                    o_free(access_token);
+                                    json_decref(j_refresh_token);
                                   } else {
-                                    y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error serialize_refresh_token");
-                                    j_body = json_pack("{ss}", "error", "server_error");
-                                    ulfius_set_json_body_response(response, 500, j_body);
+                                    j_body = json_pack("{ssss}", "error", "invalid_target", "error_description", "Invalid Resource");
+                                    ulfius_set_json_body_response(response, 400, j_body);
                                     json_decref(j_body);
                                   }
-                                  json_decref(j_refresh_token);
+                                  o_free(refresh_token);
                                 } else {
-                                  j_body = json_pack("{ssss}", "error", "invalid_target", "error_description", "Invalid Resource");
-                                  ulfius_set_json_body_response(response, 400, j_body);
+                                  y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error generate_refresh_token");
+                                  j_body = json_pack("{ss}", "error", "server_error");
+                                  ulfius_set_json_body_response(response, 500, j_body);
                                   json_decref(j_body);
                                 }
-                                o_free(refresh_token);
-                              } else {
-                                y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error generate_refresh_token");
-                                j_body = json_pack("{ss}", "error", "server_error");
-                                ulfius_set_json_body_response(response, 500, j_body);
-                                json_decref(j_body);
                               }
+                            } else if (res == G_ERROR_UNAUTHORIZED) {
+                              j_body = json_pack("{ssss}", "error", "invalid_dpop_proof", "error_description", "Invalid DPoP");
+                              ulfius_set_json_body_response(response, 403, j_body);
+                              json_decref(j_body);
+                            } else {
+                              y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error check_dpop_jti");
+                              j_body = json_pack("{ss}", "error", "server_error");
+                              ulfius_set_json_body_response(response, 500, j_body);
+                              json_decref(j_body);
+                            }
+                          } else if (check_result_value(j_jkt, G_ERROR_PARAM) || check_result_value(j_jkt, G_ERROR_UNAUTHORIZED)) {
+                            if (json_object_get(j_jkt, "nonce") != NULL) {
+                              json_body = json_pack("{ssss}", "error", "use_dpop_nonce", "error_description", "Authorization server requires nonce in DPoP proof");
+                              ulfius_set_response_properties(response, U_OPT_STATUS, 400,
+                                                                       U_OPT_HEADER_PARAMETER, "DPoP-Nonce", json_string_value(json_object_get(j_jkt, "nonce")),
+                                                                       U_OPT_JSON_BODY, json_body,
+                                                                       U_OPT_NONE);
+                              json_decref(json_body);
+
+                            } else {
+                              y_log_message(Y_LOG_LEVEL_WARNING, "Security - DPoP invalid at IP Address %s", get_ip_source(request));
+                              json_body = json_pack("{ssss}", "error", "invalid_dpop_proof", "error_description", "Invalid DPoP");
+                              ulfius_set_json_body_response(response, 403, json_body);
+                              json_decref(json_body);
+                              config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_UNAUTHORIZED_CLIENT, 1, "plugin", config->name, NULL);
                             }
-                          } else if (res == G_ERROR_UNAUTHORIZED) {
-                            j_body = json_pack("{ssss}", "error", "invalid_dpop_proof", "error_description", "Invalid DPoP");
-                            ulfius_set_json_body_response(response, 403, j_body);
-                            json_decref(j_body);
                           } else {
-                            y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error check_dpop_jti");
+                            y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error oidc_verify_dpop_proof");
                             j_body = json_pack("{ss}", "error", "server_error");
                             ulfius_set_json_body_response(response, 500, j_body);
                             json_decref(j_body);
                           }
-                        } else if (check_result_value(j_jkt, G_ERROR_PARAM) || check_result_value(j_jkt, G_ERROR_UNAUTHORIZED)) {
-                          if (json_object_get(j_jkt, "nonce") != NULL) {
-                            json_body = json_pack("{ssss}", "error", "use_dpop_nonce", "error_description", "Authorization server requires nonce in DPoP proof");
-                            ulfius_set_response_properties(response, U_OPT_STATUS, 400,
-                                                                     U_OPT_HEADER_PARAMETER, "DPoP-Nonce", json_string_value(json_object_get(j_jkt, "nonce")),
-                                                                     U_OPT_JSON_BODY, json_body,
-                                                                     U_OPT_NONE);
-                            json_decref(json_body);
-
-                          } else {
-                            y_log_message(Y_LOG_LEVEL_WARNING, "Security - DPoP invalid at IP Address %s", get_ip_source(request));
-                            json_body = json_pack("{ssss}", "error", "invalid_dpop_proof", "error_description", "Invalid DPoP");
-                            ulfius_set_json_body_response(response, 403, json_body);
-                            json_decref(json_body);
-                            config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_UNAUTHORIZED_CLIENT, 1, "plugin", config->name, NULL);
-                          }
+                          json_decref(j_jkt);
                         } else {
-                          y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error oidc_verify_dpop_proof");
+                          y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error getting user %s", username);
                           j_body = json_pack("{ss}", "error", "server_error");
                           ulfius_set_json_body_response(response, 500, j_body);
                           json_decref(j_body);
                         }
-                        json_decref(j_jkt);
+                        config->glewlwyd_config->glewlwyd_plugin_callback_release_user_view(config->glewlwyd_config, user_view);
+                        o_free(scope);
+                        json_decref(j_result_scope);
                       } else {
-                        y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error getting user %s", username);
+                        y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error get_refresh_token_duration_rolling");
                         j_body = json_pack("{ss}", "error", "server_error");
                         ulfius_set_json_body_response(response, 500, j_body);
                         json_decref(j_body);
                       }
-                      json_decref(j_user);
-                      o_free(scope);
-                      json_decref(j_result_scope);
+                      json_decref(j_refresh);
                     } else {
-                      y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error get_refresh_token_duration_rolling");
+                      y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error allocating resources for j_amr");
                       j_body = json_pack("{ss}", "error", "server_error");
                       ulfius_set_json_body_response(response, 500, j_body);
                       json_decref(j_body);
                     }
-                    json_decref(j_refresh);
+                    json_decref(j_amr);
+                    json_decref(j_result_sheme);
                   } else {
-                    y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error allocating resources for j_amr");
+                    y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error executing j_query (3)");
                     j_body = json_pack("{ss}", "error", "server_error");
                     ulfius_set_json_body_response(response, 500, j_body);
                     json_decref(j_body);
                   }
-                  json_decref(j_amr);
-                  json_decref(j_result_sheme);
                 } else {
-                  y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error executing j_query (3)");
+                  y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error executing j_query (2)");
                   j_body = json_pack("{ss}", "error", "server_error");
                   ulfius_set_json_body_response(response, 500, j_body);
                   json_decref(j_body);
                 }
               } else {
-                y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error executing j_query (2)");
-                j_body = json_pack("{ss}", "error", "server_error");
-                ulfius_set_json_body_response(response, 500, j_body);
-                json_decref(j_body);
-              }
-            } else {
-              j_query = json_pack("{sss{s{ss}}s{sO}}",
-                                  "table",
-                                  GLEWLWYD_PLUGIN_OIDC_TABLE_DEVICE_AUTHORIZATION,
-                                  "set",
-                                    "gpoda_last_check",
-                                      "raw",
-                                      SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "CURRENT_TIMESTAMP", "strftime('%s','now')", "NOW()"),
-                                  "where",
-                                    "gpoda_id",
-                                    json_object_get(json_array_get(j_result, 0), "gpoda_id"));
-              res = h_update(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
-              json_decref(j_query);
-              if (res == H_OK) {
-                if ((now - json_integer_value(json_object_get(json_array_get(j_result, 0), "last_check"))) >= json_integer_value(json_object_get(config->j_params, "device-authorization-interval"))) {
-                  // Wait for it!
-                  j_body = json_pack("{ss}", "error", "authorization_pending");
-                  ulfius_set_json_body_response(response, 400, j_body);
-                  json_decref(j_body);
+                j_query = json_pack("{sss{s{ss}}s{sO}}",
+                                    "table",
+                                    GLEWLWYD_PLUGIN_OIDC_TABLE_DEVICE_AUTHORIZATION,
+                                    "set",
+                                      "gpoda_last_check",
+                                        "raw",
+                                        SWITCH_DB_TYPE(config->glewlwyd_config->glewlwyd_config->conn->type, "CURRENT_TIMESTAMP", "strftime('%s','now')", "NOW()"),
+                                    "where",
+                                      "gpoda_id",
+                                      json_object_get(json_array_get(j_result, 0), "gpoda_id"));
+                res = h_update(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
+                json_decref(j_query);
+                if (res == H_OK) {
+                  set_pending_auth(config,
+                                   GLEWLWYD_PENDING_AUTH_TYPE_DEVICE,
+                                   device_code_hash,
+                                   json_integer_value(json_object_get(json_array_get(j_result, 0), "gpoda_id")),
+                                   json_string_value(json_object_get(json_object_get(j_client, "client"), "client_id")),
+                                   NULL,
+                                   (time_t)json_integer_value(json_object_get(json_array_get(j_result, 0), "expires_at")),
+                                   now,
+                                   generation);
+                  if ((now - json_integer_value(json_object_get(json_array_get(j_result, 0), "last_check"))) >= json_integer_value(json_object_get(config->j_params, "device-authorization-interval"))) {
+                    // Wait for it!
+                    j_body = json_pack("{ss}", "error", "authorization_pending");
+                    ulfius_set_json_body_response(response, 400, j_body);
+                    json_decref(j_body);
+                  } else {
+                    // Slow down dammit!
+                    j_body = json_pack("{ss}", "error", "slow_down");
+                    ulfius_set_json_body_response(response, 400, j_body);
+                    json_decref(j_body);
+                  }
                 } else {
-                  // Slow down dammit!
-                  j_body = json_pack("{ss}", "error", "slow_down");
-                  ulfius_set_json_body_response(response, 400, j_body);
+                  y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error executing j_query (3)");
+                  j_body = json_pack("{ss}", "error", "server_error");
+                  ulfius_set_json_body_response(response, 500, j_body);
                   json_decref(j_body);
                 }
-              } else {
-                y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error executing j_query (3)");
-                j_body = json_pack("{ss}", "error", "server_error");
-                ulfius_set_json_body_response(response, 500, j_body);
-                json_decref(j_body);
               }
+            } else {
+              // Code expired
+              j_body = json_pack("{ss}", "error", "expired_token");
+              ulfius_set_json_body_response(response, 400, j_body);
+              json_decref(j_body);
             }
           } else {
-            // Code expired
-            j_body = json_pack("{ss}", "error", "expired_token");
+            y_log_message(Y_LOG_LEVEL_DEBUG, "check_auth_type_device_code - oidc - Invalid code");
+            j_body = json_pack("{ss}", "error", "access_denied");
             ulfius_set_json_body_response(response, 400, j_body);
             json_decref(j_body);
           }
+          json_decref(j_result);
         } else {
-          y_log_message(Y_LOG_LEVEL_DEBUG, "check_auth_type_device_code - oidc - Invalid code");
-          j_body = json_pack("{ss}", "error", "access_denied");
-          ulfius_set_json_body_response(response, 400, j_body);
+          y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error executing j_query (1)");
+          j_body = json_pack("{ss}", "error", "server_error");
+          ulfius_set_json_body_response(response, 500, j_body);
           json_decref(j_body);
         }
-        json_decref(j_result);
-      } else {
-        y_log_message(Y_LOG_LEVEL_ERROR, "check_auth_type_device_code - oidc - Error executing j_query (1)");
-        j_body = json_pack("{ss}", "error", "server_error");
-        ulfius_set_json_body_response(response, 500, j_body);
-        json_decref(j_body);
       }
+      o_free(device_code_hash);
     } else {
       y_log_message(Y_LOG_LEVEL_WARNING, "Security - Authorization invalid for client_id %s at IP Address %s", client_id, ip_source);
       j_body = json_pack("{ss}", "error", "unauthorized_client");
@@ -8893,7 +10215,146 @@ static json_t * check_client_certificate_valid(struct _oidc_config * config, con
   return j_return;
 }
 
+static void clean_metadata(struct _oidc_metadata * metadata) {
+  o_free(metadata->body);
+  o_free(metadata->body_gzip);
+  o_free(metadata->etag);
+  o_free(metadata->etag_gzip);
+  metadata->body = NULL;
+  metadata->body_gzip = NULL;
+  metadata->body_gzip_len = 0;
+  metadata->etag = NULL;
+  metadata->etag_gzip = NULL;
+}
+
+static int compress_metadata_gzip(const char * body, char ** body_gzip, size_t * body_gzip_len) {
+  z_stream defstream;
+  int ret = G_OK;
+
+  memset(&defstream, 0, sizeof(z_stream));
+  defstream.avail_in = (uInt)o_strlen(body);
+  defstream.next_in = (Bytef *)body;
+  if (deflateInit2(&defstream, Z_BEST_COMPRESSION, Z_DEFLATED, GLEWLWYD_METADATA_GZIP_WINDOW_BITS | GLEWLWYD_METADATA_GZIP_ENCODING, 8, Z_DEFAULT_STRATEGY) == Z_OK) {
+    *body_gzip_len = deflateBound(&defstream, defstream.avail_in);
+    if ((*body_gzip = o_malloc(*body_gzip_len)) != NULL) {
+      defstream.avail_out = (uInt)*body_gzip_len;
+      defstream.next_out = (Bytef *)*body_gzip;
+      if (deflate(&defstream, Z_FINISH) == Z_STREAM_END) {
+        *body_gzip_len = defstream.total_out;
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "compress_metadata_gzip - Error deflate");
+        o_free(*body_gzip);
+        *body_gzip = NULL;
+        *body_gzip_len = 0;
+        ret = G_ERROR;
+      }
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "compress_metadata_gzip - Error allocating resources for body_gzip");
+      *body_gzip_len = 0;
+      ret = G_ERROR_MEMORY;
+    }
+    deflateEnd(&defstream);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "compress_metadata_gzip - Error deflateInit2");
+    ret = G_ERROR;
+  }
+  return ret;
+}
+
+/**
+ * Replace the metadata document with body, body is owned by the metadata afterwards
+ * The gzip version and the ETag are computed before the swap,
+ * so concurrent requests get either the old or the new document
+ */
+static int set_metadata(struct _oidc_config * config, struct _oidc_metadata * metadata, char * body) {
+  struct _oidc_metadata new_metadata = {NULL, NULL, 0, NULL, NULL}, old_metadata;
+  unsigned char hash[32] = {0}, hash_b64[64] = {0};
+  size_t hash_len = 32, hash_b64_len = 0;
+  int ret = G_OK;
+
+  if (body != NULL) {
+    new_metadata.body = body;
+    if (generate_digest_raw(digest_SHA256, (const unsigned char *)body, o_strlen(body), hash, &hash_len) && o_base64url_encode(hash, hash_len, hash_b64, &hash_b64_len)) {
+      new_metadata.etag = msprintf("\"%.*s\"", (int)hash_b64_len, hash_b64);
+      new_metadata.etag_gzip = msprintf("\"%.*s-gzip\"", (int)hash_b64_len, hash_b64);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "set_metadata - Error generating etag");
+      ret = G_ERROR;
+    }
+    if (compress_metadata_gzip(body, &new_metadata.body_gzip, &new_metadata.body_gzip_len) != G_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "set_metadata - Error compress_metadata_gzip");
+    }
+  }
+  pthread_mutex_lock(&config->metadata_lock);
+  old_metadata = *metadata;
+  *metadata = new_metadata;
+  pthread_mutex_unlock(&config->metadata_lock);
+  clean_metadata(&old_metadata);
+  return ret;
+}
+
+/**
+ * Send the metadata document, or 304 if the client already has the current version
+ * Return G_ERROR_NOT_FOUND if the document is not available
+ */
+static int send_metadata(struct _oidc_config * config, struct _oidc_metadata * metadata, const struct _u_request * request, struct _u_response * response) {
+  char ** etag_list = NULL, ** accept_list = NULL, * cache_control, * etag_match;
+  const char * etag;
+  json_int_t max_age = json_integer_value(json_object_get(config->j_params, "metadata-max-age"));
+  int ret = G_OK, not_modified = 0, use_gzip = 0;
+  size_t i;
+
+  if (max_age > 0) {
+    cache_control = msprintf("public, max-age=%"JSON_INTEGER_FORMAT, max_age);
+    u_map_put(response->map_header, "Cache-Control", cache_control);
+    o_free(cache_control);
+  } else {
+    u_map_put(response->map_header, "Cache-Control", "no-cache");
+  }
+  u_map_put(response->map_header, "Vary", "Accept-Encoding");
+  if (split_string(u_map_get_case(request->map_header, "Accept-Encoding"), ",", &accept_list)) {
+    use_gzip = string_array_has_trimmed_value((const char **)accept_list, "gzip");
+  }
+  free_string_array(accept_list);
+
+  pthread_mutex_lock(&config->metadata_lock);
+  if (metadata->body != NULL) {
+    use_gzip = (use_gzip && metadata->body_gzip != NULL);
+    etag = use_gzip?metadata->etag_gzip:metadata->etag;
+    if (etag != NULL) {
+      u_map_put(response->map_header, "ETag", etag);
+      if (split_string(u_map_get_case(request->map_header, "If-None-Match"), ",", &etag_list)) {
+        for (i=0; etag_list[i] != NULL && !not_modified; i++) {
+          etag_match = trimwhitespace(etag_list[i]);
+          if (0 == o_strcmp(etag_match, "*") ||
+              0 == o_strcmp(etag_match, etag) ||
+              (0 == o_strncmp(etag_match, "W/", 2) && 0 == o_strcmp(etag_match+2, etag))) {
+            not_modified = 1;
+          }
+        }
+      }
+      free_string_array(etag_list);
+    }
+    if (not_modified) {
+      response->status = 304;
+    } else {
+      u_map_put(response->map_header, ULFIUS_HTTP_HEADER_CONTENT, ULFIUS_HTTP_ENCODING_JSON);
+      if (use_gzip) {
+        u_map_put(response->map_header, "Content-Encoding", "gzip");
+        ulfius_set_binary_body_response(response, 200, metadata->body_gzip, metadata->body_gzip_len);
+      } else {
+        ulfius_set_string_body_response(response, 200, metadata->body);
+      }
+    }
+  } else {
+    ret = G_ERROR_NOT_FOUND;
+  }
+  pthread_mutex_unlock(&config->metadata_lock);
+  return ret;
+}
+
 static int generate_discovery_content(struct _oidc_config * config) {
+  struct _oidc_sign_keys * sign_keys = acquire_sign_keys(config);
   json_t * j_discovery = json_object(), * j_element = NULL, * j_rhon_info = r_library_info_json_t(), * j_dpop_sign_pubkey = json_array(), * j_sign_pubkey = json_array(), * j_signing_alg = json_array(), * j_enc_list = NULL;
   jwks_t * jwks_res;
   char * plugin_url = config->glewlwyd_config->glewlwyd_callback_get_plugin_external_url(config->glewlwyd_config, config->name);
@@ -8910,7 +10371,7 @@ static int generate_discovery_content(struct _oidc_config * config) {
     }
   }
   if (j_discovery != NULL && j_dpop_sign_pubkey != NULL && j_sign_pubkey != NULL && j_signing_alg != NULL && plugin_url != NULL) {
-    jwks_res = r_jwks_search_json_str(config->jwks_sign, "{\"kty\":\"oct\"}");
+    jwks_res = r_jwks_search_json_str(sign_keys->jwks_sign, "{\"kty\":\"oct\"}");
     if (r_jwks_size(jwks_res)) {
       if (json_array_has_string(json_object_get(j_rhon_info, "jws"), "alg"), "HS256") {
         json_array_append_new(j_signing_alg, json_string("HS256"));
@@ -8924,7 +10385,7 @@ static int generate_discovery_content(struct _oidc_config * config) {
     }
     r_jwks_free(jwks_res);
 
-    jwks_res = r_jwks_search_json_str(config->jwks_sign, "{\"kty\":\"RSA\"}");
+    jwks_res = r_jwks_search_json_str(sign_keys->jwks_sign, "{\"kty\":\"RSA\"}");
     if (r_jwks_size(jwks_res)) {
       if (json_array_has_string(json_object_get(j_rhon_info, "jws"), "alg"), "RS256") {
         json_array_append_new(j_signing_alg, json_string("RS256"));
@@ -8947,7 +10408,7 @@ static int generate_discovery_content(struct _oidc_config * config) {
     }
     r_jwks_free(jwks_res);
 
-    jwks_res = r_jwks_search_json_str(config->jwks_sign, "{\"kty\":\"EC\"}");
+    jwks_res = r_jwks_search_json_str(sign_keys->jwks_sign, "{\"kty\":\"EC\"}");
     if (r_jwks_size(jwks_res)) {
       if (json_array_has_string(json_object_get(j_rhon_info, "jws"), "alg"), "ES256") {
         json_array_append_new(j_signing_alg, json_string("ES256"));
@@ -8967,7 +10428,7 @@ static int generate_discovery_content(struct _oidc_config * config) {
       j_enc_list = json_object_get(json_object_get(j_rhon_info, "jwe"), "alg");
     }
 
-    jwks_res = r_jwks_search_json_str(config->jwks_sign, "{\"kty\":\"OKP\"}");
+    jwks_res = r_jwks_search_json_str(sign_keys->jwks_sign, "{\"kty\":\"OKP\"}");
     if (r_jwks_size(jwks_res)) {
       if (json_array_has_string(json_object_get(j_rhon_info, "jws"), "alg"), "EdDSA") {
         json_array_append_new(j_signing_alg, json_string("EdDSA"));
@@ -9196,7 +10657,7 @@ static int generate_discovery_content(struct _oidc_config * config) {
         json_object_set(j_discovery, "authorization_encryption_enc_values_supported", json_object_get(json_object_get(j_rhon_info, "jwe"), "enc"));
       }
     }
-    config->discovery_str = json_dumps(j_discovery, JSON_COMPACT);
+    ret = set_metadata(config, &config->discovery, json_dumps(j_discovery, JSON_COMPACT));
   } else {
     y_log_message(Y_LOG_LEVEL_ERROR, "generate_discovery_content - Error allocating resources for j_discovery");
     ret = G_ERROR;
@@ -9207,6 +10668,7 @@ static int generate_discovery_content(struct _oidc_config * config) {
   json_decref(j_signing_alg);
   json_decref(j_sign_pubkey);
   o_free(plugin_url);
+  release_sign_keys(sign_keys);
   return ret;
 }
 
@@ -9857,8 +11319,9 @@ static int callback_introspection(const struct _u_request * request, struct _u_r
   struct _oidc_config * config = (struct _oidc_config *)user_data;
   json_t * j_result;
   jwt_t * jwt = NULL;
-  jwa_alg alg = get_token_sign_alg(config, json_object_get((json_t *)response->shared_data, "client"), GLEWLWYD_TOKEN_TYPE_INTROSPECTION);
-  jwk_t * jwk = get_jwk_sign(config, json_object_get((json_t *)response->shared_data, "client"), alg);
+  struct _oidc_sign_keys * sign_keys = acquire_sign_keys(config);
+  jwa_alg alg = get_token_sign_alg(config, sign_keys, json_object_get((json_t *)response->shared_data, "client"), GLEWLWYD_TOKEN_TYPE_INTROSPECTION);
+  jwk_t * jwk = get_jwk_sign(config, sign_keys, json_object_get((json_t *)response->shared_data, "client"), alg);
   time_t now;
   char * token = NULL, * token_out;
   int jwt_ok, enc_res = G_OK;
@@ -9946,6 +11409,7 @@ static int callback_introspection(const struct _u_request * request, struct _u_r
   }
   json_decref(j_result);
   r_jwk_free(jwk);
+  release_sign_keys(sign_keys);
   return U_CALLBACK_CONTINUE;
 }
 
@@ -10125,12 +11589,12 @@ static int check_auth_type_access_token_request (const struct _u_request * reque
          * j_body,
          * j_refresh_token,
          * j_client = NULL,
-         * j_user,
          * j_amr,
          * j_claims_request = NULL,
          * j_jkt = NULL,
          * j_authorization_details_processed = NULL,
          * json_body;
+  const struct _glewlwyd_user_view * user_view = NULL;
   time_t now;
   int res, r_enc_res = G_OK, a_enc_res = G_OK, i_enc_res = G_OK, has_error = 0, resource_valid;
   size_t i;
@@ -10239,8 +11703,7 @@ static int check_auth_type_access_token_request (const struct _u_request * reque
                     y_log_message(Y_LOG_LEVEL_ERROR, "oidc check_auth_type_access_token_request - Error loading JSON claims_request");
                   }
                 }
-                j_user = config->glewlwyd_config->glewlwyd_plugin_callback_get_user(config->glewlwyd_config, json_string_value(json_object_get(json_object_get(j_code, "code"), "username")));
-                if (check_result_value(j_user, G_OK)) {
+                if (config->glewlwyd_config->glewlwyd_plugin_callback_get_user_view(config->glewlwyd_config, json_string_value(json_object_get(json_object_get(j_code, "code"), "username")), &user_view) == G_OK) {
                   time(&now);
                   if ((refresh_token = generate_refresh_token()) != NULL) {
                     y_log_message(Y_LOG_LEVEL_INFO, "Event oidc - Plugin '%s' - Refresh token generated for client '%s' granted by user '%s' with scope list '%s', origin: %s", config->name, client_id, json_string_value(json_object_get(json_object_get(j_code, "code"), "username")), json_string_value(json_object_get(json_object_get(j_code, "code"), "scope_list")), get_ip_source(request));
@@ -10266,7 +11729,7 @@ static int check_auth_type_access_token_request (const struct _u_request * reque
                       if ((access_token = generate_access_token(config,
                                                                 json_string_value(json_object_get(json_object_get(j_code, "code"), "username")),
                                                                 json_object_get(j_client, "client"),
-                                                                json_object_get(j_user, "user"),
+                                                                user_view->j_user,
                                                                 json_string_value(json_object_get(json_object_get(j_code, "code"), "scope_list")),
                                                                 json_object_get(j_claims_request, "userinfo"),
                                                                 resource,
@@ -10294,7 +11757,7 @@ static int check_auth_type_access_token_request (const struct _u_request * reque
                             if (check_result_value(j_amr, G_OK)) {
                               if ((id_token = generate_id_token(config,
                                                                 json_string_value(json_object_get(json_object_get(j_code, "code"), "username")),
-                                                                json_object_get(j_user, "user"),
+                                                                user_view->j_user,
                                                                 json_object_get(j_client, "client"),
                                                                 now,
                                                                 config->glewlwyd_config->glewlwyd_callback_get_session_age(config->glewlwyd_config,
@@ -10435,12 +11898,12 @@ static int check_auth_type_access_token_request (const struct _u_request * reque
                     json_decref(j_body);
                   }
                 } else {
-                  y_log_message(Y_LOG_LEVEL_ERROR, "oidc check_auth_type_access_token_request - Error glewlwyd_plugin_callback_get_user");
+                  y_log_message(Y_LOG_LEVEL_ERROR, "oidc check_auth_type_access_token_request - Error glewlwyd_plugin_callback_get_user_view");
                   j_body = json_pack("{ss}", "error", "server_error");
                   ulfius_set_json_body_response(response, 500, j_body);
                   json_decref(j_body);
                 }
-                json_decref(j_user);
+                config->glewlwyd_config->glewlwyd_plugin_callback_release_user_view(config->glewlwyd_config, user_view);
               }
             }
           } else if (res == G_ERROR_UNAUTHORIZED) {
@@ -10513,13 +11976,13 @@ static int check_auth_type_resource_owner_pwd_cred (const struct _u_request * re
          * j_client = NULL,
          * j_refresh_token,
          * j_body,
-         * j_user_only,
          * j_client_for_sub = NULL,
          * j_element = NULL,
          * j_refresh = NULL,
          * j_amr = NULL,
          * j_jkt,
          * json_body;
+  const struct _glewlwyd_user_view * user_view = NULL;
   int ret = G_OK, auth_type_allowed = 0, has_openid = 0, r_enc_res = G_OK, a_enc_res = G_OK, i_enc_res = G_OK, res;
   const char * username = u_map_get(request->map_post_body, "username"),
              * password = u_map_get(request->map_post_body, "password"),
@@ -10648,12 +12111,11 @@ static int check_auth_type_resource_owner_pwd_cred (const struct _u_request * re
                                                             json_string_value(json_object_get(j_jkt, "jkt")),
                                                             NULL);
                   if (check_result_value(j_refresh_token, G_OK)) {
-                    j_user_only = config->glewlwyd_config->glewlwyd_plugin_callback_get_user(config->glewlwyd_config, username);
-                    if (check_result_value(j_user_only, G_OK)) {
+                    if (config->glewlwyd_config->glewlwyd_plugin_callback_get_user_view(config->glewlwyd_config, username, &user_view) == G_OK) {
                       if ((access_token = generate_access_token(config,
                                                                 username,
                                                                 j_client_for_sub,
-                                                                json_object_get(j_user_only, "user"),
+                                                                user_view->j_user,
                                                                 json_string_value(json_object_get(json_object_get(j_user, "user"), "scope_list")),
                                                                 NULL,
                                                                 NULL,
@@ -10797,12 +12259,12 @@ static int check_auth_type_resource_owner_pwd_cred (const struct _u_request * re
                       }
                       o_free(access_token);
                     } else {
-                      y_log_message(Y_LOG_LEVEL_ERROR, "oidc check_auth_type_resource_owner_pwd_cred - Error glewlwyd_plugin_callback_get_user");
+                      y_log_message(Y_LOG_LEVEL_ERROR, "oidc check_auth_type_resource_owner_pwd_cred - Error glewlwyd_plugin_callback_get_user_view");
                       j_body = json_pack("{ss}", "error", "server_error");
                       ulfius_set_json_body_response(response, 500, j_body);
                       json_decref(j_body);
                     }
-                    json_decref(j_user_only);
+                    config->glewlwyd_config->glewlwyd_plugin_callback_release_user_view(config->glewlwyd_config, user_view);
                   } else {
                     y_log_message(Y_LOG_LEVEL_ERROR, "oidc check_auth_type_resource_owner_pwd_cred - Error serialize_refresh_token");
                     j_body = json_pack("{ss}", "error", "server_error");
@@ -11662,9 +13124,11 @@ static int serialize_ciba_request(struct _oidc_config * config,
 }
 
 static json_t * check_ciba_login_hint(struct _oidc_config * config, json_t * j_client, const char * login_hint_token, const char * id_token_hint, const char * login_hint, const char * ip_source) {
-  json_t * j_return = NULL, * j_login_hint = NULL, * j_result, * j_user;
+  json_t * j_return = NULL, * j_login_hint = NULL, * j_result;
+  const struct _glewlwyd_user_view * user_view = NULL;
   jwt_t * j_login_hint_token = NULL;
   char * username_from_sub = NULL;
+  int res;
 
   // expected values in the login_hint: sub or username, nothing else can be used as an identifier
   if (!o_strnullempty(login_hint_token)) {
@@ -11726,17 +13190,17 @@ static json_t * check_ciba_login_hint(struct _oidc_config * config, json_t * j_c
       username_from_sub = o_strdup(json_string_value(json_object_get(j_login_hint, "username")));
     }
     if (j_return == NULL) {
-      j_user = config->glewlwyd_config->glewlwyd_plugin_callback_get_user(config->glewlwyd_config, username_from_sub);
-      if (check_result_value(j_user, G_OK) && json_object_get(json_object_get(j_user, "user"), "enabled") == json_true()) {
-        j_return = json_pack("{sisO}", "result", G_OK, "user", json_object_get(j_user, "user"));
-      } else if (check_result_value(j_user, G_ERROR_NOT_FOUND) || json_object_get(json_object_get(j_user, "user"), "enabled") != json_true()) {
+      res = config->glewlwyd_config->glewlwyd_plugin_callback_get_user_view(config->glewlwyd_config, username_from_sub, &user_view);
+      if (res == G_OK && user_view->enabled) {
+        j_return = json_pack("{sisO}", "result", G_OK, "user", user_view->j_user);
+      } else if (res == G_ERROR_NOT_FOUND || res == G_OK) {
         y_log_message(Y_LOG_LEVEL_ERROR, "check_ciba_login_hint - invalid username '%s' for client_id '%s'", username_from_sub, json_string_value(json_object_get(j_login_hint, "username")), json_string_value(json_object_get(j_client, "client_id")));
         j_return = json_pack("{si}", "result", G_ERROR_PARAM);
       } else {
-        y_log_message(Y_LOG_LEVEL_ERROR, "check_ciba_login_hint - Error glewlwyd_plugin_callback_get_user");
+        y_log_message(Y_LOG_LEVEL_ERROR, "check_ciba_login_hint - Error glewlwyd_plugin_callback_get_user_view");
         j_return = json_pack("{si}", "result", G_ERROR);
       }
-      json_decref(j_user);
+      config->glewlwyd_config->glewlwyd_plugin_callback_release_user_view(config->glewlwyd_config, user_view);
     }
     o_free(username_from_sub);
   } else if (j_return == NULL) {
@@ -12245,6 +13709,7 @@ static int update_ciba_request(struct _oidc_config * config, json_int_t gpob_id,
   res = h_update(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
   json_decref(j_query);
   if (res == H_OK) {
+    invalidate_pending_auth(config, GLEWLWYD_PENDING_AUTH_TYPE_CIBA, gpob_id);
     if (scopes_granted != NULL) {
       if (split_string(scopes_granted, " ", &scope_array)) {
         j_query = json_pack("{sss{si}s{sI}}",
@@ -12542,16 +14007,36 @@ static int check_ciba_auth_req_id(struct _oidc_config * config,
              * client_id = request->auth_basic_user,
              * client_secret = request->auth_basic_password,
              * ip_source = get_ip_source(request);
-  json_t * j_ciba_request = get_ciba_request_from_auth_req_id(config, auth_req_id),
+  json_t * j_ciba_request = NULL,
+         * j_ciba = NULL,
          * j_response,
          * j_client = NULL,
-         * j_user = NULL,
          * j_token = NULL,
          * j_jkt = NULL;
+  const struct _glewlwyd_user_view * user_view = NULL;
   time_t now;
   int res;
+  unsigned int generation;
   char * dpop_nonce = NULL;
 
+  time(&now);
+  if (get_pending_auth(config, GLEWLWYD_PENDING_AUTH_TYPE_CIBA, auth_req_id, NULL, now, NULL, &j_ciba) == G_OK) {
+    j_ciba_request = json_pack("{siso}", "result", G_OK, "ciba", j_ciba);
+  } else {
+    generation = get_pending_auth_generation(config);
+    j_ciba_request = get_ciba_request_from_auth_req_id(config, auth_req_id);
+    if (check_result_value(j_ciba_request, G_OK) && 0 == json_integer_value(json_object_get(json_object_get(j_ciba_request, "ciba"), "status"))) {
+      set_pending_auth(config,
+                       GLEWLWYD_PENDING_AUTH_TYPE_CIBA,
+                       auth_req_id,
+                       json_integer_value(json_object_get(json_object_get(j_ciba_request, "ciba"), "gpob_id")),
+                       json_string_value(json_object_get(json_object_get(j_ciba_request, "ciba"), "client_id")),
+                       json_object_get(j_ciba_request, "ciba"),
+                       (time_t)json_integer_value(json_object_get(json_object_get(j_ciba_request, "ciba"), "expires_at")),
+                       now,
+                       generation);
+    }
+  }
   if (check_result_value(j_ciba_request, G_OK)) {
     if (client_id == NULL && u_map_get(request->map_post_body, "client_id") != NULL) {
       client_id = u_map_get(request->map_post_body, "client_id");
@@ -12617,6 +14102,18 @@ static int check_ciba_auth_req_id(struct _oidc_config * config,
       }
 
       // Check if authorization request is still pending
+      if (0 == json_integer_value(json_object_get(json_object_get(j_ciba_request, "ciba"), "status")) && wait_pending_auth(config, GLEWLWYD_PENDING_AUTH_TYPE_CIBA, auth_req_id) == G_OK) {
+        // The user answered during the long poll
+        json_decref(j_ciba_request);
+        j_ciba_request = get_ciba_request_from_auth_req_id(config, auth_req_id);
+        if (!check_result_value(j_ciba_request, G_OK)) {
+          y_log_message(Y_LOG_LEVEL_ERROR, "check_ciba_auth_req_id oidc - Error get_ciba_request_from_auth_req_id after long poll");
+          j_response = json_pack("{ss}", "error", "server_error");
+          ulfius_set_json_body_response(response, 500, j_response);
+          json_decref(j_response);
+          break;
+        }
+      }
       if (0 == json_integer_value(json_object_get(json_object_get(j_ciba_request, "ciba"), "status"))) {
         j_response = json_pack("{ss}", "error", "authorization_pending");
         ulfius_set_json_body_response(response, 400, j_response);
@@ -12690,10 +14187,9 @@ static int check_ciba_auth_req_id(struct _oidc_config * config,
       }
 
       // If we arrive here, request is accepted and valid, let's send the tokens!
-      j_user = config->glewlwyd_config->glewlwyd_plugin_callback_get_user(config->glewlwyd_config, json_string_value(json_object_get(json_object_get(j_ciba_request, "ciba"), "username")));
-      if (check_result_value(j_user, G_OK)) {
+      if (config->glewlwyd_config->glewlwyd_plugin_callback_get_user_view(config->glewlwyd_config, json_string_value(json_object_get(json_object_get(j_ciba_request, "ciba"), "username")), &user_view) == G_OK) {
         j_token = generate_ciba_token_response(config, json_object_get(j_client, "client"),
-                                               json_object_get(j_user, "user"),
+                                               user_view->j_user,
                                                json_object_get(j_ciba_request, "ciba"),
                                                json_string_value(json_object_get(json_object_get(j_ciba_request, "ciba"), "scope")),
                                                json_string_value(json_object_get(json_object_get(j_ciba_request, "ciba"), "sid")),
@@ -12719,12 +14215,12 @@ static int check_ciba_auth_req_id(struct _oidc_config * config,
         }
         json_decref(j_token);
       } else {
-        y_log_message(Y_LOG_LEVEL_ERROR, "check_ciba_auth_req_id oidc - Error glewlwyd_plugin_callback_get_user");
+        y_log_message(Y_LOG_LEVEL_ERROR, "check_ciba_auth_req_id oidc - Error glewlwyd_plugin_callback_get_user_view");
         j_response = json_pack("{ss}", "error", "server_error");
         ulfius_set_json_body_response(response, 400, j_response);
         json_decref(j_response);
       }
-      json_decref(j_user);
+      config->glewlwyd_config->glewlwyd_plugin_callback_release_user_view(config->glewlwyd_config, user_view);
     } while (0);
     json_decref(j_client);
     json_decref(j_jkt);
@@ -12970,6 +14466,7 @@ static void * run_backchannel_logout_thread(void * args) {
   char * sub, jti[OIDC_JTI_LENGTH+1] = {0}, * token, * out_token;
   jwa_alg alg;
   jwk_t * jwk = NULL;
+  struct _oidc_sign_keys * sign_keys;
   struct _u_request req;
   struct _u_response resp;
 
@@ -12977,8 +14474,10 @@ static void * run_backchannel_logout_thread(void * args) {
     j_client = elt->config->glewlwyd_config->glewlwyd_plugin_callback_get_client(elt->config->glewlwyd_config, json_string_value(json_object_get(j_element, "client_id")));
     if (check_result_value(j_client, G_OK) && json_object_get(json_object_get(j_client, "client"), "enabled") == json_true() &&
         !json_string_null_or_empty(json_object_get(json_object_get(j_client, "client"), "backchannel_logout_uri"))) {
-      alg = get_token_sign_alg(elt->config, json_object_get(j_client, "client"), GLEWLWYD_TOKEN_TYPE_ID_TOKEN);
-      jwk = get_jwk_sign(elt->config, json_object_get(j_client, "client"), alg);
+      sign_keys = acquire_sign_keys(elt->config);
+      alg = get_token_sign_alg(elt->config, sign_keys, json_object_get(j_client, "client"), GLEWLWYD_TOKEN_TYPE_ID_TOKEN);
+      jwk = get_jwk_sign(elt->config, sign_keys, json_object_get(j_client, "client"), alg);
+      release_sign_keys(sign_keys);
       if (alg != R_JWA_ALG_UNKNOWN && alg != R_JWA_ALG_NONE && jwk != NULL) {
         r_jwt_init(&jwt);
         r_jwt_set_claim_str_value(jwt, "iss", json_string_value(json_object_get(elt->config->j_params, "iss")));
@@ -13006,7 +14505,7 @@ static void * run_backchannel_logout_thread(void * args) {
                                               U_OPT_CHECK_SERVER_CERTIFICATE, json_object_get(elt->config->j_params, "request-uri-allow-https-non-secure")==json_true()?0:1,
                                               U_OPT_CHECK_PROXY_CERTIFICATE, json_object_get(elt->config->j_params, "request-uri-allow-https-non-secure")==json_true()?0:1,
                                               U_OPT_NONE);
-          if (ulfius_send_http_request(&req, &resp) == U_OK) {
+          if (elt->config->glewlwyd_config->glewlwyd_plugin_callback_http_send_request(elt->config->glewlwyd_config, &req, &resp) == G_OK) {
             if (resp.status == 200) {
               y_log_message(Y_LOG_LEVEL_DEBUG, "Send backchannel_logout successfully for client %s", json_string_value(json_object_get(json_object_get(j_client, "client"), "client_id")));
             } else {
@@ -13014,7 +14513,7 @@ static void * run_backchannel_logout_thread(void * args) {
               y_log_message(Y_LOG_LEVEL_DEBUG, "  -  response body %.*s", resp.binary_body_length, resp.binary_body);
             }
           } else {
-            y_log_message(Y_LOG_LEVEL_ERROR, "run_backchannel_logout_thread - Error ulfius_send_http_request for client %s", json_string_value(json_object_get(json_object_get(j_client, "client"), "client_id")));
+            y_log_message(Y_LOG_LEVEL_ERROR, "run_backchannel_logout_thread - Error glewlwyd_plugin_callback_http_send_request for client %s", json_string_value(json_object_get(json_object_get(j_client, "client"), "client_id")));
           }
           ulfius_clean_request(&req);
           ulfius_clean_response(&resp);
@@ -13097,9 +14596,9 @@ static int run_backchannel_logout(struct _oidc_config * config, const char * use
 }
 
 static int disable_tokens_from_session(struct _oidc_config * config, const char * username, const char * sid) {
-  json_t * j_query;
-  int res, ret = G_OK;
-  char * query, * expires_at_clause, * sid_escaped, * name_escaped, * username_escaped;
+  struct _oidc_revocation_job * job;
+  int ret;
+  char * expires_at_clause, * sid_escaped, * name_escaped, * username_escaped, * label;
   time_t now;
 
   time(&now);
@@ -13113,46 +14612,22 @@ static int disable_tokens_from_session(struct _oidc_config * config, const char
   sid_escaped = h_escape_string_with_quotes(config->glewlwyd_config->glewlwyd_config->conn, sid);
   name_escaped = h_escape_string_with_quotes(config->glewlwyd_config->glewlwyd_config->conn, config->name);
   username_escaped = h_escape_string_with_quotes(config->glewlwyd_config->glewlwyd_config->conn, username);
+  label = msprintf("tokens of a session for user '%s'", username);
 
-  // Disable access tokens
-  query = msprintf("UPDATE "GLEWLWYD_PLUGIN_OIDC_TABLE_ACCESS_TOKEN" SET gpoa_enabled=0 WHERE gpoa_enabled=1 AND gpor_id IN (SELECT gpor_id FROM "GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN" WHERE gpor_enabled=1 AND gpor_expires_at %s AND gpoc_id IN (SELECT gpoc_id FROM "GLEWLWYD_PLUGIN_OIDC_TABLE_CODE" WHERE gpoc_plugin_name=%s AND gpoc_username=%s AND gpoc_sid=%s))", expires_at_clause, name_escaped, username_escaped, sid_escaped);
-  res = h_execute_query(config->glewlwyd_config->glewlwyd_config->conn, query, NULL, H_OPTION_EXEC);
-  o_free(query);
-  if (res == H_OK) {
-    // Disable refresh tokens
-    query = msprintf("UPDATE "GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN" SET gpor_enabled=0 WHERE gpor_enabled=1 AND gpor_expires_at %s AND gpoc_id IN (SELECT gpoc_id FROM "GLEWLWYD_PLUGIN_OIDC_TABLE_CODE" WHERE gpoc_plugin_name=%s AND gpoc_username=%s AND gpoc_sid=%s)", expires_at_clause, name_escaped, username_escaped, sid_escaped);
-    res = h_execute_query(config->glewlwyd_config->glewlwyd_config->conn, query, NULL, H_OPTION_EXEC);
-    o_free(query);
-    if (res == H_OK) {
-      j_query = json_pack("{sss{si}s{sssssssi}}",
-                          "table", GLEWLWYD_PLUGIN_OIDC_TABLE_ID_TOKEN,
-                          "set",
-                            "gpoi_enabled", 0,
-                          "where",
-                            "gpoi_plugin_name", config->name,
-                            "gpoi_username", username,
-                            "gpoi_sid", sid,
-                            "gpoi_enabled", 1);
-      res = h_update(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
-      json_decref(j_query);
-      if (res == H_OK) {
-        ret = G_OK;
-      } else {
-        y_log_message(Y_LOG_LEVEL_ERROR, "disable_tokens_from_session - Error executing j_query (3)");
-        ret = G_ERROR_DB;
-      }
-    } else {
-      y_log_message(Y_LOG_LEVEL_ERROR, "disable_tokens_from_session - Error executing j_query (2)");
-      ret = G_ERROR_DB;
-    }
-  } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "disable_tokens_from_session - Error executing j_query (1)");
-    ret = G_ERROR_DB;
+  // Access tokens first, they are found through their refresh token
+  if ((job = init_revocation_job(label)) != NULL) {
+    add_revocation_step(job, &revocation_table_access_token, msprintf("gpor_id IN (SELECT gpor_id FROM "GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN" WHERE gpor_enabled=1 AND gpor_expires_at %s AND gpoc_id IN (SELECT gpoc_id FROM "GLEWLWYD_PLUGIN_OIDC_TABLE_CODE" WHERE gpoc_plugin_name=%s AND gpoc_username=%s AND gpoc_sid=%s))", expires_at_clause, name_escaped, username_escaped, sid_escaped));
+    add_revocation_step(job, &revocation_table_refresh_token, msprintf("gpor_expires_at %s AND gpoc_id IN (SELECT gpoc_id FROM "GLEWLWYD_PLUGIN_OIDC_TABLE_CODE" WHERE gpoc_plugin_name=%s AND gpoc_username=%s AND gpoc_sid=%s)", expires_at_clause, name_escaped, username_escaped, sid_escaped));
+    add_revocation_step(job, &revocation_table_id_token, msprintf("gpoi_plugin_name=%s AND gpoi_username=%s AND gpoi_sid=%s", name_escaped, username_escaped, sid_escaped));
+  }
+  if ((ret = run_revocation(config, job)) != G_OK) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "disable_tokens_from_session - Error run_revocation");
   }
   o_free(expires_at_clause);
   o_free(sid_escaped);
   o_free(name_escaped);
   o_free(username_escaped);
+  o_free(label);
   return ret;
 }
 
@@ -13248,12 +14723,12 @@ static int get_access_token_from_refresh (const struct _u_request * request,
          * j_refresh_serialize,
          * json_body,
          * j_client = NULL,
-         * j_user,
          * j_client_for_sub = NULL,
          * j_claims_request = NULL,
          * j_refresh_scope = NULL,
          * j_authorization_details_processed = NULL,
          * j_jkt = NULL;
+  const struct _glewlwyd_user_view * user_view = NULL;
   time_t now;
   char * access_token = NULL,
        * access_token_out = NULL,
@@ -13391,15 +14866,18 @@ static int get_access_token_from_refresh (const struct _u_request * request,
             time(&now);
             issued_for = get_client_hostname(request);
             if (is_refresh_token_one_use(config, json_object_get(j_client, "client"))) {
-              if (update_refresh_token(config,
-                                       json_integer_value(json_object_get(json_object_get(j_refresh, "token"), "gpor_id")),
-                                       0,
-                                       1,
-                                       now) != G_OK) {
-                y_log_message(Y_LOG_LEVEL_ERROR, "get_access_token_from_refresh oidc - Error update_refresh_token");
+              if ((res = consume_refresh_token(config, json_integer_value(json_object_get(json_object_get(j_refresh, "token"), "gpor_id")), now)) == G_ERROR_UNAUTHORIZED) {
+                // Another request rotated this token first, handle it as a replay
+                y_log_message(Y_LOG_LEVEL_WARNING, "Security - Token invalid at IP Address %s", get_ip_source(request));
+                if (disable_refresh_token_by_jti(config, json_string_value(json_object_get(json_object_get(j_refresh, "token"), "jti"))) != G_OK) {
+                  y_log_message(Y_LOG_LEVEL_ERROR, "get_access_token_from_refresh oidc - Error disable_refresh_token_by_jti");
+                }
+                config->glewlwyd_config->glewlwyd_plugin_callback_metrics_increment_counter(config->glewlwyd_config, GLWD_METRICS_OIDC_INVALID_REFRESH_TOKEN, 1, "plugin", config->name, NULL);
+                has_issues = 1;
+              } else if (res != G_OK) {
+                y_log_message(Y_LOG_LEVEL_ERROR, "get_access_token_from_refresh oidc - Error consume_refresh_token");
                 has_error = 1;
-              }
-              if ((new_refresh_token = generate_refresh_token()) == NULL) {
+              } else if ((new_refresh_token = generate_refresh_token()) == NULL) {
                 y_log_message(Y_LOG_LEVEL_ERROR, "get_access_token_from_refresh oidc - Error generate_refresh_token");
                 has_error = 1;
               } else {
@@ -13427,7 +14905,7 @@ static int get_access_token_from_refresh (const struct _u_request * request,
                     y_log_message(Y_LOG_LEVEL_ERROR, "get_access_token_from_refresh oidc - Error serialize_refresh_token");
                     has_error = 1;
                   } else {
-                    gpor_id = json_integer_value(json_object_get(json_object_get(j_refresh_serialize, "token"), "gpor_id"));
+                    gpor_id = json_integer_value(json_object_get(j_refresh_serialize, "gpor_id"));
                   }
                   json_decref(j_refresh_serialize);
                 } else {
@@ -13451,13 +14929,12 @@ static int get_access_token_from_refresh (const struct _u_request * request,
               if (json_object_get(json_object_get(j_refresh, "token"), "dpop_jkt") != json_null()) {
                 token_type = GLEWLWYD_TOKEN_TYPE_DPOP;
               }
-              j_user = config->glewlwyd_config->glewlwyd_plugin_callback_get_user(config->glewlwyd_config, json_string_value(json_object_get(json_object_get(j_refresh, "token"), "username")));
-              if (check_result_value(j_user, G_OK)) {
+              if (config->glewlwyd_config->glewlwyd_plugin_callback_get_user_view(config->glewlwyd_config, json_string_value(json_object_get(json_object_get(j_refresh, "token"), "username")), &user_view) == G_OK) {
                 j_authorization_details_processed = authorization_details_process_resource(json_object_get(json_object_get(j_refresh, "token"), "authorization_details"), resource, 0);
                 if ((access_token = generate_access_token(config,
                                                           json_string_value(json_object_get(json_object_get(j_refresh, "token"), "username")),
                                                           j_client_for_sub,
-                                                          json_object_get(j_user, "user"),
+                                                          user_view->j_user,
                                                           scope_joined,
                                                           j_claims_request,
                                                           resource,
@@ -13548,10 +15025,10 @@ static int get_access_token_from_refresh (const struct _u_request * request,
                 o_free(access_token);
                 json_decref(j_authorization_details_processed);
               } else {
-                y_log_message(Y_LOG_LEVEL_ERROR, "get_access_token_from_refresh oidc - Error glewlwyd_plugin_callback_get_user");
+                y_log_message(Y_LOG_LEVEL_ERROR, "get_access_token_from_refresh oidc - Error glewlwyd_plugin_callback_get_user_view");
                 response->status = 500;
               }
-              json_decref(j_user);
+              config->glewlwyd_config->glewlwyd_plugin_callback_release_user_view(config->glewlwyd_config, user_view);
             } else if (has_issues) {
               response->status = 400;
             } else {
@@ -13793,7 +15270,8 @@ static int callback_check_userinfo(const struct _u_request * request, struct _u_
  */
 static int callback_check_glewlwyd_session_or_token(const struct _u_request * request, struct _u_response * response, void * user_data) {
   struct _oidc_config * config = (struct _oidc_config *)user_data;
-  json_t * j_session, * j_user, * j_introspect, * j_dpop, * json_body;
+  json_t * j_session, * j_introspect, * j_dpop, * json_body;
+  const struct _glewlwyd_user_view * user_view = NULL;
   int ret = U_CALLBACK_UNAUTHORIZED, is_header_dpop = 0, res;
   const char * access_token = get_auth_header_token(u_map_get_case(request->map_header, GLEWLWYD_HEADER_AUTHORIZATION), &is_header_dpop),
              * dpop = u_map_get_case(request->map_header, GLEWLWYD_HEADER_DPOP),
@@ -13873,15 +15351,14 @@ static int callback_check_glewlwyd_session_or_token(const struct _u_request * re
     if (!o_strnullempty(u_map_get(request->map_url, "impersonate"))) {
       j_session = config->glewlwyd_config->glewlwyd_callback_check_session_valid(config->glewlwyd_config, request, config->glewlwyd_config->glewlwyd_config->admin_scope);
       if (check_result_value(j_session, G_OK)) {
-        j_user = config->glewlwyd_config->glewlwyd_plugin_callback_get_user(config->glewlwyd_config, u_map_get(request->map_url, "impersonate"));
-        if (check_result_value(j_user, G_OK)) {
+        if (config->glewlwyd_config->glewlwyd_plugin_callback_get_user_view(config->glewlwyd_config, u_map_get(request->map_url, "impersonate"), &user_view) == G_OK) {
           if (ulfius_set_response_shared_data(response, json_pack("{ss}", "username", u_map_get(request->map_url, "impersonate")), (void (*)(void *))&json_decref) != U_OK) {
             ret = U_CALLBACK_ERROR;
           } else {
             ret = U_CALLBACK_CONTINUE;
           }
         }
-        json_decref(j_user);
+        config->glewlwyd_config->glewlwyd_plugin_callback_release_user_view(config->glewlwyd_config, user_view);
       }
       json_decref(j_session);
     } else {
@@ -13977,6 +15454,7 @@ static int callback_oidc_authorization(const struct _u_request * request, struct
   jwk_t * jwk_id_token = NULL;
   jwt_t * jwt = NULL;
   jwa_alg alg;
+  struct _oidc_sign_keys * sign_keys;
 
   u_map_put(response->map_header, "Cache-Control", "no-store");
   u_map_put(response->map_header, "Pragma", "no-cache");
@@ -14495,8 +15973,10 @@ static int callback_oidc_authorization(const struct _u_request * request, struct
     // If parameter prompt=none is set, id_token_hint must be set and correspond to the last id_token provided by the client for the current user
     if (0 == o_strcmp("none", prompt)) {
       if (!o_strnullempty(id_token_hint)) {
-        alg = get_token_sign_alg(config, json_object_get(j_client, "client"), GLEWLWYD_TOKEN_TYPE_ID_TOKEN);
-        jwk_id_token = get_jwk_sign(config, json_object_get(j_client, "client"), alg);
+        sign_keys = acquire_sign_keys(config);
+        alg = get_token_sign_alg(config, sign_keys, json_object_get(j_client, "client"), GLEWLWYD_TOKEN_TYPE_ID_TOKEN);
+        jwk_id_token = get_jwk_sign(config, sign_keys, json_object_get(j_client, "client"), alg);
+        release_sign_keys(sign_keys);
         if ((jwt = r_jwt_quick_parse(id_token_hint, R_PARSE_NONE, 0)) != NULL &&
             r_jwt_verify_signature(jwt, jwk_id_token, 0) == RHN_OK) {
           j_last_token = get_last_id_token(config, json_string_value(json_object_get(json_object_get(json_object_get(j_session, "session"), "user"), "username")), client_id);
@@ -15019,13 +16499,14 @@ static int callback_oidc_get_userinfo(const struct _u_request * request, struct
   char * username = get_username_from_sub(config, json_string_value(json_object_get((json_t *)response->shared_data, "sub")), NULL),
        * token = NULL,
        * token_out = NULL;
-  json_t * j_user,
-         * j_userinfo,
+  json_t * j_userinfo,
          * j_client = config->glewlwyd_config->glewlwyd_plugin_callback_get_client(config->glewlwyd_config, json_string_value(json_object_get((json_t *)response->shared_data, "client_id")));
+  const struct _glewlwyd_user_view * user_view = NULL;
   jwt_t * jwt = NULL;
-  jwa_alg alg = get_token_sign_alg(config, json_object_get((json_t *)response->shared_data, "client"), GLEWLWYD_TOKEN_TYPE_USERINFO);
-  jwk_t * jwk = get_jwk_sign(config, json_object_get((json_t *)response->shared_data, "client"), alg);
-  int jkt_continue = 1, enc_res = G_OK;
+  struct _oidc_sign_keys * sign_keys = acquire_sign_keys(config);
+  jwa_alg alg = get_token_sign_alg(config, sign_keys, json_object_get((json_t *)response->shared_data, "client"), GLEWLWYD_TOKEN_TYPE_USERINFO);
+  jwk_t * jwk = get_jwk_sign(config, sign_keys, json_object_get((json_t *)response->shared_data, "client"), alg);
+  int jkt_continue = 1, enc_res = G_OK, res;
 
   u_map_put(response->map_header, "Cache-Control", "no-store");
   u_map_put(response->map_header, "Pragma", "no-cache");
@@ -15033,9 +16514,8 @@ static int callback_oidc_get_userinfo(const struct _u_request * request, struct
 
   if (jkt_continue) {
     if (username != NULL) {
-      j_user = config->glewlwyd_config->glewlwyd_plugin_callback_get_user(config->glewlwyd_config, username);
-      if (check_result_value(j_user, G_OK)) {
-        j_userinfo = get_userinfo(config, json_string_value(json_object_get((json_t *)response->shared_data, "sub")), json_object_get(j_user, "user"), json_object_get((json_t *)response->shared_data, "claims"), json_string_value(json_object_get((json_t *)response->shared_data, "scope")));
+      if ((res = config->glewlwyd_config->glewlwyd_plugin_callback_get_user_view(config->glewlwyd_config, username, &user_view)) == G_OK) {
+        j_userinfo = get_userinfo(config, json_string_value(json_object_get((json_t *)response->shared_data, "sub")), user_view->j_user, json_object_get((json_t *)response->shared_data, "claims"), json_string_value(json_object_get((json_t *)response->shared_data, "scope")));
         if (j_userinfo != NULL) {
           if (0 == o_strcmp("jwt", u_map_get(request->map_url, "format")) || 0 == o_strcmp("jwt", u_map_get(request->map_post_body, "format")) || 0 == o_strcasecmp("application/jwt", u_map_get_case(request->map_header, "Accept")) || 0 == o_strcasecmp("application/token-userinfo+jwt", u_map_get_case(request->map_header, "Accept"))) {
             if (jwk != NULL && alg != R_JWA_ALG_UNKNOWN) {
@@ -15080,13 +16560,13 @@ static int callback_oidc_get_userinfo(const struct _u_request * request, struct
           response->status = 500;
         }
         json_decref(j_userinfo);
-      } else if (check_result_value(j_user, G_ERROR_NOT_FOUND)) {
+      } else if (res == G_ERROR_NOT_FOUND) {
         response->status = 404;
       } else {
-        y_log_message(Y_LOG_LEVEL_ERROR, "callback_oidc_get_userinfo oidc - Error glewlwyd_plugin_callback_get_user_profile");
+        y_log_message(Y_LOG_LEVEL_ERROR, "callback_oidc_get_userinfo oidc - Error glewlwyd_plugin_callback_get_user_view");
         response->status = 500;
       }
-      json_decref(j_user);
+      config->glewlwyd_config->glewlwyd_plugin_callback_release_user_view(config->glewlwyd_config, user_view);
     } else {
       response->status = 404;
     }
@@ -15096,6 +16576,7 @@ static int callback_oidc_get_userinfo(const struct _u_request * request, struct
   o_free(username);
   json_decref(j_client);
   r_jwk_free(jwk);
+  release_sign_keys(sign_keys);
   return U_CALLBACK_CONTINUE;
 }
 
@@ -15176,14 +16657,13 @@ static int callback_oidc_disable_refresh_token(const struct _u_request * request
  * /.well-known/openid-configuration callback
  */
 static int callback_oidc_discovery(const struct _u_request * request, struct _u_response * response, void * user_data) {
-  UNUSED(request);
+  struct _oidc_config * config = (struct _oidc_config *)user_data;
 
-  u_map_put(response->map_header, "Cache-Control", "no-store");
-  u_map_put(response->map_header, "Pragma", "no-cache");
   u_map_put(response->map_header, "Referrer-Policy", "no-referrer");
 
-  u_map_put(response->map_header, ULFIUS_HTTP_HEADER_CONTENT, ULFIUS_HTTP_ENCODING_JSON);
-  ulfius_set_string_body_response(response, 200, ((struct _oidc_config *)user_data)->discovery_str);
+  if (send_metadata(config, &config->discovery, request, response) != G_OK) {
+    response->status = 500;
+  }
   return U_CALLBACK_CONTINUE;
 }
 
@@ -15191,17 +16671,13 @@ static int callback_oidc_discovery(const struct _u_request * request, struct _u_
  * /jwks allback
  */
 static int callback_oidc_get_jwks(const struct _u_request * request, struct _u_response * response, void * user_data) {
-  UNUSED(request);
   struct _oidc_config * config = (struct _oidc_config *)user_data;
 
-  u_map_put(response->map_header, "Cache-Control", "no-store");
-  u_map_put(response->map_header, "Pragma", "no-cache");
   u_map_put(response->map_header, "Referrer-Policy", "no-referrer");
 
-  if (config->jwks_str != NULL) {
-    u_map_put(response->map_header, ULFIUS_HTTP_HEADER_CONTENT, ULFIUS_HTTP_ENCODING_JSON);
-    ulfius_set_string_body_response(response, 200, config->jwks_str);
-  } else {
+  if (send_metadata(config, &config->jwks, request, response) != G_OK) {
+    u_map_put(response->map_header, "Cache-Control", "no-store");
+    u_map_remove_from_key(response->map_header, "ETag");
     ulfius_set_string_body_response(response, 403, "JWKS unavailable");
   }
   return U_CALLBACK_CONTINUE;
@@ -16110,17 +17586,18 @@ static int jwt_autocheck(struct _oidc_config * config) {
   time_t now;
   char * token, jti[OIDC_JTI_LENGTH+1] = {0};
   jwt_t * jwt = NULL;
+  struct _oidc_sign_keys * sign_keys = acquire_sign_keys(config);
   int ret;
 
   time(&now);
   token = generate_access_token(config, GLEWLWYD_CHECK_JWT_USERNAME, NULL, NULL, GLEWLWYD_CHECK_JWT_SCOPE, NULL, GLEWLWYD_CHECK_JWT_SCOPE, now, jti, NULL, NULL, NULL, NULL);
   if (token != NULL) {
-    if ((jwt = r_jwt_quick_parse(token, R_PARSE_NONE, 0)) != NULL && r_jwt_add_sign_jwks(jwt, NULL, config->jwks_public) == RHN_OK) {
+    if ((jwt = r_jwt_quick_parse(token, R_PARSE_NONE, 0)) != NULL && r_jwt_add_sign_jwks(jwt, NULL, sign_keys->jwks_public) == RHN_OK) {
       if (r_jwt_verify_signature(jwt, NULL, 0) == RHN_OK) {
         ret = RHN_OK;
       } else {
         y_log_message(Y_LOG_LEVEL_ERROR, "jwt_autocheck - oidc - Error verifying signature %s", token);
-        y_log_message(Y_LOG_LEVEL_DEBUG, "pubkey %s", r_jwks_export_to_json_str(config->jwks_public, 1));
+        y_log_message(Y_LOG_LEVEL_DEBUG, "pubkey %s", r_jwks_export_to_json_str(sign_keys->jwks_public, 1));
         ret = G_ERROR_PARAM;
       }
     } else {
@@ -16133,25 +17610,144 @@ static int jwt_autocheck(struct _oidc_config * config) {
     ret = G_ERROR;
   }
   o_free(token);
+  release_sign_keys(sign_keys);
   return ret;
 }
 
-static int build_sign_keys_from_params(struct _oidc_config * config) {
+/**
+ * Tokens signed by a retired key remain valid until they expire
+ */
+static time_t get_sign_key_retire_delay(struct _oidc_config * config) {
+  json_int_t duration = json_integer_value(json_object_get(config->j_params, "access-token-duration"));
+
+  return (time_t)(duration?duration:GLEWLWYD_ACCESS_TOKEN_EXP_DEFAULT);
+}
+
+/**
+ * Return the state of a key imported from a JWKS at the time now
+ * A key is pending before its 'nbf' and retired after its 'exp',
+ * a retired key is dropped when the access tokens it signed have expired
+ */
+static int get_sign_key_state(struct _oidc_config * config, jwk_t * jwk, time_t now) {
+  json_t * j_jwk = r_jwk_export_to_json_t(jwk);
+  json_int_t nbf = json_integer_value(json_object_get(j_jwk, "nbf")), exp = json_integer_value(json_object_get(j_jwk, "exp"));
+  int state;
+
+  if (nbf && now < (time_t)nbf) {
+    state = GLEWLWYD_SIGN_KEY_STATE_PENDING;
+  } else if (!exp || now < (time_t)exp) {
+    state = GLEWLWYD_SIGN_KEY_STATE_ACTIVE;
+  } else if (now < (time_t)exp + get_sign_key_retire_delay(config)) {
+    state = GLEWLWYD_SIGN_KEY_STATE_RETIRED;
+  } else {
+    state = GLEWLWYD_SIGN_KEY_STATE_DROPPED;
+  }
+  json_decref(j_jwk);
+  return state;
+}
+
+/**
+ * Return the next time the state of a key imported from a JWKS changes after now, 0 if it won't change
+ */
+static time_t get_sign_key_next_update(struct _oidc_config * config, jwk_t * jwk, time_t now) {
+  json_t * j_jwk = r_jwk_export_to_json_t(jwk);
+  json_int_t nbf = json_integer_value(json_object_get(j_jwk, "nbf")), exp = json_integer_value(json_object_get(j_jwk, "exp"));
+  time_t next_update = 0;
+
+  if (nbf && now < (time_t)nbf) {
+    next_update = (time_t)nbf;
+  } else if (exp && now < (time_t)exp) {
+    next_update = (time_t)exp;
+  } else if (exp && now < (time_t)exp + get_sign_key_retire_delay(config)) {
+    next_update = (time_t)exp + get_sign_key_retire_delay(config);
+  }
+  json_decref(j_jwk);
+  return next_update;
+}
+
+/**
+ * Add the active keys missing from jwks_source to the retired keys list,
+ * and remove the retired keys whose tokens have expired or that are back in jwks_source
+ * Only called during plugin init or by the rotation thread, which is the only one to replace config->sign_keys
+ */
+static void retire_sign_keys(struct _oidc_config * config, jwks_t * jwks_source, time_t now) {
+  struct _oidc_sign_keys * sign_keys = config->sign_keys;
+  struct _oidc_retired_key * retired_key;
+  jwk_t * jwk, * jwk_source;
+  size_t i;
+
+  for (i=0; i<pointer_list_size(&config->sign_keys_retired);) {
+    retired_key = (struct _oidc_retired_key *)pointer_list_get_at(&config->sign_keys_retired, i);
+    jwk_source = r_jwks_get_by_kid(jwks_source, r_jwk_get_property_str(retired_key->jwk, "kid"));
+    if (retired_key->expires_at <= now || jwk_source != NULL) {
+      pointer_list_remove_at(&config->sign_keys_retired, i);
+      free_retired_key(retired_key);
+    } else {
+      i++;
+    }
+    r_jwk_free(jwk_source);
+  }
+  if (sign_keys != NULL) {
+    for (i=0; i<r_jwks_size(sign_keys->jwks_sign); i++) {
+      jwk = r_jwks_get_at(sign_keys->jwks_sign, i);
+      jwk_source = r_jwks_get_by_kid(jwks_source, r_jwk_get_property_str(jwk, "kid"));
+      if (jwk_source == NULL) {
+        if ((retired_key = o_malloc(sizeof(struct _oidc_retired_key))) != NULL) {
+          retired_key->jwk = r_jwk_copy(jwk);
+          retired_key->expires_at = now + get_sign_key_retire_delay(config);
+          if (!pointer_list_append(&config->sign_keys_retired, retired_key)) {
+            y_log_message(Y_LOG_LEVEL_ERROR, "retire_sign_keys - Error pointer_list_append");
+            free_retired_key(retired_key);
+          }
+        } else {
+          y_log_message(Y_LOG_LEVEL_ERROR, "retire_sign_keys - Error allocating resources for retired_key");
+        }
+      }
+      r_jwk_free(jwk_source);
+      r_jwk_free(jwk);
+    }
+  }
+}
+
+/**
+ * Build a new set of signing keys from the plugin parameters
+ * Keys imported from a JWKS may have 'nbf' and 'exp' properties to schedule their use,
+ * the retired keys are added to the set until their tokens expire
+ * The public JWKS to publish is returned in jwks_str
+ */
+static int build_sign_keys_from_params(struct _oidc_config * config, time_t now, struct _oidc_sign_keys ** p_sign_keys, char ** jwks_str) {
   int ret = G_OK;
+  struct _oidc_sign_keys * sign_keys = NULL;
   jwk_t * jwk = NULL, * jwk_pub;
-  jwks_t * jwks_pub_export = NULL;
+  jwks_t * jwks_pub_export = NULL, * jwks_source = NULL;
+  struct _oidc_retired_key * retired_key;
   jwa_alg alg;
   size_t i;
-  int type;
+  int type, state;
+  time_t next_update;
   char * kid;
 
+  *p_sign_keys = NULL;
+  *jwks_str = NULL;
   do {
-    if (r_jwks_init(&config->jwks_sign) != RHN_OK) {
+    if ((sign_keys = o_malloc(sizeof(struct _oidc_sign_keys))) == NULL) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - Error allocating resources for sign_keys");
+      ret = G_ERROR_MEMORY;
+      break;
+    }
+    memset(sign_keys, 0, sizeof(struct _oidc_sign_keys));
+    sign_keys->sign_alg_default = R_JWA_ALG_UNKNOWN;
+    if (r_jwks_init(&sign_keys->jwks_sign) != RHN_OK) {
       y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - Error r_jwks_init jwks_sign");
       ret = G_ERROR;
       break;
     }
-    if (r_jwks_init(&config->jwks_public) != RHN_OK) {
+    if (r_jwks_init(&sign_keys->jwks_private) != RHN_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - Error r_jwks_init jwks_private");
+      ret = G_ERROR;
+      break;
+    }
+    if (r_jwks_init(&sign_keys->jwks_public) != RHN_OK) {
       y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - Error r_jwks_init jwks_public");
       ret = G_ERROR;
       break;
@@ -16179,7 +17775,7 @@ static int build_sign_keys_from_params(struct _oidc_config * config) {
           ret = G_ERROR_PARAM;
         }
         r_jwk_set_property_str(jwk, "alg", r_jwa_alg_to_str(alg));
-        if (r_jwks_append_jwk(config->jwks_sign, jwk) != RHN_OK) {
+        if (r_jwks_append_jwk(sign_keys->jwks_sign, jwk) != RHN_OK) {
           y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error r_jwks_append_jwk jwks_sign rsa");
           ret = G_ERROR;
         }
@@ -16192,7 +17788,7 @@ static int build_sign_keys_from_params(struct _oidc_config * config) {
           ret = G_ERROR_PARAM;
         }
         r_jwk_set_property_str(jwk, "alg", r_jwa_alg_to_str(alg));
-        if (r_jwks_append_jwk(config->jwks_public, jwk) != RHN_OK) {
+        if (r_jwks_append_jwk(sign_keys->jwks_public, jwk) != RHN_OK) {
           y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error r_jwks_append_jwk jwks_public rsa");
           ret = G_ERROR;
         }
@@ -16219,7 +17815,7 @@ static int build_sign_keys_from_params(struct _oidc_config * config) {
           ret = G_ERROR_PARAM;
         }
         r_jwk_set_property_str(jwk, "alg", r_jwa_alg_to_str(alg));
-        if (r_jwks_append_jwk(config->jwks_sign, jwk) != RHN_OK) {
+        if (r_jwks_append_jwk(sign_keys->jwks_sign, jwk) != RHN_OK) {
           y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error r_jwks_append_jwk jwks_sign ecdsa");
           ret = G_ERROR;
         }
@@ -16232,7 +17828,7 @@ static int build_sign_keys_from_params(struct _oidc_config * config) {
           ret = G_ERROR_PARAM;
         }
         r_jwk_set_property_str(jwk, "alg", r_jwa_alg_to_str(alg));
-        if (r_jwks_append_jwk(config->jwks_public, jwk) != RHN_OK) {
+        if (r_jwks_append_jwk(sign_keys->jwks_public, jwk) != RHN_OK) {
           y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error r_jwks_append_jwk jwks_public ecdsa");
           ret = G_ERROR;
         }
@@ -16259,7 +17855,7 @@ static int build_sign_keys_from_params(struct _oidc_config * config) {
           ret = G_ERROR_PARAM;
         }
         r_jwk_set_property_str(jwk, "alg", r_jwa_alg_to_str(alg));
-        if (r_jwks_append_jwk(config->jwks_sign, jwk) != RHN_OK) {
+        if (r_jwks_append_jwk(sign_keys->jwks_sign, jwk) != RHN_OK) {
           y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error r_jwks_append_jwk jwks_sign rsa-pss");
           ret = G_ERROR;
         }
@@ -16272,7 +17868,7 @@ static int build_sign_keys_from_params(struct _oidc_config * config) {
           ret = G_ERROR_PARAM;
         }
         r_jwk_set_property_str(jwk, "alg", r_jwa_alg_to_str(alg));
-        if (r_jwks_append_jwk(config->jwks_public, jwk) != RHN_OK) {
+        if (r_jwks_append_jwk(sign_keys->jwks_public, jwk) != RHN_OK) {
           y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error r_jwks_append_jwk jwks_public rsa-pss");
           ret = G_ERROR;
         }
@@ -16293,7 +17889,7 @@ static int build_sign_keys_from_params(struct _oidc_config * config) {
           ret = G_ERROR_PARAM;
         }
         r_jwk_set_property_str(jwk, "alg", r_jwa_alg_to_str(alg));
-        if (r_jwks_append_jwk(config->jwks_sign, jwk) != RHN_OK) {
+        if (r_jwks_append_jwk(sign_keys->jwks_sign, jwk) != RHN_OK) {
           y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error r_jwks_append_jwk jwks_sign eddsa");
           ret = G_ERROR;
         }
@@ -16306,7 +17902,7 @@ static int build_sign_keys_from_params(struct _oidc_config * config) {
           ret = G_ERROR_PARAM;
         }
         r_jwk_set_property_str(jwk, "alg", r_jwa_alg_to_str(alg));
-        if (r_jwks_append_jwk(config->jwks_public, jwk) != RHN_OK) {
+        if (r_jwks_append_jwk(sign_keys->jwks_public, jwk) != RHN_OK) {
           y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error r_jwks_append_jwk jwks_public eddsa");
           ret = G_ERROR;
         }
@@ -16336,11 +17932,11 @@ static int build_sign_keys_from_params(struct _oidc_config * config) {
         r_jwk_set_property_str(jwk, "alg", r_jwa_alg_to_str(alg));
         r_jwk_set_property_str(jwk, "kid", kid);
         o_free(kid);
-        if (r_jwks_append_jwk(config->jwks_sign, jwk) != RHN_OK) {
+        if (r_jwks_append_jwk(sign_keys->jwks_sign, jwk) != RHN_OK) {
           y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error r_jwks_append_jwk jwks_sign sha");
           ret = G_ERROR;
         }
-        if (r_jwks_append_jwk(config->jwks_public, jwk) != RHN_OK) {
+        if (r_jwks_append_jwk(sign_keys->jwks_public, jwk) != RHN_OK) {
           y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error r_jwks_append_jwk jwks_public sha");
           ret = G_ERROR;
         }
@@ -16352,27 +17948,45 @@ static int build_sign_keys_from_params(struct _oidc_config * config) {
     }
 
     if (!json_string_null_or_empty(json_object_get(config->j_params, "jwks-private")) || !json_string_null_or_empty(json_object_get(config->j_params, "jwks-uri"))) {
-      r_jwks_empty(config->jwks_sign);
+      r_jwks_empty(sign_keys->jwks_sign);
+      if (r_jwks_init(&jwks_source) != RHN_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - Error r_jwks_init jwks_source");
+        ret = G_ERROR;
+        break;
+      }
       if (!json_string_null_or_empty(json_object_get(config->j_params, "jwks-uri"))) {
-        if (r_jwks_import_from_uri(config->jwks_sign, json_string_value(json_object_get(config->j_params, "jwks-uri")), config->x5u_flags) != RHN_OK) {
+        if (r_jwks_import_from_uri(jwks_source, json_string_value(json_object_get(config->j_params, "jwks-uri")), config->x5u_flags) != RHN_OK) {
           y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error importing jwks_sign from uri");
           ret = G_ERROR_PARAM;
           break;
         }
       } else {
-        if (r_jwks_import_from_json_str(config->jwks_sign, json_string_value(json_object_get(config->j_params, "jwks-private"))) != RHN_OK) {
+        if (r_jwks_import_from_json_str(jwks_source, json_string_value(json_object_get(config->j_params, "jwks-private"))) != RHN_OK) {
           y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error importing jwks_sign from data");
           ret = G_ERROR_PARAM;
           break;
         }
       }
-      if (!r_jwks_size(config->jwks_sign)) {
+      if (!r_jwks_size(jwks_source)) {
         y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error jwks_sign is empty");
         ret = G_ERROR_PARAM;
         break;
       }
-      for (i=0; ret == G_OK && i<r_jwks_size(config->jwks_sign); i++) {
-        jwk = r_jwks_get_at(config->jwks_sign, i);
+      retire_sign_keys(config, jwks_source, now);
+      for (i=0; ret == G_OK && i<r_jwks_size(jwks_source)+pointer_list_size(&config->sign_keys_retired); i++) {
+        if (i<r_jwks_size(jwks_source)) {
+          jwk = r_jwks_get_at(jwks_source, i);
+          state = get_sign_key_state(config, jwk, now);
+          next_update = get_sign_key_next_update(config, jwk, now);
+        } else {
+          retired_key = (struct _oidc_retired_key *)pointer_list_get_at(&config->sign_keys_retired, i-r_jwks_size(jwks_source));
+          jwk = r_jwk_copy(retired_key->jwk);
+          state = GLEWLWYD_SIGN_KEY_STATE_RETIRED;
+          next_update = retired_key->expires_at;
+        }
+        if (next_update && (!sign_keys->next_update || next_update < sign_keys->next_update)) {
+          sign_keys->next_update = next_update;
+        }
         type = r_jwk_key_type(jwk, NULL, config->x5u_flags);
         if (!(type & R_KEY_TYPE_PRIVATE) && !(type & R_KEY_TYPE_SYMMETRIC)) {
           y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error jwk at index %zu is not a private or a symmetric key", i);
@@ -16383,19 +17997,23 @@ static int build_sign_keys_from_params(struct _oidc_config * config) {
         } else if (r_str_to_jwa_alg(r_jwk_get_property_str(jwk, "alg")) == R_JWA_ALG_UNKNOWN) {
           y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error jwk at index %zu invalid 'alg' property: '%s'", i, r_jwk_get_property_str(jwk, "alg"));
           ret = G_ERROR_PARAM;
-        } else {
+        } else if (state != GLEWLWYD_SIGN_KEY_STATE_DROPPED) {
+          if (state == GLEWLWYD_SIGN_KEY_STATE_ACTIVE) {
+            r_jwks_append_jwk(sign_keys->jwks_sign, jwk);
+          }
+          r_jwks_append_jwk(sign_keys->jwks_private, jwk);
           if (!(type & R_KEY_TYPE_SYMMETRIC)) {
             jwk_pub = NULL;
             if (r_jwk_init(&jwk_pub) != RHN_OK || r_jwk_extract_pubkey(jwk, jwk_pub, config->x5u_flags) != RHN_OK) {
               y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error extracting public key at index %zu", i);
               ret = G_ERROR;
             } else {
-              r_jwks_append_jwk(config->jwks_public, jwk_pub);
+              r_jwks_append_jwk(sign_keys->jwks_public, jwk_pub);
               r_jwks_append_jwk(jwks_pub_export, jwk_pub);
             }
             r_jwk_free(jwk_pub);
           } else {
-            r_jwks_append_jwk(config->jwks_public, jwk);
+            r_jwks_append_jwk(sign_keys->jwks_public, jwk);
           }
         }
         r_jwk_free(jwk);
@@ -16403,6 +18021,11 @@ static int build_sign_keys_from_params(struct _oidc_config * config) {
       if (ret != G_OK) {
         break;
       }
+      if (!r_jwks_size(sign_keys->jwks_sign)) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error no active key in jwks_sign");
+        ret = G_ERROR_PARAM;
+        break;
+      }
     }
 
     if (!json_string_null_or_empty(json_object_get(config->j_params, "jwks-public-uri")) || !json_string_null_or_empty(json_object_get(config->j_params, "jwks-public"))) {
@@ -16422,26 +18045,156 @@ static int build_sign_keys_from_params(struct _oidc_config * config) {
       }
     }
 
-    if (!r_jwks_size(config->jwks_sign)) {
+    if (!r_jwks_size(sign_keys->jwks_sign)) {
       y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error jwks_sign empty");
       ret = G_ERROR;
       break;
     }
 
-    if (!r_jwks_size(config->jwks_public)) {
+    if (!r_jwks_size(sign_keys->jwks_public)) {
       y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error jwks_public empty");
       ret = G_ERROR;
       break;
     }
 
+    if (!r_jwks_size(sign_keys->jwks_private)) {
+      for (i=0; i<r_jwks_size(sign_keys->jwks_sign); i++) {
+        jwk = r_jwks_get_at(sign_keys->jwks_sign, i);
+        r_jwks_append_jwk(sign_keys->jwks_private, jwk);
+        r_jwk_free(jwk);
+      }
+    }
+
+    if ((ret = build_sign_key_handles(sign_keys)) != G_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "build_sign_keys_from_params - oidc - Error build_sign_key_handles");
+      break;
+    }
+
     if (r_jwks_size(jwks_pub_export)) {
-      config->jwks_str = r_jwks_export_to_json_str(jwks_pub_export, 0);
+      *jwks_str = r_jwks_export_to_json_str(jwks_pub_export, 0);
+    }
+    for (i=0; i<r_jwks_size(sign_keys->jwks_sign); i++) {
+      jwk = r_jwks_get_at(sign_keys->jwks_sign, i);
+      sign_keys->fingerprint = mstrcatf(sign_keys->fingerprint, "%s ", r_jwk_get_property_str(jwk, "kid"));
+      r_jwk_free(jwk);
     }
+    sign_keys->fingerprint = mstrcatf(sign_keys->fingerprint, "%s", *jwks_str!=NULL?*jwks_str:"");
   } while (0);
   r_jwks_free(jwks_pub_export);
+  r_jwks_free(jwks_source);
+  if (ret == G_OK) {
+    *p_sign_keys = sign_keys;
+  } else {
+    free_sign_keys(sign_keys);
+    o_free(*jwks_str);
+    *jwks_str = NULL;
+  }
   return ret;
 }
 
+/**
+ * Publish a new set of signing keys and the corresponding JWKS and discovery documents
+ * The reference held by the published pointer on the previous set is released
+ * once no reader can be between loading the pointer and taking its reference,
+ * the set is freed when the last request using it releases its own reference
+ * Only called during plugin init or by the rotation thread
+ */
+static void publish_sign_keys(struct _oidc_config * config, struct _oidc_sign_keys * sign_keys, char * jwks_str) {
+  struct _oidc_sign_keys * old_sign_keys;
+  unsigned int epoch;
+
+  sign_keys->refcount = 1;
+  old_sign_keys = __atomic_exchange_n(&config->sign_keys, sign_keys, __ATOMIC_SEQ_CST);
+  epoch = __atomic_fetch_add(&config->sign_keys_epoch, 1, __ATOMIC_SEQ_CST) & 1;
+  while (__atomic_load_n(&config->sign_keys_readers[epoch], __ATOMIC_ACQUIRE)) {
+    sched_yield();
+  }
+  set_metadata(config, &config->jwks, jwks_str);
+  if (old_sign_keys != NULL) {
+    if (generate_discovery_content(config) != G_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "publish_sign_keys - oidc - Error generate_discovery_content");
+    }
+    release_sign_keys(old_sign_keys);
+  }
+}
+
+/**
+ * Reload the signing keys from the plugin parameters and publish them if they have changed
+ */
+static void rotate_sign_keys(struct _oidc_config * config) {
+  struct _oidc_sign_keys * sign_keys = NULL;
+  char * jwks_str = NULL;
+  time_t now;
+
+  time(&now);
+  if (build_sign_keys_from_params(config, now, &sign_keys, &jwks_str) == G_OK) {
+    config->sign_keys_next_update = sign_keys->next_update;
+    if (0 != o_strcmp(sign_keys->fingerprint, config->sign_keys->fingerprint)) {
+      y_log_message(Y_LOG_LEVEL_INFO, "oidc - Signing keys updated for plugin %s", config->name);
+      publish_sign_keys(config, sign_keys, jwks_str);
+    } else {
+      free_sign_keys(sign_keys);
+      o_free(jwks_str);
+    }
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "rotate_sign_keys - oidc - Error build_sign_keys_from_params, keep current signing keys");
+    if (config->sign_keys_next_update) {
+      config->sign_keys_next_update = now + GLEWLWYD_SIGN_KEYS_UPDATE_RETRY_DELAY;
+    }
+  }
+}
+
+/**
+ * Reload the signing keys every jwks-rotation-interval seconds,
+ * and when the next key reaches its 'nbf' or 'exp' value, even if the interval is 0
+ */
+static void * thread_sign_keys_rotation(void * args) {
+  struct _oidc_config * config = (struct _oidc_config *)args;
+  json_int_t interval = json_integer_value(json_object_get(config->j_params, "jwks-rotation-interval"));
+  struct timespec deadline;
+  time_t delay, now;
+  int stop = 0, has_deadline;
+
+  while (!stop) {
+    delay = (time_t)interval;
+    has_deadline = (interval > 0);
+    if (config->sign_keys_next_update) {
+      time(&now);
+      if (!has_deadline || config->sign_keys_next_update - now < delay) {
+        delay = config->sign_keys_next_update>now?(config->sign_keys_next_update - now):0;
+      }
+      has_deadline = 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += delay;
+    pthread_mutex_lock(&config->sign_keys_lock);
+    if (has_deadline) {
+      while (!config->sign_keys_stop && pthread_cond_timedwait(&config->sign_keys_cond, &config->sign_keys_lock, &deadline) != ETIMEDOUT);
+    } else {
+      while (!config->sign_keys_stop) {
+        pthread_cond_wait(&config->sign_keys_cond, &config->sign_keys_lock);
+      }
+    }
+    stop = config->sign_keys_stop;
+    pthread_mutex_unlock(&config->sign_keys_lock);
+    if (!stop) {
+      rotate_sign_keys(config);
+    }
+  }
+  return NULL;
+}
+
+static void stop_sign_keys_rotation(struct _oidc_config * config) {
+  if (config->sign_keys_thread_started) {
+    pthread_mutex_lock(&config->sign_keys_lock);
+    config->sign_keys_stop = 1;
+    pthread_cond_broadcast(&config->sign_keys_cond);
+    pthread_mutex_unlock(&config->sign_keys_lock);
+    pthread_join(config->sign_keys_thread, NULL);
+    config->sign_keys_thread_started = 0;
+  }
+}
+
 static int remove_subject_identifier(struct _oidc_config * config, const char * username) {
   json_t * j_query;
   int res, ret = G_OK;
@@ -16463,142 +18216,31 @@ static int remove_subject_identifier(struct _oidc_config * config, const char *
 }
 
 static int disable_user_data(struct _oidc_config * config, const char * username) {
-  json_t * j_query;
-  int res, ret = G_OK;
-
-  do {
-    j_query = json_pack("{sss{si}s{sssssi}}",
-                        "table", GLEWLWYD_PLUGIN_OIDC_TABLE_CODE,
-                        "set",
-                          "gpoc_enabled", 0,
-                        "where",
-                          "gpoc_plugin_name", config->name,
-                          "gpoc_username", username,
-                          "gpoc_enabled", 1);
-    res = h_update(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
-    json_decref(j_query);
-    if (res != H_OK) {
-      y_log_message(Y_LOG_LEVEL_ERROR, "disable_user_data - Error disable codes");
-      ret = G_ERROR;
-      break;
-    }
-
-    j_query = json_pack("{sss{si}s{sssssi}}",
-                        "table", GLEWLWYD_PLUGIN_OIDC_TABLE_REFRESH_TOKEN,
-                        "set",
-                          "gpor_enabled", 0,
-                        "where",
-                          "gpor_plugin_name", config->name,
-                          "gpor_username", username,
-                          "gpor_enabled", 1);
-    res = h_update(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
-    json_decref(j_query);
-    if (res != H_OK) {
-      y_log_message(Y_LOG_LEVEL_ERROR, "disable_user_data - Error disable refresh tokens");
-      ret = G_ERROR;
-      break;
-    }
-
-    j_query = json_pack("{sss{si}s{sssssi}}",
-                        "table", GLEWLWYD_PLUGIN_OIDC_TABLE_ACCESS_TOKEN,
-                        "set",
-                          "gpoa_enabled", 0,
-                        "where",
-                          "gpoa_plugin_name", config->name,
-                          "gpoa_username", username,
-                          "gpoa_enabled", 1);
-    res = h_update(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
-    json_decref(j_query);
-    if (res != H_OK) {
-      y_log_message(Y_LOG_LEVEL_ERROR, "disable_user_data - Error disable access tokens");
-      ret = G_ERROR;
-      break;
-    }
-
-    j_query = json_pack("{sss{si}s{sssssi}}",
-                        "table", GLEWLWYD_PLUGIN_OIDC_TABLE_ID_TOKEN,
-                        "set",
-                          "gpoi_enabled", 0,
-                        "where",
-                          "gpoi_plugin_name", config->name,
-                          "gpoi_username", username,
-                          "gpoi_enabled", 1);
-    res = h_update(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
-    json_decref(j_query);
-    if (res != H_OK) {
-      y_log_message(Y_LOG_LEVEL_ERROR, "disable_user_data - Error disable id tokens");
-      ret = G_ERROR;
-      break;
-    }
-
-    j_query = json_pack("{sss{si}s{sssss{ssss}}}",
-                        "table", GLEWLWYD_PLUGIN_OIDC_TABLE_DEVICE_AUTHORIZATION,
-                        "set",
-                          "gpoda_status", 3,
-                        "where",
-                          "gpoda_plugin_name", config->name,
-                          "gpoda_username", username,
-                          "gpoda_status",
-                            "operator", "raw",
-                            "value", "in (0, 1)");
-    res = h_update(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
-    json_decref(j_query);
-    if (res != H_OK) {
-      y_log_message(Y_LOG_LEVEL_ERROR, "disable_user_data - Error disable device auth tokens");
-      ret = G_ERROR;
-      break;
-    }
-
-    j_query = json_pack("{sss{si}s{sssssi}}",
-                        "table", GLEWLWYD_PLUGIN_OIDC_TABLE_RAR,
-                        "set",
-                          "gporar_enabled", 0,
-                        "where",
-                          "gporar_plugin_name", config->name,
-                          "gporar_username", username,
-                          "gporar_enabled", 1);
-    res = h_update(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
-    json_decref(j_query);
-    if (res != H_OK) {
-      y_log_message(Y_LOG_LEVEL_ERROR, "disable_user_data - Error disable rar");
-      ret = G_ERROR;
-      break;
-    }
-
-    j_query = json_pack("{sss{si}s{sssss{ssss}}}",
-                        "table", GLEWLWYD_PLUGIN_OIDC_TABLE_PAR,
-                        "set",
-                          "gpop_status", 2,
-                        "where",
-                          "gpop_plugin_name", config->name,
-                          "gpop_username", username,
-                          "gpop_status",
-                            "operator", "raw",
-                            "value", "in (0, 1)");
-    res = h_update(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
-    json_decref(j_query);
-    if (res != H_OK) {
-      y_log_message(Y_LOG_LEVEL_ERROR, "disable_user_data - Error disable par");
-      ret = G_ERROR;
-      break;
-    }
+  struct _oidc_revocation_job * job;
+  char * name_escaped, * username_escaped, * label;
+  int ret;
 
-    j_query = json_pack("{sss{si}s{sssssi}}",
-                        "table", GLEWLWYD_PLUGIN_OIDC_TABLE_CIBA,
-                        "set",
-                          "gpob_enabled", 0,
-                        "where",
-                          "gpob_plugin_name", config->name,
-                          "gpob_username", username,
-                          "gpob_enabled", 1);
-    res = h_update(config->glewlwyd_config->glewlwyd_config->conn, j_query, NULL);
-    json_decref(j_query);
-    if (res != H_OK) {
-      y_log_message(Y_LOG_LEVEL_ERROR, "disable_user_data - Error disable ciba");
-      ret = G_ERROR;
-      break;
-    }
-  } while (0);
+  name_escaped = h_escape_string_with_quotes(config->glewlwyd_config->glewlwyd_config->conn, config->name);
+  username_escaped = h_escape_string_with_quotes(config->glewlwyd_config->glewlwyd_config->conn, username);
+  label = msprintf("data of user '%s'", username);
+
+  // Codes and requests first so no new token can be issued while the tokens are disabled
+  if ((job = init_revocation_job(label)) != NULL) {
+    add_revocation_step(job, &revocation_table_code, msprintf("gpoc_plugin_name=%s AND gpoc_username=%s", name_escaped, username_escaped));
+    add_revocation_step(job, &revocation_table_device_authorization, msprintf("gpoda_plugin_name=%s AND gpoda_username=%s", name_escaped, username_escaped));
+    add_revocation_step(job, &revocation_table_ciba, msprintf("gpob_plugin_name=%s AND gpob_username=%s", name_escaped, username_escaped));
+    add_revocation_step(job, &revocation_table_par, msprintf("gpop_plugin_name=%s AND gpop_username=%s", name_escaped, username_escaped));
+    add_revocation_step(job, &revocation_table_rar, msprintf("gporar_plugin_name=%s AND gporar_username=%s", name_escaped, username_escaped));
+    add_revocation_step(job, &revocation_table_refresh_token, msprintf("gpor_plugin_name=%s AND gpor_username=%s", name_escaped, username_escaped));
+    add_revocation_step(job, &revocation_table_access_token, msprintf("gpoa_plugin_name=%s AND gpoa_username=%s", name_escaped, username_escaped));
+    add_revocation_step(job, &revocation_table_id_token, msprintf("gpoi_plugin_name=%s AND gpoi_username=%s", name_escaped, username_escaped));
+  }
+  if ((ret = run_revocation(config, job)) != G_OK) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "disable_user_data - Error run_revocation");
+  }
+  o_free(name_escaped);
+  o_free(username_escaped);
+  o_free(label);
   return ret;
 }
 
@@ -16620,17 +18262,44 @@ int plugin_module_unload(struct config_plugin * config) {
 
 json_t * plugin_module_init(struct config_plugin * config, const char * name, json_t * j_parameters, void ** cls) {
   pthread_mutexattr_t mutexattr;
+  pthread_condattr_t condattr;
   json_t * j_return = NULL, * j_result = NULL, * j_element = NULL;
   size_t index = 0;
   struct _oidc_config * p_config = NULL;
   jwk_t * jwk = NULL, * jwk_pub = NULL;
   jwks_t * jwks_privkey = NULL, * jwks_pubkey = NULL, * jwks_published = NULL, * jwks_specified = NULL;
-  int res;
+  struct _oidc_sign_keys * sign_keys = NULL;
+  char * jwks_str = NULL;
+  int res, i;
 
   y_log_message(Y_LOG_LEVEL_INFO, "Init plugin Glewlwyd OpenID Connect '%s'", name);
   *cls = o_malloc(sizeof(struct _oidc_config));
   if (*cls != NULL) {
     p_config = *cls;
+    pointer_list_init(&p_config->client_enc_jwks_list);
+    for (i=0; i<GLEWLWYD_PENDING_AUTH_BUCKETS; i++) {
+      pointer_list_init(&p_config->pending_auth_list[i]);
+    }
+    // Without cache invalidation, another instance sharing the database wouldn't remove the entries
+    p_config->pending_auth_enabled = (config->glewlwyd_config->cache_invalidation_backend != GLEWLWYD_CACHE_INVALIDATION_BACKEND_NONE);
+    p_config->pending_auth_generation = 0;
+    p_config->pending_auth_waiters = 0;
+    for (i=0; i<GLEWLWYD_CLIENT_REDIRECT_URI_BUCKETS; i++) {
+      pointer_list_init(&p_config->client_redirect_uri_list[i]);
+    }
+    memset(&p_config->discovery, 0, sizeof(struct _oidc_metadata));
+    memset(&p_config->jwks, 0, sizeof(struct _oidc_metadata));
+    p_config->sign_keys = NULL;
+    p_config->sign_keys_epoch = 0;
+    p_config->sign_keys_readers[0] = 0;
+    p_config->sign_keys_readers[1] = 0;
+    p_config->sign_keys_next_update = 0;
+    pointer_list_init(&p_config->sign_keys_retired);
+    p_config->sign_keys_thread_started = 0;
+    p_config->sign_keys_stop = 0;
+    pointer_list_init(&p_config->revocation_job_list);
+    p_config->revocation_thread_started = 0;
+    p_config->revocation_stop = 0;
 
     do {
       pthread_mutexattr_init ( &mutexattr );
@@ -16641,18 +18310,67 @@ json_t * plugin_module_init(struct config_plugin * config, const char * name, js
         break;
       }
       pthread_mutexattr_destroy(&mutexattr);
+      for (i=0; i<OIDC_REFRESH_TOKEN_LOCK_STRIPES; i++) {
+        if (pthread_mutex_init(&p_config->refresh_token_lock[i], NULL) != 0) {
+          break;
+        }
+      }
+      if (i < OIDC_REFRESH_TOKEN_LOCK_STRIPES) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "oidc plugin_module_init - Error initializing refresh_token_lock");
+        j_return = json_pack("{si}", "result", G_ERROR);
+        break;
+      }
+      p_config->refresh_token_claim_instance = __atomic_add_fetch(&refresh_token_claim_instance_counter, 1, __ATOMIC_RELAXED);
+      if (pthread_mutex_init(&p_config->client_enc_jwks_lock, NULL) != 0) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "oidc plugin_module_init - Error initializing client_enc_jwks_lock");
+        j_return = json_pack("{si}", "result", G_ERROR);
+        break;
+      }
+      pthread_condattr_init(&condattr);
+      pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+      if (pthread_mutex_init(&p_config->pending_auth_lock, NULL) != 0 || pthread_cond_init(&p_config->pending_auth_cond, &condattr) != 0) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "oidc plugin_module_init - Error initializing pending_auth_lock");
+        pthread_condattr_destroy(&condattr);
+        j_return = json_pack("{si}", "result", G_ERROR);
+        break;
+      }
+      pthread_condattr_destroy(&condattr);
+      if (pthread_mutex_init(&p_config->client_redirect_uri_lock, NULL) != 0) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "oidc plugin_module_init - Error initializing client_redirect_uri_lock");
+        j_return = json_pack("{si}", "result", G_ERROR);
+        break;
+      }
+      if (pthread_mutex_init(&p_config->metadata_lock, NULL) != 0) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "oidc plugin_module_init - Error initializing metadata_lock");
+        j_return = json_pack("{si}", "result", G_ERROR);
+        break;
+      }
+      pthread_condattr_init(&condattr);
+      pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+      if (pthread_mutex_init(&p_config->sign_keys_lock, NULL) != 0 || pthread_cond_init(&p_config->sign_keys_cond, &condattr) != 0) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "oidc plugin_module_init - Error initializing sign_keys_lock");
+        pthread_condattr_destroy(&condattr);
+        j_return = json_pack("{si}", "result", G_ERROR);
+        break;
+      }
+      pthread_condattr_destroy(&condattr);
+      pthread_condattr_init(&condattr);
+      pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+      if (pthread_mutex_init(&p_config->revocation_lock, NULL) != 0 || pthread_cond_init(&p_config->revocation_cond, &condattr) != 0) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "oidc plugin_module_init - Error initializing revocation_lock");
+        pthread_condattr_destroy(&condattr);
+        j_return = json_pack("{si}", "result", G_ERROR);
+        break;
+      }
+      pthread_condattr_destroy(&condattr);
 
       // Initialize empty vaiables
       p_config->name = name;
       p_config->glewlwyd_config = config;
       p_config->j_params = json_incref(j_parameters);
       json_object_set_new(p_config->j_params, "name", json_string(name));
-      p_config->discovery_str = NULL;
-      p_config->jwks_str = NULL;
       p_config->check_session_iframe = NULL;
       p_config->request_uri_duration = 0;
-      p_config->jwks_sign = NULL;
-      p_config->jwks_public = NULL;
       p_config->x5u_flags = 0;
       p_config->introspect_revoke_scope = NULL;
       p_config->client_register_scope = NULL;
@@ -16668,11 +18386,13 @@ json_t * plugin_module_init(struct config_plugin * config, const char * name, js
         break;
       }
 
-      if ((res = build_sign_keys_from_params(p_config)) != G_OK) {
+      if ((res = build_sign_keys_from_params(p_config, time(NULL), &sign_keys, &jwks_str)) != G_OK) {
         y_log_message(Y_LOG_LEVEL_ERROR, "protocol_init - oidc - Error build_sign_keys_from_params");
         j_return = json_pack("{si}", "result", res);
         break;
       }
+      p_config->sign_keys_next_update = sign_keys->next_update;
+      publish_sign_keys(p_config, sign_keys, jwks_str);
 
       p_config->dpop_max_iat = (time_t)json_integer_value(json_object_get(p_config->j_params, "oauth-dpop-iat-duration"));
       p_config->dpop_max_iat_gap = (time_t)json_integer_value(json_object_get(p_config->j_params, "oauth-dpop-iat-gap-duration"));
@@ -16832,6 +18552,18 @@ json_t * plugin_module_init(struct config_plugin * config, const char * name, js
           json_object_set_new(p_config->j_params, "device-authorization-interval", json_integer(GLEWLWYD_DEVICE_AUTH_DEFAUT_INTERVAL));
         }
       }
+      if (json_object_get(p_config->j_params, "jwks-rotation-interval") == NULL) {
+        json_object_set_new(p_config->j_params, "jwks-rotation-interval", json_integer(0));
+      }
+      if (json_object_get(p_config->j_params, "metadata-max-age") == NULL) {
+        json_object_set_new(p_config->j_params, "metadata-max-age", json_integer(0));
+      }
+      if (json_object_get(p_config->j_params, "token-long-poll-duration") == NULL) {
+        json_object_set_new(p_config->j_params, "token-long-poll-duration", json_integer(0));
+      }
+      if (json_object_get(p_config->j_params, "token-long-poll-max-requests") == NULL) {
+        json_object_set_new(p_config->j_params, "token-long-poll-max-requests", json_integer(GLEWLWYD_LONG_POLL_DEFAULT_MAX_REQUESTS));
+      }
 
       if (json_object_get(p_config->j_params, "client-cert-use-endpoint-aliases") == json_true()) {
         if (config->glewlwyd_callback_add_plugin_endpoint(config, "POST", name, "mtls/token/", GLEWLWYD_CALLBACK_PRIORITY_APPLICATION, &callback_oidc_token, (void*)*cls) != G_OK) {
@@ -16934,10 +18666,19 @@ json_t * plugin_module_init(struct config_plugin * config, const char * name, js
       config->glewlwyd_plugin_callback_metrics_add_metric(config, GLWD_METRICS_OIDC_INVALID_DEVICE_CODE, "Total number of invalid device code");
       config->glewlwyd_plugin_callback_metrics_add_metric(config, GLWD_METRICS_OIDC_INVALID_REFRESH_TOKEN, "Total number of invalid refresh token");
       config->glewlwyd_plugin_callback_metrics_add_metric(config, GLWD_METRICS_OIDC_INVALID_ACCESS_TOKEN, "Total number of invalid access token");
+      config->glewlwyd_plugin_callback_metrics_add_metric(config, GLWD_METRICS_OIDC_REVOKED, "Total number of codes, tokens and requests disabled by a revocation");
+      config->glewlwyd_plugin_callback_metrics_add_metric(config, GLWD_METRICS_OIDC_REVOCATION_BACKGROUND, "Total number of revocations continued in background");
+      config->glewlwyd_plugin_callback_metrics_add_metric(config, GLWD_METRICS_OIDC_REVOCATION_COMPLETE, "Total number of revocations continued in background and complete");
+      config->glewlwyd_plugin_callback_metrics_add_metric(config, GLWD_METRICS_OIDC_REVOCATION_FAILED, "Total number of revocations continued in background and given up");
+      config->glewlwyd_plugin_callback_metrics_add_metric(config, GLWD_METRICS_OIDC_REVOCATION_RETRY, "Total number of revocation batches failed and retried");
       config->glewlwyd_plugin_callback_metrics_increment_counter(config, GLWD_METRICS_OIDC_CODE, 0, "plugin", name, NULL);
       config->glewlwyd_plugin_callback_metrics_increment_counter(config, GLWD_METRICS_OIDC_ID_TOKEN, 0, "plugin", name, NULL);
       config->glewlwyd_plugin_callback_metrics_increment_counter(config, GLWD_METRICS_OIDC_REFRESH_TOKEN, 0, "plugin", name, NULL);
       config->glewlwyd_plugin_callback_metrics_increment_counter(config, GLWD_METRICS_OIDC_USER_ACCESS_TOKEN, 0, "plugin", name, NULL);
+      config->glewlwyd_plugin_callback_metrics_increment_counter(config, GLWD_METRICS_OIDC_REVOCATION_BACKGROUND, 0, "plugin", name, NULL);
+      config->glewlwyd_plugin_callback_metrics_increment_counter(config, GLWD_METRICS_OIDC_REVOCATION_COMPLETE, 0, "plugin", name, NULL);
+      config->glewlwyd_plugin_callback_metrics_increment_counter(config, GLWD_METRICS_OIDC_REVOCATION_FAILED, 0, "plugin", name, NULL);
+      config->glewlwyd_plugin_callback_metrics_increment_counter(config, GLWD_METRICS_OIDC_REVOCATION_RETRY, 0, "plugin", name, NULL);
       if (json_object_get(p_config->j_params, "auth-type-code-enabled") == json_true()) {
         config->glewlwyd_plugin_callback_metrics_increment_counter(config, GLWD_METRICS_OIDC_ID_TOKEN, 0, "plugin", name, "response_type", "code", NULL);
         config->glewlwyd_plugin_callback_metrics_increment_counter(config, GLWD_METRICS_OIDC_REFRESH_TOKEN, 0, "plugin", name, "response_type", "code", NULL);
@@ -16975,6 +18716,27 @@ json_t * plugin_module_init(struct config_plugin * config, const char * name, js
         config->glewlwyd_plugin_callback_metrics_increment_counter(config, GLWD_METRICS_OIDC_REFRESH_TOKEN, 0, "plugin", name, "response_type", "ciba", NULL);
         config->glewlwyd_plugin_callback_metrics_increment_counter(config, GLWD_METRICS_OIDC_USER_ACCESS_TOKEN, 0, "plugin", name, "response_type", "ciba", NULL);
       }
+      if (config->glewlwyd_plugin_callback_cache_invalidation_register(config, GLEWLWYD_CACHE_OIDC_PENDING_AUTH, &pending_auth_invalidation_callback, p_config) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "oidc plugin_module_init - Error registering pending_auth invalidation");
+        j_return = json_pack("{si}", "result", G_ERROR);
+        break;
+      }
+      if (config->glewlwyd_plugin_callback_cache_invalidation_register(config, GLEWLWYD_CACHE_CLIENT, &client_redirect_uri_invalidation_callback, p_config) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "oidc plugin_module_init - Error registering client_redirect_uri invalidation");
+        j_return = json_pack("{si}", "result", G_ERROR);
+        break;
+      }
+      if ((json_integer_value(json_object_get(p_config->j_params, "jwks-rotation-interval")) > 0 || p_config->sign_keys_next_update) && (!json_string_null_or_empty(json_object_get(p_config->j_params, "jwks-private")) || !json_string_null_or_empty(json_object_get(p_config->j_params, "jwks-uri")))) {
+        if (pthread_create(&p_config->sign_keys_thread, NULL, &thread_sign_keys_rotation, p_config)) {
+          y_log_message(Y_LOG_LEVEL_ERROR, "oidc plugin_module_init - Error pthread_create sign_keys_thread");
+          j_return = json_pack("{si}", "result", G_ERROR);
+          break;
+        }
+        p_config->sign_keys_thread_started = 1;
+      }
+      if (resume_revocation_jobs(p_config) != G_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "oidc plugin_module_init - Error resume_revocation_jobs, the stored revocations will be resumed at the next start");
+      }
     } while (0);
     json_decref(j_result);
     r_jwk_free(jwk_pub);
@@ -16989,12 +18751,32 @@ json_t * plugin_module_init(struct config_plugin * config, const char * name, js
       if (p_config != NULL) {
         o_free(p_config->introspect_revoke_scope);
         o_free(p_config->client_register_scope);
-        r_jwks_free(p_config->jwks_sign);
-        r_jwks_free(p_config->jwks_public);
+        stop_sign_keys_rotation(p_config);
+        release_sign_keys(p_config->sign_keys);
+        pointer_list_clean_free(&p_config->sign_keys_retired, &free_retired_key);
+        pointer_list_clean_free(&p_config->client_enc_jwks_list, &free_client_enc_jwks);
+        for (i=0; i<GLEWLWYD_PENDING_AUTH_BUCKETS; i++) {
+          pointer_list_clean_free(&p_config->pending_auth_list[i], &free_pending_auth);
+        }
+        for (i=0; i<GLEWLWYD_CLIENT_REDIRECT_URI_BUCKETS; i++) {
+          pointer_list_clean_free(&p_config->client_redirect_uri_list[i], &free_client_redirect_uri);
+        }
         json_decref(p_config->j_params);
         pthread_mutex_destroy(&p_config->insert_lock);
-        o_free(p_config->discovery_str);
-        o_free(p_config->jwks_str);
+        for (i=0; i<OIDC_REFRESH_TOKEN_LOCK_STRIPES; i++) {
+          pthread_mutex_destroy(&p_config->refresh_token_lock[i]);
+        }
+        pthread_mutex_destroy(&p_config->client_enc_jwks_lock);
+        pthread_mutex_destroy(&p_config->pending_auth_lock);
+        pthread_cond_destroy(&p_config->pending_auth_cond);
+        pthread_mutex_destroy(&p_config->client_redirect_uri_lock);
+        clean_metadata(&p_config->discovery);
+        clean_metadata(&p_config->jwks);
+        pthread_mutex_destroy(&p_config->metadata_lock);
+        pthread_mutex_destroy(&p_config->sign_keys_lock);
+        pthread_cond_destroy(&p_config->sign_keys_cond);
+        pthread_mutex_destroy(&p_config->revocation_lock);
+        pthread_cond_destroy(&p_config->revocation_cond);
         o_free(p_config->check_session_iframe);
         o_free(p_config);
       }
@@ -17009,6 +18791,8 @@ json_t * plugin_module_init(struct config_plugin * config, const char * name, js
 }
 
 int plugin_module_close(struct config_plugin * config, const char * name, void * cls) {
+  int i;
+
   if (cls != NULL) {
     y_log_message(Y_LOG_LEVEL_INFO, "Close plugin Glewlwyd OpenID Connect '%s'", name);
     config->glewlwyd_callback_remove_plugin_endpoint(config, "GET", name, "auth/");
@@ -17072,12 +18856,35 @@ int plugin_module_close(struct config_plugin * config, const char * name, void *
       config->glewlwyd_callback_remove_plugin_endpoint(config, "GET", name, "ciba_user_list/");
       config->glewlwyd_callback_remove_plugin_endpoint(config, "GET", name, "ciba_user_check/");
     }
-    r_jwks_free(((struct _oidc_config *)cls)->jwks_sign);
-    r_jwks_free(((struct _oidc_config *)cls)->jwks_public);
+    stop_sign_keys_rotation((struct _oidc_config *)cls);
+    stop_revocation_thread((struct _oidc_config *)cls);
+    release_sign_keys(((struct _oidc_config *)cls)->sign_keys);
+    pointer_list_clean_free(&((struct _oidc_config *)cls)->sign_keys_retired, &free_retired_key);
+    config->glewlwyd_plugin_callback_cache_invalidation_unregister(config, GLEWLWYD_CACHE_OIDC_PENDING_AUTH, cls);
+    config->glewlwyd_plugin_callback_cache_invalidation_unregister(config, GLEWLWYD_CACHE_CLIENT, cls);
+    pointer_list_clean_free(&((struct _oidc_config *)cls)->client_enc_jwks_list, &free_client_enc_jwks);
+    for (i=0; i<GLEWLWYD_PENDING_AUTH_BUCKETS; i++) {
+      pointer_list_clean_free(&((struct _oidc_config *)cls)->pending_auth_list[i], &free_pending_auth);
+    }
+    for (i=0; i<GLEWLWYD_CLIENT_REDIRECT_URI_BUCKETS; i++) {
+      pointer_list_clean_free(&((struct _oidc_config *)cls)->client_redirect_uri_list[i], &free_client_redirect_uri);
+    }
     json_decref(((struct _oidc_config *)cls)->j_params);
     pthread_mutex_destroy(&((struct _oidc_config *)cls)->insert_lock);
-    o_free(((struct _oidc_config *)cls)->discovery_str);
-    o_free(((struct _oidc_config *)cls)->jwks_str);
+    for (i=0; i<OIDC_REFRESH_TOKEN_LOCK_STRIPES; i++) {
+      pthread_mutex_destroy(&((struct _oidc_config *)cls)->refresh_token_lock[i]);
+    }
+    pthread_mutex_destroy(&((struct _oidc_config *)cls)->client_enc_jwks_lock);
+    pthread_mutex_destroy(&((struct _oidc_config *)cls)->pending_auth_lock);
+    pthread_cond_destroy(&((struct _oidc_config *)cls)->pending_auth_cond);
+    pthread_mutex_destroy(&((struct _oidc_config *)cls)->client_redirect_uri_lock);
+    clean_metadata(&((struct _oidc_config *)cls)->discovery);
+    clean_metadata(&((struct _oidc_config *)cls)->jwks);
+    pthread_mutex_destroy(&((struct _oidc_config *)cls)->metadata_lock);
+    pthread_mutex_destroy(&((struct _oidc_config *)cls)->sign_keys_lock);
+    pthread_cond_destroy(&((struct _oidc_config *)cls)->sign_keys_cond);
+    pthread_mutex_destroy(&((struct _oidc_config *)cls)->revocation_lock);
+    pthread_cond_destroy(&((struct _oidc_config *)cls)->revocation_cond);
     o_free(((struct _oidc_config *)cls)->check_session_iframe);
     o_free(cls);
   }
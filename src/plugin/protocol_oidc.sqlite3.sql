@@ -1,3 +1,4 @@
+DROP TABLE IF EXISTS gpo_revocation_job;
 DROP TABLE IF EXISTS gpo_ciba_scope;
 DROP TABLE IF EXISTS gpo_ciba_scheme;
 DROP TABLE IF EXISTS gpo_ciba;
@@ -315,3 +316,12 @@ CREATE TABLE gpo_ciba_scheme (
   gpobh_scheme_module TEXT NOT NULL,
   FOREIGN KEY(gpob_id) REFERENCES gpo_ciba(gpob_id) ON DELETE CASCADE
 );
+
+CREATE TABLE gpo_revocation_job (
+  gporj_id INTEGER PRIMARY KEY AUTOINCREMENT,
+  gporj_plugin_name TEXT NOT NULL,
+  gporj_label TEXT,
+  gporj_steps TEXT NOT NULL,
+  gporj_created_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+CREATE INDEX i_gporj_plugin_name ON gpo_revocation_job(gporj_plugin_name);
@@ -0,0 +1,379 @@
+/**
+ *
+ * Glewlwyd SSO Server
+ *
+ * Authentiation server
+ * Users are authenticated via various backend available: database, ldap
+ * Using various authentication methods available: password, OTP, send code, etc.
+ *
+ * Rate limit functions definitions
+ *
+ * Copyright 2016-2021 Nicolas Mora <mail@babelouest.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU GENERAL PUBLIC LICENSE
+ * License as published by the Free Software Foundation;
+ * version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU GENERAL PUBLIC LICENSE for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "glewlwyd.h"
+
+static const char * rate_limit_types[] = {"ip", "username", "client_id", NULL};
+
+/**
+ * Callback registered instead of a plugin endpoint callback when the endpoint is limited
+ */
+struct _glwd_rate_limit_endpoint {
+  struct config_elements * config;
+  char                   * name;
+  int                   (* callback)(const struct _u_request * request, struct _u_response * response, void * user_data);
+  void                   * user_data;
+};
+
+static void free_rate_limit_endpoint(void * data) {
+  struct _glwd_rate_limit_endpoint * endpoint = (struct _glwd_rate_limit_endpoint *)data;
+
+  if (endpoint != NULL) {
+    o_free(endpoint->name);
+    o_free(endpoint);
+  }
+}
+
+static json_int_t rate_limit_now_ms() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((json_int_t)now.tv_sec * 1000) + (now.tv_nsec / 1000000);
+}
+
+static size_t rate_limit_stripe_index(const char * key) {
+  size_t hash = 2166136261u;
+
+  while (*key) {
+    hash = (hash ^ (unsigned char)*key) * 16777619u;
+    key++;
+  }
+  return hash % GLEWLWYD_RATE_LIMIT_STRIPES;
+}
+
+/**
+ * Endpoint names are stored without trailing '/'
+ * so "oidc/token" matches the plugin url "oidc/token/"
+ */
+static char * rate_limit_endpoint_name(const char * endpoint) {
+  char * name = o_strdup(endpoint);
+  size_t len = o_strlen(name);
+
+  while (len && name[len-1] == '/') {
+    name[--len] = '\0';
+  }
+  return name;
+}
+
+/**
+ * Bucket not throttled, candidate for eviction when the stripe is full
+ */
+struct _glwd_rate_limit_lru {
+  const char * key;
+  json_int_t   updated_at;
+};
+
+static int rate_limit_lru_cmp(const void * a, const void * b) {
+  json_int_t updated_a = ((const struct _glwd_rate_limit_lru *)a)->updated_at, updated_b = ((const struct _glwd_rate_limit_lru *)b)->updated_at;
+
+  return (updated_a > updated_b) - (updated_a < updated_b);
+}
+
+/**
+ * Removes the buckets full again, they're equivalent to a missing bucket
+ * If the stripe is still full, the least recently used buckets that aren't throttled
+ * are removed until the stripe is filled at GLEWLWYD_RATE_LIMIT_STRIPE_PRUNE_BUCKETS
+ * Throttled buckets are never removed before they have a token again,
+ * so spraying new keys can't reset a throttled bucket
+ * Returns G_OK if the stripe has room for a new bucket
+ */
+static int rate_limit_prune_stripe(struct _glwd_rate_limit_stripe * stripe, json_int_t now) {
+  json_t * j_expired = json_array(), * j_bucket, * j_element = NULL;
+  struct _glwd_rate_limit_lru * lru;
+  const char * key;
+  size_t index = 0, nb_lru = 0, nb_remove;
+
+  json_object_foreach(stripe->j_bucket, key, j_bucket) {
+    if (json_integer_value(json_array_get(j_bucket, 2)) <= now) {
+      json_array_append_new(j_expired, json_string(key));
+    }
+  }
+  json_array_foreach(j_expired, index, j_element) {
+    json_object_del(stripe->j_bucket, json_string_value(j_element));
+  }
+  json_array_clear(j_expired);
+  if (json_object_size(stripe->j_bucket) >= GLEWLWYD_RATE_LIMIT_STRIPE_MAX_BUCKETS) {
+    if ((lru = o_malloc(json_object_size(stripe->j_bucket) * sizeof(struct _glwd_rate_limit_lru))) != NULL) {
+      json_object_foreach(stripe->j_bucket, key, j_bucket) {
+        if (json_integer_value(json_array_get(j_bucket, 3)) <= now) {
+          lru[nb_lru].key = key;
+          lru[nb_lru].updated_at = json_integer_value(json_array_get(j_bucket, 1));
+          nb_lru++;
+        }
+      }
+      qsort(lru, nb_lru, sizeof(struct _glwd_rate_limit_lru), &rate_limit_lru_cmp);
+      nb_remove = json_object_size(stripe->j_bucket) - GLEWLWYD_RATE_LIMIT_STRIPE_PRUNE_BUCKETS;
+      for (index=0; index<nb_lru && index<nb_remove; index++) {
+        json_array_append_new(j_expired, json_string(lru[index].key));
+      }
+      o_free(lru);
+      json_array_foreach(j_expired, index, j_element) {
+        json_object_del(stripe->j_bucket, json_string_value(j_element));
+      }
+      y_log_message(Y_LOG_LEVEL_WARNING, "Security - Rate limit buckets full, removed %zu buckets not throttled", json_array_size(j_expired));
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "rate_limit_prune_stripe - Error allocating resources for lru");
+    }
+  }
+  json_decref(j_expired);
+  return json_object_size(stripe->j_bucket) < GLEWLWYD_RATE_LIMIT_STRIPE_MAX_BUCKETS?G_OK:G_ERROR;
+}
+
+/**
+ * Token bucket, each bucket is stored as [tokens, updated_at, full_at, token_at], times in milliseconds
+ * token_at is the time when the bucket has a token again
+ * rate is the number of tokens refilled every minute, burst is the bucket capacity
+ * If the stripe is full of throttled buckets, a new key is throttled until a bucket can be removed
+ */
+static int rate_limit_take(struct config_elements * config, const char * endpoint, const char * type, const char * value, json_t * j_limit, unsigned int * retry_after) {
+  char * key = msprintf("%s\t%s\t%s", endpoint, type, value);
+  struct _glwd_rate_limit_stripe * stripe;
+  double rate = (double)json_integer_value(json_object_get(j_limit, "rate")), burst = (double)json_integer_value(json_object_get(j_limit, "burst")), tokens;
+  json_int_t now = rate_limit_now_ms();
+  json_t * j_bucket;
+  int ret;
+
+  if (key != NULL) {
+    stripe = &config->rate_limit_stripe[rate_limit_stripe_index(key)];
+    if (!pthread_mutex_lock(&stripe->lock)) {
+      if ((j_bucket = json_object_get(stripe->j_bucket, key)) != NULL) {
+        tokens = json_real_value(json_array_get(j_bucket, 0)) + ((double)(now - json_integer_value(json_array_get(j_bucket, 1))) * rate / 60000.0);
+        if (tokens > burst) {
+          tokens = burst;
+        }
+      } else if (json_object_size(stripe->j_bucket) < GLEWLWYD_RATE_LIMIT_STRIPE_MAX_BUCKETS || rate_limit_prune_stripe(stripe, now) == G_OK) {
+        tokens = burst;
+        json_object_set_new(stripe->j_bucket, key, (j_bucket = json_pack("[fIII]", tokens, now, now, now)));
+      } else {
+        tokens = 0.0;
+      }
+      if (j_bucket == NULL) {
+        y_log_message(Y_LOG_LEVEL_WARNING, "Security - Rate limit buckets full of throttled buckets, new key throttled");
+        *retry_after = (unsigned int)(60.0 / rate) + 1;
+        ret = G_ERROR_UNAUTHORIZED;
+      } else {
+        if (tokens >= 1.0) {
+          tokens -= 1.0;
+          ret = G_OK;
+        } else {
+          *retry_after = (unsigned int)((1.0 - tokens) * 60.0 / rate) + 1;
+          ret = G_ERROR_UNAUTHORIZED;
+        }
+        json_real_set(json_array_get(j_bucket, 0), tokens);
+        json_integer_set(json_array_get(j_bucket, 1), now);
+        json_integer_set(json_array_get(j_bucket, 2), now + (json_int_t)((burst - tokens) * 60000.0 / rate) + 1);
+        json_integer_set(json_array_get(j_bucket, 3), tokens<1.0?(now + (json_int_t)((1.0 - tokens) * 60000.0 / rate) + 1):now);
+      }
+      pthread_mutex_unlock(&stripe->lock);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "rate_limit_take - Error lock");
+      ret = G_ERROR;
+    }
+    o_free(key);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "rate_limit_take - Error allocating resources for key");
+    ret = G_ERROR_MEMORY;
+  }
+  return ret;
+}
+
+static void rate_limit_increment_throttled(struct config_elements * config, const char * endpoint, const char * type) {
+  char * label = msprintf("endpoint=\"%s\",type=\"%s\"", endpoint, type);
+  json_t * j_counter;
+
+  if (label != NULL && !pthread_mutex_lock(&config->rate_limit_metrics_lock)) {
+    if ((j_counter = json_object_get(config->j_rate_limit_throttled, label)) != NULL) {
+      json_integer_set(j_counter, json_integer_value(j_counter)+1);
+    } else {
+      json_object_set_new(config->j_rate_limit_throttled, label, json_integer(1));
+    }
+    pthread_mutex_unlock(&config->rate_limit_metrics_lock);
+  }
+  o_free(label);
+}
+
+static int callback_glewlwyd_rate_limit(const struct _u_request * request, struct _u_response * response, void * user_data) {
+  struct _glwd_rate_limit_endpoint * endpoint = (struct _glwd_rate_limit_endpoint *)user_data;
+  const char * client_id = !o_strnullempty(request->auth_basic_user)?request->auth_basic_user:u_map_get(request->map_post_body, "client_id");
+  unsigned int retry_after = 0;
+
+  if (glewlwyd_rate_limit_check(endpoint->config, endpoint->name, get_ip_source(request), u_map_get(request->map_post_body, "username"), client_id, &retry_after) == G_ERROR_UNAUTHORIZED) {
+    glewlwyd_rate_limit_set_response(response, retry_after);
+    return U_CALLBACK_COMPLETE;
+  } else {
+    return endpoint->callback(request, response, endpoint->user_data);
+  }
+}
+
+int glewlwyd_rate_limit_init(struct config_elements * config) {
+  int ret = G_OK, i;
+
+  config->j_rate_limit = json_object();
+  config->j_rate_limit_throttled = json_object();
+  pointer_list_init(&config->rate_limit_endpoint_list);
+  if (pthread_mutex_init(&config->rate_limit_metrics_lock, NULL)) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_rate_limit_init - Error pthread_mutex_init rate_limit_metrics_lock");
+    ret = G_ERROR;
+  }
+  for (i=0; i<GLEWLWYD_RATE_LIMIT_STRIPES && ret == G_OK; i++) {
+    config->rate_limit_stripe[i].j_bucket = json_object();
+    if (pthread_mutex_init(&config->rate_limit_stripe[i].lock, NULL)) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_rate_limit_init - Error pthread_mutex_init stripe %d", i);
+      ret = G_ERROR;
+    }
+  }
+  return ret;
+}
+
+void glewlwyd_rate_limit_close(struct config_elements * config) {
+  int i;
+
+  for (i=0; i<GLEWLWYD_RATE_LIMIT_STRIPES; i++) {
+    pthread_mutex_destroy(&config->rate_limit_stripe[i].lock);
+    json_decref(config->rate_limit_stripe[i].j_bucket);
+  }
+  pthread_mutex_destroy(&config->rate_limit_metrics_lock);
+  json_decref(config->j_rate_limit);
+  json_decref(config->j_rate_limit_throttled);
+  pointer_list_clean_free(&config->rate_limit_endpoint_list, &free_rate_limit_endpoint);
+}
+
+/**
+ * Adds the limits of an endpoint, the format is
+ * {"endpoint": "oidc/token", "ip": {"rate": 600, "burst": 100}, "client_id": {"rate": 300, "burst": 50}, "username": {"rate": 10, "burst": 5}}
+ */
+int glewlwyd_rate_limit_set_endpoint(struct config_elements * config, json_t * j_endpoint) {
+  json_t * j_limits = json_object(), * j_limit;
+  char * name;
+  int ret = G_OK, i;
+
+  if (!json_string_null_or_empty(json_object_get(j_endpoint, "endpoint"))) {
+    for (i=0; rate_limit_types[i] != NULL && ret == G_OK; i++) {
+      if ((j_limit = json_object_get(j_endpoint, rate_limit_types[i])) != NULL) {
+        if (json_integer_value(json_object_get(j_limit, "rate")) > 0 && json_integer_value(json_object_get(j_limit, "burst")) > 0) {
+          json_object_set_new(j_limits, rate_limit_types[i], json_pack("{sIsI}", "rate", json_integer_value(json_object_get(j_limit, "rate")), "burst", json_integer_value(json_object_get(j_limit, "burst"))));
+        } else {
+          y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_rate_limit_set_endpoint - Error %s, rate and burst must be positive integers", rate_limit_types[i]);
+          ret = G_ERROR_PARAM;
+        }
+      }
+    }
+    if (ret == G_OK) {
+      name = rate_limit_endpoint_name(json_string_value(json_object_get(j_endpoint, "endpoint")));
+      json_object_set(config->j_rate_limit, name, j_limits);
+      o_free(name);
+    }
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_rate_limit_set_endpoint - Error endpoint name");
+    ret = G_ERROR_PARAM;
+  }
+  json_decref(j_limits);
+  return ret;
+}
+
+/**
+ * Takes a token in each bucket of the endpoint matching the values given,
+ * returns G_ERROR_UNAUTHORIZED and the number of seconds to wait if one of them is empty
+ */
+int glewlwyd_rate_limit_check(struct config_elements * config, const char * endpoint, const char * ip_source, const char * username, const char * client_id, unsigned int * retry_after) {
+  json_t * j_limits = json_object_get(config->j_rate_limit, endpoint);
+  const char * values[] = {ip_source, username, client_id};
+  int ret = G_OK, i;
+
+  for (i=0; j_limits != NULL && rate_limit_types[i] != NULL && ret == G_OK; i++) {
+    if (!o_strnullempty(values[i]) && json_object_get(j_limits, rate_limit_types[i]) != NULL) {
+      if ((ret = rate_limit_take(config, endpoint, rate_limit_types[i], values[i], json_object_get(j_limits, rate_limit_types[i]), retry_after)) == G_ERROR_UNAUTHORIZED) {
+        y_log_message(Y_LOG_LEVEL_WARNING, "Security - Rate limit reached on endpoint %s for %s %s at IP Address %s", endpoint, rate_limit_types[i], values[i], ip_source);
+        rate_limit_increment_throttled(config, endpoint, rate_limit_types[i]);
+      } else if (ret != G_OK) {
+        // Don't block the request if the limiter itself fails
+        ret = G_OK;
+        break;
+      }
+    }
+  }
+  return ret;
+}
+
+void glewlwyd_rate_limit_set_response(struct _u_response * response, unsigned int retry_after) {
+  char * str_retry_after = msprintf("%u", retry_after?retry_after:1);
+
+  u_map_put(response->map_header, "Retry-After", str_retry_after);
+  o_free(str_retry_after);
+  response->status = 429;
+}
+
+/**
+ * If the endpoint has limits, replaces the callback with a wrapper
+ * that checks the buckets before the endpoint callback does any database or crypto work
+ * Wrappers are kept until the server stops because a removed endpoint
+ * may still be running requests
+ */
+int glewlwyd_rate_limit_wrap_callback(struct config_elements * config, const char * endpoint, int (** callback)(const struct _u_request * request, struct _u_response * response, void * user_data), void ** user_data) {
+  struct _glwd_rate_limit_endpoint * rate_limit_endpoint;
+  char * name = rate_limit_endpoint_name(endpoint);
+  int ret;
+
+  if (json_object_get(config->j_rate_limit, name) == NULL) {
+    o_free(name);
+    ret = G_OK;
+  } else if ((rate_limit_endpoint = o_malloc(sizeof(struct _glwd_rate_limit_endpoint))) != NULL) {
+    rate_limit_endpoint->config = config;
+    rate_limit_endpoint->name = name;
+    rate_limit_endpoint->callback = *callback;
+    rate_limit_endpoint->user_data = *user_data;
+    pthread_mutex_lock(&config->admission_endpoint_lock);
+    pointer_list_append(&config->rate_limit_endpoint_list, rate_limit_endpoint);
+    pthread_mutex_unlock(&config->admission_endpoint_lock);
+    *callback = &callback_glewlwyd_rate_limit;
+    *user_data = rate_limit_endpoint;
+    ret = G_OK;
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "glewlwyd_rate_limit_wrap_callback - Error allocating resources for rate_limit_endpoint");
+    o_free(name);
+    ret = G_ERROR_MEMORY;
+  }
+  return ret;
+}
+
+/**
+ * Appends the throttled requests counters to the prometheus metrics content
+ */
+char * glewlwyd_rate_limit_metrics(struct config_elements * config, char * content) {
+  json_t * j_counter;
+  const char * label;
+
+  content = mstrcatf(content, "# HELP glewlwyd_rate_limit_throttled_total Total number of requests throttled by rate limit\n");
+  content = mstrcatf(content, "# TYPE glewlwyd_rate_limit_throttled_total counter\n");
+  if (!pthread_mutex_lock(&config->rate_limit_metrics_lock)) {
+    json_object_foreach(config->j_rate_limit_throttled, label, j_counter) {
+      content = mstrcatf(content, "glewlwyd_rate_limit_throttled_total{%s} %" JSON_INTEGER_FORMAT "\n", label, json_integer_value(j_counter));
+    }
+    pthread_mutex_unlock(&config->rate_limit_metrics_lock);
+  }
+  return content;
+}
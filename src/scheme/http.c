@@ -31,6 +31,16 @@
 #include <orcania.h>
 #include "glewlwyd-common.h"
 
+struct _http_config {
+  json_t                      * j_params;
+  struct _glwd_credential_cache credential_cache;
+};
+
+static void credential_cache_invalidate(const char * cache, const char * key, void * cls) {
+  UNUSED(cache);
+  glewlwyd_credential_cache_remove(&((struct _http_config *)cls)->credential_cache, key);
+}
+
 /**
  *
  * Note on the user auth scheme module
@@ -183,9 +193,9 @@ int user_auth_scheme_module_unload(struct config_module * config) {
  *
  */
 json_t * user_auth_scheme_module_init(struct config_module * config, json_t * j_parameters, const char * mod_name, void ** cls) {
-  UNUSED(config);
   UNUSED(mod_name);
   json_t * j_return = NULL;
+  struct _http_config * http_config;
   int ret;
 
   if (json_is_object(j_parameters)) {
@@ -201,6 +211,14 @@ json_t * user_auth_scheme_module_init(struct config_module * config, json_t * j_
       y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_init http - parameter username-format is optional and must contain a property name, e.g. {username}");
       j_return = json_pack("{sis[s]}", "result", G_ERROR_PARAM, "error", "parameter username-format is optional and must contain a property name, e.g. {username}");
       ret = G_ERROR_PARAM;
+    } else if (json_object_get(j_parameters, "credential-cache-duration") != NULL && (!json_is_integer(json_object_get(j_parameters, "credential-cache-duration")) || json_integer_value(json_object_get(j_parameters, "credential-cache-duration")) < 0)) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_init http - parameter credential-cache-duration is optional and must be a positive integer or 0");
+      j_return = json_pack("{sis[s]}", "result", G_ERROR_PARAM, "error", "parameter credential-cache-duration is optional and must be a positive integer or 0");
+      ret = G_ERROR_PARAM;
+    } else if (json_object_get(j_parameters, "credential-cache-max-size") != NULL && (!json_is_integer(json_object_get(j_parameters, "credential-cache-max-size")) || json_integer_value(json_object_get(j_parameters, "credential-cache-max-size")) <= 0)) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_init http - parameter credential-cache-max-size is optional and must be a positive integer");
+      j_return = json_pack("{sis[s]}", "result", G_ERROR_PARAM, "error", "parameter credential-cache-max-size is optional and must be a positive integer");
+      ret = G_ERROR_PARAM;
     }
     if (ret == G_OK) {
       j_return = json_pack("{si}", "result", G_OK);
@@ -211,7 +229,25 @@ json_t * user_auth_scheme_module_init(struct config_module * config, json_t * j_
     j_return = json_pack("{sis[s]}", "result", G_ERROR_PARAM, "error", "parameters must be a JSON object");
   }
   if (ret == G_OK) {
-    *cls = json_incref(j_parameters);
+    if ((http_config = o_malloc(sizeof(struct _http_config))) != NULL) {
+      http_config->j_params = json_incref(j_parameters);
+      if (glewlwyd_credential_cache_init(&http_config->credential_cache, (time_t)json_integer_value(json_object_get(j_parameters, "credential-cache-duration")), json_object_get(j_parameters, "credential-cache-max-size")!=NULL?(size_t)json_integer_value(json_object_get(j_parameters, "credential-cache-max-size")):GLEWLWYD_CREDENTIAL_CACHE_MAX_SIZE) == G_OK) {
+        if (http_config->credential_cache.duration) {
+          config->glewlwyd_module_callback_cache_invalidation_register(config, GLEWLWYD_CACHE_USER, &credential_cache_invalidate, http_config);
+        }
+        *cls = http_config;
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_init http - Error glewlwyd_credential_cache_init");
+        json_decref(http_config->j_params);
+        o_free(http_config);
+        json_decref(j_return);
+        j_return = json_pack("{si}", "result", G_ERROR);
+      }
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_init http - Error allocating resources for http_config");
+      json_decref(j_return);
+      j_return = json_pack("{si}", "result", G_ERROR_MEMORY);
+    }
   }
   return j_return;
 }
@@ -232,8 +268,14 @@ json_t * user_auth_scheme_module_init(struct config_module * config, json_t * j_
  *
  */
 int user_auth_scheme_module_close(struct config_module * config, void * cls) {
-  UNUSED(config);
-  json_decref((json_t *)cls);
+  struct _http_config * http_config = (struct _http_config *)cls;
+
+  if (http_config->credential_cache.duration) {
+    config->glewlwyd_module_callback_cache_invalidation_unregister(config, GLEWLWYD_CACHE_USER, http_config);
+  }
+  glewlwyd_credential_cache_close(&http_config->credential_cache);
+  json_decref(http_config->j_params);
+  o_free(http_config);
   return G_OK;
 }
 
@@ -399,25 +441,27 @@ json_t * user_auth_scheme_module_trigger(struct config_module * config, const st
  *
  */
 int user_auth_scheme_module_validate(struct config_module * config, const struct _u_request * http_request, const char * username, json_t * j_scheme_data, void * cls) {
-  UNUSED(config);
   UNUSED(http_request);
+  struct _http_config * http_config = (struct _http_config *)cls;
   struct _u_request request;
   struct _u_response response;
   int res, ret;
   json_t * j_user = NULL;
 
-  if (!json_string_null_or_empty(json_object_get(j_scheme_data, "password"))) {
+  if (glewlwyd_credential_cache_check(&http_config->credential_cache, username, json_string_value(json_object_get(j_scheme_data, "password"))) == G_OK) {
+    ret = G_OK;
+  } else if (!json_string_null_or_empty(json_object_get(j_scheme_data, "password"))) {
     ulfius_init_request(&request);
     ulfius_init_response(&response);
     request.http_verb = o_strdup("GET");
-    request.http_url = o_strdup(json_string_value(json_object_get((json_t *)cls, "url")));
-    if (json_object_get((json_t *)cls, "check-server-certificate") == json_false()) {
+    request.http_url = o_strdup(json_string_value(json_object_get(http_config->j_params, "url")));
+    if (json_object_get(http_config->j_params, "check-server-certificate") == json_false()) {
       request.check_server_certificate = 0;
     }
-    if (!json_string_null_or_empty(json_object_get((json_t *)cls, "username-format"))) {
+    if (!json_string_null_or_empty(json_object_get(http_config->j_params, "username-format"))) {
       j_user = config->glewlwyd_module_callback_get_user(config, username);
       if (check_result_value(j_user, G_OK)) {
-        request.auth_basic_user = format_auth_basic_user(json_string_value(json_object_get((json_t *)cls, "username-format")), json_object_get(j_user, "user"));
+        request.auth_basic_user = format_auth_basic_user(json_string_value(json_object_get(http_config->j_params, "username-format")), json_object_get(j_user, "user"));
       } else {
         y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_validate http - Error glewlwyd_module_callback_get_user for username %s", username);
       }
@@ -428,18 +472,20 @@ int user_auth_scheme_module_validate(struct config_module * config, const struct
     request.auth_basic_password = o_strdup(json_string_value(json_object_get(j_scheme_data, "password")));
 
     if (request.auth_basic_user != NULL && request.auth_basic_password != NULL) {
-      res = ulfius_send_http_request(&request, &response);
-      if (res == H_OK) {
+      res = config->glewlwyd_module_callback_http_send_request(config, &request, &response);
+      if (res == G_OK) {
         if (response.status == 200) {
+          glewlwyd_credential_cache_set(&http_config->credential_cache, username, request.auth_basic_password);
           ret = G_OK;
         } else {
+          glewlwyd_credential_cache_remove(&http_config->credential_cache, username);
           if (response.status != 401 && response.status != 403) {
             y_log_message(Y_LOG_LEVEL_WARNING, "user_auth_scheme_module_validate http - Error connecting to webservice %s, response status is %d", request.http_url, response.status);
           }
           ret = G_ERROR_UNAUTHORIZED;
         }
       } else {
-        y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_validate http - Error ulfius_send_http_request");
+        y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_validate http - Error glewlwyd_module_callback_http_send_request");
         ret = G_ERROR_UNAUTHORIZED;
       }
     } else {
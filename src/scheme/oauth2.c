@@ -39,6 +39,8 @@
 #define GLEWLWYD_SCHEME_OAUTH2_STATE_ID_LENGTH              32
 #define GLEWLWYD_SCHEME_OAUTH2_NONCE_LENGTH                 16
 #define GLEWLWYD_SCHEME_OAUTH2_SERVER_JWKS_CACHE_EXPIRATION 86400
+#define GLEWLWYD_SCHEME_OAUTH2_PROVIDER_CONFIG_EXPIRATION   3600
+#define GLEWLWYD_SCHEME_OAUTH2_PROVIDER_CONFIG_RETRY        60
 #define GLEWLWYD_SCHEME_OAUTH2_STATE_REGISTRATION           "registration"
 #define GLEWLWYD_SCHEME_OAUTH2_STATE_AUTHENTICATION         "authentication"
 
@@ -47,9 +49,28 @@
 #define GLEWLWYD_SCHEME_OAUTH2_SESSION_VERIFIED       2
 #define GLEWLWYD_SCHEME_OAUTH2_SESSION_CANCELLED      3
 
+/**
+ * Shared context of a provider
+ * j_export is the iddawc session template imported by every new session,
+ * it contains the discovery document and the JWKS if the provider has a config_endpoint
+ * The expired template is rebuilt by refresh_thread while the requests keep using the current one
+ */
+struct _oauth2_provider {
+  json_t          * j_provider;
+  json_t          * j_export;
+  char            * redirect_uri;
+  time_t            expiration;
+  time_t            refresh_at; // 0 if the template never expires
+  int               refreshing;
+  int               refresh_thread_joinable;
+  pthread_t         refresh_thread;
+  pthread_mutex_t   lock;
+};
+
 struct _oauth2_config {
-  pthread_mutex_t insert_lock;
-  json_t * j_parameters;
+  pthread_mutex_t      insert_lock;
+  json_t             * j_parameters;
+  struct _pointer_list provider_list;
 };
 
 static int get_response_type(const char * str_type) {
@@ -79,6 +100,9 @@ static json_t * is_scheme_parameters_valid(json_t * j_params) {
       if (json_integer_value(json_object_get(j_params, "session_expiration")) <= 0) {
         json_array_append_new(j_errors, json_string("session_expiration is mandatory and must be a non null positive integer"));
       }
+      if (json_object_get(j_params, "provider_config_expiration") != NULL && json_integer_value(json_object_get(j_params, "provider_config_expiration")) <= 0) {
+        json_array_append_new(j_errors, json_string("provider_config_expiration is optional and must be a non null positive integer"));
+      }
       if (!json_is_array(json_object_get(j_params, "provider_list"))) {
         json_array_append_new(j_errors, json_string("provider_list is mandatory and must be a JSON array"));
       } else {
@@ -1074,13 +1098,179 @@ static int complete_session_for_user(struct config_module * config, const char *
   return ret;
 }
 
-static json_t * get_provider(struct _oauth2_config * oauth2_config, const char * provider_name) {
-  json_t * j_element = NULL, * j_return = NULL;
+/**
+ * Builds the iddawc session template of a provider
+ * The discovery document and the JWKS are fetched if the provider has a config_endpoint
+ */
+static int build_provider_export(json_t * j_provider, const char * redirect_uri, json_t ** j_export) {
+  struct _i_session i_session;
+  json_t * j_param = NULL;
   size_t index = 0;
+  int ret, is_oidc = o_strcmp("oauth2", json_string_value(json_object_get(j_provider, "provider_type")));
+
+  *j_export = NULL;
+  if (i_init_session(&i_session) == I_OK) {
+    json_array_foreach(json_object_get(j_provider, "additional_parameters"), index, j_param) {
+      i_set_additional_parameter(&i_session, json_string_value(json_object_get(j_param, "key")), json_string_value(json_object_get(j_param, "value")));
+    }
+    if (!json_string_null_or_empty(json_object_get(j_provider, "config_endpoint"))) {
+      if (i_set_parameter_list(&i_session, I_OPT_RESPONSE_TYPE, get_response_type(json_string_value(json_object_get(j_provider, "response_type"))),
+                                           I_OPT_OPENID_CONFIG_ENDPOINT, json_string_value(json_object_get(j_provider, "config_endpoint")),
+                                           I_OPT_CLIENT_ID, json_string_value(json_object_get(j_provider, "client_id")),
+                                           I_OPT_CLIENT_SECRET, json_string_value(json_object_get(j_provider, "client_secret")),
+                                           I_OPT_REDIRECT_URI, redirect_uri,
+                                           I_OPT_SCOPE, is_oidc?"openid":json_string_value(json_object_get(j_provider, "scope")),
+                                           I_OPT_TOKEN_METHOD, I_TOKEN_AUTH_METHOD_SECRET_BASIC,
+                                           I_OPT_SERVER_JWKS_CACHE_EXPIRATION, GLEWLWYD_SCHEME_OAUTH2_SERVER_JWKS_CACHE_EXPIRATION,
+                                           I_OPT_NONE) != I_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "build_provider_export oauth2 - Error setting parameters for provider %s", json_string_value(json_object_get(j_provider, "name")));
+        ret = G_ERROR_PARAM;
+      } else if (i_get_openid_config(&i_session) != I_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "build_provider_export oauth2 - Error loading openid-configuration for provider %s", json_string_value(json_object_get(j_provider, "name")));
+        ret = G_ERROR;
+      } else {
+        // Overwrite endpoints if specified
+        if (json_object_get(j_provider, "auth_endpoint") != NULL) {
+          i_set_str_parameter(&i_session, I_OPT_AUTH_ENDPOINT, json_string_value(json_object_get(j_provider, "auth_endpoint")));
+        }
+        if (json_object_get(j_provider, "token_endpoint") != NULL) {
+          i_set_str_parameter(&i_session, I_OPT_TOKEN_ENDPOINT, json_string_value(json_object_get(j_provider, "token_endpoint")));
+        }
+        if (json_object_get(j_provider, "userinfo_endpoint") != NULL) {
+          i_set_str_parameter(&i_session, I_OPT_USERINFO_ENDPOINT, json_string_value(json_object_get(j_provider, "userinfo_endpoint")));
+        }
+        ret = G_OK;
+      }
+    } else {
+      if (i_set_parameter_list(&i_session, I_OPT_RESPONSE_TYPE, get_response_type(json_string_value(json_object_get(j_provider, "response_type"))),
+                                           I_OPT_AUTH_ENDPOINT, json_string_value(json_object_get(j_provider, "auth_endpoint")),
+                                           I_OPT_TOKEN_ENDPOINT, json_string_value(json_object_get(j_provider, "token_endpoint")),
+                                           I_OPT_USERINFO_ENDPOINT, json_string_value(json_object_get(j_provider, "userinfo_endpoint")),
+                                           I_OPT_CLIENT_ID, json_string_value(json_object_get(j_provider, "client_id")),
+                                           I_OPT_CLIENT_SECRET, json_string_value(json_object_get(j_provider, "client_secret")),
+                                           I_OPT_REDIRECT_URI, redirect_uri,
+                                           I_OPT_SCOPE, is_oidc?"openid":json_string_value(json_object_get(j_provider, "scope")),
+                                           I_OPT_TOKEN_METHOD, I_TOKEN_AUTH_METHOD_SECRET_BASIC,
+                                           I_OPT_SERVER_JWKS_CACHE_EXPIRATION, GLEWLWYD_SCHEME_OAUTH2_SERVER_JWKS_CACHE_EXPIRATION,
+                                           I_OPT_NONE) != I_OK) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "build_provider_export oauth2 - Error setting parameters for provider %s", json_string_value(json_object_get(j_provider, "name")));
+        ret = G_ERROR_PARAM;
+      } else {
+        ret = G_OK;
+      }
+    }
+    if (ret == G_OK && (*j_export = i_export_session_json_t(&i_session)) == NULL) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "build_provider_export oauth2 - Error exporting session for provider %s", json_string_value(json_object_get(j_provider, "name")));
+      ret = G_ERROR;
+    }
+    i_clean_session(&i_session);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "build_provider_export oauth2 - Error i_init_session");
+    ret = G_ERROR;
+  }
+  return ret;
+}
 
-  json_array_foreach(json_object_get(oauth2_config->j_parameters, "provider_list"), index, j_element) {
-    if (j_return == NULL && 0 == o_strcmp(json_string_value(json_object_get(j_element, "name")), provider_name) && json_object_get(j_element, "enabled") != json_false()) {
-      j_return = json_pack("{sisO}", "result", G_OK, "provider", j_element);
+/**
+ * The refresh thread is joined before the provider is released,
+ * so a module reload waits for a rebuild in progress
+ */
+static void free_provider(void * data) {
+  struct _oauth2_provider * provider = (struct _oauth2_provider *)data;
+  if (provider != NULL) {
+    if (provider->refresh_thread_joinable) {
+      pthread_join(provider->refresh_thread, NULL);
+    }
+    json_decref(provider->j_provider);
+    json_decref(provider->j_export);
+    o_free(provider->redirect_uri);
+    pthread_mutex_destroy(&provider->lock);
+    o_free(provider);
+  }
+}
+
+/**
+ * Rebuilds the session template, the discovery document and the JWKS are fetched
+ * outside of the request threads
+ * The current template is kept if the rebuild fails, and the rebuild is tried again later
+ */
+static void * refresh_provider_export_thread(void * args) {
+  struct _oauth2_provider * provider = (struct _oauth2_provider *)args;
+  json_t * j_new_export = NULL;
+  time_t now;
+
+  if (build_provider_export(provider->j_provider, provider->redirect_uri, &j_new_export) != G_OK) {
+    y_log_message(Y_LOG_LEVEL_WARNING, "refresh_provider_export_thread oauth2 - Error refreshing provider %s, keep the current configuration", json_string_value(json_object_get(provider->j_provider, "name")));
+  }
+  time(&now);
+  if (!pthread_mutex_lock(&provider->lock)) {
+    if (j_new_export != NULL) {
+      json_decref(provider->j_export);
+      provider->j_export = j_new_export;
+      provider->refresh_at = now + provider->expiration;
+    } else {
+      provider->refresh_at = now + MIN(provider->expiration, GLEWLWYD_SCHEME_OAUTH2_PROVIDER_CONFIG_RETRY);
+    }
+    provider->refreshing = 0;
+    pthread_mutex_unlock(&provider->lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "refresh_provider_export_thread oauth2 - Error pthread_mutex_lock");
+    json_decref(j_new_export);
+  }
+  return NULL;
+}
+
+/**
+ * Returns the session template of the provider
+ * When the template has expired, the first caller starts its rebuild in the background,
+ * every caller gets the current template without waiting for the provider
+ */
+static json_t * get_provider_export(struct _oauth2_provider * provider) {
+  json_t * j_export = NULL;
+  time_t now;
+
+  time(&now);
+  if (!pthread_mutex_lock(&provider->lock)) {
+    if (provider->refresh_at && provider->refresh_at <= now && !provider->refreshing) {
+      // The previous refresh thread is complete since refreshing is unset
+      if (provider->refresh_thread_joinable) {
+        pthread_join(provider->refresh_thread, NULL);
+        provider->refresh_thread_joinable = 0;
+      }
+      provider->refreshing = 1;
+      if (!pthread_create(&provider->refresh_thread, NULL, &refresh_provider_export_thread, (void *)provider)) {
+        provider->refresh_thread_joinable = 1;
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "get_provider_export oauth2 - Error pthread_create");
+        provider->refresh_at = now + MIN(provider->expiration, GLEWLWYD_SCHEME_OAUTH2_PROVIDER_CONFIG_RETRY);
+        provider->refreshing = 0;
+      }
+    }
+    j_export = json_incref(provider->j_export);
+    pthread_mutex_unlock(&provider->lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "get_provider_export oauth2 - Error pthread_mutex_lock");
+  }
+  return j_export;
+}
+
+static json_t * get_provider(struct _oauth2_config * oauth2_config, const char * provider_name) {
+  struct _oauth2_provider * provider;
+  json_t * j_provider, * j_export, * j_return = NULL;
+  size_t i;
+
+  for (i=0; j_return == NULL && i<pointer_list_size(&oauth2_config->provider_list); i++) {
+    provider = (struct _oauth2_provider *)pointer_list_get_at(&oauth2_config->provider_list, i);
+    if (0 == o_strcmp(json_string_value(json_object_get(provider->j_provider, "name")), provider_name)) {
+      if ((j_export = get_provider_export(provider)) != NULL && (j_provider = json_copy(provider->j_provider)) != NULL) {
+        json_object_set(j_provider, "export", j_export);
+        j_return = json_pack("{sisO}", "result", G_OK, "provider", j_provider);
+        json_decref(j_provider);
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "get_provider oauth2 - Error getting provider %s", provider_name);
+        j_return = json_pack("{si}", "result", G_ERROR);
+      }
+      json_decref(j_export);
     }
   }
   if (j_return == NULL) {
@@ -1182,85 +1372,51 @@ int user_auth_scheme_module_unload(struct config_module * config) {
  */
 json_t * user_auth_scheme_module_init(struct config_module * config, json_t * j_parameters, const char * mod_name, void ** cls) {
   UNUSED(config);
-  UNUSED(mod_name);
-  UNUSED(config);
-  json_t * j_result, * j_return, * j_element = NULL, * j_export = NULL, * j_param;
+  json_t * j_result, * j_return, * j_element = NULL, * j_export = NULL;
   char * str_error;
-  size_t index = 0, indexParam = 0;
-  struct _i_session i_session;
+  size_t index = 0;
+  struct _oauth2_provider * provider;
   pthread_mutexattr_t mutexattr;
-  int is_oidc;
+  time_t now;
 
   j_result = is_scheme_parameters_valid(j_parameters);
   if (check_result_value(j_result, G_OK)) {
     *cls = o_malloc(sizeof(struct _oauth2_config));
     if (*cls != NULL) {
       ((struct _oauth2_config *)*cls)->j_parameters = json_pack("{sssOsOs[]}", "name", mod_name, "redirect_uri", json_object_get(j_parameters, "redirect_uri"), "session_expiration", json_object_get(j_parameters, "session_expiration"), "provider_list");
+      pointer_list_init(&((struct _oauth2_config *)*cls)->provider_list);
       pthread_mutexattr_init ( &mutexattr );
       pthread_mutexattr_settype( &mutexattr, PTHREAD_MUTEX_RECURSIVE );
       if (!pthread_mutex_init(&((struct _oauth2_config *)*cls)->insert_lock, &mutexattr)) {
+        time(&now);
         json_array_foreach(json_object_get(j_parameters, "provider_list"), index, j_element) {
           if (json_object_get(j_element, "enabled") != json_false()) {
-            is_oidc = o_strcmp("oauth2", json_string_value(json_object_get(j_element, "provider_type")));
-            if (i_init_session(&i_session) == I_OK) {
-              json_array_foreach(json_object_get(j_element, "additional_parameters"), indexParam, j_param) {
-                i_set_additional_parameter(&i_session, json_string_value(json_object_get(j_param, "key")), json_string_value(json_object_get(j_param, "value")));
-              }
-              if (!json_string_null_or_empty(json_object_get(j_element, "config_endpoint"))) {
-                if (i_set_parameter_list(&i_session, I_OPT_RESPONSE_TYPE, get_response_type(json_string_value(json_object_get(j_element, "response_type"))),
-                                                                      I_OPT_OPENID_CONFIG_ENDPOINT, json_string_value(json_object_get(j_element, "config_endpoint")),
-                                                                      I_OPT_CLIENT_ID, json_string_value(json_object_get(j_element, "client_id")),
-                                                                      I_OPT_CLIENT_SECRET, json_string_value(json_object_get(j_element, "client_secret")),
-                                                                      I_OPT_REDIRECT_URI, json_string_value(json_object_get(j_parameters, "redirect_uri")),
-                                                                      I_OPT_SCOPE, is_oidc?"openid":json_string_value(json_object_get(j_element, "scope")),
-                                                                      I_OPT_TOKEN_METHOD, I_TOKEN_AUTH_METHOD_SECRET_BASIC,
-                                                                      I_OPT_SERVER_JWKS_CACHE_EXPIRATION, GLEWLWYD_SCHEME_OAUTH2_SERVER_JWKS_CACHE_EXPIRATION,
-                                                                      I_OPT_NONE) != I_OK) {
-                  y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_init oauth2 - Error setting parameters for provider %s", json_string_value(json_object_get(j_element, "name")));
-                } else if (i_get_openid_config(&i_session) != I_OK) {
-                  y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_init oauth2 - Error loading openid-configuration for provider %s", json_string_value(json_object_get(j_element, "name")));
-                } else if ((j_export = i_export_session_json_t(&i_session)) == NULL) {
-                  y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_init oauth2 - Error exporting session for provider %s", json_string_value(json_object_get(j_element, "name")));
-                } else {
-                  // Overwrite endpoints if specified
-                  if (json_object_get(j_element, "auth_endpoint") != NULL) {
-                    i_set_str_parameter(&i_session, I_OPT_AUTH_ENDPOINT, json_string_value(json_object_get(j_element, "auth_endpoint")));
-                  }
-                  if (json_object_get(j_element, "token_endpoint") != NULL) {
-                    i_set_str_parameter(&i_session, I_OPT_TOKEN_ENDPOINT, json_string_value(json_object_get(j_element, "token_endpoint")));
-                  }
-                  if (json_object_get(j_element, "userinfo_endpoint") != NULL) {
-                    i_set_str_parameter(&i_session, I_OPT_USERINFO_ENDPOINT, json_string_value(json_object_get(j_element, "userinfo_endpoint")));
+            if (build_provider_export(j_element, json_string_value(json_object_get(j_parameters, "redirect_uri")), &j_export) == G_OK) {
+              if ((provider = o_malloc(sizeof(struct _oauth2_provider))) != NULL) {
+                if (!pthread_mutex_init(&provider->lock, NULL)) {
+                  provider->j_provider = json_incref(j_element);
+                  provider->j_export = json_incref(j_export);
+                  provider->redirect_uri = o_strdup(json_string_value(json_object_get(j_parameters, "redirect_uri")));
+                  provider->expiration = json_integer_value(json_object_get(j_parameters, "provider_config_expiration"))?(time_t)json_integer_value(json_object_get(j_parameters, "provider_config_expiration")):GLEWLWYD_SCHEME_OAUTH2_PROVIDER_CONFIG_EXPIRATION;
+                  provider->refresh_at = !json_string_null_or_empty(json_object_get(j_element, "config_endpoint"))?(now + provider->expiration):0;
+                  provider->refreshing = 0;
+                  provider->refresh_thread_joinable = 0;
+                  if (pointer_list_append(&((struct _oauth2_config *)*cls)->provider_list, provider)) {
+                    json_array_append(json_object_get(((struct _oauth2_config *)*cls)->j_parameters, "provider_list"), j_element);
+                  } else {
+                    y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_init oauth2 - Error pointer_list_append for provider %s", json_string_value(json_object_get(j_element, "name")));
+                    free_provider(provider);
                   }
-                  json_object_set(j_element, "export", j_export);
-                  json_array_append(json_object_get(((struct _oauth2_config *)*cls)->j_parameters, "provider_list"), j_element);
-                }
-                json_decref(j_export);
-              } else {
-                if (i_set_parameter_list(&i_session, I_OPT_RESPONSE_TYPE, get_response_type(json_string_value(json_object_get(j_element, "response_type"))),
-                                                                      I_OPT_AUTH_ENDPOINT, json_string_value(json_object_get(j_element, "auth_endpoint")),
-                                                                      I_OPT_TOKEN_ENDPOINT, json_string_value(json_object_get(j_element, "token_endpoint")),
-                                                                      I_OPT_USERINFO_ENDPOINT, json_string_value(json_object_get(j_element, "userinfo_endpoint")),
-                                                                      I_OPT_CLIENT_ID, json_string_value(json_object_get(j_element, "client_id")),
-                                                                      I_OPT_CLIENT_SECRET, json_string_value(json_object_get(j_element, "client_secret")),
-                                                                      I_OPT_REDIRECT_URI, json_string_value(json_object_get(j_parameters, "redirect_uri")),
-                                                                      I_OPT_SCOPE, is_oidc?"openid":json_string_value(json_object_get(j_element, "scope")),
-                                                                      I_OPT_TOKEN_METHOD, I_TOKEN_AUTH_METHOD_SECRET_BASIC,
-                                                                      I_OPT_SERVER_JWKS_CACHE_EXPIRATION, GLEWLWYD_SCHEME_OAUTH2_SERVER_JWKS_CACHE_EXPIRATION,
-                                                                      I_OPT_NONE) != I_OK) {
-                  y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_init oauth2 - Error setting parameters for provider %s", json_string_value(json_object_get(j_element, "name")));
-                } else if ((j_export = i_export_session_json_t(&i_session)) == NULL) {
-                  y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_init oauth2 - Error exporting session for provider %s", json_string_value(json_object_get(j_element, "name")));
                 } else {
-                  json_object_set(j_element, "export", j_export);
-                  json_array_append(json_object_get(((struct _oauth2_config *)*cls)->j_parameters, "provider_list"), j_element);
+                  y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_init oauth2 - Error pthread_mutex_init for provider %s", json_string_value(json_object_get(j_element, "name")));
+                  o_free(provider);
                 }
-                json_decref(j_export);
+              } else {
+                y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_init oauth2 - Error allocating resources for provider %s", json_string_value(json_object_get(j_element, "name")));
               }
-              i_clean_session(&i_session);
-            } else {
-              y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_init oauth2 - Error i_init_session");
             }
+            json_decref(j_export);
+            j_export = NULL;
           }
         }
         j_return = json_pack("{si}", "result", G_OK);
@@ -1304,6 +1460,7 @@ json_t * user_auth_scheme_module_init(struct config_module * config, json_t * j_
 int user_auth_scheme_module_close(struct config_module * config, void * cls) {
   UNUSED(config);
   json_decref(((struct _oauth2_config *)cls)->j_parameters);
+  pointer_list_clean_free(&((struct _oauth2_config *)cls)->provider_list, &free_provider);
   pthread_mutex_destroy(&((struct _oauth2_config *)cls)->insert_lock);
   o_free(cls);
   return G_OK;
@@ -26,6 +26,7 @@
  */
 
 #include <string.h>
+#include <pthread.h>
 #include <gnutls/gnutls.h>
 #include <gnutls/crypto.h>
 #include <gnutls/abstract.h>
@@ -74,6 +75,27 @@ const char * iso_3166_list[] = {"AF", "AX", "AL", "DZ", "AS", "AD", "AO", "AI",
 
 #define SAFETYNET_ISSUED_TO "CN=attest.android.com"
 
+#define G_WEBAUTHN_PUBKEY_CACHE_SIZE 256
+
+/**
+ * Public key imported from a credential, shared by the assertions
+ * while it's in the cache or being verified
+ */
+struct _webauthn_pubkey {
+  json_int_t      gswc_id;
+  char          * credential_id;
+  gnutls_pubkey_t pubkey;
+  unsigned int    refcount;
+};
+
+struct _webauthn_config {
+  json_t                  * j_params;
+  pthread_mutex_t           pubkey_lock;
+  pthread_mutex_t           counter_lock;
+  struct _webauthn_pubkey * pubkey_cache[G_WEBAUTHN_PUBKEY_CACHE_SIZE];
+  size_t                    pubkey_cache_next;
+};
+
 static json_t * get_cert_from_file_path(const char * path) {
   gnutls_x509_crt_t cert = NULL;
   gnutls_datum_t cert_dat = {NULL, 0}, export_dat = {NULL, 0};
@@ -639,6 +661,95 @@ static json_t * get_credential_from_session(struct config_module * config, json_
   return j_return;
 }
 
+static void pubkey_free(struct _webauthn_pubkey * webauthn_pubkey) {
+  gnutls_pubkey_deinit(webauthn_pubkey->pubkey);
+  o_free(webauthn_pubkey->credential_id);
+  o_free(webauthn_pubkey);
+}
+
+static void pubkey_release(struct _webauthn_config * webauthn_config, struct _webauthn_pubkey * webauthn_pubkey) {
+  int do_free = 0;
+
+  if (webauthn_pubkey != NULL) {
+    pthread_mutex_lock(&webauthn_config->pubkey_lock);
+    do_free = !--webauthn_pubkey->refcount;
+    pthread_mutex_unlock(&webauthn_config->pubkey_lock);
+    if (do_free) {
+      pubkey_free(webauthn_pubkey);
+    }
+  }
+}
+
+/**
+ * Returns the public key of the credential, imported once and kept in the cache
+ * The cache entry is checked against gswc_id, so a credential id registered again
+ * never gets the public key of the previous registration
+ */
+static struct _webauthn_pubkey * pubkey_get(struct _webauthn_config * webauthn_config, json_int_t gswc_id, const char * credential_id, json_t * j_public_key) {
+  struct _webauthn_pubkey * webauthn_pubkey = NULL, * evicted;
+  gnutls_datum_t pubkey_dat;
+  size_t i;
+  int ret;
+
+  pthread_mutex_lock(&webauthn_config->pubkey_lock);
+  for (i=0; i<G_WEBAUTHN_PUBKEY_CACHE_SIZE; i++) {
+    if (webauthn_config->pubkey_cache[i] != NULL && webauthn_config->pubkey_cache[i]->gswc_id == gswc_id && 0 == o_strcmp(webauthn_config->pubkey_cache[i]->credential_id, credential_id)) {
+      webauthn_pubkey = webauthn_config->pubkey_cache[i];
+      webauthn_pubkey->refcount++;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&webauthn_config->pubkey_lock);
+
+  if (webauthn_pubkey == NULL) {
+    if ((webauthn_pubkey = o_malloc(sizeof(struct _webauthn_pubkey))) != NULL) {
+      if (gnutls_pubkey_init(&webauthn_pubkey->pubkey) >= 0) {
+        pubkey_dat.data = (unsigned char *)json_string_value(j_public_key);
+        pubkey_dat.size = json_string_length(j_public_key);
+        if ((ret = gnutls_pubkey_import(webauthn_pubkey->pubkey, &pubkey_dat, GNUTLS_X509_FMT_PEM)) >= 0) {
+          webauthn_pubkey->gswc_id = gswc_id;
+          webauthn_pubkey->credential_id = o_strdup(credential_id);
+          webauthn_pubkey->refcount = 2;
+          pthread_mutex_lock(&webauthn_config->pubkey_lock);
+          evicted = webauthn_config->pubkey_cache[webauthn_config->pubkey_cache_next];
+          webauthn_config->pubkey_cache[webauthn_config->pubkey_cache_next] = webauthn_pubkey;
+          webauthn_config->pubkey_cache_next = (webauthn_config->pubkey_cache_next+1)%G_WEBAUTHN_PUBKEY_CACHE_SIZE;
+          pthread_mutex_unlock(&webauthn_config->pubkey_lock);
+          pubkey_release(webauthn_config, evicted);
+        } else {
+          y_log_message(Y_LOG_LEVEL_DEBUG, "pubkey_get - Error gnutls_pubkey_import: %d", ret);
+          gnutls_pubkey_deinit(webauthn_pubkey->pubkey);
+          o_free(webauthn_pubkey);
+          webauthn_pubkey = NULL;
+        }
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "pubkey_get - Error gnutls_pubkey_init");
+        o_free(webauthn_pubkey);
+        webauthn_pubkey = NULL;
+      }
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "pubkey_get - Error allocating resources for webauthn_pubkey");
+    }
+  }
+  return webauthn_pubkey;
+}
+
+static void pubkey_remove(struct _webauthn_config * webauthn_config, const char * credential_id) {
+  struct _webauthn_pubkey * removed;
+  size_t i;
+
+  for (i=0; i<G_WEBAUTHN_PUBKEY_CACHE_SIZE; i++) {
+    removed = NULL;
+    pthread_mutex_lock(&webauthn_config->pubkey_lock);
+    if (webauthn_config->pubkey_cache[i] != NULL && 0 == o_strcmp(webauthn_config->pubkey_cache[i]->credential_id, credential_id)) {
+      removed = webauthn_config->pubkey_cache[i];
+      webauthn_config->pubkey_cache[i] = NULL;
+    }
+    pthread_mutex_unlock(&webauthn_config->pubkey_lock);
+    pubkey_release(webauthn_config, removed);
+  }
+}
+
 static json_t * get_credential(struct config_module * config, json_t * j_params, const char * username, const char * credential_id) {
   json_t * j_query, * j_result, * j_return;
   char * username_escaped, * mod_name_escaped, * username_clause;
@@ -687,13 +798,13 @@ static json_t * get_credential(struct config_module * config, json_t * j_params,
   return j_return;
 }
 
-static int update_credential(struct config_module * config, json_t * j_params, const char * username, const char * credential_id, int status) {
+static int update_credential(struct config_module * config, struct _webauthn_config * webauthn_config, const char * username, const char * credential_id, int status) {
   json_t * j_query;
   char * username_escaped, * mod_name_escaped, * username_clause;
   int res, ret;
 
   username_escaped = h_escape_string_with_quotes(config->conn, username);
-  mod_name_escaped = h_escape_string_with_quotes(config->conn, json_string_value(json_object_get(j_params, "mod_name")));
+  mod_name_escaped = h_escape_string_with_quotes(config->conn, json_string_value(json_object_get(webauthn_config->j_params, "mod_name")));
   username_clause = msprintf(" = (SELECT gswu_id FROM "G_TABLE_WEBAUTHN_USER" WHERE UPPER(gswu_username) = UPPER(%s) AND gswu_mod_name = %s)", username_escaped, mod_name_escaped);
   j_query = json_pack("{sss{si}s{sss{ssss}}}",
                       "table",
@@ -715,6 +826,9 @@ static int update_credential(struct config_module * config, json_t * j_params, c
   res = h_update(config->conn, j_query, NULL);
   json_decref(j_query);
   if (res == H_OK) {
+    if (status != 1) {
+      pubkey_remove(webauthn_config, credential_id);
+    }
     ret = G_OK;
   } else {
     y_log_message(Y_LOG_LEVEL_ERROR, "get_credential - Error executing j_query");
@@ -2463,19 +2577,80 @@ static json_t * register_new_attestation(struct config_module * config, json_t *
   return j_return;
 }
 
+/**
+ * Stores the new signature counter of a credential if it's greater than the stored one
+ * The update and the check are done on the database, so concurrent assertions with
+ * the same counter value can't both succeed
+ * Returns G_OK if the counter was updated, G_ERROR_UNAUTHORIZED if the counter was
+ * already greater or equal, i.e. the assertion is a replay
+ */
+static int update_credential_counter(struct config_module * config, struct _webauthn_config * webauthn_config, json_int_t gswc_id, size_t counter_value) {
+  json_t * j_result = NULL;
+  int res, ret;
+  char * query;
+
+  if (config->conn->type==HOEL_DB_TYPE_MARIADB) {
+    // MariaDB has no UPDATE ... RETURNING and hoel doesn't return the number of updated rows,
+    // so the update sets a session variable on the updated row only
+    // The mutex keeps the variable for the duration of the check, the credential id
+    // in the variable name is unique across the instances sharing the connection
+    if (!pthread_mutex_lock(&webauthn_config->counter_lock)) {
+      query = msprintf("SET @glwd_webauthn_counter_%" JSON_INTEGER_FORMAT "=NULL", gswc_id);
+      res = h_execute_query(config->conn, query, NULL, H_OPTION_EXEC);
+      o_free(query);
+      if (res == H_OK) {
+        query = msprintf("UPDATE " G_TABLE_WEBAUTHN_CREDENTIAL " SET gswc_counter=(@glwd_webauthn_counter_%" JSON_INTEGER_FORMAT ":=%zu) WHERE gswc_id=%" JSON_INTEGER_FORMAT " AND gswc_counter<%zu", gswc_id, counter_value, gswc_id, counter_value);
+        res = h_execute_query(config->conn, query, NULL, H_OPTION_EXEC);
+        o_free(query);
+      }
+      if (res == H_OK) {
+        query = msprintf("SELECT @glwd_webauthn_counter_%" JSON_INTEGER_FORMAT " AS updated", gswc_id);
+        res = h_execute_query_json(config->conn, query, &j_result);
+        o_free(query);
+      }
+      pthread_mutex_unlock(&webauthn_config->counter_lock);
+      if (res == H_OK) {
+        ret = json_is_integer(json_object_get(json_array_get(j_result, 0), "updated"))?G_OK:G_ERROR_UNAUTHORIZED;
+        json_decref(j_result);
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "update_credential_counter - Error executing query (mariadb)");
+        config->glewlwyd_module_callback_metrics_increment_counter(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+        ret = G_ERROR_DB;
+      }
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "update_credential_counter - Error pthread_mutex_lock");
+      ret = G_ERROR;
+    }
+  } else {
+    // Conditional update and check are done in a single statement, SQLite supports RETURNING since 3.35
+    query = msprintf("UPDATE " G_TABLE_WEBAUTHN_CREDENTIAL " SET gswc_counter=%zu WHERE gswc_id=%" JSON_INTEGER_FORMAT " AND gswc_counter<%zu RETURNING gswc_id", counter_value, gswc_id, counter_value);
+    res = h_execute_query_json(config->conn, query, &j_result);
+    o_free(query);
+    if (res == H_OK) {
+      ret = json_array_size(j_result)?G_OK:G_ERROR_UNAUTHORIZED;
+      json_decref(j_result);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "update_credential_counter - Error executing query");
+      config->glewlwyd_module_callback_metrics_increment_counter(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+      ret = G_ERROR_DB;
+    }
+  }
+  return ret;
+}
+
 /**
  *
  */
-static int check_assertion(struct config_module * config, json_t * j_params, const char * username, json_t * j_scheme_data, json_t * j_assertion) {
+static int check_assertion(struct config_module * config, struct _webauthn_config * webauthn_config, const char * username, json_t * j_scheme_data, json_t * j_assertion) {
   int ret, res;
   unsigned char * client_data = NULL, * challenge_b64 = NULL, * auth_data = NULL, rpid_hash[32] = {0}, * flags, cdata_hash[32] = {0},
                   data_signed[128] = {0}, * counter;
   char * challenge_hash = NULL;
   const char * rpid = NULL;
   size_t client_data_len, challenge_b64_len, auth_data_len, rpid_hash_len = 32, cdata_hash_len = 32, counter_value = 0, rpid_len = 0;
-  json_t * j_client_data = NULL, * j_credential = NULL, * j_query;
-  gnutls_pubkey_t pubkey = NULL;
-  gnutls_datum_t pubkey_dat, data, signature;
+  json_t * j_params = webauthn_config->j_params, * j_client_data = NULL, * j_credential = NULL, * j_query;
+  struct _webauthn_pubkey * webauthn_pubkey = NULL;
+  gnutls_datum_t data, signature;
   struct _o_datum dat = {0, NULL};
 
   if (j_scheme_data != NULL && j_assertion != NULL) {
@@ -2629,15 +2804,8 @@ static int check_assertion(struct config_module * config, json_t * j_params, con
       counter = auth_data + COUNTER_OFFSET;
       counter_value = counter[3] | (counter[2] << 8) | (counter[1] << 16) | (counter[0] << 24);
 
-      if (gnutls_pubkey_init(&pubkey) < 0) {
-        y_log_message(Y_LOG_LEVEL_ERROR, "check_assertion - Error gnutls_pubkey_init");
-        ret = G_ERROR;
-        break;
-      }
-      pubkey_dat.data = (unsigned char *)json_string_value(json_object_get(json_object_get(j_credential, "credential"), "public_key"));
-      pubkey_dat.size = json_string_length(json_object_get(json_object_get(j_credential, "credential"), "public_key"));
-      if ((ret = gnutls_pubkey_import(pubkey, &pubkey_dat, GNUTLS_X509_FMT_PEM)) < 0) {
-        y_log_message(Y_LOG_LEVEL_DEBUG, "check_assertion - Error gnutls_pubkey_import: %d", ret);
+      if ((webauthn_pubkey = pubkey_get(webauthn_config, json_integer_value(json_object_get(json_object_get(j_credential, "credential"), "gswc_id")), json_string_value(json_object_get(json_object_get(j_scheme_data, "credential"), "rawId")), json_object_get(json_object_get(j_credential, "credential"), "public_key"))) == NULL) {
+        y_log_message(Y_LOG_LEVEL_DEBUG, "check_assertion - Error pubkey_get");
         ret = G_ERROR;
         break;
       }
@@ -2664,7 +2832,7 @@ static int check_assertion(struct config_module * config, json_t * j_params, con
       signature.data = dat.data;
       signature.size = dat.size;
 
-      if ((res = gnutls_pubkey_verify_data2(pubkey, GNUTLS_SIGN_ECDSA_SHA256, 0, &data, &signature)) < 0) {
+      if ((res = gnutls_pubkey_verify_data2(webauthn_pubkey->pubkey, GNUTLS_SIGN_ECDSA_SHA256, 0, &data, &signature)) < 0) {
         y_log_message(Y_LOG_LEVEL_DEBUG, "check_assertion - Invalid signature: %d", res);
         ret = G_ERROR_UNAUTHORIZED;
         break;
@@ -2679,6 +2847,15 @@ static int check_assertion(struct config_module * config, json_t * j_params, con
     o_free(dat.data);
     dat.data = NULL;
 
+    // Authenticators without a signature counter always send 0, so there's nothing to store
+    // Otherwise the counter must be updated before the assertion is accepted: if another assertion
+    // with the same or a greater counter was accepted since the credential was read, it's a replay
+    if (ret == G_OK && counter_value) {
+      if ((ret = update_credential_counter(config, webauthn_config, json_integer_value(json_object_get(json_object_get(j_credential, "credential"), "gswc_id")), counter_value)) == G_ERROR_UNAUTHORIZED) {
+        y_log_message(Y_LOG_LEVEL_DEBUG, "check_assertion - counter invalid");
+      }
+    }
+
     if (ret == G_OK) {
       // Update assertion
       j_query = json_pack("{sss{sisi}s{sO}}",
@@ -2698,26 +2875,6 @@ static int check_assertion(struct config_module * config, json_t * j_params, con
         y_log_message(Y_LOG_LEVEL_ERROR, "check_assertion - Error executing j_query (1)");
         config->glewlwyd_module_callback_metrics_increment_counter(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
         ret = G_ERROR_DB;
-      } else {
-        // Update counter in credential if necessary
-        if (counter) {
-          j_query = json_pack("{sss{si}s{sO}}",
-                              "table",
-                              G_TABLE_WEBAUTHN_CREDENTIAL,
-                              "set",
-                                "gswc_counter",
-                                counter_value,
-                              "where",
-                                "gswc_id",
-                                json_object_get(json_object_get(j_credential, "credential"), "gswc_id"));
-          res = h_update(config->conn, j_query, NULL);
-          json_decref(j_query);
-          if (res != H_OK) {
-            y_log_message(Y_LOG_LEVEL_ERROR, "check_assertion - Error executing j_query (2)");
-            config->glewlwyd_module_callback_metrics_increment_counter(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
-            ret = G_ERROR_DB;
-          }
-        }
       }
     } else if (ret == G_ERROR_PARAM) {
       j_query = json_pack("{sss{sisi}s{sO}}",
@@ -2738,7 +2895,7 @@ static int check_assertion(struct config_module * config, json_t * j_params, con
         config->glewlwyd_module_callback_metrics_increment_counter(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
         ret = G_ERROR_DB;
       }
-    } else {
+    } else if (ret != G_ERROR_DB) {
       j_query = json_pack("{sss{sisi}s{sO}}",
                           "table",
                           G_TABLE_WEBAUTHN_ASSERTION,
@@ -2764,7 +2921,7 @@ static int check_assertion(struct config_module * config, json_t * j_params, con
     o_free(auth_data);
     json_decref(j_client_data);
     json_decref(j_credential);
-    gnutls_pubkey_deinit(pubkey);
+    pubkey_release(webauthn_config, webauthn_pubkey);
   } else {
     ret = G_ERROR_PARAM;
   }
@@ -3014,12 +3171,13 @@ int user_auth_scheme_module_unload(struct config_module * config) {
  */
 json_t * user_auth_scheme_module_init(struct config_module * config, json_t * j_parameters, const char * mod_name, void ** cls) {
   UNUSED(config);
-  json_t * j_result = is_scheme_parameters_valid(j_parameters), * j_element = NULL, * j_return;
+  json_t * j_result = is_scheme_parameters_valid(j_parameters), * j_element = NULL, * j_return, * j_params;
+  struct _webauthn_config * webauthn_config;
   size_t index = 0;
   char * message;
 
   if (check_result_value(j_result, G_OK)) {
-    *cls = json_pack("{sO sO sO sO sI sI sO ss so sO sO sO sO sO sO sO ss s[]}",
+    j_params = json_pack("{sO sO sO sO sI sI sO ss so sO sO sO sO sO sO sO ss s[]}",
                      "challenge-length", json_object_get(j_parameters, "challenge-length"),
                      "rp-origin", json_object_get(j_parameters, "rp-origin"),
                      "credential-expiration", json_object_get(j_parameters, "credential-expiration"),
@@ -3039,9 +3197,33 @@ json_t * user_auth_scheme_module_init(struct config_module * config, json_t * j_
                      "mod_name", mod_name,
                      "pubKey-cred-params");
     json_array_foreach(json_object_get(j_parameters, "pubKey-cred-params"), index, j_element) {
-      json_array_append_new(json_object_get((json_t *)*cls, "pubKey-cred-params"), json_pack("{sssO}", "type", "public-key", "alg", j_element));
+      json_array_append_new(json_object_get(j_params, "pubKey-cred-params"), json_pack("{sssO}", "type", "public-key", "alg", j_element));
+    }
+    if ((webauthn_config = o_malloc(sizeof(struct _webauthn_config))) != NULL) {
+      memset(webauthn_config, 0, sizeof(struct _webauthn_config));
+      if (!pthread_mutex_init(&webauthn_config->pubkey_lock, NULL)) {
+        if (!pthread_mutex_init(&webauthn_config->counter_lock, NULL)) {
+          webauthn_config->j_params = j_params;
+          *cls = webauthn_config;
+          j_return = json_pack("{si}", "result", G_OK);
+        } else {
+          y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_init webauthn - Error pthread_mutex_init counter_lock");
+          pthread_mutex_destroy(&webauthn_config->pubkey_lock);
+          json_decref(j_params);
+          o_free(webauthn_config);
+          j_return = json_pack("{si}", "result", G_ERROR);
+        }
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_init webauthn - Error pthread_mutex_init");
+        json_decref(j_params);
+        o_free(webauthn_config);
+        j_return = json_pack("{si}", "result", G_ERROR);
+      }
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_init webauthn - Error allocating resources for webauthn_config");
+      json_decref(j_params);
+      j_return = json_pack("{si}", "result", G_ERROR_MEMORY);
     }
-    j_return = json_pack("{si}", "result", G_OK);
   } else if (check_result_value(j_result, G_ERROR_PARAM)) {
     message = json_dumps(json_object_get(j_result, "error"), JSON_COMPACT);
     y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_init webauthn - Error input parameters: %s", message);
@@ -3071,7 +3253,18 @@ json_t * user_auth_scheme_module_init(struct config_module * config, json_t * j_
  */
 int user_auth_scheme_module_close(struct config_module * config, void * cls) {
   UNUSED(config);
-  json_decref((json_t *)cls);
+  struct _webauthn_config * webauthn_config = (struct _webauthn_config *)cls;
+  size_t i;
+
+  for (i=0; i<G_WEBAUTHN_PUBKEY_CACHE_SIZE; i++) {
+    if (webauthn_config->pubkey_cache[i] != NULL) {
+      pubkey_free(webauthn_config->pubkey_cache[i]);
+    }
+  }
+  pthread_mutex_destroy(&webauthn_config->pubkey_lock);
+  pthread_mutex_destroy(&webauthn_config->counter_lock);
+  json_decref(webauthn_config->j_params);
+  o_free(webauthn_config);
   return G_OK;
 }
 
@@ -3096,9 +3289,9 @@ int user_auth_scheme_module_can_use(struct config_module * config, const char *
   json_t * j_user_id, * j_credential;
   int ret;
 
-  j_user_id = get_user_id_from_username(config, (json_t *)cls, username, 0);
+  j_user_id = get_user_id_from_username(config, ((struct _webauthn_config *)cls)->j_params, username, 0);
   if (check_result_value(j_user_id, G_OK)) {
-    j_credential = get_credential_list(config, (json_t *)cls, username, 1);
+    j_credential = get_credential_list(config, ((struct _webauthn_config *)cls)->j_params, username, 1);
     if (check_result_value(j_credential, G_OK)) {
       ret = GLEWLWYD_IS_REGISTERED;
     } else if (check_result_value(j_credential, G_ERROR_NOT_FOUND)) {
@@ -3148,21 +3341,21 @@ json_t * user_auth_scheme_module_register(struct config_module * config, const s
   int res;
 
   if (0 == o_strcmp(json_string_value(json_object_get(j_scheme_data, "register")), "new-credential")) {
-    j_user_id = get_user_id_from_username(config, (json_t *)cls, username, 1);
+    j_user_id = get_user_id_from_username(config, ((struct _webauthn_config *)cls)->j_params, username, 1);
     if (check_result_value(j_user_id, G_OK)) {
-      j_credential = generate_new_credential(config, (json_t *)cls, username);
+      j_credential = generate_new_credential(config, ((struct _webauthn_config *)cls)->j_params, username);
       if (check_result_value(j_credential, G_OK)) {
         j_return = json_pack("{sis{sOsOsOsss{sOss}sO}}",
                               "result", G_OK,
                               "response",
                                 "session", json_object_get(json_object_get(j_credential, "credential"), "session"),
                                 "challenge", json_object_get(json_object_get(j_credential, "credential"), "challenge"),
-                                "pubKey-cred-params", json_object_get((json_t *)cls, "pubKey-cred-params"),
-                                "attestation-required", json_object_get((json_t *)cls, "force-fmt-none")==json_true()?"none":"direct",
+                                "pubKey-cred-params", json_object_get(((struct _webauthn_config *)cls)->j_params, "pubKey-cred-params"),
+                                "attestation-required", json_object_get(((struct _webauthn_config *)cls)->j_params, "force-fmt-none")==json_true()?"none":"direct",
                                 "user",
                                   "id", json_object_get(j_user_id, "user_id"),
                                   "name", username,
-                                "rpId", json_object_get((json_t *)cls, "rp-origin")
+                                "rpId", json_object_get(((struct _webauthn_config *)cls)->j_params, "rp-origin")
                              );
       } else {
         y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_register webauthn - Error generate_new_credential");
@@ -3175,9 +3368,9 @@ json_t * user_auth_scheme_module_register(struct config_module * config, const s
     }
     json_decref(j_user_id);
   } else if (0 == o_strcmp(json_string_value(json_object_get(j_scheme_data, "register")), "register-credential")) {
-    j_credential = get_credential_from_session(config, (json_t *)cls, username, json_string_value(json_object_get(j_scheme_data, "session")));
+    j_credential = get_credential_from_session(config, ((struct _webauthn_config *)cls)->j_params, username, json_string_value(json_object_get(j_scheme_data, "session")));
     if (check_result_value(j_credential, G_OK)) {
-      j_result = register_new_attestation(config, (json_t *)cls, j_scheme_data, json_object_get(j_credential, "credential"));
+      j_result = register_new_attestation(config, ((struct _webauthn_config *)cls)->j_params, j_scheme_data, json_object_get(j_credential, "credential"));
       if (check_result_value(j_result, G_OK)) {
         j_return = json_pack("{siso}", "result", G_OK, "updated", json_true());
       } else if (check_result_value(j_result, G_ERROR_UNAUTHORIZED)) {
@@ -3199,9 +3392,9 @@ json_t * user_auth_scheme_module_register(struct config_module * config, const s
     }
     json_decref(j_credential);
   } else if (0 == o_strcmp(json_string_value(json_object_get(j_scheme_data, "register")), "remove-credential") && !json_string_null_or_empty(json_object_get(j_scheme_data, "credential_id"))) {
-    j_credential = get_credential(config, (json_t *)cls, username, json_string_value(json_object_get(j_scheme_data, "credential_id")));
+    j_credential = get_credential(config, ((struct _webauthn_config *)cls)->j_params, username, json_string_value(json_object_get(j_scheme_data, "credential_id")));
     if (check_result_value(j_credential, G_OK)) {
-      if ((res = update_credential(config, (json_t *)cls, username, json_string_value(json_object_get(j_scheme_data, "credential_id")), 4)) == G_OK) {
+      if ((res = update_credential(config, (struct _webauthn_config *)cls, username, json_string_value(json_object_get(j_scheme_data, "credential_id")), 4)) == G_OK) {
         j_return = json_pack("{siso}", "result", G_OK, "updated", json_true());
       } else if (res == G_ERROR_PARAM) {
         j_return = json_pack("{si}", "result", G_ERROR_PARAM);
@@ -3217,9 +3410,9 @@ json_t * user_auth_scheme_module_register(struct config_module * config, const s
     }
     json_decref(j_credential);
   } else if (0 == o_strcmp(json_string_value(json_object_get(j_scheme_data, "register")), "disable-credential") && !json_string_null_or_empty(json_object_get(j_scheme_data, "credential_id"))) {
-    j_credential = get_credential(config, (json_t *)cls, username, json_string_value(json_object_get(j_scheme_data, "credential_id")));
+    j_credential = get_credential(config, ((struct _webauthn_config *)cls)->j_params, username, json_string_value(json_object_get(j_scheme_data, "credential_id")));
     if (check_result_value(j_credential, G_OK)) {
-      if ((res = update_credential(config, (json_t *)cls, username, json_string_value(json_object_get(j_scheme_data, "credential_id")), 3)) == G_OK) {
+      if ((res = update_credential(config, (struct _webauthn_config *)cls, username, json_string_value(json_object_get(j_scheme_data, "credential_id")), 3)) == G_OK) {
         j_return = json_pack("{siso}", "result", G_OK, "updated", json_true());
       } else if (res == G_ERROR_PARAM) {
         j_return = json_pack("{si}", "result", G_ERROR_PARAM);
@@ -3235,9 +3428,9 @@ json_t * user_auth_scheme_module_register(struct config_module * config, const s
     }
     json_decref(j_credential);
   } else if (0 == o_strcmp(json_string_value(json_object_get(j_scheme_data, "register")), "enable-credential") && !json_string_null_or_empty(json_object_get(j_scheme_data, "credential_id"))) {
-    j_credential = get_credential(config, (json_t *)cls, username, json_string_value(json_object_get(j_scheme_data, "credential_id")));
+    j_credential = get_credential(config, ((struct _webauthn_config *)cls)->j_params, username, json_string_value(json_object_get(j_scheme_data, "credential_id")));
     if (check_result_value(j_credential, G_OK)) {
-      if ((res = update_credential(config, (json_t *)cls, username, json_string_value(json_object_get(j_scheme_data, "credential_id")), 1)) == G_OK) {
+      if ((res = update_credential(config, (struct _webauthn_config *)cls, username, json_string_value(json_object_get(j_scheme_data, "credential_id")), 1)) == G_OK) {
         j_return = json_pack("{siso}", "result", G_OK, "updated", json_true());
       } else if (res == G_ERROR_PARAM) {
         j_return = json_pack("{si}", "result", G_ERROR_PARAM);
@@ -3253,9 +3446,9 @@ json_t * user_auth_scheme_module_register(struct config_module * config, const s
     }
     json_decref(j_credential);
   } else if (0 == o_strcmp(json_string_value(json_object_get(j_scheme_data, "register")), "edit-credential") && !json_string_null_or_empty(json_object_get(j_scheme_data, "credential_id")) && !json_string_null_or_empty(json_object_get(j_scheme_data, "name"))) {
-    j_credential = get_credential(config, (json_t *)cls, username, json_string_value(json_object_get(j_scheme_data, "credential_id")));
+    j_credential = get_credential(config, ((struct _webauthn_config *)cls)->j_params, username, json_string_value(json_object_get(j_scheme_data, "credential_id")));
     if (check_result_value(j_credential, G_OK)) {
-      if ((res = update_credential_name(config, (json_t *)cls, username, json_string_value(json_object_get(j_scheme_data, "credential_id")), json_string_value(json_object_get(j_scheme_data, "name")))) == G_OK) {
+      if ((res = update_credential_name(config, ((struct _webauthn_config *)cls)->j_params, username, json_string_value(json_object_get(j_scheme_data, "credential_id")), json_string_value(json_object_get(j_scheme_data, "name")))) == G_OK) {
         j_return = json_pack("{si}", "result", G_OK);
       } else if (res == G_ERROR_PARAM) {
         j_return = json_pack("{si}", "result", G_ERROR_PARAM);
@@ -3271,11 +3464,11 @@ json_t * user_auth_scheme_module_register(struct config_module * config, const s
     }
     json_decref(j_credential);
   } else if (0 == o_strcmp(json_string_value(json_object_get(j_scheme_data, "register")), "trigger-assertion")) {
-    j_user_id = get_user_id_from_username(config, (json_t *)cls, username, 0);
+    j_user_id = get_user_id_from_username(config, ((struct _webauthn_config *)cls)->j_params, username, 0);
     if (check_result_value(j_user_id, G_OK)) {
-      j_credential = get_credential_list(config, (json_t *)cls, username, 1);
+      j_credential = get_credential_list(config, ((struct _webauthn_config *)cls)->j_params, username, 1);
       if (check_result_value(j_credential, G_OK)) {
-        j_assertion = generate_new_assertion(config, (json_t *)cls, username, 1);
+        j_assertion = generate_new_assertion(config, ((struct _webauthn_config *)cls)->j_params, username, 1);
         if (check_result_value(j_assertion, G_OK)) {
           j_return = json_pack("{sis{sOsOsOs{sOss}sO}}",
                               "result", G_OK,
@@ -3286,7 +3479,7 @@ json_t * user_auth_scheme_module_register(struct config_module * config, const s
                                 "user",
                                   "id", json_object_get(j_user_id, "user_id"),
                                   "name", username,
-                                "rpId", json_object_get((json_t *)cls, "rp-origin")
+                                "rpId", json_object_get(((struct _webauthn_config *)cls)->j_params, "rp-origin")
                               );
         } else if (check_result_value(j_assertion, G_ERROR_UNAUTHORIZED)) {
           j_return = json_pack("{si}", "result", G_ERROR_UNAUTHORIZED);
@@ -3310,11 +3503,11 @@ json_t * user_auth_scheme_module_register(struct config_module * config, const s
     }
     json_decref(j_user_id);
   } else if (0 == o_strcmp(json_string_value(json_object_get(j_scheme_data, "register")), "validate-assertion")) {
-    j_user_id = get_user_id_from_username(config, (json_t *)cls, username, 0);
+    j_user_id = get_user_id_from_username(config, ((struct _webauthn_config *)cls)->j_params, username, 0);
     if (check_result_value(j_user_id, G_OK)) {
-      j_assertion = get_assertion_from_session(config, (json_t *)cls, username, json_string_value(json_object_get(j_scheme_data, "session")), 1);
+      j_assertion = get_assertion_from_session(config, ((struct _webauthn_config *)cls)->j_params, username, json_string_value(json_object_get(j_scheme_data, "session")), 1);
       if (check_result_value(j_assertion, G_OK)) {
-        if ((res = check_assertion(config, (json_t *)cls, username, j_scheme_data, json_object_get(j_assertion, "assertion"))) == G_OK) {
+        if ((res = check_assertion(config, (struct _webauthn_config *)cls, username, j_scheme_data, json_object_get(j_assertion, "assertion"))) == G_OK) {
           j_return = json_pack("{si}", "result", G_OK);
         } else if (res == G_ERROR_UNAUTHORIZED || res == G_ERROR_PARAM) {
           j_return = json_pack("{si}", "result", res);
@@ -3366,9 +3559,9 @@ json_t * user_auth_scheme_module_register_get(struct config_module * config, con
   UNUSED(http_request);
   json_t * j_return, * j_user_id, * j_credential_list;
 
-  j_user_id = get_user_id_from_username(config, (json_t *)cls, username, 1);
+  j_user_id = get_user_id_from_username(config, ((struct _webauthn_config *)cls)->j_params, username, 1);
   if (check_result_value(j_user_id, G_OK)) {
-    j_credential_list = get_credential_list(config, (json_t *)cls, username, 0);
+    j_credential_list = get_credential_list(config, ((struct _webauthn_config *)cls)->j_params, username, 0);
     if (check_result_value(j_credential_list, G_OK)) {
       j_return = json_pack("{sisO}", "result", G_OK, "response", json_object_get(j_credential_list, "credential"));
     } else if (check_result_value(j_credential_list, G_ERROR_NOT_FOUND)) {
@@ -3408,14 +3601,14 @@ int user_auth_scheme_module_deregister(struct config_module * config, const char
   size_t index = 0;
   int ret;
 
-  j_user_id = get_user_id_from_username(config, (json_t *)cls, username, 1);
+  j_user_id = get_user_id_from_username(config, ((struct _webauthn_config *)cls)->j_params, username, 1);
   if (check_result_value(j_user_id, G_OK)) {
-    j_credential_list = get_credential_list(config, (json_t *)cls, username, 0);
+    j_credential_list = get_credential_list(config, ((struct _webauthn_config *)cls)->j_params, username, 0);
     if (check_result_value(j_credential_list, G_OK)) {
       json_array_foreach(json_object_get(j_credential_list, "credential"), index, j_element) {
-        j_credential = get_credential(config, (json_t *)cls, username, json_string_value(json_object_get(j_element, "credential_id")));
+        j_credential = get_credential(config, ((struct _webauthn_config *)cls)->j_params, username, json_string_value(json_object_get(j_element, "credential_id")));
         if (check_result_value(j_credential, G_OK)) {
-          if (update_credential(config, (json_t *)cls, username, json_string_value(json_object_get(j_element, "credential_id")), 4) != G_OK) {
+          if (update_credential(config, (struct _webauthn_config *)cls, username, json_string_value(json_object_get(j_element, "credential_id")), 4) != G_OK) {
             y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_deregister webauthn - Error update_credential");
           }
         } else {
@@ -3467,14 +3660,14 @@ json_t * user_auth_scheme_module_trigger(struct config_module * config, const st
   json_t * j_return = NULL, * j_session = config->glewlwyd_module_callback_check_user_session(config, http_request, username), * j_credential, * j_assertion, * j_user_id, * j_credential_fake;
   unsigned char user_id_fake[64];
 
-  if (check_result_value(j_session, G_OK) || json_object_get((json_t *)cls, "session-mandatory") == json_false()) {
-    j_credential_fake = generate_credential_fake_list((json_t *)cls, username);
+  if (check_result_value(j_session, G_OK) || json_object_get(((struct _webauthn_config *)cls)->j_params, "session-mandatory") == json_false()) {
+    j_credential_fake = generate_credential_fake_list(((struct _webauthn_config *)cls)->j_params, username);
     if (check_result_value(j_credential_fake, G_OK)) {
-      j_user_id = get_user_id_from_username(config, (json_t *)cls, username, 0);
+      j_user_id = get_user_id_from_username(config, ((struct _webauthn_config *)cls)->j_params, username, 0);
       if (check_result_value(j_user_id, G_OK)) {
-        j_credential = get_credential_list(config, (json_t *)cls, username, 1);
+        j_credential = get_credential_list(config, ((struct _webauthn_config *)cls)->j_params, username, 1);
         if (check_result_value(j_credential, G_OK)) {
-          j_assertion = generate_new_assertion(config, (json_t *)cls, username, 0);
+          j_assertion = generate_new_assertion(config, ((struct _webauthn_config *)cls)->j_params, username, 0);
           if (check_result_value(j_assertion, G_OK)) {
             j_return = json_pack("{sis{sOsOsOs{sOss}sOsssi}}",
                                 "result", G_OK,
@@ -3485,11 +3678,11 @@ json_t * user_auth_scheme_module_trigger(struct config_module * config, const st
                                   "user",
                                     "id", json_object_get(j_user_id, "user_id"),
                                     "name", username,
-                                  "rpId", json_object_get((json_t *)cls, "rp-origin"),
-                                  "attestation-required", json_object_get((json_t *)cls, "force-fmt-none")==json_true()?"none":"direct",
+                                  "rpId", json_object_get(((struct _webauthn_config *)cls)->j_params, "rp-origin"),
+                                  "attestation-required", json_object_get(((struct _webauthn_config *)cls)->j_params, "force-fmt-none")==json_true()?"none":"direct",
                                   "timeout", 60000
                                 );
-            if (json_object_get((json_t *)cls, "session-mandatory") == json_false()) {
+            if (json_object_get(((struct _webauthn_config *)cls)->j_params, "session-mandatory") == json_false()) {
               json_array_extend(json_object_get(json_object_get(j_return, "response"), "allowCredentials"), json_object_get(j_credential_fake, "credential"));
             }
           } else if (check_result_value(j_assertion, G_ERROR_UNAUTHORIZED)) {
@@ -3500,8 +3693,8 @@ json_t * user_auth_scheme_module_trigger(struct config_module * config, const st
           }
           json_decref(j_assertion);
         } else if (check_result_value(j_credential, G_ERROR_NOT_FOUND)) {
-          if (json_object_get((json_t *)cls, "session-mandatory") == json_false()) {
-            j_assertion = generate_new_assertion(config, (json_t *)cls, username, 2);
+          if (json_object_get(((struct _webauthn_config *)cls)->j_params, "session-mandatory") == json_false()) {
+            j_assertion = generate_new_assertion(config, ((struct _webauthn_config *)cls)->j_params, username, 2);
             if (check_result_value(j_assertion, G_OK)) {
               j_return = json_pack("{sis{sOsOsOs{sOss}sO}}",
                                   "result", G_OK,
@@ -3512,7 +3705,7 @@ json_t * user_auth_scheme_module_trigger(struct config_module * config, const st
                                     "user",
                                       "id", json_object_get(j_user_id, "user_id"),
                                       "name", username,
-                                    "rpId", json_object_get((json_t *)cls, "rp-origin")
+                                    "rpId", json_object_get(((struct _webauthn_config *)cls)->j_params, "rp-origin")
                                   );
             } else {
               y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_trigger webauthn - Error register_new_assertion");
@@ -3528,9 +3721,9 @@ json_t * user_auth_scheme_module_trigger(struct config_module * config, const st
         }
         json_decref(j_credential);
       } else if (check_result_value(j_user_id, G_ERROR_NOT_FOUND)) {
-        if (json_object_get((json_t *)cls, "session-mandatory") == json_false()) {
-          if (generate_fake_user_id((json_t *)cls, username, user_id_fake) == G_OK) {
-            j_assertion = generate_new_assertion(config, (json_t *)cls, username, 2);
+        if (json_object_get(((struct _webauthn_config *)cls)->j_params, "session-mandatory") == json_false()) {
+          if (generate_fake_user_id(((struct _webauthn_config *)cls)->j_params, username, user_id_fake) == G_OK) {
+            j_assertion = generate_new_assertion(config, ((struct _webauthn_config *)cls)->j_params, username, 2);
             if (check_result_value(j_assertion, G_OK)) {
               j_return = json_pack("{sis{sOsOsOs{ssss}sO}}",
                                   "result", G_OK,
@@ -3541,7 +3734,7 @@ json_t * user_auth_scheme_module_trigger(struct config_module * config, const st
                                     "user",
                                       "id", user_id_fake,
                                       "name", username,
-                                    "rpId", json_object_get((json_t *)cls, "rp-origin")
+                                    "rpId", json_object_get(((struct _webauthn_config *)cls)->j_params, "rp-origin")
                                   );
             } else {
               y_log_message(Y_LOG_LEVEL_ERROR, "user_auth_scheme_module_trigger webauthn - Error register_new_assertion");
@@ -3601,11 +3794,11 @@ int user_auth_scheme_module_validate(struct config_module * config, const struct
   int ret, res;
   json_t * j_user_id, * j_assertion;
 
-  j_user_id = get_user_id_from_username(config, (json_t *)cls, username, 0);
+  j_user_id = get_user_id_from_username(config, ((struct _webauthn_config *)cls)->j_params, username, 0);
   if (check_result_value(j_user_id, G_OK)) {
-    j_assertion = get_assertion_from_session(config, (json_t *)cls, username, json_string_value(json_object_get(j_scheme_data, "session")), 0);
+    j_assertion = get_assertion_from_session(config, ((struct _webauthn_config *)cls)->j_params, username, json_string_value(json_object_get(j_scheme_data, "session")), 0);
     if (check_result_value(j_assertion, G_OK)) {
-      if ((res = check_assertion(config, (json_t *)cls, username, j_scheme_data, json_object_get(j_assertion, "assertion"))) == G_OK) {
+      if ((res = check_assertion(config, (struct _webauthn_config *)cls, username, j_scheme_data, json_object_get(j_assertion, "assertion"))) == G_OK) {
         ret = G_OK;
       } else if (res == G_ERROR_UNAUTHORIZED || res == G_ERROR_PARAM) {
         ret = res;
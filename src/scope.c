@@ -26,43 +26,51 @@
  */
 #include "glewlwyd.h"
 
+static const struct _glwd_statement statement_current_session = {
+  "glwd_current_session",
+  "SELECT gus_id, gus_username AS username FROM " GLEWLWYD_TABLE_USER_SESSION " WHERE gus_session_hash=$1 AND gus_enabled=1 AND gus_expiration > NOW() AND gus_current=1 ORDER BY gus_current DESC LIMIT 1",
+  "SELECT gus_id, gus_username AS username FROM " GLEWLWYD_TABLE_USER_SESSION " WHERE gus_session_hash=$1 AND gus_enabled=1 AND gus_expiration > (strftime('%s','now')) AND gus_current=1 ORDER BY gus_current DESC LIMIT 1",
+  "SELECT gus_id, gus_username AS username FROM " GLEWLWYD_TABLE_USER_SESSION " WHERE gus_session_hash=$1 AND gus_enabled=1 AND gus_expiration > NOW() AND gus_current=1 ORDER BY gus_current DESC LIMIT 1"
+};
+
+static const struct _glwd_statement statement_scope_get = {
+  "glwd_scope_get",
+  "SELECT gs_name AS name, gs_display_name AS display_name, gs_description AS description, gs_password_required, gs_password_max_age AS password_max_age FROM " GLEWLWYD_TABLE_SCOPE " WHERE gs_name=$1",
+  NULL,
+  NULL
+};
+
+static const struct _glwd_statement statement_auth_scheme_list_from_scope = {
+  "glwd_auth_scheme_list_from_scope",
+  "SELECT \
+    gsg_name AS group_name, \
+    gsg_scheme_required AS scheme_required, \
+    guasmi_module AS scheme_type, \
+    guasmi_name AS scheme_name, \
+    guasmi_display_name AS scheme_display_name \
+    FROM \
+    " GLEWLWYD_TABLE_SCOPE_GROUP ", \
+    " GLEWLWYD_TABLE_USER_AUTH_SCHEME_MODULE_INSTANCE ", \
+    " GLEWLWYD_TABLE_SCOPE_GROUP_AUTH_SCHEME_MODULE_INSTANCE " \
+    WHERE \
+    " GLEWLWYD_TABLE_SCOPE_GROUP_AUTH_SCHEME_MODULE_INSTANCE ".guasmi_id = " GLEWLWYD_TABLE_USER_AUTH_SCHEME_MODULE_INSTANCE ".guasmi_id AND \
+    " GLEWLWYD_TABLE_SCOPE_GROUP ".gsg_id = " GLEWLWYD_TABLE_SCOPE_GROUP_AUTH_SCHEME_MODULE_INSTANCE ".gsg_id AND \
+    " GLEWLWYD_TABLE_SCOPE_GROUP_AUTH_SCHEME_MODULE_INSTANCE ".gsg_id IN  \
+      (SELECT gsg_id FROM " GLEWLWYD_TABLE_SCOPE_GROUP " WHERE gs_id =  \
+        (SELECT gs_id FROM " GLEWLWYD_TABLE_SCOPE " WHERE gs_name=$1)) \
+    ORDER BY \
+    " GLEWLWYD_TABLE_SCOPE_GROUP ".gsg_id, \
+    " GLEWLWYD_TABLE_USER_AUTH_SCHEME_MODULE_INSTANCE ".guasmi_name",
+  NULL,
+  NULL
+};
+
 static json_t * get_current_session(struct config_elements * config, const char * session_hash) {
-  json_t * j_query, * j_result = NULL, * j_return;
+  json_t * j_params = json_pack("[s]", session_hash), * j_result = NULL, * j_return;
   int res;
-  char * expire_clause;
 
-  if (config->conn->type==HOEL_DB_TYPE_MARIADB) {
-    expire_clause = o_strdup("> NOW()");
-  } else if (config->conn->type==HOEL_DB_TYPE_PGSQL) {
-    expire_clause = o_strdup("> NOW()");
-  } else { // HOEL_DB_TYPE_SQLITE
-    expire_clause = o_strdup("> (strftime('%s','now'))");
-  }
-  j_query = json_pack("{sss[ss]s{sssis{ssss}si}sssi}",
-                      "table",
-                      GLEWLWYD_TABLE_USER_SESSION,
-                      "columns",
-                        "gus_id",
-                        "gus_username AS username",
-                      "where",
-                        "gus_session_hash",
-                        session_hash,
-                        "gus_enabled",
-                        1,
-                        "gus_expiration",
-                          "operator",
-                          "raw",
-                          "value",
-                          expire_clause,
-                        "gus_current",
-                        1,
-                      "order_by",
-                      "gus_current DESC",
-                      "limit",
-                      1);
-  o_free(expire_clause);
-  res = h_select(config->conn, j_query, &j_result, NULL);
-  json_decref(j_query);
+  res = execute_statement_json(config, config->conn, &statement_current_session, j_params, &j_result);
+  json_decref(j_params);
   if (res == H_OK) {
     if (json_array_size(j_result) > 0) {
       j_return = json_pack("{sisO}", "result", G_OK, "session", json_array_get(j_result, 0));
@@ -70,7 +78,7 @@ static json_t * get_current_session(struct config_elements * config, const char
       j_return = json_pack("{si}", "result", G_ERROR_NOT_FOUND);
     }
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "get_current_session - Error executing j_query");
+    y_log_message(Y_LOG_LEVEL_ERROR, "get_current_session - Error executing statement");
     glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
     j_return = json_pack("{si}", "result", G_ERROR_DB);
   }
@@ -114,11 +122,11 @@ static json_t * get_current_user_from_session(struct config_elements * config, c
   return j_return;
 }
 
-json_t * get_scope_list(struct config_elements * config, const char * pattern, size_t offset, size_t limit) {
+json_t * get_scope_list(struct config_elements * config, const char * pattern, const char * after, size_t offset, size_t limit) {
   json_t * j_query, * j_result, * j_return, * j_element, * j_scheme;
   int res;
   size_t index;
-  char * pattern_escaped, * pattern_clause;
+  char * pattern_escaped, * pattern_clause, * after_escaped, * after_clause;
 
   j_query = json_pack("{sss[sssss]siss}",
                       "table",
@@ -143,7 +151,18 @@ json_t * get_scope_list(struct config_elements * config, const char * pattern, s
     o_free(pattern_escaped);
     o_free(pattern_clause);
   }
-  res = h_select(config->conn, j_query, &j_result, NULL);
+  if (!o_strnullempty(after)) {
+    // Keyset pagination, scopes are sorted by name so the next page starts right after the last name sent
+    after_escaped = h_escape_string_with_quotes(config->conn, after);
+    after_clause = msprintf("> %s", after_escaped);
+    if (json_object_get(j_query, "where") == NULL) {
+      json_object_set_new(j_query, "where", json_object());
+    }
+    json_object_set_new(json_object_get(j_query, "where"), "gs_name", json_pack("{ssss}", "operator", "raw", "value", after_clause));
+    o_free(after_escaped);
+    o_free(after_clause);
+  }
+  res = select_read(config, j_query, &j_result, GLEWLWYD_DB_READ_REPLICA);
   json_decref(j_query);
   if (res == H_OK) {
     json_array_foreach(j_result, index, j_element) {
@@ -170,23 +189,11 @@ json_t * get_scope_list(struct config_elements * config, const char * pattern, s
 }
 
 json_t * get_scope(struct config_elements * config, const char * scope) {
-  json_t * j_query, * j_result = NULL, * j_return, * j_scheme;
+  json_t * j_params = json_pack("[s]", scope), * j_result = NULL, * j_return, * j_scheme;
   int res;
 
-  j_query = json_pack("{sss[sssss]s{ss}}",
-                      "table",
-                      GLEWLWYD_TABLE_SCOPE,
-                      "columns",
-                        "gs_name AS name",
-                        "gs_display_name AS display_name",
-                        "gs_description AS description",
-                        "gs_password_required",
-                        "gs_password_max_age AS password_max_age",
-                      "where",
-                        "gs_name",
-                        scope);
-  res = h_select(config->conn, j_query, &j_result, NULL);
-  json_decref(j_query);
+  res = execute_statement_json_read(config, &statement_scope_get, j_params, &j_result, GLEWLWYD_DB_READ_REPLICA_FALLBACK);
+  json_decref(j_params);
   if (res == H_OK) {
     if (json_array_size(j_result)) {
       json_object_set(json_array_get(j_result, 0), "password_required", json_integer_value(json_object_get(json_array_get(j_result, 0), "gs_password_required"))?json_true():json_false());
@@ -208,7 +215,7 @@ json_t * get_scope(struct config_elements * config, const char * scope) {
       j_return = json_pack("{si}", "result", G_ERROR_NOT_FOUND);
     }
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "get_scope - Error executing j_query");
+    y_log_message(Y_LOG_LEVEL_ERROR, "get_scope - Error executing statement");
     glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
     j_return = json_pack("{si}", "result", G_ERROR_DB);
   }
@@ -217,71 +224,38 @@ json_t * get_scope(struct config_elements * config, const char * scope) {
 }
 
 json_t * get_auth_scheme_list_from_scope(struct config_elements * config, const char * scope) {
-  const char * str_query_pattern = 
-    "SELECT \
-    gsg_name AS group_name, \
-    gsg_scheme_required AS scheme_required, \
-    guasmi_module AS scheme_type, \
-    guasmi_name AS scheme_name, \
-    guasmi_display_name AS scheme_display_name \
-    FROM \
-    " GLEWLWYD_TABLE_SCOPE_GROUP ", \
-    " GLEWLWYD_TABLE_USER_AUTH_SCHEME_MODULE_INSTANCE ", \
-    " GLEWLWYD_TABLE_SCOPE_GROUP_AUTH_SCHEME_MODULE_INSTANCE " \
-    WHERE \
-    " GLEWLWYD_TABLE_SCOPE_GROUP_AUTH_SCHEME_MODULE_INSTANCE ".guasmi_id = " GLEWLWYD_TABLE_USER_AUTH_SCHEME_MODULE_INSTANCE ".guasmi_id AND \
-    " GLEWLWYD_TABLE_SCOPE_GROUP ".gsg_id = " GLEWLWYD_TABLE_SCOPE_GROUP_AUTH_SCHEME_MODULE_INSTANCE ".gsg_id AND \
-    " GLEWLWYD_TABLE_SCOPE_GROUP_AUTH_SCHEME_MODULE_INSTANCE ".gsg_id IN  \
-      (SELECT gsg_id FROM " GLEWLWYD_TABLE_SCOPE_GROUP " WHERE gs_id =  \
-        (SELECT gs_id FROM " GLEWLWYD_TABLE_SCOPE " WHERE gs_name=%s)) \
-    ORDER BY \
-    " GLEWLWYD_TABLE_SCOPE_GROUP ".gsg_id, \
-    " GLEWLWYD_TABLE_USER_AUTH_SCHEME_MODULE_INSTANCE ".guasmi_name;";
-  char * scope_escape = h_escape_string_with_quotes(config->conn, scope), * str_query = NULL;
-  json_t * j_return, * j_result = NULL, * j_element;
+  json_t * j_params = json_pack("[s]", scope), * j_return, * j_result = NULL, * j_element;
   int res;
   size_t index;
   
-  if (scope_escape != NULL) {
-    str_query = msprintf(str_query_pattern, scope_escape);
-    if (str_query != NULL) {
-      res = h_execute_query_json(config->conn, str_query, &j_result);
-      if (res == H_OK) {
-        if (json_array_size(j_result)) {
-          j_return = json_pack("{sis{}s{}}", "result", G_OK, "scheme", "scheme_required");
-          if (j_return != NULL) {
-            json_array_foreach(j_result, index, j_element) {
-              if (json_object_get(json_object_get(j_return, "scheme"), json_string_value(json_object_get(j_element, "group_name"))) == NULL) {
-                json_object_set_new(json_object_get(j_return, "scheme"), json_string_value(json_object_get(j_element, "group_name")), json_array());
-                json_object_set(json_object_get(j_return, "scheme_required"), json_string_value(json_object_get(j_element, "group_name")), json_object_get(j_element, "scheme_required"));
-              }
-              if (json_object_get(json_object_get(j_return, "scheme"), json_string_value(json_object_get(j_element, "group_name"))) != NULL) {
-                json_array_append_new(json_object_get(json_object_get(j_return, "scheme"), json_string_value(json_object_get(j_element, "group_name"))), json_pack("{ssssss?}", "scheme_type", json_string_value(json_object_get(j_element, "scheme_type")), "scheme_name", json_string_value(json_object_get(j_element, "scheme_name")), "scheme_display_name", json_string_value(json_object_get(j_element, "scheme_display_name"))));
-              }
-            }
-          } else {
-            y_log_message(Y_LOG_LEVEL_ERROR, "get_auth_scheme_list_from_scope - Error allocating resources for j_return");
-            j_return = json_pack("{si}", "result", G_ERROR_MEMORY);
+  res = execute_statement_json_read(config, &statement_auth_scheme_list_from_scope, j_params, &j_result, GLEWLWYD_DB_READ_REPLICA);
+  json_decref(j_params);
+  if (res == H_OK) {
+    if (json_array_size(j_result)) {
+      j_return = json_pack("{sis{}s{}}", "result", G_OK, "scheme", "scheme_required");
+      if (j_return != NULL) {
+        json_array_foreach(j_result, index, j_element) {
+          if (json_object_get(json_object_get(j_return, "scheme"), json_string_value(json_object_get(j_element, "group_name"))) == NULL) {
+            json_object_set_new(json_object_get(j_return, "scheme"), json_string_value(json_object_get(j_element, "group_name")), json_array());
+            json_object_set(json_object_get(j_return, "scheme_required"), json_string_value(json_object_get(j_element, "group_name")), json_object_get(j_element, "scheme_required"));
+          }
+          if (json_object_get(json_object_get(j_return, "scheme"), json_string_value(json_object_get(j_element, "group_name"))) != NULL) {
+            json_array_append_new(json_object_get(json_object_get(j_return, "scheme"), json_string_value(json_object_get(j_element, "group_name"))), json_pack("{ssssss?}", "scheme_type", json_string_value(json_object_get(j_element, "scheme_type")), "scheme_name", json_string_value(json_object_get(j_element, "scheme_name")), "scheme_display_name", json_string_value(json_object_get(j_element, "scheme_display_name"))));
           }
-        } else {
-          j_return = json_pack("{si}", "result", G_ERROR_NOT_FOUND);
         }
       } else {
-        y_log_message(Y_LOG_LEVEL_ERROR, "get_auth_scheme_list_from_scope - Error executing str_query");
-        glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
-        j_return = json_pack("{si}", "result", G_ERROR_DB);
+        y_log_message(Y_LOG_LEVEL_ERROR, "get_auth_scheme_list_from_scope - Error allocating resources for j_return");
+        j_return = json_pack("{si}", "result", G_ERROR_MEMORY);
       }
-      json_decref(j_result);
     } else {
-      y_log_message(Y_LOG_LEVEL_ERROR, "get_auth_scheme_list_from_scope - Error allocating resources for str_query");
-      j_return = json_pack("{si}", "result", G_ERROR);
+      j_return = json_pack("{si}", "result", G_ERROR_NOT_FOUND);
     }
-    o_free(str_query);
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "get_auth_scheme_list_from_scope - Error h_escape_string");
-    j_return = json_pack("{si}", "result", G_ERROR);
+    y_log_message(Y_LOG_LEVEL_ERROR, "get_auth_scheme_list_from_scope - Error executing statement");
+    glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
+    j_return = json_pack("{si}", "result", G_ERROR_DB);
   }
-  o_free(scope_escape);
+  json_decref(j_result);
   return j_return;
 }
 
@@ -443,7 +417,7 @@ json_t * get_validated_auth_scheme_list_from_scope_list(struct config_elements *
                   json_array_foreach(j_group, index_scheme, j_scheme) {
                     scheme = get_user_auth_scheme_module_instance(config, json_string_value(json_object_get(j_scheme, "scheme_name")));
                     if (scheme != NULL) {
-                      if (scheme->enabled && (can_use_scheme = scheme->module->user_auth_scheme_module_can_use(config->config_m, json_string_value(json_object_get(json_object_get(j_user, "user"), "username")), scheme->cls)) != GLEWLWYD_IS_NOT_AVAILABLE) {
+                      if (scheme->enabled && (can_use_scheme = get_scheme_can_use(config, scheme, json_string_value(json_object_get(json_object_get(j_user, "user"), "username")))) != GLEWLWYD_IS_NOT_AVAILABLE) {
                         if (can_use_scheme == GLEWLWYD_IS_REGISTERED) {
                           j_scheme_valid = is_scheme_valid_for_session(config, scheme->guasmi_id, scheme->guasmi_max_use, 0, session_hash);
                           if (check_result_value(j_scheme_valid, G_OK)) {
@@ -662,7 +636,7 @@ json_t * get_client_grant_list(struct config_elements * config, const char * use
   if (limit) {
     json_object_set_new(j_query, "limit", json_integer(limit));
   }
-  res = h_select(config->conn, j_query, &j_result, NULL);
+  res = select_read(config, j_query, &j_result, GLEWLWYD_DB_READ_REPLICA);
   json_decref(j_query);
   if (res == H_OK) {
     j_return = json_pack("{sis[]}", "result", G_OK, "client_grant");
@@ -687,7 +661,7 @@ json_t * get_client_grant_list(struct config_elements * config, const char * use
         o_free(scope_clause);
         o_free(client_id_escaped);
         o_free(username_escaped);
-        res = h_select(config->conn, j_query, &j_result_scope, NULL);
+        res = select_read(config, j_query, &j_result_scope, GLEWLWYD_DB_READ_REPLICA);
         json_decref(j_query);
         if (res == H_OK) {
           json_array_append_new(json_object_get(j_return, "client_grant"), json_pack("{sOsOsOsO}", "client_id", json_object_get(json_object_get(j_client, "client"), "client_id"), "name", json_object_get(json_object_get(j_client, "client"), "name"), "description", json_object_get(json_object_get(j_client, "client"), "description"), "scope", j_result_scope));
@@ -1076,6 +1050,9 @@ int set_scope(struct config_elements * config, const char * scope, json_t * j_sc
     glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
     ret = G_ERROR_DB;
   }
+  if (ret == G_OK) {
+    glewlwyd_cache_invalidation_publish(config, GLEWLWYD_CACHE_SCOPE, scope);
+  }
   return ret;
 }
 
@@ -1098,5 +1075,8 @@ int delete_scope(struct config_elements * config, const char * scope) {
     glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
     ret = G_ERROR_DB;
   }
+  if (ret == G_OK) {
+    glewlwyd_cache_invalidation_publish(config, GLEWLWYD_CACHE_SCOPE, scope);
+  }
   return ret;
 }
@@ -95,41 +95,44 @@ static void send_mail_on_new_connexion(struct config_elements * config, const ch
   json_decref(j_misc_config);
 }
 
+static const struct _glwd_statement statement_session_scheme = {
+  "glwd_session_scheme",
+  "SELECT guasmi_id, UNIX_TIMESTAMP(guss_expiration) AS expiration FROM " GLEWLWYD_TABLE_USER_SESSION_SCHEME " WHERE gus_id=$1 AND guss_enabled=1 AND guss_expiration > NOW()",
+  "SELECT guasmi_id, guss_expiration AS expiration FROM " GLEWLWYD_TABLE_USER_SESSION_SCHEME " WHERE gus_id=$1 AND guss_enabled=1 AND guss_expiration > (strftime('%s','now'))",
+  "SELECT guasmi_id, EXTRACT(EPOCH FROM guss_expiration)::integer AS expiration FROM " GLEWLWYD_TABLE_USER_SESSION_SCHEME " WHERE gus_id=$1 AND guss_enabled=1 AND guss_expiration > NOW()"
+};
+
+static const struct _glwd_statement statement_session_for_username = {
+  "glwd_session_for_username",
+  "SELECT gus_id, UNIX_TIMESTAMP(gus_expiration) AS expiration FROM " GLEWLWYD_TABLE_USER_SESSION " WHERE gus_session_hash=$1 AND gus_username=$2 AND gus_enabled=1 AND gus_expiration > NOW()",
+  "SELECT gus_id, gus_expiration AS expiration FROM " GLEWLWYD_TABLE_USER_SESSION " WHERE gus_session_hash=$1 AND gus_username=$2 AND gus_enabled=1 AND gus_expiration > (strftime('%s','now'))",
+  "SELECT gus_id, EXTRACT(EPOCH FROM gus_expiration)::integer AS expiration FROM " GLEWLWYD_TABLE_USER_SESSION " WHERE gus_session_hash=$1 AND gus_username=$2 AND gus_enabled=1 AND gus_expiration > NOW()"
+};
+
+static const struct _glwd_statement statement_users_for_session = {
+  "glwd_users_for_session",
+  "SELECT gus_username, UNIX_TIMESTAMP(gus_last_login) AS last_login FROM " GLEWLWYD_TABLE_USER_SESSION " WHERE gus_session_hash=$1 AND gus_enabled=1 AND gus_expiration > NOW() ORDER BY gus_current DESC",
+  "SELECT gus_username, gus_last_login AS last_login FROM " GLEWLWYD_TABLE_USER_SESSION " WHERE gus_session_hash=$1 AND gus_enabled=1 AND gus_expiration > (strftime('%s','now')) ORDER BY gus_current DESC",
+  "SELECT gus_username, EXTRACT(EPOCH FROM gus_last_login)::integer AS last_login FROM " GLEWLWYD_TABLE_USER_SESSION " WHERE gus_session_hash=$1 AND gus_enabled=1 AND gus_expiration > NOW() ORDER BY gus_current DESC"
+};
+
+static const struct _glwd_statement statement_current_user_for_session = {
+  "glwd_current_user_for_session",
+  "SELECT gus_username, UNIX_TIMESTAMP(gus_expiration) AS expiration FROM " GLEWLWYD_TABLE_USER_SESSION " WHERE gus_session_hash=$1 AND gus_enabled=1 AND gus_expiration > NOW() AND gus_current=1 ORDER BY gus_current DESC LIMIT 1",
+  "SELECT gus_username, gus_expiration AS expiration FROM " GLEWLWYD_TABLE_USER_SESSION " WHERE gus_session_hash=$1 AND gus_enabled=1 AND gus_expiration > (strftime('%s','now')) AND gus_current=1 ORDER BY gus_current DESC LIMIT 1",
+  "SELECT gus_username, EXTRACT(EPOCH FROM gus_expiration)::integer AS expiration FROM " GLEWLWYD_TABLE_USER_SESSION " WHERE gus_session_hash=$1 AND gus_enabled=1 AND gus_expiration > NOW() AND gus_current=1 ORDER BY gus_current DESC LIMIT 1"
+};
+
 json_t * get_session_scheme(struct config_elements * config, json_int_t gus_id) {
-  json_t * j_query, * j_result, * j_return;
+  json_t * j_params = json_pack("[I]", gus_id), * j_result, * j_return;
   int res;
-  char * expire_clause;
-  
-  if (config->conn->type==HOEL_DB_TYPE_MARIADB) {
-    expire_clause = o_strdup("> NOW()");
-  } else if (config->conn->type==HOEL_DB_TYPE_PGSQL) {
-    expire_clause = o_strdup("> NOW()");
-  } else { // HOEL_DB_TYPE_SQLITE
-    expire_clause = o_strdup("> (strftime('%s','now'))");
-  }
-  j_query = json_pack("{sss[ss]s{sIsis{ssss}}}",
-                      "table",
-                      GLEWLWYD_TABLE_USER_SESSION_SCHEME,
-                      "columns",
-                        "guasmi_id",
-                        SWITCH_DB_TYPE(config->conn->type, "UNIX_TIMESTAMP(guss_expiration) AS expiration", "guss_expiration AS expiration", "EXTRACT(EPOCH FROM guss_expiration)::integer AS expiration"),
-                      "where",
-                        "gus_id",
-                        gus_id,
-                        "guss_enabled",
-                        1,
-                        "guss_expiration",
-                          "operator",
-                          "raw",
-                          "value",
-                          expire_clause);
-  o_free(expire_clause);
-  res = h_select(config->conn, j_query, &j_result, NULL);
-  json_decref(j_query);
+
+  res = execute_statement_json(config, config->conn, &statement_session_scheme, j_params, &j_result);
+  json_decref(j_params);
   if (res == H_OK) {
     j_return = json_pack("{siso}", "result", G_OK, "scheme", j_result);
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "get_session_scheme - Error executing j_query");
+    y_log_message(Y_LOG_LEVEL_ERROR, "get_session_scheme - Error executing statement");
     glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
     j_return = json_pack("{si}", "result", G_ERROR_DB);
   }
@@ -137,40 +140,14 @@ json_t * get_session_scheme(struct config_elements * config, json_int_t gus_id)
 }
 
 json_t * get_session_for_username(struct config_elements * config, const char * session_uid, const char * username) {
-  json_t * j_query, * j_result, * j_return, * j_session_scheme;
+  json_t * j_params, * j_result, * j_return, * j_session_scheme;
   int res;
-  char * expire_clause;
   char * session_uid_hash = generate_hash(config->hash_algorithm, session_uid);
 
-  if (config->conn->type==HOEL_DB_TYPE_MARIADB) {
-    expire_clause = o_strdup("> NOW()");
-  } else if (config->conn->type==HOEL_DB_TYPE_PGSQL) {
-    expire_clause = o_strdup("> NOW()");
-  } else { // HOEL_DB_TYPE_SQLITE
-    expire_clause = o_strdup("> (strftime('%s','now'))");
-  }
   if (session_uid_hash != NULL) {
-    j_query = json_pack("{sss[ss]s{sssssis{ssss}}}",
-                        "table",
-                        GLEWLWYD_TABLE_USER_SESSION,
-                        "columns",
-                          "gus_id",
-                          SWITCH_DB_TYPE(config->conn->type, "UNIX_TIMESTAMP(gus_expiration) AS expiration", "gus_expiration AS expiration", "EXTRACT(EPOCH FROM gus_expiration)::integer AS expiration"),
-                        "where",
-                          "gus_session_hash",
-                          session_uid_hash,
-                          "gus_username",
-                          username,
-                          "gus_enabled",
-                          1,
-                          "gus_expiration",
-                            "operator",
-                            "raw",
-                            "value",
-                            expire_clause);
-    o_free(expire_clause);
-    res = h_select(config->conn, j_query, &j_result, NULL);
-    json_decref(j_query);
+    j_params = json_pack("[ss]", session_uid_hash, username);
+    res = execute_statement_json_read(config, &statement_session_for_username, j_params, &j_result, GLEWLWYD_DB_READ_PRIMARY);
+    json_decref(j_params);
     if (res == H_OK) {
       if (json_array_size(j_result) > 0) {
         j_session_scheme = get_session_scheme(config, json_integer_value(json_object_get(json_array_get(j_result, 0), "gus_id")));
@@ -197,7 +174,7 @@ json_t * get_session_for_username(struct config_elements * config, const char *
       }
       json_decref(j_result);
     } else {
-      y_log_message(Y_LOG_LEVEL_ERROR, "get_session_for_username - Error executing j_query");
+      y_log_message(Y_LOG_LEVEL_ERROR, "get_session_for_username - Error executing statement");
       glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
       j_return = json_pack("{si}", "result", G_ERROR_DB);
     }
@@ -210,43 +187,18 @@ json_t * get_session_for_username(struct config_elements * config, const char *
 }
 
 json_t * get_users_for_session(struct config_elements * config, const char * session_uid) {
-  json_t * j_query, * j_result, * j_return, * j_element, * j_user, * j_session_array;
+  json_t * j_params, * j_result, * j_return, * j_element, * j_user, * j_session_array;
   int res;
   size_t index;
-  char * expire_clause, * session_uid_hash;
+  char * session_uid_hash;
 
   if (session_uid != NULL && !o_strnullempty(session_uid)) {
-    if (config->conn->type==HOEL_DB_TYPE_MARIADB) {
-      expire_clause = o_strdup("> NOW()");
-    } else if (config->conn->type==HOEL_DB_TYPE_PGSQL) {
-      expire_clause = o_strdup("> NOW()");
-    } else { // HOEL_DB_TYPE_SQLITE
-      expire_clause = o_strdup("> (strftime('%s','now'))");
-    }
     session_uid_hash = generate_hash(config->hash_algorithm, session_uid);
     if (session_uid_hash != NULL) {
-      j_query = json_pack("{sss[ss]s{sssis{ssss}}ss}",
-                          "table",
-                          GLEWLWYD_TABLE_USER_SESSION,
-                          "columns",
-                            "gus_username",
-                            SWITCH_DB_TYPE(config->conn->type, "UNIX_TIMESTAMP(gus_last_login) AS last_login", "gus_last_login AS last_login", "EXTRACT(EPOCH FROM gus_last_login)::integer AS last_login"),
-                          "where",
-                            "gus_session_hash",
-                            session_uid_hash,
-                            "gus_enabled",
-                            1,
-                            "gus_expiration",
-                              "operator",
-                              "raw",
-                              "value",
-                              expire_clause,
-                          "order_by",
-                          "gus_current DESC");
-      o_free(expire_clause);
+      j_params = json_pack("[s]", session_uid_hash);
       o_free(session_uid_hash);
-      res = h_select(config->conn, j_query, &j_result, NULL);
-      json_decref(j_query);
+      res = execute_statement_json_read(config, &statement_users_for_session, j_params, &j_result, GLEWLWYD_DB_READ_PRIMARY);
+      json_decref(j_params);
       if (res == H_OK) {
         if (json_array_size(j_result) > 0) {
           j_session_array = json_array();
@@ -276,7 +228,7 @@ json_t * get_users_for_session(struct config_elements * config, const char * ses
         }
         json_decref(j_result);
       } else {
-        y_log_message(Y_LOG_LEVEL_ERROR, "get_users_for_session - Error executing j_query");
+        y_log_message(Y_LOG_LEVEL_ERROR, "get_users_for_session - Error executing statement");
         glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
         j_return = json_pack("{si}", "result", G_ERROR_DB);
       }
@@ -290,71 +242,71 @@ json_t * get_users_for_session(struct config_elements * config, const char * ses
   return j_return;
 }
 
-json_t * get_current_user_for_session(struct config_elements * config, const char * session_uid) {
-  json_t * j_query, * j_result, * j_return;
+static json_t * get_current_username_for_session(struct config_elements * config, const char * session_uid) {
+  json_t * j_params, * j_result, * j_return;
   int res;
-  char * expire_clause, * session_uid_hash;
+  char * session_uid_hash;
 
   if (!o_strnullempty(session_uid)) {
-    if (config->conn->type==HOEL_DB_TYPE_MARIADB) {
-      expire_clause = o_strdup("> NOW()");
-    } else if (config->conn->type==HOEL_DB_TYPE_PGSQL) {
-      expire_clause = o_strdup("> NOW()");
-    } else { // HOEL_DB_TYPE_SQLITE
-      expire_clause = o_strdup("> (strftime('%s','now'))");
-    }
     session_uid_hash = generate_hash(config->hash_algorithm, session_uid);
     if (session_uid_hash != NULL) {
-      j_query = json_pack("{sss[ss]s{sssis{ssss}si}sssi}",
-                          "table",
-                          GLEWLWYD_TABLE_USER_SESSION,
-                          "columns",
-                            "gus_username",
-                            SWITCH_DB_TYPE(config->conn->type, "UNIX_TIMESTAMP(gus_expiration) AS expiration", "gus_expiration AS expiration", "EXTRACT(EPOCH FROM gus_expiration)::integer AS expiration"),
-                          "where",
-                            "gus_session_hash",
-                            session_uid_hash,
-                            "gus_enabled",
-                            1,
-                            "gus_expiration",
-                              "operator",
-                              "raw",
-                              "value",
-                              expire_clause,
-                            "gus_current",
-                            1,
-                          "order_by",
-                          "gus_current DESC",
-                          "limit",
-                          1);
-      res = h_select(config->conn, j_query, &j_result, NULL);
-      json_decref(j_query);
+      j_params = json_pack("[s]", session_uid_hash);
+      res = execute_statement_json_read(config, &statement_current_user_for_session, j_params, &j_result, GLEWLWYD_DB_READ_PRIMARY);
+      json_decref(j_params);
       if (res == H_OK) {
         if (json_array_size(j_result) > 0) {
-          j_return = get_user(config, json_string_value(json_object_get(json_array_get(j_result, 0), "gus_username")), NULL);
+          j_return = json_pack("{sisO}", "result", G_OK, "username", json_object_get(json_array_get(j_result, 0), "gus_username"));
         } else {
           j_return = json_pack("{si}", "result", G_ERROR_NOT_FOUND);
         }
         json_decref(j_result);
       } else {
-        y_log_message(Y_LOG_LEVEL_ERROR, "get_current_user_for_session - Error executing j_query");
+        y_log_message(Y_LOG_LEVEL_ERROR, "get_current_username_for_session - Error executing statement");
         glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
         j_return = json_pack("{si}", "result", G_ERROR_DB);
       }
     } else if (session_uid == NULL) {
       j_return = json_pack("{si}", "result", G_ERROR_NOT_FOUND);
     } else {
-      y_log_message(Y_LOG_LEVEL_ERROR, "get_current_user_for_session - Error generate_hash");
+      y_log_message(Y_LOG_LEVEL_ERROR, "get_current_username_for_session - Error generate_hash");
       j_return = json_pack("{si}", "result", G_ERROR);
     }
     o_free(session_uid_hash);
-    o_free(expire_clause);
   } else {
     j_return = json_pack("{si}", "result", G_ERROR_NOT_FOUND);
   }
   return j_return;
 }
 
+json_t * get_current_user_for_session(struct config_elements * config, const char * session_uid) {
+  json_t * j_username = get_current_username_for_session(config, session_uid), * j_return;
+
+  if (check_result_value(j_username, G_OK)) {
+    j_return = get_user(config, json_string_value(json_object_get(j_username, "username")), NULL);
+  } else {
+    j_return = json_pack("{si}", "result", json_integer_value(json_object_get(j_username, "result")));
+  }
+  json_decref(j_username);
+  return j_return;
+}
+
+/**
+ * Same as get_current_user_for_session without copying the user
+ * The view must be released with release_user_view
+ */
+int get_current_user_view_for_session(struct config_elements * config, const char * session_uid, const struct _glewlwyd_user_view ** view) {
+  json_t * j_username = get_current_username_for_session(config, session_uid);
+  int ret;
+
+  if (check_result_value(j_username, G_OK)) {
+    ret = get_user_view(config, json_string_value(json_object_get(j_username, "username")), view);
+  } else {
+    ret = (int)json_integer_value(json_object_get(j_username, "result"));
+  }
+  json_decref(j_username);
+  return ret;
+}
+
 int user_session_update(struct config_elements * config, const char * session_uid, const char * ip_source, const char * user_agent, const char * issued_for, const char * username, const char * scheme_name, int update_login) {
   json_t * j_query, * j_session = get_session_for_username(config, session_uid, username), * j_last_index;
   struct _user_auth_scheme_module_instance * scheme_instance = NULL;
@@ -698,6 +650,9 @@ int user_session_delete(struct config_elements * config, const char * session_ui
       glewlwyd_metrics_increment_counter_va(config, GLWD_METRICS_DATABSE_ERROR, 1, NULL);
       ret = G_ERROR_DB;
     }
+    if (ret == G_OK) {
+      glewlwyd_cache_invalidation_publish(config, GLEWLWYD_CACHE_SESSION, session_uid_hash);
+    }
     o_free(session_uid_hash);
   } else {
     y_log_message(Y_LOG_LEVEL_ERROR, "user_session_delete - Error generate_hash");
@@ -756,7 +711,7 @@ json_t * get_user_session_list(struct config_elements * config, const char * use
     o_free(pattern_clause);
     o_free(pattern_escaped);
   }
-  res = h_select(config->conn, j_query, &j_result, NULL);
+  res = select_read(config, j_query, &j_result, GLEWLWYD_DB_READ_REPLICA);
   json_decref(j_query);
   if (res == H_OK) {
     json_array_foreach(j_result, index, j_element) {
@@ -784,6 +739,7 @@ int delete_user_session_from_hash(struct config_elements * config, const char *
   json_t * j_query, * j_result, * j_element = NULL;
   int res, ret = G_OK;
   unsigned char session_hash_dec[128];
+  char * session_hash_str;
   size_t session_hash_dec_len = 0, index = 0;
   
   j_query = json_pack("{sss[s]s{ss}}",
@@ -833,36 +789,122 @@ int delete_user_session_from_hash(struct config_elements * config, const char *
       ret = G_ERROR_DB;
     }
   }
+  if (ret == G_OK) {
+    if (session_hash != NULL) {
+      session_hash_str = o_strndup((const char *)session_hash_dec, session_hash_dec_len);
+      glewlwyd_cache_invalidation_publish(config, GLEWLWYD_CACHE_SESSION, session_hash_str);
+      o_free(session_hash_str);
+    } else {
+      glewlwyd_cache_invalidation_publish(config, GLEWLWYD_CACHE_SESSION, NULL);
+    }
+  }
   return ret;
 }
 
+/**
+ * Returns the can_use value of a user for the scheme instance
+ * Values are cached per user and scheme for config->scheme_can_use_cache_expiration seconds
+ * A value is not cached if the cache was invalidated while the module computed it,
+ * so a late value can't replace a newer one
+ */
+int get_scheme_can_use(struct config_elements * config, struct _user_auth_scheme_module_instance * instance, const char * username) {
+  json_t * j_cache_user, * j_cache_entry;
+  unsigned int generation = 0;
+  time_t now;
+  int can_use = GLEWLWYD_IS_NOT_AVAILABLE, cached = 0;
+
+  time(&now);
+  if (config->scheme_can_use_cache_expiration && !pthread_mutex_lock(&config->scheme_can_use_cache_lock)) {
+    j_cache_entry = json_object_get(json_object_get(config->j_scheme_can_use_cache, username), instance->name);
+    if (j_cache_entry != NULL && json_integer_value(json_object_get(j_cache_entry, "expires_at")) > (json_int_t)now) {
+      can_use = (int)json_integer_value(json_object_get(j_cache_entry, "can_use"));
+      cached = 1;
+    }
+    generation = config->scheme_can_use_cache_generation;
+    pthread_mutex_unlock(&config->scheme_can_use_cache_lock);
+  }
+  if (!cached) {
+    can_use = instance->module->user_auth_scheme_module_can_use(config->config_m, username, instance->cls);
+    if (config->scheme_can_use_cache_expiration && !pthread_mutex_lock(&config->scheme_can_use_cache_lock)) {
+      if (generation == config->scheme_can_use_cache_generation) {
+        if (json_object_size(config->j_scheme_can_use_cache) >= GLEWLWYD_SCHEME_CAN_USE_CACHE_MAX_USERS) {
+          json_object_clear(config->j_scheme_can_use_cache);
+        }
+        if ((j_cache_user = json_object_get(config->j_scheme_can_use_cache, username)) == NULL) {
+          json_object_set_new(config->j_scheme_can_use_cache, username, (j_cache_user = json_object()));
+        }
+        json_object_set_new(j_cache_user, instance->name, json_pack("{sisI}", "can_use", can_use, "expires_at", (json_int_t)(now + config->scheme_can_use_cache_expiration)));
+      }
+      pthread_mutex_unlock(&config->scheme_can_use_cache_lock);
+    }
+  }
+  return can_use;
+}
+
+static void invalidate_scheme_can_use_cache_local(struct config_elements * config, const char * username, const char * scheme_name) {
+  if (!pthread_mutex_lock(&config->scheme_can_use_cache_lock)) {
+    if (username == NULL) {
+      json_object_clear(config->j_scheme_can_use_cache);
+    } else if (scheme_name == NULL) {
+      json_object_del(config->j_scheme_can_use_cache, username);
+    } else {
+      json_object_del(json_object_get(config->j_scheme_can_use_cache, username), scheme_name);
+    }
+    config->scheme_can_use_cache_generation++;
+    pthread_mutex_unlock(&config->scheme_can_use_cache_lock);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "invalidate_scheme_can_use_cache_local - Error pthread_mutex_lock");
+  }
+}
+
+/**
+ * Removes cached can_use values
+ * All users if username is NULL, all schemes of the user if scheme_name is NULL
+ * The other instances remove all the values of the user
+ */
+void invalidate_scheme_can_use_cache(struct config_elements * config, const char * username, const char * scheme_name) {
+  invalidate_scheme_can_use_cache_local(config, username, scheme_name);
+  glewlwyd_cache_invalidation_publish(config, GLEWLWYD_CACHE_SCHEME_CAN_USE, username);
+}
+
+/**
+ * Cache invalidation handler, key is the username
+ */
+void invalidate_scheme_can_use_cache_callback(const char * cache, const char * key, void * cls) {
+  UNUSED(cache);
+  invalidate_scheme_can_use_cache_local((struct config_elements *)cls, key, NULL);
+}
+
 json_t * get_scheme_list_for_user(struct config_elements * config, const char * username) {
   json_t * j_scheme_modules = get_user_auth_scheme_module_list(config), 
          * j_return, 
          * j_module_array = NULL, 
-         * j_element = NULL;
+         * j_element = NULL,
+         * j_user_scheme;
   size_t index = 0;
   struct _user_auth_scheme_module_instance * instance = NULL;
-  int can_use, has_scheme;
   
   if (check_result_value(j_scheme_modules, G_OK)) {
     j_module_array = json_array();
     if (j_module_array != NULL) {
-      json_array_foreach(json_object_get(j_scheme_modules, "module"), index, j_element) {
-        instance = get_user_auth_scheme_module_instance(config, json_string_value(json_object_get(j_element, "name")));
-        if (instance != NULL) {
-          can_use = instance->module->user_auth_scheme_module_can_use(config->config_m, username, instance->cls);
-          if (can_use != GLEWLWYD_IS_NOT_AVAILABLE) {
-            if ((has_scheme = user_has_scheme(config, username, json_string_value(json_object_get(j_element, "name")))) == G_OK) {
-              json_array_append_new(j_module_array, json_pack("{sOsOsO}", "module", json_object_get(j_element, "module"), "name", json_object_get(j_element, "name"), "display_name", json_object_get(j_element, "display_name")));
-            } else if (has_scheme != G_ERROR_NOT_FOUND) {
-              y_log_message(Y_LOG_LEVEL_ERROR, "get_scheme_list_for_user - Error user_has_scheme");
+      j_user_scheme = get_user_scheme_list(config, username);
+      if (check_result_value(j_user_scheme, G_OK)) {
+        json_array_foreach(json_object_get(j_scheme_modules, "module"), index, j_element) {
+          if (json_object_get(json_object_get(j_user_scheme, "scheme"), json_string_value(json_object_get(j_element, "name"))) != NULL) {
+            instance = get_user_auth_scheme_module_instance(config, json_string_value(json_object_get(j_element, "name")));
+            if (instance != NULL) {
+              if (get_scheme_can_use(config, instance, username) != GLEWLWYD_IS_NOT_AVAILABLE) {
+                json_array_append_new(j_module_array, json_pack("{sOsOsO}", "module", json_object_get(j_element, "module"), "name", json_object_get(j_element, "name"), "display_name", json_object_get(j_element, "display_name")));
+              }
+            } else {
+              y_log_message(Y_LOG_LEVEL_ERROR, "get_scheme_list_for_user - Error instance %s/%s not found", json_string_value(json_object_get(j_element, "module")), json_string_value(json_object_get(j_element, "name")));
             }
           }
-        } else {
-          y_log_message(Y_LOG_LEVEL_ERROR, "get_scheme_list_for_user - Error instance %s/%s not found", json_string_value(json_object_get(j_element, "module")), json_string_value(json_object_get(j_element, "name")));
         }
+      } else if (!check_result_value(j_user_scheme, G_ERROR_NOT_FOUND)) {
+        y_log_message(Y_LOG_LEVEL_ERROR, "get_scheme_list_for_user - Error get_user_scheme_list");
       }
+      json_decref(j_user_scheme);
       j_return = json_pack("{sisO}", "result", G_OK, "scheme", j_module_array);
     } else {
       y_log_message(Y_LOG_LEVEL_ERROR, "get_scheme_list_for_user - Error allocating resources for j_module_array");
@@ -358,6 +358,7 @@ json_t * auth_register_user_scheme(struct config_elements * config, const char *
   } else {
     j_return = json_pack("{si}", "result", G_ERROR_UNAUTHORIZED);
   }
+  invalidate_scheme_can_use_cache(config, username, scheme_name);
   return j_return;
 }
 
@@ -407,43 +408,122 @@ int user_has_scope(json_t * j_user, const char * scope) {
   return 0;
 }
 
-int user_has_scheme(struct config_elements * config, const char * username, const char * scheme_name) {
-  json_t * j_user, * j_element = NULL, * j_group = NULL, * j_scheme = NULL, * j_scope = NULL;
+/**
+ * Returns the names of all the schemes available in the user scopes
+ * The user and its scopes are fetched once
+ */
+json_t * get_user_scheme_list(struct config_elements * config, const char * username) {
+  json_t * j_user, * j_element = NULL, * j_group = NULL, * j_scheme = NULL, * j_scope = NULL, * j_scheme_list, * j_return;
   size_t index = 0, index_s = 0;
   const char * group = NULL;
-  int ret = G_ERROR_NOT_FOUND;
   
   j_user = get_user(config, username, NULL);
   if (check_result_value(j_user, G_OK)) {
-    json_array_foreach(json_object_get(json_object_get(j_user, "user"), "scope"), index, j_element) {
-      j_scope = get_scope(config, json_string_value(j_element));
-      if (check_result_value(j_scope, G_OK)) {
-        json_object_foreach(json_object_get(json_object_get(j_scope, "scope"), "scheme"), group, j_group) {
-          json_array_foreach(j_group, index_s, j_scheme) {
-            if (0 == o_strcmp(json_string_value(json_object_get(j_scheme, "scheme_name")), scheme_name)) {
-              ret = G_OK;
+    if ((j_scheme_list = json_object()) != NULL) {
+      json_array_foreach(json_object_get(json_object_get(j_user, "user"), "scope"), index, j_element) {
+        j_scope = get_scope(config, json_string_value(j_element));
+        if (check_result_value(j_scope, G_OK)) {
+          json_object_foreach(json_object_get(json_object_get(j_scope, "scope"), "scheme"), group, j_group) {
+            json_array_foreach(j_group, index_s, j_scheme) {
+              if (json_string_length(json_object_get(j_scheme, "scheme_name"))) {
+                json_object_set(j_scheme_list, json_string_value(json_object_get(j_scheme, "scheme_name")), json_true());
+              }
             }
           }
+        } else {
+          y_log_message(Y_LOG_LEVEL_ERROR, "get_user_scheme_list - Error get_scope '%s'", json_string_value(j_element));
         }
-      } else {
-        y_log_message(Y_LOG_LEVEL_ERROR, "user_has_scheme - Error get_scope '%s'", json_string_value(j_element));
+        json_decref(j_scope);
       }
-      json_decref(j_scope);
+      j_return = json_pack("{sisO}", "result", G_OK, "scheme", j_scheme_list);
+      json_decref(j_scheme_list);
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "get_user_scheme_list - Error allocating resources for j_scheme_list");
+      j_return = json_pack("{si}", "result", G_ERROR_MEMORY);
     }
-  } else if (!check_result_value(j_user, G_ERROR_NOT_FOUND)) {
-    y_log_message(Y_LOG_LEVEL_ERROR, "user_has_scheme - Error get_user");
-    ret = G_ERROR;
+  } else if (check_result_value(j_user, G_ERROR_NOT_FOUND)) {
+    j_return = json_pack("{si}", "result", G_ERROR_NOT_FOUND);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "get_user_scheme_list - Error get_user");
+    j_return = json_pack("{si}", "result", G_ERROR);
   }
   json_decref(j_user);
+  return j_return;
+}
+
+int user_has_scheme(struct config_elements * config, const char * username, const char * scheme_name) {
+  json_t * j_user_scheme = get_user_scheme_list(config, username);
+  int ret;
+  
+  if (check_result_value(j_user_scheme, G_OK)) {
+    ret = json_object_get(json_object_get(j_user_scheme, "scheme"), scheme_name)!=NULL?G_OK:G_ERROR_NOT_FOUND;
+  } else if (check_result_value(j_user_scheme, G_ERROR_NOT_FOUND)) {
+    ret = G_ERROR_NOT_FOUND;
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "user_has_scheme - Error get_user_scheme_list");
+    ret = G_ERROR;
+  }
+  json_decref(j_user_scheme);
   return ret;
 }
 
-json_t * get_user(struct config_elements * config, const char * username, const char * source) {
+/**
+ * Users resolved during the current callback
+ * A view is kept until the end of the callback, so the session check,
+ * the scope check and the token generation don't query the user backends again
+ */
+struct _user_view_scope {
+  unsigned int         depth;
+  struct _pointer_list view_list;
+};
+
+static __thread struct _user_view_scope user_view_scope = {0, {0, NULL}};
+
+static struct _glewlwyd_user_view * user_view_scope_get(const char * username) {
+  struct _glewlwyd_user_view * view;
+  size_t i;
+
+  for (i=0; i<pointer_list_size(&user_view_scope.view_list); i++) {
+    view = (struct _glewlwyd_user_view *)pointer_list_get_at(&user_view_scope.view_list, i);
+    if (0 == o_strcmp(username, view->lookup)) {
+      return view;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Removes a modified user from the current callback scope
+ * Views already returned to the callers stay valid until they are released
+ */
+static void user_view_scope_remove(const char * username) {
+  struct _glewlwyd_user_view * view;
+  size_t i;
+
+  if (user_view_scope.depth) {
+    for (i=pointer_list_size(&user_view_scope.view_list); i>0; i--) {
+      view = (struct _glewlwyd_user_view *)pointer_list_get_at(&user_view_scope.view_list, i-1);
+      if (0 == o_strcasecmp(username, view->lookup) || 0 == o_strcasecmp(username, view->username)) {
+        pointer_list_remove_at(&user_view_scope.view_list, i-1);
+        release_user_view(view);
+      }
+    }
+  }
+}
+
+static void user_cache_invalidate(struct config_elements * config, const char * username) {
+  user_view_scope_remove(username);
+  glewlwyd_cache_invalidation_local(config, GLEWLWYD_CACHE_USER, username);
+  glewlwyd_cache_invalidation_publish(config, GLEWLWYD_CACHE_USER, username);
+}
+
+static json_t * resolve_user(struct config_elements * config, const char * username, const char * source) {
   int found = 0, result;
   json_t * j_return = NULL, * j_user, * j_module_list, * j_module;
   struct _user_module_instance * user_module;
   struct _user_middleware_module_instance * user_middleware_module;
   size_t index, i;
+  struct _pointer_list * instance_list;
   
   if (o_strnullempty(username)) {
     j_return = json_pack("{si}", "result", G_ERROR_PARAM);
@@ -453,8 +533,9 @@ json_t * get_user(struct config_elements * config, const char * username, const
       j_user = user_module->module->user_module_get(config->config_m, username, user_module->cls);
       if (check_result_value(j_user, G_OK)) {
         result = G_OK;
-        for (i=0; i<pointer_list_size(config->user_middleware_module_instance_list); i++) {
-          user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(config->user_middleware_module_instance_list, i);
+        instance_list = GLEWLWYD_MODULE_LIST_GET(config->user_middleware_module_instance_list);
+        for (i=0; i<pointer_list_size(instance_list); i++) {
+          user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(instance_list, i);
           if (user_middleware_module != NULL && user_middleware_module->enabled) {
             if ((result = user_middleware_module->module->user_middleware_module_get(config->config_m, username, json_object_get(j_user, "user"), user_middleware_module->cls)) != G_OK) {
               y_log_message(Y_LOG_LEVEL_ERROR, "get_user - Error user_middleware_module_get at index %zu for user %s", i, username);
@@ -492,8 +573,9 @@ json_t * get_user(struct config_elements * config, const char * username, const
               if (check_result_value(j_user, G_OK)) {
                 found = 1;
                 result = G_OK;
-                for (i=0; i<pointer_list_size(config->user_middleware_module_instance_list); i++) {
-                  user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(config->user_middleware_module_instance_list, i);
+                instance_list = GLEWLWYD_MODULE_LIST_GET(config->user_middleware_module_instance_list);
+                for (i=0; i<pointer_list_size(instance_list); i++) {
+                  user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(instance_list, i);
                   if (user_middleware_module != NULL && user_middleware_module->enabled) {
                     if ((result = user_middleware_module->module->user_middleware_module_get(config->config_m, username, json_object_get(j_user, "user"), user_middleware_module->cls)) != G_OK) {
                       y_log_message(Y_LOG_LEVEL_ERROR, "get_user - Error user_middleware_module_get at index %zu for user %s", i, username);
@@ -531,12 +613,99 @@ json_t * get_user(struct config_elements * config, const char * username, const
   return j_return;
 }
 
+void user_view_scope_begin(void) {
+  user_view_scope.depth++;
+}
+
+void user_view_scope_end(void) {
+  if (user_view_scope.depth && !--user_view_scope.depth) {
+    pointer_list_clean_free(&user_view_scope.view_list, (void (*)(void *))&release_user_view);
+  }
+}
+
+int get_user_view(struct config_elements * config, const char * username, const struct _glewlwyd_user_view ** view) {
+  struct _glewlwyd_user_view * new_view;
+  json_t * j_user;
+  int ret;
+
+  if (o_strnullempty(username) || view == NULL) {
+    ret = G_ERROR_PARAM;
+  } else if (user_view_scope.depth && (new_view = user_view_scope_get(username)) != NULL) {
+    __atomic_add_fetch(&new_view->refcount, 1, __ATOMIC_RELAXED);
+    *view = new_view;
+    ret = G_OK;
+  } else {
+    j_user = resolve_user(config, username, NULL);
+    if (check_result_value(j_user, G_OK)) {
+      if ((new_view = o_malloc(sizeof(struct _glewlwyd_user_view))) != NULL && (new_view->lookup = o_strdup(username)) != NULL) {
+        new_view->j_user = json_incref(json_object_get(j_user, "user"));
+        new_view->username = json_string_value(json_object_get(new_view->j_user, "username"));
+        new_view->source = json_string_value(json_object_get(new_view->j_user, "source"));
+        new_view->enabled = (json_object_get(new_view->j_user, "enabled") == json_true());
+        new_view->j_scope = json_object_get(new_view->j_user, "scope");
+        new_view->refcount = 1;
+        if (user_view_scope.depth && pointer_list_append(&user_view_scope.view_list, new_view)) {
+          new_view->refcount++;
+        }
+        *view = new_view;
+        ret = G_OK;
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "get_user_view - Error allocating resources for view");
+        o_free(new_view);
+        ret = G_ERROR_MEMORY;
+      }
+    } else if (check_result_value(j_user, G_ERROR_NOT_FOUND)) {
+      ret = G_ERROR_NOT_FOUND;
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "get_user_view - Error resolve_user");
+      ret = G_ERROR;
+    }
+    json_decref(j_user);
+  }
+  return ret;
+}
+
+void release_user_view(const struct _glewlwyd_user_view * view) {
+  struct _glewlwyd_user_view * cur_view = (struct _glewlwyd_user_view *)view;
+
+  if (cur_view != NULL && !__atomic_sub_fetch(&cur_view->refcount, 1, __ATOMIC_ACQ_REL)) {
+    json_decref(cur_view->j_user);
+    o_free(cur_view->lookup);
+    o_free(cur_view);
+  }
+}
+
+/**
+ * The user returned can be modified by the caller, so it's a copy
+ * of the view when the user is already resolved in the current callback
+ */
+json_t * get_user(struct config_elements * config, const char * username, const char * source) {
+  const struct _glewlwyd_user_view * view = NULL;
+  json_t * j_return;
+  int res;
+
+  if (source != NULL) {
+    j_return = resolve_user(config, username, source);
+  } else if ((res = get_user_view(config, username, &view)) == G_OK) {
+    if (__atomic_load_n(&view->refcount, __ATOMIC_RELAXED) > 1) {
+      j_return = json_pack("{siso}", "result", G_OK, "user", json_deep_copy(view->j_user));
+    } else {
+      j_return = json_pack("{sisO}", "result", G_OK, "user", view->j_user);
+    }
+    release_user_view(view);
+  } else {
+    j_return = json_pack("{si}", "result", res==G_ERROR_MEMORY?G_ERROR:res);
+  }
+  return j_return;
+}
+
 json_t * get_user_profile(struct config_elements * config, const char * username, const char * source) {
   int found = 0, result;
   json_t * j_return = NULL, * j_module_list, * j_module, * j_profile;
   struct _user_module_instance * user_module;
   struct _user_middleware_module_instance * user_middleware_module;
   size_t index, i;
+  struct _pointer_list * instance_list;
   
   if (source != NULL) {
     user_module = get_user_module_instance(config, source);
@@ -544,8 +713,9 @@ json_t * get_user_profile(struct config_elements * config, const char * username
       j_profile = user_module->module->user_module_get_profile(config->config_m, username, user_module->cls);
       if (check_result_value(j_profile, G_OK)) {
         result = G_OK;
-        for (i=0; i<pointer_list_size(config->user_middleware_module_instance_list); i++) {
-          user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(config->user_middleware_module_instance_list, i);
+        instance_list = GLEWLWYD_MODULE_LIST_GET(config->user_middleware_module_instance_list);
+        for (i=0; i<pointer_list_size(instance_list); i++) {
+          user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(instance_list, i);
           if (user_middleware_module != NULL && user_middleware_module->enabled) {
             if ((result = user_middleware_module->module->user_middleware_module_get_profile(config->config_m, username, json_object_get(j_profile, "user"), user_middleware_module->cls)) != G_OK) {
               y_log_message(Y_LOG_LEVEL_ERROR, "get_user_profile - Error user_middleware_module_get_profile at index %zu for user %s", i, username);
@@ -581,8 +751,9 @@ json_t * get_user_profile(struct config_elements * config, const char * username
               j_profile = user_module->module->user_module_get_profile(config->config_m, username, user_module->cls);
               if (check_result_value(j_profile, G_OK)) {
                 result = G_OK;
-                for (i=0; i<pointer_list_size(config->user_middleware_module_instance_list); i++) {
-                  user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(config->user_middleware_module_instance_list, i);
+                instance_list = GLEWLWYD_MODULE_LIST_GET(config->user_middleware_module_instance_list);
+                for (i=0; i<pointer_list_size(instance_list); i++) {
+                  user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(instance_list, i);
                   if (user_middleware_module != NULL && user_middleware_module->enabled) {
                     if ((result = user_middleware_module->module->user_middleware_module_get_profile(config->config_m, username, json_object_get(j_profile, "user"), user_middleware_module->cls)) != G_OK) {
                       y_log_message(Y_LOG_LEVEL_ERROR, "get_user_profile - Error user_middleware_module_get_profile at index %d for user %s", i, username);
@@ -624,6 +795,7 @@ json_t * get_user_list(struct config_elements * config, const char * pattern, si
   struct _user_middleware_module_instance * user_middleware_module;
   size_t cur_offset, cur_limit, count_total, index, index_u, i;
   int result;
+  struct _pointer_list * instance_list;
   
   if (source != NULL) {
     user_module = get_user_module_instance(config, source);
@@ -693,8 +865,9 @@ json_t * get_user_list(struct config_elements * config, const char * pattern, si
   }
   if (check_result_value(j_return, G_OK)) {
     result = G_OK;
-    for (i=0; i<pointer_list_size(config->user_middleware_module_instance_list); i++) {
-      user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(config->user_middleware_module_instance_list, i);
+    instance_list = GLEWLWYD_MODULE_LIST_GET(config->user_middleware_module_instance_list);
+    for (i=0; i<pointer_list_size(instance_list); i++) {
+      user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(instance_list, i);
       if (user_middleware_module != NULL && user_middleware_module->enabled) {
         if ((result = user_middleware_module->module->user_middleware_module_get_list(config->config_m, json_object_get(j_return, "user"), user_middleware_module->cls)) != G_OK) {
           y_log_message(Y_LOG_LEVEL_ERROR, "get_user_list - Error user_middleware_module_get_list at index %zu", i);
@@ -716,9 +889,11 @@ json_t * is_user_valid(struct config_elements * config, const char * username, j
   struct _user_module_instance * user_module;
   struct _user_middleware_module_instance * user_middleware_module;
   size_t index, i;
+  struct _pointer_list * instance_list;
   
-  for (i=0; i<pointer_list_size(config->user_middleware_module_instance_list); i++) {
-    user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(config->user_middleware_module_instance_list, i);
+  instance_list = GLEWLWYD_MODULE_LIST_GET(config->user_middleware_module_instance_list);
+  for (i=0; i<pointer_list_size(instance_list); i++) {
+    user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(instance_list, i);
     if (user_middleware_module != NULL && user_middleware_module->enabled) {
       if (user_middleware_module->module->user_middleware_module_update(config->config_m, username, j_user_copy, user_middleware_module->cls) != G_OK) {
         y_log_message(Y_LOG_LEVEL_ERROR, "is_user_valid - Error user_middleware_module_update at index %zu for user %s", i, username);
@@ -793,12 +968,14 @@ int add_user(struct config_elements * config, json_t * j_user, const char * sour
   struct _user_module_instance * user_module;
   struct _user_middleware_module_instance * user_middleware_module;
   size_t index, i;
+  struct _pointer_list * instance_list;
   
   if (source != NULL) {
     user_module = get_user_module_instance(config, source);
     if (user_module != NULL && user_module->enabled && !user_module->readonly) {
-      for (i=0; i<pointer_list_size(config->user_middleware_module_instance_list); i++) {
-        user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(config->user_middleware_module_instance_list, i);
+      instance_list = GLEWLWYD_MODULE_LIST_GET(config->user_middleware_module_instance_list);
+      for (i=0; i<pointer_list_size(instance_list); i++) {
+        user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(instance_list, i);
         if (user_middleware_module != NULL && user_middleware_module->enabled) {
           if ((result = user_middleware_module->module->user_middleware_module_update(config->config_m, json_string_value(json_object_get(j_user, "username")), j_user, user_middleware_module->cls)) != G_OK) {
             y_log_message(Y_LOG_LEVEL_ERROR, "add_user - Error user_middleware_module_get_list at index %zu for user %s", i, json_string_value(json_object_get(j_user, "username")));
@@ -833,8 +1010,9 @@ int add_user(struct config_elements * config, json_t * j_user, const char * sour
         if (!found) {
           user_module = get_user_module_instance(config, json_string_value(json_object_get(j_module, "name")));
           if (user_module != NULL && user_module->enabled && !user_module->readonly) {
-            for (i=0; i<pointer_list_size(config->user_middleware_module_instance_list); i++) {
-              user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(config->user_middleware_module_instance_list, i);
+            instance_list = GLEWLWYD_MODULE_LIST_GET(config->user_middleware_module_instance_list);
+            for (i=0; i<pointer_list_size(instance_list); i++) {
+              user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(instance_list, i);
               if (user_middleware_module != NULL && user_middleware_module->enabled) {
                 if ((result = user_middleware_module->module->user_middleware_module_update(config->config_m, json_string_value(json_object_get(j_user, "username")), j_user, user_middleware_module->cls)) != G_OK) {
                   y_log_message(Y_LOG_LEVEL_ERROR, "add_user - Error user_middleware_module_get_list at index %zu for user %s", i, json_string_value(json_object_get(j_user, "username")));
@@ -868,6 +1046,7 @@ int add_user(struct config_elements * config, json_t * j_user, const char * sour
       ret = G_ERROR_NOT_FOUND;
     }
   }
+  invalidate_scheme_can_use_cache(config, json_string_value(json_object_get(j_user, "username")), NULL);
   return ret;
 }
 
@@ -877,12 +1056,14 @@ int set_user(struct config_elements * config, const char * username, json_t * j_
   struct _user_middleware_module_instance * user_middleware_module;
   json_t * j_cur_user;
   size_t i;
+  struct _pointer_list * instance_list;
   
   if (source != NULL) {
     user_module = get_user_module_instance(config, source);
     if (user_module != NULL && user_module->enabled && !user_module->readonly) {
-      for (i=0; i<pointer_list_size(config->user_middleware_module_instance_list); i++) {
-        user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(config->user_middleware_module_instance_list, i);
+      instance_list = GLEWLWYD_MODULE_LIST_GET(config->user_middleware_module_instance_list);
+      for (i=0; i<pointer_list_size(instance_list); i++) {
+        user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(instance_list, i);
         if (user_middleware_module != NULL && user_middleware_module->enabled) {
           if ((result = user_middleware_module->module->user_middleware_module_update(config->config_m, username, j_user, user_middleware_module->cls)) != G_OK) {
             y_log_message(Y_LOG_LEVEL_ERROR, "set_user - Error user_middleware_module_update at index %zu for user %s", i, username);
@@ -918,6 +1099,10 @@ int set_user(struct config_elements * config, const char * username, json_t * j_
   } else {
     ret = G_ERROR_PARAM;
   }
+  if (ret == G_OK) {
+    user_cache_invalidate(config, username);
+  }
+  invalidate_scheme_can_use_cache(config, username, NULL);
   return ret;
 }
 
@@ -930,14 +1115,16 @@ int delete_user(struct config_elements * config, const char * username, const ch
   json_t * j_cur_user;
   int result;
   size_t i;
+  struct _pointer_list * instance_list;
   
   if (source != NULL) {
     user_module = get_user_module_instance(config, source);
     if (user_module != NULL && user_module->enabled && !user_module->readonly) {
       j_cur_user = user_module->module->user_module_get(config->config_m, username, user_module->cls);
       if (check_result_value(j_cur_user, G_OK)) {
-        for (i=0; i<pointer_list_size(config->user_middleware_module_instance_list); i++) {
-          user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(config->user_middleware_module_instance_list, i);
+        instance_list = GLEWLWYD_MODULE_LIST_GET(config->user_middleware_module_instance_list);
+        for (i=0; i<pointer_list_size(instance_list); i++) {
+          user_middleware_module = (struct _user_middleware_module_instance *)pointer_list_get_at(instance_list, i);
           if (user_middleware_module != NULL && user_middleware_module->enabled) {
             if ((result = user_middleware_module->module->user_middleware_module_delete(config->config_m, username, j_cur_user, user_middleware_module->cls)) != G_OK) {
               y_log_message(Y_LOG_LEVEL_ERROR, "delete_user - Error user_middleware_module_delete at index %zu for user %s", i, username);
@@ -961,8 +1148,9 @@ int delete_user(struct config_elements * config, const char * username, const ch
         ret = G_ERROR;
       }
       if (ret == G_OK) {
-        for (i = 0; i < pointer_list_size(config->user_auth_scheme_module_instance_list); i++) {
-          scheme_module = pointer_list_get_at(config->user_auth_scheme_module_instance_list, i);
+        instance_list = GLEWLWYD_MODULE_LIST_GET(config->user_auth_scheme_module_instance_list);
+        for (i = 0; i < pointer_list_size(instance_list); i++) {
+          scheme_module = pointer_list_get_at(instance_list, i);
           if (scheme_module != NULL && scheme_module->enabled) {
             if ((ret = scheme_module->module->user_auth_scheme_module_deregister(config->config_m, username, scheme_module->cls)) != G_OK) {
               y_log_message(Y_LOG_LEVEL_ERROR, "delete_user - Error user_auth_scheme_module_deregister for scheme %s", scheme_module->name);
@@ -972,8 +1160,9 @@ int delete_user(struct config_elements * config, const char * username, const ch
         }
       }
       if (ret == G_OK) {
-        for (i = 0; i < pointer_list_size(config->plugin_module_instance_list); i++) {
-          plugin_module = pointer_list_get_at(config->plugin_module_instance_list, i);
+        instance_list = GLEWLWYD_MODULE_LIST_GET(config->plugin_module_instance_list);
+        for (i = 0; i < pointer_list_size(instance_list); i++) {
+          plugin_module = pointer_list_get_at(instance_list, i);
           if (plugin_module != NULL && plugin_module->enabled) {
             if ((ret = plugin_module->module->plugin_user_revoke(config->config_p, username, plugin_module->cls)) != G_OK) {
               y_log_message(Y_LOG_LEVEL_ERROR, "delete_user - Error plugin_user_revoke for plugin %s", plugin_module->name);
@@ -992,6 +1181,10 @@ int delete_user(struct config_elements * config, const char * username, const ch
   } else {
     ret = G_ERROR_PARAM;
   }
+  if (ret == G_OK) {
+    user_cache_invalidate(config, username);
+  }
+  invalidate_scheme_can_use_cache(config, username, NULL);
   return ret;
 }
 
@@ -1045,6 +1238,10 @@ json_t * user_set_profile(struct config_elements * config, const char * username
     j_return = json_pack("{si}", "result", G_ERROR);
   }
   json_decref(j_user);
+  if (check_result_value(j_return, G_OK)) {
+    user_cache_invalidate(config, username);
+  }
+  invalidate_scheme_can_use_cache(config, username, NULL);
   return j_return;
 }
 
@@ -1055,6 +1252,7 @@ int user_delete_profile(struct config_elements * config, const char * username)
   struct _plugin_module_instance * plugin_module;
   int ret;
   size_t i;
+  struct _pointer_list * instance_list;
 
   if (check_result_value(j_user, G_OK)) {
     user_module = get_user_module_instance(config, json_string_value(json_object_get(json_object_get(j_user, "user"), "source")));
@@ -1073,8 +1271,9 @@ int user_delete_profile(struct config_elements * config, const char * username)
         }
       }
       if (ret == G_OK && !(config->delete_profile & GLEWLWYD_PROFILE_DELETE_DISABLE_PROFILE)) {
-        for (i = 0; i < pointer_list_size(config->user_auth_scheme_module_instance_list); i++) {
-          scheme_module = pointer_list_get_at(config->user_auth_scheme_module_instance_list, i);
+        instance_list = GLEWLWYD_MODULE_LIST_GET(config->user_auth_scheme_module_instance_list);
+        for (i = 0; i < pointer_list_size(instance_list); i++) {
+          scheme_module = pointer_list_get_at(instance_list, i);
           if (scheme_module != NULL && scheme_module->enabled) {
             if ((ret = scheme_module->module->user_auth_scheme_module_deregister(config->config_m, username, scheme_module->cls)) != G_OK) {
               y_log_message(Y_LOG_LEVEL_ERROR, "user_delete_profile - Error user_auth_scheme_module_deregister for scheme %s", scheme_module->name);
@@ -1084,8 +1283,9 @@ int user_delete_profile(struct config_elements * config, const char * username)
         }
       }
       if (ret == G_OK && !(config->delete_profile & GLEWLWYD_PROFILE_DELETE_DISABLE_PROFILE)) {
-        for (i = 0; i < pointer_list_size(config->plugin_module_instance_list); i++) {
-          plugin_module = pointer_list_get_at(config->plugin_module_instance_list, i);
+        instance_list = GLEWLWYD_MODULE_LIST_GET(config->plugin_module_instance_list);
+        for (i = 0; i < pointer_list_size(instance_list); i++) {
+          plugin_module = pointer_list_get_at(instance_list, i);
           if (plugin_module != NULL && plugin_module->enabled) {
             if ((ret = plugin_module->module->plugin_user_revoke(config->config_p, username, plugin_module->cls)) != G_OK) {
               y_log_message(Y_LOG_LEVEL_ERROR, "user_delete_profile - Error plugin_user_revoke for plugin %s", plugin_module->name);
@@ -1106,6 +1306,10 @@ int user_delete_profile(struct config_elements * config, const char * username)
     ret = G_ERROR;
   }
   json_decref(j_user);
+  if (ret == G_OK) {
+    user_cache_invalidate(config, username);
+  }
+  invalidate_scheme_can_use_cache(config, username, NULL);
   return ret;
 }
 
@@ -1139,6 +1343,9 @@ int user_update_password(struct config_elements * config, const char * username,
     ret = G_ERROR;
   }
   json_decref(j_user);
+  if (ret == G_OK) {
+    user_cache_invalidate(config, username);
+  }
   return ret;
 }
 
@@ -1164,6 +1371,9 @@ int user_set_password(struct config_elements * config, const char * username, co
     ret = G_ERROR;
   }
   json_decref(j_user);
+  if (ret == G_OK) {
+    user_cache_invalidate(config, username);
+  }
   return ret;
 }
 
@@ -1261,3 +1471,19 @@ void glewlwyd_module_callback_update_issued_for(struct config_module * config, c
   }
   update_issued_for(config->glewlwyd_config, cur_conn, sql_table, issued_for_column, issued_for_value, id_column, id_value);
 }
+
+int glewlwyd_module_callback_cache_invalidation_register(struct config_module * config, const char * cache, glewlwyd_cache_invalidation_callback callback, void * cls) {
+  return glewlwyd_cache_invalidation_register(config->glewlwyd_config, cache, callback, cls);
+}
+
+int glewlwyd_module_callback_cache_invalidation_unregister(struct config_module * config, const char * cache, void * cls) {
+  return glewlwyd_cache_invalidation_unregister(config->glewlwyd_config, cache, cls);
+}
+
+int glewlwyd_module_callback_cache_invalidation_publish(struct config_module * config, const char * cache, const char * key) {
+  return glewlwyd_cache_invalidation_publish(config->glewlwyd_config, cache, key);
+}
+
+int glewlwyd_module_callback_http_send_request(struct config_module * config, const struct _u_request * request, struct _u_response * response) {
+  return glewlwyd_http_client_send_request(config->glewlwyd_config, request, response);
+}
@@ -32,6 +32,16 @@
 #include <ulfius.h>
 #include "glewlwyd-common.h"
 
+struct mod_parameters {
+  json_t                      * j_params;
+  struct _glwd_credential_cache credential_cache;
+};
+
+static void credential_cache_invalidate(const char * cache, const char * key, void * cls) {
+  UNUSED(cache);
+  glewlwyd_credential_cache_remove(&((struct mod_parameters *)cls)->credential_cache, key);
+}
+
 json_t * user_module_load(struct config_module * config) {
   UNUSED(config);
   return json_pack("{sisssssssf}",
@@ -48,11 +58,11 @@ int user_module_unload(struct config_module * config) {
 }
 
 json_t * user_module_init(struct config_module * config, int readonly, int multiple_passwords, json_t * j_params, void ** cls) {
-  UNUSED(config);
   UNUSED(readonly);
   UNUSED(multiple_passwords);
   size_t index = 0;
   json_t * j_element = NULL, * j_return = NULL;
+  struct mod_parameters * param;
   int ret;
   
   if (json_is_object(j_params)) {
@@ -72,6 +82,14 @@ json_t * user_module_init(struct config_module * config, int readonly, int multi
       y_log_message(Y_LOG_LEVEL_ERROR, "user_module_init http - parameter username-format is optional and must contain {username}");
       j_return = json_pack("{sis[s]}", "result", G_ERROR_PARAM, "error", "parameter username-format is optional and must contain {username}");
       ret = G_ERROR_PARAM;
+    } else if (json_object_get(j_params, "credential-cache-duration") != NULL && (!json_is_integer(json_object_get(j_params, "credential-cache-duration")) || json_integer_value(json_object_get(j_params, "credential-cache-duration")) < 0)) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "user_module_init http - parameter credential-cache-duration is optional and must be a positive integer or 0");
+      j_return = json_pack("{sis[s]}", "result", G_ERROR_PARAM, "error", "parameter credential-cache-duration is optional and must be a positive integer or 0");
+      ret = G_ERROR_PARAM;
+    } else if (json_object_get(j_params, "credential-cache-max-size") != NULL && (!json_is_integer(json_object_get(j_params, "credential-cache-max-size")) || json_integer_value(json_object_get(j_params, "credential-cache-max-size")) <= 0)) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "user_module_init http - parameter credential-cache-max-size is optional and must be a positive integer");
+      j_return = json_pack("{sis[s]}", "result", G_ERROR_PARAM, "error", "parameter credential-cache-max-size is optional and must be a positive integer");
+      ret = G_ERROR_PARAM;
     } else {
       json_array_foreach(json_object_get(j_params, "default-scope"), index, j_element) {
         if (json_string_null_or_empty(j_element)) {
@@ -92,14 +110,38 @@ json_t * user_module_init(struct config_module * config, int readonly, int multi
     j_return = json_pack("{sis[s]}", "result", G_ERROR_PARAM, "error", "parameters must be a JSON object");
   }
   if (ret == G_OK) {
-    *cls = json_incref(j_params);
+    if ((param = o_malloc(sizeof(struct mod_parameters))) != NULL) {
+      param->j_params = json_incref(j_params);
+      if (glewlwyd_credential_cache_init(&param->credential_cache, (time_t)json_integer_value(json_object_get(j_params, "credential-cache-duration")), json_object_get(j_params, "credential-cache-max-size")!=NULL?(size_t)json_integer_value(json_object_get(j_params, "credential-cache-max-size")):GLEWLWYD_CREDENTIAL_CACHE_MAX_SIZE) == G_OK) {
+        if (param->credential_cache.duration) {
+          config->glewlwyd_module_callback_cache_invalidation_register(config, GLEWLWYD_CACHE_USER, &credential_cache_invalidate, param);
+        }
+        *cls = param;
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "user_module_init http - Error glewlwyd_credential_cache_init");
+        json_decref(param->j_params);
+        o_free(param);
+        json_decref(j_return);
+        j_return = json_pack("{si}", "result", G_ERROR);
+      }
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "user_module_init http - Error allocating resources for param");
+      json_decref(j_return);
+      j_return = json_pack("{si}", "result", G_ERROR_MEMORY);
+    }
   }
   return j_return;
 }
 
 int user_module_close(struct config_module * config, void * cls) {
-  UNUSED(config);
-  json_decref((json_t *)cls);
+  struct mod_parameters * param = (struct mod_parameters *)cls;
+
+  if (param->credential_cache.duration) {
+    config->glewlwyd_module_callback_cache_invalidation_unregister(config, GLEWLWYD_CACHE_USER, param);
+  }
+  glewlwyd_credential_cache_close(&param->credential_cache);
+  json_decref(param->j_params);
+  o_free(param);
   return G_OK;
 }
 
@@ -123,14 +165,14 @@ json_t * user_module_get(struct config_module * config, const char * username, v
   UNUSED(config);
   UNUSED(username);
   UNUSED(cls);
-  return json_pack("{sis{sssOso}}", "result", G_OK, "user", "username", username, "scope", json_object_get((json_t *)cls, "default-scope"), "enabled", json_true());
+  return json_pack("{sis{sssOso}}", "result", G_OK, "user", "username", username, "scope", json_object_get(((struct mod_parameters *)cls)->j_params, "default-scope"), "enabled", json_true());
 }
 
 json_t * user_module_get_profile(struct config_module * config, const char * username, void * cls) {
   UNUSED(config);
   UNUSED(username);
   UNUSED(cls);
-  return json_pack("{sis{sssOso}}", "result", G_OK, "user", "username", username, "scope", json_object_get((json_t *)cls, "default-scope"), "enabled", json_true());
+  return json_pack("{sis{sssOso}}", "result", G_OK, "user", "username", username, "scope", json_object_get(((struct mod_parameters *)cls)->j_params, "default-scope"), "enabled", json_true());
 }
 
 json_t * user_module_is_valid(struct config_module * config, const char * username, json_t * j_user, int mode, void * cls) {
@@ -173,37 +215,42 @@ int user_module_delete(struct config_module * config, const char * username, voi
 }
 
 int user_module_check_password(struct config_module * config, const char * username, const char * password, void * cls) {
-  UNUSED(config);
+  struct mod_parameters * param = (struct mod_parameters *)cls;
   struct _u_request request;
   struct _u_response response;
   int res, ret;
   
+  if (glewlwyd_credential_cache_check(&param->credential_cache, username, password) == G_OK) {
+    return G_OK;
+  }
   ulfius_init_request(&request);
   ulfius_init_response(&response);
   request.http_verb = o_strdup("GET");
-  request.http_url = o_strdup(json_string_value(json_object_get((json_t *)cls, "url")));
-  if (json_object_get((json_t *)cls, "check-server-certificate") == json_false()) {
+  request.http_url = o_strdup(json_string_value(json_object_get(param->j_params, "url")));
+  if (json_object_get(param->j_params, "check-server-certificate") == json_false()) {
     request.check_server_certificate = 0;
   }
-  if (!json_string_null_or_empty(json_object_get((json_t *)cls, "username-format"))) {
-    request.auth_basic_user = str_replace(json_string_value(json_object_get((json_t *)cls, "username-format")), "{username}", username);
+  if (!json_string_null_or_empty(json_object_get(param->j_params, "username-format"))) {
+    request.auth_basic_user = str_replace(json_string_value(json_object_get(param->j_params, "username-format")), "{username}", username);
   } else {
     request.auth_basic_user = o_strdup(username);
   }
   request.auth_basic_password = o_strdup(password);
   
-  res = ulfius_send_http_request(&request, &response);
-  if (res == H_OK) {
+  res = config->glewlwyd_module_callback_http_send_request(config, &request, &response);
+  if (res == G_OK) {
     if (response.status == 200) {
+      glewlwyd_credential_cache_set(&param->credential_cache, username, password);
       ret = G_OK;
     } else {
+      glewlwyd_credential_cache_remove(&param->credential_cache, username);
       if (response.status != 401 && response.status != 403) {
         y_log_message(Y_LOG_LEVEL_WARNING, "user_module_check_password http - Error connecting to webservice %s, response status is %d", request.http_url, response.status);
       }
       ret = G_ERROR_UNAUTHORIZED;
     }
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "user_module_check_password http - Error ulfius_send_http_request");
+    y_log_message(Y_LOG_LEVEL_ERROR, "user_module_check_password http - Error glewlwyd_module_callback_http_send_request");
     ret = G_ERROR;
   }
   
@@ -25,9 +25,199 @@
  *
  */
 #include <string.h>
+#include <stdint.h>
 
 #include "glewlwyd.h"
 
+/**
+ * Cursor used to stream a list response, the rows are fetched
+ * and serialized page by page while the response is sent,
+ * after the endpoint callback returned, so the cursor holds its own module epoch reference
+ */
+struct _glwd_list_stream {
+  struct config_elements * config;
+  struct _module_epoch_ref epoch;
+  json_t              * (* get_page)(struct _glwd_list_stream * list_stream, size_t limit);
+  char                   * pattern;
+  char                   * source;
+  char                   * username;
+  char                   * sort;
+  char                   * after;
+  size_t                   offset;
+  size_t                   limit;
+  size_t                   count;
+  char                   * buffer;
+  size_t                   buffer_len;
+  size_t                   buffer_offset;
+  unsigned short           complete;
+};
+
+static json_t * list_stream_get_user_page(struct _glwd_list_stream * list_stream, size_t limit) {
+  json_t * j_user_list = get_user_list(list_stream->config, list_stream->pattern, list_stream->offset, limit, list_stream->source), * j_return = NULL;
+
+  if (check_result_value(j_user_list, G_OK)) {
+    j_return = json_incref(json_object_get(j_user_list, "user"));
+    list_stream->offset += json_array_size(j_return);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "list_stream_get_user_page - Error get_user_list");
+  }
+  json_decref(j_user_list);
+  return j_return;
+}
+
+static json_t * list_stream_get_client_page(struct _glwd_list_stream * list_stream, size_t limit) {
+  json_t * j_client_list = get_client_list(list_stream->config, list_stream->pattern, list_stream->offset, limit, list_stream->source), * j_return = NULL;
+
+  if (check_result_value(j_client_list, G_OK)) {
+    j_return = json_incref(json_object_get(j_client_list, "client"));
+    list_stream->offset += json_array_size(j_return);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "list_stream_get_client_page - Error get_client_list");
+  }
+  json_decref(j_client_list);
+  return j_return;
+}
+
+static json_t * list_stream_get_scope_page(struct _glwd_list_stream * list_stream, size_t limit) {
+  json_t * j_scope_list = get_scope_list(list_stream->config, list_stream->pattern, list_stream->after, list_stream->offset, limit), * j_return = NULL;
+
+  if (check_result_value(j_scope_list, G_OK)) {
+    j_return = json_incref(json_object_get(j_scope_list, "scope"));
+    if (json_array_size(j_return)) {
+      // Next pages use the last scope name as cursor instead of an offset
+      o_free(list_stream->after);
+      list_stream->after = o_strdup(json_string_value(json_object_get(json_array_get(j_return, json_array_size(j_return)-1), "name")));
+      list_stream->offset = 0;
+    }
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "list_stream_get_scope_page - Error get_scope_list");
+  }
+  json_decref(j_scope_list);
+  return j_return;
+}
+
+static json_t * list_stream_get_session_page(struct _glwd_list_stream * list_stream, size_t limit) {
+  json_t * j_session_list = get_user_session_list(list_stream->config, list_stream->username, list_stream->pattern, list_stream->offset, limit, list_stream->sort), * j_return = NULL;
+
+  if (check_result_value(j_session_list, G_OK)) {
+    j_return = json_incref(json_object_get(j_session_list, "session"));
+    list_stream->offset += json_array_size(j_return);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "list_stream_get_session_page - Error get_user_session_list");
+  }
+  json_decref(j_session_list);
+  return j_return;
+}
+
+/**
+ * Fetch the next page of the list and serialize it in the stream buffer
+ */
+static int list_stream_fill_buffer(struct _glwd_list_stream * list_stream) {
+  json_t * j_page = NULL, * j_element;
+  size_t index, page_limit = MIN(list_stream->limit, GLEWLWYD_LIST_STREAM_PAGE_SIZE);
+  char * str_element;
+  int ret = G_OK;
+
+  o_free(list_stream->buffer);
+  list_stream->buffer = o_strdup(!list_stream->count?"[":"");
+  list_stream->buffer_offset = 0;
+  if (page_limit && (j_page = list_stream->get_page(list_stream, page_limit)) == NULL) {
+    ret = G_ERROR;
+  } else {
+    json_array_foreach(j_page, index, j_element) {
+      if ((str_element = json_dumps(j_element, JSON_COMPACT)) != NULL) {
+        list_stream->buffer = mstrcatf(list_stream->buffer, "%s%s", list_stream->count?",":"", str_element);
+        list_stream->count++;
+        o_free(str_element);
+      } else {
+        y_log_message(Y_LOG_LEVEL_ERROR, "list_stream_fill_buffer - Error json_dumps");
+        ret = G_ERROR_MEMORY;
+        break;
+      }
+    }
+    list_stream->limit -= json_array_size(j_page);
+    if (json_array_size(j_page) < page_limit || !list_stream->limit) {
+      list_stream->buffer = mstrcatf(list_stream->buffer, "]");
+      list_stream->complete = 1;
+    }
+  }
+  json_decref(j_page);
+  list_stream->buffer_len = o_strlen(list_stream->buffer);
+  return ret;
+}
+
+static ssize_t callback_glewlwyd_list_stream(void * cls, uint64_t pos, char * buf, size_t max) {
+  UNUSED(pos);
+  struct _glwd_list_stream * list_stream = (struct _glwd_list_stream *)cls;
+  size_t len;
+
+  if (list_stream->buffer_offset >= list_stream->buffer_len) {
+    if (list_stream->complete) {
+      return U_STREAM_END;
+    } else if (list_stream_fill_buffer(list_stream) != G_OK) {
+      return U_STREAM_ERROR;
+    }
+  }
+  len = MIN(max, list_stream->buffer_len - list_stream->buffer_offset);
+  memcpy(buf, list_stream->buffer + list_stream->buffer_offset, len);
+  list_stream->buffer_offset += len;
+  return (ssize_t)len;
+}
+
+static void callback_glewlwyd_list_stream_free(void * cls) {
+  struct _glwd_list_stream * list_stream = (struct _glwd_list_stream *)cls;
+
+  if (list_stream != NULL) {
+    o_free(list_stream->pattern);
+    o_free(list_stream->source);
+    o_free(list_stream->username);
+    o_free(list_stream->sort);
+    o_free(list_stream->after);
+    o_free(list_stream->buffer);
+    glewlwyd_module_epoch_leave(list_stream->config, &list_stream->epoch);
+    o_free(list_stream);
+  }
+}
+
+static struct _glwd_list_stream * list_stream_new(struct config_elements * config, json_t * (* get_page)(struct _glwd_list_stream * list_stream, size_t limit), const char * pattern, size_t offset, size_t limit) {
+  struct _glwd_list_stream * list_stream = o_malloc(sizeof(struct _glwd_list_stream));
+
+  if (list_stream != NULL) {
+    memset(list_stream, 0, sizeof(struct _glwd_list_stream));
+    list_stream->config = config;
+    glewlwyd_module_epoch_enter(config, &list_stream->epoch);
+    list_stream->get_page = get_page;
+    list_stream->pattern = o_strdup(pattern);
+    list_stream->offset = offset;
+    // A streamed list is meant to export large lists, limit 0 means no limit for all the lists
+    list_stream->limit = limit?limit:SIZE_MAX;
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "list_stream_new - Error allocating resources for list_stream");
+  }
+  return list_stream;
+}
+
+/**
+ * Send the list as a chunked response, so large lists never fully live in memory
+ */
+static int set_list_stream_response(struct _u_response * response, struct _glwd_list_stream * list_stream) {
+  int ret;
+
+  if (list_stream != NULL) {
+    ulfius_add_header_to_response(response, "Content-Type", "application/json");
+    if (ulfius_set_stream_response(response, 200, callback_glewlwyd_list_stream, callback_glewlwyd_list_stream_free, U_STREAM_SIZE_UNKNOWN, GLEWLWYD_LIST_STREAM_BLOCK_SIZE, list_stream) == U_OK) {
+      ret = G_OK;
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "set_list_stream_response - Error ulfius_set_stream_response");
+      callback_glewlwyd_list_stream_free(list_stream);
+      ret = G_ERROR;
+    }
+  } else {
+    ret = G_ERROR_MEMORY;
+  }
+  return ret;
+}
+
 int callback_glewlwyd_options (const struct _u_request * request, struct _u_response * response, void * user_data) {
   UNUSED(request);
   
@@ -77,14 +267,13 @@ int callback_404_if_necessary (const struct _u_request * request, struct _u_resp
 int callback_glewlwyd_check_user_profile_valid (const struct _u_request * request, struct _u_response * response, void * user_data) {
   struct config_elements * config = (struct config_elements *)user_data;
   char * session_uid;
-  json_t * j_user;
+  const struct _glewlwyd_user_view * view = NULL;
   int ret, res;
   
   if ((session_uid = get_session_id(config, request)) != NULL) {
-    j_user = get_current_user_for_session(config, session_uid);
-    if (check_result_value(j_user, G_OK) && json_object_get(json_object_get(j_user, "user"), "enabled") == json_true()) {
+    if (get_current_user_view_for_session(config, session_uid, &view) == G_OK && view->enabled) {
       if ((res = is_scope_list_valid_for_session(config, config->profile_scope, session_uid)) == G_OK) {
-        if (ulfius_set_response_shared_data(response, json_deep_copy(json_object_get(j_user, "user")), (void (*)(void *))&json_decref) != U_OK) {
+        if (ulfius_set_response_shared_data(response, json_incref(view->j_user), (void (*)(void *))&json_decref) != U_OK) {
           ret = U_CALLBACK_ERROR;
         } else {
           ret = U_CALLBACK_IGNORE;
@@ -98,7 +287,7 @@ int callback_glewlwyd_check_user_profile_valid (const struct _u_request * reques
     } else {
       ret = U_CALLBACK_UNAUTHORIZED;
     }
-    json_decref(j_user);
+    release_user_view(view);
   } else {
     ret = U_CALLBACK_UNAUTHORIZED;
   }
@@ -109,13 +298,12 @@ int callback_glewlwyd_check_user_profile_valid (const struct _u_request * reques
 int callback_glewlwyd_check_user_session (const struct _u_request * request, struct _u_response * response, void * user_data) {
   struct config_elements * config = (struct config_elements *)user_data;
   char * session_uid;
-  json_t * j_user;
+  const struct _glewlwyd_user_view * view = NULL;
   int ret;
   
   if ((session_uid = get_session_id(config, request)) != NULL) {
-    j_user = get_current_user_for_session(config, session_uid);
-    if (check_result_value(j_user, G_OK) && json_object_get(json_object_get(j_user, "user"), "enabled") == json_true()) {
-      if (ulfius_set_response_shared_data(response, json_deep_copy(json_object_get(j_user, "user")), (void (*)(void *))&json_decref) != U_OK) {
+    if (get_current_user_view_for_session(config, session_uid, &view) == G_OK && view->enabled) {
+      if (ulfius_set_response_shared_data(response, json_incref(view->j_user), (void (*)(void *))&json_decref) != U_OK) {
         ret = U_CALLBACK_ERROR;
       } else {
         ret = U_CALLBACK_IGNORE;
@@ -123,7 +311,7 @@ int callback_glewlwyd_check_user_session (const struct _u_request * request, str
     } else {
       ret = U_CALLBACK_UNAUTHORIZED;
     }
-    json_decref(j_user);
+    release_user_view(view);
   } else {
     ret = U_CALLBACK_UNAUTHORIZED;
   }
@@ -134,14 +322,13 @@ int callback_glewlwyd_check_user_session (const struct _u_request * request, str
 int callback_glewlwyd_check_admin_session (const struct _u_request * request, struct _u_response * response, void * user_data) {
   struct config_elements * config = (struct config_elements *)user_data;
   char * session_uid;
-  json_t * j_user;
+  const struct _glewlwyd_user_view * view = NULL;
   int ret, res;
   
   if ((session_uid = get_session_id(config, request)) != NULL) {
-    j_user = get_current_user_for_session(config, session_uid);
-    if (check_result_value(j_user, G_OK) && json_object_get(json_object_get(j_user, "user"), "enabled") == json_true()) {
+    if (get_current_user_view_for_session(config, session_uid, &view) == G_OK && view->enabled) {
       if ((res = is_scope_list_valid_for_session(config, config->admin_scope, session_uid)) == G_OK) {
-        if (ulfius_set_response_shared_data(response, json_deep_copy(json_object_get(j_user, "user")), (void (*)(void *))&json_decref) != U_OK) {
+        if (ulfius_set_response_shared_data(response, json_incref(view->j_user), (void (*)(void *))&json_decref) != U_OK) {
           ret = U_CALLBACK_ERROR;
         } else {
           ret = U_CALLBACK_IGNORE;
@@ -155,7 +342,7 @@ int callback_glewlwyd_check_admin_session (const struct _u_request * request, st
     } else {
       ret = U_CALLBACK_UNAUTHORIZED;
     }
-    json_decref(j_user);
+    release_user_view(view);
   } else {
     ret = U_CALLBACK_UNAUTHORIZED;
   }
@@ -166,7 +353,7 @@ int callback_glewlwyd_check_admin_session (const struct _u_request * request, st
 int callback_glewlwyd_check_admin_session_or_api_key (const struct _u_request * request, struct _u_response * response, void * user_data) {
   struct config_elements * config = (struct config_elements *)user_data;
   char * session_uid = NULL;
-  json_t * j_user;
+  const struct _glewlwyd_user_view * view = NULL;
   int ret, res;
   const char * api_key = u_map_get_case(request->map_header, GLEWLWYD_API_KEY_HEADER_KEY), * ip_source = get_ip_source(request);
   
@@ -185,10 +372,9 @@ int callback_glewlwyd_check_admin_session_or_api_key (const struct _u_request *
       ret = U_CALLBACK_ERROR;
     }
   } else if ((session_uid = get_session_id(config, request)) != NULL) {
-    j_user = get_current_user_for_session(config, session_uid);
-    if (check_result_value(j_user, G_OK) && json_object_get(json_object_get(j_user, "user"), "enabled") == json_true()) {
+    if (get_current_user_view_for_session(config, session_uid, &view) == G_OK && view->enabled) {
       if ((res = is_scope_list_valid_for_session(config, config->admin_scope, session_uid)) == G_OK) {
-        if (ulfius_set_response_shared_data(response, json_deep_copy(json_object_get(j_user, "user")), (void (*)(void *))&json_decref) != U_OK) {
+        if (ulfius_set_response_shared_data(response, json_incref(view->j_user), (void (*)(void *))&json_decref) != U_OK) {
           ret = U_CALLBACK_ERROR;
         } else {
           ret = U_CALLBACK_IGNORE;
@@ -202,7 +388,7 @@ int callback_glewlwyd_check_admin_session_or_api_key (const struct _u_request *
     } else {
       ret = U_CALLBACK_UNAUTHORIZED;
     }
-    json_decref(j_user);
+    release_user_view(view);
     o_free(session_uid);
   } else {
     ret = U_CALLBACK_UNAUTHORIZED;
@@ -213,16 +399,16 @@ int callback_glewlwyd_check_admin_session_or_api_key (const struct _u_request *
 int callback_glewlwyd_check_admin_session_delegate (const struct _u_request * request, struct _u_response * response, void * user_data) {
   struct config_elements * config = (struct config_elements *)user_data;
   char * session_uid;
-  json_t * j_user, * j_delegate;
+  const struct _glewlwyd_user_view * view = NULL;
+  json_t * j_delegate;
   int ret;
   
   if ((session_uid = get_session_id(config, request)) != NULL) {
-    j_user = get_current_user_for_session(config, session_uid);
-    if (check_result_value(j_user, G_OK) && json_object_get(json_object_get(j_user, "user"), "enabled") == json_true()) {
+    if (get_current_user_view_for_session(config, session_uid, &view) == G_OK && view->enabled) {
       if (is_scope_list_valid_for_session(config, config->admin_scope, session_uid) == G_OK) {
         j_delegate = get_user(config, u_map_get(request->map_url, "username"), NULL);
         if (check_result_value(j_delegate, G_OK)) {
-          if (ulfius_set_response_shared_data(response, json_deep_copy(json_object_get(j_delegate, "user")), (void (*)(void *))&json_decref) != U_OK) {
+          if (ulfius_set_response_shared_data(response, json_incref(json_object_get(j_delegate, "user")), (void (*)(void *))&json_decref) != U_OK) {
             ret = U_CALLBACK_ERROR;
           } else {
             ret = U_CALLBACK_IGNORE;
@@ -237,7 +423,7 @@ int callback_glewlwyd_check_admin_session_delegate (const struct _u_request * re
     } else {
       ret = U_CALLBACK_UNAUTHORIZED;
     }
-    json_decref(j_user);
+    release_user_view(view);
   } else {
     ret = U_CALLBACK_UNAUTHORIZED;
   }
@@ -253,6 +439,7 @@ int callback_glewlwyd_user_auth (const struct _u_request * request, struct _u_re
   char * session_uid, expires[129];
   time_t now;
   struct tm ts;
+  unsigned int retry_after = 0;
   
   time(&now);
   now += GLEWLWYD_DEFAULT_SESSION_EXPIRATION_COOKIE;
@@ -260,7 +447,9 @@ int callback_glewlwyd_user_auth (const struct _u_request * request, struct _u_re
   strftime(expires, 128, "%a, %d %b %Y %T %Z", &ts);
   if (j_param != NULL) {
     if (!json_string_null_or_empty(json_object_get(j_param, "username"))) {
-      if (json_object_get(j_param, "scheme_type") == NULL || 0 == o_strcmp(json_string_value(json_object_get(j_param, "scheme_type")), "password")) {
+      if (glewlwyd_rate_limit_check(config, "auth", ip_source, json_string_value(json_object_get(j_param, "username")), NULL, &retry_after) == G_ERROR_UNAUTHORIZED) {
+        glewlwyd_rate_limit_set_response(response, retry_after);
+      } else if (json_object_get(j_param, "scheme_type") == NULL || 0 == o_strcmp(json_string_value(json_object_get(j_param, "scheme_type")), "password")) {
         if (!json_string_null_or_empty(json_object_get(j_param, "password"))) {
           j_result = auth_check_user_credentials(config, json_string_value(json_object_get(j_param, "username")), json_string_value(json_object_get(j_param, "password")));
           if (check_result_value(j_result, G_OK)) {
@@ -788,68 +977,30 @@ int callback_glewlwyd_reload_modules (const struct _u_request * request, struct
   struct config_elements * config = (struct config_elements *)user_data;
   UNUSED(request);
 
-  close_user_module_instance_list(config);
-  close_user_module_list(config);
-  
-  close_user_middleware_module_instance_list(config);
-  close_user_middleware_module_list(config);
-  
-  close_client_module_instance_list(config);
-  close_client_module_list(config);
-  
-  close_user_auth_scheme_module_instance_list(config);
-  close_user_auth_scheme_module_list(config);
-  
-  close_plugin_module_instance_list(config);
-  close_plugin_module_list(config);
-  
-  // Initialize user modules
-  if (init_user_module_list(config) != G_OK) {
-    y_log_message(Y_LOG_LEVEL_ERROR, "Error initializing user modules");
-    response->status = 500;
-  }
-  if (load_user_module_instance_list(config) != G_OK) {
-    y_log_message(Y_LOG_LEVEL_ERROR, "Error loading user modules instances");
+  // New modules and instances are loaded alongside the current ones, the current ones are closed when they're not used anymore
+  if (reload_user_module_list(config) != G_OK) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "Error reloading user modules");
     response->status = 500;
   }
 
-  // Initialize user modules
-  if (init_user_middleware_module_list(config) != G_OK) {
-    y_log_message(Y_LOG_LEVEL_ERROR, "Error initializing user middleware modules");
-    response->status = 500;
-  }
-  if (load_user_middleware_module_instance_list(config) != G_OK) {
-    y_log_message(Y_LOG_LEVEL_ERROR, "Error loading user middleware modules instances");
+  if (reload_user_middleware_module_list(config) != G_OK) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "Error reloading user middleware modules");
     response->status = 500;
   }
 
-  // Initialize client modules
-  if (init_client_module_list(config) != G_OK) {
-    y_log_message(Y_LOG_LEVEL_ERROR, "Error initializing client modules");
-    response->status = 500;
-  }
-  if (load_client_module_instance_list(config) != G_OK) {
-    y_log_message(Y_LOG_LEVEL_ERROR, "Error loading client modules instances");
+  if (reload_client_module_list(config) != G_OK) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "Error reloading client modules");
     response->status = 500;
   }
 
-  // Initialize user auth scheme modules
-  if (init_user_auth_scheme_module_list(config) != G_OK) {
-    y_log_message(Y_LOG_LEVEL_ERROR, "Error initializing user auth scheme modules");
-    response->status = 500;
-  }
-  if (load_user_auth_scheme_module_instance_list(config) != G_OK) {
-    y_log_message(Y_LOG_LEVEL_ERROR, "Error loading user auth scheme modules instances");
+  if (reload_user_auth_scheme_module_list(config) != G_OK) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "Error reloading user auth scheme modules");
     response->status = 500;
   }
 
-  // Initialize plugins
-  if (init_plugin_module_list(config) != G_OK) {
-    y_log_message(Y_LOG_LEVEL_ERROR, "Error initializing plugins modules");
-    response->status = 500;
-  }
-  if (load_plugin_module_instance_list(config) != G_OK) {
-    y_log_message(Y_LOG_LEVEL_ERROR, "Error loading plugins modules instances");
+  // Plugins endpoints can't be declared twice, so plugin instances are closed before being loaded again
+  if (reload_plugin_module_list(config) != G_OK) {
+    y_log_message(Y_LOG_LEVEL_ERROR, "Error reloading plugins modules");
     response->status = 500;
   }
 
@@ -1898,6 +2049,7 @@ int callback_glewlwyd_manage_plugin_module (const struct _u_request * request, s
 
 int callback_glewlwyd_get_user_list (const struct _u_request * request, struct _u_response * response, void * user_data) {
   struct config_elements * config = (struct config_elements *)user_data;
+  struct _glwd_list_stream * list_stream;
   json_t * j_user_list;
   size_t offset = 0, limit = GLEWLWYD_DEFAULT_LIMIT_SIZE;
   long int l_converted = 0;
@@ -1911,18 +2063,28 @@ int callback_glewlwyd_get_user_list (const struct _u_request * request, struct _
   }
   if (u_map_get(request->map_url, "limit") != NULL) {
     l_converted = strtol(u_map_get(request->map_url, "limit"), &endptr, 10);
-    if (!(*endptr) && l_converted > 0) {
+    if (!(*endptr) && (l_converted > 0 || (!l_converted && u_map_get(request->map_url, "stream") != NULL))) {
       limit = (size_t)l_converted;
     }
   }
-  j_user_list = get_user_list(config, u_map_get(request->map_url, "pattern"), offset, limit, u_map_get(request->map_url, "source"));
-  if (check_result_value(j_user_list, G_OK)) {
-    ulfius_set_json_body_response(response, 200, json_object_get(j_user_list, "user"));
+  if (u_map_get(request->map_url, "stream") != NULL) {
+    if ((list_stream = list_stream_new(config, &list_stream_get_user_page, u_map_get(request->map_url, "pattern"), offset, limit)) != NULL) {
+      list_stream->source = o_strdup(u_map_get(request->map_url, "source"));
+    }
+    if (set_list_stream_response(response, list_stream) != G_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "callback_glewlwyd_get_user_list - Error set_list_stream_response");
+      response->status = 500;
+    }
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "callback_glewlwyd_get_user_list - Error get_user_list");
-    response->status = 500;
+    j_user_list = get_user_list(config, u_map_get(request->map_url, "pattern"), offset, limit, u_map_get(request->map_url, "source"));
+    if (check_result_value(j_user_list, G_OK)) {
+      ulfius_set_json_body_response(response, 200, json_object_get(j_user_list, "user"));
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "callback_glewlwyd_get_user_list - Error get_user_list");
+      response->status = 500;
+    }
+    json_decref(j_user_list);
   }
-  json_decref(j_user_list);
   return U_CALLBACK_CONTINUE;
 }
 
@@ -2051,6 +2213,7 @@ int callback_glewlwyd_delete_user (const struct _u_request * request, struct _u_
 
 int callback_glewlwyd_get_client_list (const struct _u_request * request, struct _u_response * response, void * user_data) {
   struct config_elements * config = (struct config_elements *)user_data;
+  struct _glwd_list_stream * list_stream;
   json_t * j_client_list;
   size_t offset = 0, limit = GLEWLWYD_DEFAULT_LIMIT_SIZE;
   long int l_converted = 0;
@@ -2064,18 +2227,28 @@ int callback_glewlwyd_get_client_list (const struct _u_request * request, struct
   }
   if (u_map_get(request->map_url, "limit") != NULL) {
     l_converted = strtol(u_map_get(request->map_url, "limit"), &endptr, 10);
-    if (!(*endptr) && l_converted > 0) {
+    if (!(*endptr) && (l_converted > 0 || (!l_converted && u_map_get(request->map_url, "stream") != NULL))) {
       limit = (size_t)l_converted;
     }
   }
-  j_client_list = get_client_list(config, u_map_get(request->map_url, "pattern"), offset, limit, u_map_get(request->map_url, "source"));
-  if (check_result_value(j_client_list, G_OK)) {
-    ulfius_set_json_body_response(response, 200, json_object_get(j_client_list, "client"));
+  if (u_map_get(request->map_url, "stream") != NULL) {
+    if ((list_stream = list_stream_new(config, &list_stream_get_client_page, u_map_get(request->map_url, "pattern"), offset, limit)) != NULL) {
+      list_stream->source = o_strdup(u_map_get(request->map_url, "source"));
+    }
+    if (set_list_stream_response(response, list_stream) != G_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "callback_glewlwyd_get_client_list - Error set_list_stream_response");
+      response->status = 500;
+    }
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "callback_glewlwyd_get_client_list - Error get_client_list");
-    response->status = 500;
+    j_client_list = get_client_list(config, u_map_get(request->map_url, "pattern"), offset, limit, u_map_get(request->map_url, "source"));
+    if (check_result_value(j_client_list, G_OK)) {
+      ulfius_set_json_body_response(response, 200, json_object_get(j_client_list, "client"));
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "callback_glewlwyd_get_client_list - Error get_client_list");
+      response->status = 500;
+    }
+    json_decref(j_client_list);
   }
-  json_decref(j_client_list);
   return U_CALLBACK_CONTINUE;
 }
 
@@ -2204,6 +2377,7 @@ int callback_glewlwyd_delete_client (const struct _u_request * request, struct _
 
 int callback_glewlwyd_get_scope_list (const struct _u_request * request, struct _u_response * response, void * user_data) {
   struct config_elements * config = (struct config_elements *)user_data;
+  struct _glwd_list_stream * list_stream;
   json_t * j_scope_list;
   size_t offset = 0, limit = GLEWLWYD_DEFAULT_LIMIT_SIZE;
   long int l_converted = 0;
@@ -2221,14 +2395,24 @@ int callback_glewlwyd_get_scope_list (const struct _u_request * request, struct
       limit = (size_t)l_converted;
     }
   }
-  j_scope_list = get_scope_list(config, u_map_get(request->map_url, "pattern"), offset, limit);
-  if (check_result_value(j_scope_list, G_OK)) {
-    ulfius_set_json_body_response(response, 200, json_object_get(j_scope_list, "scope"));
+  if (u_map_get(request->map_url, "stream") != NULL) {
+    if ((list_stream = list_stream_new(config, &list_stream_get_scope_page, u_map_get(request->map_url, "pattern"), offset, limit)) != NULL) {
+      list_stream->after = o_strdup(u_map_get(request->map_url, "after"));
+    }
+    if (set_list_stream_response(response, list_stream) != G_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "callback_glewlwyd_get_scope_list - Error set_list_stream_response");
+      response->status = 500;
+    }
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "callback_glewlwyd_get_scope_list - Error get_scope_list");
-    response->status = 500;
+    j_scope_list = get_scope_list(config, u_map_get(request->map_url, "pattern"), u_map_get(request->map_url, "after"), offset, limit);
+    if (check_result_value(j_scope_list, G_OK)) {
+      ulfius_set_json_body_response(response, 200, json_object_get(j_scope_list, "scope"));
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "callback_glewlwyd_get_scope_list - Error get_scope_list");
+      response->status = 500;
+    }
+    json_decref(j_scope_list);
   }
-  json_decref(j_scope_list);
   return U_CALLBACK_CONTINUE;
 }
 
@@ -2561,6 +2745,7 @@ int callback_glewlwyd_user_get_client_grant_list (const struct _u_request * requ
 
 int callback_glewlwyd_user_get_session_list (const struct _u_request * request, struct _u_response * response, void * user_data) {
   struct config_elements * config = (struct config_elements *)user_data;
+  struct _glwd_list_stream * list_stream;
   json_t * j_session_list;
   size_t offset = 0, limit = GLEWLWYD_DEFAULT_LIMIT_SIZE;
   long int l_converted = 0;
@@ -2574,21 +2759,34 @@ int callback_glewlwyd_user_get_session_list (const struct _u_request * request,
   }
   if (u_map_get(request->map_url, "limit") != NULL) {
     l_converted = strtol(u_map_get(request->map_url, "limit"), &endptr, 10);
-    if (!(*endptr) && l_converted > 0) {
+    if (!(*endptr) && (l_converted > 0 || (!l_converted && u_map_get(request->map_url, "stream") != NULL))) {
       limit = (size_t)l_converted;
     }
   }
   if (0 == o_strcmp(u_map_get(request->map_url, "sort"), "session_hash") || 0 == o_strcmp(u_map_get(request->map_url, "sort"), "user_agent") || 0 == o_strcmp(u_map_get(request->map_url, "sort"), "issued_for") || 0 == o_strcmp(u_map_get(request->map_url, "sort"), "expiration") || 0 == o_strcmp(u_map_get(request->map_url, "sort"), "last_login") || 0 == o_strcmp(u_map_get(request->map_url, "sort"), "enabled")) {
     sort = msprintf("gpgr_%s%s", u_map_get(request->map_url, "sort"), (u_map_get_case(request->map_url, "desc")!=NULL?" DESC":" ASC"));
   }
-  j_session_list = get_user_session_list(config, json_string_value(json_object_get((json_t *)response->shared_data, "username")), u_map_get(request->map_url, "pattern"), offset, limit, sort);
-  if (check_result_value(j_session_list, G_OK)) {
-    ulfius_set_json_body_response(response, 200, json_object_get(j_session_list, "session"));
+  if (u_map_get(request->map_url, "stream") != NULL) {
+    if ((list_stream = list_stream_new(config, &list_stream_get_session_page, u_map_get(request->map_url, "pattern"), offset, limit)) != NULL) {
+      list_stream->username = o_strdup(json_string_value(json_object_get((json_t *)response->shared_data, "username")));
+      list_stream->sort = sort;
+      sort = NULL;
+    }
+    if (set_list_stream_response(response, list_stream) != G_OK) {
+      y_log_message(Y_LOG_LEVEL_ERROR, "callback_glewlwyd_user_get_session_list - Error set_list_stream_response");
+      response->status = 500;
+    }
   } else {
-    y_log_message(Y_LOG_LEVEL_ERROR, "callback_glewlwyd_user_get_session_list - Error get_user_session_list");
-    response->status = 500;
+    j_session_list = get_user_session_list(config, json_string_value(json_object_get((json_t *)response->shared_data, "username")), u_map_get(request->map_url, "pattern"), offset, limit, sort);
+    if (check_result_value(j_session_list, G_OK)) {
+      ulfius_set_json_body_response(response, 200, json_object_get(j_session_list, "session"));
+    } else {
+      y_log_message(Y_LOG_LEVEL_ERROR, "callback_glewlwyd_user_get_session_list - Error get_user_session_list");
+      response->status = 500;
+    }
+    json_decref(j_session_list);
   }
-  json_decref(j_session_list);
+  o_free(sort);
   return U_CALLBACK_CONTINUE;
 }
 
@@ -2812,9 +3010,12 @@ int callback_metrics (const struct _u_request * request, struct _u_response * re
         }
       }
     }
+    pthread_mutex_unlock(&config->metrics_lock);
+    content = glewlwyd_admission_metrics(config, content);
+    content = glewlwyd_rate_limit_metrics(config, content);
+    content = glewlwyd_alloc_cache_metrics(config, content);
     ulfius_set_string_body_response(response, 200, content);
     o_free(content);
-    pthread_mutex_unlock(&config->metrics_lock);
   } else {
     y_log_message(Y_LOG_LEVEL_ERROR, "callback_metrics - Error lock");
     response->status = 500;
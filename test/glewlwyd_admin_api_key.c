@@ -110,6 +110,51 @@ START_TEST(test_glwd_admin_api_key_disable)
 }
 END_TEST
 
+START_TEST(test_glwd_admin_api_key_counter)
+{
+  struct _u_request req, req_api;
+  struct _u_response resp;
+  json_t * j_body;
+  char * header;
+  int i;
+  
+  ulfius_init_request(&req);
+  ulfius_init_request(&req_api);
+  
+  ulfius_copy_request(&req, &admin_req);
+  
+  ulfius_init_response(&resp);
+  ck_assert_int_eq(ulfius_set_request_properties(&req, U_OPT_HTTP_VERB, "POST", U_OPT_HTTP_URL, SERVER_URI "/key", U_OPT_NONE), U_OK);
+  ck_assert_int_eq(ulfius_send_http_request(&req, &resp), U_OK);
+  ck_assert_int_eq(200, resp.status);
+  ck_assert_ptr_ne(NULL, j_body = ulfius_get_json_body_response(&resp, NULL));
+  ck_assert_int_gt(json_string_length(json_object_get(j_body, "key")), 0);
+  header = msprintf("token %s", json_string_value(json_object_get(j_body, "key")));
+  json_decref(j_body);
+  ulfius_clean_response(&resp);
+  
+  ck_assert_int_eq(ulfius_set_request_properties(&req_api, U_OPT_HEADER_PARAMETER, "Authorization", header, U_OPT_NONE), U_OK);
+  
+  for (i=0; i<3; i++) {
+    ck_assert_int_eq(run_simple_test(&req_api, "GET", SERVER_URI "/mod/type", NULL, NULL, NULL, NULL, 200, NULL, NULL, NULL), 1);
+  }
+  
+  // Pending usage counters are written before the list is returned
+  ulfius_init_response(&resp);
+  ck_assert_int_eq(ulfius_set_request_properties(&req, U_OPT_HTTP_VERB, "GET", U_OPT_NONE), U_OK);
+  ck_assert_int_eq(ulfius_send_http_request(&req, &resp), U_OK);
+  ck_assert_int_eq(200, resp.status);
+  ck_assert_ptr_ne(NULL, j_body = ulfius_get_json_body_response(&resp, NULL));
+  ck_assert_int_eq(json_integer_value(json_object_get(json_array_get(j_body, json_array_size(j_body)-1), "counter")), 3);
+  json_decref(j_body);
+  ulfius_clean_response(&resp);
+
+  o_free(header);
+  ulfius_clean_request(&req);
+  ulfius_clean_request(&req_api);
+}
+END_TEST
+
 static Suite *glewlwyd_suite(void)
 {
   Suite *s;
@@ -119,6 +164,7 @@ static Suite *glewlwyd_suite(void)
   tc_core = tcase_create("test_glwd_admin_api_key");
   tcase_add_test(tc_core, test_glwd_admin_api_key_add);
   tcase_add_test(tc_core, test_glwd_admin_api_key_use);
+  tcase_add_test(tc_core, test_glwd_admin_api_key_counter);
   tcase_add_test(tc_core, test_glwd_admin_api_key_disable);
   tcase_set_timeout(tc_core, 30);
   suite_add_tcase(s, tc_core);
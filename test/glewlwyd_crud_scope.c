@@ -316,6 +316,80 @@ START_TEST(test_glwd_crud_scope_list_limit)
 }
 END_TEST
 
+START_TEST(test_glwd_crud_scope_list_stream)
+{
+  json_t * j_result;
+  int res;
+  struct _u_response resp;
+  
+  ulfius_init_response(&resp);
+  admin_req.http_url = msprintf("%s/scope/?stream&limit=3", SERVER_URI);
+  admin_req.http_verb = o_strdup("GET");
+  res = ulfius_send_http_request(&admin_req, &resp);
+  ck_assert_int_eq(res, U_OK);
+  ck_assert_int_eq(resp.status, 200);
+  j_result = ulfius_get_json_body_response(&resp, NULL);
+  ck_assert_int_eq(json_array_size(j_result), 3);
+  ck_assert_str_eq(json_string_value(json_object_get(json_array_get(j_result, 0), "name")), "g_admin");
+  ck_assert_str_eq(json_string_value(json_object_get(json_array_get(j_result, 1), "name")), "g_profile");
+  ck_assert_str_eq(json_string_value(json_object_get(json_array_get(j_result, 2), "name")), "openid");
+  o_free(admin_req.http_url);
+  o_free(admin_req.http_verb);
+  admin_req.http_url = NULL;
+  admin_req.http_verb = NULL;
+  ulfius_clean_response(&resp);
+  json_decref(j_result);
+  
+  ulfius_init_response(&resp);
+  admin_req.http_url = msprintf("%s/scope/?after=g_profile&limit=2", SERVER_URI);
+  admin_req.http_verb = o_strdup("GET");
+  res = ulfius_send_http_request(&admin_req, &resp);
+  ck_assert_int_eq(res, U_OK);
+  j_result = ulfius_get_json_body_response(&resp, NULL);
+  ck_assert_int_eq(json_array_size(j_result), 2);
+  ck_assert_str_eq(json_string_value(json_object_get(json_array_get(j_result, 0), "name")), "openid");
+  ck_assert_str_eq(json_string_value(json_object_get(json_array_get(j_result, 1), "name")), "scope1");
+  o_free(admin_req.http_url);
+  o_free(admin_req.http_verb);
+  admin_req.http_url = NULL;
+  admin_req.http_verb = NULL;
+  ulfius_clean_response(&resp);
+  json_decref(j_result);
+  
+  ulfius_init_response(&resp);
+  admin_req.http_url = msprintf("%s/scope/?stream&after=openid", SERVER_URI);
+  admin_req.http_verb = o_strdup("GET");
+  res = ulfius_send_http_request(&admin_req, &resp);
+  ck_assert_int_eq(res, U_OK);
+  j_result = ulfius_get_json_body_response(&resp, NULL);
+  ck_assert_int_eq(json_array_size(j_result), 3);
+  ck_assert_str_eq(json_string_value(json_object_get(json_array_get(j_result, 0), "name")), "scope1");
+  ck_assert_str_eq(json_string_value(json_object_get(json_array_get(j_result, 2), "name")), "scope3");
+  o_free(admin_req.http_url);
+  o_free(admin_req.http_verb);
+  admin_req.http_url = NULL;
+  admin_req.http_verb = NULL;
+  ulfius_clean_response(&resp);
+  json_decref(j_result);
+  
+  ulfius_init_response(&resp);
+  admin_req.http_url = msprintf("%s/scope/?stream&after=scope3", SERVER_URI);
+  admin_req.http_verb = o_strdup("GET");
+  res = ulfius_send_http_request(&admin_req, &resp);
+  ck_assert_int_eq(res, U_OK);
+  j_result = ulfius_get_json_body_response(&resp, NULL);
+  ck_assert_int_eq(json_is_array(j_result), 1);
+  ck_assert_int_eq(json_array_size(j_result), 0);
+  o_free(admin_req.http_url);
+  o_free(admin_req.http_verb);
+  admin_req.http_url = NULL;
+  admin_req.http_verb = NULL;
+  ulfius_clean_response(&resp);
+  json_decref(j_result);
+  
+}
+END_TEST
+
 static Suite *glewlwyd_suite(void)
 {
   Suite *s;
@@ -334,6 +408,7 @@ static Suite *glewlwyd_suite(void)
   tcase_add_test(tc_core, test_glwd_crud_scope_delete_OK);
   tcase_add_test(tc_core, test_glwd_crud_scope_list_limit);
   tcase_add_test(tc_core, test_glwd_crud_scope_list_pattern);
+  tcase_add_test(tc_core, test_glwd_crud_scope_list_stream);
   tcase_set_timeout(tc_core, 30);
   suite_add_tcase(s, tc_core);
 
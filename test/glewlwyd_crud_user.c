@@ -211,6 +211,62 @@ START_TEST(test_glwd_crud_user_list_limit)
 }
 END_TEST
 
+START_TEST(test_glwd_crud_user_list_stream)
+{
+  json_t * j_result;
+  int res;
+  struct _u_response resp;
+  
+  ulfius_init_response(&resp);
+  admin_req.http_url = msprintf("%s/user/?stream&limit=0", SERVER_URI);
+  admin_req.http_verb = o_strdup("GET");
+  res = ulfius_send_http_request(&admin_req, &resp);
+  ck_assert_int_eq(res, U_OK);
+  ck_assert_int_eq(resp.status, 200);
+  j_result = ulfius_get_json_body_response(&resp, NULL);
+  ck_assert_int_eq(json_array_size(j_result), 4);
+  ck_assert_str_eq(json_string_value(json_object_get(json_array_get(j_result, 0), "username")), "admin");
+  ck_assert_str_eq(json_string_value(json_object_get(json_array_get(j_result, 3), "username")), "user3");
+  o_free(admin_req.http_url);
+  o_free(admin_req.http_verb);
+  admin_req.http_url = NULL;
+  admin_req.http_verb = NULL;
+  ulfius_clean_response(&resp);
+  json_decref(j_result);
+  
+  ulfius_init_response(&resp);
+  admin_req.http_url = msprintf("%s/user/?stream&offset=1&limit=0", SERVER_URI);
+  admin_req.http_verb = o_strdup("GET");
+  res = ulfius_send_http_request(&admin_req, &resp);
+  ck_assert_int_eq(res, U_OK);
+  j_result = ulfius_get_json_body_response(&resp, NULL);
+  ck_assert_int_eq(json_array_size(j_result), 3);
+  ck_assert_str_eq(json_string_value(json_object_get(json_array_get(j_result, 0), "username")), "user1");
+  o_free(admin_req.http_url);
+  o_free(admin_req.http_verb);
+  admin_req.http_url = NULL;
+  admin_req.http_verb = NULL;
+  ulfius_clean_response(&resp);
+  json_decref(j_result);
+  
+  ulfius_init_response(&resp);
+  admin_req.http_url = msprintf("%s/user/?stream&limit=2", SERVER_URI);
+  admin_req.http_verb = o_strdup("GET");
+  res = ulfius_send_http_request(&admin_req, &resp);
+  ck_assert_int_eq(res, U_OK);
+  j_result = ulfius_get_json_body_response(&resp, NULL);
+  ck_assert_int_eq(json_array_size(j_result), 2);
+  ck_assert_str_eq(json_string_value(json_object_get(json_array_get(j_result, 1), "username")), "user1");
+  o_free(admin_req.http_url);
+  o_free(admin_req.http_verb);
+  admin_req.http_url = NULL;
+  admin_req.http_verb = NULL;
+  ulfius_clean_response(&resp);
+  json_decref(j_result);
+  
+}
+END_TEST
+
 START_TEST(test_glwd_crud_user_list_pattern)
 {
   json_t * j_result;
@@ -398,6 +454,7 @@ static Suite *glewlwyd_suite(void)
   tcase_add_test(tc_core, test_glwd_crud_user_delete_error);
   tcase_add_test(tc_core, test_glwd_crud_user_delete_OK);
   tcase_add_test(tc_core, test_glwd_crud_user_list_limit);
+  tcase_add_test(tc_core, test_glwd_crud_user_list_stream);
   tcase_add_test(tc_core, test_glwd_crud_user_list_pattern);
   tcase_add_test(tc_core, test_glwd_crud_user_list_add_user_module_instances);
   tcase_add_test(tc_core, test_glwd_crud_user_list_page_multiple_source);
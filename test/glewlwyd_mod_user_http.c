@@ -5,6 +5,7 @@
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#include <netinet/in.h>
 #include <gnutls/gnutls.h>
 #include <gnutls/crypto.h>
 #include <check.h>
@@ -38,6 +39,10 @@ char * host = NULL;
 
 struct _u_request user_req, admin_req;
 char * code;
+unsigned int auth_basic_counter = 0;
+unsigned int pool_request_counter = 0;
+unsigned int pool_connection_counter = 0;
+unsigned short int pool_client_port[8];
 
 /**
  * Auth function for basic authentication
@@ -73,6 +78,55 @@ int auth_basic_format (const struct _u_request * request, struct _u_response * r
   }
 }
 
+/**
+ * Auth function for basic authentication counting the calls
+ */
+int auth_basic_count (const struct _u_request * request, struct _u_response * response, void * user_data) {
+  auth_basic_counter++;
+  return auth_basic(request, response, user_data);
+}
+
+/**
+ * Auth function for basic authentication counting the calls and the connections used
+ * A connection is identified by the client port
+ */
+int auth_basic_pool (const struct _u_request * request, struct _u_response * response, void * user_data) {
+  unsigned short int port = 0;
+  unsigned int i;
+
+  if (request->client_address->sa_family == AF_INET) {
+    port = ntohs(((struct sockaddr_in *)request->client_address)->sin_port);
+  } else if (request->client_address->sa_family == AF_INET6) {
+    port = ntohs(((struct sockaddr_in6 *)request->client_address)->sin6_port);
+  }
+  pool_request_counter++;
+  for (i=0; i<pool_connection_counter && pool_client_port[i] != port; i++);
+  if (i == pool_connection_counter && pool_connection_counter < 8) {
+    pool_client_port[pool_connection_counter++] = port;
+  }
+  return auth_basic(request, response, user_data);
+}
+
+static int run_auth_password(const char * password) {
+  struct _u_request auth_req;
+  struct _u_response auth_resp;
+  json_t * j_body;
+  int status;
+  
+  ulfius_init_request(&auth_req);
+  ulfius_init_response(&auth_resp);
+  auth_req.http_verb = strdup("POST");
+  auth_req.http_url = msprintf("%s/auth/", SERVER_URI);
+  j_body = json_pack("{ssss}", "username", HTTP_USER, "password", password);
+  ulfius_set_json_body_request(&auth_req, j_body);
+  json_decref(j_body);
+  ulfius_send_http_request(&auth_req, &auth_resp);
+  status = auth_resp.status;
+  ulfius_clean_request(&auth_req);
+  ulfius_clean_response(&auth_resp);
+  return status;
+}
+
 START_TEST(test_glwd_http_auth_module_add)
 {
   char * param_url;
@@ -209,6 +263,83 @@ START_TEST(test_glwd_http_auth_module_unavailable_add)
 }
 END_TEST
 
+START_TEST(test_glwd_http_auth_module_cache_invalid_add)
+{
+  json_t * j_params = json_pack("{sssssssis{sssos[ss]si}}", "module", "http", "name", "mod_irl", "display_name", "HTTP", "order_rank", 1, "parameters", "url", "http://localhost/", "check-server-certificate", json_true(), "default-scope", "g_profile", "scope1", "credential-cache-duration", -1);
+  char * url = SERVER_URI "/mod/user";
+  ck_assert_int_eq(run_simple_test(&admin_req, "POST", url, NULL, NULL, j_params, NULL, 400, NULL, NULL, NULL), 1);
+  json_decref(j_params);
+  j_params = json_pack("{sssssssis{sssos[ss]sisi}}", "module", "http", "name", "mod_irl", "display_name", "HTTP", "order_rank", 1, "parameters", "url", "http://localhost/", "check-server-certificate", json_true(), "default-scope", "g_profile", "scope1", "credential-cache-duration", 60, "credential-cache-max-size", 0);
+  ck_assert_int_eq(run_simple_test(&admin_req, "POST", url, NULL, NULL, j_params, NULL, 400, NULL, NULL, NULL), 1);
+  json_decref(j_params);
+}
+END_TEST
+
+START_TEST(test_glwd_http_auth_module_cache_add)
+{
+  char * param_url;
+  if (host == NULL) {
+    param_url = msprintf("http://%s:%d/auth/count/", HOST, PORT);
+  } else {
+    param_url = msprintf("http://%s:%d/auth/count/", host, PORT);
+  }
+  json_t * j_params = json_pack("{sssssssis{sssos[ss]si}}", "module", "http", "name", "mod_irl", "display_name", "HTTP", "order_rank", 1, "parameters", "url", param_url, "check-server-certificate", json_true(), "default-scope", "g_profile", "scope1", "credential-cache-duration", 60);
+  char * url = SERVER_URI "/mod/user";
+  ck_assert_int_eq(run_simple_test(&admin_req, "POST", url, NULL, NULL, j_params, NULL, 200, NULL, NULL, NULL), 1);
+  json_decref(j_params);
+  o_free(param_url);
+}
+END_TEST
+
+START_TEST(test_glwd_http_auth_http_auth_cache)
+{
+  auth_basic_counter = 0;
+  ck_assert_int_eq(run_auth_password(HTTP_PASSWORD), 200);
+  ck_assert_int_eq(auth_basic_counter, 1);
+  ck_assert_int_eq(run_auth_password(HTTP_PASSWORD), 200);
+  ck_assert_int_eq(auth_basic_counter, 1);
+  ck_assert_int_eq(run_auth_password("invalid"), 401);
+  ck_assert_int_eq(auth_basic_counter, 2);
+  ck_assert_int_eq(run_auth_password("invalid"), 401);
+  ck_assert_int_eq(auth_basic_counter, 3);
+  ck_assert_int_eq(run_auth_password(HTTP_PASSWORD), 200);
+  ck_assert_int_eq(auth_basic_counter, 4);
+  ck_assert_int_eq(run_auth_password(HTTP_PASSWORD), 200);
+  ck_assert_int_eq(auth_basic_counter, 4);
+}
+END_TEST
+
+START_TEST(test_glwd_http_auth_module_pool_add)
+{
+  char * param_url;
+  if (host == NULL) {
+    param_url = msprintf("http://%s:%d/auth/pool/", HOST, PORT);
+  } else {
+    param_url = msprintf("http://%s:%d/auth/pool/", host, PORT);
+  }
+  json_t * j_params = json_pack("{sssssssis{sssos[ss]}}", "module", "http", "name", "mod_irl", "display_name", "HTTP", "order_rank", 1, "parameters", "url", param_url, "check-server-certificate", json_true(), "default-scope", "g_profile", "scope1");
+  char * url = SERVER_URI "/mod/user";
+  ck_assert_int_eq(run_simple_test(&admin_req, "POST", url, NULL, NULL, j_params, NULL, 200, NULL, NULL, NULL), 1);
+  json_decref(j_params);
+  o_free(param_url);
+}
+END_TEST
+
+START_TEST(test_glwd_http_auth_http_auth_pool)
+{
+  int i;
+
+  pool_request_counter = 0;
+  pool_connection_counter = 0;
+  for (i=0; i<5; i++) {
+    ck_assert_int_eq(run_auth_password(HTTP_PASSWORD), 200);
+  }
+  // The requests are sent one after the other through the same pooled connection
+  ck_assert_int_eq(pool_request_counter, 5);
+  ck_assert_int_eq(pool_connection_counter, 1);
+}
+END_TEST
+
 static Suite *glewlwyd_suite(void)
 {
   Suite *s;
@@ -227,6 +358,13 @@ static Suite *glewlwyd_suite(void)
   tcase_add_test(tc_core, test_glwd_http_auth_module_unavailable_add);
   tcase_add_test(tc_core, test_glwd_http_auth_http_auth_fail);
   tcase_add_test(tc_core, test_glwd_http_auth_module_delete);
+  tcase_add_test(tc_core, test_glwd_http_auth_module_cache_invalid_add);
+  tcase_add_test(tc_core, test_glwd_http_auth_module_cache_add);
+  tcase_add_test(tc_core, test_glwd_http_auth_http_auth_cache);
+  tcase_add_test(tc_core, test_glwd_http_auth_module_delete);
+  tcase_add_test(tc_core, test_glwd_http_auth_module_pool_add);
+  tcase_add_test(tc_core, test_glwd_http_auth_http_auth_pool);
+  tcase_add_test(tc_core, test_glwd_http_auth_module_delete);
   tcase_set_timeout(tc_core, 30);
   suite_add_tcase(s, tc_core);
 
@@ -256,6 +394,8 @@ int main(int argc, char *argv[])
   }
   ulfius_add_endpoint_by_val(&instance, "GET", PREFIX, NULL, 0, &auth_basic, NULL);
   ulfius_add_endpoint_by_val(&instance, "GET", PREFIX, "/format", 0, &auth_basic_format, NULL);
+  ulfius_add_endpoint_by_val(&instance, "GET", PREFIX, "/count", 0, &auth_basic_count, NULL);
+  ulfius_add_endpoint_by_val(&instance, "GET", PREFIX, "/pool", 0, &auth_basic_pool, NULL);
   if (ulfius_start_framework(&instance) == U_OK) {
     y_log_message(Y_LOG_LEVEL_INFO, "Start framework on port %d", instance.port);
   } else {
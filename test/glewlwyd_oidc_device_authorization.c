@@ -5,6 +5,7 @@
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#include <unistd.h>
 #include <gnutls/gnutls.h>
 #include <gnutls/crypto.h>
 #include <gnutls/abstract.h>
@@ -38,6 +39,7 @@
 #define CLIENT_NAME "client for device"
 #define CLIENT_SECRET "very-secret"
 #define RESOURCE "https://resource.tld/"
+#define LONG_POLL_DURATION 2
 
 struct _u_request admin_req;
 struct _u_request user_req;
@@ -71,6 +73,37 @@ START_TEST(test_oidc_device_authorization_add_module_ok)
 }
 END_TEST
 
+START_TEST(test_oidc_device_authorization_add_module_long_poll_ok)
+{
+  json_t * j_parameters = json_pack("{sssssssos{sssssssssisisisososososososososisi}}",
+                                "module", PLUGIN_MODULE,
+                                "name", PLUGIN_NAME,
+                                "display_name", PLUGIN_DISPLAY_NAME,
+                                "enabled", json_true(),
+                                "parameters",
+                                  "iss", PLUGIN_ISS,
+                                  "jwt-type", "sha",
+                                  "jwt-key-size", "256",
+                                  "key", "secret",
+                                  "code-duration", PLUGIN_CODE_DURATION,
+                                  "refresh-token-duration", PLUGIN_REFRESH_TOKEN_DURATION,
+                                  "access-token-duration", PLUGIN_ACCESS_TOKEN_DURATION,
+                                  "allow-non-oidc", json_true(),
+                                  "auth-type-client-enabled", json_true(),
+                                  "auth-type-code-enabled", json_true(),
+                                  "auth-type-token-enabled", json_true(),
+                                  "auth-type-implicit-enabled", json_true(),
+                                  "auth-type-password-enabled", json_true(),
+                                  "auth-type-refresh-enabled", json_true(),
+                                  "auth-type-device-enabled", json_true(),
+                                  "device-authorization-interval", 1,
+                                  "token-long-poll-duration", LONG_POLL_DURATION);
+
+  ck_assert_int_eq(run_simple_test(&admin_req, "POST", SERVER_URI "/mod/plugin/", NULL, NULL, j_parameters, NULL, 200, NULL, NULL, NULL), 1);
+  json_decref(j_parameters);
+}
+END_TEST
+
 START_TEST(test_oidc_device_authorization_add_client_confidential_ok)
 {
   json_t * j_parameters = json_pack("{sssssssos[s]so}",
@@ -767,6 +800,68 @@ START_TEST(test_oidc_device_authorization_device_verification_auth_slow_down)
 }
 END_TEST
 
+START_TEST(test_oidc_device_authorization_device_verification_auth_pending_long_poll)
+{
+  struct _u_request req;
+  struct _u_response resp;
+  json_t * j_resp;
+  const char * device_code;
+  time_t start;
+  
+  ck_assert_int_eq(ulfius_init_request(&req), U_OK);
+  ck_assert_int_eq(ulfius_init_response(&resp), U_OK);
+  req.http_url = o_strdup(SERVER_URI "/" PLUGIN_NAME "/device_authorization/");
+  req.http_verb = o_strdup("POST");
+  u_map_put(req.map_post_body, "grant_type", "device_authorization");
+  u_map_put(req.map_post_body, "client_id", CLIENT_ID);
+  u_map_put(req.map_post_body, "scope", SCOPE_LIST);
+  req.auth_basic_user = o_strdup(CLIENT_ID);
+  req.auth_basic_password = o_strdup(CLIENT_SECRET);
+  
+  ck_assert_int_eq(ulfius_send_http_request(&req, &resp), U_OK);
+  ck_assert_int_eq(200, resp.status);
+  ck_assert_ptr_ne(j_resp = ulfius_get_json_body_response(&resp, NULL), NULL);
+  ck_assert_ptr_ne(device_code = json_string_value(json_object_get(j_resp, "device_code")), NULL);
+  
+  ulfius_clean_request(&req);
+  ulfius_clean_response(&resp);
+  
+  ck_assert_int_eq(ulfius_init_request(&req), U_OK);
+  ck_assert_int_eq(ulfius_init_response(&resp), U_OK);
+  req.http_url = o_strdup(SERVER_URI "/" PLUGIN_NAME "/token/");
+  req.http_verb = o_strdup("POST");
+  u_map_put(req.map_post_body, "grant_type", "urn:ietf:params:oauth:grant-type:device_code");
+  u_map_put(req.map_post_body, "client_id", CLIENT_ID);
+  u_map_put(req.map_post_body, "device_code", device_code);
+  req.auth_basic_user = o_strdup(CLIENT_ID);
+  req.auth_basic_password = o_strdup(CLIENT_SECRET);
+  json_decref(j_resp);
+  
+  // First poll reads the database and answers right away
+  ck_assert_int_eq(ulfius_send_http_request(&req, &resp), U_OK);
+  ck_assert_int_eq(400, resp.status);
+  ck_assert_ptr_ne(j_resp = ulfius_get_json_body_response(&resp, NULL), NULL);
+  ck_assert_str_eq(json_string_value(json_object_get(j_resp, "error")), "authorization_pending");
+  ulfius_clean_response(&resp);
+  json_decref(j_resp);
+  
+  // Next poll waits on the server until the long poll duration
+  sleep(2);
+  time(&start);
+  ck_assert_int_eq(ulfius_init_response(&resp), U_OK);
+  ck_assert_int_eq(ulfius_send_http_request(&req, &resp), U_OK);
+  ck_assert_int_eq(400, resp.status);
+  ck_assert_int_ge(time(NULL)-start, LONG_POLL_DURATION-1);
+  ck_assert_ptr_ne(j_resp = ulfius_get_json_body_response(&resp, NULL), NULL);
+  ck_assert_str_eq(json_string_value(json_object_get(j_resp, "error")), "authorization_pending");
+  ulfius_clean_response(&resp);
+  
+  json_decref(j_resp);
+  ulfius_clean_request(&req);
+  
+}
+END_TEST
+
 START_TEST(test_oidc_device_authorization_device_verification_device_code_invalid)
 {
   struct _u_request req;
@@ -1009,6 +1104,11 @@ static Suite *glewlwyd_suite(void)
   tcase_add_test(tc_core, test_oidc_device_authorization_device_verification_client_secret_invalid);
   tcase_add_test(tc_core, test_oidc_device_authorization_delete_client);
   tcase_add_test(tc_core, test_oidc_device_authorization_delete_module);
+  tcase_add_test(tc_core, test_oidc_device_authorization_add_module_long_poll_ok);
+  tcase_add_test(tc_core, test_oidc_device_authorization_add_client_confidential_ok);
+  tcase_add_test(tc_core, test_oidc_device_authorization_device_verification_auth_pending_long_poll);
+  tcase_add_test(tc_core, test_oidc_device_authorization_delete_client);
+  tcase_add_test(tc_core, test_oidc_device_authorization_delete_module);
   tcase_set_timeout(tc_core, 30);
   suite_add_tcase(s, tc_core);
 
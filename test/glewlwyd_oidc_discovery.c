@@ -57,6 +57,71 @@ START_TEST(test_oidc_discovery_default_test)
 }
 END_TEST
 
+START_TEST(test_oidc_discovery_etag)
+{
+  struct _u_request req;
+  struct _u_response resp;
+  char * etag, * etag_list, * etag_gzip;
+
+  ulfius_init_request(&req);
+  ulfius_init_response(&resp);
+  ck_assert_int_eq(ulfius_set_request_properties(&req, U_OPT_HTTP_VERB, "GET", U_OPT_HTTP_URL, SERVER_URI "/oidc/.well-known/openid-configuration", U_OPT_NONE), U_OK);
+  ck_assert_int_eq(ulfius_send_http_request(&req, &resp), U_OK);
+  ck_assert_int_eq(resp.status, 200);
+  ck_assert_ptr_ne(u_map_get_case(resp.map_header, "ETag"), NULL);
+  etag = o_strdup(u_map_get_case(resp.map_header, "ETag"));
+  ulfius_clean_response(&resp);
+
+  ulfius_init_response(&resp);
+  ck_assert_int_eq(ulfius_set_request_properties(&req, U_OPT_HEADER_PARAMETER, "If-None-Match", etag, U_OPT_NONE), U_OK);
+  ck_assert_int_eq(ulfius_send_http_request(&req, &resp), U_OK);
+  ck_assert_int_eq(resp.status, 304);
+  ck_assert_str_eq(u_map_get_case(resp.map_header, "ETag"), etag);
+  ck_assert_int_eq(resp.binary_body_length, 0);
+  ulfius_clean_response(&resp);
+
+  ulfius_init_response(&resp);
+  ck_assert_int_eq(ulfius_set_request_properties(&req, U_OPT_HEADER_PARAMETER, "If-None-Match", "\"error\"", U_OPT_NONE), U_OK);
+  ck_assert_int_eq(ulfius_send_http_request(&req, &resp), U_OK);
+  ck_assert_int_eq(resp.status, 200);
+  ulfius_clean_response(&resp);
+
+  ulfius_init_response(&resp);
+  etag_list = msprintf("\"error\", %s", etag);
+  ck_assert_int_eq(ulfius_set_request_properties(&req, U_OPT_HEADER_PARAMETER, "If-None-Match", etag_list, U_OPT_NONE), U_OK);
+  ck_assert_int_eq(ulfius_send_http_request(&req, &resp), U_OK);
+  ck_assert_int_eq(resp.status, 304);
+  o_free(etag_list);
+  ulfius_clean_response(&resp);
+
+  ulfius_init_response(&resp);
+  u_map_remove_from_key(req.map_header, "If-None-Match");
+  ck_assert_int_eq(ulfius_set_request_properties(&req, U_OPT_HEADER_PARAMETER, "Accept-Encoding", "gzip", U_OPT_NONE), U_OK);
+  ck_assert_int_eq(ulfius_send_http_request(&req, &resp), U_OK);
+  ck_assert_int_eq(resp.status, 200);
+  ck_assert_str_eq(u_map_get_case(resp.map_header, "Content-Encoding"), "gzip");
+  etag_gzip = msprintf("%.*s-gzip\"", (int)o_strlen(etag)-1, etag);
+  ck_assert_str_eq(u_map_get_case(resp.map_header, "ETag"), etag_gzip);
+  ulfius_clean_response(&resp);
+
+  ulfius_init_response(&resp);
+  ck_assert_int_eq(ulfius_set_request_properties(&req, U_OPT_HEADER_PARAMETER, "If-None-Match", etag, U_OPT_NONE), U_OK);
+  ck_assert_int_eq(ulfius_send_http_request(&req, &resp), U_OK);
+  ck_assert_int_eq(resp.status, 200);
+  ulfius_clean_response(&resp);
+
+  ulfius_init_response(&resp);
+  ck_assert_int_eq(ulfius_set_request_properties(&req, U_OPT_HEADER_PARAMETER, "If-None-Match", etag_gzip, U_OPT_NONE), U_OK);
+  ck_assert_int_eq(ulfius_send_http_request(&req, &resp), U_OK);
+  ck_assert_int_eq(resp.status, 304);
+  ulfius_clean_response(&resp);
+
+  o_free(etag);
+  o_free(etag_gzip);
+  ulfius_clean_request(&req);
+}
+END_TEST
+
 START_TEST(test_oidc_discovery_add_plugin)
 {
   json_t * j_param = json_pack("{sssssss{sssssssssssisisisosososososososososssssosos[{ssssso}{ssssso}]sssss{ssss}s[ssss]s[s]sosososos[s]sososssisssososisosssosos{s{s[ss]s[ss]s[ss]s[ss]s[ss]}s{s[s]s[ss]s[ss]s[ss]s[s]}s{s[s]s[s]s[s]s[sss]s[s]}s{}}sososssisosisisososososososo}}",
@@ -299,6 +364,7 @@ static Suite *glewlwyd_suite(void)
   s = suite_create("Glewlwyd oidc discovery");
   tc_core = tcase_create("test_oidc_discovery");
   tcase_add_test(tc_core, test_oidc_discovery_default_test);
+  tcase_add_test(tc_core, test_oidc_discovery_etag);
   tcase_add_test(tc_core, test_oidc_discovery_add_plugin);
   tcase_add_test(tc_core, test_oidc_discovery_new_plugin_test);
   tcase_add_test(tc_core, test_oidc_discovery_delete_plugin);
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#include <unistd.h>
 #include <gnutls/gnutls.h>
 #include <gnutls/crypto.h>
 #include <gnutls/abstract.h>
@@ -413,6 +414,46 @@ static int callback_request_jwks_valid (const struct _u_request * request, struc
   return U_CALLBACK_COMPLETE;
 }
 
+static int callback_request_jwks_rotation (const struct _u_request * request, struct _u_response * response, void * user_data) {
+  json_t * jwks = json_loads(jwks_privkey, JSON_DECODE_ANY, NULL), * j_element = NULL;
+  size_t index = 0;
+
+  if (*(int *)user_data) {
+    json_array_foreach(json_object_get(jwks, "keys"), index, j_element) {
+      if (0 == o_strcmp(KID_1, json_string_value(json_object_get(j_element, "kid")))) {
+        json_array_remove(json_object_get(jwks, "keys"), index);
+        break;
+      }
+    }
+  }
+  ulfius_set_json_body_response(response, 200, jwks);
+  json_decref(jwks);
+  return U_CALLBACK_COMPLETE;
+}
+
+static char * get_client_cred_access_token(void) {
+  struct _u_response resp;
+  struct _u_request req;
+  json_t * j_resp;
+  char * token = NULL;
+
+  ulfius_init_response(&resp);
+  ulfius_init_request(&req);
+  req.http_url = o_strdup(SERVER_URI "/" PLUGIN_NAME "/token/");
+  req.http_verb = o_strdup("POST");
+  u_map_put(req.map_post_body, "grant_type", "client_credentials");
+  u_map_put(req.map_post_body, "scope", CLIENT_SCOPE);
+  req.auth_basic_user = o_strdup(CLIENT_ID);
+  req.auth_basic_password = o_strdup(CLIENT_SECRET);
+  if (ulfius_send_http_request(&req, &resp) == U_OK && resp.status == 200 && (j_resp = ulfius_get_json_body_response(&resp, NULL)) != NULL) {
+    token = o_strdup(json_string_value(json_object_get(j_resp, "access_token")));
+    json_decref(j_resp);
+  }
+  ulfius_clean_request(&req);
+  ulfius_clean_response(&resp);
+  return token;
+}
+
 START_TEST(test_oidc_jwks_add_module_alg_missing)
 {
   json_t * j_parameters = json_pack("{sssssssos{sssssssisisisososososososososososisssssssossssssssssssssssss}}",
@@ -786,6 +827,85 @@ START_TEST(test_oidc_jwks_add_module_ok)
 }
 END_TEST
 
+START_TEST(test_oidc_jwks_add_module_pending_key)
+{
+  json_t * j_jwks = json_loads(jwks_privkey, JSON_DECODE_ANY, NULL), * j_element = NULL, * j_parameters;
+  char * str_jwks;
+  size_t index = 0;
+
+  ck_assert_ptr_ne(j_jwks, NULL);
+  json_array_foreach(json_object_get(j_jwks, "keys"), index, j_element) {
+    if (0 == o_strcmp(KID_1, json_string_value(json_object_get(j_element, "kid")))) {
+      json_object_set_new(j_element, "nbf", json_integer(time(NULL)+PLUGIN_ACCESS_TOKEN_DURATION));
+    }
+  }
+  str_jwks = json_dumps(j_jwks, JSON_COMPACT);
+  j_parameters = json_pack("{sssssssos{sssssisisisososssi}}",
+                           "module", PLUGIN_MODULE,
+                           "name", PLUGIN_NAME,
+                           "display_name", PLUGIN_DISPLAY_NAME,
+                           "enabled", json_true(),
+                           "parameters",
+                             "iss", PLUGIN_ISS,
+                             "jwks-private", str_jwks,
+                             "code-duration", PLUGIN_CODE_DURATION,
+                             "refresh-token-duration", PLUGIN_REFRESH_TOKEN_DURATION,
+                             "access-token-duration", PLUGIN_ACCESS_TOKEN_DURATION,
+                             "allow-non-oidc", json_true(),
+                             "auth-type-client-enabled", json_true(),
+                             "client-sign_kid-parameter", "sign_kid",
+                             "jwks-rotation-interval", 60);
+  ck_assert_int_eq(run_simple_test(&admin_req, "POST", SERVER_URI "/mod/plugin/", NULL, NULL, j_parameters, NULL, 200, NULL, NULL, NULL), 1);
+  json_decref(j_parameters);
+  json_decref(j_jwks);
+  o_free(str_jwks);
+}
+END_TEST
+
+START_TEST(test_oidc_jwks_client_cred_pending_key)
+{
+  struct _u_response resp;
+  struct _u_request req;
+  json_t * j_resp = NULL;
+  jwt_t * jwt;
+  jwks_t * jwks_pub;
+  jwk_t * jwk;
+
+  ck_assert_int_eq(r_jwks_init(&jwks_pub), RHN_OK);
+  ck_assert_int_eq(r_jwks_import_from_uri(jwks_pub, SERVER_URI "/" PLUGIN_NAME "/jwks", 0), RHN_OK);
+  // The pending key is published before it's used
+  ck_assert_ptr_ne(jwk = r_jwks_get_by_kid(jwks_pub, KID_1), NULL);
+  r_jwk_free(jwk);
+  
+  ck_assert_int_eq(ulfius_init_response(&resp), U_OK);
+  ck_assert_int_eq(ulfius_init_request(&req), U_OK);
+  
+  req.http_url = o_strdup(SERVER_URI "/" PLUGIN_NAME "/token/");
+  req.http_verb = o_strdup("POST");
+  u_map_put(req.map_post_body, "grant_type", "client_credentials");
+  u_map_put(req.map_post_body, "scope", CLIENT_SCOPE);
+  req.auth_basic_user = o_strdup(CLIENT_ID);
+  req.auth_basic_password = o_strdup(CLIENT_SECRET);
+  
+  ck_assert_int_eq(ulfius_send_http_request(&req, &resp), U_OK);
+  ck_assert_int_eq(resp.status, 200);
+  ck_assert_ptr_ne(j_resp = ulfius_get_json_body_response(&resp, NULL), NULL);
+  ck_assert_ptr_ne(json_object_get(j_resp, "access_token"), NULL);
+  ck_assert_int_eq(r_jwt_init(&jwt), RHN_OK);
+  ck_assert_int_eq(r_jwt_parse(jwt, json_string_value(json_object_get(j_resp, "access_token")), 0), RHN_OK);
+  ck_assert_str_ne(KID_1, r_jwt_get_header_str_value(jwt, "kid"));
+  ck_assert_ptr_ne(jwk = r_jwks_get_by_kid(jwks_pub, r_jwt_get_header_str_value(jwt, "kid")), NULL);
+  ck_assert_int_eq(r_jwt_add_sign_keys(jwt, NULL, jwk), RHN_OK);
+  ck_assert_int_eq(r_jwt_verify_signature(jwt, NULL, 0), RHN_OK);
+  json_decref(j_resp);
+  r_jwk_free(jwk);
+  r_jwt_free(jwt);
+  r_jwks_free(jwks_pub);
+  ulfius_clean_request(&req);
+  ulfius_clean_response(&resp);
+}
+END_TEST
+
 START_TEST(test_oidc_jwks_add_module_public_jwks_invalid)
 {
   json_t * j_parameters = json_pack("{sssssssos{sssssssssisisisososososososososososisssssssossssssssssssssssss}}",
@@ -1503,6 +1623,76 @@ START_TEST(test_oidc_jwks_request_token_jwt_nested_rsa_no_kid_invalid)
 }
 END_TEST
 
+START_TEST(test_oidc_jwks_client_cred_rotation)
+{
+  struct _u_instance instance;
+  json_t * j_parameters;
+  jwt_t * jwt_old, * jwt_new;
+  jwks_t * jwks_pub;
+  jwk_t * jwk;
+  char * token_old, * token_new;
+  int rotated = 0;
+
+  ck_assert_int_eq(ulfius_init_instance(&instance, 7600, NULL, NULL), U_OK);
+  ck_assert_int_eq(ulfius_add_endpoint_by_val(&instance, "GET", NULL, "/jwks", 0, &callback_request_jwks_rotation, &rotated), U_OK);
+  ck_assert_int_eq(ulfius_start_framework(&instance), U_OK);
+
+  j_parameters = json_pack("{sssssssos{sssssisisisososssi}}",
+                           "module", PLUGIN_MODULE,
+                           "name", PLUGIN_NAME,
+                           "display_name", PLUGIN_DISPLAY_NAME,
+                           "enabled", json_true(),
+                           "parameters",
+                             "iss", PLUGIN_ISS,
+                             "jwks-uri", "http://localhost:7600/jwks",
+                             "code-duration", PLUGIN_CODE_DURATION,
+                             "refresh-token-duration", PLUGIN_REFRESH_TOKEN_DURATION,
+                             "access-token-duration", PLUGIN_ACCESS_TOKEN_DURATION,
+                             "allow-non-oidc", json_true(),
+                             "auth-type-client-enabled", json_true(),
+                             "client-sign_kid-parameter", "sign_kid",
+                             "jwks-rotation-interval", 1);
+  ck_assert_int_eq(run_simple_test(&admin_req, "POST", SERVER_URI "/mod/plugin/", NULL, NULL, j_parameters, NULL, 200, NULL, NULL, NULL), 1);
+  json_decref(j_parameters);
+
+  ck_assert_ptr_ne(token_old = get_client_cred_access_token(), NULL);
+  ck_assert_int_eq(r_jwt_init(&jwt_old), RHN_OK);
+  ck_assert_int_eq(r_jwt_parse(jwt_old, token_old, 0), RHN_OK);
+  ck_assert_str_eq(KID_1, r_jwt_get_header_str_value(jwt_old, "kid"));
+
+  // Remove the active key from the source and let the rotation thread reload it
+  rotated = 1;
+  sleep(3);
+
+  // The retired key is still published so the tokens it signed can be verified
+  ck_assert_int_eq(r_jwks_init(&jwks_pub), RHN_OK);
+  ck_assert_int_eq(r_jwks_import_from_uri(jwks_pub, SERVER_URI "/" PLUGIN_NAME "/jwks", 0), RHN_OK);
+  ck_assert_ptr_ne(jwk = r_jwks_get_by_kid(jwks_pub, KID_1), NULL);
+  ck_assert_int_eq(r_jwt_add_sign_keys(jwt_old, NULL, jwk), RHN_OK);
+  ck_assert_int_eq(r_jwt_verify_signature(jwt_old, NULL, 0), RHN_OK);
+  r_jwk_free(jwk);
+
+  // The retired key isn't used to sign new tokens anymore
+  ck_assert_ptr_ne(token_new = get_client_cred_access_token(), NULL);
+  ck_assert_int_eq(r_jwt_init(&jwt_new), RHN_OK);
+  ck_assert_int_eq(r_jwt_parse(jwt_new, token_new, 0), RHN_OK);
+  ck_assert_str_ne(KID_1, r_jwt_get_header_str_value(jwt_new, "kid"));
+  ck_assert_ptr_ne(jwk = r_jwks_get_by_kid(jwks_pub, r_jwt_get_header_str_value(jwt_new, "kid")), NULL);
+  ck_assert_int_eq(r_jwt_add_sign_keys(jwt_new, NULL, jwk), RHN_OK);
+  ck_assert_int_eq(r_jwt_verify_signature(jwt_new, NULL, 0), RHN_OK);
+  r_jwk_free(jwk);
+
+  ck_assert_int_eq(run_simple_test(&admin_req, "DELETE", SERVER_URI "/mod/plugin/" PLUGIN_NAME, NULL, NULL, NULL, NULL, 200, NULL, NULL, NULL), 1);
+  r_jwks_free(jwks_pub);
+  r_jwt_free(jwt_old);
+  r_jwt_free(jwt_new);
+  o_free(token_old);
+  o_free(token_new);
+  ulfius_stop_framework(&instance);
+  ulfius_clean_instance(&instance);
+}
+END_TEST
+
 static Suite *glewlwyd_suite(void)
 {
   Suite *s;
@@ -1564,6 +1754,12 @@ static Suite *glewlwyd_suite(void)
   tcase_add_test(tc_core, test_oidc_jwks_request_token_jwt_nested_rsa_no_kid_invalid);
   tcase_add_test(tc_core, test_oidc_jwks_delete_client);
   tcase_add_test(tc_core, test_oidc_jwks_delete_module);
+  tcase_add_test(tc_core, test_oidc_jwks_add_module_pending_key);
+  tcase_add_test(tc_core, test_oidc_jwks_add_client_no_sign_kid);
+  tcase_add_test(tc_core, test_oidc_jwks_client_cred_pending_key);
+  tcase_add_test(tc_core, test_oidc_jwks_delete_module);
+  tcase_add_test(tc_core, test_oidc_jwks_client_cred_rotation);
+  tcase_add_test(tc_core, test_oidc_jwks_delete_client);
   tcase_set_timeout(tc_core, 30);
   suite_add_tcase(s, tc_core);
 
@@ -1044,6 +1044,104 @@ START_TEST(test_oidc_jwt_encrypted_id_token_valid_jwks)
 }
 END_TEST
 
+static char * get_id_token(void) {
+  struct _u_response resp;
+  char * id_token = NULL;
+
+  ulfius_init_response(&resp);
+  o_free(user_req.http_url);
+  user_req.http_url = msprintf("%s/%s/auth?response_type=id_token&g_continue&client_id=%s&redirect_uri=%s&state=xyzabcd&nonce=nonce1234&scope=%s", SERVER_URI, PLUGIN_NAME, CLIENT_ID, CLIENT_REDIRECT, SCOPE_LIST);
+  o_free(user_req.http_verb);
+  user_req.http_verb = o_strdup("GET");
+  if (ulfius_send_http_request(&user_req, &resp) == U_OK && resp.status == 302 && o_strstr(u_map_get(resp.map_header, "Location"), "id_token=") != NULL) {
+    id_token = o_strdup(o_strstr(u_map_get(resp.map_header, "Location"), "id_token=")+o_strlen("id_token="));
+    if (o_strchr(id_token, '&')) {
+      *o_strchr(id_token, '&') = '\0';
+    }
+  }
+  ulfius_clean_response(&resp);
+  return id_token;
+}
+
+START_TEST(test_oidc_jwt_encrypted_id_token_valid_jwks_cached)
+{
+  jwt_t * jwt_idt;
+  jwks_t * jwks;
+  char * id_token;
+  int i;
+
+  ck_assert_int_eq(r_jwks_init(&jwks), RHN_OK);
+  ck_assert_int_eq(r_jwks_import_from_json_str(jwks, jwks_privkey), RHN_OK);
+  // The second id_token is encrypted with the client jwks kept in cache
+  for (i=0; i<2; i++) {
+    ck_assert_ptr_ne((id_token = get_id_token()), NULL);
+    ck_assert_int_eq(r_jwt_init(&jwt_idt), RHN_OK);
+    ck_assert_int_eq(r_jwt_parse(jwt_idt, id_token, 0), RHN_OK);
+    ck_assert_int_eq(R_JWT_TYPE_NESTED_SIGN_THEN_ENCRYPT, r_jwt_get_type(jwt_idt));
+    ck_assert_str_eq(r_jwt_get_header_str_value(jwt_idt, "kid"), KID_2);
+    ck_assert_int_eq(r_jwt_add_enc_jwks(jwt_idt, jwks, NULL), RHN_OK);
+    ck_assert_int_eq(r_jwt_add_sign_keys_pem_der(jwt_idt, R_FORMAT_PEM, NULL, 0, (unsigned char *)pubkey_2_pem, o_strlen(pubkey_2_pem)), RHN_OK);
+    ck_assert_int_eq(r_jwt_decrypt_verify_signature_nested(jwt_idt, NULL, 0, NULL, 0), RHN_OK);
+    r_jwt_free(jwt_idt);
+    o_free(id_token);
+  }
+  r_jwks_free(jwks);
+}
+END_TEST
+
+START_TEST(test_oidc_jwt_encrypted_update_client_jwks_to_pubkey)
+{
+  json_t * j_client = json_pack("{ss ss so s[s] s[sssss] s[s] ss ss ss ss ss ss ss ss so}",
+                                "client_secret", CLIENT_SECRET,
+                                "name", CLIENT_NAME,
+                                "confidential", json_true(),
+                                "redirect_uri", CLIENT_REDIRECT,
+                                "authorization_type",
+                                  "code", "token", "id_token", "password", "client_credentials",
+                                "scope", CLIENT_SCOPE,
+                                "pubkey", pubkey_1_pem,
+                                "enc", CLIENT_ENC,
+                                "alg", CLIENT_PUBKEY_ALG,
+                                "encrypt_code", "1",
+                                "encrypt_at", "TruE",
+                                "encrypt_userinfo", "YES",
+                                "encrypt_id_token", "indeed, my friend",
+                                "encrypt_refresh_token", "1",
+                                "enabled", json_true());
+  ck_assert_int_eq(run_simple_test(&admin_req, "PUT", SERVER_URI "/client/" CLIENT_ID, NULL, NULL, j_client, NULL, 200, NULL, NULL, NULL), 1);
+  json_decref(j_client);
+}
+END_TEST
+
+START_TEST(test_oidc_jwt_encrypted_id_token_valid_updated_client)
+{
+  jwt_t * jwt_idt;
+  jwks_t * jwks;
+  char * id_token;
+
+  // The cached client jwks must not be used after the client update
+  ck_assert_ptr_ne((id_token = get_id_token()), NULL);
+  ck_assert_int_eq(r_jwks_init(&jwks), RHN_OK);
+  ck_assert_int_eq(r_jwks_import_from_json_str(jwks, jwks_privkey), RHN_OK);
+  ck_assert_int_eq(r_jwt_init(&jwt_idt), RHN_OK);
+  ck_assert_int_eq(r_jwt_parse(jwt_idt, id_token, 0), RHN_OK);
+  ck_assert_int_eq(R_JWT_TYPE_NESTED_SIGN_THEN_ENCRYPT, r_jwt_get_type(jwt_idt));
+  ck_assert_int_eq(r_jwt_add_enc_jwks(jwt_idt, jwks, NULL), RHN_OK);
+  ck_assert_int_ne(r_jwt_decrypt_nested(jwt_idt, NULL, 0), RHN_OK);
+  r_jwt_free(jwt_idt);
+
+  ck_assert_int_eq(r_jwt_init(&jwt_idt), RHN_OK);
+  ck_assert_int_eq(r_jwt_parse(jwt_idt, id_token, 0), RHN_OK);
+  ck_assert_int_eq(r_jwt_add_enc_keys_pem_der(jwt_idt, R_FORMAT_PEM, (unsigned char *)privkey_1_pem, o_strlen(privkey_1_pem), NULL, 0), RHN_OK);
+  ck_assert_int_eq(r_jwt_add_sign_keys_pem_der(jwt_idt, R_FORMAT_PEM, NULL, 0, (unsigned char *)pubkey_2_pem, o_strlen(pubkey_2_pem)), RHN_OK);
+  ck_assert_int_eq(r_jwt_decrypt_verify_signature_nested(jwt_idt, NULL, 0, NULL, 0), RHN_OK);
+  r_jwt_free(jwt_idt);
+
+  r_jwks_free(jwks);
+  o_free(id_token);
+}
+END_TEST
+
 static Suite *glewlwyd_suite(void)
 {
   Suite *s;
@@ -1074,6 +1172,9 @@ static Suite *glewlwyd_suite(void)
   tcase_add_test(tc_core, test_oidc_jwt_encrypted_delete_client_pubkey);
   tcase_add_test(tc_core, test_oidc_jwt_encrypted_add_client_jwks);
   tcase_add_test(tc_core, test_oidc_jwt_encrypted_id_token_valid_jwks);
+  tcase_add_test(tc_core, test_oidc_jwt_encrypted_id_token_valid_jwks_cached);
+  tcase_add_test(tc_core, test_oidc_jwt_encrypted_update_client_jwks_to_pubkey);
+  tcase_add_test(tc_core, test_oidc_jwt_encrypted_id_token_valid_updated_client);
   tcase_add_test(tc_core, test_oidc_jwt_encrypted_delete_client_pubkey);
   tcase_add_test(tc_core, test_oidc_jwt_encrypted_delete_module);
   tcase_set_timeout(tc_core, 30);
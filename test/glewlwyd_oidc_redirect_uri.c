@@ -0,0 +1,153 @@
+/* Public domain, no copyright. Use at your own risk. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <check.h>
+#include <ulfius.h>
+#include <orcania.h>
+#include <yder.h>
+
+#include "unit-tests.h"
+
+#define SERVER_URI "http://localhost:4593/api"
+#define USERNAME_ADMIN "admin"
+#define PASSWORD_ADMIN "password"
+#define SCOPE_LIST "openid"
+#define CLIENT_ID "client_redirect_uri"
+#define CLIENT_NAME "client with many redirect_uri"
+#define CLIENT_REDIRECT_URI_PREFIX "https://client.tld/callback"
+#define CLIENT_REDIRECT_URI_NEW "https://client.tld/new-callback"
+#define NB_REDIRECT_URI 300
+
+struct _u_request admin_req;
+
+START_TEST(test_oidc_redirect_uri_add_client)
+{
+  json_t * j_parameters = json_pack("{sssssos[]s[s]so}",
+                                "client_id", CLIENT_ID,
+                                "client_name", CLIENT_NAME,
+                                "confidential", json_false(),
+                                "redirect_uri",
+                                "authorization_type", "code",
+                                "enabled", json_true());
+  char * redirect_uri;
+  int i;
+
+  for (i=0; i<NB_REDIRECT_URI; i++) {
+    redirect_uri = msprintf(CLIENT_REDIRECT_URI_PREFIX "/%d", i);
+    json_array_append_new(json_object_get(j_parameters, "redirect_uri"), json_string(redirect_uri));
+    o_free(redirect_uri);
+  }
+  ck_assert_int_eq(run_simple_test(&admin_req, "POST", SERVER_URI "/client/", NULL, NULL, j_parameters, NULL, 200, NULL, NULL, NULL), 1);
+  json_decref(j_parameters);
+}
+END_TEST
+
+START_TEST(test_oidc_redirect_uri_valid)
+{
+  ck_assert_int_eq(run_simple_test(NULL, "GET", SERVER_URI "/oidc/auth?response_type=code&client_id=" CLIENT_ID "&redirect_uri=" CLIENT_REDIRECT_URI_PREFIX "/0&state=xyz&scope=" SCOPE_LIST, NULL, NULL, NULL, NULL, 302, NULL, NULL, "login.html"), 1);
+  ck_assert_int_eq(run_simple_test(NULL, "GET", SERVER_URI "/oidc/auth?response_type=code&client_id=" CLIENT_ID "&redirect_uri=" CLIENT_REDIRECT_URI_PREFIX "/299&state=xyz&scope=" SCOPE_LIST, NULL, NULL, NULL, NULL, 302, NULL, NULL, "login.html"), 1);
+}
+END_TEST
+
+START_TEST(test_oidc_redirect_uri_invalid)
+{
+  ck_assert_int_eq(run_simple_test(NULL, "GET", SERVER_URI "/oidc/auth?response_type=code&client_id=" CLIENT_ID "&redirect_uri=" CLIENT_REDIRECT_URI_PREFIX "/300&state=xyz&scope=" SCOPE_LIST, NULL, NULL, NULL, NULL, 302, NULL, NULL, "unauthorized_client"), 1);
+  ck_assert_int_eq(run_simple_test(NULL, "GET", SERVER_URI "/oidc/auth?response_type=code&client_id=" CLIENT_ID "&redirect_uri=" CLIENT_REDIRECT_URI_PREFIX "&state=xyz&scope=" SCOPE_LIST, NULL, NULL, NULL, NULL, 302, NULL, NULL, "unauthorized_client"), 1);
+  ck_assert_int_eq(run_simple_test(NULL, "GET", SERVER_URI "/oidc/auth?response_type=code&client_id=" CLIENT_ID "&redirect_uri=" CLIENT_REDIRECT_URI_NEW "&state=xyz&scope=" SCOPE_LIST, NULL, NULL, NULL, NULL, 302, NULL, NULL, "unauthorized_client"), 1);
+}
+END_TEST
+
+START_TEST(test_oidc_redirect_uri_update_client)
+{
+  json_t * j_parameters = json_pack("{sss[s]}", "client_name", CLIENT_NAME, "redirect_uri", CLIENT_REDIRECT_URI_NEW);
+
+  ck_assert_int_eq(run_simple_test(&admin_req, "PUT", SERVER_URI "/client/" CLIENT_ID, NULL, NULL, j_parameters, NULL, 200, NULL, NULL, NULL), 1);
+  json_decref(j_parameters);
+}
+END_TEST
+
+START_TEST(test_oidc_redirect_uri_updated)
+{
+  ck_assert_int_eq(run_simple_test(NULL, "GET", SERVER_URI "/oidc/auth?response_type=code&client_id=" CLIENT_ID "&redirect_uri=" CLIENT_REDIRECT_URI_NEW "&state=xyz&scope=" SCOPE_LIST, NULL, NULL, NULL, NULL, 302, NULL, NULL, "login.html"), 1);
+  ck_assert_int_eq(run_simple_test(NULL, "GET", SERVER_URI "/oidc/auth?response_type=code&client_id=" CLIENT_ID "&redirect_uri=" CLIENT_REDIRECT_URI_PREFIX "/0&state=xyz&scope=" SCOPE_LIST, NULL, NULL, NULL, NULL, 302, NULL, NULL, "unauthorized_client"), 1);
+}
+END_TEST
+
+START_TEST(test_oidc_redirect_uri_delete_client)
+{
+  ck_assert_int_eq(run_simple_test(&admin_req, "DELETE", SERVER_URI "/client/" CLIENT_ID, NULL, NULL, NULL, NULL, 200, NULL, NULL, NULL), 1);
+}
+END_TEST
+
+static Suite *glewlwyd_suite(void)
+{
+  Suite *s;
+  TCase *tc_core;
+
+  s = suite_create("Glewlwyd oidc redirect_uri");
+  tc_core = tcase_create("test_oidc_redirect_uri");
+  tcase_add_test(tc_core, test_oidc_redirect_uri_add_client);
+  tcase_add_test(tc_core, test_oidc_redirect_uri_valid);
+  tcase_add_test(tc_core, test_oidc_redirect_uri_invalid);
+  tcase_add_test(tc_core, test_oidc_redirect_uri_update_client);
+  tcase_add_test(tc_core, test_oidc_redirect_uri_updated);
+  tcase_add_test(tc_core, test_oidc_redirect_uri_delete_client);
+  tcase_set_timeout(tc_core, 30);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+int main(int argc, char *argv[])
+{
+  int number_failed = 0;
+  Suite *s;
+  SRunner *sr;
+  struct _u_request auth_req;
+  struct _u_response auth_resp;
+  int res, do_test = 0, i;
+  json_t * j_body;
+  
+  y_init_logs("Glewlwyd test", Y_LOG_MODE_CONSOLE, Y_LOG_LEVEL_DEBUG, NULL, "Starting Glewlwyd test");
+  
+  // Getting a valid session id for authenticated http requests
+  ulfius_init_request(&auth_req);
+  ulfius_init_request(&admin_req);
+  ulfius_init_response(&auth_resp);
+  auth_req.http_verb = strdup("POST");
+  auth_req.http_url = msprintf("%s/auth/", SERVER_URI);
+  j_body = json_pack("{ssss}", "username", USERNAME_ADMIN, "password", PASSWORD_ADMIN);
+  ulfius_set_json_body_request(&auth_req, j_body);
+  json_decref(j_body);
+  res = ulfius_send_http_request(&auth_req, &auth_resp);
+  if (res == U_OK && auth_resp.status == 200) {
+    for (i=0; i<auth_resp.nb_cookies; i++) {
+      char * cookie = msprintf("%s=%s", auth_resp.map_cookie[i].key, auth_resp.map_cookie[i].value);
+      u_map_put(admin_req.map_header, "Cookie", cookie);
+      o_free(cookie);
+      do_test = 1;
+    }
+    ulfius_clean_response(&auth_resp);
+  } else {
+    y_log_message(Y_LOG_LEVEL_ERROR, "Error authentication");
+  }
+  ulfius_clean_request(&auth_req);
+  
+  if (do_test) {
+    s = glewlwyd_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+  }
+  
+  ulfius_clean_request(&admin_req);
+  
+  return (do_test && number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
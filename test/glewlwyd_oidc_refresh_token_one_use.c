@@ -5,6 +5,7 @@
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#include <pthread.h>
 #include <gnutls/gnutls.h>
 #include <gnutls/crypto.h>
 #include <gnutls/abstract.h>
@@ -41,6 +42,8 @@
 #define CLIENT_NAME "client one use refresh tokens"
 #define CLIENT_SECRET "very-secret"
 
+#define REFRESH_CONCURRENT_THREADS 16
+
 struct _u_request admin_req;
 
 START_TEST(test_oidc_refresh_token_one_use_add_module_always_ok)
@@ -368,6 +371,82 @@ START_TEST(test_oidc_refresh_token_one_use_simulate_attack_valid)
 }
 END_TEST
 
+struct _refresh_thread {
+  const char * refresh_token;
+  int status;
+};
+
+static void * run_refresh_token_thread(void * args) {
+  struct _refresh_thread * refresh_thread = (struct _refresh_thread *)args;
+  struct _u_request req;
+  struct _u_response resp;
+
+  ulfius_init_request(&req);
+  ulfius_init_response(&resp);
+  req.http_url = o_strdup(SERVER_URI "/" PLUGIN_NAME "/token/");
+  req.http_verb = o_strdup("POST");
+  u_map_put(req.map_post_body, "grant_type", "refresh_token");
+  u_map_put(req.map_post_body, "client_id", CLIENT_ID);
+  u_map_put(req.map_post_body, "client_secret", CLIENT_SECRET);
+  u_map_put(req.map_post_body, "refresh_token", refresh_thread->refresh_token);
+  if (ulfius_send_http_request(&req, &resp) == U_OK) {
+    refresh_thread->status = (int)resp.status;
+  } else {
+    refresh_thread->status = 0;
+  }
+  ulfius_clean_response(&resp);
+  ulfius_clean_request(&req);
+  return NULL;
+}
+
+START_TEST(test_oidc_refresh_token_one_use_concurrent_rotation_valid)
+{
+  struct _u_request req;
+  struct _u_response resp;
+  json_t * j_resp;
+  struct _refresh_thread refresh_thread[REFRESH_CONCURRENT_THREADS];
+  pthread_t thread[REFRESH_CONCURRENT_THREADS];
+  int i, nb_ok = 0, nb_invalid = 0;
+  
+  ck_assert_int_eq(ulfius_init_request(&req), U_OK);
+  ck_assert_int_eq(ulfius_init_response(&resp), U_OK);
+  req.http_url = o_strdup(SERVER_URI "/" PLUGIN_NAME "/token/");
+  req.http_verb = o_strdup("POST");
+  u_map_put(req.map_post_body, "grant_type", "password");
+  u_map_put(req.map_post_body, "client_id", CLIENT_ID);
+  u_map_put(req.map_post_body, "client_secret", CLIENT_SECRET);
+  u_map_put(req.map_post_body, "scope", SCOPE_LIST);
+  u_map_put(req.map_post_body, "username", USERNAME);
+  u_map_put(req.map_post_body, "password", PASSWORD);
+  
+  ck_assert_int_eq(ulfius_send_http_request(&req, &resp), U_OK);
+  ck_assert_int_eq(200, resp.status);
+  ck_assert_ptr_ne(j_resp = ulfius_get_json_body_response(&resp, NULL), NULL);
+  ck_assert_ptr_ne(json_object_get(j_resp, "refresh_token"), NULL);
+  ulfius_clean_response(&resp);
+  ulfius_clean_request(&req);
+  
+  // Rotate the same refresh token from many threads, only one may get a new token
+  for (i=0; i<REFRESH_CONCURRENT_THREADS; i++) {
+    refresh_thread[i].refresh_token = json_string_value(json_object_get(j_resp, "refresh_token"));
+    refresh_thread[i].status = 0;
+    ck_assert_int_eq(pthread_create(&thread[i], NULL, run_refresh_token_thread, &refresh_thread[i]), 0);
+  }
+  for (i=0; i<REFRESH_CONCURRENT_THREADS; i++) {
+    pthread_join(thread[i], NULL);
+    if (refresh_thread[i].status == 200) {
+      nb_ok++;
+    } else if (refresh_thread[i].status == 400) {
+      nb_invalid++;
+    }
+  }
+  ck_assert_int_eq(nb_ok, 1);
+  ck_assert_int_eq(nb_invalid, REFRESH_CONCURRENT_THREADS-1);
+  
+  json_decref(j_resp);
+}
+END_TEST
+
 static Suite *glewlwyd_suite(void)
 {
   Suite *s;
@@ -379,6 +458,7 @@ static Suite *glewlwyd_suite(void)
   tcase_add_test(tc_core, test_oidc_refresh_token_one_use_add_client_ok);
   tcase_add_test(tc_core, test_oidc_refresh_token_one_use_refresh_queue_valid);
   tcase_add_test(tc_core, test_oidc_refresh_token_one_use_simulate_attack_valid);
+  tcase_add_test(tc_core, test_oidc_refresh_token_one_use_concurrent_rotation_valid);
   tcase_add_test(tc_core, test_oidc_refresh_token_one_use_delete_client);
   tcase_add_test(tc_core, test_oidc_refresh_token_one_use_delete_module);
   tcase_add_test(tc_core, test_oidc_refresh_token_one_use_add_module_client_driven_ok);
@@ -46,6 +46,11 @@
 #define TOKEN_TYPE_HINT_ID_TOKEN "id_token"
 #define TOKEN_TYPE_BEARER "bearer"
 
+#define REVOKE_USERNAME "revoke_user"
+#define REVOKE_PASSWORD "password"
+#define REVOKE_NB_TOKENS 4100 // More than the batches run by the request thread
+#define REVOKE_WAIT 60
+
 struct _u_request admin_req;
 
 START_TEST(test_oidc_introspection_plugin_add_target_client)
@@ -900,6 +905,106 @@ START_TEST(test_oidc_introspection_id_token)
 }
 END_TEST
 
+static int is_introspection_active(const char * token) {
+  struct _u_request req;
+  struct _u_response resp;
+  json_t * j_body;
+  int ret = -1;
+
+  ulfius_init_request(&req);
+  ulfius_init_response(&resp);
+  req.http_verb = o_strdup("POST");
+  req.http_url = o_strdup(SERVER_URI "/" PLUGIN_NAME "/introspect");
+  req.auth_basic_user = o_strdup(CLIENT_CONFIDENTIAL_1);
+  req.auth_basic_password = o_strdup(CLIENT_CONFIDENTIAL_1_SECRET);
+  u_map_put(req.map_post_body, "token", token);
+  if (ulfius_send_http_request(&req, &resp) == U_OK && resp.status == 200) {
+    j_body = ulfius_get_json_body_response(&resp, NULL);
+    ret = (json_object_get(j_body, "active") == json_true());
+    json_decref(j_body);
+  }
+  ulfius_clean_response(&resp);
+  ulfius_clean_request(&req);
+  return ret;
+}
+
+START_TEST(test_oidc_introspection_revoke_user_add)
+{
+  json_t * j_parameters = json_pack("{sssssos[s]}", "username", REVOKE_USERNAME, "password", REVOKE_PASSWORD, "enabled", json_true(), "scope", SCOPE_LIST);
+
+  ck_assert_int_eq(run_simple_test(&admin_req, "POST", SERVER_URI "/user/", NULL, NULL, j_parameters, NULL, 200, NULL, NULL, NULL), 1);
+  json_decref(j_parameters);
+}
+END_TEST
+
+START_TEST(test_oidc_introspection_revoke_user_tokens_disabled)
+{
+  struct _u_request req;
+  struct _u_response resp;
+  json_t * j_body, * j_token_list = json_array(), * j_element = NULL;
+  char * refresh_token;
+  size_t index = 0;
+  int i, active;
+
+  ck_assert_ptr_ne(j_token_list, NULL);
+  ulfius_init_request(&req);
+  ulfius_init_response(&resp);
+  req.http_verb = o_strdup("POST");
+  req.http_url = o_strdup(SERVER_URI "/" PLUGIN_NAME "/token");
+  u_map_put(req.map_post_body, "grant_type", "password");
+  u_map_put(req.map_post_body, "scope", SCOPE_LIST);
+  u_map_put(req.map_post_body, "username", REVOKE_USERNAME);
+  u_map_put(req.map_post_body, "password", REVOKE_PASSWORD);
+  req.auth_basic_user = o_strdup(CLIENT_CONFIDENTIAL_1);
+  req.auth_basic_password = o_strdup(CLIENT_CONFIDENTIAL_1_SECRET);
+  ck_assert_int_eq(ulfius_send_http_request(&req, &resp), U_OK);
+  ck_assert_int_eq(resp.status, 200);
+  j_body = ulfius_get_json_body_response(&resp, NULL);
+  refresh_token = o_strdup(json_string_value(json_object_get(j_body, "refresh_token")));
+  ck_assert_ptr_ne(refresh_token, NULL);
+  json_array_append(j_token_list, json_object_get(j_body, "access_token"));
+  json_decref(j_body);
+  ulfius_clean_response(&resp);
+  ulfius_clean_request(&req);
+
+  // Every refresh adds an access token to revoke
+  for (i=1; i<REVOKE_NB_TOKENS; i++) {
+    ulfius_init_request(&req);
+    ulfius_init_response(&resp);
+    req.http_verb = o_strdup("POST");
+    req.http_url = o_strdup(SERVER_URI "/" PLUGIN_NAME "/token");
+    u_map_put(req.map_post_body, "grant_type", "refresh_token");
+    u_map_put(req.map_post_body, "refresh_token", refresh_token);
+    req.auth_basic_user = o_strdup(CLIENT_CONFIDENTIAL_1);
+    req.auth_basic_password = o_strdup(CLIENT_CONFIDENTIAL_1_SECRET);
+    ck_assert_int_eq(ulfius_send_http_request(&req, &resp), U_OK);
+    ck_assert_int_eq(resp.status, 200);
+    j_body = ulfius_get_json_body_response(&resp, NULL);
+    ck_assert_ptr_ne(json_object_get(j_body, "access_token"), NULL);
+    json_array_append(j_token_list, json_object_get(j_body, "access_token"));
+    json_decref(j_body);
+    ulfius_clean_response(&resp);
+    ulfius_clean_request(&req);
+  }
+  ck_assert_int_eq(is_introspection_active(refresh_token), 1);
+  ck_assert_int_eq(is_introspection_active(json_string_value(json_array_get(j_token_list, 0))), 1);
+  ck_assert_int_eq(is_introspection_active(json_string_value(json_array_get(j_token_list, REVOKE_NB_TOKENS-1))), 1);
+
+  ck_assert_int_eq(run_simple_test(&admin_req, "DELETE", SERVER_URI "/user/" REVOKE_USERNAME, NULL, NULL, NULL, NULL, 200, NULL, NULL, NULL), 1);
+
+  // The end of the revocation runs in background
+  ck_assert_int_eq(is_introspection_active(refresh_token), 0);
+  json_array_foreach(j_token_list, index, j_element) {
+    for (i=0; (active = is_introspection_active(json_string_value(j_element))) == 1 && i<REVOKE_WAIT; i++) {
+      sleep(1);
+    }
+    ck_assert_int_eq(active, 0);
+  }
+  o_free(refresh_token);
+  json_decref(j_token_list);
+}
+END_TEST
+
 static Suite *glewlwyd_suite(void)
 {
   Suite *s;
@@ -911,6 +1016,8 @@ static Suite *glewlwyd_suite(void)
   tcase_add_test(tc_core, test_oidc_introspection_invalid_format_target_client);
   tcase_add_test(tc_core, test_oidc_introspection_access_token_target_client);
   tcase_add_test(tc_core, test_oidc_introspection_refresh_token_target_client);
+  tcase_add_test(tc_core, test_oidc_introspection_revoke_user_add);
+  tcase_add_test(tc_core, test_oidc_introspection_revoke_user_tokens_disabled);
   tcase_add_test(tc_core, test_oidc_introspection_plugin_remove);
   tcase_add_test(tc_core, test_oidc_introspection_plugin_add_auth_scope);
   tcase_add_test(tc_core, test_oidc_introspection_invalid_format_bearer);
@@ -925,7 +1032,7 @@ static Suite *glewlwyd_suite(void)
   tcase_add_test(tc_core, test_oidc_introspection_plugin_add_target_client_check_expiration);
   tcase_add_test(tc_core, test_oidc_introspection_token_target_client_check_expiration);
   tcase_add_test(tc_core, test_oidc_introspection_plugin_remove);
-  tcase_set_timeout(tc_core, 30);
+  tcase_set_timeout(tc_core, 300);
   suite_add_tcase(s, tc_core);
 
   return s;
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#include <pthread.h>
 
 #include <check.h>
 #include <ulfius.h>
@@ -25,6 +26,8 @@
 #define CLIENT_SECRET "password"
 #define CLIENT_REDIRECT_URI "../../test-oauth2.html?param=client3"
 #define RESPONSE_TYPE "code"
+#define ALLOC_CACHE_NB_THREADS 8
+#define ALLOC_CACHE_NB_REQUESTS 50
 
 struct _u_request admin_req;
 struct _u_request user_req;
@@ -322,6 +325,58 @@ START_TEST(test_glwd_prometheus_metrics_glwd_flow_ok)
 }
 END_TEST
 
+/**
+ * Sends requests sharing the same session and scopes, so the server
+ * frees in a thread the blocks allocated by another one
+ */
+static void * run_alloc_cache_requests(void * args) {
+  struct _u_request req;
+  struct _u_response resp;
+  size_t * nb_error = (size_t *)args;
+  int i;
+
+  for (i=0; i<ALLOC_CACHE_NB_REQUESTS; i++) {
+    ulfius_init_request(&req);
+    ulfius_init_response(&resp);
+    req.http_verb = o_strdup("GET");
+    if (i%2) {
+      req.http_url = o_strdup(SERVER_URI "/profile_list/");
+      u_map_put(req.map_header, "Cookie", u_map_get(user_req.map_header, "Cookie"));
+    } else {
+      req.http_url = o_strdup(SERVER_URI "/scope/");
+      u_map_put(req.map_header, "Cookie", u_map_get(admin_req.map_header, "Cookie"));
+    }
+    if (ulfius_send_http_request(&req, &resp) != U_OK || resp.status != 200) {
+      (*nb_error)++;
+    }
+    ulfius_clean_request(&req);
+    ulfius_clean_response(&resp);
+  }
+  return NULL;
+}
+
+START_TEST(test_glwd_prometheus_metrics_alloc_cache_threads)
+{
+  pthread_t thread[ALLOC_CACHE_NB_THREADS];
+  size_t nb_error[ALLOC_CACHE_NB_THREADS] = {0};
+  json_t * j_label = json_pack("{ss}", "class", "auth");
+  int nb_alloc_1, nb_alloc_2, i;
+
+  ck_assert_int_ne(-1, nb_alloc_1 = get_metrics("glewlwyd_alloc_total", j_label));
+  for (i=0; i<ALLOC_CACHE_NB_THREADS; i++) {
+    ck_assert_int_eq(pthread_create(&thread[i], NULL, &run_alloc_cache_requests, &nb_error[i]), 0);
+  }
+  for (i=0; i<ALLOC_CACHE_NB_THREADS; i++) {
+    ck_assert_int_eq(pthread_join(thread[i], NULL), 0);
+    ck_assert_int_eq(nb_error[i], 0);
+  }
+  ck_assert_int_eq(run_simple_test(&user_req, "GET", SERVER_URI "/profile_list/", NULL, NULL, NULL, NULL, 200, NULL, NULL, NULL), 1);
+  ck_assert_int_gt(nb_alloc_2 = get_metrics("glewlwyd_alloc_total", j_label), nb_alloc_1);
+  ck_assert_int_gt(get_metrics("glewlwyd_alloc_cache_hit_total", j_label), 0);
+  json_decref(j_label);
+}
+END_TEST
+
 static Suite *glewlwyd_suite(void)
 {
   Suite *s;
@@ -334,6 +389,7 @@ static Suite *glewlwyd_suite(void)
   tcase_add_test(tc_core, test_glwd_prometheus_metrics_auth_invalid_pwd_increase);
   tcase_add_test(tc_core, test_glwd_prometheus_metrics_oidc_flow_ok);
   tcase_add_test(tc_core, test_glwd_prometheus_metrics_glwd_flow_ok);
+  tcase_add_test(tc_core, test_glwd_prometheus_metrics_alloc_cache_threads);
   tcase_set_timeout(tc_core, 30);
   suite_add_tcase(s, tc_core);
 
@@ -0,0 +1,138 @@
+/* Public domain, no copyright. Use at your own risk. */
+
+/**
+ * This test needs a Glewlwyd instance using the configuration file test/glewlwyd-rate-limit.conf
+ * $ ./glewlwyd --config-file=test/glewlwyd-rate-limit.conf
+ * The endpoint auth is limited to 3 requests per username, refilled at 1 request per minute
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <check.h>
+#include <ulfius.h>
+#include <orcania.h>
+#include <yder.h>
+
+#include "unit-tests.h"
+
+#define SERVER_URI "http://localhost:4593/api"
+#define PASSWORD "invalid"
+#define RATE_LIMIT_BURST 3
+#define RATE_LIMIT_STRIPES 32
+#define RATE_LIMIT_STRIPE_MAX_BUCKETS 4096
+#define USERNAME_THROTTLED "rate_limit_throttled"
+#define USERNAME_TARGET "rate_limit_target"
+
+/**
+ * Same hash as the server, so the usernames sprayed fill the stripe of the target bucket
+ */
+static size_t get_stripe_index(const char * username) {
+  char * key = msprintf("auth\tusername\t%s", username), * cur;
+  size_t hash = 2166136261u;
+
+  for (cur = key; *cur; cur++) {
+    hash = (hash ^ (unsigned char)*cur) * 16777619u;
+  }
+  o_free(key);
+  return hash % RATE_LIMIT_STRIPES;
+}
+
+static int auth_status(const char * username, int check_retry_after) {
+  struct _u_request req;
+  struct _u_response resp;
+  json_t * j_body = json_pack("{ssss}", "username", username, "password", PASSWORD);
+  int status;
+
+  ulfius_init_request(&req);
+  ulfius_init_response(&resp);
+  ck_assert_int_eq(ulfius_set_request_properties(&req, U_OPT_HTTP_VERB, "POST", U_OPT_HTTP_URL, SERVER_URI "/auth/", U_OPT_JSON_BODY, j_body, U_OPT_NONE), U_OK);
+  ck_assert_int_eq(ulfius_send_http_request(&req, &resp), U_OK);
+  status = resp.status;
+  if (check_retry_after) {
+    ck_assert_int_gt(strtol(u_map_get_case(resp.map_header, "Retry-After"), NULL, 10), 0);
+  }
+  json_decref(j_body);
+  ulfius_clean_request(&req);
+  ulfius_clean_response(&resp);
+  return status;
+}
+
+START_TEST(test_glwd_rate_limit_throttle)
+{
+  int i;
+
+  for (i=0; i<RATE_LIMIT_BURST; i++) {
+    ck_assert_int_eq(auth_status(USERNAME_THROTTLED, 0), 401);
+  }
+  ck_assert_int_eq(auth_status(USERNAME_THROTTLED, 1), 429);
+  ck_assert_int_eq(auth_status(USERNAME_THROTTLED, 1), 429);
+  // Other usernames have their own bucket
+  ck_assert_int_eq(auth_status(USERNAME_THROTTLED "_other", 0), 401);
+}
+END_TEST
+
+START_TEST(test_glwd_rate_limit_full_stripe_keeps_throttled)
+{
+  size_t stripe = get_stripe_index(USERNAME_TARGET);
+  char * username;
+  int i, nb_sprayed = 0;
+
+  for (i=0; i<RATE_LIMIT_BURST; i++) {
+    ck_assert_int_eq(auth_status(USERNAME_TARGET, 0), 401);
+  }
+  ck_assert_int_eq(auth_status(USERNAME_TARGET, 1), 429);
+
+  // Fill the stripe of the throttled bucket with new usernames, the stripe is pruned on the way
+  for (i=0; nb_sprayed<RATE_LIMIT_STRIPE_MAX_BUCKETS+256; i++) {
+    username = msprintf("rate_limit_spray_%d", i);
+    if (get_stripe_index(username) == stripe) {
+      // The buckets not throttled are removed to make room, so the new usernames are still tracked
+      ck_assert_int_eq(auth_status(username, 0), 401);
+      nb_sprayed++;
+    }
+    o_free(username);
+  }
+
+  // The throttled bucket wasn't reset by the spray
+  ck_assert_int_eq(auth_status(USERNAME_TARGET, 1), 429);
+}
+END_TEST
+
+static Suite *glewlwyd_suite(void)
+{
+  Suite *s;
+  TCase *tc_core;
+
+  s = suite_create("Glewlwyd rate limit");
+  tc_core = tcase_create("test_glwd_rate_limit");
+  tcase_add_test(tc_core, test_glwd_rate_limit_throttle);
+  tcase_add_test(tc_core, test_glwd_rate_limit_full_stripe_keeps_throttled);
+  tcase_set_timeout(tc_core, 60);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+int main(int argc, char *argv[])
+{
+  int number_failed;
+  Suite *s;
+  SRunner *sr;
+
+  y_init_logs("Glewlwyd test", Y_LOG_MODE_CONSOLE, Y_LOG_LEVEL_DEBUG, NULL, "Starting Glewlwyd test");
+
+  s = glewlwyd_suite();
+  sr = srunner_create(s);
+
+  srunner_run_all(sr, CK_VERBOSE);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+
+  y_close_logs();
+
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
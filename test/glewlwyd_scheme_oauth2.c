@@ -6,6 +6,7 @@
 #include <errno.h>
 #include <time.h>
 #include <ctype.h>
+#include <unistd.h>
 #include <sys/socket.h>
 #include <sys/select.h>
 #include <sys/time.h>
@@ -61,6 +62,8 @@
 
 #define ISSUER "https://glewlwyd.tld/"
 #define AUTH_ENDPOINT "http://localhost:8080/auth"
+#define AUTH_ENDPOINT_REFRESHED "http://localhost:8080/auth_refreshed"
+#define PROVIDER_CONFIG_EXPIRATION 1
 #define TOKEN_ENDPOINT "http://localhost:8080/token"
 #define USERINFO_ENDPOINT "http://localhost:8080/userinfo"
 #define JWKS_URI "http://localhost:8080/jwks"
@@ -342,6 +345,28 @@ static int callback_openid_configuration_valid (const struct _u_request * reques
   return U_CALLBACK_CONTINUE;
 }
 
+static int openid_configuration_version = 0;
+
+/**
+ * Version 0 is the valid configuration, version 1 has another authorization_endpoint,
+ * version 2 is an unavailable config endpoint
+ */
+static int callback_openid_configuration_versioned (const struct _u_request * request, struct _u_response * response, void * user_data) {
+  json_t * j_response;
+  
+  if (openid_configuration_version == 2) {
+    response->status = 500;
+  } else {
+    j_response = json_loads(openid_configuration_valid, JSON_DECODE_ANY, NULL);
+    if (openid_configuration_version == 1) {
+      json_object_set_new(j_response, "authorization_endpoint", json_string(AUTH_ENDPOINT_REFRESHED));
+    }
+    ulfius_set_json_body_response(response, 200, j_response);
+    json_decref(j_response);
+  }
+  return U_CALLBACK_CONTINUE;
+}
+
 static int callback_openid_jwks_valid (const struct _u_request * request, struct _u_response * response, void * user_data) {
   jwk_t * jwk;
   jwks_t * jwks;
@@ -678,6 +703,42 @@ START_TEST(test_glwd_scheme_oauth2_irl_module_add_provider_oidc_code)
 }
 END_TEST
 
+START_TEST(test_glwd_scheme_oauth2_irl_module_add_provider_oidc_code_refresh)
+{
+  struct _u_instance instance;
+  openid_configuration_version = 0;
+  ck_assert_int_eq(ulfius_init_instance(&instance, PROVIDER_PORT, NULL, NULL), U_OK);
+  ck_assert_int_eq(ulfius_add_endpoint_by_val(&instance, "GET", NULL, "/.well-known/openid-configuration", 0, &callback_openid_configuration_versioned, NULL), U_OK);
+  ck_assert_int_eq(ulfius_add_endpoint_by_val(&instance, "GET", NULL, "/jwks", 0, &callback_openid_jwks_valid, NULL), U_OK);
+  ck_assert_int_eq(ulfius_start_framework(&instance), U_OK);
+  json_t * j_parameters = json_pack("{sssssssisis{sssisis[{ssssssssssssssssso}]}}", 
+                                    "module", MODULE_MODULE, 
+                                    "name", MODULE_NAME, 
+                                    "display_name", MODULE_DISPLAY_NAME, 
+                                    "expiration", MODULE_EXPIRATION, 
+                                    "max_use", MODULE_MAX_USE, 
+                                    "parameters", 
+                                      "redirect_uri", REDIRECT_URI,
+                                      "session_expiration", SESSION_EXPIRATION,
+                                      "provider_config_expiration", PROVIDER_CONFIG_EXPIRATION,
+                                      "provider_list",
+                                        "name", PROVIDER_NAME,
+                                        "provider_type", PROVIDER_TYPE_OIDC,
+                                        "logo_uri", PROVIDER_LOGO_URI,
+                                        "logo_fa", PROVIDER_LOGO_FA,
+                                        "response_type", PROVIDER_RESPONSE_TYPE_CODE,
+                                        "client_id", PROVIDER_CLIENT_ID,
+                                        "client_secret", PROVIDER_CLIENT_SECRET,
+                                        "config_endpoint", PROVIDER_CONFIG_ENDPOINT,
+                                        "enabled", json_true());
+  
+  ck_assert_int_eq(run_simple_test(&admin_req, "POST", SERVER_URI "/mod/scheme/", NULL, NULL, j_parameters, NULL, 200, NULL, NULL, NULL), 1);
+  ck_assert_int_eq(ulfius_stop_framework(&instance), U_OK);
+  ulfius_clean_instance(&instance);
+  json_decref(j_parameters);
+}
+END_TEST
+
 START_TEST(test_glwd_scheme_oauth2_irl_module_add_provider_oidc_id_token)
 {
   struct _u_instance instance;
@@ -1479,6 +1540,79 @@ START_TEST(test_glwd_scheme_oauth2_irl_register_oauth2_code_ok)
 }
 END_TEST
 
+/**
+ * Returns the authorization URL of a new registration
+ */
+static char * get_register_new_redirect_to(void) {
+  struct _u_request req;
+  struct _u_response resp;
+  json_t * j_parameters, * j_response;
+  char * redirect_to;
+  
+  ulfius_init_request(&req);
+  ulfius_init_response(&resp);
+  ulfius_copy_request(&req, &user_req);
+  j_parameters = json_pack("{sssssss{ssss}}",
+                           "username", USERNAME,
+                           "scheme_type", MODULE_MODULE,
+                           "scheme_name", MODULE_NAME,
+                           "value",
+                             "provider", PROVIDER_NAME,
+                             "action", "new");
+  req.http_verb = o_strdup("POST");
+  req.http_url = o_strdup(SERVER_URI "profile/scheme/register/");
+  ck_assert_int_eq(ulfius_set_json_body_request(&req, j_parameters), U_OK);
+  ck_assert_int_eq(ulfius_send_http_request(&req, &resp), U_OK);
+  ck_assert_int_eq(resp.status, 200);
+  j_response = ulfius_get_json_body_response(&resp, NULL);
+  ck_assert_ptr_ne(j_response, NULL);
+  redirect_to = o_strdup(json_string_value(json_object_get(j_response, "redirect_to")));
+  ck_assert_ptr_ne(redirect_to, NULL);
+  json_decref(j_parameters);
+  json_decref(j_response);
+  ulfius_clean_request(&req);
+  ulfius_clean_response(&resp);
+  return redirect_to;
+}
+
+START_TEST(test_glwd_scheme_oauth2_irl_register_oidc_provider_config_refresh)
+{
+  struct _u_instance instance;
+  char * redirect_to;
+  
+  ck_assert_int_eq(ulfius_init_instance(&instance, PROVIDER_PORT, NULL, NULL), U_OK);
+  ck_assert_int_eq(ulfius_add_endpoint_by_val(&instance, "GET", NULL, "/.well-known/openid-configuration", 0, &callback_openid_configuration_versioned, NULL), U_OK);
+  ck_assert_int_eq(ulfius_add_endpoint_by_val(&instance, "GET", NULL, "/jwks", 0, &callback_openid_jwks_valid, NULL), U_OK);
+  ck_assert_int_eq(ulfius_start_framework(&instance), U_OK);
+  
+  // The expired configuration is used while it's rebuilt, then the new one is used
+  openid_configuration_version = 1;
+  sleep(PROVIDER_CONFIG_EXPIRATION+1);
+  redirect_to = get_register_new_redirect_to();
+  ck_assert_int_eq(o_strncmp(redirect_to, AUTH_ENDPOINT "?", o_strlen(AUTH_ENDPOINT "?")), 0);
+  o_free(redirect_to);
+  sleep(1);
+  redirect_to = get_register_new_redirect_to();
+  ck_assert_int_eq(o_strncmp(redirect_to, AUTH_ENDPOINT_REFRESHED "?", o_strlen(AUTH_ENDPOINT_REFRESHED "?")), 0);
+  o_free(redirect_to);
+  
+  // The current configuration is kept when the rebuild fails
+  openid_configuration_version = 2;
+  sleep(PROVIDER_CONFIG_EXPIRATION+1);
+  redirect_to = get_register_new_redirect_to();
+  ck_assert_int_eq(o_strncmp(redirect_to, AUTH_ENDPOINT_REFRESHED "?", o_strlen(AUTH_ENDPOINT_REFRESHED "?")), 0);
+  o_free(redirect_to);
+  sleep(1);
+  redirect_to = get_register_new_redirect_to();
+  ck_assert_int_eq(o_strncmp(redirect_to, AUTH_ENDPOINT_REFRESHED "?", o_strlen(AUTH_ENDPOINT_REFRESHED "?")), 0);
+  o_free(redirect_to);
+  
+  openid_configuration_version = 0;
+  ck_assert_int_eq(ulfius_stop_framework(&instance), U_OK);
+  ulfius_clean_instance(&instance);
+}
+END_TEST
+
 START_TEST(test_glwd_scheme_oauth2_irl_register_oauth2_code_ok_collision)
 {
   struct _u_instance instance;
@@ -4391,6 +4525,11 @@ static Suite *glewlwyd_suite(void)
   tcase_add_test(tc_core, test_glwd_scheme_oauth2_irl_register_delete);
   tcase_add_test(tc_core, test_glwd_scheme_oauth2_scope_unset);
   tcase_add_test(tc_core, test_glwd_scheme_oauth2_irl_module_remove);
+  tcase_add_test(tc_core, test_glwd_scheme_oauth2_irl_module_add_provider_oidc_code_refresh);
+  tcase_add_test(tc_core, test_glwd_scheme_oauth2_scope_set);
+  tcase_add_test(tc_core, test_glwd_scheme_oauth2_irl_register_oidc_provider_config_refresh);
+  tcase_add_test(tc_core, test_glwd_scheme_oauth2_scope_unset);
+  tcase_add_test(tc_core, test_glwd_scheme_oauth2_irl_module_remove);
   tcase_add_test(tc_core, test_glwd_scheme_oauth2_irl_module_add_provider_oauth2_code);
   tcase_add_test(tc_core, test_glwd_scheme_oauth2_irl_module_add_provider_oauth2_code_collision);
   tcase_add_test(tc_core, test_glwd_scheme_oauth2_scope_collision_set);
@@ -10,6 +10,7 @@ let defaultParam = {
   "jwt-key-size":"256",
   "jwks-uri":"",
   "jwks-private":"",
+  "jwks-rotation-interval":0,
   "default-kid":"",
   "client-sign_kid-parameter":"",
   "jwks-public":"",
@@ -37,6 +38,7 @@ let defaultParam = {
   "service-documentation":"https://github.com/babelouest/glewlwyd/tree/master/docs",
   "op-policy-uri":"",
   "op-tos-uri":"",
+  "metadata-max-age":0,
   "jwks-show":true,
   "jwks-x5c":[],
   "request-parameter-allow":true,
@@ -89,6 +91,8 @@ let defaultParam = {
   "client-encrypt_introspection-parameter":"encrypt_introspection",
   "device-authorization-expiration":600,
   "device-authorization-interval":5,
+  "token-long-poll-duration":0,
+  "token-long-poll-max-requests":64,
   "client-cert-header-name":"SSL_CLIENT_CERT",
   "client-cert-use-endpoint-aliases":false,
   "client-cert-self-signed-allowed":false,
@@ -2116,6 +2120,14 @@ class GlwdOIDCParams extends Component {
                   </div>
                   {this.state.errorList["jwks-private"]?<span className="error-input">{this.state.errorList["jwks-private"]}</span>:""}
                 </div>
+                <div className="form-group">
+                  <div className="input-group mb-3">
+                    <div className="input-group-prepend">
+                      <label className="input-group-text" htmlFor="mod-glwd-jwks-rotation-interval">{i18next.t("admin.mod-glwd-jwks-rotation-interval")}</label>
+                    </div>
+                    <input type="number" min="0" step="1" className="form-control" id="mod-glwd-jwks-rotation-interval" onChange={(e) => this.changeNumberParam(e, "jwks-rotation-interval")} value={this.state.mod.parameters["jwks-rotation-interval"]} placeholder={i18next.t("admin.mod-glwd-jwks-rotation-interval-ph")} />
+                  </div>
+                </div>
                 <div className="form-group">
                   <div className="input-group mb-3">
                     <div className="input-group-prepend">
@@ -2380,6 +2392,14 @@ class GlwdOIDCParams extends Component {
                     <input type="text" className="form-control" id="mod-glwd-op-tos-uri" onChange={(e) => this.changeParam(e, "op-tos-uri")} value={this.state.mod.parameters["op-tos-uri"]} placeholder={i18next.t("admin.mod-glwd-op-tos-uri-ph")} />
                   </div>
                 </div>
+                <div className="form-group">
+                  <div className="input-group mb-3">
+                    <div className="input-group-prepend">
+                      <label className="input-group-text" htmlFor="mod-glwd-metadata-max-age">{i18next.t("admin.mod-glwd-metadata-max-age")}</label>
+                    </div>
+                    <input type="number" min="0" step="1" className="form-control" id="mod-glwd-metadata-max-age" onChange={(e) => this.changeNumberParam(e, "metadata-max-age")} value={this.state.mod.parameters["metadata-max-age"]} placeholder={i18next.t("admin.mod-glwd-metadata-max-age-ph")} />
+                  </div>
+                </div>
                 <hr/>
                 <div className="form-group">
                   <div className="input-group mb-3">
@@ -3023,6 +3043,22 @@ class GlwdOIDCParams extends Component {
                     <input type="number" min="1" step="1" className="form-control" id="mod-glwd-device-authorization-interval" onChange={(e) => this.changeNumberParam(e, "device-authorization-interval")} value={this.state.mod.parameters["device-authorization-interval"]} placeholder={i18next.t("admin.mod-glwd-device-authorization-interval-ph")} disabled={!this.state.mod.parameters["auth-type-device-enabled"]} />
                   </div>
                 </div>
+                <div className="form-group">
+                  <div className="input-group mb-3">
+                    <div className="input-group-prepend">
+                      <label className="input-group-text" htmlFor="mod-glwd-token-long-poll-duration">{i18next.t("admin.mod-glwd-token-long-poll-duration")}</label>
+                    </div>
+                    <input type="number" min="0" max="10" step="1" className="form-control" id="mod-glwd-token-long-poll-duration" onChange={(e) => this.changeNumberParam(e, "token-long-poll-duration")} value={this.state.mod.parameters["token-long-poll-duration"]} placeholder={i18next.t("admin.mod-glwd-token-long-poll-duration-ph")} />
+                  </div>
+                </div>
+                <div className="form-group">
+                  <div className="input-group mb-3">
+                    <div className="input-group-prepend">
+                      <label className="input-group-text" htmlFor="mod-glwd-token-long-poll-max-requests">{i18next.t("admin.mod-glwd-token-long-poll-max-requests")}</label>
+                    </div>
+                    <input type="number" min="1" step="1" className="form-control" id="mod-glwd-token-long-poll-max-requests" onChange={(e) => this.changeNumberParam(e, "token-long-poll-max-requests")} value={this.state.mod.parameters["token-long-poll-max-requests"]} placeholder={i18next.t("admin.mod-glwd-token-long-poll-max-requests-ph")} disabled={!this.state.mod.parameters["token-long-poll-duration"]} />
+                  </div>
+                </div>
               </div>
             </div>
           </div>
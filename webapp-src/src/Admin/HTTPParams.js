@@ -39,9 +39,13 @@ class HTTPParams extends Component {
     });
   }
   
-  changeParam(e, param) {
+  changeParam(e, param, number) {
     var mod = this.state.mod;
-    mod.parameters[param] = e.target.value;
+    if (number) {
+      mod.parameters[param] = parseInt(e.target.value);
+    } else {
+      mod.parameters[param] = e.target.value;
+    }
     this.setState({mod: mod});
   }
   
@@ -81,6 +85,14 @@ class HTTPParams extends Component {
       hasError = true;
       errorList["username-format"] = i18next.t("admin.mod-http-username-format-error")
     }
+    if (this.state.mod.parameters["credential-cache-duration"] !== undefined && (isNaN(this.state.mod.parameters["credential-cache-duration"]) || this.state.mod.parameters["credential-cache-duration"] < 0)) {
+      hasError = true;
+      errorList["credential-cache-duration"] = i18next.t("admin.mod-http-credential-cache-duration-error")
+    }
+    if (this.state.mod.parameters["credential-cache-max-size"] !== undefined && (isNaN(this.state.mod.parameters["credential-cache-max-size"]) || this.state.mod.parameters["credential-cache-max-size"] <= 0)) {
+      hasError = true;
+      errorList["credential-cache-max-size"] = i18next.t("admin.mod-http-credential-cache-max-size-error")
+    }
     if (!hasError) {
       this.setState({errorList: {}}, () => {
         messageDispatcher.sendMessage('ModEdit', {type: "modValid"});
@@ -156,6 +168,24 @@ class HTTPParams extends Component {
           </div>
           {this.state.errorList["username-format"]?<span className="error-input">{this.state.errorList["username-format"]}</span>:""}
         </div>
+        <div className="form-group">
+          <div className="input-group mb-3">
+            <div className="input-group-prepend">
+              <label className="input-group-text" htmlFor="mod-http-credential-cache-duration">{i18next.t("admin.mod-http-credential-cache-duration")}</label>
+            </div>
+            <input type="number" min="0" step="1" className={this.state.errorList["credential-cache-duration"]?"form-control is-invalid":"form-control"} id="mod-http-credential-cache-duration" onChange={(e) => this.changeParam(e, "credential-cache-duration", 1)} value={this.state.mod.parameters["credential-cache-duration"]||0} placeholder={i18next.t("admin.mod-http-credential-cache-duration-ph")} />
+          </div>
+          {this.state.errorList["credential-cache-duration"]?<span className="error-input">{this.state.errorList["credential-cache-duration"]}</span>:""}
+        </div>
+        <div className="form-group">
+          <div className="input-group mb-3">
+            <div className="input-group-prepend">
+              <label className="input-group-text" htmlFor="mod-http-credential-cache-max-size">{i18next.t("admin.mod-http-credential-cache-max-size")}</label>
+            </div>
+            <input type="number" min="1" step="1" className={this.state.errorList["credential-cache-max-size"]?"form-control is-invalid":"form-control"} id="mod-http-credential-cache-max-size" onChange={(e) => this.changeParam(e, "credential-cache-max-size", 1)} value={this.state.mod.parameters["credential-cache-max-size"]||1024} placeholder={i18next.t("admin.mod-http-credential-cache-max-size-ph")} disabled={!this.state.mod.parameters["credential-cache-duration"]} />
+          </div>
+          {this.state.errorList["credential-cache-max-size"]?<span className="error-input">{this.state.errorList["credential-cache-max-size"]}</span>:""}
+        </div>
       </div>
     );
   }